@@ -0,0 +1,153 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+// Microbenchmarks of the occupation charts, the space divisions and the insertion schedules
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "gen/occupationchart.h"
+#include "gen/spacemultidiv.h"
+#include "opt/insertionschedule.h"
+#include "range.h"
+#include "spacedivision.h"
+
+using namespace Ladybirds;
+using gen::Range;
+using gen::Space;
+
+namespace {
+
+/// Places \p n blocks in a memory chart like the scheduler does (cf. opt::Schedule): each at the earliest time after
+/// a random release at which its size fits for its duration. Returns the end of the last block.
+template<typename chart_t>
+long FillChart(chart_t & chart, int n, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    long release = 0, end = 0;
+    for(int i = 0; i < n; ++i)
+    {
+        release += rng() % 20;
+        long duration = 10 + rng() % 200, size = 1 + rng() % (chart.GetCapacity()/8);
+        long start = chart.Available(release, duration, size);
+        chart.Occupy(start, start + duration, size);
+        end = std::max(end, start + duration);
+    }
+    return end;
+}
+
+template<typename impl_t>
+void BM_OccupationChart_Fill(benchmark::State & state)
+{
+    for(auto _ : state)
+    {
+        gen::OccupationChart<long, impl_t> chart(1 << 20);
+        benchmark::DoNotOptimize(FillChart(chart, state.range(0), 1));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_OccupationChart_Fill, gen::MapChart)->RangeMultiplier(10)->Range(1000, 100000)
+                                                          ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_OccupationChart_Fill, gen::SegmentTreeChart)->RangeMultiplier(10)->Range(1000, 1000000)
+                                                                  ->Unit(benchmark::kMillisecond);
+
+template<typename impl_t>
+void BM_OccupationChart_Query(benchmark::State & state)
+{
+    gen::OccupationChart<long, impl_t> chart(1 << 20);
+    long end = FillChart(chart, state.range(0), 2);
+    std::mt19937 rng(3);
+    for(auto _ : state)
+    {
+        long from = rng() % end, to = from + 1 + rng() % 1000;
+        benchmark::DoNotOptimize(chart.LeastAvail(from, to));
+        benchmark::DoNotOptimize(chart.AvailableSince(to, 1 << 16));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_OccupationChart_Query, gen::MapChart)->RangeMultiplier(10)->Range(1000, 100000);
+BENCHMARK_TEMPLATE(BM_OccupationChart_Query, gen::SegmentTreeChart)->RangeMultiplier(10)->Range(1000, 1000000);
+
+
+/// Returns a random block of a 2D buffer of \p extent x \p extent elements, like the (overlapping) ranges accessed by
+/// the tasks of a stencil or a blocked matrix product: a tile of 16 to 64 elements per side, extended by a halo
+Space RandomBlock(std::mt19937 & rng, int extent)
+{
+    Space s;
+    for(int dim = 0; dim < 2; ++dim)
+    {
+        int size = 16 + rng() % 49, begin = rng() % (extent - size), halo = rng() % 4;
+        s.push_back(Range::BeginEnd(std::max(begin - halo, 0), std::min(begin + size + halo, extent)));
+    }
+    return s;
+}
+
+void BM_SpaceDivision_Assign(benchmark::State & state)
+{
+    int extent = 4096;
+    for(auto _ : state)
+    {
+        gen::SpaceDivision<int> div(Space({extent, extent}));
+        std::mt19937 rng(4);
+        for(int i = 0; i < state.range(0); ++i) div.AssignSection(RandomBlock(rng, extent), i);
+        benchmark::DoNotOptimize(div.GetSectionCount());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SpaceDivision_Assign)->RangeMultiplier(10)->Range(1000, 10000)->Unit(benchmark::kMillisecond);
+
+void BM_SpaceDivision_FindOverlaps(benchmark::State & state)
+{
+    int extent = 4096;
+    gen::SpaceDivision<int> div(Space({extent, extent}));
+    std::mt19937 rng(5);
+    for(int i = 0; i < state.range(0); ++i) div.AssignSection(RandomBlock(rng, extent), i);
+    for(auto _ : state) benchmark::DoNotOptimize(div.FindOverlaps(RandomBlock(rng, extent)));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SpaceDivision_FindOverlaps)->RangeMultiplier(10)->Range(1000, 100000);
+
+void BM_SpaceMultiDiv_Assign(benchmark::State & state)
+{
+    int extent = 1024;
+    for(auto _ : state)
+    {
+        gen::SpaceMultiDiv<int> div(Space({extent, extent}));
+        std::mt19937 rng(6);
+        for(int i = 0; i < state.range(0); ++i) div.AssignSection(RandomBlock(rng, extent), i % 64);
+        benchmark::DoNotOptimize(div.GetSectionCount());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SpaceMultiDiv_Assign)->Arg(1000)->Arg(3000)->Unit(benchmark::kMillisecond);
+
+
+/// Inserts \p n jobs with random arrivals and deadlines, as the memory transfer scheduling does, keeping the resource
+/// busy about 60% of the time
+template<typename sched_t>
+void BM_InsertionSchedule(benchmark::State & state)
+{
+    for(auto _ : state)
+    {
+        sched_t sched;
+        std::mt19937 rng(7);
+        opt::Time arrival = 0;
+        for(int i = 0; i < state.range(0); ++i)
+        {
+            arrival += rng() % 16;
+            opt::Time duration = 1 + rng() % 8, deadline = arrival + duration + rng() % 256;
+            sched.PerformInsertion(sched.TryInsertion(arrival, deadline, duration));
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_InsertionSchedule, opt::InsertionSchedule)->RangeMultiplier(10)->Range(1000, 100000)
+                                                                ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_InsertionSchedule, opt::IndexedInsertionSchedule)->RangeMultiplier(10)->Range(1000, 1000000)
+                                                                       ->Unit(benchmark::kMillisecond);
+
+} //namespace ::
+
+BENCHMARK_MAIN();
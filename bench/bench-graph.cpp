@@ -0,0 +1,313 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+// Microbenchmarks of the graph containers (PresDeque, ItemSet, ItemMap) and of the algorithms in graph-extra.h
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "graph/graph-extra.h"
+#include "graph/graph.h"
+#include "graph/itemmap.h"
+#include "graph/itemset.h"
+#include "graph/presdeque.h"
+
+using namespace Ladybirds::graph;
+
+namespace {
+
+struct Item : public PresDequeElementBase
+{
+    long Value;
+    Item(long value) : Value(value) {}
+};
+
+/// Fills \p list with \p n items and, if \p gaps, removes every third of them, like passes that delete tasks do
+void FillList(PresDeque<Item> & list, long n, bool gaps)
+{
+    std::vector<Item*> items;
+    items.reserve(n);
+    for(long i = 0; i < n; ++i) items.push_back(&*list.emplace(i));
+    if(gaps) for(long i = 0; i < n; i += 3) list.erase(items[i]);
+}
+
+void BM_PresDeque_Emplace(benchmark::State & state)
+{
+    for(auto _ : state)
+    {
+        PresDeque<Item> list;
+        for(long i = 0; i < state.range(0); ++i) benchmark::DoNotOptimize(&*list.emplace(i));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PresDeque_Emplace)->RangeMultiplier(10)->Range(1000, 1000000);
+
+void BM_PresDeque_EraseEmplace(benchmark::State & state)
+{
+    // removed slots are reused by the next insertions
+    PresDeque<Item> list;
+    FillList(list, state.range(0), false);
+    std::vector<Item*> items;
+    for(auto & item : list) items.push_back(&item);
+    std::mt19937 rng(1);
+    for(auto _ : state)
+    {
+        auto & pitem = items[rng() % items.size()];
+        long value = pitem->Value;
+        list.erase(pitem);
+        pitem = &*list.emplace(value);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PresDeque_EraseEmplace)->RangeMultiplier(10)->Range(1000, 1000000);
+
+void BM_PresDeque_Iterate(benchmark::State & state)
+{
+    PresDeque<Item> list;
+    FillList(list, state.range(0), state.range(1));
+    for(auto _ : state)
+    {
+        long sum = 0;
+        for(auto & item : list) sum += item.Value;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * list.size());
+}
+BENCHMARK(BM_PresDeque_Iterate)->ArgsProduct({{1000, 100000, 1000000}, {0, 1}})->ArgNames({"n", "gaps"});
+
+void BM_PresDeque_FromID(benchmark::State & state)
+{
+    PresDeque<Item> list;
+    FillList(list, state.range(0), true);
+    std::mt19937 rng(2);
+    auto minid = list.GetMinID(), span = list.GetMaxID() - minid + 1;
+    for(auto _ : state) benchmark::DoNotOptimize(list.TryFromID(minid + rng() % span));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PresDeque_FromID)->RangeMultiplier(10)->Range(1000, 1000000);
+
+
+/// Set patterns of the ItemSet benchmarks: a few scattered items (e.g. the successors of a task), half of the items
+/// at random, and long runs of consecutive items (e.g. the tasks of a group or a reachability row)
+enum Pattern { Sparse, Dense, Runs };
+
+ItemSet MakeSet(const PresDeque<Item> & list, Pattern pattern, unsigned seed)
+{
+    ItemSet set = list.GetSubset();
+    std::mt19937 rng(seed);
+    long n = list.size(), start = 0;
+    for(auto & item : list)
+    {
+        long i = item.GetID() - list.GetMinID();
+        switch(pattern)
+        {
+            case Sparse: if(rng() % 100 == 0) set.Insert(item); break;
+            case Dense:  if(rng() % 2) set.Insert(item); break;
+            case Runs:
+                if(i == start) start += n/64 + rng() % (n/16 + 1);
+                if((start / (n/32 + 1)) % 2) set.Insert(item);
+                break;
+        }
+    }
+    return set;
+}
+
+void BM_ItemSet_Insert(benchmark::State & state)
+{
+    PresDeque<Item> list;
+    FillList(list, state.range(0), false);
+    std::vector<const Item*> order;
+    for(auto & item : list) order.push_back(&item);
+    std::shuffle(order.begin(), order.end(), std::mt19937(3));
+    order.resize(order.size()/4);
+    for(auto _ : state)
+    {
+        ItemSet set = list.GetSubset();
+        for(auto pitem : order) set.Insert(pitem);
+        benchmark::DoNotOptimize(set.ElementCount());
+    }
+    state.SetItemsProcessed(state.iterations() * order.size());
+}
+BENCHMARK(BM_ItemSet_Insert)->RangeMultiplier(10)->Range(1000, 1000000);
+
+void BM_ItemSet_Contains(benchmark::State & state)
+{
+    PresDeque<Item> list;
+    FillList(list, state.range(0), false);
+    ItemSet set = MakeSet(list, Pattern(state.range(1)), 4);
+    std::vector<const Item*> items;
+    for(auto & item : list) items.push_back(&item);
+    std::mt19937 rng(5);
+    for(auto _ : state) benchmark::DoNotOptimize(set.Contains(items[rng() % items.size()]));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ItemSet_Contains)->ArgsProduct({{1000, 100000, 1000000}, {Sparse, Dense, Runs}})
+                              ->ArgNames({"n", "pattern"});
+
+void BM_ItemSet_Union(benchmark::State & state)
+{
+    PresDeque<Item> list;
+    FillList(list, state.range(0), false);
+    ItemSet a = MakeSet(list, Pattern(state.range(1)), 6), b = MakeSet(list, Pattern(state.range(1)), 7);
+    for(auto _ : state)
+    {
+        ItemSet c = a;
+        c |= b;
+        benchmark::DoNotOptimize(c.ElementCount());
+    }
+    state.SetItemsProcessed(state.iterations() * list.size());
+}
+BENCHMARK(BM_ItemSet_Union)->ArgsProduct({{1000, 100000, 1000000}, {Sparse, Dense, Runs}})
+                           ->ArgNames({"n", "pattern"});
+
+void BM_ItemSet_Intersection(benchmark::State & state)
+{
+    PresDeque<Item> list;
+    FillList(list, state.range(0), false);
+    ItemSet a = MakeSet(list, Pattern(state.range(1)), 8), b = MakeSet(list, Pattern(state.range(1)), 9);
+    for(auto _ : state)
+    {
+        ItemSet c = a;
+        c &= b;
+        benchmark::DoNotOptimize(c.ElementCount());
+        benchmark::DoNotOptimize(a.Intersects(b));
+    }
+    state.SetItemsProcessed(state.iterations() * list.size());
+}
+BENCHMARK(BM_ItemSet_Intersection)->ArgsProduct({{1000, 100000, 1000000}, {Sparse, Dense, Runs}})
+                                  ->ArgNames({"n", "pattern"});
+
+void BM_ItemSet_IterateIDs(benchmark::State & state)
+{
+    PresDeque<Item> list;
+    FillList(list, state.range(0), false);
+    ItemSet set = MakeSet(list, Pattern(state.range(1)), 10);
+    for(auto _ : state)
+    {
+        long sum = 0;
+        for(auto id : set.IDs()) sum += id;
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * set.ElementCount());
+}
+BENCHMARK(BM_ItemSet_IterateIDs)->ArgsProduct({{1000, 100000, 1000000}, {Sparse, Dense, Runs}})
+                                ->ArgNames({"n", "pattern"});
+
+void BM_ItemMap_Access(benchmark::State & state)
+{
+    PresDeque<Item> list;
+    FillList(list, state.range(0), true);
+    ItemMap<long> map(list, 0);
+    for(auto _ : state)
+    {
+        for(auto & item : list) map[item] += item.Value;
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * list.size());
+}
+BENCHMARK(BM_ItemMap_Access)->RangeMultiplier(10)->Range(1000, 1000000);
+
+
+class BenchEdge;
+class BenchNode : public Node<Graph<BenchNode>, BenchEdge> {};
+class BenchEdge : public Edge<BenchNode> {};
+using BenchGraph = Graph<BenchNode>;
+
+/// Builds a task graph like those of the programs: \p n nodes in levels of width \p width, each with up to four
+/// edges from the previous levels, mostly the directly preceding one (cf. examples/synthetic). With \p cycles, some
+/// edges point backwards.
+void MakeGraph(BenchGraph & g, int n, int width, bool cycles = false)
+{
+    std::vector<BenchNode*> nodes;
+    for(int i = 0; i < n; ++i) nodes.push_back(g.EmplaceNode());
+    std::mt19937 rng(11);
+    for(int i = width; i < n; ++i)
+    {
+        int level = i / width, preds = 1 + rng() % 4;
+        for(int j = 0; j < preds; ++j)
+        {
+            int back = rng() % 8 == 0 ? 1 + rng() % std::min(level, 4) : 1;
+            int src = (level - back)*width + rng() % width;
+            if(cycles && rng() % 32 == 0) g.EmplaceEdge(nodes[i], nodes[src]);
+            else g.EmplaceEdge(nodes[src], nodes[i]);
+        }
+    }
+}
+
+void BM_Graph_TopologicalOrder(benchmark::State & state)
+{
+    BenchGraph g;
+    MakeGraph(g, state.range(0), 64);
+    std::vector<const BenchNode*> order;
+    for(auto _ : state)
+    {
+        order.clear();
+        benchmark::DoNotOptimize(TopologicalOrder(g, order));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Graph_TopologicalOrder)->RangeMultiplier(10)->Range(1000, 1000000);
+
+void BM_Graph_ParallelLevelOrder(benchmark::State & state)
+{
+    BenchGraph g;
+    MakeGraph(g, state.range(0), 64);
+    auto csr = g.Freeze();
+    std::vector<decltype(csr)::Index> order;
+    for(auto _ : state)
+    {
+        order.clear();
+        benchmark::DoNotOptimize(ParallelLevelOrder(csr, order, nullptr, state.range(1)));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Graph_ParallelLevelOrder)->ArgNames({"n", "threads"})->ArgsProduct({{100000, 1000000}, {1, 2, 4, 8}})
+                                      ->UseRealTime();
+
+void BM_Graph_ReachabilityMatrix(benchmark::State & state)
+{
+    BenchGraph g;
+    MakeGraph(g, state.range(0), 64, state.range(1));
+    for(auto _ : state) benchmark::DoNotOptimize(ReachabilityMatrix(g));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+// with cycles, the closure falls back to Floyd-Warshall, which takes minutes on 10000 nodes
+BENCHMARK(BM_Graph_ReachabilityMatrix)->ArgNames({"n", "cycles"})->Args({1000, 0})->Args({3000, 0})->Args({10000, 0})
+                                      ->Args({1000, 1})->Args({3000, 1})->Unit(benchmark::kMillisecond);
+
+void BM_Graph_PruneEdges(benchmark::State & state)
+{
+    for(auto _ : state)
+    {
+        state.PauseTiming();
+        BenchGraph g;
+        MakeGraph(g, state.range(0), 64);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(PruneEdges(g));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Graph_PruneEdges)->Arg(1000)->Arg(3000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+void BM_Graph_StronglyConnected(benchmark::State & state)
+{
+    BenchGraph g;
+    MakeGraph(g, state.range(0), 64, true);
+    for(auto _ : state) benchmark::DoNotOptimize(StronglyConnected(g));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Graph_StronglyConnected)->RangeMultiplier(10)->Range(1000, 100000);
+
+void BM_Graph_ParallelStronglyConnected(benchmark::State & state)
+{
+    BenchGraph g;
+    MakeGraph(g, state.range(0), 64, true);
+    for(auto _ : state) benchmark::DoNotOptimize(ParallelStronglyConnected(g, nullptr, state.range(1)));
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Graph_ParallelStronglyConnected)->ArgNames({"n", "threads"})->ArgsProduct({{100000, 1000000}, {1, 4, 8}})
+                                             ->UseRealTime();
+
+} //namespace ::
@@ -0,0 +1,8 @@
+-- The same mapping as mapping.lua, given by rules instead of one entry per task (cf. pass LoadMapping)
+local groups = {"a", "b", "c", "d", "e", "f", "g", "h", "i", "j", "k", "l", "m", "n", "o", "p"};
+
+rules = {
+    {pattern = "Barrier[*]", group = "i"},
+    {pattern = "GenMatrices[*]", groups = groups},
+    {pattern = "MatrixMultiplication[*]", range = {0, 15}, groups = groups},
+}
@@ -1,14 +1,35 @@
 -- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
 init();
-
-lfs.mkdir('gencode');
-lfs.mkdir('gencode/DAL');
-lfs.mkdir('gencode/DAL/app1');
-lfs.mkdir('gencode/DAL/app1/src');
-
+tools.mkpath('gencode/DAL/app1/src');
 outdir=tools.realpath('gencode/DAL')..'/';
+local lbbase = tools.basename(args.lbfile)
+
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources, output=outdir..'app1/src/'..lbbase..'.c'};
+assert(prog, nil);
+
+local result = Ladybirds.TaskTopoSort{prog} and
+        Ladybirds.CalcSuccessorMatrix{prog} and
+        (not args.mapping or Ladybirds.LoadMapping{prog, filename=args.mapping}) and
+        (not args.costs and Ladybirds.EstimateCosts{prog} or args.costs and Ladybirds.LoadCost{prog, filename=args.costs}) and
+        (args.mapping or args.groups == 0 or Ladybirds.AutoGroup{prog, groups=args.groups}) and
+        (not args.projinfo or Ladybirds.LoadProjectInfo{prog, filename=args.projinfo}) and
+        Ladybirds.PopulateGroups{prog} and
+        Ladybirds.BufferPreallocation{prog} and
+        Ladybirds.BufferAllocation{prog} and
+        true or error()
+
+-- FIFO capacities (in tokens) that sustain the throughput of unbounded FIFOs for this mapping
+local fifos = Ladybirds.FifoSizes{prog} or error();
+vprintf("FIFOs: %d tokens, iteration period %g\n", fifos.tokens, fifos.sizedperiod);
+
+local x = Ladybirds.Export{prog};
+
+if #x.divisions ~= 1 then
+    error("Program has "..#x.divisions.." divisions, but only one is supported.");
+end
 
+local div = x.divisions[1]
 
 
 local distribute = function(n)
@@ -21,29 +42,20 @@ end;
 
 
 -- data type checks
-basetypesizes={}
-for _,kernel in pairs(kernels) do
+local basetypesizes={}
+for _,kernel in pairs(x.kernels) do
     for _,packet in ipairs(kernel.packets) do
         basetypesizes[packet.basetype] = packet.basetypesize
     end
 end
 
 -- give buffers names
-for i, buffer in ipairs(buffers) do
+for i, buffer in ipairs(div.buffers) do
     buffer.name = "_buffer_"..i;
 end
 
-local listbuffers = function(ports)
-    local ret = "";
-    for i,port in ipairs(ports) do
-        if i > 1 then ret = ret..", "; end;
-        ret = ret..port.iface.buffer.name;
-    end
-    return ret;
-end
-
 -- give groups names
-for i,group in ipairs(groups) do
+for i,group in ipairs(x.groups) do
     local inctr, outctr = 0, 0
     group.name = "_Process"..i;
     group.inputs = {};
@@ -67,26 +79,29 @@ for i,group in ipairs(groups) do
     end
 end
 
-for i,channel in ipairs(channels) do
+-- a token is the dummy pointer the processes pass per port (cf. process.c), the data stay in the shared buffers
+for i,channel in ipairs(x.channels) do
     channel.name = "Channel"..i;
+    channel.tokens = fifos.capacities[i];
+    channel.fifosize = channel.tokens*8;
 end
 
 local bindings = {}
-for i,group in ipairs(groups) do
+for i,group in ipairs(x.groups) do
     bindings[i] = {group = group.name, target = "core_"..distribute(i-1)};
 end
 
 
 --sort groups, first by number of members, then by name of first member
-table.sort(groups, function(grp1, grp2) 
-                       if #grp1 ~= #grp2 then return #grp1 > #grp2;
+table.sort(x.groups, function(grp1, grp2)
+                       if #grp1.operations ~= #grp2.operations then return #grp1.operations > #grp2.operations;
                        else return grp1.operations[1].task.name < grp2.operations[1].task.name; end
                    end);
 
 --create view model
-model = { appname=appname, ofiles=ofiles, definitions=definitions, typeckecks=map2array(basetypesizes), 
-    kernels=marklast(kernels, "packets"), buffers=buffers, tasks=tasks, channels=channels, groups=groups,
-    bindings=bindings, auxfiles=auxfiles};
+model = { appname=appname, definitions=x.definitions, typeckecks=map2array(basetypesizes),
+    kernels=marklast(x.kernels, "packets"), buffers=div.buffers, tasks=x.tasks, channels=x.channels, groups=x.groups,
+    bindings=bindings, auxfiles=x.auxfiles};
 
 render("configure", model);
 render("fsm.xml", model)
@@ -98,31 +113,14 @@ render("app1/src/buffers.h", model)
 render("app1/src/experiment.h", model)
 render("app1/src/experiment.cpp", model)
 
-process_h_template = fastache.parse(resdir.."app1/src/process.h.mustache")
-process_c_template = fastache.parse(resdir.."app1/src/process.c.mustache")
-
 outdir = outdir.."app1/src/";
-groups[1].buffershere = true;
-for _,group in ipairs(groups) do
-    local fn = outdir..group.name..".h";
-    printf("writing %s\n", fn);
-    process_h_template:render(fn, group)
-    fn = outdir..group.name..".c";
-    printf("writing %s\n", fn);
-    process_c_template:render(fn, group)
+x.groups[1].buffershere = true;
+local jobs = {};
+for _,group in ipairs(x.groups) do
+    jobs[#jobs+1] = {template=resdir.."app1/src/process.h.mustache", model=group, output=outdir..group.name..".h"};
+    jobs[#jobs+1] = {template=resdir.."app1/src/process.c.mustache", model=group, output=outdir..group.name..".c"};
 end
+renderall(jobs);
 
-for _,file in ipairs(codefiles) do copy(file); end;
-for _,file in ipairs(auxfiles) do copy(file); end;
-
--- Collect all required C files
-cfiles={}
-for _,task in ipairs(tasks) do
-    cfiles[task.kernel.codefile] = true;
-end
-
--- Copy all required C files and create a list of object files
-ofiles = {}
-for cfile in pairs(cfiles) do
-    copy(cfile);
-end
+for _,file in ipairs(x.codefiles) do copy(file); end;
+for _,file in ipairs(x.auxfiles) do copy(file); end;
@@ -0,0 +1,157 @@
+-- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+-- Autotuner of the code generation knobs of the pthreads-dynamic backend: generates the program for random settings
+-- of the knobs below, builds each with its Makefile and measures it with make bench (cf. experiment.h), and narrows
+-- them down by successive halving: every round, the faster half is measured again with twice the repetitions, until
+-- one is left. Knobs given on the command line are not tuned. The winner is written as the table tuned into the
+-- project info file of the program (cf. projinfofile), from where later runs of pthreads-dynamic take it (cf.
+-- applytuned), and the program is generated once more with it. The measurements go to gencode/autotune/results.csv.
+-- The environment variables LB_TUNE_CONFIGS (number of settings, default 16), LB_TUNE_REPEAT (repetitions in the
+-- first round, default 3), LB_TUNE_KNOBS (the knobs to tune, default all) and LB_TUNE_SEED select what is run.
+
+init();
+tools.mkpath('gencode/autotune');
+local tunedir = tools.realpath('gencode/autotune')..'/';
+local backend = resdir.."../pthreads-dynamic/main.lua";
+local infofile = projinfofile();
+
+local words = function(s)
+    local list = {};
+    for w in s:gmatch("[^%s,]+") do list[#list+1] = w; end
+    return list;
+end
+
+local hwthreads = 1;
+local nproc = io.popen("nproc 2>/dev/null");
+if nproc then hwthreads = tonumber(nproc:read("*l") or "") or 1; nproc:close(); end
+local groups = {};
+for n = 1, hwthreads do
+    if n & (n-1) == 0 or n == hwthreads then groups[#groups+1] = n; end
+end
+
+-- the knobs and their values, the default first
+local knobs = {
+    {"groups", groups},                         -- number of threads (without a mapping)
+    {"simdwidth", {0, 128, 256, 512}},          -- bits of the task bitfields checked at once
+    {"coarsen", {0, 1000, 10000, 100000}},      -- cost up to which instances of a kernel run as one task
+    {"prefetch", {0, 4, 16}},                   -- cache lines of the next inputs to prefetch
+    {"numa", {false, true}},                    -- binding of the buffers to the nodes of their groups
+    {"futex", {false, true}},                   -- events on futexes instead of condition variables
+    {"depcounters", {false, true}},             -- atomic dependency counters instead of bitfields
+    {"staticorder", {false, true}},
+    {"fuse", {false, true}},
+};
+local selected = {};
+for _,name in ipairs(words(os.getenv("LB_TUNE_KNOBS") or "")) do selected[name] = true; end
+local tuned = {};
+for _,knob in ipairs(knobs) do
+    local name = knob[1];
+    local given = args[name] and args[name] ~= 0 or name == "groups" and args.mapping;
+    if not given and (next(selected) == nil or selected[name]) then tuned[#tuned+1] = knob; end
+end
+if #tuned == 0 then error("No knobs to tune"); end
+
+-- random settings, the defaults first
+math.randomseed(tonumber(os.getenv("LB_TUNE_SEED") or "") or 1);
+local nconfigs = tonumber(os.getenv("LB_TUNE_CONFIGS") or "") or 16;
+local configs, seen = {}, {};
+for attempt = 1, 100*nconfigs do
+    if #configs >= nconfigs then break; end
+    local config, key = {}, {};
+    for _,knob in ipairs(tuned) do
+        local values = knob[2];
+        local value = #configs == 0 and values[1] or values[math.random(#values)];
+        config[knob[1]] = value;
+        key[#key+1] = tostring(value);
+    end
+    key = table.concat(key, ",");
+    if not seen[key] then
+        seen[key] = true;
+        config.key = key;
+        configs[#configs+1] = config;
+    end
+end
+
+local names = {};
+for _,knob in ipairs(tuned) do names[#names+1] = knob[1]; end
+local results = io.open(tunedir.."results.csv", "w");
+results:write("round,repeat,"..table.concat(names, ",")..",median\n");
+
+-- generates the program with config (or the defaults if nil) by running pthreads-dynamic, quietly unless -v
+local saved = {};
+for _,name in ipairs(names) do saved[name] = args[name]; end
+local generate = function(config)
+    for _,name in ipairs(names) do args[name] = config and config[name] or saved[name]; end
+    local print = printf;
+    if not args.verbose then printf = function() end; end
+    autotuning, pgoiteration, pgotrace = config ~= nil, nil, nil;
+    local ok, err = pcall(dofile, backend);
+    autotuning = nil;
+    printf = print;
+    return ok, err;
+end
+
+-- median run time of config in µs with repeat runs (infinite if it does not build or run)
+local measure = function(config, repeats)
+    local ok, err = generate(config);
+    if not ok then
+        printf("  %s: generating failed: %s\n", config.key, tostring(err));
+        return math.huge;
+    end
+    if not os.execute("make -C '"..outdir.."' >/dev/null 2>&1") then
+        printf("  %s: building failed\n", config.key);
+        return math.huge;
+    end
+    local bench = io.popen("make -s -C '"..outdir.."' bench WARMUP=1 REPEAT="..repeats.." 2>/dev/null");
+    local output = bench:read("*a");
+    bench:close();
+    local median = tonumber(output:match("median ([%d%.]+)") or output:match("finished%. ([%d%.]+)") or "");
+    if not median then printf("  %s: running failed\n", config.key); end
+    return median or math.huge;
+end
+
+local alive, repeats, round = configs, tonumber(os.getenv("LB_TUNE_REPEAT") or "") or 3, 1;
+printf("Autotuning %s over %d settings\n", table.concat(names, ", "), #configs);
+while true do
+    printf("Round %d: %d settings, %d runs each\n", round, #alive, repeats);
+    for _,config in ipairs(alive) do
+        config.median = measure(config, repeats);
+        local row = {round, repeats};
+        for _,name in ipairs(names) do row[#row+1] = tostring(config[name]); end
+        row[#row+1] = config.median;
+        results:write(table.concat(row, ",").."\n");
+        results:flush();
+        vprintf("  %s: median %g µs\n", config.key, config.median);
+    end
+    table.sort(alive, function(a, b) return a.median < b.median; end);
+    if #alive == 1 or alive[1].median == math.huge then break; end
+    local kept = {};
+    for i = 1, (#alive + 1) // 2 do kept[i] = alive[i]; end
+    alive, repeats, round = kept, repeats*2, round + 1;
+end
+results:close();
+
+local best = alive[1];
+if best.median == math.huge then
+    generate(nil);
+    error("Autotuning: no setting could be built and run");
+end
+
+-- the table tuned replaces the one of an earlier run in the project info file
+local lines = {};
+for _,name in ipairs(names) do lines[#lines+1] = string.format("    %s = %s,", name, tostring(best[name])); end
+local block = string.format("-- autotune begin: median %g µs\ntuned = {\n%s\n};\n-- autotune end\n", best.median,
+                            table.concat(lines, "\n"));
+local fid = io.open(infofile);
+local contents = fid and fid:read("*a") or "";
+if fid then fid:close(); end
+contents = contents:gsub("%-%- autotune begin.-%-%- autotune end\n?", "");
+fid = io.open(infofile, "w") or error("Cannot write "..infofile);
+if contents ~= "" and contents:sub(-1) ~= "\n" then contents = contents.."\n"; end
+fid:write(contents..block);
+fid:close();
+
+printf("Best setting (median %g µs): %s\n", best.median, best.key);
+printf("Written to %s, results in %sresults.csv\n", infofile, tunedir);
+local ok, err = generate(best);
+if not ok then error(err); end
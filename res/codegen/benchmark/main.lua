@@ -0,0 +1,94 @@
+-- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+-- Compiler scalability benchmark: instantiates the given program (e.g. examples/synthetic/synthetic.lb) for several
+-- shapes and sizes of its task graph, runs the pipelines of other backends on each instance and records the statistics
+-- of their passes (cf. -time-passes) in gencode/benchmark/results.csv. The program gets the shape and the size through
+-- benchmark.h, which defines LB_SHAPE (0: fanout, 1: pipeline, 2: random) and the enum constants Width and Depth.
+-- The environment variables LB_BENCH_SHAPES, LB_BENCH_SIZES (approximate task counts) and LB_BENCH_BACKENDS select
+-- what is run.
+
+init();
+tools.mkpath('gencode/benchmark');
+local benchdir = tools.realpath('gencode/benchmark')..'/';
+local codegendir = resdir.."../";
+local template = args.lbfile;
+local lbname = tools.basename(args.lbfile);
+
+local words = function(s)
+    local list = {};
+    for w in s:gmatch("[^%s,]+") do list[#list+1] = w; end
+    return list;
+end
+local shapes = words(os.getenv("LB_BENCH_SHAPES") or "fanout pipeline random");
+local sizes = words(os.getenv("LB_BENCH_SIZES") or "1000 10000 100000 1000000");
+local backends = words(os.getenv("LB_BENCH_BACKENDS") or "pthreads-dynamic");
+
+-- LB_SHAPE and the width and depth of the task graph for about n tasks
+local shapeinfo = {
+    fanout = {0, function(n) return n, 1; end},
+    pipeline = {1, function(n) local depth = math.min(n, 100); return math.max(n // depth, 1), depth; end},
+    random = {2, function(n)
+        local depth = math.max(math.floor(math.sqrt(n)), 1);
+        return math.max(n // depth, 1), depth;
+    end},
+};
+
+-- without grouping, every task would get its own thread, and code generation would dominate everything else
+if args.groups == 0 then args.groups = 8; end
+
+-- the program sizes in kB are only measured with -timepasses (-1 otherwise)
+local fields = {"wall", "cpu", "peakrss", "tasksbefore", "tasksafter", "depsbefore", "depsafter",
+                "buffersbefore", "buffersafter", "programkbbefore", "programkbafter", "scratchkb"};
+local results = io.open(benchdir.."results.csv", "w");
+results:write("backend,shape,width,depth,pass,"..table.concat(fields, ",").."\n");
+
+local walltimes = {}; -- walltimes[backend.."/"..shape][pass] = list of {tasks, wall}, by increasing size
+for _,backend in ipairs(backends) do
+    for _,shape in ipairs(shapes) do
+        local info = shapeinfo[shape] or error("Unknown shape "..shape);
+        for _,size in ipairs(sizes) do
+            local width, depth = info[2](tonumber(size));
+            local dir = benchdir..shape.."-"..size.."/";
+            tools.mkpath(dir);
+            filecopy(template, dir..lbname);
+            local header = io.open(dir.."benchmark.h", "w");
+            header:write(string.format("#define LB_SHAPE %d\nenum {Width = %d, Depth = %d};\n", info[1], width, depth));
+            header:close();
+
+            printf("Benchmark: %s pipeline on %s graph of %d x %d tasks\n", backend, shape, width, depth);
+            local first = #Ladybirds.PassStats().passes + 1;
+            args.lbfile = dir..lbname;
+            local ok, err = pcall(dofile, codegendir..backend.."/main.lua");
+            if not ok then printf("Benchmark failed: %s\n", tostring(err)); end
+
+            local passes = Ladybirds.PassStats().passes;
+            local tasks = passes[first] and passes[first].tasksafter or -1; -- as parsed
+            local key = backend.."/"..shape;
+            walltimes[key] = walltimes[key] or {};
+            for i = first, #passes do
+                local pass = passes[i];
+                local row = {backend, shape, width, depth, pass.name};
+                for _,f in ipairs(fields) do row[#row+1] = pass[f]; end
+                results:write(table.concat(row, ",").."\n");
+                local list = walltimes[key][pass.name] or {};
+                walltimes[key][pass.name] = list;
+                list[#list+1] = {tasks, pass.wall};
+            end
+        end
+    end
+end
+results:close();
+
+-- growth of the wall time of each pass between the two largest sizes, as exponent of the number of tasks
+-- (small times are too noisy to compare)
+printf("\nScaling exponents (wall time ~ tasks^x) between the two largest sizes:\n");
+for key,passes in pairs(walltimes) do
+    for name,list in pairs(passes) do
+        local a, b = list[#list-1], list[#list];
+        if a and b and b[1] > a[1] and a[1] > 0 and a[2] > 0 and b[2] >= 0.05 then
+            local x = math.log(b[2]/a[2]) / math.log(b[1]/a[1]);
+            printf("  %-30s %-24s %5.2f%s\n", key, name, x, x > 1.5 and "  (superlinear)" or "");
+        end
+    end
+end
+printf("Results written to %sresults.csv\n", benchdir);
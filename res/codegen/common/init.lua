@@ -39,9 +39,18 @@ else
     vprintf = function(s,...) end
 end
 
+-- Appends the object files of the further .lb files of the program (args.lbsources) to the list ofiles and returns
+-- it. Ladybirds.Parse{sources=args.lbsources, ...} rewrites each of them next to the main output.
+addlbobjects = function(ofiles)
+    for _,src in ipairs(args.lbsources or {}) do
+        ofiles[#ofiles+1] = tools.basename(src)..'.o';
+    end
+    return ofiles;
+end
+
 genkernel = function(file, source)
     file = file:gsub('%.kernel$', '.c')
-    io.open(outdir..file, "w+"):write(source)
+    writeoutput(outdir..file, source);
 end
 
 -- Copy fromfile to tofile. If only one argument is given, copy indir..file to outdir..file.
@@ -51,8 +60,8 @@ copy = function(fromfile, tofile)
         return copy(indir..fromfile, outdir..fromfile);
     end
 
-    os.remove(tofile);
-    tools.symlink(fromfile, tofile);
+    tools.symlink(fromfile, tofile); -- keeps an existing link to the same file
+    addoutput(tofile);
 end
 
 filecopy = function(from, to)
@@ -67,13 +76,102 @@ filecontents = function(path)
     return ret;
 end
 
+-- The files generated in this run (by absolute path), and the list of them in the output directory of the backend,
+-- which is read at the end of the run (cf. finishoutputs) to remove the files generated by an earlier run only
+local outputs, manifest = {}, nil;
+
+-- Notes path as generated in this run
+addoutput = function(path)
+    path = tools.realpath(path);
+    if not manifest then manifest = tools.realpath(outdir).."/.lboutputs"; end
+    outputs[path] = true;
+end
+
+-- Moves the file tmppath to path unless path already has the same contents, such that unchanged outputs keep their
+-- timestamps and make does not rebuild them. Returns true if path changed.
+updateoutput = function(tmppath, path)
+    addoutput(path);
+    local new = filecontents(tmppath);
+    local fid = io.open(path);
+    local same = fid and fid:read("*a") == new;
+    if fid then io.close(fid); end
+    if same then
+        os.remove(tmppath);
+        return false;
+    end
+    local ok, err = os.rename(tmppath, path);
+    if not ok then error(err, 2); end
+    return true;
+end
+
+-- Writes contents to path unless it already has them (cf. updateoutput)
+writeoutput = function(path, contents)
+    local fid, err = io.open(path..".lbtmp", "w");
+    if not fid then error(err, 2); end
+    fid:write(contents);
+    io.close(fid);
+    return updateoutput(path..".lbtmp", path);
+end
+
+-- Renders the parsed template to path with view_model, leaving path untouched if it does not change
+rendertemplate = function(template, path, view_model)
+    template:render(path..".lbtmp", view_model);
+    if updateoutput(path..".lbtmp", path) then
+        printf("writing %s\n", path);
+    else
+        vprintf("unchanged %s\n", path);
+    end
+end
+
+-- Renders a list of jobs {template=<path of the .mustache file>, model=<view model>, output=<path>} concurrently on
+-- native threads, like rendertemplate for each of them. The view models are converted beforehand as far as the
+-- templates look into them, so they must not contain functions.
+renderall = function(jobs)
+    local changed = tools.renderall(jobs);
+    for i,job in ipairs(jobs) do
+        addoutput(job.output);
+        if changed[i] then
+            printf("writing %s\n", job.output);
+        else
+            vprintf("unchanged %s\n", job.output);
+        end
+    end
+end
+
 render = function(file, view_model, template)
-    printf("writing %s\n", file);
     if template then
         error("deprecated parameter template");
     end
-    local template = fastache.parse(resdir..file..".mustache");
-    template:render(outdir..file, view_model);
+    rendertemplate(fastache.parse(resdir..file..".mustache"), outdir..file, view_model);
+end
+
+-- Like render, but with a template shared by all backends (in the directory of this file)
+rendercommon = function(file, view_model)
+    local thisdir = tools.realpath(debug.getinfo(1, "S").source:match("@(.*/)"));
+    rendertemplate(fastache.parse(thisdir.."/"..file..".mustache"), outdir..file, view_model);
+end
+
+-- Removes the files listed by the previous run that were not generated (or copied) in this one and updates the list.
+-- Called after the backend has finished successfully.
+finishoutputs = function()
+    if not manifest then return; end
+    local dir = tools.dirname(manifest).."/";
+    local fid = io.open(manifest);
+    if fid then
+        for line in fid:lines() do
+            local path = dir..line;
+            if line ~= "" and not outputs[path] and os.remove(path) then vprintf("removed stale %s\n", path); end
+        end
+        io.close(fid);
+    end
+
+    local list = {};
+    for path in pairs(outputs) do
+        if path:sub(1, #dir) == dir then list[#list+1] = path:sub(#dir+1); end -- others are not removed later
+    end
+    table.sort(list);
+    list[#list+1] = "";
+    writeoutput(manifest, table.concat(list, "\n"));
 end
 
 map2array = function(tbl)
@@ -101,14 +199,97 @@ indexstring = function(index)
     return ret..")";
 end;
 
-printreport = function(x)
+-- Binds the external packets listed in the project info (x.mappedfiles) to their files: marks the entry of each in
+-- extargs (the MainEntryArguments of a backend, with argname and index) with mapped={number=...} and returns the list
+-- of files for mappedfiles.c. The bound buffers are mapped by _lb_invoke instead of being passed by its caller.
+mapexternalfiles = function(x, extargs)
+    local files = {};
+    for _,binding in ipairs(x.mappedfiles or {}) do
+        local entry;
+        for _,arg in ipairs(extargs) do
+            if arg.argname == binding.packet then entry = arg; end
+        end
+        local packet;
+        for _,p in ipairs(x.maintask.kernel.packets) do
+            if p.name == binding.packet then packet = p; end
+        end
+        if not entry or not packet then
+            error("mapped file "..binding.file..": "..binding.packet.." is not an external packet of "..
+                  x.maintask.kernel.func);
+        end
+        local size = packet.basetypesize;
+        for _,dim in ipairs(packet.arraydims) do size = size*dim; end
+        entry.mapped = {number=#files};
+        files[#files+1] = {file=binding.file, size=size, read=(packet.dir ~= "out" and 1 or 0),
+                           write=(packet.dir ~= "in" and 1 or 0)};
+    end
+    return files;
+end
+
+-- The project info file of the program: the one given with -p, else <app>.projinfo.lua next to the specification
+-- (which need not exist)
+projinfofile = function()
+    return args.projinfo or indir..appname..".projinfo.lua";
+end
+
+-- Takes the knobs found by the autotune backend (the table tuned in the project info file) over into args, for the
+-- options that were left at their defaults on the command line. Does nothing while the autotune backend is running.
+applytuned = function()
+    if autotuning then return; end
+    local info = {};
+    local chunk = loadfile(projinfofile(), "t", info);
+    if not chunk or not pcall(chunk) or type(info.tuned) ~= "table" then return; end
+    for knob,value in pairs(info.tuned) do
+        if not args[knob] or args[knob] == 0 then
+            vprintf("tuned: %s = %s\n", knob, tostring(value));
+            args[knob] = value;
+        end
+    end
+end
+
+-- Writes the report on the exported program x. The optional table counters holds the hardware counts measured for
+-- each task (by task name, as written by pthreads-dynamic with -counters), the optional table movement the result of
+-- the DataMovement pass.
+printreport = function(x, counters, movement)
     printf("writing report\n");
     lfs.mkdir(outdir.."report");
 
+    local measured = {};
+    for _,group in ipairs(x.groups) do
+        for _,op in ipairs(group.operations) do
+            local c = counters and counters[op.task.name];
+            if c then
+                measured[#measured+1] = {name=op.task.name, group=group.name, runs=c.runs, cycles=c.cycles,
+                    instructions=c.instructions, l1dmisses=c.l1dmisses, llcmisses=c.llcmisses,
+                    ipc=string.format("%.2f", c.cycles > 0 and c.instructions/c.cycles or 0)};
+            end
+        end
+    end
+    table.sort(measured, function(a, b) return a.cycles > b.cycles; end);
+
+    -- the live bytes as polyline in a chart of 800 x 200 pixels
+    if movement then
+        local points, n, peak = {}, #movement.live, math.max(movement.peakbytes, 1);
+        for i,bytes in ipairs(movement.live) do
+            points[i] = string.format("%.1f,%.1f", n > 1 and 800*(i-1)/(n-1) or 0, 200 - 200*bytes/peak);
+        end
+        movement.chart = table.concat(points, " ");
+        local int = function(v) return string.format("%.0f", v); end
+        for _,f in ipairs{"dependencybytes", "crossgroupbytes", "bufferbytes", "peakbytes"} do
+            movement[f] = int(movement[f]);
+        end
+        for _,g in ipairs(movement.groups) do g.bytes = int(g.bytes); end
+        for _,k in ipairs(movement.kernels) do
+            k.cost, k.bytes, k.intensity = int(k.cost), int(k.bytes), string.format("%.3f", k.intensity);
+        end
+        movement.haskernels = #movement.kernels > 0;
+    end
+
     local thisdir = tools.realpath(debug.getinfo(1, "S").source:match("@(.*/)"));
-    local template = fastache.parse(thisdir.."/report.html.mustache");
-    template:render(outdir.."report/summary.html", {appname = appname, groups = x.groups});
+    rendertemplate(fastache.parse(thisdir.."/report.html.mustache"), outdir.."report/summary.html",
+                   {appname = appname, groups = x.groups, passes = Ladybirds.PassStats().passes,
+                    counters = measured, hascounters = #measured > 0,
+                    movement = movement, hasmovement = movement ~= nil});
     
-    template = fastache.parse(thisdir.."/buffers.lua.mustache");
-    template:render(outdir.."report/buffers.lua", x);
+    rendertemplate(fastache.parse(thisdir.."/buffers.lua.mustache"), outdir.."report/buffers.lua", x);
 end;
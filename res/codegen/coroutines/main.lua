@@ -0,0 +1,138 @@
+-- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+-- Coroutine backend: every task is a C++20 coroutine, which awaits its inputs (co_await, i.e. its predecessors) and is
+-- resumed by the last of them, so any number of waiting tasks occupies no thread. The coroutines run on a fixed number
+-- of worker threads. The tasks without inputs acquire data (e.g. read files) and may block, so they move over to a few
+-- I/O threads, and the compute tasks keep running meanwhile. Groups (from a mapping or AutoGroup) only set the number
+-- of worker threads.
+
+init();
+tools.mkpath('gencode/coroutines/lb-includes');
+outdir=tools.realpath('gencode/coroutines')..'/';
+local lbbase = tools.basename(args.lbfile)
+
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources, output=outdir..lbbase..'.c'};
+assert(prog, nil);
+
+local result = Ladybirds.TaskTopoSort{prog} and
+        Ladybirds.CalcSuccessorMatrix{prog} and
+        (not args.mapping or Ladybirds.LoadMapping{prog, filename=args.mapping}) and
+        (args.mapping or args.groups == 0 or
+            ((not args.costs or Ladybirds.LoadCost{prog, filename=args.costs}) and
+             Ladybirds.AutoGroup{prog, groups=args.groups})) and
+        (not args.projinfo or Ladybirds.LoadProjectInfo{prog, filename=args.projinfo}) and
+        Ladybirds.PopulateGroups{prog} and
+        Ladybirds.BufferPreallocation{prog} and
+        (args.align == 0 and args.hugepages == 0 or
+            Ladybirds.AlignBuffers{prog, alignment=math.max(args.align, 1), hugepages=args.hugepages}) and
+        Ladybirds.BufferAllocation{prog} and
+        true or error()
+
+-- only await the predecessors that are not implied by others
+local syncs = Ladybirds.SyncPoints{prog} or error();
+local x = Ladybirds.Export{prog};
+
+if #x.divisions ~= 1 then
+    error("Program has "..#x.divisions.." divisions, but only one is supported.");
+end
+
+local div = x.divisions[1]
+
+-- data type checks
+local basetypesizes={}
+for _,kernel in pairs(x.kernels) do
+    for _,packet in ipairs(kernel.packets) do
+        basetypesizes[packet.basetype] = packet.basetypesize
+    end
+end
+
+-- give buffers names
+local extargs = {};
+for i, buffer in ipairs(div.buffers) do
+    buffer.align = math.max(buffer.alignment, 8);
+    buffer.name = "_buffer_"..i;
+end
+for _,buffer in ipairs(x.externalbuffers) do
+    local idx = buffer.extargindex;
+    buffer.name = "ExternalBuffers["..idx.."].Base"
+    buffer.callparam = "ExternalBuffers["..idx.."].Dimensions"
+    extargs[#extargs+1] = {index=#extargs, argname=x.maintask.kernel.packets[idx+1].name};
+end
+
+-- number the tasks, and find the ones without inputs, which run on the I/O threads
+local workers = #x.groups > 0 and #x.groups or 4;
+local iotasks = 0;
+for i,task in ipairs(x.tasks) do
+    task.coid = i-1;
+    task.succs = {};
+    task.npreds = 0;
+    task.io = 1;
+    for _,iface in ipairs(task.ifaces) do
+        if iface.packet.dir ~= "out" then task.io = 0; end
+    end
+    iotasks = iotasks + task.io;
+end
+
+-- dependency counters and successor lists, each pair of tasks counts only once
+local waitsfor = {};
+for _,entry in ipairs(syncs.syncs) do
+    waitsfor[entry.task] = {};
+    for _,pred in ipairs(entry.waits) do waitsfor[entry.task][pred] = true; end
+end
+local successors = {};
+for _,dep in ipairs(x.dependencies) do
+    local src, dst = dep.from.task, dep.to.task;
+    local waits = waitsfor[dst.name];
+    if src.coid and dst.coid and not src.succs[dst] and (not waits or waits[src.name]) then
+        src.succs[dst] = true;
+        src.succs[#src.succs+1] = dst.coid;
+        dst.npreds = dst.npreds + 1;
+    end
+end
+for _,task in ipairs(x.tasks) do
+    task.succstart = #successors;
+    for _,succ in ipairs(task.succs) do successors[#successors+1] = succ; end
+    task.succend = #successors;
+    task.succs = nil;
+end
+
+
+-- Copy all required C files and create a list of object files
+local ofiles = addlbobjects{"main.o", "experiment.o", "executor.o", lbbase..'.o'}
+
+-- external packets bound to files in the project info, mapped by _lb_invoke
+local mappedfiles = mapexternalfiles(x, extargs);
+if #mappedfiles > 0 then ofiles[#ofiles+1] = "mappedfiles.o"; end
+
+for _,file in ipairs(x.codefiles) do
+    copy(file);
+    if file:match('%.c$') then
+        ofiles[#ofiles+1] = file:gsub('%.c$', '.o')
+    end
+end
+
+for _,file in ipairs(x.auxfiles) do
+    copy(file);
+end
+
+
+--create view model
+model = { appname=appname, ofiles=ofiles, definitions=x.definitions, typeckecks=map2array(basetypesizes),
+    kernels=x.kernels, buffers=div.buffers, tasks=x.tasks, maintask=x.maintask,
+    MainEntryArguments=extargs, ExternalBufferCount=math.max(#extargs, 1),
+    mapping=(#mappedfiles > 0), mappedfiles=mappedfiles, mappedfilecount=#mappedfiles,
+    workers=workers, iothreads=math.min(iotasks, 4), iotasks=(iotasks > 0), TaskCount=#x.tasks,
+    tasksuccessors=table.concat(successors, ", ") };
+
+render("Makefile", model)
+render("global.h", model)
+render("main.c", model)
+render("executor.h", model)
+render("executor.cpp", model)
+render("lb-includes/ladybirds.h", model)
+rendercommon("experiment.h", model)
+rendercommon("experiment.c", model)
+if #mappedfiles > 0 then
+    rendercommon("mappedfiles.h", model)
+    rendercommon("mappedfiles.c", model)
+end
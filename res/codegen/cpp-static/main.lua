@@ -0,0 +1,157 @@
+-- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+-- Static C++ backend: the flattened program becomes constexpr data (the tasks and their waits for other groups) and
+-- one variadic template list of tasks per group (program.cpp). Instantiating the groups (lb::Group in lbstatic.h)
+-- unrolls each group into a straight sequence of direct kernel calls, and the waits that the order of the groups
+-- implies are dropped at compile time. There are no function pointer tables and no dependency bitfields; the kernels
+-- stay C and are inlined into the groups by link-time optimization, with their dimensions as template arguments.
+-- Each group runs on a thread of its own; without a mapping, the tasks are grouped into -groups groups (default 4).
+
+init();
+tools.mkpath('gencode/cpp-static/lb-includes');
+outdir=tools.realpath('gencode/cpp-static')..'/';
+local lbbase = tools.basename(args.lbfile)
+
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources, output=outdir..lbbase..'.c'};
+assert(prog, nil);
+
+local result = Ladybirds.TaskTopoSort{prog} and
+        Ladybirds.CalcSuccessorMatrix{prog} and
+        (not args.mapping or Ladybirds.LoadMapping{prog, filename=args.mapping}) and
+        (args.mapping or
+            ((args.costs and Ladybirds.LoadCost{prog, filename=args.costs} or
+              not args.costs and Ladybirds.EstimateCosts{prog}) and
+             Ladybirds.AutoGroup{prog, groups=args.groups > 0 and args.groups or 4})) and
+        (not args.projinfo or Ladybirds.LoadProjectInfo{prog, filename=args.projinfo}) and
+        Ladybirds.PopulateGroups{prog} and
+        Ladybirds.BufferPreallocation{prog} and
+        (args.align == 0 and args.hugepages == 0 or
+            Ladybirds.AlignBuffers{prog, alignment=math.max(args.align, 1), hugepages=args.hugepages}) and
+        Ladybirds.BufferAllocation{prog} and
+        true or error()
+
+-- only wait for the predecessors that are not implied by others
+local syncs = Ladybirds.SyncPoints{prog} or error();
+local x = Ladybirds.Export{prog};
+
+if #x.divisions ~= 1 then
+    error("Program has "..#x.divisions.." divisions, but only one is supported.");
+end
+
+local div = x.divisions[1]
+
+-- data type checks
+local basetypesizes={}
+for _,kernel in pairs(x.kernels) do
+    for _,packet in ipairs(kernel.packets) do
+        basetypesizes[packet.basetype] = packet.basetypesize
+    end
+end
+
+-- give buffers names
+local extargs = {};
+for i, buffer in ipairs(div.buffers) do
+    buffer.align = math.max(buffer.alignment, 8);
+    buffer.name = "_buffer_"..i;
+end
+for _,buffer in ipairs(x.externalbuffers) do
+    local idx = buffer.extargindex;
+    buffer.name = "static_cast<uint8_t *>(ExternalBuffers["..idx.."].Base)"
+    buffer.callparam = "ExternalBuffers["..idx.."].Dimensions"
+    extargs[#extargs+1] = {index=#extargs, argname=x.maintask.kernel.packets[idx+1].name};
+end
+
+-- number the tasks in the order of the groups, each group in its own (topological) order
+local tasks = {};
+for _,group in ipairs(x.groups) do
+    for i,op in ipairs(group.operations) do
+        local task = op.task;
+        task.sid, task.group, task.position = #tasks, group, i;
+        task.waits = {};
+        tasks[#tasks+1] = task;
+    end
+end
+
+-- the constant dimensions of the interfaces become template arguments (lb::Dims), the others stay pointers
+for _,task in ipairs(tasks) do
+    for _,iface in ipairs(task.ifaces) do
+        local values = iface.callparam and iface.callparam:match("^%(int%[%]%)(%b{})$");
+        iface.dimsarg = values and "lb::Dims<"..values:sub(2, -2)..">::Values"
+                        or iface.callparam or iface.buffer.callparam;
+    end
+end
+
+-- the waits of each task for tasks of other groups: until that group has finished the predecessor, i.e. as many tasks
+-- as its position. Which of them the order of the groups implies is left to the compiler (cf. lb::Schedule).
+local waitsfor = {};
+for _,entry in ipairs(syncs.syncs) do
+    waitsfor[entry.task] = {};
+    for _,pred in ipairs(entry.waits) do waitsfor[entry.task][pred] = true; end
+end
+for _,dep in ipairs(x.dependencies) do
+    local src, dst = dep.from.task, dep.to.task;
+    local waits = waitsfor[dst.name];
+    if src.sid and dst.sid and src ~= dst and (not waits or waits[src.name]) then
+        if src.group == dst.group then
+            if src.position > dst.position then
+                error("Task "..dst.name.." runs before its predecessor "..src.name.." in its group.");
+            end
+        else
+            local key = src.group.number..":"..src.position;
+            if not dst.waits[key] then
+                dst.waits[key] = true;
+                dst.waits[#dst.waits+1] = {group=src.group.number, count=src.position};
+            end
+        end
+    end
+end
+local waits = {};
+for _,task in ipairs(tasks) do
+    table.sort(task.waits, function(a, b) return a.group < b.group or a.group == b.group and a.count < b.count; end);
+    task.waitstart = #waits;
+    for _,wait in ipairs(task.waits) do waits[#waits+1] = wait; end
+    task.waitend = #waits;
+    task.groupnumber, task.index = task.group.number, task.position-1;
+    task.group, task.waits = nil, nil;
+end
+for _,group in ipairs(x.groups) do
+    group.ops = {};
+    for _,op in ipairs(group.operations) do group.ops[#group.ops+1] = {sid=op.task.sid}; end
+end
+
+
+-- Copy all required C files and create a list of object files
+local ofiles = addlbobjects{"program.o", "experiment.o", lbbase..'.o'}
+
+-- external packets bound to files in the project info, mapped by _lb_invoke
+local mappedfiles = mapexternalfiles(x, extargs);
+if #mappedfiles > 0 then ofiles[#ofiles+1] = "mappedfiles.o"; end
+
+for _,file in ipairs(x.codefiles) do
+    copy(file);
+    if file:match('%.c$') then
+        ofiles[#ofiles+1] = file:gsub('%.c$', '.o')
+    end
+end
+
+for _,file in ipairs(x.auxfiles) do
+    copy(file);
+end
+
+
+--create view model
+model = { appname=appname, ofiles=ofiles, definitions=x.definitions, typeckecks=map2array(basetypesizes),
+    kernels=x.kernels, buffers=div.buffers, tasks=tasks, waits=waits, groups=x.groups, maintask=x.maintask,
+    MainEntryArguments=extargs, ExternalBufferCount=math.max(#extargs, 1), groupcount=#x.groups,
+    mapping=(#mappedfiles > 0), mappedfiles=mappedfiles, mappedfilecount=#mappedfiles };
+
+render("Makefile", model)
+render("lbstatic.h", model)
+render("program.cpp", model)
+render("lb-includes/ladybirds.h", model)
+rendercommon("experiment.h", model)
+rendercommon("experiment.c", model)
+if #mappedfiles > 0 then
+    rendercommon("mappedfiles.h", model)
+    rendercommon("mappedfiles.c", model)
+end
@@ -0,0 +1,257 @@
+-- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+-- CUDA backend: the kernels given with -device run on the GPU, all others on the host. For each device kernel «func»,
+-- the application provides a __device__ function «func»_device with the same parameters in «appname».cu, which is
+-- called by one thread block per task. Independent instances of a device kernel (the same dependency level, e.g. the
+-- instances of a genvar loop) are batched into one launch. The device buffers mirror the BufferAllocation layout, and
+-- the regions of the channels (cf. PlacePorts) between host and device tasks are copied with cudaMemcpy2DAsync. The
+-- order of launches, copies and host tasks follows from the dependency graph, using one CUDA event per batch.
+
+init();
+tools.mkpath('gencode/cuda/lb-includes');
+outdir=tools.realpath('gencode/cuda')..'/';
+local lbbase = tools.basename(args.lbfile)
+
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources, output=outdir..lbbase..'.c'};
+assert(prog, nil);
+
+-- without a mapping, every task gets its own group, so every dependency between tasks becomes a channel
+local result = Ladybirds.TaskTopoSort{prog} and
+        Ladybirds.CalcSuccessorMatrix{prog} and
+        (not args.projinfo or Ladybirds.LoadProjectInfo{prog, filename=args.projinfo}) and
+        Ladybirds.PopulateGroups{prog} and
+        Ladybirds.BufferPreallocation{prog} and
+        (args.align == 0 and args.hugepages == 0 or
+            Ladybirds.AlignBuffers{prog, alignment=math.max(args.align, 1), hugepages=args.hugepages}) and
+        Ladybirds.BufferAllocation{prog} and
+        Ladybirds.PlacePorts{prog} and
+        true or error()
+
+local x = Ladybirds.Export{prog};
+
+if #x.divisions ~= 1 then
+    error("Program has "..#x.divisions.." divisions, but only one is supported.");
+end
+
+local div = x.divisions[1]
+
+-- data type checks
+local basetypesizes={}
+for _,kernel in pairs(x.kernels) do
+    for _,packet in ipairs(kernel.packets) do
+        basetypesizes[packet.basetype] = packet.basetypesize
+    end
+end
+
+-- give buffers names
+local extargs = {};
+for i, buffer in ipairs(div.buffers) do
+    buffer.align = math.max(buffer.alignment, 8);
+    buffer.name = "_buffer_"..i;
+    buffer.devindex = i-1;
+end
+for _,buffer in ipairs(x.externalbuffers) do
+    local idx = buffer.extargindex;
+    buffer.name = "ExternalBuffers["..idx.."].Base"
+    buffer.callparam = "ExternalBuffers["..idx.."].Dimensions"
+    extargs[#extargs+1] = {index=#extargs, argname=x.maintask.kernel.packets[idx+1].name};
+end
+
+-- the device kernels
+local isdevice = {};
+for name in (args.device or ""):gmatch("[^,%s]+") do isdevice[name] = true; end
+local devkernels = {};
+for _,kernel in pairs(x.kernels) do
+    if isdevice[kernel.func] then
+        kernel.device = true;
+        devkernels[#devkernels+1] = kernel;
+        isdevice[kernel.func] = nil;
+    end
+end
+for name in pairs(isdevice) do error("Device kernel "..name.." does not exist."); end
+
+-- number the tasks, and sort them into dependency levels (the tasks are sorted topologically)
+local preds = {};
+for i,task in ipairs(x.tasks) do
+    task.cudaid = i-1;
+    preds[task] = {};
+end
+for _,dep in ipairs(x.dependencies) do
+    local src, dst = dep.from.task, dep.to.task;
+    if preds[src] and preds[dst] and src ~= dst then preds[dst][src] = true; end
+end
+local devdims, ndevdims = {}, 0;
+for _,task in ipairs(x.tasks) do
+    task.level = 0;
+    for pred in pairs(preds[task]) do task.level = math.max(task.level, pred.level+1); end
+    if task.kernel.device then
+        for _,iface in ipairs(task.ifaces) do
+            if not iface.buffer or iface.buffer.isexternal then
+                error("Device task "..task.name.." accesses an argument of the metakernel, which only host tasks can.");
+            end
+            -- the dimensions are passed as compound literals on the host, which device code cannot use
+            local dims = iface.callparam:match("^%(int%[%]%)(%b{})$") or "{0}";
+            if not devdims[dims] then
+                devdims[dims] = {name="_lb_devdims_"..ndevdims, values=dims};
+                ndevdims = ndevdims+1;
+            end
+            iface.devcallparam = devdims[dims].name;
+            iface.devbuffer = "_dev"..iface.buffer.name;
+        end
+    end
+end
+local dimarrays = {};
+for _,dims in pairs(devdims) do dimarrays[#dimarrays+1] = dims; end
+table.sort(dimarrays, function(a, b) return a.name < b.name; end);
+
+-- the copies of a port region between the host and the device buffers: rows of contiguous bytes, given as offset,
+-- pitch, width and height
+local regioncopies = function(port)
+    local buffer = port.iface.buffer;
+    if not port.bufferdims or #port.bufferdims == 0 then
+        return {{offset=0, pitch=buffer.size, width=buffer.size, height=1}};
+    end
+    local sizes, extents, starts, stride, rest = {}, {}, {}, 1, port.offset;
+    for i = #port.bufferdims, 1, -1 do
+        sizes[i], extents[i] = port.bufferdims[i], port.dims[i];
+        starts[i] = (rest // stride) % sizes[i];
+        stride = stride * sizes[i];
+    end
+    -- merge inner dimensions that are covered completely into rows
+    while #sizes > 1 and extents[#sizes] == sizes[#sizes] do
+        local n = #sizes;
+        sizes[n-1], extents[n-1], starts[n-1] = sizes[n-1]*sizes[n], extents[n-1]*sizes[n], starts[n-1]*sizes[n];
+        sizes[n], extents[n], starts[n] = nil, nil, nil;
+    end
+    local n = #sizes;
+    local pitch = sizes[n];
+    local height = n > 1 and extents[n-1] or 1;
+    local copies = {};
+    -- one 2D copy for each index of the outer dimensions
+    local enumerate;
+    enumerate = function(dim, base)
+        if dim >= n-1 then
+            local offset = base;
+            if n > 1 then offset = offset*sizes[n-1] + starts[n-1]; end
+            copies[#copies+1] = {offset=offset*pitch + starts[n], pitch=pitch, width=extents[n], height=height};
+            return;
+        end
+        for i = starts[dim], starts[dim]+extents[dim]-1 do enumerate(dim+1, base*sizes[dim] + i); end
+    end
+    enumerate(1, 0);
+    return copies;
+end
+
+-- batches: the device tasks of the same kernel and level
+local batches, batchof = {}, {};
+local bylevel = {};
+for _,task in ipairs(x.tasks) do
+    if task.kernel.device then
+        local key = task.level.."/"..task.kernel.func;
+        local batch = batchof[key];
+        if not batch then
+            batch = {number=#batches, level=task.level, tasks={}, waitevents={}, copies={}};
+            batchof[key] = batch;
+            batches[#batches+1] = batch;
+        end
+        task.batch = batch;
+        task.block = #batch.tasks;
+        batch.tasks[#batch.tasks+1] = task;
+        batch.count = #batch.tasks;
+    end
+end
+
+-- host tasks issue the copies to the device after they have finished, device batches those to the host
+local copyevents = 0;
+for _,task in ipairs(x.tasks) do task.copies = {}; end
+for _,channel in ipairs(x.channels) do
+    local src, dst = channel.from.iface.task, channel.to.iface.task;
+    if src.kernel.device ~= dst.kernel.device then
+        local owner = src.kernel.device and src.batch or src;
+        local buffer = channel.to.iface.buffer;
+        for _,copy in ipairs(regioncopies(channel.to)) do
+            copy.host, copy.device = buffer.name, buffer.devindex;
+            copy.kind = src.kernel.device and "cudaMemcpyDeviceToHost" or "cudaMemcpyHostToDevice";
+            owner.copies[#owner.copies+1] = copy;
+        end
+        if not src.kernel.device and not src.copyevent then
+            src.copyevent = #batches + copyevents;
+            copyevents = copyevents+1;
+        end
+    end
+end
+
+-- the events each batch and host task has to wait for
+local steps = {};
+for level = 0, math.huge do
+    local found = false;
+    for _,batch in ipairs(batches) do
+        if batch.level == level then
+            found = true;
+            local waits = {};
+            for _,task in ipairs(batch.tasks) do
+                for pred in pairs(preds[task]) do
+                    local event = pred.kernel.device and pred.batch.number or pred.copyevent;
+                    if event and not waits[event] then
+                        waits[event] = true;
+                        batch.waitevents[#batch.waitevents+1] = {event=event};
+                    end
+                end
+            end
+            steps[#steps+1] = {batch=batch};
+        end
+    end
+    for _,task in ipairs(x.tasks) do
+        if task.level == level then
+            found = true;
+            if not task.kernel.device then
+                local waits = {};
+                task.syncevents = {};
+                for pred in pairs(preds[task]) do
+                    if pred.kernel.device and not waits[pred.batch] then
+                        waits[pred.batch] = true;
+                        task.syncevents[#task.syncevents+1] = {event=pred.batch.number};
+                    end
+                end
+                steps[#steps+1] = {host=task};
+            end
+        end
+    end
+    if not found then break; end
+end
+
+
+-- Copy all required C files and create a list of object files
+local ofiles = addlbobjects{"main.o", "device.o", "experiment.o", lbbase..'.o'}
+
+for _,file in ipairs(x.codefiles) do
+    copy(file);
+    if file:match('%.c$') then
+        ofiles[#ofiles+1] = file:gsub('%.c$', '.o')
+    end
+end
+
+for _,file in ipairs(x.auxfiles) do
+    copy(file);
+end
+if #devkernels > 0 then
+    copy(appname..".cu");
+    ofiles[#ofiles+1] = appname..".o";
+end
+
+
+--create view model
+model = { appname=appname, ofiles=ofiles, definitions=x.definitions, typeckecks=map2array(basetypesizes), 
+    kernels=x.kernels, devkernels=devkernels, buffers=div.buffers, tasks=x.tasks, maintask=x.maintask,
+    MainEntryArguments=extargs, ExternalBufferCount=math.max(#extargs, 1),
+    batches=batches, steps=steps, dimarrays=dimarrays, BufferCount=math.max(#div.buffers, 1),
+    EventCount=math.max(#batches + copyevents, 1) };
+
+render("Makefile", model)
+render("global.h", model)
+render("device.h", model)
+render("device.cu", model)
+render("main.c", model)
+render("lb-includes/ladybirds.h", model)
+rendercommon("experiment.h", model)
+rendercommon("experiment.c", model)
@@ -0,0 +1,104 @@
+-- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+-- Design-space exploration: parses and prepares the program once, then evaluates each variant given with -variants
+-- in a process of its own (cf. tools.forkeach), which starts from a copy-on-write copy of the prepared program. A
+-- variant loads its mapping and costs, is list scheduled on the platform (cf. ListSchedule), simulated with the
+-- runtime of pthreads-dynamic (cf. SimulateRuntime) and measured by the peak of its live buffer bytes (cf.
+-- DataMovement). The results are written to gencode/dse/results.csv as the variants finish, and the Pareto front of
+-- makespan against memory to gencode/dse/pareto.csv.
+--
+-- The variants file is a Lua script returning a table with a list of variants and optionally the platform (default:
+-- Ladybirds.HostPlatform{}), e.g.
+--     return { platform = myplatform, variants = {
+--         {name="rows", mapping="rows.mapping.lua"},
+--         {name="blocks", mapping="blocks.mapping.lua", costs="measured.costs.lua", weight=0.5, portfolio=4} } };
+-- Each variant needs a mapping; costs, weight and portfolio are optional (cf. LoadCost and ListSchedule). Relative
+-- file names are taken from the directory of the variants file. -jobs sets the number of processes running at once.
+
+init();
+tools.mkpath('gencode/dse');
+local outdir = tools.realpath('gencode/dse')..'/';
+
+if not args.variants then error("The dse backend needs a list of variants (-variants=<file>)"); end
+local spec = dofile(args.variants);
+local variants = spec.variants or error("No variants in "..args.variants);
+local specdir = tools.dirname(tools.realpath(args.variants))..'/';
+local path = function(file) return file:sub(1, 1) == '/' and file or specdir..file; end
+local platform = spec.platform or Ladybirds.HostPlatform{} or error();
+
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources};
+assert(prog, nil);
+local result = Ladybirds.TaskTopoSort{prog} and
+        Ladybirds.CalcSuccessorMatrix{prog} and
+        (args.costs and Ladybirds.LoadCost{prog, filename=args.costs} or
+            not args.costs and Ladybirds.EstimateCosts{prog}) and
+        true or error()
+
+-- runs in the child process, which may change prog freely
+local evaluate = function(variant)
+    if not variant.mapping then error("Variant "..tostring(variant.name).." has no mapping"); end
+    local result = (not variant.costs or Ladybirds.LoadCost{prog, filename=path(variant.costs)}) and
+            Ladybirds.LoadMapping{prog, filename=path(variant.mapping), platform=platform} and
+            Ladybirds.PopulateGroups{prog} and
+            Ladybirds.BufferPreallocation{prog} and
+            true or error("Unable to apply the variant")
+    -- one thread per schedule, the other cores evaluate the other variants
+    local schedule = Ladybirds.ListSchedule{prog, platform=platform, weight=variant.weight or 0,
+                                            portfolio=variant.portfolio or 0, threads=1} or error()
+    local movement = Ladybirds.DataMovement{prog, limit=1, points=1} or error();
+    -- the makespan with the runtime of pthreads-dynamic, in cost units
+    local simulation = Ladybirds.SimulateRuntime{prog, platform=platform, scale=1} or error();
+    return {makespan=schedule.makespan, simulated=simulation.makespan, peakbytes=movement.peakbytes,
+            crossgroupbytes=movement.crossgroupbytes};
+end
+
+local fields = {"makespan", "simulated", "peakbytes", "crossgroupbytes"};
+local csv = function(file, rows)
+    file:write("variant,"..table.concat(fields, ",").."\n");
+    for _,row in ipairs(rows or {}) do
+        local line = {row.name};
+        for _,f in ipairs(fields) do line[#line+1] = row[f]; end
+        file:write(table.concat(line, ",").."\n");
+    end
+end
+
+local names = {};
+for i,variant in ipairs(variants) do names[i] = variant.name or tostring(i); end
+local results = io.open(outdir.."results.csv", "w");
+csv(results);
+printf("Evaluating %d variants\n", #variants);
+local rows = tools.forkeach(variants, evaluate, args.jobs > 0 and args.jobs or nil, function(i, row)
+    row.name = names[i];
+    if row.error then
+        printf("  %-24s failed: %s\n", row.name, row.error);
+        return;
+    end
+    vprintf("  %-24s makespan %g, peak %g bytes\n", row.name, row.makespan, row.peakbytes);
+    local line = {row.name};
+    for _,f in ipairs(fields) do line[#line+1] = row[f]; end
+    results:write(table.concat(line, ",").."\n");
+    results:flush();
+end);
+results:close();
+
+-- the variants not dominated by another one, i.e., none is at least as good in both makespan and memory and better
+-- in one of them, by increasing makespan
+local valid = {};
+for i,row in ipairs(rows) do
+    if not row.error then row.name = names[i]; valid[#valid+1] = row; end
+end
+table.sort(valid, function(a, b)
+    return a.makespan < b.makespan or a.makespan == b.makespan and a.peakbytes < b.peakbytes;
+end);
+local front = {};
+for _,row in ipairs(valid) do
+    if #front == 0 or row.peakbytes < front[#front].peakbytes then front[#front+1] = row; end
+end
+
+local pareto = io.open(outdir.."pareto.csv", "w");
+csv(pareto, front);
+pareto:close();
+
+printf("\nPareto front of makespan against peak memory (%d of %d variants):\n", #front, #variants);
+for _,row in ipairs(front) do printf("  %-24s makespan %12g  peak %12g bytes\n", row.name, row.makespan, row.peakbytes); end
+printf("Results written to %sresults.csv and %spareto.csv\n", outdir, outdir);
@@ -4,8 +4,20 @@ init();
 tools.mkpath('gencode/graphviz');
 outdir=tools.realpath('gencode/graphviz')..'/';
 
-local prog = Ladybirds.Parse({filename=args.lbfile});
+-- Graphs with more than this many nodes are cut, since dot takes hours on them (0: no limit)
+local maxnodes = args.maxnodes or 0;
+
+local prog = Ladybirds.Parse({filename=args.lbfile, sources=args.lbsources});
 assert(prog, nil);
+-- the groups (from a mapping or AutoGroup) become clusters of the collapsed view
+if args.mapping or args.groups > 0 then
+    local result = Ladybirds.TaskTopoSort{prog} and
+            Ladybirds.CalcSuccessorMatrix{prog} and
+            (args.mapping and Ladybirds.LoadMapping{prog, filename=args.mapping} or
+                (not args.costs or Ladybirds.LoadCost{prog, filename=args.costs}) and
+                Ladybirds.AutoGroup{prog, groups=args.groups}) and
+            true or error()
+end
 local x = Ladybirds.Export(prog);
 
 local dotfiles = {}
@@ -22,7 +34,8 @@ end
 
 local fullprog = { name="full program", tasks = x.tasks, dependencies = x.dependencies,
                    inputs = x.maintask, outputs = outputs};
-table.insert(x.metakernels, fullprog);
+local fullcut = maxnodes > 0 and #x.tasks > maxnodes;
+if not fullcut then table.insert(x.metakernels, fullprog); end
 
 for _,mk in pairs(x.metakernels) do
     printf("now processing %s\n", mk.name);
@@ -81,9 +94,152 @@ for _,mk in pairs(x.metakernels) do
     
     local filename = string.gsub(mk.name, " ", "-")..'.dot';
     
-    mk_dot_template:render(outdir..filename, model);
+    rendertemplate(mk_dot_template, outdir..filename, model);
     dotfiles[#dotfiles+1] = filename;
 end
 
+
+-- Quotes str for an identifier or label in a dot file (escape sequences like \n are kept)
+local dotstring = function(str)
+    return '"'..tostring(str):gsub('"', '\\"')..'"';
+end
+
+local bytestring = function(bytes)
+    if bytes >= 1024*1024 then return string.format("%.1f MiB", bytes/(1024*1024)); end
+    if bytes >= 1024 then return string.format("%.1f KiB", bytes/1024); end
+    return string.format("%d B", bytes);
+end
+
+-- Bytes passed by dependency dep, i.e. the size of the range of its source packet
+local depbytes = function(dep)
+    local size = 1;
+    for _,p in ipairs(dep.from.task.kernel and dep.from.task.kernel.packets or {}) do
+        if p.name == dep.from.packet then size = p.basetypesize; end
+    end
+    for _,rg in ipairs(dep.from.index or {}) do size = size*(rg.last - rg.first + 1); end
+    return size;
+end
+
+-- Writes a graph to outdir..filename line by line instead of rendering a view model, which is too large for big
+-- programs. At most maxnodes nodes are written, the further ones and their edges are left out and counted in a note.
+local dotwriter = function(filename, name)
+    local path = outdir..filename;
+    local fid, err = io.open(path..".lbtmp", "w");
+    if not fid then error(err); end
+    local w = {nodes=0, omitted=0, written={}, indent="    "};
+    fid:write("digraph ", dotstring(name), "\n{\n    label=", dotstring(name), ";\n    rankdir=\"LR\";\n",
+              '    fontname="Linux Biolinum";\n    edge[fontcolor="red" fontname="Linux Biolinum"];\n',
+              '    node[shape=box style=rounded fontname="Linux Biolinum"];\n\n');
+    w.line = function(str) fid:write(w.indent, str, "\n"); end
+    w.node = function(id, attrs)
+        if maxnodes > 0 and w.nodes >= maxnodes then
+            w.omitted = w.omitted + 1;
+            return;
+        end
+        w.nodes = w.nodes + 1;
+        w.written[id] = true;
+        w.line(dotstring(id).." ["..attrs.."];");
+    end
+    w.edge = function(from, to, attrs)
+        if w.written[from] and w.written[to] then w.line(dotstring(from).." -> "..dotstring(to).." ["..attrs.."];"); end
+    end
+    w.close = function()
+        if w.omitted > 0 then
+            w.line(string.format('"[omitted]" [shape=note label="%d more nodes omitted (-maxnodes=%d)"];',
+                                 w.omitted, maxnodes));
+            printf("%s: %d of %d nodes omitted\n", filename, w.omitted, w.nodes + w.omitted);
+        end
+        fid:write("}\n");
+        io.close(fid);
+        if updateoutput(path..".lbtmp", path) then printf("writing %s\n", path);
+        else vprintf("unchanged %s\n", path); end
+    end
+    return w;
+end
+
+-- The full program as plain nodes, cut at maxnodes tasks
+if fullcut then
+    printf("now processing %s (%d tasks, cut)\n", fullprog.name, #x.tasks);
+    local w = dotwriter("full-program.dot", fullprog.name);
+    for _,task in ipairs(x.tasks) do w.node(task.name, "label="..dotstring(task.name)); end
+    for _,dep in ipairs(x.dependencies) do
+        w.edge(dep.from.task.name, dep.to.task.name,
+               "taillabel="..dotstring(dep.from.packet).." headlabel="..dotstring(dep.to.packet));
+    end
+    w.close();
+    dotfiles[#dotfiles+1] = "full-program.dot";
+end
+
+-- Collapsed view: the instances of each task of a genvar loop (i.e. of a task family) become one node with their
+-- count, per group if the program is grouped, and the groups become clusters. The edges between the nodes sum up the
+-- dependencies, and their width grows with the bytes passed.
+printf("now processing collapsed program\n");
+local groupof = {};
+for i,group in ipairs(x.groups) do
+    group.label = group.name or ("group "..(i-1));
+    for _,task in ipairs(group.members) do groupof[task] = group; end
+end
+
+local nodes, nodelist = {}, {};
+local nodeof = function(task)
+    local fam = task.family and task.family >= 0 and x.families[task.family+1];
+    local id = fam and string.format("[family %d #%d]", task.family, task.familypos % fam.period) or task.name;
+    local group = groupof[task];
+    if group then id = id.." @"..group.label; end
+    local node = nodes[id];
+    if not node then
+        node = {id=id, count=0, first=task.name, kernel=task.kernel and task.kernel.name, group=group};
+        nodes[id] = node;
+        nodelist[#nodelist+1] = node;
+    end
+    node.count = node.count + 1;
+    return node;
+end
+local tasknode = {};
+for _,task in ipairs(x.tasks) do tasknode[task] = nodeof(task); end
+tasknode[x.maintask] = nodeof(x.maintask);
+tasknode[outputs] = nodeof(outputs);
+
+local edges, edgelist, maxbytes = {}, {}, 1;
+for _,dep in ipairs(x.dependencies) do
+    local from, to = tasknode[dep.from.task], tasknode[dep.to.task];
+    local key = from.id.."\0"..to.id;
+    local edge = edges[key];
+    if not edge then
+        edge = {from=from.id, to=to.id, count=0, bytes=0};
+        edges[key] = edge;
+        edgelist[#edgelist+1] = edge;
+    end
+    edge.count = edge.count + 1;
+    edge.bytes = edge.bytes + depbytes(dep);
+    maxbytes = math.max(maxbytes, edge.bytes);
+end
+
+local w = dotwriter("collapsed.dot", "collapsed program");
+local writenode = function(node)
+    local label = node.count > 1 and string.format("%s\\n%s  x%d", node.first, node.kernel or "", node.count)
+                  or node.first;
+    w.node(node.id, "label="..dotstring(label)..(node.count > 1 and " peripheries=2" or ""));
+end
+for _,group in ipairs(x.groups) do
+    w.line("subgraph "..dotstring("cluster_"..group.label).." {");
+    w.indent = "        ";
+    w.line("label="..dotstring(group.label)..";");
+    for _,node in ipairs(nodelist) do
+        if node.group == group then writenode(node); end
+    end
+    w.indent = "    ";
+    w.line("}");
+end
+for _,node in ipairs(nodelist) do
+    if not node.group then writenode(node); end
+end
+for _,edge in ipairs(edgelist) do
+    local label = bytestring(edge.bytes)..(edge.count > 1 and string.format(" (%d)", edge.count) or "");
+    w.edge(edge.from, edge.to, string.format("label=%s penwidth=%.1f", dotstring(label), 1 + 7*edge.bytes/maxbytes));
+end
+w.close();
+dotfiles[#dotfiles+1] = "collapsed.dot";
+
 model = { appname=appname, dotfiles=dotfiles};
 render("Makefile", model)
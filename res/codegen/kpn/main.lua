@@ -0,0 +1,211 @@
+-- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+-- KPN backend: each group (from a mapping or AutoGroup) becomes a process of a Kahn process network, i.e. a thread
+-- that runs the tasks of its group in topological order, once per frame of a stream. Every channel is a lock-free
+-- single-producer/single-consumer FIFO, whose tokens hold the region of its port (cf. PlacePorts). The groups work on
+-- private copies of the buffers they use, so a group only ever waits for an empty or a full FIFO, and consecutive
+-- groups work on different frames. The FIFOs hold -pipeline tokens (default 2, rounded up to a power of two).
+
+init();
+tools.mkpath('gencode/kpn/lb-includes');
+outdir=tools.realpath('gencode/kpn')..'/';
+local lbbase = tools.basename(args.lbfile)
+
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources, output=outdir..lbbase..'.c'};
+assert(prog, nil);
+
+local result = Ladybirds.TaskTopoSort{prog} and
+        Ladybirds.CalcSuccessorMatrix{prog} and
+        (not args.mapping or Ladybirds.LoadMapping{prog, filename=args.mapping}) and
+        (args.mapping or args.groups == 0 or
+            ((not args.costs or Ladybirds.LoadCost{prog, filename=args.costs}) and
+             Ladybirds.AutoGroup{prog, groups=args.groups})) and
+        (not args.projinfo or Ladybirds.LoadProjectInfo{prog, filename=args.projinfo}) and
+        Ladybirds.PopulateGroups{prog} and
+        Ladybirds.BufferPreallocation{prog} and
+        (args.align == 0 and args.hugepages == 0 or
+            Ladybirds.AlignBuffers{prog, alignment=math.max(args.align, 1), hugepages=args.hugepages}) and
+        Ladybirds.BufferAllocation{prog} and
+        Ladybirds.PlacePorts{prog} and
+        true or error()
+
+-- bind the groups to hardware threads along the host topology (given by -topology or read from /sys)
+local binding = Ladybirds.BindGroups{prog, topology=args.topology} or error();
+
+local x = Ladybirds.Export{prog};
+
+if #x.divisions ~= 1 then
+    error("Program has "..#x.divisions.." divisions, but only one is supported.");
+end
+
+local div = x.divisions[1]
+local cachelinesize = 64
+local fifodepth = 1;
+while fifodepth < math.max(args.pipeline, 2) do fifodepth = fifodepth*2; end
+
+-- data type checks
+local basetypesizes={}
+for _,kernel in pairs(x.kernels) do
+    for _,packet in ipairs(kernel.packets) do
+        basetypesizes[packet.basetype] = packet.basetypesize
+    end
+end
+for _,packet in ipairs(x.maintask.kernel.packets) do
+    packet.streamparamstring = packet.paramstring:gsub("void %* _lb_base_", "void * const * _lb_frames_");
+end
+
+local extargs = {};
+for i, buffer in ipairs(div.buffers) do
+    buffer.align = math.max(buffer.alignment, 8);
+    buffer.index = i;
+end
+for _,buffer in ipairs(x.externalbuffers) do
+    local idx = buffer.extargindex;
+    buffer.name = "ExternalFrames["..idx.."][_frame]"
+    buffer.callparam = "ExternalBuffers["..idx.."].Dimensions"
+    extargs[#extargs+1] = {index=#extargs, argname=x.maintask.kernel.packets[idx+1].name};
+end
+
+-- number the tasks, run the operations of each group in topological order, and give each group its own copies of
+-- the buffers it uses
+local topoindex = {};
+for i,task in ipairs(x.tasks) do
+    task.kpnid = i-1;
+    topoindex[task] = i;
+end
+local boundcpus = {};
+for _,entry in ipairs(binding.bindings) do boundcpus[entry.group] = entry.cpu; end
+for i,group in ipairs(x.groups) do
+    group.number = i-1;
+    group.targetcore = boundcpus[group.name] or -1;
+    table.sort(group.operations, function(a, b) return topoindex[a.task] < topoindex[b.task]; end);
+
+    local copies = {};
+    group.buffers, group.buffername = {}, {};
+    for _,op in ipairs(group.operations) do
+        for _,iface in ipairs(op.task.ifaces) do
+            local buffer = iface.buffer;
+            if buffer and not buffer.isexternal and not copies[buffer] then
+                copies[buffer] = {name="_g"..group.number.."_buffer_"..buffer.index, size=buffer.size,
+                                  align=buffer.align};
+                group.buffers[#group.buffers+1] = copies[buffer];
+            end
+            iface.bufname = buffer and (copies[buffer] and copies[buffer].name or buffer.name) or "0";
+        end
+    end
+    for buffer,copy in pairs(copies) do group.buffername[buffer] = copy.name; end
+end
+
+-- the rows of the region of a port, relative to the start of its buffer (the last dimension is given in bytes)
+local regionrows = function(port)
+    local buffer = port.iface.buffer;
+    if not port.bufferdims or #port.bufferdims == 0 then
+        return {{offset=0, pitch=buffer.size, width=buffer.size, height=1}};
+    end
+    local sizes, extents, starts, stride, rest = {}, {}, {}, 1, port.offset;
+    for i = #port.bufferdims, 1, -1 do
+        sizes[i], extents[i] = port.bufferdims[i], port.dims[i];
+        starts[i] = (rest // stride) % sizes[i];
+        stride = stride * sizes[i];
+    end
+    -- merge inner dimensions that are covered completely
+    while #sizes > 1 and extents[#sizes] == sizes[#sizes] do
+        local n = #sizes;
+        sizes[n-1], extents[n-1], starts[n-1] = sizes[n-1]*sizes[n], extents[n-1]*sizes[n], starts[n-1]*sizes[n];
+        sizes[n], extents[n], starts[n] = nil, nil, nil;
+    end
+    local n = #sizes;
+    local pitch = sizes[n];
+    local height = n > 1 and extents[n-1] or 1;
+    local rows = {};
+    -- one block of rows for each index of the outer dimensions
+    local enumerate;
+    enumerate = function(dim, base)
+        if dim >= n-1 then
+            local offset = base;
+            if n > 1 then offset = offset*sizes[n-1] + starts[n-1]; end
+            rows[#rows+1] = {offset=offset*pitch + starts[n], pitch=pitch, width=extents[n], height=height};
+            return;
+        end
+        for i = starts[dim], starts[dim]+extents[dim]-1 do enumerate(dim+1, base*sizes[dim] + i); end
+    end
+    enumerate(1, 0);
+    return rows;
+end
+
+local tokensize = function(rows)
+    local size = 0;
+    for _,r in ipairs(rows) do size = size + r.width*r.height; end
+    return size;
+end
+
+-- Channels of external buffers and without data (cf. Channel::Dep) only synchronize, as all groups access the same
+-- external memory of a frame.
+local fifoof = {};
+for i,channel in ipairs(x.channels) do
+    channel.number = i-1;
+    fifoof[channel.from], fifoof[channel.to] = channel, channel;
+    local buffer = channel.from.iface.buffer;
+    if channel.hasdata and buffer and not buffer.isexternal then
+        channel.pushrows, channel.poprows = regionrows(channel.from), regionrows(channel.to);
+        local size = tokensize(channel.pushrows);
+        if size ~= tokensize(channel.poprows) then
+            error("The ports of channel "..i.." have regions of different sizes.");
+        end
+        channel.carriesdata = size > 0 or nil;
+        channel.slotsize = (size + cachelinesize-1) // cachelinesize * cachelinesize;
+    end
+    channel.slotsize = channel.carriesdata and channel.slotsize or 0;
+    channel.data = channel.carriesdata and "FifoData"..channel.number or "0";
+end
+
+local fifocall = function(channel, group, port, rows, rowsname)
+    if not channel.carriesdata then return {fifo=channel.number, buffer="0", rows="0", nrows=0}; end
+    return {fifo=channel.number, buffer=group.buffername[port.iface.buffer], rows=rowsname..channel.number,
+            nrows=#rows};
+end
+for _,group in ipairs(x.groups) do
+    for _,op in ipairs(group.operations) do
+        op.pops, op.pushes = {}, {};
+        for _,port in ipairs(op.inputs or {}) do
+            local chan = fifoof[port];
+            if chan then op.pops[#op.pops+1] = fifocall(chan, group, port, chan.poprows, "PopRows"); end
+        end
+        for _,port in ipairs(op.outputs or {}) do
+            local chan = fifoof[port];
+            if chan then op.pushes[#op.pushes+1] = fifocall(chan, group, port, chan.pushrows, "PushRows"); end
+        end
+    end
+end
+vprintf("KPN: %d groups, %d FIFOs of %d tokens\n", #x.groups, #x.channels, fifodepth);
+
+
+-- Copy all required C files and create a list of object files
+local ofiles = addlbobjects{"main.o", "fifo.o", "experiment.o", lbbase..'.o'}
+
+for _,file in ipairs(x.codefiles) do
+    copy(file);
+    if file:match('%.c$') then
+        ofiles[#ofiles+1] = file:gsub('%.c$', '.o')
+    end
+end
+
+for _,file in ipairs(x.auxfiles) do
+    copy(file);
+end
+
+
+--create view model
+model = { appname=appname, ofiles=ofiles, definitions=x.definitions, typeckecks=map2array(basetypesizes), 
+    kernels=x.kernels, tasks=x.tasks, maintask=x.maintask, groups=x.groups, groupcount=#x.groups,
+    MainEntryArguments=extargs, ExternalBufferCount=math.max(#extargs, 1),
+    channels=x.channels, FifoCount=math.max(#x.channels, 1), fifodepth=fifodepth, cachelinesize=cachelinesize };
+
+render("Makefile", model)
+render("global.h", model)
+render("fifo.h", model)
+render("fifo.c", model)
+render("main.c", model)
+render("lb-includes/ladybirds.h", model)
+rendercommon("experiment.h", model)
+rendercommon("experiment.c", model)
@@ -0,0 +1,181 @@
+-- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+-- MPI backend: each group (from a mapping or AutoGroup) becomes an MPI rank, which runs the tasks of its group one
+-- after the other. The channels between the groups are sent with non-blocking MPI_Isend/MPI_Irecv of the regions
+-- their ports describe (cf. PlacePorts), using subarray datatypes. Receives are posted as early as the buffer they
+-- write to allows, and a task only waits for the receives it needs. All ranks hold the same buffer layout.
+
+init();
+tools.mkpath('gencode/mpi/lb-includes');
+outdir=tools.realpath('gencode/mpi')..'/';
+local lbbase = tools.basename(args.lbfile)
+
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources, output=outdir..lbbase..'.c'};
+assert(prog, nil);
+
+local result = Ladybirds.TaskTopoSort{prog} and
+        Ladybirds.CalcSuccessorMatrix{prog} and
+        (not args.mapping or Ladybirds.LoadMapping{prog, filename=args.mapping}) and
+        (args.mapping or args.groups == 0 or
+            ((not args.costs or Ladybirds.LoadCost{prog, filename=args.costs}) and
+             Ladybirds.AutoGroup{prog, groups=args.groups})) and
+        (not args.projinfo or Ladybirds.LoadProjectInfo{prog, filename=args.projinfo}) and
+        Ladybirds.PopulateGroups{prog} and
+        Ladybirds.BufferPreallocation{prog} and
+        (args.align == 0 and args.hugepages == 0 or
+            Ladybirds.AlignBuffers{prog, alignment=math.max(args.align, 1), hugepages=args.hugepages}) and
+        Ladybirds.BufferAllocation{prog} and
+        Ladybirds.PlacePorts{prog} and
+        true or error()
+
+local x = Ladybirds.Export{prog};
+
+if #x.divisions ~= 1 then
+    error("Program has "..#x.divisions.." divisions, but only one is supported.");
+end
+
+local div = x.divisions[1]
+
+-- data type checks
+local basetypesizes={}
+for _,kernel in pairs(x.kernels) do
+    for _,packet in ipairs(kernel.packets) do
+        basetypesizes[packet.basetype] = packet.basetypesize
+    end
+end
+
+-- give buffers names
+local extargs = {};
+for i, buffer in ipairs(div.buffers) do
+    buffer.align = math.max(buffer.alignment, 8);
+    buffer.name = "_buffer_"..i;
+end
+for _,buffer in ipairs(x.externalbuffers) do
+    local idx = buffer.extargindex;
+    buffer.name = "ExternalBuffers["..idx.."].Base"
+    buffer.callparam = "ExternalBuffers["..idx.."].Dimensions"
+    extargs[#extargs+1] = {index=#extargs, argname=x.maintask.kernel.packets[idx+1].name};
+end
+
+-- number the tasks, and run the operations of each group in topological order
+local topoindex = {};
+for i,task in ipairs(x.tasks) do
+    task.mpiid = i-1;
+    topoindex[task] = i;
+end
+for i,group in ipairs(x.groups) do
+    group.number = i-1;
+    for _,op in ipairs(group.operations) do op.task.rank = i-1; end
+    table.sort(group.operations, function(a, b) return topoindex[a.task] < topoindex[b.task]; end);
+end
+
+-- the datatype of a port: the subarray of its buffer it covers, with the last dimension in bytes
+local porttype = function(port)
+    local buffer = port.iface.buffer;
+    if not port.bufferdims or #port.bufferdims == 0 then
+        return {ndims=1, sizes=tostring(buffer.size), subsizes=tostring(buffer.size), starts="0"};
+    end
+    local starts, stride, rest = {}, 1, port.offset;
+    for i = #port.bufferdims, 1, -1 do
+        starts[i] = (rest // stride) % port.bufferdims[i];
+        stride = stride * port.bufferdims[i];
+    end
+    return {ndims=#port.bufferdims, sizes=table.concat(port.bufferdims, ", "), subsizes=table.concat(port.dims, ", "),
+            starts=table.concat(starts, ", ")};
+end
+
+local channelof = {};
+local channels = {};
+for i,channel in ipairs(x.channels) do
+    channel.number = i-1;
+    channel.sendtype = porttype(channel.from);
+    channel.recvtype = porttype(channel.to);
+    channelof[channel.from], channelof[channel.to] = channel, channel;
+    channels[#channels+1] = channel;
+end
+
+for _,group in ipairs(x.groups) do
+    for _,op in ipairs(group.operations) do
+        for _,port in ipairs(op.outputs or {}) do
+            if channelof[port] then channelof[port].fromrank = group.number; end
+        end
+        for _,port in ipairs(op.inputs or {}) do
+            if channelof[port] then channelof[port].torank = group.number; end
+        end
+    end
+end
+
+-- Walk through the operations of each rank, and note when to post, wait for and complete each transfer. A receive is
+-- posted after the last operation before its consumer that accesses the same buffer, and a buffer is only written
+-- (or received into) again once the sends from it have completed.
+for _,group in ipairs(x.groups) do
+    local lastaccess, pendingsends = {}, {};
+    local waitforsends = function(buffer)
+        local ret = {};
+        for _,number in ipairs(pendingsends[buffer] or {}) do ret[#ret+1] = {channel=number}; end
+        pendingsends[buffer] = nil;
+        return ret;
+    end
+    
+    group.initialrecvs, group.sends = {}, {};
+    for pos,op in ipairs(group.operations) do
+        op.waitsends, op.waitrecvs, op.postsends, op.postrecvs = {}, {}, {}, {};
+        -- all sends from a buffer were posted by operations accessing it, i.e. at the latest by lastaccess
+        for _,port in ipairs(op.inputs or {}) do
+            local chan = channelof[port];
+            if chan then
+                local buffer = port.iface.buffer;
+                local recv = {channel=chan.number, buffer=buffer.name, rank=chan.fromrank,
+                              sendsbefore=waitforsends(buffer)};
+                local prev = lastaccess[buffer] and group.operations[lastaccess[buffer]];
+                table.insert(prev and prev.postrecvs or group.initialrecvs, recv);
+                op.waitrecvs[#op.waitrecvs+1] = {channel=chan.number};
+            end
+        end
+        for _,iface in ipairs(op.task.ifaces) do
+            if iface.buffer and iface.packet.dir ~= "in" then
+                for _,wait in ipairs(waitforsends(iface.buffer)) do op.waitsends[#op.waitsends+1] = wait; end
+            end
+            if iface.buffer then lastaccess[iface.buffer] = pos; end
+        end
+        for _,port in ipairs(op.outputs or {}) do
+            local chan = channelof[port];
+            if chan then
+                local buffer = port.iface.buffer;
+                op.postsends[#op.postsends+1] = {channel=chan.number, buffer=buffer.name, rank=chan.torank};
+                group.sends[#group.sends+1] = {channel=chan.number};
+                pendingsends[buffer] = pendingsends[buffer] or {};
+                table.insert(pendingsends[buffer], chan.number);
+            end
+        end
+    end
+end
+
+
+-- Copy all required C files and create a list of object files
+local ofiles = addlbobjects{"main.o", "experiment.o", lbbase..'.o'}
+
+for _,file in ipairs(x.codefiles) do
+    copy(file);
+    if file:match('%.c$') then
+        ofiles[#ofiles+1] = file:gsub('%.c$', '.o')
+    end
+end
+
+for _,file in ipairs(x.auxfiles) do
+    copy(file);
+end
+
+
+--create view model
+model = { appname=appname, ofiles=ofiles, definitions=x.definitions, typeckecks=map2array(basetypesizes), 
+    kernels=x.kernels, buffers=div.buffers, tasks=x.tasks, maintask=x.maintask, groups=x.groups,
+    MainEntryArguments=extargs, ExternalBufferCount=math.max(#extargs, 1),
+    channels=channels, ChannelCount=math.max(#channels, 1), RankCount=#x.groups, mpi=true };
+
+render("Makefile", model)
+render("global.h", model)
+render("main.c", model)
+render("lb-includes/ladybirds.h", model)
+rendercommon("experiment.h", model)
+rendercommon("experiment.c", model)
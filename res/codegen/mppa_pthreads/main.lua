@@ -1,5 +1,10 @@
 -- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+-- MPPA pthreads backend: the groups run as threads on the 16 processing elements (PEs) of one compute cluster, which
+-- all share the memory of the cluster. With a mapping whose groups are named after the PEs (pe0 to pe15), the groups
+-- are bound to these PEs and the program is list scheduled on the cluster (cf. ListSchedule); each thread then prefers
+-- its tasks in the order of their scheduled start times.
+
 init();
 
 lfs.mkdir('gencode');
@@ -7,140 +12,149 @@ lfs.mkdir('gencode/mppa_pthreads');
 lfs.mkdir('gencode/mppa_pthreads/lb-includes');
 
 outdir = tools.realpath('gencode/mppa_pthreads')..'/';
+local lbbase = tools.basename(args.lbfile)
 
 local bitfieldvarsize = 64
 
+-- the compute cluster: 16 PEs on a shared memory of 2 MiB
+local nCores, clustermemsize = 16, 2<<20;
+local cluster = Ladybirds.CreatePlatform();
+local k1 = cluster:addcoretype{name="k1"};
+local smem = cluster:addmem{name="smem", size=clustermemsize};
+for pe = 0, nCores-1 do
+    local core = cluster:addcore{name="pe"..pe, type=k1};
+    cluster:addlink{core=core, mem=smem, readcost=10, writecost=10};
+end
+
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources, output=outdir..lbbase..'.c'};
+assert(prog, nil);
+
+local result = Ladybirds.TaskTopoSort{prog} and
+        Ladybirds.CalcSuccessorMatrix{prog} and
+        (not args.mapping or Ladybirds.LoadMapping{prog, filename=args.mapping, platform=cluster}) and
+        (not args.mapping or (args.costs and Ladybirds.LoadCost{prog, filename=args.costs}) or
+            (not args.costs and Ladybirds.EstimateCosts{prog})) and
+        (not args.projinfo or Ladybirds.LoadProjectInfo{prog, filename=args.projinfo}) and
+        Ladybirds.PopulateGroups{prog} and
+        Ladybirds.BufferPreallocation{prog} and
+        Ladybirds.BufferAllocation{prog} and
+        true or error()
+
+local schedule = args.mapping and (Ladybirds.ListSchedule{prog, platform=cluster} or error());
+if schedule then vprintf("Predicted makespan on the cluster: %g\n", schedule.makespan); end
+
+local x = Ladybirds.Export{prog};
+
+if #x.divisions ~= 1 then
+    error("Program has "..#x.divisions.." divisions, but only one is supported.");
+end
+local div = x.divisions[1]
 
+-- without a mapping to PEs, the groups are spread over the PEs in turn (PE 0 also runs the main thread)
 local distribute = function(n)
-    local nCores = 16;    -- the MPPA-256 has 16 cores per cluster
-    return n % nCores + 1;
+    return n % nCores;
 end;
 
 -- data type checks
-basetypesizes={}
-for _, kernel in pairs(kernels) do
+local basetypesizes={}
+for _, kernel in pairs(x.kernels) do
     for _, packet in ipairs(kernel.packets) do
         basetypesizes[packet.basetype] = packet.basetypesize
     end
 end
 
--- give buffers names
-for i, buffer in ipairs(buffers) do
-    buffer.name = "_buffer_"..i;
+-- give buffers names; all of them live in the cluster memory
+local buffersize = 0;
+for i, buffer in ipairs(div.buffers) do
+    if buffer.isexternal then
+        local argname = x.maintask.kernel.packets[buffer.extargindex+1].name;
+        buffer.name = "_lb_base_"..argname;
+    else
+        buffer.name = "_buffer_"..i;
+        buffersize = buffersize + buffer.size;
+    end
+end
+if buffersize > clustermemsize then
+    error(string.format("The buffers need %d bytes, but the cluster memory only has %d.", buffersize, clustermemsize));
 end
 
 -- assign channel numbers
-for i, channel in ipairs(channels) do
+for i, channel in ipairs(x.channels) do
     local n = i-1;
     channel.number = n;
     channel.from.number = n;
     channel.to.number = n;
 end
 
-local curfieldindex = 0
-local nextindex = function(index, id)
-    id = id+1
-    if id >= bitfieldvarsize then
-        return index+1, 0
-    else
-        return index, id
+-- order the operations of each group by their scheduled start, which GetNextTask follows among the ready tasks
+if schedule then
+    local start = {};
+    for _,entry in ipairs(schedule.timings) do start[entry.task] = entry.start; end
+    for _,group in ipairs(x.groups) do
+        for i,op in ipairs(group.operations) do op.position = i; end
+        table.sort(group.operations, function(a, b)
+            local sa, sb = start[a.task.name] or 0, start[b.task.name] or 0;
+            if sa ~= sb then return sa < sb; end
+            return a.position < b.position;
+        end);
     end
 end
 
+-- the bits of the tasks and the checks of their predecessors (cf. ExportRuntimeTables), each group in its own words
+local tablegroups, tabledeps = {}, {};
+for i,group in ipairs(x.groups) do
+    local names = {};
+    for id,op in ipairs(group.operations) do names[id] = op.task.name; end
+    tablegroups[i] = names;
+end
+for i,dep in ipairs(x.dependencies) do tabledeps[i] = {from=dep.from.task.name, to=dep.to.task.name}; end
+local tables = Ladybirds.ExportRuntimeTables{prog, groups=tablegroups, deps=tabledeps, wordbits=bitfieldvarsize}
+               or error();
+local curfieldindex = tables.length;
+
 -- give groups names and operations ids
-for i,group in ipairs(groups) do
+for i,group in ipairs(x.groups) do
+    local pe = args.mapping and group.name:match("^pe(%d+)$");
+    group.targetcore = pe and tonumber(pe) or distribute(i-1);
     group.name = "_Thread"..i;
     group.number = i-1;
-    group.targetcore = distribute(i-1);
-    group.localfieldindexmin = curfieldindex
     
-    local curfieldid = 0
     for id,op in ipairs(group.operations) do
+        local entry = tables.groups[i].ops[id];
         op.id = id;
         op.task.group = group;
-        op.task.bitfield = 1<<curfieldid
-        op.task.bitfieldhex = string.format("%#x", 1<<curfieldid)
-        op.task.bitfieldindex = curfieldindex
-        op.task.taskdeps = {}
-        
-        curfieldindex, curfieldid = nextindex(curfieldindex, curfieldid)
-    end
-    
-    group.localfieldindexmax = curfieldindex
-    curfieldindex = curfieldindex+1;--start new field for new thread (only one thread writes to each field variable)
-end
-
-taskdeps={}
-
---fill the task dependencies bitfield tables
-for _,dep in ipairs(dependencies) do
-    local src = dep.from.task;
-    local deplist = dep.to.task.taskdeps;
-
-    deplist[src.bitfieldindex] = (deplist[src.bitfieldindex] or 0) | src.bitfield;
-end
-
--- fill bitfield output for each operation
-for i,group in ipairs(groups) do
-    local dataoffset = 0;
-    
-    for _,op in ipairs(group.operations) do
-        op.checkstart = dataoffset;
-        
-        local mydeps, mydepindices, otherdeps, otherdepindices = "", "", "", ""
-        for index,data in pairs(op.task.taskdeps) do
-            if index >= group.localfieldindexmin and index <= group.localfieldindexmax then
-                mydepindices = mydepindices .. index .. ", ";
-                mydeps = mydeps .. string.format("%#x, ", data)
-            else
-                otherdepindices = otherdepindices .. index .. ", ";
-                otherdeps = otherdeps .. string.format("%#x, ", data)
-            end
-            dataoffset = dataoffset+1
-        end
-        
-        op.depfieldindices = mydepindices .. otherdepindices;
-        op.depfielddata = mydeps .. otherdeps;
-        op.checkend = dataoffset;
+        op.task.bitfieldhex, op.task.bitfieldindex = entry.bit, entry.index;
+        op.depfieldindices, op.depfielddata = entry.indices, entry.data;
+        op.checkstart, op.checkend = entry.checkstart, entry.checkend;
     end
 end
 
 -- set bindings
 local bindings = {}
-for i, group in ipairs(groups) do
-    bindings[i] = {group = group.name, target = distribute(i-1)};
+for i, group in ipairs(x.groups) do
+    bindings[i] = {group = group.name, target = group.targetcore};
 end
 
 
--- Collect all required C files
-cfiles={}
-for _, task in ipairs(tasks) do
-    cfiles[task.kernel.codefile] = true;
-end
-
 -- Copy all required C files and create a list of object files
-ofiles = {"main.o", "experiment.o", "events.o", "taskmanagement.o"}
-for cfile in pairs(cfiles) do
-    copy(cfile);
-    ofiles[#ofiles+1] = cfile:gsub('%.c$', '.o')
-end
+ofiles = addlbobjects{"main.o", "experiment.o", "events.o", "taskmanagement.o", lbbase..'.o'}
 
-for _, file in ipairs(codefiles) do
+for _, file in ipairs(x.codefiles) do
     copy(file);
     if file:match('%.c$') then
         ofiles[#ofiles+1] = file:gsub('%.c$', '.o')
     end
 end
 
-for _, file in ipairs(auxfiles) do
+for _, file in ipairs(x.auxfiles) do
     copy(file);
 end
 
 
 --create view model
-model = { appname=appname, ofiles=ofiles, definitions=definitions, typeckecks=map2array(basetypesizes),
-    kernels=marklast(kernels, "packets"), buffers=buffers, tasks=tasks, channels=channels, groups=groups,
-    bindings=bindings, auxfiles=auxfiles, channelcount=#channels, threadcount=#groups, maintask=maintask,
+model = { appname=appname, ofiles=ofiles, definitions=x.definitions, typeckecks=map2array(basetypesizes),
+    kernels=x.kernels, buffers=div.buffers, tasks=x.tasks, channels=x.channels, groups=x.groups,
+    bindings=bindings, auxfiles=x.auxfiles, channelcount=#x.channels, threadcount=#x.groups, maintask=x.maintask,
     TaskBitfieldUnitSize=bitfieldvarsize, TaskBitfieldLength=curfieldindex};
 
 render("Makefile", model)
@@ -155,11 +169,9 @@ render("taskmanagement.h", model)
 render("taskmanagement.c", model)
 render("lb-includes/ladybirds.h", model)
 
-thread_c_template = fastache.parse(resdir.."thread.c.mustache")
-
-for _,group in ipairs(groups) do
-    local fn = outdir..group.name..".c";
-    printf("writing %s\n", fn);
-    thread_c_template:render(fn, group)
+local jobs = {};
+for _,group in ipairs(x.groups) do
+    jobs[#jobs+1] = {template=resdir.."thread.c.mustache", model=group, output=outdir..group.name..".c"};
 end
+renderall(jobs);
 
@@ -0,0 +1,99 @@
+-- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+-- OpenMP backend: the flattened task graph is emitted as OpenMP tasks, which are created in topological order by a
+-- single thread and scheduled by the OpenMP runtime (thread binding and wait policy are configured as usual, e.g.
+-- via OMP_PROC_BIND and OMP_WAIT_POLICY). Each task has a dependency object, and it depends on the objects of the
+-- predecessors it has to wait for (cf. SyncPoints). The buffers are laid out by BufferAllocation.
+
+init();
+tools.mkpath('gencode/openmp/lb-includes');
+outdir=tools.realpath('gencode/openmp')..'/';
+local lbbase = tools.basename(args.lbfile)
+
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources, output=outdir..lbbase..'.c'};
+assert(prog, nil);
+
+local result = Ladybirds.TaskTopoSort{prog} and
+        Ladybirds.CalcSuccessorMatrix{prog} and
+        (not args.mapping or Ladybirds.LoadMapping{prog, filename=args.mapping}) and
+        (not args.projinfo or Ladybirds.LoadProjectInfo{prog, filename=args.projinfo}) and
+        Ladybirds.PopulateGroups{prog} and
+        Ladybirds.BufferPreallocation{prog} and
+        (args.align == 0 and args.hugepages == 0 or
+            Ladybirds.AlignBuffers{prog, alignment=math.max(args.align, 1), hugepages=args.hugepages}) and
+        Ladybirds.BufferAllocation{prog} and
+        true or error()
+
+-- only depend on the predecessors that are not implied by others
+local syncs = Ladybirds.SyncPoints{prog} or error();
+local x = Ladybirds.Export{prog};
+
+if #x.divisions ~= 1 then
+    error("Program has "..#x.divisions.." divisions, but only one is supported.");
+end
+
+local div = x.divisions[1]
+
+-- data type checks
+local basetypesizes={}
+for _,kernel in pairs(x.kernels) do
+    for _,packet in ipairs(kernel.packets) do
+        basetypesizes[packet.basetype] = packet.basetypesize
+    end
+end
+
+-- give buffers names
+local extargs = {};
+for i, buffer in ipairs(div.buffers) do
+    buffer.align = math.max(buffer.alignment, 8);
+    buffer.name = "_buffer_"..i;
+end
+for _,buffer in ipairs(x.externalbuffers) do
+    local idx = buffer.extargindex;
+    buffer.name = "ExternalBuffers["..idx.."].Base"
+    buffer.callparam = "ExternalBuffers["..idx.."].Dimensions"
+    extargs[#extargs+1] = {index=#extargs, argname=x.maintask.kernel.packets[idx+1].name};
+end
+
+-- number the tasks, and list the predecessors each of them depends on
+local ids = {};
+for i,task in ipairs(x.tasks) do
+    task.ompid = i-1;
+    task.waits = {};
+    ids[task.name] = i-1;
+end
+for _,entry in ipairs(syncs.syncs) do
+    local task = ids[entry.task] and x.tasks[ids[entry.task]+1];
+    for _,pred in ipairs(task and entry.waits or {}) do
+        if ids[pred] then task.waits[#task.waits+1] = {pred=ids[pred]}; end
+    end
+end
+
+
+-- Copy all required C files and create a list of object files
+local ofiles = addlbobjects{"main.o", "experiment.o", lbbase..'.o'}
+
+for _,file in ipairs(x.codefiles) do
+    copy(file);
+    if file:match('%.c$') then
+        ofiles[#ofiles+1] = file:gsub('%.c$', '.o')
+    end
+end
+
+for _,file in ipairs(x.auxfiles) do
+    copy(file);
+end
+
+
+--create view model
+model = { appname=appname, ofiles=ofiles, definitions=x.definitions, typeckecks=map2array(basetypesizes), 
+    kernels=x.kernels, buffers=div.buffers, tasks=x.tasks, maintask=x.maintask,
+    MainEntryArguments=extargs, ExternalBufferCount=math.max(#extargs, 1),
+    TaskCount=math.max(#x.tasks, 1) };
+
+render("Makefile", model)
+render("global.h", model)
+render("main.c", model)
+render("lb-includes/ladybirds.h", model)
+rendercommon("experiment.h", model)
+rendercommon("experiment.c", model)
@@ -1,207 +1,997 @@
 -- Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
-init();
-tools.mkpath('gencode/pthreads-dynamic/lb-includes');
-outdir=tools.realpath('gencode/pthreads-dynamic')..'/';
-local lbbase = tools.basename(args.lbfile)
-
-local prog = Ladybirds.Parse{filename=args.lbfile, output=outdir..lbbase..'.c'};
-assert(prog, nil);
-
-local result = Ladybirds.TaskTopoSort{prog} and
-        Ladybirds.CalcSuccessorMatrix{prog} and
-        (not args.mapping or Ladybirds.LoadMapping{prog, filename=args.mapping}) and
-        (not args.projinfo or Ladybirds.LoadProjectInfo{prog, filename=args.projinfo}) and
-        Ladybirds.PopulateGroups{prog} and
-        Ladybirds.BufferPreallocation{prog} and
-        Ladybirds.BufferAllocation{prog} and
-        true or error()
-
-local x = Ladybirds.Export{prog};
-
-
-
-local bitfieldvarsize = 64
-
-if #x.divisions ~= 1 then
-    error("Program has "..#x.divisions.." divisions, but only one is supported.");
-end
-
---[[
--- Xeon Phi Mode: 60 cores, 4 threads/core
-local distribute = function(n)
-    local nCores = 60;
-    local nHwThreads = nCores*4;
-
-    if n % nHwThreads == nHwThreads-1 then return 0;
-    else return (n*4)%(nHwThreads-1) + 1; end;
-end;]]--
-
-local distribute = function(n)
-    return n%4;
-end
-
-
--- data type checks
-local basetypesizes={}
-for _,kernel in pairs(x.kernels) do
-    for _,packet in ipairs(kernel.packets) do
-        basetypesizes[packet.basetype] = packet.basetypesize
-    end
-end
-
-local div = x.divisions[1]
-
--- give buffers names
-local extargs = {};
-for i, buffer in ipairs(div.buffers) do
-    buffer.name = "_buffer_"..i;
-end
-
-for _,buffer in ipairs(x.externalbuffers) do
-    local idx = buffer.extargindex;
-    buffer.name = "ExternalBuffers["..idx.."].Base"
-    buffer.callparam = "ExternalBuffers["..idx.."].Dimensions"
-    extargs[#extargs+1] = {index=#extargs, argname=x.maintask.kernel.packets[idx+1].name};
-end
-
-local listbuffers = function(ports)
-    local ret = "";
-    for i,port in ipairs(ports) do
-        if i > 1 then ret = ret..", "; end;
-        ret = ret..port.iface.buffer.name;
-    end
-    return ret;
-end
-
-for i,channel in ipairs(x.channels) do
-    local n = i-1;
-    channel.number = n;
-    channel.from.number = n;
-    channel.to.number = n;
-end
-
-local curfieldindex = 0
-local nextindex = function(index, id)
-    id = id+1
-    if id >= bitfieldvarsize then
-        return index+1, 0
-    else
-        return index, id
-    end
-end
-
-
--- give groups names and operations ids
-for i,group in ipairs(x.groups) do
-    group.name = "_Thread"..i;
-    group.number = i-1;
-    group.targetcore = distribute(i-1);
-    group.localfieldindexmin = curfieldindex
-    
-    local curfieldid = 0
-    for id,op in ipairs(group.operations) do
-        op.id = id;
-        op.task.group = group;
-        op.task.bitfield = 1<<curfieldid
-        op.task.bitfieldhex = string.format("%#x", 1<<curfieldid)
-        op.task.bitfieldindex = curfieldindex
-        op.task.taskdeps = {}
-        
-        curfieldindex, curfieldid = nextindex(curfieldindex, curfieldid)
-    end
-    
-    group.localfieldindexmax = curfieldindex
-    curfieldindex = curfieldindex+1;--start new field for new thread (only one thread writes to each field variable)
-end
-
-local taskdeps={}
-x.maintask.bitfield = 0;
-x.maintask.bitfieldindex = 1; --wrong index, but don't care since the bitfield is zero anyway...
-x.maintask.taskdeps = {};
---fill the task dependencies bitfield tables
-for _,dep in ipairs(x.dependencies) do
-    local src = dep.from.task;
-    local deplist = dep.to.task.taskdeps;
-
-    deplist[src.bitfieldindex] = (deplist[src.bitfieldindex] or 0) | src.bitfield;
-end
-
-
--- fill bitfield output for each operation
-for i,group in ipairs(x.groups) do
-    local dataoffset = 0;
-    
-    for _,op in ipairs(group.operations) do
-        op.checkstart = dataoffset;
-        
-        local mydeps, mydepindices, otherdeps, otherdepindices = "", "", "", ""
-        for index,data in pairs(op.task.taskdeps) do
-            if index >= group.localfieldindexmin and index <= group.localfieldindexmax then
-                mydepindices = mydepindices .. index .. ", ";
-                mydeps = mydeps .. string.format("%#x, ", data)
-            else
-                otherdepindices = otherdepindices .. index .. ", ";
-                otherdeps = otherdeps .. string.format("%#x, ", data)
-            end
-            dataoffset = dataoffset+1
-        end
-        
-        op.depfieldindices = mydepindices .. otherdepindices;
-        op.depfielddata = mydeps .. otherdeps;
-        op.checkend = dataoffset;
-    end
-end
-
-
-local bindings = {}
-for i,group in ipairs(x.groups) do
-    bindings[i] = {group = group.name, target = distribute(i-1)};
-end
-
-
-
-
--- Copy all required C files and create a list of object files
-ofiles = {"main.o", "experiment.o", "events.o", "taskmanagement.o", lbbase..'.o'}
-
-for _,file in ipairs(x.codefiles) do
-    copy(file);
-    if file:match('%.c$') then
-        ofiles[#ofiles+1] = file:gsub('%.c$', '.o')
-    end
-end
-
-for _,file in ipairs(x.auxfiles) do
-    copy(file);
-end
-
-
-
---create view model
-model = { appname=appname, ofiles=ofiles, definitions=x.definitions, typeckecks=map2array(basetypesizes), 
-    kernels=x.kernels, buffers=div.buffers, tasks=x.tasks, channels=x.channels, groups=x.groups,
-    bindings=bindings, auxfiles=x.auxfiles, channelcount=#x.channels, threadcount=#x.groups, maintask=x.maintask,
-    TaskBitfieldUnitSize=bitfieldvarsize, TaskBitfieldLength=curfieldindex,
-
-    MainEntryArguments=extargs, ExternalBufferCount=#extargs};
-
-render("Makefile", model)
-render("main.c", model)
-render("global.h", model)
-render("buffers.h", model)
-render("experiment.h", model)
-render("experiment.c", model)
-render("events.h", model)
-render("events.c", model)
-render("taskmanagement.h", model)
-render("taskmanagement.c", model)
-render("lb-includes/ladybirds.h", model)
-
-thread_c_template = fastache.parse(resdir.."thread.c.mustache")
-
-for _,group in ipairs(x.groups) do
-    local fn = outdir..group.name..".c";
-    printf("writing %s\n", fn);
-    thread_c_template:render(fn, group)
-end
+init();
+applytuned(); -- the knobs found by the autotune backend, unless given on the command line
+tools.mkpath('gencode/pthreads-dynamic/lb-includes');
+outdir=tools.realpath('gencode/pthreads-dynamic')..'/';
+local lbbase = tools.basename(args.lbfile)
+
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources, output=outdir..lbbase..'.c'};
+assert(prog, nil);
+-- one dependency per box instead of the tiles left by expanding the meta-kernels, for smaller tables
+Ladybirds.CoalesceDependencies{prog} or error();
+
+-- profile-guided compilation: the task costs are measured in the trace of an earlier build (-profile, or the run of
+-- the previous iteration of -pgo), and also written to <app>.costs.lua for LoadCost
+local profile = pgotrace or args.profile;
+local tracing = args.trace or args.pgo > 0;
+if profile then
+    local measured = Ladybirds.TraceCost{prog, filename=profile, output=outdir..appname..".costs.lua"} or error();
+    printf("Profile %s: makespan predicted from the measured costs %.1f µs, achieved %.1f µs (mean of %d runs)\n",
+           profile, measured.predicted, measured.achieved, measured.instances);
+end
+
+-- the successor matrix, the costs and the project information do not depend on each other (cf. RunPipeline)
+local autogroup = not args.mapping and args.groups ~= 0;
+local coarsen = args.coarsen > 0;
+local prefetch = args.prefetch > 0;
+local needcosts = autogroup or coarsen or prefetch or args.multiplex;
+-- reentrant contexts (-contexts): up to args.contexts invocations run at the same time, each in a context of its own
+-- (cf. _lb_context_create in main.c), which runs the groups on its own threads in one slot of the buffers
+local contexts = args.contexts > 0;
+local pipeline = {{"TaskTopoSort", order=args.order}, "CalcSuccessorMatrix"};
+if args.mapping then pipeline[#pipeline+1] = {"LoadMapping", filename=args.mapping}; end
+if needcosts and args.costs and not profile then pipeline[#pipeline+1] = {"LoadCost", filename=args.costs}; end
+-- without measured costs, group (and coarsen) by the operation counts estimated from the kernel bodies
+if needcosts and not args.costs and not profile then pipeline[#pipeline+1] = "EstimateCosts"; end
+if args.projinfo then pipeline[#pipeline+1] = {"LoadProjectInfo", filename=args.projinfo}; end
+
+local result = Ladybirds.RunPipeline{prog, pipeline} and
+        (not autogroup or Ladybirds.AutoGroup{prog, groups=args.groups}) and
+        Ladybirds.PopulateGroups{prog} and
+        Ladybirds.BufferPreallocation{prog, padrows=args.padrows} and
+        (args.align == 0 and args.hugepages == 0 or
+            Ladybirds.AlignBuffers{prog, alignment=math.max(args.align, 1), hugepages=args.hugepages}) and
+        (args.packbuffers and Ladybirds.BufferPacking{prog} or
+            not args.packbuffers and Ladybirds.BufferAllocation{prog}) and
+        -- a mapping may define several divisions, whose channels are copied like those of the copy engine
+        (not args.copyengine and (not args.mapping or args.zerocopy) or Ladybirds.PlacePorts{prog}) and
+        true or error()
+
+-- stagger the buffers in a common arena such that they map to different cache sets
+local layout = args.cachelayout and not args.packbuffers and (Ladybirds.CacheLayout{prog} or error())
+
+local priorities = Ladybirds.TaskPriorities{prog} or error();
+-- only wait for the predecessors that are not implied by others (the groups run their ready tasks in any order)
+local syncs = Ladybirds.SyncPoints{prog} or error();
+-- bind the groups to hardware threads along the host topology (given by -topology or read from /sys)
+local binding = Ladybirds.BindGroups{prog, topology=args.topology} or error();
+-- data volumes and buffer lifetimes for the report, before fusion merges the tasks
+local movement = Ladybirds.DataMovement{prog} or error();
+-- run linear chains of tasks within the groups as one fused task each
+local fusion = args.fuse and (Ladybirds.FuseChains{prog} or error());
+-- run chunks of consecutive instances of a kernel as one task each (like the chains, which take the other tasks)
+local coarsening = coarsen and (Ladybirds.CoarsenTasks{prog, mincost=args.coarsen} or error());
+if coarsening then
+    local chunked = {};
+    for _,chunk in ipairs(coarsening.chunks) do
+        for _,name in ipairs(chunk.tasks) do chunked[name] = true; end
+    end
+    local chains = coarsening.chunks;
+    for _,chain in ipairs(fusion and fusion.chains or {}) do
+        local free = true;
+        for _,name in ipairs(chain.tasks) do free = free and not chunked[name]; end
+        if free then chains[#chains+1] = chain; end
+    end
+    fusion = {chains=chains};
+end
+
+local x = Ladybirds.Export{prog};
+
+-- order the tasks of each group by decreasing upward rank, such that GetNextTask, which returns the first ready task
+-- in this order, prefers the tasks on the critical path
+local rank = {};
+for _,entry in ipairs(priorities.priorities) do rank[entry.task] = entry.priority; end
+for _,group in ipairs(x.groups) do
+    for i,op in ipairs(group.operations) do op.position = i; end
+    table.sort(group.operations, function(a, b)
+        local ra, rb = rank[a.task.name] or 0, rank[b.task.name] or 0;
+        if ra ~= rb then return ra > rb; end
+        return a.position < b.position;
+    end);
+end
+
+
+-- the dependencies that need their own synchronization (cf. SyncPoints), i.e. whose source is not implied by others
+local waitsfor, syncdeps = {}, {};
+for _,entry in ipairs(syncs.syncs) do
+    waitsfor[entry.task] = {};
+    for _,pred in ipairs(entry.waits) do waitsfor[entry.task][pred] = true; end
+end
+for _,dep in ipairs(x.dependencies) do
+    local waits = waitsfor[dep.to.task.name];
+    if not waits or waits[dep.from.task.name] then syncdeps[#syncdeps+1] = dep; end
+end
+
+-- fused chains (and chunks): the operation of the first task of a chain runs all its tasks (calls), the others have no
+-- operation and are represented by the first one (head) in the dependencies. The buffers used by a chain only are placed in
+-- the scratch memory of the group, which all its chains share.
+local headof = {};
+local head = function(task) return headof[task] or task; end
+for _,task in ipairs(x.tasks) do task.calls = {task}; end
+if fusion then
+    local taskbyname = {};
+    for _,task in ipairs(x.tasks) do taskbyname[task.name] = task; end
+    local chainof = {};
+    for _,chain in ipairs(fusion.chains) do
+        local first = taskbyname[chain.tasks[1]];
+        chainof[first] = chain;
+        first.calls = {};
+        for _,name in ipairs(chain.tasks) do
+            local task = taskbyname[name];
+            table.insert(first.calls, task);
+            if task ~= first then headof[task] = first; end
+        end
+    end
+    for _,group in ipairs(x.groups) do
+        local ops = {};
+        for _,op in ipairs(group.operations) do
+            if not headof[op.task] then ops[#ops+1] = op; end
+            for _,task in ipairs(op.task.calls) do task.group = group; end
+            
+            local chain = chainof[op.task];
+            local offsets, size = {}, 0;
+            for _,entry in ipairs(chain and chain.scratch or {}) do
+                if not offsets[entry.buffer] then
+                    offsets[entry.buffer] = size;
+                    size = size + (entry.size + 63) // 64 * 64;
+                end
+                for _,iface in ipairs(taskbyname[entry.task].ifaces) do
+                    if iface.packet.name == entry.packet then
+                        iface.localbuffer = {name="(_Scratch"..(contexts and "[_slot]" or "").."+"..
+                                                  offsets[entry.buffer]..")"};
+                    end
+                end
+            end
+            if size > 0 then group.scratchsize = math.max(group.scratchsize or 0, size); end
+        end
+        group.operations = ops;
+    end
+    local fused = {};
+    for _,dep in ipairs(syncdeps) do
+        local src, dst = head(dep.from.task), head(dep.to.task);
+        if src ~= dst then fused[#fused+1] = {from={task=src}, to={task=dst}}; end
+    end
+    syncdeps = fused;
+end
+
+local bitfieldvarsize = 64
+local cachelinesize = 64 --the bitfield words of each group start on their own cache line
+
+-- wide bitfield checks (-simdwidth): the dependencies of a task are checked in vectors of several words each, so a
+-- task waiting for many tasks of a group needs few checks. The tasks with successors in other groups take the first
+-- bits of their group, such that the predecessors of a task from another group cluster in few vectors.
+local simdwidth = args.simdwidth;
+if simdwidth ~= 0 and simdwidth ~= 128 and simdwidth ~= 256 and simdwidth ~= 512 then
+    error("-simdwidth must be 128, 256 or 512 (bits), not "..simdwidth..".");
+end
+local vectorwords = simdwidth // bitfieldvarsize;
+
+-- divisions (from the mapping, e.g. one per NUMA node): each division has its own buffers, in its own arena if they are
+-- packed, and its groups are bound to their own socket (cf. BindGroups). Its buffers are touched first by its threads,
+-- so they are placed on its node. Inputs from channels crossing divisions are read from local copies, which the copy
+-- engine fills (unless -zerocopy, which lets the threads read the buffers of other divisions in place).
+local multidiv = #x.divisions > 1;
+local divcopies = multidiv and not args.zerocopy;
+local copyengine = args.copyengine or divcopies;
+local numa = args.numa or multidiv;
+-- the contexts only have their own copies of the state of the default runtime
+if contexts and (args.pipeline > 0 or args.rebalance or args.multiplex or args.counters or tracing or numa
+                 or copyengine) then
+    error("-contexts cannot be used with -pipeline, -rebalance, -multiplex, -counters, -trace, -pgo, -numa or "..
+          "-copyengine, nor with a mapping of several divisions.");
+end
+-- batched invocations (-batch): _lb_invoke_<main>_batch runs the program on up to args.batch inputs (items) at once.
+-- Each task runs its kernels for all items in turn, so the synchronization between the tasks is paid once per batch.
+-- The buffers get a leading dimension of one copy per item, which the wrappers index with _item.
+local batch = args.batch > 0;
+if batch and (args.pipeline > 0 or contexts or args.tabledispatch or copyengine or prefetch or numa) then
+    error("-batch cannot be used with -pipeline, -contexts, -tabledispatch, -copyengine, -prefetch or -numa, nor "..
+          "with a mapping of several divisions.");
+end
+local buffers = {};
+for d,div in ipairs(x.divisions) do
+    div.number = d-1;
+    for _,group in ipairs(div.groups) do group.division = div; end
+    for _,buffer in ipairs(div.buffers) do
+        buffer.division = div;
+        buffers[#buffers+1] = buffer;
+    end
+end
+
+-- fallback if the topology is unknown
+--[[
+-- Xeon Phi Mode: 60 cores, 4 threads/core
+local distribute = function(n)
+    local nCores = 60;
+    local nHwThreads = nCores*4;
+
+    if n % nHwThreads == nHwThreads-1 then return 0;
+    else return (n*4)%(nHwThreads-1) + 1; end;
+end;]]--
+
+local distribute = function(n)
+    return n%4;
+end
+
+
+-- data type checks
+local basetypesizes={}
+for _,kernel in pairs(x.kernels) do
+    for _,packet in ipairs(kernel.packets) do
+        basetypesizes[packet.basetype] = packet.basetypesize
+    end
+end
+
+-- pipeline mode: invocations of a stream overlap, each using one of several copies (slots) of the buffers.
+-- The tasks are called with the current frame (_frame) and slot (_slot). With -contexts, each context has a slot.
+local pipeline = args.pipeline > 0;
+local slotted = pipeline or contexts;
+local slots = contexts and args.contexts or math.max(args.pipeline, 1);
+local slotindex = slotted and "[_slot]" or batch and "[_item]" or "";
+local copied = slotted or batch; -- whether the buffers have a leading dimension of copies
+if pipeline then
+    for _,packet in ipairs(x.maintask.kernel.packets) do
+        packet.streamparamstring = packet.paramstring:gsub("void %* _lb_base_", "void * const * _lb_frames_");
+    end
+end
+if batch then
+    for _,packet in ipairs(x.maintask.kernel.packets) do
+        packet.batchparamstring = packet.paramstring:gsub("void %* _lb_base_", "void * const * _lb_items_");
+    end
+end
+
+-- give buffers names
+local extargs = {};
+local arenas, arenaof = {}, {};
+for i, buffer in ipairs(buffers) do
+    buffer.align = math.max(buffer.alignment, 8);
+    if (args.packbuffers or layout) and buffer.bankaddress >= 0 then
+        -- packed and staggered buffers live at their offset in the arena of their division
+        local arena = arenaof[buffer.division];
+        if not arena then
+            arena = {name="_BufferArena"..(multidiv and buffer.division.number or ""), size=0,
+                     align=layout and layout.alignment or 8};
+            arenaof[buffer.division] = arena;
+            arenas[#arenas+1] = arena;
+        end
+        buffer.name = "("..arena.name..slotindex.."+"..buffer.bankaddress..")";
+        buffer.packed, buffer.arena = true, arena;
+        arena.size = math.max(arena.size, buffer.bankaddress + buffer.size);
+        arena.align = math.max(arena.align, buffer.align);
+    else
+        buffer.declname = "_buffer_"..i;
+        buffer.name = buffer.declname..slotindex;
+    end
+end
+
+for _,buffer in ipairs(x.externalbuffers) do
+    local idx = buffer.extargindex;
+    buffer.name = pipeline and "ExternalFrames["..idx.."][_frame]" or batch and "ExternalItems["..idx.."][_item]" or
+                  "ExternalBuffers"..slotindex.."["..idx.."].Base";
+    buffer.callparam = "ExternalBuffers"..(slotted and slotindex or "").."["..idx.."].Dimensions"
+    extargs[#extargs+1] = {index=#extargs, argname=x.maintask.kernel.packets[idx+1].name};
+end
+
+local listbuffers = function(ports)
+    local ret = "";
+    for i,port in ipairs(ports) do
+        if i > 1 then ret = ret..", "; end;
+        ret = ret..port.iface.buffer.name;
+    end
+    return ret;
+end
+
+for i,channel in ipairs(x.channels) do
+    local n = i-1;
+    channel.number = n;
+    channel.from.number = n;
+    channel.to.number = n;
+end
+
+-- the bits of the tasks and the checks of their predecessors (cf. ExportRuntimeTables). Only the thread of a group
+-- writes its words, which start on a new cache line.
+local tablegroups, tabledeps = {}, {};
+for i,group in ipairs(x.groups) do
+    local names = {};
+    for id,op in ipairs(group.operations) do names[id] = op.task.name; end
+    tablegroups[i] = names;
+end
+for i,dep in ipairs(syncdeps) do tabledeps[i] = {from=dep.from.task.name, to=dep.to.task.name}; end
+local tables = Ladybirds.ExportRuntimeTables{prog, groups=tablegroups, deps=tabledeps, wordbits=bitfieldvarsize,
+                                            linewords=math.max(cachelinesize*8, simdwidth) // bitfieldvarsize,
+                                            vectorwords=vectorwords, crossfirst=vectorwords > 0} or error();
+local curfieldindex = tables.length;
+
+-- give groups names and operations ids
+local boundcpus = {};
+for _,entry in ipairs(binding.bindings) do boundcpus[entry.group] = entry.cpu; end
+for i,group in ipairs(x.groups) do
+    group.targetcore = boundcpus[group.name] or distribute(i-1);
+    group.name = "_Thread"..i;
+    group.number = i-1;
+    
+    for id,op in ipairs(group.operations) do
+        local entry = tables.groups[i].ops[id];
+        op.id = id;
+        op.task.group = group;
+        op.task.bitfieldhex, op.task.bitfieldindex = entry.bit, entry.index;
+        op.depfieldindices, op.depfielddata = entry.indices, entry.data;
+        op.checkstart, op.checkend = entry.checkstart, entry.checkend;
+    end
+end
+
+-- static order mode: each group runs its operations in the given order, and only waits for the cross-group
+-- predecessors that are not implied by its earlier waits. What a group knows to be finished after each task is tracked
+-- as a vector clock, which holds the number of operations of each group finished before.
+if args.staticorder then
+    local position, preds, clocks = {}, {}, {};
+    local remaining = 0;
+    for _,group in ipairs(x.groups) do
+        group.staticorder = true;
+        for id,op in ipairs(group.operations) do
+            position[op.task], preds[op.task] = id, {};
+            op.waits, op.postwakes = {}, {};
+        end
+        remaining = remaining + #group.operations;
+    end
+    for _,dep in ipairs(syncdeps) do
+        local src, dst = dep.from.task, dep.to.task;
+        if position[src] and position[dst] and src ~= dst then
+            if src.group == dst.group and position[src] > position[dst] then
+                error("Static order: task "..dst.name.." runs before its predecessor "..src.name.." in its group.");
+            end
+            table.insert(preds[dst], src);
+        end
+    end
+    
+    -- walk through the groups in lockstep, as far as the dependencies allow
+    local nextop = {};
+    for gi = 1, #x.groups do nextop[gi] = 1; end
+    while remaining > 0 do
+        local progress = false;
+        for gi,group in ipairs(x.groups) do
+            local op = group.operations[nextop[gi]];
+            local ready = op ~= nil;
+            for _,pred in ipairs(op and preds[op.task] or {}) do ready = ready and clocks[pred] ~= nil; end
+            if ready then
+                local prev = group.operations[nextop[gi]-1];
+                local clock = {};
+                for gj = 1, #x.groups do clock[gj] = prev and clocks[prev.task][gj] or 0; end
+                
+                -- the latest predecessor in each other group that is not known to be finished yet
+                local candidates = {};
+                for _,pred in ipairs(preds[op.task]) do
+                    local gj = pred.group.number+1;
+                    if gj ~= gi and position[pred] > clock[gj] and
+                       (not candidates[gj] or position[pred] > position[candidates[gj]]) then
+                        candidates[gj] = pred;
+                    end
+                end
+                -- drop the waits implied by others, and wait for the rest
+                local waits = {};
+                for gj,pred in pairs(candidates) do
+                    local implied = false;
+                    for gk,other in pairs(candidates) do
+                        implied = implied or (gk ~= gj and clocks[other][gj] >= position[pred]);
+                    end
+                    if not implied then waits[#waits+1] = pred; end
+                end
+                table.sort(waits, function(a, b) return a.group.number < b.group.number; end);
+                for _,pred in ipairs(waits) do
+                    op.waits[#op.waits+1] = {waitgroup=pred.group.number, waitcount=position[pred]};
+                    for gj = 1, #x.groups do clock[gj] = math.max(clock[gj], clocks[pred][gj]); end
+                    local predop = pred.group.operations[position[pred]];
+                    predop.post = true;
+                    predop.postwakes[group.number] = true;
+                end
+                clock[gi] = nextop[gi];
+                clocks[op.task] = clock;
+                
+                nextop[gi] = nextop[gi]+1;
+                remaining = remaining-1;
+                progress = true;
+            end
+        end
+        if not progress then error("Static order: the orders of the groups and the dependencies form a cycle."); end
+    end
+    for _,group in ipairs(x.groups) do
+        for _,op in ipairs(group.operations) do
+            local wakes = {};
+            for number in pairs(op.postwakes) do wakes[#wakes+1] = {group=number}; end
+            table.sort(wakes, function(a, b) return a.group < b.group; end);
+            op.postwakes = wakes;
+        end
+    end
+end
+
+--note which other groups each task has to wake up when it finishes
+for _,dep in ipairs(syncdeps) do
+    local src = dep.from.task;
+    local dstgroup = dep.to.task.group;
+    if src.group and dstgroup and dstgroup ~= src.group then
+        src.wakegroups = src.wakegroups or {};
+        src.wakegroups[dstgroup.number] = true;
+    end
+end
+
+
+-- copy engine: the inputs that only come from other groups are read from local copies, into which the thread of the
+-- consumer copies the regions of their channels while it waits for tasks (as soon as the producers have finished),
+-- or at the latest right before the consumer runs. The producers wake the consumer group for this. Without
+-- -copyengine, this only applies to the inputs whose buffers belong to another division.
+if copyengine then
+    if args.depcounters or args.staticorder then
+        error((args.copyengine and "-copyengine" or "Copying between divisions")..
+              " needs the default runtime, it cannot be used with -depcounters or -staticorder (see also -zerocopy).");
+    end
+    -- the rows of the region of a port, relative to the start of its buffer (the last dimension is given in bytes)
+    local regionrows = function(port)
+        local buffer = port.iface.buffer;
+        if not port.bufferdims or #port.bufferdims == 0 then
+            return {{offset=0, pitch=buffer.size, width=buffer.size, height=1}};
+        end
+        local sizes, extents, starts, stride, rest = {}, {}, {}, 1, port.offset;
+        for i = #port.bufferdims, 1, -1 do
+            sizes[i], extents[i] = port.bufferdims[i], port.dims[i];
+            starts[i] = (rest // stride) % sizes[i];
+            stride = stride * sizes[i];
+        end
+        while #sizes > 1 and extents[#sizes] == sizes[#sizes] do
+            local n = #sizes;
+            sizes[n-1], extents[n-1], starts[n-1] = sizes[n-1]*sizes[n], extents[n-1]*sizes[n], starts[n-1]*sizes[n];
+            sizes[n], extents[n], starts[n] = nil, nil, nil;
+        end
+        local n = #sizes;
+        local pitch, height, rows = sizes[n], n > 1 and extents[n-1] or 1, {};
+        local enumerate;
+        enumerate = function(dim, base)
+            if dim >= n-1 then
+                local offset = base;
+                if n > 1 then offset = offset*sizes[n-1] + starts[n-1]; end
+                rows[#rows+1] = {offset=offset*pitch + starts[n], pitch=pitch, width=extents[n], height=height};
+                return;
+            end
+            for i = starts[dim], starts[dim]+extents[dim]-1 do enumerate(dim+1, base*sizes[dim] + i); end
+        end
+        enumerate(1, 0);
+        return rows;
+    end
+
+    local channelsto, internal = {}, {};
+    for _,channel in ipairs(x.channels) do
+        local iface = channel.to.iface;
+        channelsto[iface] = channelsto[iface] or {};
+        table.insert(channelsto[iface], channel);
+    end
+    for _,dep in ipairs(x.dependencies) do
+        if dep.from.task.group == dep.to.task.group then internal[dep.to.task.name.."."..dep.to.packet] = true; end
+    end
+    local ncopies, nbytes = 0, 0;
+    for _,group in ipairs(x.groups) do
+        group.localcopies, group.prefetches = {}, {};
+        for _,op in ipairs(group.operations) do
+            op.fetches = {};
+            for _,iface in ipairs(op.task.ifaces) do
+                local buffer = iface.buffer;
+                if iface.packet.dir == "in" and buffer and not buffer.isexternal and channelsto[iface]
+                   and not internal[op.task.name.."."..iface.packet.name]
+                   and (args.copyengine or buffer.division ~= group.division) then
+                    iface.localbuffer = {name="_LocalCopy"..#group.localcopies, size=buffer.size, align=buffer.align};
+                    group.localcopies[#group.localcopies+1] = iface.localbuffer;
+                    ncopies, nbytes = ncopies+1, nbytes + buffer.size;
+                    for _,channel in ipairs(channelsto[iface]) do
+                        local src = head(channel.from.iface.task);
+                        local rows = regionrows(channel.to);
+                        local job = #group.prefetches;
+                        group.prefetches[#group.prefetches+1] = {job=job, rows=rows, nrows=#rows,
+                            target=iface.localbuffer.name, source=buffer.name,
+                            fieldindex=src.bitfieldindex, bithex=src.bitfieldhex};
+                        op.fetches[#op.fetches+1] = {job=job};
+                        src.wakegroups = src.wakegroups or {};
+                        src.wakegroups[group.number] = true;
+                    end
+                end
+            end
+        end
+        group.copyengine = #group.prefetches > 0 or nil;
+    end
+    vprintf("Copy engine: %d inputs read from local copies (%d bytes)\n", ncopies, nbytes);
+end
+
+-- software prefetch: right before running a task, a thread hints the cache to load the first lines (at most
+-- args.prefetch) of the inputs of the operation likely to run after it, i.e. the next one in the order of its group.
+-- A cheap task cannot hide the latency of these loads, so the prefetches look further ahead, until the tasks in
+-- between cost as much as the average task of the group (cf. LoadCost, EstimateCosts). Each operation is prefetched
+-- once, by the last operation that has it in reach.
+if prefetch then
+    -- the first rows of the region of an interface, up to the given number of lines (nil for scalars)
+    local inputrows = function(iface, lines)
+        local size, dims, strides = iface.packet.basetypesize, iface.packet.arraydims, iface.bufferdims;
+        local n = #dims;
+        if n == 0 or #strides ~= n then return nil; end
+        -- the inner dimensions that are contiguous in the buffer make up one row
+        local width, k = dims[n]*size, n-1;
+        while k >= 1 and strides[k]*size == width do width, k = width*dims[k], k-1; end
+        local pitch, height = width, 1;
+        if k >= 1 then pitch, height = strides[k]*size, dims[k]; end
+        local rowlines = (width + cachelinesize-1) // cachelinesize;
+        if rowlines >= lines then return {pitch=pitch, width=lines*cachelinesize, height=1}; end
+        return {pitch=pitch, width=width, height=math.min(height, lines // rowlines)};
+    end
+    local nregions, ncases = 0, 0;
+    for _,group in ipairs(x.groups) do
+        local ops, costs, total = group.operations, {}, 0;
+        for i,op in ipairs(ops) do
+            op.prefetchindex = i-1;
+            costs[i] = 0;
+            for _,call in ipairs(op.task.calls) do costs[i] = costs[i] + (call.cost or 0); end
+            total = total + costs[i];
+        end
+        local mean = #ops > 0 and total / #ops or 0;
+        group.prefetchcases = {};
+        local reached = 1;
+        for i = 1, #ops-1 do
+            local j, ahead = i+1, costs[i];
+            while j < #ops and ahead < mean do ahead, j = ahead + costs[j], j+1; end
+            local entry = {task=i-1, regions={}};
+            for t = reached+1, j do
+                local inputs = {};
+                for _,call in ipairs(ops[t].task.calls) do
+                    for _,iface in ipairs(call.ifaces) do
+                        if iface.packet.dir ~= "out" and iface.buffer then inputs[#inputs+1] = iface; end
+                    end
+                end
+                local quota = math.max(args.prefetch // math.max(#inputs, 1), 1);
+                for _,iface in ipairs(inputs) do
+                    local rows = inputrows(iface, quota);
+                    if rows then
+                        local name = iface.localbuffer and iface.localbuffer.name or iface.buffer.name;
+                        rows.address = name.."+"..iface.offset;
+                        entry.regions[#entry.regions+1] = rows;
+                    end
+                end
+            end
+            reached = math.max(reached, j);
+            if #entry.regions > 0 then
+                group.prefetchcases[#group.prefetchcases+1] = entry;
+                nregions, ncases = nregions + #entry.regions, ncases+1;
+            end
+        end
+        group.prefetchnext = #group.prefetchcases > 0 or nil;
+    end
+    vprintf("Prefetch: %d input regions hinted by %d tasks\n", nregions, ncases);
+end
+
+-- table dispatch: instead of a wrapper for each task, each group gets one dispatcher for each of its kernels, which
+-- takes the arguments of a task from a constant table (the buffers by number, cf. BufferAddress). Operations that
+-- need more than one kernel call (fused chains) or prefetches keep their wrappers. The operations are run by calling
+-- dispatch(dispatcharg, frame, slot).
+local bufferbases, buffertablelength = {}, 1;
+if args.tabledispatch then
+    local addresses = {};
+    for _,buffer in ipairs(buffers) do
+        if not buffer.isexternal then
+            buffer.tableindex = #addresses;
+            addresses[#addresses+1] = buffer.name;
+        end
+    end
+    for _,buffer in ipairs(x.externalbuffers) do buffer.tableindex = -1-buffer.extargindex; end
+    for slot = 0, slots-1 do
+        local names = {};
+        for i,name in ipairs(addresses) do names[i] = name:gsub("_slot", tostring(slot)); end
+        bufferbases[#bufferbases+1] = {addresses=#names > 0 and table.concat(names, ", ") or "0"};
+    end
+    buffertablelength = math.max(#addresses, 1);
+end
+for _,group in ipairs(x.groups) do
+    local kernels, dims = {}, {};
+    group.dispatchkernels, group.dims = {}, {};
+    for _,op in ipairs(group.operations) do
+        op.dispatch, op.dispatcharg = "Task"..op.id, 0;
+        if args.tabledispatch and #op.task.calls == 1 and #(op.fetches or {}) == 0 then
+            local task, kernel = op.task, op.task.kernel;
+            local entry = kernels[kernel];
+            if not entry then
+                entry = {func=kernel.func, kparams=kernel.parameters, nifaces=#task.ifaces, ifacenumbers={}, rows={}};
+                for i = 1, #task.ifaces do entry.ifacenumbers[i] = {n=i-1}; end
+                kernels[kernel] = entry;
+                group.dispatchkernels[#group.dispatchkernels+1] = entry;
+            end
+            local row = {params=task.parameters, entries={}};
+            for _,iface in ipairs(task.ifaces) do
+                local values = iface.callparam:match("^%(int%[%]%)(%b{})$");
+                if not values then error("Table dispatch: unexpected dimensions "..iface.callparam.." of "..task.name); end
+                if not dims[values] then
+                    dims[values] = #group.dims;
+                    group.dims[#group.dims+1] = {number=#group.dims, values=values};
+                end
+                row.entries[#row.entries+1] = {buffer=iface.buffer.tableindex, offset=iface.offset, dims=dims[values]};
+            end
+            op.tablerow = true;
+            op.dispatch, op.dispatcharg = "Run_"..kernel.func, #entry.rows;
+            entry.rows[#entry.rows+1] = row;
+        end
+    end
+end
+
+-- specialization: the kernel calls of the wrappers go through copies (_Specialize.c, which includes the program
+-- source), one for each kernel, set of parameters and dimensions. The constant dimensions and parameters, the known
+-- alignment, and restrict for buffers no other interface of the call uses, let the compiler optimize each copy for
+-- its call. Dimensions of external buffers are only known at run time and remain arguments.
+local specializations = {};
+if args.specialize then
+    local alignment = function(...)  -- largest power of two (at most 4096) dividing all arguments
+        local ret = 4096;
+        for _,n in ipairs{...} do
+            while ret > 1 and n % ret ~= 0 do ret = ret // 2; end
+        end
+        return ret;
+    end
+    local byparams = {};
+    for _,group in ipairs(x.groups) do
+        for _,op in ipairs(group.operations) do
+            for _,call in ipairs(op.tablerow and {} or op.task.calls) do
+                local key, callargs, signature, kargs, dims, users = {call.kernel.func}, {}, {}, {}, {}, {};
+                for _,param in ipairs(call.parameters) do kargs[#kargs+1], key[#key+1] = param, param; end
+                for _,iface in ipairs(call.ifaces) do
+                    local name = iface.localbuffer and iface.localbuffer.name or iface.buffer.name;
+                    users[name] = (users[name] or 0) + 1;
+                end
+                for i,iface in ipairs(call.ifaces) do
+                    local n, buffer, localbuf = i-1, iface.buffer, iface.localbuffer;
+                    local name = localbuf and localbuf.name or buffer.name;
+                    local align = 1;
+                    if localbuf then align = alignment(localbuf.align or 64, iface.offset);
+                    elseif buffer.packed then  -- the slots are rows of the arena
+                        local arena = buffer.arena;
+                        align = alignment(arena.align, buffer.bankaddress + iface.offset, copied and arena.size or 0);
+                    elseif not buffer.isexternal then
+                        align = alignment(buffer.align, iface.offset, copied and buffer.size or 0);
+                    end
+                    local restrict = not (buffer.isexternal and not localbuf) and users[name] == 1;
+                    local values = iface.callparam:match("^%(int%[%]%)(%b{})$");
+                    if values then
+                        dims[#dims+1] = {name="d"..n, values=values};
+                        key[#key+1] = values;
+                    else
+                        signature[#signature+1] = "const int * d"..n;
+                        callargs[#callargs+1] = iface.callparam;
+                        key[#key+1] = "?";
+                    end
+                    signature[#signature+1] = "void * "..(restrict and "restrict " or "").."p"..n;
+                    callargs[#callargs+1] = name.."+"..iface.offset;
+                    kargs[#kargs+1] = "d"..n;
+                    kargs[#kargs+1] = align > 1 and "__builtin_assume_aligned(p"..n..", "..align..")" or "p"..n;
+                    key[#key+1] = align..(restrict and "r" or "");
+                end
+                key = table.concat(key, "/");
+                local spec = byparams[key];
+                if not spec then
+                    spec = {func="_Spec"..#specializations, kernel=call.kernel.func, dims=dims,
+                            signature=#signature > 0 and table.concat(signature, ", ") or "void", args=table.concat(kargs, ", ")};
+                    byparams[key] = spec;
+                    specializations[#specializations+1] = spec;
+                end
+                call.spec = {func=spec.func, args=table.concat(callargs, ", ")};
+            end
+        end
+    end
+    vprintf("Specialization: %d copies of kernels\n", #specializations);
+end
+
+-- the groups each operation wakes up when it finishes
+for i,group in ipairs(x.groups) do
+    local wakeoffset = 0;
+    
+    for _,op in ipairs(group.operations) do
+        local wakegroups = {};
+        for number in pairs(op.task.wakegroups or {}) do wakegroups[#wakegroups+1] = number; end
+        table.sort(wakegroups);
+        op.wakegroups = table.concat(wakegroups, ", ")..(#wakegroups > 0 and "," or "");
+        op.wakestart = wakeoffset;
+        wakeoffset = wakeoffset + #wakegroups;
+        op.wakeend = wakeoffset;
+    end
+end
+
+
+-- dependency counters (alternative to the bitfields): each task counts its unfinished predecessors, and the last
+-- predecessor to finish pushes it onto the ready queue of its group. Tasks are numbered globally in group order.
+-- With -rebalance, the runtime measures the tasks and moves them to other groups between invocations (cf. Rebalance
+-- in taskmanagement.c); the tasks using memory of their thread (scratch memory of fused chains) stay where they are.
+if args.rebalance and (not args.depcounters or args.staticorder or args.counters or prefetch) then
+    error("-rebalance needs -depcounters and cannot be used with -staticorder, -counters or -prefetch.");
+end
+local tasknodes, groupstarts, successors = {}, {}, {};
+if args.depcounters then
+    for _,group in ipairs(x.groups) do
+        group.depcounters, group.rebalance, group.multiplex = true, args.rebalance, args.multiplex;
+        group.taskstart = #tasknodes;
+        groupstarts[#groupstarts+1] = {start=#tasknodes};
+        for id,op in ipairs(group.operations) do
+            local movable = #(op.fetches or {}) == 0;
+            for _,call in ipairs(op.task.calls) do
+                for _,iface in ipairs(call.ifaces) do movable = movable and iface.localbuffer == nil; end
+            end
+            op.task.globalid = #tasknodes;
+            tasknodes[#tasknodes+1] = {group=group.number, index=id-1, succs={}, npreds=0, movable=movable and 1 or 0,
+                                       name=op.task.name};
+        end
+    end
+    for _,dep in ipairs(syncdeps) do
+        local src, dst = dep.from.task, dep.to.task;
+        if src.globalid and dst.globalid then
+            local node = tasknodes[src.globalid+1];
+            if not node.succs[dst] then
+                node.succs[dst] = true;
+                node.succs[#node.succs+1] = dst.globalid;
+                tasknodes[dst.globalid+1].npreds = tasknodes[dst.globalid+1].npreds + 1;
+            end
+        end
+    end
+    for _,node in ipairs(tasknodes) do
+        node.succstart = #successors;
+        for _,succ in ipairs(node.succs) do successors[#successors+1] = succ; end
+        node.succend = #successors;
+        node.succs = nil;
+    end
+end
+
+-- multiplexing (-multiplex): the groups run on a few worker threads instead of one thread each, assigned to the
+-- workers by their costs, the most expensive first to the least loaded worker (longest processing time first). Each
+-- worker takes the ready tasks of its groups in turns, one group's tasks still run one after the other. By default,
+-- there is one worker per core the groups are bound to.
+local workers, groupworkers = {}, {};
+if args.multiplex then
+    if not args.depcounters or args.staticorder or args.rebalance or args.counters or numa then
+        error("-multiplex needs -depcounters and cannot be used with -staticorder, -rebalance, -counters or -numa.");
+    end
+    local cores, seen = {}, {};
+    for _,group in ipairs(x.groups) do
+        if not seen[group.targetcore] then cores[#cores+1], seen[group.targetcore] = group.targetcore, true; end
+    end
+    local nworkers = math.min(args.workers > 0 and args.workers or #cores, #x.groups);
+    for i = 1, nworkers do workers[i] = {number=i-1, targetcore=cores[(i-1) % #cores + 1], load=0, groups={}}; end
+
+    local bycost = {};
+    for _,group in ipairs(x.groups) do
+        group.cost = 0;
+        for _,op in ipairs(group.operations) do
+            for _,task in ipairs(op.task.calls) do group.cost = group.cost + (task.cost or 0); end
+        end
+        if group.cost <= 0 then group.cost = #group.operations; end -- no costs: count the tasks
+        bycost[#bycost+1] = group;
+    end
+    table.sort(bycost, function(a, b)
+        if a.cost ~= b.cost then return a.cost > b.cost; end
+        return a.number < b.number;
+    end);
+    for _,group in ipairs(bycost) do
+        local lightest = workers[1];
+        for _,worker in ipairs(workers) do if worker.load < lightest.load then lightest = worker; end end
+        lightest.load = lightest.load + group.cost;
+        table.insert(lightest.groups, group);
+        group.worker = lightest.number;
+    end
+    local start = 0;
+    for _,worker in ipairs(workers) do
+        table.sort(worker.groups, function(a, b) return a.number < b.number; end);
+        worker.groupstart = start;
+        start = start + #worker.groups;
+        vprintf("Worker %d on core %d: %d groups, cost %g\n", worker.number, worker.targetcore, #worker.groups,
+                worker.load);
+    end
+    for _,group in ipairs(x.groups) do groupworkers[#groupworkers+1] = group.worker; end
+end
+
+local initialdeps = {};
+for i,node in ipairs(tasknodes) do initialdeps[i] = node.npreds; end
+local pendinginit = {};
+for slot = 1, slots do pendinginit[slot] = "{"..table.concat(initialdeps, ", ").."}"; end
+
+
+-- NUMA placement: each buffer is touched first by the group that writes most of its data. With several divisions,
+-- this is the group of its division that writes most of it, or else the first group of its division.
+if numa then
+    local writers = {};
+    for _,group in ipairs(x.groups) do
+        group.numa = true;
+        group.touchbuffers = {};
+        for _,op in ipairs(group.operations) do
+            for _,iface in ipairs(op.task.ifaces) do
+                local buffer = iface.buffer;
+                if buffer and not buffer.isexternal and iface.packet.dir ~= "in" then
+                    local bytes = iface.packet.basetypesize;
+                    for _,dim in ipairs(iface.packet.arraydims) do bytes = bytes*dim; end
+                    writers[buffer] = writers[buffer] or {};
+                    writers[buffer][group] = (writers[buffer][group] or 0) + bytes;
+                end
+            end
+        end
+    end
+    for _,buffer in ipairs(buffers) do
+        local owner, maxbytes = nil, 0;
+        for _,group in ipairs(multidiv and buffer.division.groups or x.groups) do
+            local bytes = writers[buffer] and writers[buffer][group] or 0;
+            if bytes > maxbytes then owner, maxbytes = group, bytes; end
+        end
+        if multidiv and not buffer.isexternal then owner = owner or buffer.division.groups[1]; end
+        for slot = 0, owner and slots-1 or -1 do
+            local name = buffer.name:gsub("_slot", tostring(slot));
+            table.insert(owner.touchbuffers, {name=name, size=buffer.size});
+        end
+    end
+end
+
+local bindings = {}
+for i,group in ipairs(x.groups) do
+    bindings[i] = {group = group.name, target = group.targetcore};
+end
+
+
+
+
+-- Copy all required C files and create a list of object files
+ofiles = {"main.o", "experiment.o", "events.o", "taskmanagement.o", lbbase..'.o'}
+if args.specialize then ofiles[#ofiles] = "_Specialize.o"; end  -- includes the program source
+addlbobjects(ofiles);
+if tracing then ofiles[#ofiles+1] = "trace.o"; end
+if args.counters then ofiles[#ofiles+1] = "counters.o"; end
+
+-- external packets bound to files in the project info, mapped by _lb_invoke (not by the _lb_stream entry)
+local mappedfiles = mapexternalfiles(x, extargs);
+if #mappedfiles > 0 then ofiles[#ofiles+1] = "mappedfiles.o"; end
+if contexts and #mappedfiles > 0 then error("-contexts cannot be used with packets bound to files."); end
+if batch and #mappedfiles > 0 then error("-batch cannot be used with packets bound to files."); end
+
+for _,file in ipairs(x.codefiles) do
+    copy(file);
+    if file:match('%.c$') then
+        ofiles[#ofiles+1] = file:gsub('%.c$', '.o')
+    end
+end
+
+for _,file in ipairs(x.auxfiles) do
+    copy(file);
+end
+
+
+-- sharding: the task wrappers, buffer definitions and dependency counter tables are spread over args.shards extra
+-- files (_ShardN.c), such that make -j can compile them in parallel. Each item goes to the lightest shard, the
+-- heaviest items first. Wrappers that use state of their thread (prefetches, scratch memory) stay in its file.
+local shards, slotdims = {}, slotted and "["..slots.."]" or batch and "["..args.batch.."]" or "";
+if args.shards > 0 then
+    local items = {};
+    for _,group in ipairs(x.groups) do
+        for _,op in ipairs(group.operations) do
+            local weight, private = 1, #(op.fetches or {}) > 0;
+            for _,call in ipairs(op.task.calls) do
+                weight = weight + 1 + #call.ifaces + #call.parameters;
+                for _,iface in ipairs(call.ifaces) do private = private or iface.localbuffer ~= nil; end
+            end
+            if not op.tablerow and not private then
+                op.shard, op.dispatch = true, group.name.."_Task"..op.id;
+                items[#items+1] = {weight=weight, list="wrappers", entry=op};
+            end
+        end
+    end
+    for _,buffer in ipairs(buffers) do
+        if not buffer.isexternal and not buffer.packed then
+            items[#items+1] = {weight=1, list="buffers", entry=buffer};
+        end
+    end
+    for _,arena in ipairs(arenas) do items[#items+1] = {weight=1, list="arenas", entry=arena}; end
+    if args.depcounters then
+        local tables = {tasknodes=tasknodes, groupstarts=groupstarts, tasksuccessors=table.concat(successors, ", "),
+                        initialdeps=table.concat(initialdeps, ", "), pendinginit=table.concat(pendinginit, ", "),
+                        threadcount=#x.groups};
+        items[#items+1] = {weight=1 + #tasknodes//8, list="deptables", entry=tables};
+    end
+    table.sort(items, function(a, b) return a.weight > b.weight; end);
+
+    local loads = {};
+    for i = 1, args.shards do
+        shards[i], loads[i] = {wrappers={}, buffers={}, arenas={}, slotdims=slotdims, batch=batch}, 0;
+    end
+    for _,item in ipairs(items) do
+        local lightest = 1;
+        for i = 2, #shards do if loads[i] < loads[lightest] then lightest = i; end end
+        local shard = shards[lightest];
+        if item.list ~= "deptables" then table.insert(shard[item.list], item.entry);
+        else shard[item.list] = item.entry; end
+        loads[lightest] = loads[lightest] + item.weight;
+    end
+    for i = #shards, 1, -1 do  -- drop the shards that got nothing
+        if loads[i] == 0 then table.remove(shards, i); end
+    end
+    for i,shard in ipairs(shards) do
+        shard.name = "_Shard"..(i-1);
+        ofiles[#ofiles+1] = shard.name..".o";
+    end
+    vprintf("Sharding: %d items in %d files\n", #items, #shards);
+end
+
+
+
+--create view model
+model = { appname=appname, ofiles=ofiles, definitions=x.definitions, typeckecks=map2array(basetypesizes), 
+    kernels=x.kernels, buffers=buffers, tasks=x.tasks, channels=x.channels, groups=x.groups,
+    bindings=bindings, auxfiles=x.auxfiles, channelcount=#x.channels, threadcount=#x.groups, maintask=x.maintask,
+    TaskBitfieldUnitSize=bitfieldvarsize, TaskBitfieldLength=curfieldindex, cachelinesize=cachelinesize,
+
+    MainEntryArguments=extargs, ExternalBufferCount=#extargs,
+    mapping=(#mappedfiles > 0), mappedfiles=mappedfiles, mappedfilecount=#mappedfiles,
+    arenas=arenas, numa=numa, futexevents=args.futex, staticorder=args.staticorder, copyengine=copyengine,
+    tabledispatch=args.tabledispatch, bufferbases=bufferbases, BufferTableLength=buffertablelength,
+    depcounters=args.depcounters, tasknodes=tasknodes, groupstarts=groupstarts, TaskCount=math.max(#tasknodes, 1),
+    tasksuccessors=table.concat(successors, ", "), initialdeps=table.concat(initialdeps, ", "),
+    pendinginit=table.concat(pendinginit, ", "), rebalance=args.depcounters and args.rebalance,
+    multiplex=args.multiplex, workers=workers, workercount=args.multiplex and #workers or #x.groups,
+    groupworkers=table.concat(groupworkers, ", "), tasknames=tracing and (args.rebalance or args.multiplex),
+    pipeline=pipeline, slots=slots, slotdims=slotdims, contexts=contexts, batch=batch, BatchSize=args.batch,
+    sharded=(#shards > 0), specializations=specializations, lbbase=lbbase, trace=tracing,
+    counters=args.counters, prefetch=prefetch, simd=vectorwords > 0, SimdWidth=simdwidth, VectorWords=vectorwords};
+
+render("Makefile", model)
+render("main.c", model)
+render("global.h", model)
+render("buffers.h", model)
+rendercommon("experiment.h", model)
+rendercommon("experiment.c", model)
+if #mappedfiles > 0 then
+    rendercommon("mappedfiles.h", model)
+    rendercommon("mappedfiles.c", model)
+end
+render("events.h", model)
+render("events.c", model)
+render("taskmanagement.h", model)
+render("taskmanagement.c", model)
+render("lb-includes/ladybirds.h", model)
+if tracing then
+    render("trace.h", model)
+    render("trace.c", model)
+end
+if args.counters then
+    render("counters.h", model)
+    render("counters.c", model)
+end
+if args.specialize then
+    local template = fastache.parse(resdir.."specialize.c.mustache");
+    rendertemplate(template, outdir.."_Specialize.c", model);
+end
+
+local jobs = {};
+for _,group in ipairs(x.groups) do
+    group.trace, group.counters, group.contexts, group.batch = tracing, args.counters, contexts, batch;
+    for i,op in ipairs(group.operations) do op.counterindex = i-1; end
+    jobs[#jobs+1] = {template=resdir.."thread.c.mustache", model=group, output=outdir..group.name..".c"};
+end
+for _,shard in ipairs(shards) do
+    jobs[#jobs+1] = {template=resdir.."shard.c.mustache", model=shard, output=outdir..shard.name..".c"};
+end
+renderall(jobs);
+
+
+-- the counters written by an earlier build with -counters, when given as cost file, also go into the report
+local measuredcounters;
+if args.costs then
+    local measured = {};
+    local chunk = loadfile(args.costs, "t", measured);
+    if chunk and pcall(chunk) then measuredcounters = measured.counters; end
+end
+printreport(x, measuredcounters, movement);
+
+
+-- profile-guided compilation (-pgo): build and run the traced program, then compile it again with the measured costs
+pgoiteration = (pgoiteration or 0) + 1;
+if pgoiteration <= args.pgo then
+    local trace = outdir..appname..".trace.json";
+    printf("PGO iteration %d: building and running %s\n", pgoiteration, appname);
+    os.remove(trace);
+    if not os.execute("make -C '"..outdir.."' >/dev/null && cd '"..outdir.."' && LB_TRACE='"..trace.."' ./"..appname) then
+        error("PGO: building or running "..appname.." failed");
+    end
+    pgotrace = trace;
+    dofile(resdir.."main.lua");
+end
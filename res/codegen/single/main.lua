@@ -5,18 +5,21 @@ tools.mkpath('gencode/single/lb-includes');
 outdir=tools.realpath('gencode/single')..'/';
 local lbbase = tools.basename(args.lbfile)
 
-local prog = Ladybirds.Parse{filename=args.lbfile, output=outdir..lbbase..'.c'};
+local prog = Ladybirds.Parse{filename=args.lbfile, sources=args.lbsources, output=outdir..lbbase..'.c'};
 assert(prog, nil);
 
-local result = Ladybirds.TaskTopoSort{prog} and
+local result = Ladybirds.TaskTopoSort{prog, order=args.order} and
         Ladybirds.CalcSuccessorMatrix{prog} and
         (not args.mapping or Ladybirds.LoadMapping{prog, filename=args.mapping}) and
         (not args.projinfo or Ladybirds.LoadProjectInfo{prog, filename=args.projinfo}) and
         Ladybirds.PopulateGroups{prog} and
-        Ladybirds.BufferPreallocation{prog} and
+        Ladybirds.BufferPreallocation{prog, padrows=args.padrows} and
         Ladybirds.BufferAllocation{prog} and
         true or error()
 
+-- stagger the buffers in a common arena such that they map to different cache sets
+local layout = args.cachelayout and (Ladybirds.CacheLayout{prog} or error())
+
 local x = Ladybirds.Export{prog};
 migratefromglobal(x)
 
@@ -33,7 +36,7 @@ for _,task in ipairs(x.tasks) do
 end
 
 -- Copy all required C files and create a list of object files
-local ofiles = {"experiment.o", lbbase..'.o'}
+local ofiles = addlbobjects{"experiment.o", lbbase..'.o'}
 
 for _,file in ipairs(x.codefiles) do
     copy(file);
@@ -61,6 +64,9 @@ for i, buffer in ipairs(div.buffers) do
         local argname = x.maintask.kernel.packets[idx+1].name;
         buffer.name = "_lb_base_"..argname;
         buffer.callparam = "_lb_size_"..argname;
+    elseif layout and buffer.bankaddress >= 0 then
+        buffer.name = "(_BufferArena+"..buffer.bankaddress..")";
+        buffer.packed = true;
     else
         buffer.name = "_buffer_"..i;
     end
@@ -69,7 +75,9 @@ end
 
 --create view model
 model = { appname=appname, ofiles=ofiles, definitions=x.definitions, typeckecks=map2array(basetypesizes), 
-    kernels=x.kernels, buffers=x.buffers, tasks=x.tasks, maintask=x.maintask };
+    kernels=x.kernels, buffers=x.buffers, tasks=x.tasks, maintask=x.maintask,
+    packedbuffers=(layout and layout.arenasize > 0), arenasize=(layout and layout.arenasize),
+    arenaalign=(layout and layout.alignment) };
 
 
 
@@ -77,7 +85,7 @@ render("Makefile", model)
 render("global.h", model)
 render("main.c", model)
 render("lb-includes/ladybirds.h", model)
-render("experiment.h", model)
-render("experiment.c", model)
+rendercommon("experiment.h", model)
+rendercommon("experiment.c", model)
 
 
@@ -2,7 +2,7 @@
 
 init();
 
-local prog = Ladybirds.Parse({filename=args.lbfile});
+local prog = Ladybirds.Parse({filename=args.lbfile, sources=args.lbsources});
 assert(prog, nil);
 local x = Ladybirds.Export(prog);
 
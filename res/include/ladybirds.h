@@ -5,7 +5,9 @@
 
 #if defined(__cplusplus) && defined(__LADYBIDRS_INSTRUMENTATION_AT_WORK__)
 
+#include <algorithm>
 #include <array>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <unordered_map>
@@ -15,16 +17,29 @@ struct RWCount {int R=0, W=0; };
 
 
 
+/// Writes the access counts of the packets of each task instance to the file given by AccessOutput.
+/** The file is a record file for LoadAccessCounts (cf. tools::RecordFile): a line "#ladybirds accesses 1", then one
+ *  line per task instance with its full name, followed by the name, read count and write count of each packet.
+ *  If AccessSampling is set to some N > 1, only the accesses of every N-th instance of each kernel call are counted,
+ *  the other instances are assumed to access their packets as often as the last counted one. They skip the counters
+ *  and bounds checks, which leaves mostly the proxy objects (cf. PacketInstrumentationBase) the compiler inlines. **/
 class ProgramInstrumentation
 {
     friend class TaskInstrumentation;
+    template<typename bt, int i, int... dims> friend class PacketInstrumentationBase;
     template<typename bt, int i, int... dims> friend class PacketInstrumentation;
 private:
     std::ofstream Output;
+    int Sampling = 1;            ///< Count only the accesses of every Sampling-th instance of each kernel call
+    bool Counting = true;        ///< Whether the accesses of the current task instance are counted
+    const char *Kernel = "";     ///< Kernel of the current task instance
+    std::unordered_map<const char*, int> Instances; ///< Number of instances of each kernel call so far
+    std::unordered_map<const char*, std::unordered_map<const char*, RWCount>> Sampled; ///< Per kernel and packet
     
 public:
     ProgramInstrumentation()
     {
+        if(const char *sampling = getenv("AccessSampling")) Sampling = std::max(atoi(sampling), 1);
         const char* outfile = getenv("AccessOutput");
         if(!outfile) return;
         
@@ -35,11 +50,10 @@ public:
             exit(1);
         }
         
-        Output << "accesses = {\n";
+        Output << "#ladybirds accesses 1\n";
     }
     ~ProgramInstrumentation()
     {
-        Output << "}\n";
         Output.close();
     }
 };
@@ -71,7 +85,8 @@ protected:
 public:
     PacketInstrumentationBase<Basetype, MoreDimensions...> operator[] (unsigned long index)
     {
-        if(Dimension1 > 0 && index >= Dimension1) std::cerr << "WARNING: Variable access out of bounds for packet " << Packetname_ << std::endl;
+        if(Dimension1 > 0 && index >= Dimension1 && InstrumentationObject.Counting)
+            std::cerr << "WARNING: Variable access out of bounds for packet " << Packetname_ << std::endl;
         unsigned long addrmul = Blocksizes_[0];
         for(auto i = sizeof...(MoreDimensions); i > 0; --i) addrmul *= Blocksizes_[i];
         return PacketInstrumentationBase<Basetype, MoreDimensions...>(Packetname_, Base_+(index*addrmul), Blocksizes_, Accesses);
@@ -81,13 +96,13 @@ public:
     
     PacketInstrumentationBase &operator=(const Basetype &newval)
     {
-        Accesses.W++;
+        if(InstrumentationObject.Counting) Accesses.W++;
         *Base_ = newval;
         return *this;
     }
     operator const Basetype&()
     {
-        Accesses.R++;
+        if(InstrumentationObject.Counting) Accesses.R++;
         return *Base_;
     }
     
@@ -95,8 +110,16 @@ public:
     template<typename... Factors>
         constexpr static int Mul(int factor1, Factors... factors) { return factor1 * Mul(factors...); };
     
-    Basetype *rawread() { Accesses.R += Mul(Dimension1, MoreDimensions...); return Base_; }
-    Basetype *rawwrite() { Accesses.W += Mul(Dimension1, MoreDimensions...); return Base_; }
+    Basetype *rawread()
+    {
+        if(InstrumentationObject.Counting) Accesses.R += Mul(Dimension1, MoreDimensions...);
+        return Base_;
+    }
+    Basetype *rawwrite()
+    {
+        if(InstrumentationObject.Counting) Accesses.W += Mul(Dimension1, MoreDimensions...);
+        return Base_;
+    }
 };
 
 template<typename Basetype, int Dimension1 = 0, int... MoreDimensions>
@@ -119,7 +142,9 @@ public:
     
     ~PacketInstrumentation()
     {
-        InstrumentationObject.Output << this->Packetname_ << " = {" << this->Accesses.R << ',' << this->Accesses.W << "}, ";
+        auto &sample = InstrumentationObject.Sampled[InstrumentationObject.Kernel][this->Packetname_];
+        if(InstrumentationObject.Counting) sample = this->Accesses;
+        InstrumentationObject.Output << ' ' << this->Packetname_ << ' ' << sample.R << ' ' << sample.W;
     }
 };
 
@@ -130,11 +155,15 @@ protected:
     std::unordered_map<const char*, int> CallCounts_;
     
 public:
-    struct Closebracket { inline ~Closebracket() { InstrumentationObject.Output << " },\n"; } };
-    Closebracket Call(const char *taskname)
+    struct EndRecord { inline ~EndRecord() { InstrumentationObject.Output << '\n'; } };
+    EndRecord Call(const char *taskname)
     {
-        InstrumentationObject.Output << "[\"" << Callstack_ << taskname << '[' << CallCounts_[taskname]++ << "]\"] = { ";
-        return Closebracket();
+        int count = CallCounts_[taskname]++;
+        InstrumentationObject.Kernel = taskname;
+        auto &obj = InstrumentationObject;
+        obj.Counting = obj.Instances[taskname]++ % obj.Sampling == 0;
+        InstrumentationObject.Output << Callstack_ << taskname << '[' << count << ']';
+        return EndRecord();
     }
     
     struct ReduceStack
@@ -184,6 +213,8 @@ void invokeseq(int);
 #define buddy(buddypacket) __attribute__((annotate("buddy="#buddypacket)))
 #define param __attribute__((annotate("param"))) const
 #define genvar __attribute__((annotate("genvar")))
+#define splitalong(dim) __attribute__((annotate("split="#dim)))
+#define halo(dim, extent) __attribute__((annotate("split="#dim","#extent)))
 
 #else //def __LADYBIDRS_PARSER_AT_WORK__
 
@@ -194,6 +225,8 @@ void invokeseq(int);
 #define inout
 #define buddy(buddypacket)
 #define param const
+#define splitalong(dim)
+#define halo(dim, extent)
 #define genvar
 #define invoke(x) (x)
 #define invokeseq(x) (x)
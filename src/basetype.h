@@ -4,6 +4,7 @@
 #define BASETYPE_H
 
 #include <string>
+#include <unordered_map>
 
 namespace Ladybirds {
 namespace spec {
@@ -27,6 +28,9 @@ public:
     static const BaseType * FromString(const std::string & name, bool * success = nullptr);
 };
 
+//! The base types of a program by name (cf. impl::Program::Types)
+using BaseTypeMap = std::unordered_map<std::string, BaseType>;
+
 
 
 } //namespace spec
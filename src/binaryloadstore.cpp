@@ -0,0 +1,483 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "binaryloadstore.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+namespace Ladybirds { namespace loadstore {
+
+using std::string;
+
+namespace {
+constexpr char Magic[3] = {'L', 'B', 'B'};
+constexpr char FormatVersion = 1;
+constexpr size_t HeaderSize = sizeof(Magic) + 1;
+
+/// \internal Appends \p val as a variable-length integer (7 bits per byte, least significant first)
+void AppendVarint(string & s, uint64_t val)
+{
+    for(; val >= 0x80; val >>= 7) s += char(val | 0x80);
+    s += char(val);
+}
+
+/// \internal Inserts \p val as a variable-length integer at position \p pos of \p s (cf. AppendVarint)
+void InsertVarint(string & s, size_t pos, uint64_t val)
+{
+    string enc;
+    AppendVarint(enc, val);
+    s.insert(pos, enc);
+}
+
+/// \internal Formats an error message like printf
+string FormatMessage(const char * msg, va_list args)
+{
+    char buf[1024];
+    int size = vsnprintf(buf, sizeof(buf), msg, args);
+    if(size < 0) return msg;
+    return string(buf, std::min(size, (int) sizeof(buf)-1));
+}
+} //namespace ::
+
+
+/////////////////
+// BinaryStore
+
+string BinaryStore::GetData()
+{
+    for(auto & entry : Objects_)
+    {
+        if(!entry.second.Registered) Error("Unresolved reference to an object of type %s", entry.second.Type);
+    }
+
+    string ret(Magic, sizeof(Magic));
+    ret += FormatVersion;
+    AppendVarint(ret, Names_.size());
+    for(auto * pname : Names_)
+    {
+        AppendVarint(ret, pname->size());
+        ret += *pname;
+    }
+    return ret += Data_;
+}
+
+int BinaryStore::GetNameId(const char * name)
+{
+    auto it = NameIdsByPtr_.find(name);
+    if(it != NameIdsByPtr_.end()) return it->second;
+
+    auto res = NameIds_.emplace(name, (int) Names_.size());
+    if(res.second) Names_.push_back(&res.first->first);
+    return NameIdsByPtr_[name] = res.first->second;
+}
+
+BinaryStore::Object & BinaryStore::GetObject(const Referenceable * pobj, const char * type)
+{
+    return Objects_.emplace(pobj, Object{(int) Objects_.size() + 1, false, type}).first->second;
+}
+
+bool BinaryStore::PrepareNamedVar(const char* name, bool showErrorMsg)
+{
+    AppendVarint(Data_, GetNameId(name));
+    VarStarts_.push_back(Data_.size());
+    return true;
+}
+
+bool BinaryStore::FlushNamedVar(const char *name, bool showErrorMsg)
+{
+    if(!name) return true; // anonymous variable (cf. LoadStore::AnonymousIO)
+
+    assert(!VarStarts_.empty());
+    size_t start = VarStarts_.back();
+    VarStarts_.pop_back();
+    InsertVarint(Data_, start, Data_.size() - start);
+    return true;
+}
+
+bool BinaryStore::RawIO(bool& var)
+{
+    Data_ += char(var ? 1 : 0);
+    return true;
+}
+
+bool BinaryStore::RawIO(int& var)
+{
+    uint32_t u = var;
+    AppendVarint(Data_, (u << 1) ^ (var < 0 ? ~uint32_t(0) : 0)); // zigzag encoding, for small negative numbers
+    return true;
+}
+
+bool BinaryStore::RawIO(double& var)
+{
+    static_assert(sizeof(double) == sizeof(uint64_t), "Need 64-bit doubles");
+    uint64_t bits;
+    memcpy(&bits, &var, sizeof(bits));
+    for(int i = 0; i < 8; ++i, bits >>= 8) Data_ += char(bits & 0xff);
+    return true;
+}
+
+bool BinaryStore::RawIO(std::string& var)
+{
+    AppendVarint(Data_, var.size());
+    Data_ += var;
+    return true;
+}
+
+bool BinaryStore::RawIO(LoadStorableCompound& var)
+{
+    size_t start = Data_.size();
+    bool ret = var.LoadStoreMembers(*this);
+    InsertVarint(Data_, start, Data_.size() - start);
+    return ret;
+}
+
+bool BinaryStore::RawIORef(Referenceable*& ref, const char* type, bool required)
+{
+    if(!ref)
+    {
+        if(required)
+        {
+            Error("Tried to reference null pointer.");
+            return false;
+        }
+        AppendVarint(Data_, 0);
+        return true;
+    }
+
+    auto & entry = GetObject(ref, type);
+    if(!entry.Registered) ++NumForwardRefs_;
+    AppendVarint(Data_, entry.Id);
+    return true;
+}
+
+bool BinaryStore::RawIO_Register(Referenceable& obj)
+{
+    auto & entry = GetObject(&obj, obj.GetTypeString());
+    if(entry.Registered)
+    {
+        Error("Object of type %s registered twice", obj.GetTypeString());
+        return false;
+    }
+    entry.Registered = true;
+
+    AppendVarint(Data_, entry.Id);
+    AppendVarint(Data_, GetNameId(obj.GetTypeString()));
+    return RawIO(static_cast<LoadStorableCompound&>(obj));
+}
+
+bool BinaryStore::RawIOHandle(Referenceable*& ref, const void *context, const char* type, bool required)
+{
+    Error("Cannot store a handle (%s) in binary form", type);
+    return false;
+}
+
+bool BinaryStore::RawArrayIO(int nItems, std::function<bool(LoadStore &)> callback)
+{
+    AppendVarint(Data_, nItems);
+
+    bool ret = true;
+    for(int i = 0; i < nItems; ++i) ret = callback(*this) && ret;
+    return ret;
+}
+
+bool BinaryStore::RawMapIO(int nItems, std::function<bool(std::string &, LoadStore &)> callback)
+{
+    AppendVarint(Data_, nItems);
+
+    bool ret = true;
+    string key;
+    for(int i = 0; i < nItems; ++i)
+    {
+        // the key is only known after the callback, but precedes the value
+        size_t start = Data_.size();
+        ret = callback(key, *this) && ret;
+        string enc;
+        AppendVarint(enc, key.size());
+        Data_.insert(start, enc += key);
+    }
+    return ret;
+}
+
+void BinaryStore::Error(const char* msg, ... )
+{
+    ++NumErrors_;
+
+    va_list args; va_start(args, msg);
+    string str = FormatMessage(msg, args);
+    va_end(args);
+    fprintf(stderr, "Error: %s\n", str.c_str());
+}
+
+
+
+/////////////////
+// BinaryLoad
+
+BinaryLoad::BinaryLoad(std::string data, bool quiet)
+ : LoadStore(LoadStore::Load), Data_(std::move(data)), Limit_(Data_.size()), Quiet_(quiet)
+{
+    ReadHeader();
+}
+
+bool BinaryLoad::ReadHeader()
+{
+    if(Data_.size() < HeaderSize || memcmp(Data_.data(), Magic, sizeof(Magic)) != 0)
+        return DataError("Not a Ladybirds binary file");
+    if(Data_[sizeof(Magic)] != FormatVersion)
+    {
+        Error("Unsupported binary format version %d (expected %d)", Data_[sizeof(Magic)], FormatVersion);
+        Broken_ = true;
+        return false;
+    }
+    Pos_ = HeaderSize;
+
+    size_t nnames;
+    if(!ReadSize(nnames)) return false;
+    Names_.reserve(nnames);
+    for(size_t i = 0; i < nnames; ++i)
+    {
+        size_t len;
+        if(!ReadSize(len)) return false;
+        Names_.emplace_back(Data_, Pos_, len);
+        NameIds_.emplace(Names_.back(), (int) i);
+        Pos_ += len;
+    }
+    return true;
+}
+
+bool BinaryLoad::DataError(const char * msg)
+{
+    if(!Broken_) Error("%s", msg);
+    Broken_ = true;
+    return false;
+}
+
+bool BinaryLoad::ReadVarint(uint64_t & val)
+{
+    if(Broken_) return false;
+
+    val = 0;
+    for(int shift = 0; shift < 64; shift += 7)
+    {
+        if(Pos_ >= Limit_) return DataError("Unexpected end of data");
+        unsigned char byte = Data_[Pos_++];
+        val |= uint64_t(byte & 0x7f) << shift;
+        if(!(byte & 0x80)) return true;
+    }
+    return DataError("Invalid number");
+}
+
+bool BinaryLoad::ReadSize(size_t & size)
+{
+    uint64_t val;
+    if(!ReadVarint(val)) return false;
+    if(val > Limit_ - Pos_) return DataError("Invalid length");
+    size = val;
+    return true;
+}
+
+bool BinaryLoad::ReadNameId(int & id)
+{
+    uint64_t val;
+    if(!ReadVarint(val)) return false;
+    if(val >= Names_.size()) return DataError("Invalid name index");
+    id = int(val);
+    return true;
+}
+
+bool BinaryLoad::SkipCompound()
+{
+    size_t len;
+    if(!ReadSize(len)) return false;
+    Pos_ += len;
+    return true;
+}
+
+bool BinaryLoad::PrepareNamedVar(const char* name, bool showErrorMsg)
+{
+    int id;
+    auto it = NameIdsByPtr_.find(name);
+    if(it != NameIdsByPtr_.end()) id = it->second;
+    else
+    {
+        auto itname = NameIds_.find(name);
+        id = NameIdsByPtr_[name] = (itname != NameIds_.end()) ? itname->second : -1;
+    }
+
+    for(size_t i = FrameBegin_; i < Fields_.size(); ++i)
+    {
+        if(Fields_[i].NameId != id) continue;
+        Pos_ = Fields_[i].Begin;
+        Limit_ = Fields_[i].End;
+        return true;
+    }
+
+    if(showErrorMsg) Error("Parameter '%s' not found", name);
+    return false;
+}
+
+bool BinaryLoad::RawIO(bool& var)
+{
+    if(Broken_) return false;
+    if(Pos_ >= Limit_) return DataError("Unexpected end of data");
+    char c = Data_[Pos_++];
+    if(c != 0 && c != 1) return DataError("Boolean expected");
+    var = c;
+    return true;
+}
+
+bool BinaryLoad::RawIO(int& var)
+{
+    uint64_t val;
+    if(!ReadVarint(val)) return false;
+    if(val > 0xffffffffu) return DataError("Integer out of bounds");
+    uint32_t u = uint32_t(val >> 1) ^ (val & 1 ? ~uint32_t(0) : 0);
+    var = int(u);
+    return true;
+}
+
+bool BinaryLoad::RawIO(double& var)
+{
+    if(Broken_) return false;
+    if(Limit_ - Pos_ < 8) return DataError("Unexpected end of data");
+    uint64_t bits = 0;
+    for(int i = 8; i-- > 0; ) bits = (bits << 8) | (unsigned char) Data_[Pos_ + i];
+    Pos_ += 8;
+    memcpy(&var, &bits, sizeof(var));
+    return true;
+}
+
+bool BinaryLoad::RawIO(std::string& var)
+{
+    size_t len;
+    if(!ReadSize(len)) return false;
+    var.assign(Data_, Pos_, len);
+    Pos_ += len;
+    return true;
+}
+
+bool BinaryLoad::RawIO(LoadStorableCompound& var)
+{
+    size_t len;
+    if(!ReadSize(len)) return false;
+    size_t end = Pos_ + len, limit = Limit_, framebegin = FrameBegin_, fieldsbegin = Fields_.size();
+
+    // index the members first, such that they can be loaded in any order
+    Limit_ = end;
+    bool ret = true;
+    while(Pos_ < end)
+    {
+        int id; size_t size;
+        if(!ReadNameId(id) || !ReadSize(size))
+        {
+            ret = false;
+            break;
+        }
+        Fields_.push_back(Field{id, Pos_, Pos_ + size});
+        Pos_ += size;
+    }
+
+    FrameBegin_ = fieldsbegin;
+    if(ret) ret = var.LoadStoreMembers(*this);
+
+    Fields_.resize(fieldsbegin);
+    FrameBegin_ = framebegin;
+    Pos_ = end;
+    Limit_ = limit;
+    return ret;
+}
+
+bool BinaryLoad::RawIORef(Referenceable*& ref, const char* type, bool required)
+{
+    uint64_t id;
+    if(!ReadVarint(id)) return false;
+    if(id == 0)
+    {
+        if(required)
+        {
+            Error("Reference to %s expected, got null pointer", type);
+            return false;
+        }
+        ref = nullptr;
+        return true;
+    }
+
+    auto it = Objects_.find(int(id));
+    if(id > INT_MAX || it == Objects_.end())
+    {
+        Error("Reference to a %s that has not been loaded", type);
+        return false;
+    }
+    if(Names_[it->second.TypeId] != type)
+    {
+        Error("%s expected, got %s", type, Names_[it->second.TypeId].c_str());
+        return false;
+    }
+    ref = it->second.Ptr;
+    return true;
+}
+
+bool BinaryLoad::RawIO_Register(Referenceable& obj)
+{
+    uint64_t id;
+    int tid;
+    if(!ReadVarint(id) || !ReadNameId(tid)) return false;
+    if(id == 0 || id > INT_MAX) return DataError("Invalid object number");
+
+    const char * type = obj.GetTypeString();
+    if(Names_[tid] != type)
+    {
+        Error("%s expected, got %s", type, Names_[tid].c_str());
+        SkipCompound();
+        return false;
+    }
+    if(!Objects_.emplace(int(id), Object{&obj, tid}).second) return DataError("Object loaded twice");
+
+    return RawIO(static_cast<LoadStorableCompound&>(obj));
+}
+
+bool BinaryLoad::RawIOHandle(Referenceable*& ref, const void *context, const char* type, bool required)
+{
+    Error("Cannot load a handle (%s) from binary data", type);
+    return false;
+}
+
+bool BinaryLoad::RawArrayIO(int nItems, std::function<bool(LoadStore &)> callback)
+{
+    size_t n;
+    if(!ReadSize(n)) return false;
+
+    bool ret = true;
+    for(size_t i = 0; i < n && !Broken_; ++i) ret = callback(*this) && ret;
+    return ret && !Broken_;
+}
+
+bool BinaryLoad::RawMapIO(int nItems, std::function<bool(std::string &, LoadStore &)> callback)
+{
+    size_t n;
+    if(!ReadSize(n)) return false;
+
+    bool ret = true;
+    string key;
+    for(size_t i = 0; i < n && !Broken_; ++i)
+    {
+        if(!RawIO(key)) return false;
+        ret = callback(key, *this) && ret;
+    }
+    return ret && !Broken_;
+}
+
+void BinaryLoad::Error(const char* msg, ... )
+{
+    ++NumErrors_;
+
+    va_list args; va_start(args, msg);
+    string str = FormatMessage(msg, args);
+    va_end(args);
+    if(FirstError_.empty()) FirstError_ = str;
+    if(!Quiet_) fprintf(stderr, "Error: %s\n", str.c_str());
+}
+
+}} //namespace Ladybirds::loadstore
@@ -0,0 +1,137 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef BINARYLOADSTORE_H
+#define BINARYLOADSTORE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "loadstore.h"
+
+namespace Ladybirds { namespace loadstore {
+
+//! Stores objects in a compact binary format, to be loaded again by BinaryLoad (e.g. for caching them on disk).
+/** The data is the tree of values given by the RawIO calls, preceded by a table of the variable names.
+ *  A named variable is stored as the index of its name and its length, such that a compound can load its members
+ *  in any order, and members missing or not known when loading are simply skipped.
+ *  Numbers and lengths are stored as variable-length integers. Registered objects (cf. RawIO_Register) are numbered
+ *  in the order in which they first appear, and are stored together with their type string (cf. ADD_CLASS_SIGNATURE);
+ *  a reference is stored as the number of the object. Handles cannot be stored. **/
+class BinaryStore : public LoadStore
+{
+    struct Object { int Id; bool Registered; const char * Type; };
+
+private:
+    std::string Data_;
+    std::vector<size_t> VarStarts_;                       ///< Of the named variables being written
+    std::unordered_map<std::string, int> NameIds_;
+    std::unordered_map<const char*, int> NameIdsByPtr_;   ///< Cache for NameIds_, as names are mostly literals
+    std::vector<const std::string*> Names_;               ///< By id
+    std::unordered_map<const Referenceable*, Object> Objects_;
+    int NumErrors_ = 0;
+    int NumForwardRefs_ = 0;
+
+public:
+    inline BinaryStore() : LoadStore(LoadStore::Store) {}
+
+    BinaryStore(const BinaryStore& other) = delete;
+    BinaryStore& operator=(const BinaryStore& other) = delete;
+
+    //! Returns the stored data, with the header and the name table, once the root object is stored.
+    /** Files an Error() for every object that was referenced but not registered. **/
+    std::string GetData();
+
+    virtual bool PrepareNamedVar(const char* name, bool showErrorMsg = true) override;
+    virtual bool FlushNamedVar(const char *name, bool showErrorMsg = true) override;
+
+    virtual bool RawArrayIO(int nItems, std::function<bool(LoadStore &)> callback) override;
+    virtual bool RawMapIO(int nItems, std::function<bool(std::string &, LoadStore &)> callback) override;
+    virtual bool RawIO(LoadStorableCompound& var) override;
+    virtual bool RawIO(std::string& var) override;
+    virtual bool RawIO(bool& var) override;
+    virtual bool RawIO(int& var) override;
+    virtual bool RawIO(double& var) override;
+    virtual bool RawIORef(Referenceable *& ref, const char * type, bool required) override;
+    virtual bool RawIO_Register(Referenceable& obj) override;
+    virtual bool RawIOHandle(Referenceable *& ref, const void *context, const char *type, bool required) override;
+
+    using LoadStore::RawIORef;
+    using LoadStore::RawIOHandle;
+
+    virtual void Error(const char* msg, ... ) override;
+    inline int GetErrorCount() const {return NumErrors_;}
+    //! The number of references stored before the object they refer to, which BinaryLoad cannot resolve
+    inline int GetForwardRefCount() const {return NumForwardRefs_;}
+
+private:
+    int GetNameId(const char * name);
+    Object & GetObject(const Referenceable * pobj, const char * type);
+};
+
+
+
+//! Loads objects stored by BinaryStore. Errors are printed to stderr, unless the object is created quiet.
+/** An object can only be referenced once it is loaded (i.e. registered by RawIO_Register), so the members have to be
+ *  loaded in an order in which the references to an object come after it. **/
+class BinaryLoad : public LoadStore
+{
+    struct Field { int NameId; size_t Begin, End; };
+    struct Object { Referenceable * Ptr; int TypeId; };
+
+private:
+    std::string Data_;
+    size_t Pos_ = 0;   ///< Position of the next value to be read
+    size_t Limit_ = 0; ///< End of the variable being read
+    std::vector<std::string> Names_;
+    std::unordered_map<std::string, int> NameIds_;
+    std::unordered_map<const char*, int> NameIdsByPtr_; ///< Cache for NameIds_, as names are mostly literals
+    std::vector<Field> Fields_;     ///< Named variables of the compounds being read, innermost last
+    size_t FrameBegin_ = 0;         ///< Index of the first field of the innermost compound being read in Fields_
+    std::unordered_map<int, Object> Objects_;
+    bool Quiet_;
+    bool Broken_ = false; ///< Set when the data turned out to be damaged; all further reads then fail silently
+    int NumErrors_ = 0;
+    std::string FirstError_;
+
+public:
+    //! Prepares loading from \p data. Files an Error() if it does not appear to be stored by BinaryStore.
+    BinaryLoad(std::string data, bool quiet = false);
+
+    BinaryLoad(const BinaryLoad& other) = delete;
+    BinaryLoad& operator=(const BinaryLoad& other) = delete;
+
+    virtual bool PrepareNamedVar(const char* name, bool showErrorMsg = true) override;
+
+    virtual bool RawArrayIO(int nItems, std::function<bool(LoadStore &)> callback) override;
+    virtual bool RawMapIO(int nItems, std::function<bool(std::string &, LoadStore &)> callback) override;
+    virtual bool RawIO(LoadStorableCompound& var) override;
+    virtual bool RawIO(std::string& var) override;
+    virtual bool RawIO(bool& var) override;
+    virtual bool RawIO(int& var) override;
+    virtual bool RawIO(double& var) override;
+    virtual bool RawIORef(Referenceable *& ref, const char * type, bool required) override;
+    virtual bool RawIO_Register(Referenceable& obj) override;
+    virtual bool RawIOHandle(Referenceable *& ref, const void *context, const char *type, bool required) override;
+
+    using LoadStore::RawIORef;
+    using LoadStore::RawIOHandle;
+
+    virtual void Error(const char* msg, ... ) override;
+    inline int GetErrorCount() const {return NumErrors_;}
+    //! The message of the first error (empty if there was none)
+    inline const std::string & GetFirstError() const {return FirstError_;}
+
+private:
+    bool ReadHeader();
+    bool ReadVarint(uint64_t & val);
+    bool ReadSize(size_t & size); ///< Reads a length or number of items, which cannot exceed the remaining data
+    bool ReadNameId(int & id);
+    bool SkipCompound();
+    bool DataError(const char * msg);
+};
+
+}} //namespace Ladybirds::loadstore
+
+#endif // BINARYLOADSTORE_H
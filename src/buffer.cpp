@@ -19,6 +19,7 @@ bool Buffer::LoadStoreMembers(loadstore::LoadStore &ls)
         assert(((size_t) externalargindex) < arglist.size() && &arglist[externalargindex] == pExternalSource);
     }
     return ls.IO("size", Size) & ls.IO("membank", MemBank) & ls.IO("bankaddress", BankOffset)
+         & ls.IO("alignment", Alignment, false, 0)
          & ls.IO("isexternal", isexternal, false) & ls.IO("extargindex", externalargindex);
 }
 
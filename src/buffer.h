@@ -19,6 +19,7 @@ public:
     int Size = 1;        //!< Size, in bytes, of the buffer
     int MemBank = 0;    //!< Memory bank to store the buffer in (used for optimizing on MPPA)
     int BankOffset = -1; //!< Memory address of the buffer within the bank (i.e. 0 means at the start of the bank)
+    int Alignment = 0;   //!< Required alignment of the buffer in bytes (0: no particular alignment)
     
     const spec::Packet *pExternalSource = nullptr; ///< For packets provided from outside to a metakernel on invocation
     
@@ -23,7 +23,7 @@ std::string gUserDir;
 Ladybirds::tools::CmdLineOptions Ladybirds::tools::gCmdLineOptions;
 
 namespace {
-void Setfile(string & target, const llvm::cl::opt<string> & source)
+void Setfile(string & target, const string & source)
 {
     int crop = source.compare(0, 7, "file://") == 0 ? 7 : 0;
     target.assign(source, crop, string::npos);
@@ -122,25 +122,151 @@ void CmdLineOptions::Initialize(int argc, char* argv[])
     opt<string> projectinfofile("p", desc("Give the path to a project information file"), value_desc("project info"), sub(sc));
     opt<string> timingfile("t", desc("Give the path to a timing information file"), value_desc("timing info"), sub(sc));
     opt<string> accesscountfile("a", desc("Give the path to a timing information file"), value_desc("timing info"), sub(sc));
+    opt<int>    autogroups("g", desc("Merge the tasks into the given number of groups (without mapping)"),
+                           value_desc("number of groups"), init(0), sub(sc));
     opt<bool>   verbose("v", desc("Print out more information"), sub(sc));
     opt<bool>   stupidbanks("stupidbanks", desc("Purely load-balancing based bank assignment"), sub(sc));
+    opt<bool>   packbuffers("packbuffers", desc("Pack buffers into one arena instead of merging them"), sub(sc));
+    opt<int>    bufferalign("align", desc("Align generated buffers to the given number of bytes"),
+                            value_desc("bytes"), init(64), sub(sc));
+    opt<int>    hugepages("hugepages", desc("Align buffers of at least the given size to huge pages"),
+                          value_desc("bytes"), init(0), sub(sc));
+    opt<bool>   cachelayout("cachelayout", desc("Stagger buffers in one arena to avoid cache conflicts"), sub(sc));
+    opt<bool>   padrows("padrows", desc("Pad the rows of buffers read in column blocks to avoid cache conflicts"),
+                        sub(sc));
+    opt<bool>   numa("numa", desc("Place each buffer on the NUMA node of the thread writing most of it"), sub(sc));
+    opt<int>    pipeline("pipeline", desc("Let up to the given number of streamed invocations overlap"),
+                         value_desc("slots"), init(0), sub(sc));
+    opt<int>    contexts("contexts", desc("Let up to the given number of invocations run at the same time, each in a "
+                                          "context of its own (pthreads-dynamic)"), value_desc("n"), init(0), sub(sc));
+    opt<int>    batch("batch", desc("Let generated programs run each task for up to the given number of inputs per "
+                                    "invocation (pthreads-dynamic)"), value_desc("items"), init(0), sub(sc));
+    opt<bool>   futex("futex", desc("Let generated threads spin and then sleep on futexes when waiting for tasks"),
+                      sub(sc));
+    opt<bool>   depcounters("depcounters", desc("Let generated threads count dependencies instead of scanning bitfields"),
+                            sub(sc));
+    opt<bool>   rebalance("rebalance", desc("Let generated threads with -depcounters move tasks between them by their "
+                                    "measured run times between invocations"), sub(sc));
+    opt<bool>   multiplex("multiplex", desc("Let a bounded number of generated threads run the groups (with "
+                                    "-depcounters)"), sub(sc));
+    opt<int>    workers("workers", desc("Number of generated threads with -multiplex (0: one per core)"),
+                        value_desc("threads"), init(0), sub(sc));
+    opt<bool>   staticorder("staticorder", desc("Let generated threads run their tasks in a fixed order"), sub(sc));
+    opt<bool>   copyengine("copyengine", desc("Let idle generated threads prefetch inputs from other threads"), sub(sc));
+    opt<bool>   zerocopy("zerocopy", desc("Let generated threads read the data of other divisions in place instead of "
+                                      "copying it"), sub(sc));
+    opt<bool>   fuse("fuse", desc("Let generated threads run linear chains of tasks as one fused task"), sub(sc));
+    opt<double> coarsen("coarsen", desc("Let generated threads run consecutive instances of a kernel as one task, up "
+                                        "to the given cost"), value_desc("cost"), init(0), sub(sc));
+    opt<int>    prefetch("prefetch", desc("Let generated threads prefetch up to the given number of cache lines of the "
+                                      "inputs of the tasks likely to run next"), value_desc("lines"), init(0), sub(sc));
+    opt<int>    simdwidth("simdwidth", desc("Let generated threads check the dependencies of a task in vectors of 128, 256 "
+                                        "or 512 bits"), value_desc("bits"), init(0), sub(sc));
+    opt<int>    maxnodes("maxnodes", desc("Largest number of nodes per graph written by the graphviz backend (0: no limit)"),
+                         value_desc("nodes"), init(2000), sub(sc));
+    opt<string> variants("variants", desc("Lua file with the mappings, costs and scheduler settings to evaluate "
+                                          "(dse backend)"), value_desc("filename"), sub(sc));
+    opt<int>    jobs("jobs", desc("Number of variants evaluated at once by the dse backend (0: one per hardware "
+                                  "thread)"), value_desc("processes"), init(0), sub(sc));
+    opt<bool>   tabledispatch("tabledispatch", desc("Let generated threads run tasks from per-kernel argument tables"),
+                              sub(sc));
+    opt<bool>   specialize("specialize", desc("Call the kernels through copies specialized for constant arguments"),
+                           sub(sc));
+    opt<bool>   trace("trace", desc("Let generated threads record a trace of their tasks, written at exit"), sub(sc));
+    opt<bool>   counters("counters", desc("Let generated threads count cycles and cache misses of each task"), sub(sc));
+    opt<string> profile("profile", desc("Take the task costs from this trace of the generated program"),
+                        value_desc("trace file"), sub(sc));
+    opt<int>    pgo("pgo", desc("Build, run and recompile the generated program with its measured task costs"),
+                    value_desc("iterations"), init(0), sub(sc));
+    opt<int>    shards("shards", desc("Spread the generated task wrappers and buffers over the given number of files"),
+                       value_desc("files"), init(0), sub(sc));
+    opt<string> topology("topology", desc("Bind the generated threads along the host topology given in this file"),
+                         value_desc("filename"), sub(sc));
+    opt<string> taskorder("order", desc("Order of the tasks: level by level, depth first (dfs) or keeping the data in "
+                                        "flight small (locality), e.g. for the single backend"),
+                          value_desc("level|dfs|locality"), init("level"), sub(sc));
+    opt<string> device("device", desc("Comma-separated list of kernels to run on the GPU (cuda backend)"),
+                       value_desc("kernels"), sub(sc));
     opt<bool>   instrumentation("i", desc("Generate C++ code with inbuilt instrumentation"), sub(sc));
+    opt<string> parsecache("parse-cache", desc("Keep parsed programs in this directory and reuse them while the "
+                                               "specification and its headers are unchanged"),
+                           value_desc("directory"), sub(sc));
+    opt<string> passcache("pass-cache", desc("Keep the results of expensive passes in this directory and reuse them "
+                                             "while their input is unchanged"), value_desc("directory"), sub(sc));
+    opt<string> scratchdir("scratch-dir", desc("Keep the largest arrays of the compiler (the reachability of the tasks) "
+                                               "in memory-mapped files in this directory once they exceed -mem-budget"),
+                           value_desc("directory"), sub(sc));
+    opt<int>    membudget("mem-budget", desc("Megabytes of arrays kept in memory with -scratch-dir"),
+                          value_desc("MB"), init(1024), sub(sc));
+    opt<bool>   nopch("no-pch", desc("Do not precompile the headers included at the start of the specification"),
+                      sub(sc));
+    opt<string> serve("serve", desc("Keep the compiler loaded and run the compilations requested on this socket"),
+                      value_desc("socket"), sub(sc));
+    opt<string> server("server", desc("Compile on the server listening on this socket (cf. -serve)"),
+                       value_desc("socket"), sub(sc));
+    opt<bool>   timepasses("time-passes", desc("Print the time and memory used by each pass of the compiler"), sub(sc));
     opt<string> clang_passthrough("clang-args", desc("Additional arguments to be passed on to the clang compiler"), sub(sc));
-    opt<string> inputfile(Positional, desc("<specification file>"), sub(sc));
+    list<string> inputfiles(Positional, desc("<specification files>"), sub(sc));
     
     std::vector<const char*> argvPlus = {"", "ladybirds"};
     argvPlus.insert(argvPlus.end(), argv+1, argv+argc);
     ParseCommandLineOptions(argvPlus.size(), argvPlus.data());
 
-    Setfile(ProgramSpec,  inputfile);
+    // the first file is the program's main specification, the others hold further kernels (cf. parse::LoadCSpec)
+    ExtraSpecs.resize(inputfiles.empty() ? 0 : inputfiles.size() - 1);
+    if(!inputfiles.empty()) Setfile(ProgramSpec, inputfiles[0]);
+    for(size_t i = 0; i < ExtraSpecs.size(); ++i) Setfile(ExtraSpecs[i], inputfiles[i+1]);
     Setfile(MappingSpec,  mappingfile);
     Setfile(CostSpec,     costfile);
     Setfile(ProjectInfo,  projectinfofile);
     Setfile(TimingInfo,   timingfile);
     Setfile(AccessCounts, accesscountfile);
+    Setfile(ParseCache,   parsecache);
+    Setfile(PassCache,    passcache);
+    Setfile(ScratchDir,   scratchdir);
+    MemBudget = membudget;
+    if(!nopch && !gUserDir.empty()) PchDir = gUserDir + "pch";
+    Setfile(ServeSocket,  serve);
+    Setfile(ServerSocket, server);
+    Setfile(Variants,     variants);
+    AutoGroups = autogroups;
     Verbose = verbose;
     StupidBankAssign = stupidbanks;
+    PackBuffers = packbuffers;
+    CacheLayout = cachelayout;
+    PadRows = padrows;
+    BufferAlignment = bufferalign;
+    HugePages = hugepages;
+    Numa = numa;
+    Pipeline = pipeline;
+    Contexts = contexts;
+    Batch = batch;
+    FutexEvents = futex;
+    DepCounters = depcounters;
+    Rebalance = rebalance;
+    Multiplex = multiplex;
+    Workers = workers;
+    StaticOrder = staticorder;
+    CopyEngine = copyengine;
+    ZeroCopy = zerocopy;
+    FuseChains = fuse;
+    Coarsen = coarsen;
+    Prefetch = prefetch;
+    SimdWidth = simdwidth;
+    MaxNodes = maxnodes;
+    Jobs = jobs;
+    TableDispatch = tabledispatch;
+    Shards = shards;
+    Specialize = specialize;
+    Trace = trace;
+    HwCounters = counters;
+    Profile = profile;
+    PgoIterations = pgo;
+    Topology = topology;
+    TaskOrder = taskorder;
+    DeviceKernels = device;
     Instrumentation = instrumentation;
+    TimePasses = timepasses;
 
     std::istringstream iss(clang_passthrough);
     ClangParams = {
@@ -165,7 +291,7 @@ void CmdLineOptions::Initialize(int argc, char* argv[])
         exit(1);
     }
     
-    if(ProgramSpec.empty())
+    if(ProgramSpec.empty() && ServeSocket.empty()) // a server gets the input files with the requests
     {
         gMsgUI.Fatal("No input files!");
         exit(1);
@@ -182,14 +308,58 @@ static bool LsStringOrNull(loadstore::LoadStore & ls, const char * name, std::st
 bool CmdLineOptions::LoadStoreMembers(loadstore::LoadStore & ls)
 {
     return ls.IO("lbfile", ProgramSpec)
+         & ls.IO("lbsources", ExtraSpecs, false)
+         & LsStringOrNull(ls, "backend", Backend)
          & LsStringOrNull(ls, "projinfo", ProjectInfo)
          & LsStringOrNull(ls, "mapping", MappingSpec)
          & LsStringOrNull(ls, "costs", CostSpec)
          & LsStringOrNull(ls, "timings", TimingInfo)
          & LsStringOrNull(ls, "accesscounts", AccessCounts)
+         & ls.IO("groups", AutoGroups, false, 0)
          & ls.IO("verbose", Verbose, false)
          & ls.IO("instrumentation", Instrumentation, false)
-         & ls.IO("stupidbanks", StupidBankAssign, false);
+         & ls.IO("timepasses", TimePasses, false)
+         & ls.IO("stupidbanks", StupidBankAssign, false)
+         & ls.IO("packbuffers", PackBuffers, false)
+         & ls.IO("cachelayout", CacheLayout, false)
+         & ls.IO("padrows", PadRows, false)
+         & ls.IO("align", BufferAlignment, false, 64)
+         & ls.IO("hugepages", HugePages, false, 0)
+         & ls.IO("numa", Numa, false)
+         & ls.IO("pipeline", Pipeline, false, 0)
+         & ls.IO("contexts", Contexts, false, 0)
+         & ls.IO("batch", Batch, false, 0)
+         & ls.IO("futex", FutexEvents, false)
+         & ls.IO("depcounters", DepCounters, false)
+         & ls.IO("rebalance", Rebalance, false)
+         & ls.IO("multiplex", Multiplex, false)
+         & ls.IO("workers", Workers, false, 0)
+         & ls.IO("staticorder", StaticOrder, false)
+         & ls.IO("copyengine", CopyEngine, false)
+         & ls.IO("zerocopy", ZeroCopy, false)
+         & ls.IO("fuse", FuseChains, false)
+         & ls.IO("coarsen", Coarsen, false, 0)
+         & ls.IO("prefetch", Prefetch, false, 0)
+         & ls.IO("simdwidth", SimdWidth, false, 0)
+         & ls.IO("maxnodes", MaxNodes, false, 2000)
+         & LsStringOrNull(ls, "variants", Variants)
+         & ls.IO("jobs", Jobs, false, 0)
+         & ls.IO("tabledispatch", TableDispatch, false)
+         & ls.IO("shards", Shards, false, 0)
+         & ls.IO("specialize", Specialize, false)
+         & ls.IO("trace", Trace, false)
+         & ls.IO("counters", HwCounters, false)
+         & LsStringOrNull(ls, "profile", Profile)
+         & LsStringOrNull(ls, "parsecache", ParseCache)
+         & LsStringOrNull(ls, "passcache", PassCache)
+         & LsStringOrNull(ls, "scratchdir", ScratchDir)
+         & ls.IO("membudget", MemBudget, false, 1024)
+         & LsStringOrNull(ls, "pchdir", PchDir)
+         & ls.IO("pgo", PgoIterations, false, 0)
+         & ls.IO("topology", Topology, false)
+         & ls.IO("order", TaskOrder, false, "level")
+         & ls.IO("device", DeviceKernels, false)
+         & ls.IO("clangparams", ClangParams, false);
 }
 
 }} //namespace Ladybirds::tools
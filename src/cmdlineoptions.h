@@ -18,16 +18,60 @@ namespace tools {
 struct CmdLineOptions : public loadstore::LoadStorableCompound
 {
     std::string ProgramSpec;
+    std::vector<std::string> ExtraSpecs; //!< Further specification files of the program (cf. parse::LoadCSpec)
     std::string ProjectInfo;
     std::string MappingSpec;
     std::string CostSpec;
     std::string AccessCounts;
     std::string TimingInfo;
     std::string Backend;
+    std::string Topology; //!< Host topology for BindGroups (empty: read from /sys)
+    std::string TaskOrder = "level"; //!< Topological order of the tasks (cf. TaskTopoSort pass: level, dfs or locality)
+    std::string DeviceKernels; //!< Comma-separated names of the kernels to run on the GPU (cuda backend)
+    std::string Profile; //!< Trace of the generated program to take the task costs from (cf. TraceCost pass)
+    std::string ParseCache; //!< Directory for caching parsed programs (cf. parse::ParseCache, empty: no caching)
+    std::string PassCache; //!< Directory for caching the results of passes (cf. lua::Pass::ResultIO, empty: none)
+    std::string ScratchDir; //!< Directory for arrays moved out of core (cf. graph::ScratchSpace, empty: none)
+    std::string PchDir; //!< Directory for precompiled headers of the specifications (cf. parse::PrefixHeader, empty: none)
+    std::string ServeSocket; //!< Unix socket to serve compile requests on (cf. tools::Serve, empty: compile directly)
+    std::string ServerSocket; //!< Unix socket of a server to compile on (cf. tools::RunOnServer, empty: no server)
+    std::string Variants; //!< Lua file listing the variants evaluated by the dse backend (platform, mappings, costs)
     std::vector<std::string> ClangParams;
+    int AutoGroups = 0; //!< Number of groups for the AutoGroup pass (0: no automatic grouping)
+    int BufferAlignment = 64; //!< Minimum alignment of generated buffers (cf. AlignBuffers pass)
+    int HugePages = 0; //!< Buffers of at least this size are aligned to huge pages (0: never)
+    int Pipeline = 0; //!< Number of buffer copies for overlapping streamed invocations (0: no streaming)
+    int Contexts = 0; //!< Number of contexts for concurrent invocations (0: one invocation at a time, pthreads-dynamic)
+    int Batch = 0; //!< Largest number of inputs of one batched invocation (0: no batched entry, pthreads-dynamic)
+    int PgoIterations = 0; //!< Number of times to build, run and recompile with the measured costs (pthreads-dynamic)
+    int Shards = 0; //!< Number of extra files for the generated task wrappers and buffers (0: none, pthreads-dynamic)
+    int Prefetch = 0; //!< Cache lines of the inputs of the next tasks to prefetch before each task (pthreads-dynamic)
+    int SimdWidth = 0; //!< Bits of the task bitfields checked at once (0: one word, pthreads-dynamic)
+    int Workers = 0; //!< Number of worker threads with -multiplex (0: one per core the groups are bound to)
+    int Jobs = 0; //!< Number of processes evaluating variants at once in the dse backend (0: one per hardware thread)
+    int MemBudget = 1024; //!< Megabytes of arrays kept in memory with ScratchDir (cf. graph::ScratchSpace)
+    int MaxNodes = 2000; //!< Nodes per graph written by the graphviz backend, larger ones are cut (0: no limit)
+    double Coarsen = 0; //!< Cost up to which instances of a kernel run as one task (cf. CoarsenTasks, pthreads-dynamic)
     bool Verbose;
     bool StupidBankAssign;
+    bool PackBuffers;
+    bool CacheLayout;
+    bool PadRows; //!< Pad the rows of buffers read in column blocks (cf. BufferPreallocation)
+    bool Numa;
+    bool FutexEvents; //!< Generate futex-based events instead of condition variables (pthreads-dynamic)
+    bool DepCounters; //!< Generate a runtime with atomic dependency counters and ready queues (pthreads-dynamic)
+    bool Rebalance; //!< Move tasks between threads by their measured run times between invocations (-depcounters)
+    bool Multiplex; //!< Run the groups on a bounded pool of worker threads (-depcounters, cf. Workers)
+    bool StaticOrder; //!< Generate straight-line task sequences that only wait for other groups (pthreads-dynamic)
+    bool CopyEngine; //!< Copy inputs from other groups into local buffers while waiting for tasks (pthreads-dynamic)
+    bool ZeroCopy; //!< Read the data of other divisions in place instead of copying it (pthreads-dynamic)
+    bool FuseChains; //!< Run linear chains of tasks within a group as one task (cf. FuseChains pass, pthreads-dynamic)
+    bool TableDispatch; //!< Dispatch tasks through per-kernel argument tables instead of wrappers (pthreads-dynamic)
+    bool Specialize; //!< Call kernels through copies with constant dimensions and parameters (pthreads-dynamic)
+    bool Trace; //!< Record the tasks run by each thread and write them as a Chrome trace at exit (pthreads-dynamic)
+    bool HwCounters; //!< Count cycles, instructions and cache misses of each task, written at exit (pthreads-dynamic)
     bool Instrumentation;
+    bool TimePasses; //!< Print the time, memory and program sizes of each pass at the end (cf. lua::PassStats)
     
     //! Parses the command line and stores the results in this structure. Also sets gResourceDir.
     void Initialize(int argc, char * argv[]);
@@ -17,6 +17,7 @@ bool Dependency::Anchor::LoadStoreMembers(loadstore::LoadStore &ls)
 {
     Task * ptask;
     std::string packetname;
+    vector<Range> index(Index.begin(), Index.end());
     
     if(ls.IsStoring())
     {
@@ -27,16 +28,18 @@ bool Dependency::Anchor::LoadStoreMembers(loadstore::LoadStore &ls)
     
     if(!( ls.IORef("task", ptask)
         & ls.IO("packet", packetname)
-        & ls.IO("index", Index.AsVector(), false)))
+        & ls.IO("index", index, false)))
         return false;
     
     if(ls.IsStoring()) return true;
     
+    Index.AsVector().assign(index.begin(), index.end());
+    
     TheIface = ptask->GetIfaceByName(packetname);
     if(!TheIface)
     {
         ls.Error("Kernel '%s' does not produce/consume a block called '%s'.",
-                    TheIface->GetTask()->GetKernel()->Name.c_str(), packetname.c_str());
+                    ptask->GetKernel()->Name.c_str(), packetname.c_str());
         return false;
     }
 
@@ -119,7 +122,7 @@ long Dependency::GetMemSize() const
 
 std::ostream &operator<<(std::ostream &strm, Dependency::Anchor &anch)
 {
-    return strm << anch.TheIface->GetTask()->Name << '.' << anch.TheIface->GetName() << anch.Index;
+    return strm << anch.TheIface->GetTask()->GetFullName() << '.' << anch.TheIface->GetName() << anch.Index;
 }
 
 
@@ -44,6 +44,8 @@ public:
     //! Returns true if From and To together with the corresponing Indices are type compatible.
     bool CheckCompatibility() const;
     long GetMemSize() const; //!< Amount of memory that needs to be transmitted
+    //! Bytes allocated on the heap for the indices of the anchors (cf. impl::MemStats)
+    inline std::size_t GetHeapBytes() const { return From.Index.GetHeapBytes() + To.Index.GetHeapBytes(); }
     
     virtual bool LoadStoreMembers(loadstore::LoadStore& ls) override;
     
@@ -0,0 +1,86 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "dependencyindex.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "program.h"
+
+namespace Ladybirds { namespace impl {
+
+using spec::Dependency;
+using spec::Task;
+
+DependencyIndex::DependencyIndex(const Program & prog)
+    : pDepsBegin_(prog.Dependencies.data()), DepCount_(prog.Dependencies.size()),
+      GraphVersion_(prog.TaskGraph.GetVersion()), Revision_(prog.Revision), pMainTask_(&prog.MainTask),
+      FirstSlots_(prog.TaskGraph.GetNodeMap<Slot>(0))
+{
+    Slot nslots = 0;
+    for(auto & t : prog.GetTasks())
+    {
+        FirstSlots_[t] = nslots;
+        nslots += t.Ifaces.size();
+    }
+    MainSlot_ = nslots;
+    nslots += prog.MainTask.Ifaces.size();
+
+    // counting sort of the dependencies by the slots of their producing and consuming interfaces
+    OutOffsets_.assign(nslots + 1, 0);
+    InOffsets_.assign(nslots + 1, 0);
+    for(auto & dep : prog.Dependencies)
+    {
+        ++OutOffsets_[GetSlot(*dep.From.TheIface) + 1];
+        ++InOffsets_[GetSlot(*dep.To.TheIface) + 1];
+    }
+    std::partial_sum(OutOffsets_.begin(), OutOffsets_.end(), OutOffsets_.begin());
+    std::partial_sum(InOffsets_.begin(), InOffsets_.end(), InOffsets_.begin());
+
+    OutDeps_.resize(DepCount_);
+    InDeps_.resize(DepCount_);
+    auto outpos = OutOffsets_, inpos = InOffsets_;
+    for(auto & dep : prog.Dependencies)
+    {
+        OutDeps_[outpos[GetSlot(*dep.From.TheIface)]++] = &dep;
+        InDeps_[inpos[GetSlot(*dep.To.TheIface)]++] = &dep;
+    }
+
+    // the outgoing dependencies of each task once more, ordered by consuming task for GetDeps
+    PairDeps_ = OutDeps_;
+    PairKeys_.resize(DepCount_);
+    auto consumerslot = [this](const Dependency * pdep) { return GetFirstSlot(*pdep->To.TheIface->GetTask()); };
+    auto addtask = [&](const Task & t)
+    {
+        Slot first = GetFirstSlot(t), last = first + t.Ifaces.size();
+        auto itbegin = PairDeps_.begin() + OutOffsets_[first], itend = PairDeps_.begin() + OutOffsets_[last];
+        std::stable_sort(itbegin, itend,
+                         [&](auto pdep1, auto pdep2) { return consumerslot(pdep1) < consumerslot(pdep2); });
+        for(auto it = itbegin; it != itend; ++it) PairKeys_[it - PairDeps_.begin()] = consumerslot(*it);
+
+        for(Slot s = first; s != last; ++s)
+        {
+            if(OutOffsets_[s] != OutOffsets_[s + 1]) Producers_.push_back(&t.Ifaces[s - first]);
+        }
+    };
+    for(auto & t : prog.GetTasks()) addtask(t);
+    addtask(prog.MainTask);
+}
+
+bool DependencyIndex::IsCurrent(const Program & prog) const
+{
+    return prog.Dependencies.data() == pDepsBegin_ && prog.Dependencies.size() == DepCount_
+        && prog.TaskGraph.GetVersion() == GraphVersion_ && prog.Revision == Revision_;
+}
+
+DependencyIndex::DepRange DependencyIndex::GetDeps(const Task & from, const Task & to) const
+{
+    Slot first = GetFirstSlot(from);
+    auto itbegin = PairKeys_.begin() + OutOffsets_[first];
+    auto itend = PairKeys_.begin() + OutOffsets_[first + from.Ifaces.size()];
+    auto range = std::equal_range(itbegin, itend, GetFirstSlot(to));
+    return DepRange(PairDeps_.data() + (range.first - PairKeys_.begin()),
+                    PairDeps_.data() + (range.second - PairKeys_.begin()));
+}
+
+}} //namespace Ladybirds::impl
@@ -0,0 +1,97 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_IMPL_DEPENDENCYINDEX_H
+#define LADYBIRDS_IMPL_DEPENDENCYINDEX_H
+
+#include <cstddef>
+#include <vector>
+
+#include "graph/graph.h"
+#include "graph/itemmap.h"
+#include "dependency.h"
+#include "task.h"
+
+namespace Ladybirds { namespace impl {
+struct Program;
+
+/** An index of the dependencies of a program by producing interface, consuming interface and pair of tasks, as
+ *  returned by Program::GetDependencyIndex.
+ *
+ *  The interfaces of all tasks (and of the main task) are numbered consecutively, task by task, and the dependencies of
+ *  each interface are stored contiguously in compressed sparse row format, in the order of Program::Dependencies. As
+ *  the interfaces of a task are numbered consecutively, the dependencies of a task are contiguous as well. The index is
+ *  only valid as long as neither the dependency list nor the task graph change; IsCurrent checks this as far as it can
+ *  be noticed, i.e. for changes of the task graph, of the storage of the dependency list or by another pass.
+ **/
+class DependencyIndex
+{
+public:
+    /// A range of dependencies
+    class DepRange
+    {
+        const spec::Dependency * const *pBegin_, * const *pEnd_;
+    public:
+        inline DepRange(const spec::Dependency * const * pbegin, const spec::Dependency * const * pend)
+            : pBegin_(pbegin), pEnd_(pend) {}
+        inline const spec::Dependency * const * begin() const { return pBegin_; }
+        inline const spec::Dependency * const * end() const { return pEnd_; }
+        inline std::size_t size() const { return pEnd_ - pBegin_; }
+        inline bool empty() const { return pBegin_ == pEnd_; }
+    };
+
+private:
+    using Slot = int;
+
+    const spec::Dependency * pDepsBegin_;
+    std::size_t DepCount_;
+    graph::Version GraphVersion_;
+    unsigned Revision_;
+    const spec::Task * pMainTask_;
+    graph::ItemMap<Slot> FirstSlots_; ///< First interface slot of each task
+    Slot MainSlot_;                   ///< First interface slot of the main task
+    std::vector<Slot> OutOffsets_, InOffsets_; ///< Start of the dependencies of each slot; one extra end element
+    std::vector<const spec::Dependency*> OutDeps_, InDeps_;
+    std::vector<const spec::Dependency*> PairDeps_; ///< Like OutDeps_, but per task sorted by consuming task
+    std::vector<Slot> PairKeys_;                    ///< First slot of the consuming task of each entry of PairDeps_
+    std::vector<const spec::Iface*> Producers_;
+
+public:
+    explicit DependencyIndex(const Program & prog);
+
+    /// Checks if the index still reflects the current dependencies and task graph of \p prog
+    bool IsCurrent(const Program & prog) const;
+
+    /// The dependencies whose data is produced by \p iface
+    inline DepRange GetOutDeps(const spec::Iface & iface) const
+        { return GetRange(OutOffsets_, OutDeps_, GetSlot(iface), 1); }
+    /// The dependencies whose data is consumed by \p iface
+    inline DepRange GetInDeps(const spec::Iface & iface) const
+        { return GetRange(InOffsets_, InDeps_, GetSlot(iface), 1); }
+    /// The dependencies whose data is produced by \p task, by interface
+    inline DepRange GetOutDeps(const spec::Task & task) const
+        { return GetRange(OutOffsets_, OutDeps_, GetFirstSlot(task), task.Ifaces.size()); }
+    /// The dependencies whose data is consumed by \p task, by interface
+    inline DepRange GetInDeps(const spec::Task & task) const
+        { return GetRange(InOffsets_, InDeps_, GetFirstSlot(task), task.Ifaces.size()); }
+    /// The dependencies from \p from to \p to
+    DepRange GetDeps(const spec::Task & from, const spec::Task & to) const;
+    /// The interfaces (of the tasks and of the main task) that produce data for at least one dependency, in the order
+    /// of the tasks and of the interfaces within a task
+    inline const std::vector<const spec::Iface*> & GetProducers() const { return Producers_; }
+    /// The position of \p dep in Program::Dependencies, e.g. for indexing per-dependency data
+    inline std::size_t GetPosition(const spec::Dependency & dep) const { return &dep - pDepsBegin_; }
+
+private:
+    inline Slot GetFirstSlot(const spec::Task & task) const
+        { return &task == pMainTask_ ? MainSlot_ : FirstSlots_[task]; }
+    inline Slot GetSlot(const spec::Iface & iface) const
+        { return GetFirstSlot(*iface.GetTask()) + Slot(&iface - iface.GetTask()->Ifaces.data()); }
+    using DepVector = std::vector<const spec::Dependency*>;
+    static inline DepRange GetRange(const std::vector<Slot> & offsets, const DepVector & deps, Slot first,
+                                    std::size_t count)
+        { return DepRange(deps.data() + offsets[first], deps.data() + offsets[first + count]); }
+};
+
+}} //namespace Ladybirds::impl
+
+#endif // LADYBIRDS_IMPL_DEPENDENCYINDEX_H
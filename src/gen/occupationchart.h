@@ -7,6 +7,8 @@
 #include <algorithm>
 #include <limits>
 #include <map>
+#include <type_traits>
+#include <vector>
 
 namespace Ladybirds {
 namespace gen {
@@ -31,11 +33,20 @@ public:
     inline T *operator->() { return Occupant_; }
 };
     
+/// Selects the implementation of OccupationChart that stores the occupation as a step function in a std::map.
+/** Works for any occupation type, but most operations are linear in the number of steps they cover. **/
+struct MapChart {};
+/// Selects the implementation of OccupationChart that stores the occupation in a segment tree over time.
+/** Needs an arithmetic occupation type, but occupying and all queries take logarithmic time. **/
+struct SegmentTreeChart {};
+
+template<typename T, typename impl_t = MapChart> class OccupationChart;
+
 /** 
  * Stores the occupation of a certain resource over time
  **/
 template<typename T>
-class OccupationChart
+class OccupationChart<T, MapChart>
 {
 public:
     using Time = long;
@@ -47,6 +58,10 @@ private:
     
 public:
     OccupationChart(long capacity = 1) : Capacity_(capacity), Entries_({{Time(0), T()}}) {}
+    inline long GetCapacity() const { return Capacity_; }
+    /// Returns the bytes allocated for the entries, estimating the tree overhead per entry as four pointers
+    inline std::size_t GetHeapBytes() const
+        { return Entries_.size() * (sizeof(typename decltype(Entries_)::value_type) + 4*sizeof(void*)); }
 
     T operator[](Time t) const
     {
@@ -158,6 +173,204 @@ public:
     }
 };
 
+/**
+ * Stores the occupation of a certain resource over time in a segment tree, with the same interface as the map-based
+ * chart.
+ *
+ * The tree spans the entire time range [0, Infinite) and only creates the nodes an operation actually splits, so its
+ * depth is bounded by the number of bits of Time. Each node stores the amount added to its whole range (Add) and the
+ * maximum and minimum occupation within its range, excluding the additions stored in its ancestors. Missing children
+ * are unoccupied. Occupy, Unoccupy, operator[], AvailableSince and LeastAvail take O(log range) time. Available needs
+ * one such step for every gap that is too short to fit the requested duration.
+ **/
+template<typename T>
+class OccupationChart<T, SegmentTreeChart>
+{
+    static_assert(std::is_arithmetic<T>::value, "Segment tree occupation charts need an arithmetic occupation type");
+
+public:
+    using Time = long;
+    static constexpr Time Infinite = std::numeric_limits<Time>::max();
+
+private:
+    struct Node
+    {
+        T Add = T(), Max = T(), Min = T();
+        int Left = -1, Right = -1;
+    };
+
+    long Capacity_;
+    std::vector<Node> Nodes_;
+
+public:
+    OccupationChart(long capacity = 1) : Capacity_(capacity), Nodes_(1) {}
+    inline long GetCapacity() const { return Capacity_; }
+    /// Returns the bytes allocated for the nodes of the tree
+    inline std::size_t GetHeapBytes() const { return Nodes_.capacity() * sizeof(Node); }
+
+    T operator[](Time t) const
+    {
+        assert(t >= 0);
+        T ret = T();
+        Time lo = 0, hi = Infinite;
+        for(int i = 0; i >= 0; )
+        {
+            auto &node = Nodes_[i];
+            ret += node.Add;
+            Time mid = Mid(lo, hi);
+            if(t < mid) i = node.Left, hi = mid;
+            else i = node.Right, lo = mid;
+        }
+        return ret;
+    }
+
+    void Clear() { Nodes_.assign(1, Node()); }
+
+    bool Occupy(Time from, Time to, T occ)
+    {
+        assert(from >= 0 && to > from);
+        if(RangeMax(0, 0, Infinite, from, to) + occ > Capacity_) return false;
+        Update(0, 0, Infinite, from, to, occ);
+        return true;
+    }
+
+    bool Unoccupy(Time from, Time to, T occ)
+    {
+        assert(from >= 0 && to > from);
+        if(RangeMin(0, 0, Infinite, from, to) - occ < 0) return false;
+        Update(0, 0, Infinite, from, to, -occ);
+        return true;
+    }
+
+    /// Returns the point in time no sooner than \p from at which an amount \p occ of resources
+    /// will be available for at least \p duration
+    Time Available(Time from, Time duration, T occ) const
+    {
+        T maxocc = Capacity_ - occ;
+        while(true)
+        {
+            from = FirstWhere(0, 0, Infinite, T(), from, [maxocc](T v) { return v <= maxocc; },
+                              [](const Node &n) { return n.Min; });
+            if(from == Infinite) return Infinite;
+
+            Time to = (duration == Infinite || duration >= Infinite - from) ? Infinite : from + duration;
+            Time blocked = FirstWhere(0, 0, Infinite, T(), from, [maxocc](T v) { return v > maxocc; },
+                                      [](const Node &n) { return n.Max; });
+            if(blocked >= to) return from;
+            from = blocked;
+        }
+    }
+
+    /// Returns the earliest point t in time such that an amount \p occ of resources is available
+    /// throughout the entire timespan [t, \p at). If no such t exists, returns \p at.
+    Time AvailableSince(Time at, T occ) const
+    {
+        T maxocc = Capacity_ - occ;
+        Time last = LastBlocked(0, 0, Infinite, T(), at, maxocc);
+        return last < 0 ? 0 : last + 1;
+    }
+
+    /// Returns the maximum amount of resources available throughout the entire timespan [\p from, \p to)
+    auto LeastAvail(Time from, Time to) const
+    {
+        return Capacity_ - RangeMax(0, 0, Infinite, from, to);
+    }
+
+private:
+    static inline Time Mid(Time lo, Time hi) { return lo + (hi - lo)/2; }
+    inline T ChildMax(int i) const { return i < 0 ? T() : Nodes_[i].Max; }
+    inline T ChildMin(int i) const { return i < 0 ? T() : Nodes_[i].Min; }
+
+    /// \internal Adds \p occ to [\p from, \p to) within the subtree of node \p i, which spans [\p lo, \p hi)
+    void Update(int i, Time lo, Time hi, Time from, Time to, T occ)
+    {
+        if(from <= lo && hi <= to)
+        {
+            auto &node = Nodes_[i];
+            node.Add += occ, node.Max += occ, node.Min += occ;
+            return;
+        }
+
+        Time mid = Mid(lo, hi);
+        if(from < mid)
+        {
+            if(Nodes_[i].Left < 0) { int child = NewNode(); Nodes_[i].Left = child; }
+            Update(Nodes_[i].Left, lo, mid, from, to, occ);
+        }
+        if(to > mid)
+        {
+            if(Nodes_[i].Right < 0) { int child = NewNode(); Nodes_[i].Right = child; }
+            Update(Nodes_[i].Right, mid, hi, from, to, occ);
+        }
+
+        auto &node = Nodes_[i];
+        node.Max = node.Add + std::max(ChildMax(node.Left), ChildMax(node.Right));
+        node.Min = node.Add + std::min(ChildMin(node.Left), ChildMin(node.Right));
+    }
+
+    inline int NewNode() { Nodes_.emplace_back(); return Nodes_.size() - 1; }
+
+    /// \internal Maximum occupation in [\p from, \p to) within the subtree of node \p i (excluding ancestors)
+    T RangeMax(int i, Time lo, Time hi, Time from, Time to) const
+    {
+        if(i < 0) return T();
+        auto &node = Nodes_[i];
+        if(from <= lo && hi <= to) return node.Max;
+        Time mid = Mid(lo, hi);
+        T ret = std::numeric_limits<T>::lowest();
+        if(from < mid) ret = std::max(ret, RangeMax(node.Left, lo, mid, from, to));
+        if(to > mid) ret = std::max(ret, RangeMax(node.Right, mid, hi, from, to));
+        return node.Add + ret;
+    }
+
+    /// \internal Minimum occupation in [\p from, \p to) within the subtree of node \p i (excluding ancestors)
+    T RangeMin(int i, Time lo, Time hi, Time from, Time to) const
+    {
+        if(i < 0) return T();
+        auto &node = Nodes_[i];
+        if(from <= lo && hi <= to) return node.Min;
+        Time mid = Mid(lo, hi);
+        T ret = std::numeric_limits<T>::max();
+        if(from < mid) ret = std::min(ret, RangeMin(node.Left, lo, mid, from, to));
+        if(to > mid) ret = std::min(ret, RangeMin(node.Right, mid, hi, from, to));
+        return node.Add + ret;
+    }
+
+    /// \internal Returns the first point in time no sooner than \p from (and within [\p lo, \p hi)) at which the
+    /// occupation satisfies \p pred, or Infinite. \p bound selects the node statistic (Min or Max) that tells whether
+    /// a subtree can contain such a point; \p base is the sum of the additions of the ancestors of node \p i.
+    template<typename pred_t, typename bound_t>
+    Time FirstWhere(int i, Time lo, Time hi, T base, Time from, pred_t pred, bound_t bound) const
+    {
+        if(hi <= from) return Infinite;
+        if(i < 0) return pred(base) ? std::max(lo, from) : Infinite;
+        auto &node = Nodes_[i];
+        if(!pred(base + bound(node))) return Infinite;
+        if(node.Left < 0 && node.Right < 0) return std::max(lo, from);
+
+        Time mid = Mid(lo, hi);
+        Time ret = FirstWhere(node.Left, lo, mid, base + node.Add, from, pred, bound);
+        if(ret != Infinite) return ret;
+        return FirstWhere(node.Right, mid, hi, base + node.Add, from, pred, bound);
+    }
+
+    /// \internal Returns the last point in time before \p at (and within [\p lo, \p hi)) at which the occupation
+    /// exceeds \p maxocc, or -1.
+    Time LastBlocked(int i, Time lo, Time hi, T base, Time at, T maxocc) const
+    {
+        if(lo >= at) return -1;
+        if(i < 0) return base > maxocc ? std::min(hi, at) - 1 : -1;
+        auto &node = Nodes_[i];
+        if(base + node.Max <= maxocc) return -1;
+        if(node.Left < 0 && node.Right < 0) return std::min(hi, at) - 1;
+
+        Time mid = Mid(lo, hi);
+        Time ret = LastBlocked(node.Right, mid, hi, base + node.Add, at, maxocc);
+        if(ret >= 0) return ret;
+        return LastBlocked(node.Left, lo, mid, base + node.Add, at, maxocc);
+    }
+};
+
 /** 
  * Stores the occupation of a certain resource over time, where only one occupant can occupy the resource at a time.
  * A pointer to this occupant is stored.
@@ -0,0 +1,129 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_GEN_SECTIONINDEX_H
+#define LADYBIRDS_GEN_SECTIONINDEX_H
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "range.h"
+
+namespace Ladybirds {
+namespace gen {
+
+//! Index of the sections (subspaces) of a container for finding the ones overlapping a space (cf. SpaceDivision).
+/** For each dimension, the sections are sorted by their begin in that dimension, in one list for each size class
+ *  (sizes from 2^i to 2^(i+1)-1). A section in class i overlapping a range begins at most 2^(i+1)-2 elements before
+ *  it, so each class needs one logarithmic search and then only visits sections close to the range. Queries go along
+ *  the dimension in which they cover the smallest part of the envelope of the sections, so slices of a large array
+ *  are found among the sections of that slice.
+ *  The index refers to the sections by the address of their Space, which has to stay valid as long as they are
+ *  indexed (e.g. the key of a node-based container), and stores a \p Handle (e.g. an iterator) for each one.
+ *  Spaces without dimensions are indexed as if they had one of size 1. **/
+template<typename Handle>
+class SectionIndex
+{
+    using Key = std::pair<int, const Space*>; ///< Begin in the dimension, and the section
+    struct KeyLess
+    {
+        bool operator()(const Key & a, const Key & b) const
+            { return a.first != b.first ? a.first < b.first : std::less<const Space*>()(a.second, b.second); }
+    };
+    using SizeClass = std::map<Key, Handle, KeyLess>;
+
+    struct Dimension
+    {
+        std::vector<SizeClass> Classes;
+        Range Envelope; ///< Union of the ranges of all sections inserted since the last Clear
+    };
+
+    std::vector<Dimension> Dims_;
+    size_t Size_ = 0;
+
+public:
+    //! Creates an index for sections of \p ndims dimensions
+    explicit SectionIndex(int ndims) : Dims_(std::max(ndims, 1)) {}
+    //! Creates an index for sections of the dimensions of the first one inserted
+    SectionIndex() = default;
+
+    //! Returns the number of sections in the index
+    size_t size() const { return Size_; }
+
+    void Clear()
+    {
+        for(auto & dim : Dims_) dim = Dimension();
+        Size_ = 0;
+    }
+
+    //! Adds the section \p sec
+    void Insert(const Space & sec, Handle handle)
+    {
+        ++Size_;
+        if(Dims_.empty()) Dims_.resize(std::max(sec.Dimensions(), 1));
+        for(size_t d = 0; d < Dims_.size(); ++d)
+        {
+            auto & dim = Dims_[d];
+            Range rg = GetRange(sec, d);
+            auto cls = GetClass(rg.size());
+            if(dim.Classes.size() <= cls) dim.Classes.resize(cls + 1);
+            dim.Classes[cls].emplace(Key(rg.first(), &sec), handle);
+            dim.Envelope |= rg;
+        }
+    }
+
+    //! Removes the section \p sec (the same object that was inserted)
+    void Erase(const Space & sec)
+    {
+        --Size_;
+        for(size_t d = 0; d < Dims_.size(); ++d)
+        {
+            Range rg = GetRange(sec, d);
+            Dims_[d].Classes[GetClass(rg.size())].erase(Key(rg.first(), &sec));
+        }
+    }
+
+    //! Calls \p fn(handle) for each section overlapping \p s (cf. Space::Overlaps), in no particular order.
+    //! \p fn may not modify the index.
+    template<typename F> void ForOverlaps(const Space & s, F && fn) const
+    {
+        if(Size_ == 0) return;
+
+        size_t best = 0;
+        double bestshare = 2;
+        for(size_t d = 0; d < Dims_.size(); ++d)
+        {
+            double share = double(std::max(GetRange(s, d).size(), 0)) / std::max(Dims_[d].Envelope.size(), 1);
+            if(share < bestshare) best = d, bestshare = share;
+        }
+
+        Range rg = GetRange(s, best);
+        auto & classes = Dims_[best].Classes;
+        for(size_t cls = 0; cls < classes.size(); ++cls)
+        {
+            long long from = (long long) rg.first() - (2LL << cls) + 2;
+            from = std::max<long long>(from, std::numeric_limits<int>::min());
+            auto it = classes[cls].lower_bound(Key(int(from), nullptr));
+            for(auto itend = classes[cls].end(); it != itend && it->first.first < rg.end(); ++it)
+            {
+                if(it->first.second->Overlaps(s)) fn(it->second);
+            }
+        }
+    }
+
+private:
+    static Range GetRange(const Space & s, size_t d) { return s.Dimensions() ? s[d] : Range::BeginCount(0, 1); }
+    static size_t GetClass(int size)
+    {
+        size_t cls = 0;
+        while(size > 1) size >>= 1, ++cls; // empty sections (size <= 0) go to class 0
+        return cls;
+    }
+};
+
+}} //namespace Ladybirds::gen
+
+#endif // LADYBIRDS_GEN_SECTIONINDEX_H
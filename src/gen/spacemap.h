@@ -4,40 +4,53 @@
 #define LADYBIRDS_GEN_SPACEMAP_H
 
 #include <deque>
+#include <list>
 
+#include "gen/sectionindex.h"
 #include "range.h"
 
 namespace Ladybirds {
 namespace gen {
 
+//! Map from (possibly overlapping) subspaces to values. The keys must not be changed while they are in the map.
 template<typename T>
 class SpaceMap
 {
 public:
     struct Entry { Space Key; T Value; };
-    using Iterator = typename std::deque<Entry>::iterator;
+    using Iterator = typename std::list<Entry>::iterator;
     
 private:
-    std::deque<Entry> Entries_;
+    std::list<Entry> Entries_;
+    SectionIndex<Iterator> Index_; ///< Of the keys, for FindOverlaps
     
 public:
     SpaceMap() = default;
+    SpaceMap(const SpaceMap &) = delete; // the index refers to the entries
+    SpaceMap & operator=(const SpaceMap &) = delete;
     
     Iterator Begin() { return Entries_.begin(); }
     Iterator End() { return Entries_.end(); }
     
     template<typename... Args>
-    Iterator Insert(Args&&... args) { return Entries_.emplace(Entries_.end(), Entry{std::forward<Args>(args)...}); }
+    Iterator Insert(Args&&... args)
+    {
+        auto it = Entries_.emplace(Entries_.end(), Entry{std::forward<Args>(args)...});
+        Index_.Insert(it->Key, it);
+        return it;
+    }
     
-    void Remove(Iterator pos) { Entries_.erase(pos); }
+    void Remove(Iterator pos)
+    {
+        Index_.Erase(pos->Key);
+        Entries_.erase(pos);
+    }
     
+    //! Returns the entries whose keys overlap \p s, in no particular order (cf. SectionIndex)
     std::deque<Iterator> FindOverlaps(const Space &s)
     {
         std::deque<Iterator> ret;
-        for(Iterator it = Begin(), itend = End(); it != itend; ++it)
-        {
-            if(it->Key.Overlaps(s)) ret.push_back(it);
-        }
+        Index_.ForOverlaps(s, [&ret](Iterator it) { ret.push_back(it); });
         return ret;
     }
 };
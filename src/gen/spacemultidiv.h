@@ -50,19 +50,22 @@ public:
 
             if(overlap->first->count(assign) == 0)
             {
-                this->TrimSection(overlap, sec);
-                
                 AssignGroup grp = *overlap->first;
+                Space common = overlap->second & sec;
+                this->TrimSection(overlap, sec); // invalidates overlap
+                
                 grp.insert(assign);
                 auto *pgrp = &*AssignGroups_.insert(std::move(grp)).first;
-                this->Sections_.emplace(pgrp, overlap->second & sec);
+                this->Emplace(this->Sections_.end(), pgrp, std::move(common));
             }
         }
         
-        if(sd.IsEmpty()) return;
-        
-        auto *pgrp = &*AssignGroups_.insert(AssignGroup({assign})).first;
-        for(auto &entry : sd.GetSections()) this->Sections_.emplace(pgrp, entry.second);
+        if(!sd.IsEmpty())
+        {
+            auto *pgrp = &*AssignGroups_.insert(AssignGroup({assign})).first;
+            for(auto &entry : sd.GetSections()) this->Emplace(this->Sections_.end(), pgrp, entry.second);
+        }
+        this->CoalesceIfFragmented();
     }
     
     //! Removes all assignments made to \p unassign from this division (not implemented currently)
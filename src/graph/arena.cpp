@@ -0,0 +1,27 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "arena.h"
+
+namespace Ladybirds { namespace graph {
+
+constexpr std::size_t Arena::Granularity;
+constexpr std::size_t Arena::MaxPooledSize;
+constexpr std::size_t Arena::ChunkSize;
+
+thread_local Arena * Arena::pCurrent_ = nullptr;
+
+void * Arena::Carve(std::size_t size)
+{
+    if(std::size_t(pEnd_ - pPos_) < size)
+    {
+        //the rest of the current chunk is lost, but it is smaller than MaxPooledSize
+        Chunks_.emplace_back(new char[ChunkSize]);
+        pPos_ = Chunks_.back().get();
+        pEnd_ = pPos_ + ChunkSize;
+    }
+    void * ret = pPos_;
+    pPos_ += size;
+    return ret;
+}
+
+}} //namespace Ladybirds::graph
@@ -0,0 +1,153 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef GRAPH_ARENA_H
+#define GRAPH_ARENA_H
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace Ladybirds { namespace graph {
+
+//! Monotonic memory arena with pools for small blocks.
+/** Memory is taken from large chunks that are only released when the arena is destroyed. Small blocks are grouped
+ ** into size classes; a deallocated small block is put into the free list of its class and handed out again by the
+ ** next allocation of the same class. Large blocks bypass the arena and go directly to the global operator new.
+ **
+ ** The arena is meant to hold the many small objects of a Program (task interfaces, graph storage), such that building
+ ** and tearing down a program graph only needs a few hundred allocations instead of millions. Containers use it
+ ** through ArenaAllocator, which picks up the arena that is active (cf. Arena::Scope) at the time of its construction.
+ ** The arena must outlive all objects allocated from it. It is not thread-safe. **/
+class Arena
+{
+public:
+    static constexpr std::size_t Granularity = alignof(std::max_align_t); ///< Size classes are multiples of this
+    static constexpr std::size_t MaxPooledSize = 1024; ///< Larger blocks are not managed by the arena
+    static constexpr std::size_t ChunkSize = 64 * 1024;
+
+    //! Makes an arena the active one for the lifetime of the scope object. Scopes can be nested.
+    class Scope
+    {
+        Arena * pPrevious_;
+    public:
+        inline explicit Scope(Arena & arena) : pPrevious_(pCurrent_) { pCurrent_ = &arena; }
+        inline ~Scope() { pCurrent_ = pPrevious_; }
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+    };
+
+private:
+    struct FreeBlock { FreeBlock * pNext; };
+    static constexpr std::size_t nClasses = MaxPooledSize / Granularity;
+
+    static thread_local Arena * pCurrent_;
+
+    std::vector<std::unique_ptr<char[]>> Chunks_;
+    char *pPos_ = nullptr, *pEnd_ = nullptr;
+    FreeBlock * FreeLists_[nClasses] = {};
+    std::size_t BytesInUse_ = 0;
+    std::vector<std::unique_ptr<Arena>> Adopted_; ///< Arenas kept alive as long as this one (cf. Adopt)
+
+public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena & operator=(const Arena &) = delete;
+
+    //! Returns the active arena, or nullptr if no arena is active
+    static inline Arena * Current() { return pCurrent_; }
+
+    //! Allocates \p size bytes, suitably aligned for any object of that size
+    inline void * Allocate(std::size_t size)
+    {
+        if(size > MaxPooledSize) return ::operator new(size);
+        auto cls = SizeClass(size);
+        BytesInUse_ += (cls+1) * Granularity;
+        if(FreeBlock * pblock = FreeLists_[cls])
+        {
+            FreeLists_[cls] = pblock->pNext;
+            return pblock;
+        }
+        return Carve((cls+1) * Granularity);
+    }
+    //! Returns a block obtained from Allocate with the same \p size to the arena
+    inline void Deallocate(void * p, std::size_t size)
+    {
+        if(size > MaxPooledSize) return ::operator delete(p);
+        auto cls = SizeClass(size);
+        assert(BytesInUse_ >= (cls+1) * Granularity);
+        BytesInUse_ -= (cls+1) * Granularity;
+        FreeLists_[cls] = new(p) FreeBlock{FreeLists_[cls]};
+    }
+
+    //! Takes over \p arena, such that objects allocated from it (e.g. a program parsed in another thread) can be
+    //! moved into containers of this arena's owner. It is destroyed together with this arena.
+    inline void Adopt(std::unique_ptr<Arena> arena) { Adopted_.push_back(std::move(arena)); }
+
+    //! Number of bytes of pooled blocks that are currently allocated, including those of adopted arenas
+    inline std::size_t GetBytesInUse() const
+    {
+        auto ret = BytesInUse_;
+        for(auto & uparena : Adopted_) ret += uparena->GetBytesInUse();
+        return ret;
+    }
+    //! Number of bytes reserved from the system for pooled blocks, including those of adopted arenas
+    inline std::size_t GetBytesReserved() const
+    {
+        auto ret = Chunks_.size() * ChunkSize;
+        for(auto & uparena : Adopted_) ret += uparena->GetBytesReserved();
+        return ret;
+    }
+
+private:
+    static inline std::size_t SizeClass(std::size_t size) { return size ? (size-1) / Granularity : 0; }
+    void * Carve(std::size_t size);
+};
+
+
+//! Allocator for standard containers that takes its memory from an Arena.
+/** A default-constructed allocator uses Arena::Current(); if there is no active arena, it falls back to the global
+ ** operator new. The arena is propagated along with the container contents on move assignment and swap, and a copy of
+ ** a container uses the arena that is active at the time of the copy. **/
+template<typename T>
+class ArenaAllocator
+{
+    template<typename U> friend class ArenaAllocator;
+    Arena * pArena_;
+
+public:
+    using value_type = T;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    inline ArenaAllocator() : pArena_(Arena::Current()) {}
+    inline explicit ArenaAllocator(Arena * parena) : pArena_(parena) {}
+    template<typename U> inline ArenaAllocator(const ArenaAllocator<U> & other) : pArena_(other.pArena_) {}
+
+    inline T * allocate(std::size_t n)
+    {
+        auto size = n * sizeof(T);
+        static_assert(alignof(T) <= Arena::Granularity, "over-aligned types are not supported");
+        return static_cast<T*>(pArena_ ? pArena_->Allocate(size) : ::operator new(size));
+    }
+    inline void deallocate(T * p, std::size_t n)
+    {
+        if(pArena_) pArena_->Deallocate(p, n * sizeof(T));
+        else ::operator delete(p);
+    }
+
+    inline ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+
+    inline Arena * GetArena() const { return pArena_; }
+
+    template<typename U> inline bool operator==(const ArenaAllocator<U> & other) const
+        { return pArena_ == other.pArena_; }
+    template<typename U> inline bool operator!=(const ArenaAllocator<U> & other) const
+        { return pArena_ != other.pArena_; }
+};
+
+}} //namespace Ladybirds::graph
+
+#endif // GRAPH_ARENA_H
@@ -0,0 +1,96 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_GRAPH_CSR_H
+#define LADYBIRDS_GRAPH_CSR_H
+
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include "itemmap.h"
+
+namespace Ladybirds {
+namespace graph {
+
+/** An immutable snapshot of a Graph in compressed sparse row format, as returned by Graph::Freeze.
+ *
+ *  The nodes are numbered 0...NodeCount()-1 in the order of Graph::Nodes(). For each node, the indices of its
+ *  successors (and predecessors) are stored contiguously, in the order of Node::OutEdges() (Node::InEdges()), so
+ *  traversals do not need to chase the linked edge lists. The snapshot is only valid as long as the graph does not
+ *  change, which can be checked with IsCurrent.
+ **/
+template<class graph_t>
+class CsrGraph
+{
+public:
+    using node_t = const typename graph_t::node_t;
+    using Index = int;
+
+    /// A range of node indices
+    class IndexRange
+    {
+        const Index *pBegin_, *pEnd_;
+    public:
+        inline IndexRange(const Index * pbegin, const Index * pend) : pBegin_(pbegin), pEnd_(pend) {}
+        inline const Index * begin() const { return pBegin_; }
+        inline const Index * end() const { return pEnd_; }
+        inline std::size_t size() const { return pEnd_ - pBegin_; }
+    };
+
+private:
+    const graph_t * pGraph_;
+    decltype(std::declval<graph_t>().GetVersion()) Version_;
+    std::vector<node_t*> Nodes_;
+    ItemMap<Index> Indices_;
+    std::vector<Index> OutOffsets_, OutNeighbors_, InOffsets_, InNeighbors_;
+
+public:
+    explicit CsrGraph(const graph_t & g);
+
+    /// Checks if the snapshot still reflects the current state of \p g
+    inline bool IsCurrent(const graph_t & g) const { return &g == pGraph_ && Version_ == g.GetVersion(); }
+    inline const graph_t & GetGraph() const { return *pGraph_; }
+
+    inline Index NodeCount() const { return Nodes_.size(); }
+    inline node_t & GetNode(Index i) const { return *Nodes_[i]; }
+    inline Index GetIndex(const node_t * pn) const { return Indices_[pn]; }
+
+    inline IndexRange Successors(Index i) const
+        { return IndexRange(OutNeighbors_.data() + OutOffsets_[i], OutNeighbors_.data() + OutOffsets_[i+1]); }
+    inline IndexRange Predecessors(Index i) const
+        { return IndexRange(InNeighbors_.data() + InOffsets_[i], InNeighbors_.data() + InOffsets_[i+1]); }
+    inline std::size_t OutDegree(Index i) const { return OutOffsets_[i+1] - OutOffsets_[i]; }
+    inline std::size_t InDegree(Index i) const { return InOffsets_[i+1] - InOffsets_[i]; }
+};
+
+
+template<class graph_t>
+CsrGraph<graph_t>::CsrGraph(const graph_t & g)
+    : pGraph_(&g), Version_(g.GetVersion()), Indices_(g.template GetNodeMap<Index>(-1))
+{
+    Nodes_.reserve(g.Nodes().size());
+    for(auto & n : g.Nodes())
+    {
+        Indices_[n] = Nodes_.size();
+        Nodes_.push_back(&n);
+    }
+
+    auto nnodes = Nodes_.size();
+    OutOffsets_.reserve(nnodes+1);
+    InOffsets_.reserve(nnodes+1);
+    OutNeighbors_.reserve(g.Edges().size());
+    InNeighbors_.reserve(g.Edges().size());
+    for(auto * pn : Nodes_)
+    {
+        OutOffsets_.push_back(OutNeighbors_.size());
+        for(auto & e : pn->OutEdges()) OutNeighbors_.push_back(Indices_[e.GetTarget()]);
+        InOffsets_.push_back(InNeighbors_.size());
+        for(auto & e : pn->InEdges()) InNeighbors_.push_back(Indices_[e.GetSource()]);
+    }
+    OutOffsets_.push_back(OutNeighbors_.size());
+    InOffsets_.push_back(InNeighbors_.size());
+}
+
+}} //namespace Ladybirds::graph
+
+#endif // LADYBIRDS_GRAPH_CSR_H
@@ -0,0 +1,75 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_GRAPH_DEGENERACY_H
+#define LADYBIRDS_GRAPH_DEGENERACY_H
+
+#include <vector>
+
+#include "csr.h"
+
+namespace Ladybirds {
+namespace graph {
+
+/// Computes a smallest-last (degeneracy) ordering of the nodes of \p csr, as used for greedy graph coloring.
+/** The graph is treated as undirected: The degree of a node counts both its in- and out-edges. A node of smallest
+ *  remaining degree is removed repeatedly, and the degrees of its neighbors are updated. Returns the node indices in
+ *  reverse order of removal, i.e., the order in which the nodes should be colored. Ties between nodes of equal degree
+ *  are broken deterministically. The degrees are kept in buckets, so this takes O(V+E) time. **/
+template<class graph_t>
+std::vector<typename CsrGraph<graph_t>::Index> SmallestLastOrder(const CsrGraph<graph_t> & csr)
+{
+    using Index = typename CsrGraph<graph_t>::Index;
+    Index nnodes = csr.NodeCount();
+    std::vector<Index> degrees(nnodes), next(nnodes), prev(nnodes);
+    std::vector<bool> removed(nnodes, false);
+    Index maxdegree = 0;
+    for(Index i = 0; i < nnodes; ++i)
+    {
+        degrees[i] = csr.OutDegree(i) + csr.InDegree(i);
+        if(degrees[i] > maxdegree) maxdegree = degrees[i];
+    }
+
+    // buckets of nodes with equal degree, as doubly linked lists
+    std::vector<Index> heads(maxdegree+1, -1);
+    auto unlink = [&](Index i)
+    {
+        if(prev[i] >= 0) next[prev[i]] = next[i];
+        else heads[degrees[i]] = next[i];
+        if(next[i] >= 0) prev[next[i]] = prev[i];
+    };
+    auto pushfront = [&](Index i)
+    {
+        auto &head = heads[degrees[i]];
+        prev[i] = -1, next[i] = head;
+        if(head >= 0) prev[head] = i;
+        head = i;
+    };
+    for(Index i = nnodes; i-- > 0; ) pushfront(i);
+
+    std::vector<Index> ret(nnodes);
+    Index mindegree = 0;
+    for(Index pos = nnodes; pos-- > 0; )
+    {
+        while(heads[mindegree] < 0) ++mindegree;
+        Index i = heads[mindegree];
+        unlink(i);
+        removed[i] = true;
+        ret[pos] = i;
+
+        auto update = [&](Index j)
+        {
+            if(removed[j]) return;
+            unlink(j);
+            --degrees[j];
+            pushfront(j);
+            if(degrees[j] < mindegree) mindegree = degrees[j];
+        };
+        for(auto j : csr.Successors(i)) update(j);
+        for(auto j : csr.Predecessors(i)) update(j);
+    }
+    return ret;
+}
+
+}} //namespace Ladybirds::graph
+
+#endif // LADYBIRDS_GRAPH_DEGENERACY_H
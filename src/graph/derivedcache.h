@@ -0,0 +1,53 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_GRAPH_DERIVEDCACHE_H
+#define LADYBIRDS_GRAPH_DERIVEDCACHE_H
+
+#include <memory>
+#include <typeindex>
+#include <unordered_map>
+
+namespace Ladybirds {
+namespace graph {
+
+/// Memoizes data derived from a graph (e.g. a reachability matrix), as used by Graph::GetDerived.
+/** Each entry is identified by a key type, which must always be used with the same type of value. The owner drops all
+ *  entries whenever the graph is modified. **/
+class DerivedCache
+{
+    struct EntryBase
+    {
+        virtual ~EntryBase() = default;
+    };
+    template<typename t> struct Entry : EntryBase
+    {
+        t Value;
+        Entry(t && value) : Value(std::move(value)) {}
+    };
+
+    std::unordered_map<std::type_index, std::unique_ptr<EntryBase>> Entries_;
+
+public:
+    DerivedCache() = default;
+    DerivedCache(const DerivedCache &) = delete;
+    DerivedCache & operator=(const DerivedCache &) = delete;
+    DerivedCache(DerivedCache &&) = default;
+    DerivedCache & operator=(DerivedCache &&) = default;
+
+    /// Returns the entry for \p key_t, computing it by calling \p compute() if it is not present
+    template<class key_t, typename fn_t> const auto & Get(fn_t compute)
+    {
+        using value_t = decltype(compute());
+        std::type_index key(typeid(key_t));
+        auto it = Entries_.find(key); // lookups of present entries do not modify the map, even if run concurrently
+        if(it == Entries_.end()) it = Entries_.emplace(key, std::make_unique<Entry<value_t>>(compute())).first;
+        return static_cast<Entry<value_t>&>(*it->second).Value;
+    }
+
+    inline bool IsEmpty() const { return Entries_.empty(); }
+    inline void Clear() { if(!Entries_.empty()) Entries_.clear(); }
+};
+
+}} //namespace Ladybirds::graph
+
+#endif // LADYBIRDS_GRAPH_DERIVEDCACHE_H
@@ -15,6 +15,7 @@ class Edge : public PresDequeElementBase
 {
     using node_t = NodeClass;
     template<class, class> friend class Graph;
+    template<typename> friend class PresDeque; //for moving edges in PresDeque::Compact
     template<class> friend class EdgeIterator;
     template<class> friend class OutEdgeIterator;
     template<class> friend class InEdgeIterator;
@@ -7,7 +7,9 @@
 #include <limits>
 #include <vector>
 
+#include "csr.h"
 #include "graph.h"
+#include "graph-parallel.h"
 #include "itemmap.h"
 #include "itemset.h"
 #include "tools.h"
@@ -45,47 +47,182 @@ ItemMap<ItemSet> AdjacencyMatrix(const graph_t & g)
     return ret;
 }
 
-/// Returns a reachability matrix for the graph \p g, i.e. a map which contains for each node the set of nodes that can
-/// be reached from it by following the edges in the graph. Note that the nodes do not list themselves in the matrix.
-template<class graph_t> 
-ItemMap<ItemSet> ReachabilityMatrix(const graph_t & g)
+/// Writes a topological order of the nodes of the snapshot \p g to \p order, i.e. every node index appears after the
+/// indices of all its predecessors. Returns false if \p g contains cycles; in this case, \p order only contains the
+/// nodes that are not part of or reachable from a cycle.
+template<class graph_t>
+bool TopologicalOrder(const CsrGraph<graph_t> & g, /*out*/ std::vector<typename CsrGraph<graph_t>::Index> & order)
 {
-    auto ret = AdjacencyMatrix(g);
+    using Index = typename CsrGraph<graph_t>::Index;
+    std::vector<Index> inedgecounts(g.NodeCount());
     
-    //Apply the Floyd-Warshall algorithm to ret, transforming it from an adjacency to a reachability matrix
-    for(auto & n1 : g.Nodes())
+    assert(order.empty());
+    order.reserve(g.NodeCount());
+    for(Index i = 0, n = g.NodeCount(); i < n; ++i)
     {
-        for(auto & n2 : g.Nodes())
+        if((inedgecounts[i] = g.InDegree(i)) == 0) order.push_back(i);
+    }
+    
+    //order is used as the queue of ready nodes at the same time
+    for(std::size_t i = 0; i < order.size(); ++i)
+    {
+        for(Index succ : g.Successors(order[i]))
         {
-            if(ret[n1].Contains(n2)) ret[n1] |= ret[n2];
+            if(--inedgecounts[succ] == 0) order.push_back(succ);
         }
     }
+    return order.size() == std::size_t(g.NodeCount());
+}
+
+/// Writes a topological order of the nodes in \p g to \p order, i.e. every node appears after all its predecessors.
+/// Returns false if \p g contains cycles; in this case, \p order only contains the nodes that are not part of or
+/// reachable from a cycle.
+template<class graph_t>
+bool TopologicalOrder(const graph_t & g, /*out*/ std::vector<const typename graph_t::node_t *> & order)
+{
+    auto csr = g.Freeze();
+    std::vector<typename decltype(csr)::Index> indices;
+    bool ret = TopologicalOrder(csr, indices);
     
+    assert(order.empty());
+    order.reserve(indices.size());
+    for(auto i : indices) order.push_back(&csr.GetNode(i));
     return ret;
 }
 
-/// Removes all edges from \p g which are not necessary for keeping the connectivity, i.e. if there was a path from
-/// node n1 to node n2 before, there will still be a path from n1 to n2 afterwards.
-/// Returns a reachability matrix (cf. \ref ReachabilityMatrix).
-template<class graph_t> 
-ItemMap<ItemSet> PruneEdges(graph_t & g)
+/// Returns an adjacency matrix for the graph snapshot \p g
+template<class graph_t>
+ItemMap<ItemSet> AdjacencyMatrix(const CsrGraph<graph_t> & g)
 {
-    auto ret = AdjacencyMatrix(g), edges = ret;
+    auto ret = g.GetGraph().GetNodeMap(g.GetGraph().GetNodeSet());
     
-    // Apply the Floyd-Warshall algorithm to ret, transforming it from an adjacency to a reachability matrix
-    // At the same time, remove all entries from its copy 'edges' that are considered duplicate, such that 'edges'
-    // only contains the edges that are strictly necessary to maintain connectivity.
-    for(auto & n1 : g.Nodes())
+    for(typename CsrGraph<graph_t>::Index i = 0, n = g.NodeCount(); i < n; ++i)
     {
-        for(auto & n2 : g.Nodes())
+        auto & row = ret[g.GetNode(i)];
+        for(auto succ : g.Successors(i)) row.Insert(g.GetNode(succ));
+    }
+    return ret;
+}
+
+namespace internal {
+/// \internal Transforms the adjacency matrix \p adj of \p g into a reachability matrix. This is the fallback for
+/// graphs with cycles, where no topological order exists. If \p pedges is not null, all entries that connect a node to
+/// a node that is reachable by other means are removed from the adjacency matrix \p *pedges.
+template<class graph_t>
+void ClosureFloydWarshall(const CsrGraph<graph_t> & g, /*inout*/ ItemMap<ItemSet> & adj,
+                          /*inout*/ ItemMap<ItemSet> *pedges)
+{
+    using Index = typename CsrGraph<graph_t>::Index;
+    if(!pedges)
+    {
+        //Warshall's algorithm: the intermediate node must be the outer loop, otherwise paths through cycles are missed
+        for(Index k = 0, n = g.NodeCount(); k < n; ++k)
+        {
+            auto & nk = g.GetNode(k);
+            for(Index i = 0; i < n; ++i)
+            {
+                auto & row = adj[g.GetNode(i)];
+                if(row.Contains(nk)) row |= adj[nk];
+            }
+        }
+        return;
+    }
+    
+    for(Index i1 = 0, n = g.NodeCount(); i1 < n; ++i1)
+    {
+        auto & n1 = g.GetNode(i1);
+        for(Index i2 = 0; i2 < n; ++i2)
         {
-            if(ret[n1].Contains(n2))
+            auto & n2 = g.GetNode(i2);
+            if(adj[n1].Contains(n2))
             {
-                ret[n1] |= ret[n2];
-                edges[n1].Remove(ret[n2]);
+                adj[n1] |= adj[n2];
+                (*pedges)[n1].Remove(adj[n2]);
             }
         }
     }
+}
+
+/// \internal Transforms the adjacency matrix \p adj of the acyclic graph \p g into a reachability matrix, given a
+/// topological order \p order of its nodes. The nodes are visited once in reverse topological order, such that each
+/// row is complete before it is merged into the rows of its predecessors; the merging is done word by word on the
+/// underlying bit sets. If \p pedges is not null, it receives the edges that are strictly necessary for connectivity,
+/// i.e. the entries of \p adj that cannot be reached through any other successor (cf. \ref PruneEdges).
+template<class graph_t>
+void ClosureTopological(const CsrGraph<graph_t> & g, const std::vector<typename CsrGraph<graph_t>::Index> & order,
+                        /*inout*/ ItemMap<ItemSet> & adj, /*out*/ ItemMap<ItemSet> *pedges)
+{
+    for(auto it = order.rbegin(), itend = order.rend(); it != itend; ++it)
+    {
+        auto & n = g.GetNode(*it);
+        auto & row = adj[n];
+        
+        if(!pedges)
+        {
+            for(auto succ : g.Successors(*it)) row |= adj[g.GetNode(succ)];
+            continue;
+        }
+        
+        //everything that can be reached through a successor makes a direct edge to it redundant
+        auto & necessary = (*pedges)[n];
+        for(auto succ : g.Successors(*it))
+        {
+            auto & succrow = adj[g.GetNode(succ)];
+            row |= succrow;
+            necessary.Remove(succrow);
+        }
+    }
+}
+
+/// \internal Transforms the adjacency matrix \p adj of \p g into a reachability matrix, and, if \p pedges is not
+/// null, removes the redundant entries from \p *pedges (cf. ClosureFloydWarshall and ClosureTopological). From
+/// ParallelNodeLimit nodes on, acyclic graphs are processed level by level on all hardware threads.
+template<class graph_t>
+void Closure(const CsrGraph<graph_t> & g, /*inout*/ ItemMap<ItemSet> & adj, /*inout*/ ItemMap<ItemSet> *pedges)
+{
+    std::vector<typename CsrGraph<graph_t>::Index> order;
+    if(std::size_t(g.NodeCount()) >= ParallelNodeLimit)
+    {
+        std::vector<std::size_t> levelstarts;
+        if(ParallelLevelOrder(g, order, &levelstarts)) ParallelClosureTopological(g, order, levelstarts, 0, adj, pedges);
+        else ClosureFloydWarshall(g, adj, pedges);
+        return;
+    }
+    if(TopologicalOrder(g, order)) ClosureTopological(g, order, adj, pedges);
+    else ClosureFloydWarshall(g, adj, pedges);
+}
+} //namespace internal
+
+/// Returns a reachability matrix for the graph snapshot \p g (cf. \ref ReachabilityMatrix(const graph_t&)).
+template<class graph_t>
+ItemMap<ItemSet> ReachabilityMatrix(const CsrGraph<graph_t> & g)
+{
+    auto ret = AdjacencyMatrix(g);
+    internal::Closure(g, ret, nullptr);
+    return ret;
+}
+
+/// Returns a reachability matrix for the graph \p g, i.e. a map which contains for each node the set of nodes that can
+/// be reached from it by following the edges in the graph. Note that the nodes do not list themselves in the matrix.
+template<class graph_t> 
+ItemMap<ItemSet> ReachabilityMatrix(const graph_t & g)
+{
+    return ReachabilityMatrix(g.Freeze());
+}
+
+/// Removes all edges from \p g which are not necessary for keeping the connectivity, i.e. if there was a path from
+/// node n1 to node n2 before, there will still be a path from n1 to n2 afterwards.
+/// Returns a reachability matrix (cf. \ref ReachabilityMatrix).
+template<class graph_t> 
+ItemMap<ItemSet> PruneEdges(graph_t & g)
+{
+    auto csr = g.Freeze();
+    auto ret = AdjacencyMatrix(csr), edges = ret;
+    
+    // Transform ret from an adjacency to a reachability matrix. At the same time, remove all entries from its copy
+    // 'edges' that are considered duplicate, such that 'edges' only contains the edges that are strictly necessary to
+    // maintain connectivity.
+    internal::Closure(csr, ret, &edges);
     
     for(auto it = g.EdgesBegin(), itend = g.EdgesEnd(); it != itend; )
     {
@@ -193,6 +330,52 @@ StronglyConnected(const graph_t &g, std::vector<const typename graph_t::node_t *
 }
 
 
+/// Variants of the analyses above that are memoized in the graph (cf. Graph::GetDerived). The results are computed on
+/// the first call and returned from the cache until the graph is modified. The references become invalid then.
+namespace cached {
+
+namespace internal {
+struct EdgeMatrixKey {};
+struct AdjacencyMatrixKey {};
+struct ReachabilityMatrixKey {};
+struct TopologicalOrderKey {};
+} //namespace internal
+
+/// Result of \ref cached::TopologicalOrder
+template<class node_t> struct NodeOrder
+{
+    std::vector<const node_t *> Order; ///< Topological order, cf. \ref graph::TopologicalOrder
+    bool IsComplete; ///< False if the graph contains cycles, i.e. Order does not contain all nodes
+};
+
+/// \copydoc graph::EdgeMatrix
+template<class graph_t> const auto & EdgeMatrix(const graph_t & g)
+    { return g.template GetDerived<internal::EdgeMatrixKey>([](const graph_t & g) { return graph::EdgeMatrix(g); }); }
+/// \copydoc graph::AdjacencyMatrix(const graph_t&)
+template<class graph_t> const ItemMap<ItemSet> & AdjacencyMatrix(const graph_t & g)
+{
+    return g.template GetDerived<internal::AdjacencyMatrixKey>([](const graph_t & g)
+        { return graph::AdjacencyMatrix(g); });
+}
+/// \copydoc graph::ReachabilityMatrix(const graph_t&)
+template<class graph_t> const ItemMap<ItemSet> & ReachabilityMatrix(const graph_t & g)
+{
+    return g.template GetDerived<internal::ReachabilityMatrixKey>([](const graph_t & g)
+        { return graph::ReachabilityMatrix(g); });
+}
+/// Returns a topological order of the nodes in \p g (cf. \ref graph::TopologicalOrder)
+template<class graph_t> const NodeOrder<typename graph_t::node_t> & TopologicalOrder(const graph_t & g)
+{
+    return g.template GetDerived<internal::TopologicalOrderKey>([](const graph_t & g)
+    {
+        NodeOrder<typename graph_t::node_t> ret;
+        ret.IsComplete = graph::TopologicalOrder(g, ret.Order);
+        return ret;
+    });
+}
+
+} //namespace cached
+
 }} //namespace Ladybirds::graph
 
 #endif // LADYBIRDS_GRAPH_GRAPH_EXTRA_H
@@ -0,0 +1,321 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_GRAPH_GRAPH_PARALLEL_H
+#define LADYBIRDS_GRAPH_GRAPH_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "csr.h"
+#include "itemmap.h"
+#include "itemset.h"
+
+namespace Ladybirds {
+namespace graph {
+
+/// Number of nodes from which the analyses of graph-extra.h and the passes switch to the parallel variants below.
+/// Below, starting the threads and synchronizing them after every level costs more than it saves.
+constexpr std::size_t ParallelNodeLimit = std::size_t(1) << 16;
+
+namespace internal {
+/// \internal Lets \p nthreads threads wait for each other, any number of times
+class Barrier
+{
+    std::mutex Mutex_;
+    std::condition_variable Cond_;
+    unsigned Threads_, Waiting_ = 0, Generation_ = 0;
+
+public:
+    explicit Barrier(unsigned nthreads) : Threads_(nthreads) {}
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(Mutex_);
+        unsigned generation = Generation_;
+        if(++Waiting_ == Threads_)
+        {
+            Waiting_ = 0;
+            ++Generation_;
+            Cond_.notify_all();
+        }
+        else Cond_.wait(lock, [&]() { return Generation_ != generation; });
+    }
+};
+
+/// \internal Returns \p nthreads, or the number of hardware threads if it is 0
+inline unsigned ThreadCount(unsigned nthreads)
+{
+    return nthreads > 0 ? nthreads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+/// \internal Runs \p fn(t) for t = 0...nthreads-1 on as many threads, the calling thread taking t = 0
+template<typename fn_t>
+void RunThreads(unsigned nthreads, fn_t fn)
+{
+    std::vector<std::thread> threads;
+    for(unsigned t = 1; t < nthreads; ++t) threads.emplace_back(fn, t);
+    fn(0u);
+    for(auto & thread : threads) thread.join();
+}
+
+/// \internal Calls \p fn(i) for all i in [\p begin, \p end), distributed over the threads in blocks of \p block, which
+/// take them from \p next. All threads must call it with the same arguments.
+template<typename fn_t>
+void ForBlocks(std::atomic<std::size_t> & next, std::size_t begin, std::size_t end, std::size_t block, fn_t fn)
+{
+    for(std::size_t start; (start = begin + next.fetch_add(block, std::memory_order_relaxed)) < end; )
+    {
+        for(std::size_t i = start, stop = std::min(end, start + block); i < stop; ++i) fn(i);
+    }
+}
+} //namespace internal
+
+
+/// Writes a topological order of the nodes of the snapshot \p g to \p order, level by level: first the nodes without
+/// predecessors, then those all of whose predecessors are in the first level, and so on, each level in increasing
+/// index order (the order of GetLevelOrder in TaskTopoSort). If \p plevelstarts is not null, it receives the position
+/// in \p order of the first node of each level, followed by the size of \p order; the level of a node is the length of
+/// the longest path leading to it. This is Kahn's algorithm, level-synchronous: the successors of each level are
+/// counted down by \p nthreads threads (0: one per hardware thread), which then wait for each other. Returns false if
+/// \p g contains cycles; in this case, \p order only contains the nodes that are not part of or reachable from a cycle.
+template<class graph_t>
+bool ParallelLevelOrder(const CsrGraph<graph_t> & g, /*out*/ std::vector<typename CsrGraph<graph_t>::Index> & order,
+                        /*out*/ std::vector<std::size_t> * plevelstarts = nullptr, unsigned nthreads = 0)
+{
+    using Index = typename CsrGraph<graph_t>::Index;
+    constexpr std::size_t block = 256;
+    const std::size_t n = g.NodeCount();
+    nthreads = internal::ThreadCount(nthreads);
+
+    assert(order.empty());
+    order.reserve(n);
+    std::vector<std::atomic<Index>> counts(n);
+    std::vector<std::vector<Index>> found(nthreads);
+    std::vector<std::size_t> levelstarts;
+    std::atomic<std::size_t> next{0};
+    std::size_t levelstart = 0;
+    bool done = false;
+    internal::Barrier barrier(nthreads);
+
+    internal::RunThreads(nthreads, [&](unsigned t)
+    {
+        auto & mine = found[t];
+        internal::ForBlocks(next, 0, n, block, [&](std::size_t i)
+        {
+            counts[i].store(g.InDegree(i), std::memory_order_relaxed);
+            if(g.InDegree(i) == 0) mine.push_back(i);
+        });
+        while(true)
+        {
+            barrier.Wait();
+            if(t == 0)
+            {   // the nodes found are the next level, in index order
+                levelstart = order.size();
+                for(auto & list : found)
+                {
+                    order.insert(order.end(), list.begin(), list.end());
+                    list.clear();
+                }
+                std::sort(order.begin() + levelstart, order.end());
+                done = order.size() == levelstart;
+                if(!done) levelstarts.push_back(levelstart);
+                next.store(0, std::memory_order_relaxed);
+            }
+            barrier.Wait();
+            if(done) return;
+            internal::ForBlocks(next, levelstart, order.size(), block, [&](std::size_t i)
+            {
+                for(Index succ : g.Successors(order[i]))
+                {
+                    if(counts[succ].fetch_sub(1, std::memory_order_acq_rel) == 1) mine.push_back(succ);
+                }
+            });
+        }
+    });
+
+    if(plevelstarts)
+    {
+        *plevelstarts = std::move(levelstarts);
+        plevelstarts->push_back(order.size());
+    }
+    return order.size() == n;
+}
+
+
+namespace internal {
+/// \internal Transforms the adjacency matrix \p adj of the acyclic graph \p g into a reachability matrix like
+/// ClosureTopological, given a level order \p order of its nodes with the starts of the levels \p levelstarts (cf.
+/// ParallelLevelOrder). The successors of a node are in later levels, so the rows of one level are independent of each
+/// other; they are merged by \p nthreads threads, level by level from the last one.
+template<class graph_t>
+void ParallelClosureTopological(const CsrGraph<graph_t> & g,
+                                const std::vector<typename CsrGraph<graph_t>::Index> & order,
+                                const std::vector<std::size_t> & levelstarts, unsigned nthreads,
+                                /*inout*/ ItemMap<ItemSet> & adj, /*out*/ ItemMap<ItemSet> *pedges)
+{
+    nthreads = ThreadCount(nthreads);
+    std::atomic<std::size_t> next{0};
+    Barrier barrier(nthreads);
+
+    RunThreads(nthreads, [&](unsigned t)
+    {
+        for(std::size_t level = levelstarts.size() - 1; level-- > 0; )
+        {
+            ForBlocks(next, levelstarts[level], levelstarts[level+1], 16, [&](std::size_t i)
+            {
+                auto & n = g.GetNode(order[i]);
+                auto & row = adj[n];
+                for(auto succ : g.Successors(order[i]))
+                {
+                    auto & succrow = adj[g.GetNode(succ)];
+                    row |= succrow;
+                    if(pedges) (*pedges)[n].Remove(succrow);
+                }
+            });
+            barrier.Wait();
+            if(t == 0) next.store(0, std::memory_order_relaxed);
+            barrier.Wait();
+        }
+    });
+}
+} //namespace internal
+
+
+/// Returns the strongly connected components (SCCs) of the graph \p g like StronglyConnected (cf. graph-extra.h), but
+/// computed by \p nthreads threads (0: one per hardware thread). The nodes that have no predecessors or no successors
+/// among the remaining nodes are trimmed first, as they are components of their own. The rest is split by the
+/// forward-backward algorithm: the nodes both reachable from a pivot and reaching it form its SCC, and the nodes only
+/// reachable from it, only reaching it, and neither are independent subproblems, which the threads take from a common
+/// queue. The SCCs are sorted by their first node (in the order of g.Nodes()), as are the nodes of each SCC.
+template<class graph_t>
+std::vector<std::vector<const typename graph_t::node_t *>>
+ParallelStronglyConnected(const graph_t &g, std::vector<const typename graph_t::node_t *> *psinglenodes = nullptr,
+                          unsigned nthreads = 0)
+{
+    auto csr = g.Freeze();
+    using Index = typename decltype(csr)::Index;
+    const Index n = csr.NodeCount();
+    nthreads = internal::ThreadCount(nthreads);
+
+    // trimming: a node without predecessors or successors among the untrimmed nodes is a component of its own
+    constexpr int trimmed = -1;
+    std::vector<std::atomic<int>> colors(n);
+    std::vector<Index> indeg(n), outdeg(n), queue;
+    for(Index i = 0; i < n; ++i)
+    {
+        colors[i].store(0, std::memory_order_relaxed);
+        indeg[i] = csr.InDegree(i), outdeg[i] = csr.OutDegree(i);
+        if(indeg[i] == 0 || outdeg[i] == 0) colors[i].store(trimmed, std::memory_order_relaxed), queue.push_back(i);
+    }
+    for(std::size_t q = 0; q < queue.size(); ++q)
+    {
+        auto trim = [&](Index j, std::vector<Index> & degrees)
+        {
+            if(colors[j].load(std::memory_order_relaxed) == trimmed || --degrees[j] > 0) return;
+            colors[j].store(trimmed, std::memory_order_relaxed);
+            queue.push_back(j);
+        };
+        for(Index succ : csr.Successors(queue[q])) trim(succ, indeg);
+        for(Index pred : csr.Predecessors(queue[q])) trim(pred, outdeg);
+    }
+
+    // forward-backward on the rest: every subproblem is a set of nodes of one color, which no other subproblem has
+    std::deque<std::vector<Index>> work;
+    std::vector<Index> rest;
+    for(Index i = 0; i < n; ++i) if(colors[i].load(std::memory_order_relaxed) != trimmed) rest.push_back(i);
+    if(!rest.empty()) work.push_back(std::move(rest));
+    std::atomic<int> nextcolor{1};
+    std::vector<int> fwd(n, trimmed), bwd(n, trimmed); // marks of the subproblem (by its color) that reached a node
+    std::vector<std::vector<Index>> sccs;
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned busy = 0;
+
+    internal::RunThreads(nthreads, [&](unsigned)
+    {
+        std::vector<Index> frontier;
+        auto search = [&](Index pivot, int color, std::vector<int> & marks, bool forward)
+        {
+            frontier.assign(1, pivot);
+            marks[pivot] = color;
+            while(!frontier.empty())
+            {
+                Index cur = frontier.back();
+                frontier.pop_back();
+                for(Index other : forward ? csr.Successors(cur) : csr.Predecessors(cur))
+                {
+                    if(colors[other].load(std::memory_order_relaxed) != color || marks[other] == color) continue;
+                    marks[other] = color;
+                    frontier.push_back(other);
+                }
+            }
+        };
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true)
+        {
+            cond.wait(lock, [&]() { return !work.empty() || busy == 0; });
+            if(work.empty()) return;
+            auto nodes = std::move(work.front());
+            work.pop_front();
+            ++busy;
+            lock.unlock();
+
+            int color = colors[nodes.front()].load(std::memory_order_relaxed);
+            Index pivot = nodes.front();
+            search(pivot, color, fwd, true);
+            search(pivot, color, bwd, false);
+            std::vector<Index> scc, parts[3];
+            for(Index i : nodes)
+            {
+                bool f = fwd[i] == color, b = bwd[i] == color;
+                if(f && b) scc.push_back(i);
+                else parts[f ? 0 : b ? 1 : 2].push_back(i);
+            }
+            for(auto & part : parts)
+            {
+                if(part.empty()) continue;
+                int newcolor = nextcolor.fetch_add(1, std::memory_order_relaxed);
+                for(Index i : part) colors[i].store(newcolor, std::memory_order_relaxed);
+            }
+
+            lock.lock();
+            if(scc.size() > 1 || std::find(csr.Successors(pivot).begin(), csr.Successors(pivot).end(), pivot)
+                                 != csr.Successors(pivot).end())
+                sccs.push_back(std::move(scc));
+            else colors[pivot].store(trimmed, std::memory_order_relaxed);
+            for(auto & part : parts) if(!part.empty()) work.push_back(std::move(part));
+            --busy;
+            cond.notify_all();
+        }
+    });
+
+    for(auto & scc : sccs) std::sort(scc.begin(), scc.end());
+    std::sort(sccs.begin(), sccs.end(), [](auto & a, auto & b) { return a.front() < b.front(); });
+    std::vector<std::vector<const typename graph_t::node_t *>> ret;
+    ret.reserve(sccs.size());
+    for(auto & scc : sccs)
+    {
+        ret.emplace_back();
+        for(Index i : scc) ret.back().push_back(&csr.GetNode(i));
+    }
+    if(psinglenodes)
+    {
+        assert(psinglenodes->empty());
+        for(Index i = 0; i < n; ++i)
+        {
+            if(colors[i].load(std::memory_order_relaxed) == trimmed) psinglenodes->push_back(&csr.GetNode(i));
+        }
+    }
+    return ret;
+}
+
+}} //namespace Ladybirds::graph
+
+#endif // LADYBIRDS_GRAPH_GRAPH_PARALLEL_H
@@ -4,6 +4,9 @@
 #define LADYBIRDS_GRAPH_GRAPH_H
 
 #include <limits>
+#include <unordered_map>
+#include "csr.h"
+#include "derivedcache.h"
 #include "edge.h"
 #include "itemmap.h"
 #include "itemset.h"
@@ -28,8 +31,8 @@ public:
     constexpr Version(bool initialize = false) : Val_(initialize ? Startval : Uninitialized) {}
     
     constexpr void operator++() {++Val_;}
-    constexpr bool operator==(Version other) { return other.Val_ == Val_; }
-    constexpr bool operator!=(Version other) { return other.Val_ != Val_; }
+    constexpr bool operator==(Version other) const { return other.Val_ == Val_; }
+    constexpr bool operator!=(Version other) const { return other.Val_ != Val_; }
 };
 
 template<class NodeClass, class VersionClass = NoVersion>
@@ -44,6 +47,7 @@ private:
     PresDeque<node_t> Nodes_;
     PresDeque<edge_t> Edges_;
     Version Version_ = Version(true);
+    mutable DerivedCache Derived_;
     
 public:
     using NodeIterator = typename decltype(Nodes_)::iterator;
@@ -61,20 +65,28 @@ public:
     {
         Nodes_ = std::move(other.Nodes_), Edges_ = std::move(other.Edges_);
         for(auto &n : Nodes_) n.Graph_ = this;
-        ++Version_;
+        other.Modified();
+        Modified();
         return *this;
     }
     
     /// Returns the current version number of the graph. This number is changed each time the graph is modified.
     inline Version GetVersion() const { return Version_; }
+    /// Returns a snapshot of the graph in compressed sparse row format for fast traversal (cf. CsrGraph).
+    inline CsrGraph<Graph> Freeze() const { return CsrGraph<Graph>(*this); }
+    /// Returns data derived from the graph, identified by \p key_t. On the first call after a modification of the
+    /// graph, the data is computed by \p compute(graph); afterwards, the stored result is returned. The reference is
+    /// valid until the graph is modified (cf. DerivedCache).
+    template<class key_t, typename fn_t> const auto & GetDerived(fn_t compute) const
+        { return Derived_.Get<key_t>([this, &compute]() { return compute(*this); }); }
     
     inline bool IsEmpty() const { return Nodes_.empty(); }
-    inline void Clear() { Edges_.clear(); Nodes_.clear(); ++Version_; }
+    inline void Clear() { Edges_.clear(); Nodes_.clear(); Modified(); }
     inline void ClearEdges()
     {
         Edges_.clear();
         for(auto &n : Nodes_) n.FirstInEdge_ = n.FirstOutEdge_ = nullptr;
-        ++Version_;
+        Modified();
     }
     
     inline auto NodesBegin()       { return Nodes_.begin(); }
@@ -102,7 +114,7 @@ public:
     {
         auto it = Nodes_.emplace(std::forward<Args>(args)...);
         it->Graph_ = static_cast<typename node_t::graph_t*>(this);
-        ++Version_;
+        Modified();
         return &*it;
     }
     
@@ -116,12 +128,14 @@ public:
         
         e.PrevOut_ = nullptr;
         e.NextOut_ = source->FirstOutEdge_;
+        if(e.NextOut_) e.NextOut_->PrevOut_ = &e;
         source->FirstOutEdge_ = &e;
         e.PrevIn_ = nullptr;
         e.NextIn_ = target->FirstInEdge_;
+        if(e.NextIn_) e.NextIn_->PrevIn_ = &e;
         target->FirstInEdge_ = &e;
         
-        ++Version_;
+        Modified();
         return &e;
     }
     
@@ -134,7 +148,7 @@ public:
             RemoveEdge(&*it++);
         
         Nodes_.erase(node);
-        ++Version_;
+        Modified();
     }
     
     void RemoveEdge(edge_t * edge)
@@ -151,7 +165,7 @@ public:
         if(edge->NextIn_) edge->NextIn_->PrevIn_ = edge->PrevIn_;
         
         Edges_.erase(edge);
-        ++Version_;
+        Modified();
     }
     
     //! Reorders the nodes in this graph, according to the order given by \p neworder.
@@ -177,7 +191,7 @@ public:
         for(auto & e : Edges_) edgemap[e] = {nodemap[e.Source_], nodemap[e.Target_]};
         
         //now move the nodes
-        decltype(Nodes_) newnodemap;
+        decltype(Nodes_) newnodemap(Nodes_.get_allocator());
         for(const node_t * pn : neworder)
         {
             assert(pn->Graph_ == this);
@@ -192,8 +206,48 @@ public:
             e.Source_ = &Nodes_.FromID(ids.from);
             e.Target_ = &Nodes_.FromID(ids.to);
         }
-        ++Version_;
+        Modified();
     }
+    
+    //! Returns the fraction of the node ID range that consists of gaps left behind by removed nodes.
+    inline double GetNodeFragmentation() const
+        { return Nodes_.empty() ? 0.0 : double(Nodes_.GetGapCount()) / (Nodes_.GetGapCount() + Nodes_.size()); }
+    
+    //! Returns the bytes taken by the slots of the nodes and edges (cf. PresDeque::GetHeapBytes)
+    inline std::size_t GetHeapBytes() const { return Nodes_.GetHeapBytes() + Edges_.GetHeapBytes(); }
+    
+    //! Renumbers nodes and edges densely (cf. PresDeque::Compact), keeping their order.
+    //! All pointers to nodes and edges and all maps and sets based on them become invalid.
+    void Compact()
+    {
+        std::unordered_map<const node_t*, node_t*> newnodes;
+        std::unordered_map<const edge_t*, edge_t*> newedges;
+        newnodes.reserve(Nodes_.size());
+        newedges.reserve(Edges_.size());
+        
+        //the maps are only used to look up addresses of moved-from objects, which are never dereferenced
+        Nodes_.Compact([&newnodes](const node_t & oldnode, node_t & newnode) { newnodes[&oldnode] = &newnode; });
+        Edges_.Compact([&newedges](const edge_t & oldedge, edge_t & newedge) { newedges[&oldedge] = &newedge; });
+        
+        auto newedge = [&newedges](edge_t * pe) { return pe ? newedges.at(pe) : nullptr; };
+        for(auto & e : Edges_)
+        {
+            e.Source_ = newnodes.at(e.Source_);
+            e.Target_ = newnodes.at(e.Target_);
+            e.PrevIn_ = newedge(e.PrevIn_), e.NextIn_ = newedge(e.NextIn_);
+            e.PrevOut_ = newedge(e.PrevOut_), e.NextOut_ = newedge(e.NextOut_);
+        }
+        for(auto & n : Nodes_)
+        {
+            n.FirstInEdge_ = newedge(n.FirstInEdge_);
+            n.FirstOutEdge_ = newedge(n.FirstOutEdge_);
+        }
+        Modified();
+    }
+    
+private:
+    /// \internal To be called after each modification: Changes the version and drops all derived data
+    inline void Modified() { ++Version_; Derived_.Clear(); }
 };
 
 }} //namespace Ladybirds::graph
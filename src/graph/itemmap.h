@@ -48,6 +48,15 @@ public:
         { return const_cast<ItemMap*>(this)->operator[](elem); }
     inline const tval & operator [](const PresDequeElementBase * pelem) const { return operator[](*pelem); }
     inline bool IsEmpty() const { return MinID_ == 0; }
+    /// Returns the bytes allocated for the values, not counting the map object itself
+    inline std::size_t GetHeapBytes() const { return Vec_.capacity() * sizeof(tval); }
+    /// Like GetHeapBytes, but adds \p valbytes(value) for every value, e.g. for values that allocate memory themselves
+    template<typename fn_t> std::size_t GetHeapBytes(fn_t valbytes) const
+    {
+        std::size_t ret = GetHeapBytes();
+        for(auto & val : Vec_) ret += valbytes(val);
+        return ret;
+    }
 };
 }} //namespace Ladybirds::graph
 
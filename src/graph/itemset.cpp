@@ -6,56 +6,374 @@
 
 namespace Ladybirds { namespace graph {
 
+constexpr std::size_t ItemSet::chunksize; //definition required for odr-use before C++17
+
+/// Number of words that the early-exit loops process at once (Contains, Intersects)
+static constexpr std::size_t blocksize = 8;
+
+/// \internal Returns the first position >= \p pos in the bit set \p pbits of \p nwords words, at which the bit has the
+/// value \p value, or nwords*64 if there is none.
+static std::size_t NextBit(const std::uint64_t * pbits, std::size_t nwords, std::size_t pos, bool value)
+{
+    std::size_t idx = pos / 64;
+    if(idx >= nwords) return nwords*64;
+
+    auto getword = [pbits, value](std::size_t i) { return value ? pbits[i] : ~pbits[i]; };
+    std::uint64_t w = getword(idx) & (~std::uint64_t(0) << (pos % 64));
+    while(!w)
+    {
+        if(++idx == nwords) return nwords*64;
+        w = getword(idx);
+    }
+    return idx*64 + __builtin_ctzll(w);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Chunk functionality
+//
+bool ItemSet::Chunk::Contains(low_t low) const
+{
+    switch(Type)
+    {
+    case ChunkType::Empty:  return false;
+    case ChunkType::Array:  return std::binary_search(Array.begin(), Array.end(), low);
+    case ChunkType::Bitmap: return (Bits[low / wordsize] >> (low % wordsize)) & 1;
+    case ChunkType::Runs:
+    {
+        auto it = std::upper_bound(Runs.begin(), Runs.end(), low, [](low_t l, const Run & r){ return l < r.First; });
+        return it != Runs.begin() && (--it)->Last >= low;
+    }
+    }
+    return false;
+}
+
+void ItemSet::Chunk::OrInto(word * pbits) const
+{
+    switch(Type)
+    {
+    case ChunkType::Empty: break;
+    case ChunkType::Array:
+        for(low_t low : Array) pbits[low / wordsize] |= word(1) << (low % wordsize);
+        break;
+    case ChunkType::Bitmap:
+    {
+        const word * psrc = Bits.data();
+        for(std::size_t i = 0, n = Bits.size(); i < n; ++i) pbits[i] |= psrc[i];
+        break;
+    }
+    case ChunkType::Runs:
+        for(auto & run : Runs)
+        {
+            std::size_t first = run.First / wordsize, last = run.Last / wordsize;
+            word firstmask = ~word(0) << (run.First % wordsize), lastmask = ~word(0) >> (wordsize-1 - run.Last % wordsize);
+            if(first == last) { pbits[first] |= firstmask & lastmask; continue; }
+            pbits[first] |= firstmask;
+            for(auto i = first + 1; i < last; ++i) pbits[i] = ~word(0);
+            pbits[last] |= lastmask;
+        }
+        break;
+    }
+}
+
+const ItemSet::word * ItemSet::Chunk::GetBits(int slot) const
+{
+    if(Type == ChunkType::Bitmap) return Bits.data();
+    
+    thread_local std::vector<word> scratch[2];
+    scratch[slot].assign(Words(), 0);
+    OrInto(scratch[slot].data());
+    return scratch[slot].data();
+}
+
+void ItemSet::Chunk::Clear()
+{
+    Type = ChunkType::Empty;
+    Count = 0;
+    std::vector<low_t>().swap(Array); //release the memory
+    std::vector<word>().swap(Bits);
+    std::vector<Run>().swap(Runs);
+}
+
+void ItemSet::Chunk::Fill()
+{
+    Clear();
+    if(Length == 0) return;
+    Type = ChunkType::Runs;
+    Count = Length;
+    Runs.push_back({0, low_t(Length-1)});
+}
+
+void ItemSet::Chunk::ConvertToBitmap()
+{
+    if(Type == ChunkType::Bitmap) return;
+
+    std::vector<word> bits(Words(), 0);
+    OrInto(bits.data());
+    auto count = Count;
+    Clear();
+    Type = ChunkType::Bitmap;
+    Count = count;
+    Bits.swap(bits);
+}
+
+void ItemSet::Chunk::Optimize()
+{
+    assert(Type == ChunkType::Bitmap);
+
+    const word * pbits = Bits.data();
+    std::size_t nwords = Bits.size(), count = 0, nruns = 0;
+    word carry = 0; //highest bit of the previous word, seen as a 1 in front of the current one
+    for(std::size_t i = 0; i < nwords; ++i)
+    {
+        word w = pbits[i];
+        count += __builtin_popcountll(w);
+        nruns += __builtin_popcountll(w & ~((w << 1) | carry)); //number of run starts
+        carry = w >> (wordsize-1);
+    }
+    Count = count;
+
+    if(count == 0) Clear();
+    else if(count <= MaxArray())
+    {
+        std::vector<low_t> array;
+        array.reserve(count);
+        for(std::size_t pos = NextBit(pbits, nwords, 0, true); pos < Length; pos = NextBit(pbits, nwords, pos+1, true))
+            array.push_back(pos);
+        Clear();
+        Type = ChunkType::Array;
+        Count = count;
+        Array.swap(array);
+    }
+    else if(2 * nruns * sizeof(Run) <= nwords * sizeof(word)) //runs need at most half the space of the bit set
+    {
+        std::vector<Run> runs;
+        runs.reserve(nruns);
+        for(std::size_t pos = NextBit(pbits, nwords, 0, true); pos < Length; )
+        {
+            auto end = std::min<std::size_t>(NextBit(pbits, nwords, pos, false), Length);
+            runs.push_back({low_t(pos), low_t(end-1)});
+            pos = NextBit(pbits, nwords, end, true);
+        }
+        Clear();
+        Type = ChunkType::Runs;
+        Count = count;
+        Runs.swap(runs);
+    }
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// IDIterator
+//
+void ItemSet::IDIterator::StartChunk()
+{
+    for(auto & chunks = pSet_->Chunks_; Chunk_ < chunks.size(); ++Chunk_)
+    {
+        auto & chunk = chunks[Chunk_];
+        Idx_ = 0;
+        switch(chunk.Type)
+        {
+        case ChunkType::Empty: continue;
+        case ChunkType::Array: SetPos(chunk.Array[0]); return;
+        case ChunkType::Runs:  SetPos(chunk.Runs[0].First); return;
+        case ChunkType::Bitmap:
+            while(!(Cur_ = chunk.Bits[Idx_])) ++Idx_; //non-empty bit set chunks always have a bit set
+            SetPos(Idx_*wordsize + __builtin_ctzll(Cur_));
+            return;
+        }
+    }
+    *this = IDIterator(); //no further items
+}
+
+ItemSet::IDIterator & ItemSet::IDIterator::operator++()
+{
+    auto & chunk = pSet_->Chunks_[Chunk_];
+    std::size_t low = Value_ - pSet_->MinID_ - (Chunk_ << chunkbits);
+    switch(chunk.Type)
+    {
+    case ChunkType::Empty: break;
+    case ChunkType::Array:
+        if(++Idx_ < chunk.Array.size()) { SetPos(chunk.Array[Idx_]); return *this; }
+        break;
+    case ChunkType::Runs:
+        if(low < chunk.Runs[Idx_].Last) { SetPos(low+1); return *this; }
+        if(++Idx_ < chunk.Runs.size()) { SetPos(chunk.Runs[Idx_].First); return *this; }
+        break;
+    case ChunkType::Bitmap:
+        Cur_ &= Cur_ - 1; //clear lowest bit
+        while(!Cur_ && ++Idx_ < chunk.Bits.size()) Cur_ = chunk.Bits[Idx_];
+        if(Cur_) { SetPos(Idx_*wordsize + __builtin_ctzll(Cur_)); return *this; }
+        break;
+    }
+
+    ++Chunk_;
+    StartChunk();
+    return *this;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ItemSet
+//
+void ItemSet::InitChunks(std::size_t range)
+{
+    Chunks_.resize((range + chunksize - 1) / chunksize);
+    for(auto & chunk : Chunks_)
+    {
+        chunk.Length = std::min(range, chunksize);
+        range -= chunk.Length;
+    }
+}
+
 void ItemSet::Insert(const PresDequeElementBase * pelem)
 {
     assert(BaseChecker_ && BaseChecker_->Check(pelem));
-    auto pos = pelem->GetID()-MinID_;
-    Vec_[pos/wordsize] |= word(1) << (pos%wordsize);
+    std::size_t pos = pelem->GetID()-MinID_;
+    auto & chunk = Chunks_[pos >> chunkbits];
+    low_t low = pos % chunksize;
+
+    switch(chunk.Type)
+    {
+    case ChunkType::Empty:
+        chunk.Type = ChunkType::Array;
+        chunk.Array.assign(1, low);
+        chunk.Count = 1;
+        break;
+    case ChunkType::Array:
+    {
+        auto it = std::lower_bound(chunk.Array.begin(), chunk.Array.end(), low);
+        if(it != chunk.Array.end() && *it == low) return;
+        chunk.Array.insert(it, low);
+        if(++chunk.Count > chunk.MaxArray()) chunk.ConvertToBitmap();
+        break;
+    }
+    case ChunkType::Runs:
+        if(chunk.Contains(low)) return;
+        chunk.ConvertToBitmap();
+        //fall through
+    case ChunkType::Bitmap:
+    {
+        auto & w = chunk.Bits[low / wordsize];
+        auto bit = word(1) << (low % wordsize);
+        if(w & bit) return;
+        w |= bit;
+        ++chunk.Count;
+        break;
+    }
+    }
+    CachedCount_ = countInvalid;
 }
 
 void ItemSet::Remove(const PresDequeElementBase * pelem)
 {
     assert(BaseChecker_ && BaseChecker_->Check(pelem));
-    auto pos = pelem->GetID()-MinID_;
-    Vec_[pos/wordsize] &= ~(word(1) << (pos%wordsize));
+    std::size_t pos = pelem->GetID()-MinID_;
+    auto & chunk = Chunks_[pos >> chunkbits];
+    low_t low = pos % chunksize;
+
+    switch(chunk.Type)
+    {
+    case ChunkType::Empty: return;
+    case ChunkType::Array:
+    {
+        auto it = std::lower_bound(chunk.Array.begin(), chunk.Array.end(), low);
+        if(it == chunk.Array.end() || *it != low) return;
+        chunk.Array.erase(it);
+        if(--chunk.Count == 0) chunk.Clear();
+        break;
+    }
+    case ChunkType::Runs:
+        if(!chunk.Contains(low)) return;
+        chunk.ConvertToBitmap();
+        //fall through
+    case ChunkType::Bitmap:
+    {
+        auto & w = chunk.Bits[low / wordsize];
+        auto bit = word(1) << (low % wordsize);
+        if(!(w & bit)) return;
+        w &= ~bit;
+        if(--chunk.Count == 0) chunk.Clear();
+        else if(chunk.Count < chunk.MaxArray()/2) chunk.Optimize(); //hysteresis avoids converting back and forth
+        break;
+    }
+    }
+    CachedCount_ = countInvalid;
 }
 
 
 bool ItemSet::Contains(const PresDequeElementBase * pelem) const
 {
     assert(BaseChecker_ && BaseChecker_->Check(pelem));
-    auto pos = pelem->GetID()-MinID_;
-    return (Vec_[pos/wordsize] & (word(1) << (pos%wordsize))) != 0;
+    std::size_t pos = pelem->GetID()-MinID_;
+    return Chunks_[pos >> chunkbits].Contains(pos % chunksize);
 }
 
 void ItemSet::InsertAll()
 {
     assert(BaseChecker_);
-    Vec_.assign(Vec_.size(), ~word(0));
+    for(auto & chunk : Chunks_) chunk.Fill();
     ElementCountCorrection_ = ElementCountCorrectionBackup_;
+    CachedCount_ = countInvalid;
 }
 
 void ItemSet::RemoveAll()
 {
     assert(BaseChecker_);
-    Vec_.assign(Vec_.size(), 0);
+    for(auto & chunk : Chunks_) chunk.Clear();
     ElementCountCorrection_ = 0;
+    CachedCount_ = 0;
 }
 
 std::size_t ItemSet::ElementCount() const
 {
     assert(BaseChecker_);
-    std::size_t bitcount = ElementCountCorrection_;
-    for(word w : Vec_) bitcount += __builtin_popcount(w);
-    return bitcount;
+    if(CachedCount_ != countInvalid) return CachedCount_;
+
+    std::size_t count = ElementCountCorrection_;
+    for(auto & chunk : Chunks_) count += chunk.Count;
+    return CachedCount_ = count;
+}
+
+std::size_t ItemSet::GetHeapBytes() const
+{
+    std::size_t ret = Chunks_.capacity() * sizeof(Chunk);
+    for(auto & chunk : Chunks_)
+    {
+        ret += chunk.Array.capacity() * sizeof(low_t) + chunk.Bits.capacity() * sizeof(word)
+             + chunk.Runs.capacity() * sizeof(Run);
+    }
+    return ret;
 }
 
 bool ItemSet::Contains(const ItemSet & other) const
 {
     assert(BaseChecker_ && BaseChecker_->Check(other.BaseChecker_.get()));
-    for(auto i = Vec_.size(); i-- > 0; )
+    for(std::size_t c = 0, nchunks = Chunks_.size(); c < nchunks; ++c)
     {
-        if((Vec_[i] & other.Vec_[i]) != other.Vec_[i]) return false;
+        auto & mine = Chunks_[c], & theirs = other.Chunks_[c];
+        if(theirs.Count == 0 || mine.IsFull()) continue;
+        if(mine.Count < theirs.Count) return false;
+
+        if(theirs.Type == ChunkType::Array)
+        {
+            for(low_t low : theirs.Array) if(!mine.Contains(low)) return false;
+            continue;
+        }
+
+        //compare bit sets, checking blocks of words at once, such that the compiler can vectorize the inner loop
+        const word * a = mine.GetBits(0), * b = theirs.GetBits(1);
+        std::size_t n = mine.Words();
+        std::size_t i = 0;
+        for(; i + blocksize <= n; i += blocksize)
+        {
+            word missing = 0;
+            for(std::size_t j = i; j < i + blocksize; ++j) missing |= b[j] & ~a[j];
+            if(missing) return false;
+        }
+        for(; i < n; ++i)
+        {
+            if(b[i] & ~a[i]) return false;
+        }
     }
     return true;
 }
@@ -63,9 +381,47 @@ bool ItemSet::Contains(const ItemSet & other) const
 bool ItemSet::Intersects(const ItemSet & other) const
 {
     assert(BaseChecker_ && BaseChecker_->Check(other.BaseChecker_.get()));
-    for(auto i = Vec_.size(); i-- > 0; )
+    for(std::size_t c = 0, nchunks = Chunks_.size(); c < nchunks; ++c)
     {
-        if((Vec_[i] & other.Vec_[i])) return true;
+        auto & mine = Chunks_[c], & theirs = other.Chunks_[c];
+        if(mine.Count == 0 || theirs.Count == 0) continue;
+        if(mine.IsFull() || theirs.IsFull()) return true;
+
+        //iterate over the smaller array, if there is one
+        const Chunk * parray = nullptr, * pother = nullptr;
+        if(mine.Type == ChunkType::Array) parray = &mine, pother = &theirs;
+        if(theirs.Type == ChunkType::Array && (!parray || theirs.Count < mine.Count)) parray = &theirs, pother = &mine;
+        if(parray)
+        {
+            for(low_t low : parray->Array) if(pother->Contains(low)) return true;
+            continue;
+        }
+
+        if(mine.Type == ChunkType::Runs && theirs.Type == ChunkType::Runs)
+        {   //merge the sorted run lists, looking for an overlap
+            auto it1 = mine.Runs.begin(), it2 = theirs.Runs.begin();
+            while(it1 != mine.Runs.end() && it2 != theirs.Runs.end())
+            {
+                if(it1->First <= it2->Last && it2->First <= it1->Last) return true;
+                if(it1->Last < it2->Last) ++it1;
+                else ++it2;
+            }
+            continue;
+        }
+
+        const word * a = mine.GetBits(0), * b = theirs.GetBits(1);
+        std::size_t n = mine.Words();
+        std::size_t i = 0;
+        for(; i + blocksize <= n; i += blocksize)
+        {
+            word common = 0;
+            for(std::size_t j = i; j < i + blocksize; ++j) common |= a[j] & b[j];
+            if(common) return true;
+        }
+        for(; i < n; ++i)
+        {
+            if(a[i] & b[i]) return true;
+        }
     }
     return false;
 }
@@ -74,21 +430,103 @@ bool ItemSet::Intersects(const ItemSet & other) const
 ItemSet & ItemSet::operator &=(const ItemSet & other)
 {
     assert(BaseChecker_ && BaseChecker_->Check(other.BaseChecker_.get()));
-    for(auto i = Vec_.size(); i-- > 0; ) Vec_[i] &= other.Vec_[i];
+    for(std::size_t c = 0, nchunks = Chunks_.size(); c < nchunks; ++c)
+    {
+        auto & mine = Chunks_[c];
+        auto & theirs = other.Chunks_[c];
+        if(mine.Count == 0 || theirs.IsFull()) continue;
+        if(theirs.Count == 0) { mine.Clear(); continue; }
+        if(mine.IsFull()) { mine = theirs; continue; }
+
+        if(mine.Type == ChunkType::Array || theirs.Type == ChunkType::Array)
+        {   //the result is an array: keep the entries of the array that are also in the other chunk
+            std::vector<low_t> array;
+            const Chunk & arraychunk = (mine.Type == ChunkType::Array) ? mine : theirs;
+            const Chunk & otherchunk = (mine.Type == ChunkType::Array) ? theirs : mine;
+            std::copy_if(arraychunk.Array.begin(), arraychunk.Array.end(), std::back_inserter(array),
+                         [&otherchunk](low_t low) { return otherchunk.Contains(low); });
+            mine.Clear();
+            if(array.empty()) continue;
+            mine.Type = ChunkType::Array;
+            mine.Count = array.size();
+            mine.Array.swap(array);
+            continue;
+        }
+
+        mine.ConvertToBitmap();
+        word * d = mine.Bits.data();
+        const word * s = theirs.GetBits(0);
+        for(std::size_t i = 0, n = mine.Words(); i < n; ++i) d[i] &= s[i];
+        mine.Optimize();
+    }
+    CachedCount_ = countInvalid;
     return *this;
 }
 
 ItemSet & ItemSet::operator |=(const ItemSet & other)
 {
     assert(BaseChecker_ && BaseChecker_->Check(other.BaseChecker_.get()));
-    for(auto i = Vec_.size(); i-- > 0; ) Vec_[i] |= other.Vec_[i];
+    for(std::size_t c = 0, nchunks = Chunks_.size(); c < nchunks; ++c)
+    {
+        auto & mine = Chunks_[c];
+        auto & theirs = other.Chunks_[c];
+        if(theirs.Count == 0 || mine.IsFull()) continue;
+        if(mine.Count == 0 || theirs.IsFull()) { mine = theirs; continue; }
+
+        if(mine.Type == ChunkType::Array && theirs.Type == ChunkType::Array
+           && mine.Count + theirs.Count <= mine.MaxArray())
+        {
+            std::vector<low_t> array;
+            array.reserve(mine.Count + theirs.Count);
+            std::set_union(mine.Array.begin(), mine.Array.end(), theirs.Array.begin(), theirs.Array.end(),
+                           std::back_inserter(array));
+            mine.Count = array.size();
+            mine.Array.swap(array);
+            continue;
+        }
+
+        mine.ConvertToBitmap();
+        theirs.OrInto(mine.Bits.data());
+        mine.Optimize();
+    }
+    CachedCount_ = countInvalid;
     return *this;
 }
 
 ItemSet & ItemSet::Remove(const ItemSet & other)
 {
     assert(BaseChecker_ && BaseChecker_->Check(other.BaseChecker_.get()));
-    for(auto i = Vec_.size(); i-- > 0; ) Vec_[i] &= ~other.Vec_[i];
+    for(std::size_t c = 0, nchunks = Chunks_.size(); c < nchunks; ++c)
+    {
+        auto & mine = Chunks_[c];
+        auto & theirs = other.Chunks_[c];
+        if(mine.Count == 0 || theirs.Count == 0) continue;
+        if(theirs.IsFull()) { mine.Clear(); continue; }
+
+        if(mine.Type == ChunkType::Array)
+        {
+            auto newend = std::remove_if(mine.Array.begin(), mine.Array.end(),
+                                         [&theirs](low_t low) { return theirs.Contains(low); });
+            mine.Array.erase(newend, mine.Array.end());
+            mine.Count = mine.Array.size();
+            if(mine.Count == 0) mine.Clear();
+            continue;
+        }
+
+        mine.ConvertToBitmap();
+        word * d = mine.Bits.data();
+        if(theirs.Type == ChunkType::Array)
+        {
+            for(low_t low : theirs.Array) d[low / wordsize] &= ~(word(1) << (low % wordsize));
+        }
+        else
+        {
+            const word * s = theirs.GetBits(0);
+            for(std::size_t i = 0, n = mine.Words(); i < n; ++i) d[i] &= ~s[i];
+        }
+        mine.Optimize();
+    }
+    CachedCount_ = countInvalid;
     return *this;
 }
 
@@ -3,8 +3,11 @@
 #ifndef LADYBIRDS_GRAPH_ITEMSET_H
 #define LADYBIRDS_GRAPH_ITEMSET_H
 
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
 #include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "internal/basechecker.h"
@@ -17,19 +20,59 @@ struct PresDequeElementBase;
     
 /** A class to store a subset of items in a list.
  *  This list (called the base of the set) is of type PresDeque.
- *  Internally uses a bit set, such that the memory consumption is minimized
- *  and union and itersection operations are fast.
+ *  Internally, the ID range of the base is split into chunks of 64Ki IDs (in the style of Roaring bitmaps). Each chunk
+ *  is stored in the most compact of three representations: a sorted array for sparse chunks, a bit set for dense
+ *  ones, and a list of runs (intervals) for chunks that consist of a few ranges, e.g. almost full ones. Thus the
+ *  memory consumption is kept small, and union and intersection operations are fast.
  **/
 class ItemSet
 {
 private:
-    using word = std::size_t;
+    using word = std::uint64_t;
+    using low_t = std::uint16_t; ///< Position of an ID inside its chunk
     static constexpr int wordsize = sizeof(word)*8;
+    static constexpr int chunkbits = 16;
+    static constexpr std::size_t chunksize = std::size_t(1) << chunkbits;
+    static constexpr std::size_t countInvalid = ~std::size_t(0);
+    
+    enum class ChunkType : std::uint8_t { Empty, Array, Bitmap, Runs };
+    struct Run { low_t First, Last; };
+    
+    /// \internal The items in a range of (at most) chunksize IDs. Only the member corresponding to Type is used.
+    struct Chunk
+    {
+        ChunkType Type = ChunkType::Empty;
+        std::uint32_t Length = 0; ///< Number of IDs covered by the chunk
+        std::uint32_t Count = 0;  ///< Number of items in the chunk
+        std::vector<low_t> Array; ///< Sorted positions
+        std::vector<word> Bits;   ///< Bit set with Words() words
+        std::vector<Run> Runs;    ///< Sorted, disjoint, non-adjacent runs
+        
+        inline std::size_t Words() const { return (Length + wordsize - 1) / wordsize; }
+        /// The maximum number of items of an array chunk. Arrays are smaller than bit sets up to this size.
+        inline std::size_t MaxArray() const { return Length / 16; }
+        inline bool IsFull() const { return Count == Length; }
+        
+        bool Contains(low_t low) const;
+        void OrInto(word * pbits) const; ///< Sets the bits of the items in the chunk in the bit set \p pbits
+        /// Returns the chunk as a bit set, using the thread-local scratch space \p slot (0 or 1) for non-bit sets.
+        const word * GetBits(int slot) const;
+        void Clear();
+        void Fill(); ///< Inserts all IDs of the chunk (as a single run)
+        void ConvertToBitmap();
+        void Optimize(); ///< Recounts a bit set chunk and converts it to the most compact representation
+    };
+    
+public:
+    class IDIterator;
+    template<typename t> class ElementIterator;
+    template<class iterator> class Range;
     
 private:
-    std::vector<word> Vec_;
+    std::vector<Chunk> Chunks_;
     std::size_t MinID_;
     std::size_t ElementCountCorrection_, ElementCountCorrectionBackup_;
+    mutable std::size_t CachedCount_ = countInvalid;
 
 #ifndef NDEBUG
 private:
@@ -50,6 +93,17 @@ public:
     ItemSet & operator=(ItemSet &&) = default;
 
     std::size_t ElementCount() const; ///< Returns the number of elements contained in the set
+    std::size_t GetHeapBytes() const; ///< Returns the bytes allocated for the chunks, not counting the object itself
+    inline bool IsEmpty() const { return ElementCount() == 0; } ///< Checks if the set contains no elements
+    
+    /// Returns a range over the IDs of the items in the set, in ascending order. Only the items actually stored are
+    /// visited, empty chunks and words are skipped. Note that if items have been inserted with InsertAll, the range
+    /// also contains IDs of free slots in the base; use \ref Elements to iterate over actual items only.
+    inline Range<IDIterator> IDs() const;
+    /// Returns a range over the items in the set, which must be a subset of \p base, in ascending order of their IDs.
+    template<typename t> inline Range<ElementIterator<t>> Elements(PresDeque<t> & base) const;
+    /// Returns a range over the items in the set, which must be a subset of \p base, in ascending order of their IDs.
+    template<typename t> inline Range<ElementIterator<const t>> Elements(const PresDeque<t> & base) const;
     
     void Insert(const PresDequeElementBase * pelem); ///< Inserts an item \p pelem into the set
     inline void Insert(const PresDequeElementBase & elem) { Insert(&elem); } ///< Inserts an item \p elem into the set
@@ -74,7 +128,92 @@ public:
     inline ItemSet operator &(const ItemSet & other) { ItemSet ret = *this; return ret &= other; return ret; }
     /// Returns the union of this set and \p other
     inline ItemSet operator |(const ItemSet & other) { ItemSet ret = *this; return ret |= other; return ret; }
+    
+private:
+    void InitChunks(std::size_t range); ///< \internal Sets up empty chunks for \p range IDs
+};
+
+
+/// Iterator over the IDs contained in an ItemSet (cf. ItemSet::IDs). A default-constructed iterator marks the end.
+class ItemSet::IDIterator
+{
+    friend class ItemSet;
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::ptrdiff_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = value_type;
+    
+private:
+    const ItemSet * pSet_ = nullptr; //null for the end iterator
+    std::size_t Chunk_ = 0, Idx_ = 0; //current chunk and index of the array entry / word / run in it
+    word Cur_ = 0; //remaining bits of the current word for bit set chunks
+    std::ptrdiff_t Value_ = 0;
+    
+    explicit IDIterator(const ItemSet * pset) : pSet_(pset) { StartChunk(); }
+    void StartChunk(); //moves to the first item in the first non-empty chunk from Chunk_ on
+    inline void SetPos(std::size_t low) { Value_ = pSet_->MinID_ + (Chunk_ << chunkbits) + low; }
+    
+public:
+    IDIterator() = default;
+    
+    inline bool operator==(const IDIterator & other) const { return pSet_ == other.pSet_ && Value_ == other.Value_; }
+    inline bool operator!=(const IDIterator & other) const { return !(*this == other); }
+    
+    inline std::ptrdiff_t operator*() const { return Value_; }
+    IDIterator & operator++();
+    inline IDIterator operator++(int) { auto ret = *this; ++*this; return ret; }
 };
+
+/// Iterator over the items contained in an ItemSet (cf. ItemSet::Elements). A default-constructed iterator marks the
+/// end. Free slots in the base are skipped.
+template<typename t>
+class ItemSet::ElementIterator
+{
+    friend class ItemSet;
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::remove_const_t<t>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = t *;
+    using reference = t &;
+    
+private:
+    using base_t = std::conditional_t<std::is_const<t>::value, const PresDeque<value_type>, PresDeque<value_type>>;
+    
+    IDIterator It_;
+    base_t * pBase_ = nullptr;
+    t * pCur_ = nullptr;
+    
+    inline ElementIterator(IDIterator it, base_t * pbase) : It_(it), pBase_(pbase) { Skip(); }
+    inline void Skip();
+    
+public:
+    ElementIterator() = default;
+    
+    inline bool operator==(const ElementIterator & other) const { return pCur_ == other.pCur_; }
+    inline bool operator!=(const ElementIterator & other) const { return pCur_ != other.pCur_; }
+    
+    inline t & operator*() const { return *pCur_; }
+    inline t * operator->() const { return pCur_; }
+    inline ElementIterator & operator++() { ++It_; Skip(); return *this; }
+    inline ElementIterator operator++(int) { auto ret = *this; ++*this; return ret; }
+};
+
+/// Range of iterators as returned by ItemSet::IDs and ItemSet::Elements, usable in range-based for loops
+template<class iterator>
+class ItemSet::Range
+{
+private:
+    iterator It_;
+    
+public:
+    inline Range(iterator it) : It_(it) {}
+    inline iterator begin() const { return It_; }
+    inline iterator end() const { return iterator(); }
+};
+
 }} //namespace Ladybirds::graph
 
 #include "itemset.inc"
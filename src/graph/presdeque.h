@@ -8,6 +8,8 @@
 #include <iostream>
 #include <utility>
 
+#include "arena.h"
+
 namespace Ladybirds {namespace graph {
 
 template<typename t> class PresDeque;
@@ -95,11 +97,16 @@ template<class container> auto GetRange(container & ctr) { return ContainerRange
 
 /// Helper class that prevents std containers from calling constructors or destructors of their elements.
 /// This class is needed by PresDeque, which has a different construction/destruction scheme and thus handles
-/// construction and destruction "manually".
+/// construction and destruction "manually". The memory itself comes from the active Arena, if any (cf. ArenaAllocator).
 template<typename t>
-class NonXstructiveAllocator : public std::allocator<t>
+class NonXstructiveAllocator : public ArenaAllocator<t>
 {
 public:
+    NonXstructiveAllocator() = default;
+    template<class U> NonXstructiveAllocator(const ArenaAllocator<U> & other) : ArenaAllocator<t>(other) {}
+    
+    NonXstructiveAllocator select_on_container_copy_construction() const { return NonXstructiveAllocator(); }
+    
     template<class... Args> void construct(t*, Args&&...) {} //No construction!
     template<class U, class... Args> void construct( U* p, Args&&... args )
         {::new((void *)p) U(std::forward<Args>(args)...);} //but normal construction of any other object
@@ -107,7 +114,7 @@ public:
     template<class U> void destroy(U* p) {p->~U();} //but normal destruction of any other object
     template<class U> struct rebind
     {//this is necessary because STL uses rebind to get an allocator for type t (again!)
-        using other = std::conditional_t<std::is_same<U, t>::value, NonXstructiveAllocator<t>, std::allocator<U>>;
+        using other = std::conditional_t<std::is_same<U, t>::value, NonXstructiveAllocator<t>, ArenaAllocator<U>>;
     };
 };
 
@@ -134,6 +141,8 @@ private:
     
 public:
     PresDeque() : base() {};
+    /// Constructs an empty list that takes its memory from the same place as a list with allocator \p alloc
+    explicit PresDeque(const typename base::allocator_type & alloc) : base(alloc) {}
     PresDeque(const PresDeque &) = delete; //TODO: implement copy constructor as well as assignment
     PresDeque & operator=(const PresDeque &) = delete;
     PresDeque(PresDeque &&) = default;
@@ -142,11 +151,25 @@ public:
     ~PresDeque() { clear(); }
     
     t & FromID(ID_t id) { auto it = IteratorFromID(id); assert(it->IsAlive()); return *it; }
+    /// Returns the element with the ID \p id, or nullptr if there is no such element (e.g. because it was removed).
+    t * TryFromID(ID_t id)
+        { return const_cast<t*>(static_cast<const PresDeque*>(this)->TryFromID(id)); }
+    const t * TryFromID(ID_t id) const
+    {
+        if(id < MinID_ || id > MaxID_) return nullptr;
+        auto & elem = *IteratorFromID(id);
+        return elem.IsAlive() ? &elem : nullptr;
+    }
         
     inline auto GetMinID() const { return MinID_; }
     inline auto GetMaxID() const { return MaxID_; }
     
     inline auto size() const { return Size_; }
+    /// Returns the number of dead slots between GetMinID() and GetMaxID(), i.e. the holes in the ID range.
+    inline Size_t GetGapCount() const { return base::size() - Size_; }
+    /// Returns the bytes taken by the slots of the list, including the dead ones, but not what the elements allocate
+    /// themselves. The slots are taken from the active arena at construction, if there is one (cf. Arena::Scope).
+    inline std::size_t GetHeapBytes() const { return base::size() * sizeof(t); }
     
     iterator begin() {return iterator(base::begin());}
     const_iterator begin() const {return base::begin();}
@@ -155,6 +178,7 @@ public:
     const_iterator end() const {return base::end();}
     const_iterator cend() const {return base::cend();}
     
+    using base::get_allocator;
     using base::front;
     using base::back;
     using base::empty;
@@ -246,6 +270,18 @@ public:
         return ++it;
     }
     
+    /// Moves all elements to new slots without gaps in between, such that the IDs become dense again.
+    /// Unlike all other operations, this invalidates all pointers to elements of the list. For each element,
+    /// \p relocated(const t & oldelem, t & newelem) is called right after it has been moved, giving the owner a chance
+    /// to update any pointers. \p oldelem must not be accessed after the call (it will be destroyed).
+    template<typename fn_t> void Compact(fn_t relocated)
+    {
+        PresDeque newlist(get_allocator()); //stay in the same arena
+        for(t & elem : *this) relocated(elem, *newlist.emplace(std::move(elem)));
+        clear();
+        *this = std::move(newlist);
+    }
+    
     bool IsValidElement(const PresDequeElementBase * pelem) const
     {
         return pelem->IsAlive() && pelem->GetID() <= GetMaxID() &&
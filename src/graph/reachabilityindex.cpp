@@ -0,0 +1,60 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "reachabilityindex.h"
+
+namespace Ladybirds { namespace graph {
+
+template<typename fn_t>
+bool ReachabilityIndex::ForEachSuccessor(const PresDequeElementBase * from, fn_t fn) const
+{
+    auto & label = Labels_[from];
+    for(auto i = label.FirstEntry; i < label.EndEntry; ++i)
+    {
+        auto & entry = Entries_[i];
+        for(auto j = ChainStarts_[entry.Chain] + entry.MinPos, jend = ChainStarts_[entry.Chain+1]; j < jend; ++j)
+        {
+            if(!fn(ChainNodes_[j])) return false;
+        }
+    }
+    return true;
+}
+
+bool ReachabilityIndex::Reaches(const PresDequeElementBase * from, const PresDequeElementBase * to) const
+{
+    if(Dense_) return Matrix_[from].Contains(to);
+
+    auto & lfrom = Labels_[from], & lto = Labels_[to];
+    auto itbegin = Entries_.begin() + lfrom.FirstEntry, itend = Entries_.begin() + lfrom.EndEntry;
+    auto it = std::lower_bound(itbegin, itend, lto.Chain,
+                               [](const ChainEntry & entry, int chain) { return entry.Chain < chain; });
+    return it != itend && it->Chain == lto.Chain && it->MinPos <= lto.Pos;
+}
+
+std::size_t ReachabilityIndex::SuccessorCount(const PresDequeElementBase * from) const
+{
+    return Dense_ ? Matrix_[from].ElementCount() : Labels_[from].SuccessorCount;
+}
+
+bool ReachabilityIndex::ReachesAll(const PresDequeElementBase * from, const ItemSet & targets) const
+{
+    if(Dense_) return Matrix_[from].Contains(targets);
+
+    std::size_t found = 0;
+    ForEachSuccessor(from, [&](auto * pn) { if(targets.Contains(pn)) ++found; return true; });
+    return found == targets.ElementCount();
+}
+
+bool ReachabilityIndex::ReachesAny(const PresDequeElementBase * from, const ItemSet & targets) const
+{
+    if(Dense_) return Matrix_[from].Intersects(targets);
+
+    return !ForEachSuccessor(from, [&](auto * pn) { return !targets.Contains(pn); });
+}
+
+std::size_t ReachabilityIndex::GetHeapBytes() const
+{
+    return Matrix_.GetHeapBytes([](const ItemSet & row) { return row.GetHeapBytes(); }) + Labels_.GetHeapBytes()
+         + Entries_.GetHeapBytes() + ChainStarts_.capacity() * sizeof(std::size_t) + ChainNodes_.GetHeapBytes();
+}
+
+}} //namespace Ladybirds::graph
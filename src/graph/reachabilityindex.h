@@ -0,0 +1,366 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_GRAPH_REACHABILITYINDEX_H
+#define LADYBIRDS_GRAPH_REACHABILITYINDEX_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "graph-extra.h"
+#include "itemmap.h"
+#include "itemset.h"
+#include "scratcharray.h"
+
+namespace Ladybirds {
+namespace graph {
+
+/** Answers the question whether a node of a graph can be reached from another one (i.e. is a strict successor).
+ *
+ *  There are two representations: The dense one is a reachability matrix as returned by \ref ReachabilityMatrix, and
+ *  takes n² bits. The compressed one is only available for acyclic graphs. It decomposes the graph into chains
+ *  (paths along the edges) and stores for each node the first position it can reach in every chain that it can reach
+ *  at all. The memory consumption is linear in the number of nodes times the average number of chains reachable from
+ *  a node, and a query takes O(log(number of chains)).
+ *
+ *  Both representations can be kept up to date when single edges are inserted or removed (cf. InsertEdge and
+ *  RemoveEdge): Only the entries of the nodes from which the changed edge can be reached are recomputed. Adding or
+ *  removing nodes is not supported; the index must be rebuilt in this case.
+ *
+ *  The entries and chains of the compressed representation are the bulk of its memory and are ScratchArrays, so they
+ *  move out of core in the out-of-core mode (cf. \ref ScratchSpace). They are written in reverse topological order.
+ **/
+class ReachabilityIndex
+{
+public:
+    /// Node count up to which \ref ReachabilityIndex::Build uses the dense representation.
+    static constexpr std::size_t DefaultDenseLimit = 16384;
+
+private:
+    struct ChainEntry
+    {
+        int Chain;
+        int MinPos; ///< First position in the chain that can be reached
+    };
+    struct NodeLabel
+    {
+        int Chain = -1, Pos = 0;
+        std::size_t FirstEntry = 0, EndEntry = 0; ///< Range in Entries_
+        std::size_t SuccessorCount = 0;
+    };
+
+    bool Dense_ = true;
+    ItemMap<ItemSet> Matrix_; ///< Dense representation
+
+    ItemMap<NodeLabel> Labels_; ///< Compressed representation
+    ScratchArray<ChainEntry> Entries_;
+    std::vector<std::size_t> ChainStarts_; ///< Start of each chain in ChainNodes_; contains one extra end element
+    ScratchArray<const PresDequeElementBase*> ChainNodes_;
+    std::size_t DeadEntries_ = 0; ///< Number of entries in Entries_ that are not referenced by any label any more
+
+public:
+    /// Constructs an empty (unusable) index
+    ReachabilityIndex() = default;
+    /// Constructs a dense index from a reachability matrix (cf. \ref ReachabilityMatrix).
+    explicit ReachabilityIndex(ItemMap<ItemSet> && matrix) : Matrix_(std::move(matrix)) {}
+
+    ReachabilityIndex(const ReachabilityIndex &) = default;
+    ReachabilityIndex(ReachabilityIndex &&) = default;
+    ReachabilityIndex & operator=(const ReachabilityIndex &) = default;
+    ReachabilityIndex & operator=(ReachabilityIndex &&) = default;
+
+    /// Builds a compressed index for \p g. If \p g is cyclic, a dense index is built instead.
+    template<class graph_t> static ReachabilityIndex Compressed(const graph_t & g);
+    /// Builds a dense index for graphs with up to \p denselimit nodes, and a compressed one for larger graphs.
+    template<class graph_t>
+    static ReachabilityIndex Build(const graph_t & g, std::size_t denselimit = DefaultDenseLimit)
+        { return g.Nodes().size() <= denselimit ? ReachabilityIndex(ReachabilityMatrix(g)) : Compressed(g); }
+
+    inline bool IsDense() const { return Dense_; }
+    /// Returns the bytes allocated for the index (of either representation), not counting the object itself
+    std::size_t GetHeapBytes() const;
+
+    /// Checks if \p to can be reached from \p from
+    bool Reaches(const PresDequeElementBase * from, const PresDequeElementBase * to) const;
+    /// Returns the number of nodes that can be reached from \p from
+    std::size_t SuccessorCount(const PresDequeElementBase * from) const;
+    /// Checks if all nodes in \p targets can be reached from \p from. \p targets must be a subset of the graph's nodes.
+    bool ReachesAll(const PresDequeElementBase * from, const ItemSet & targets) const;
+    /// Checks if any node in \p targets can be reached from \p from. \p targets must be a subset of the graph's nodes.
+    bool ReachesAny(const PresDequeElementBase * from, const ItemSet & targets) const;
+
+    /// Updates the index after the edge (\p from, \p to) has been inserted into \p g.
+    template<class graph_t> void InsertEdge(const graph_t & g, const typename graph_t::node_t * from,
+                                            const typename graph_t::node_t * to);
+    /// Updates the index after the edge (\p from, \p to) has been removed from \p g.
+    template<class graph_t> void RemoveEdge(const graph_t & g, const typename graph_t::node_t * from,
+                                            const typename graph_t::node_t * to);
+
+private:
+    /// \internal Returns \p pn and all nodes from which it can be reached in \p g, such that each node comes after
+    /// all its successors. Returns an empty list if these nodes are part of a cycle.
+    template<class graph_t> static std::vector<const typename graph_t::node_t *>
+        AncestorsReverseTopological(const graph_t & g, const typename graph_t::node_t * pn);
+    /// \internal Recomputes the compressed label of \p pn from the labels of its successors. \p best must contain
+    /// one element per chain, all being std::numeric_limits<int>::max(), and is left in that state.
+    template<class node_t> void ComputeLabel(const node_t * pn, std::vector<int> & best, std::vector<int> & touched);
+    /// \internal Recomputes the row of \p pn in the dense matrix from the rows of its successors.
+    template<class node_t> void ComputeRow(const node_t * pn);
+    /// \internal Removes unreferenced entries from Entries_ (compressed representation only).
+    template<class graph_t> void CompactEntries(const graph_t & g);
+    
+    /// \internal Calls \p fn for each node reachable from \p from (compressed representation only) until it returns
+    /// false. Returns false if \p fn did so, true otherwise.
+    template<typename fn_t> bool ForEachSuccessor(const PresDequeElementBase * from, fn_t fn) const;
+};
+
+
+template<class graph_t>
+ReachabilityIndex ReachabilityIndex::Compressed(const graph_t & g)
+{
+    using node_t = const typename graph_t::node_t;
+    std::vector<node_t *> order;
+    if(!TopologicalOrder(g, order)) return ReachabilityIndex(ReachabilityMatrix(g));
+
+    ReachabilityIndex ret;
+    ret.Dense_ = false;
+    ret.Labels_ = g.GetNodeMap(NodeLabel());
+    auto & labels = ret.Labels_;
+
+    //greedy chain decomposition: start a new chain at the first unassigned node in topological order, then extend it
+    //along the edges as long as there is an unassigned successor.
+    ret.ChainNodes_.reserve(order.size());
+    for(node_t * pstart : order)
+    {
+        if(labels[pstart].Chain >= 0) continue;
+        int chain = ret.ChainStarts_.size(), pos = 0;
+        ret.ChainStarts_.push_back(ret.ChainNodes_.size());
+
+        for(node_t * pn = pstart; pn; )
+        {
+            labels[pn].Chain = chain, labels[pn].Pos = pos++;
+            ret.ChainNodes_.push_back(pn);
+
+            node_t * pnext = nullptr;
+            for(auto & e : pn->OutEdges())
+            {
+                if(labels[e.GetTarget()].Chain < 0) { pnext = e.GetTarget(); break; }
+            }
+            pn = pnext;
+        }
+    }
+    int nchains = ret.ChainStarts_.size();
+    ret.ChainStarts_.push_back(ret.ChainNodes_.size());
+
+    //in reverse topological order, merge the entries of all successors, keeping the minimum position for each chain
+    std::vector<int> best(nchains, std::numeric_limits<int>::max()), touched;
+    for(auto it = order.rbegin(), itend = order.rend(); it != itend; ++it) ret.ComputeLabel(*it, best, touched);
+    
+    ret.Entries_.shrink_to_fit();
+    return ret;
+}
+
+template<class node_t>
+void ReachabilityIndex::ComputeLabel(const node_t * pn, std::vector<int> & best, std::vector<int> & touched)
+{
+    assert(touched.empty());
+    auto update = [&best, &touched](int chain, int pos)
+    {
+        if(best[chain] == std::numeric_limits<int>::max()) touched.push_back(chain);
+        if(pos < best[chain]) best[chain] = pos;
+    };
+
+    for(auto & e : pn->OutEdges())
+    {
+        auto & lsucc = Labels_[e.GetTarget()];
+        update(lsucc.Chain, lsucc.Pos);
+        for(auto i = lsucc.FirstEntry; i < lsucc.EndEntry; ++i) update(Entries_[i].Chain, Entries_[i].MinPos);
+    }
+
+    std::sort(touched.begin(), touched.end());
+    auto & label = Labels_[pn];
+    DeadEntries_ += label.EndEntry - label.FirstEntry;
+    label.FirstEntry = Entries_.size();
+    label.SuccessorCount = 0;
+    for(int chain : touched)
+    {
+        Entries_.push_back({chain, best[chain]});
+        label.SuccessorCount += ChainStarts_[chain+1] - ChainStarts_[chain] - best[chain];
+        best[chain] = std::numeric_limits<int>::max();
+    }
+    label.EndEntry = Entries_.size();
+    touched.clear();
+}
+
+template<class node_t>
+void ReachabilityIndex::ComputeRow(const node_t * pn)
+{
+    auto & row = Matrix_[pn];
+    row.RemoveAll();
+    for(auto & e : pn->OutEdges())
+    {
+        row.Insert(e.GetTarget());
+        row |= Matrix_[e.GetTarget()];
+    }
+}
+
+template<class graph_t>
+void ReachabilityIndex::CompactEntries(const graph_t & g)
+{
+    ScratchArray<ChainEntry> entries;
+    entries.reserve(Entries_.size() - DeadEntries_);
+    for(auto & n : g.Nodes())
+    {
+        auto & label = Labels_[n];
+        auto first = entries.size();
+        entries.append(Entries_.begin() + label.FirstEntry, Entries_.begin() + label.EndEntry);
+        label.FirstEntry = first, label.EndEntry = entries.size();
+    }
+    Entries_ = std::move(entries);
+    DeadEntries_ = 0;
+}
+
+template<class graph_t>
+std::vector<const typename graph_t::node_t *>
+ReachabilityIndex::AncestorsReverseTopological(const graph_t & g, const typename graph_t::node_t * pn)
+{
+    using node_t = const typename graph_t::node_t;
+    
+    //collect the ancestors by a backward search, counting for each of them the out-edges within the ancestor set
+    std::vector<node_t *> ancestors{pn}, ret;
+    auto found = g.GetNodeSet();
+    found.Insert(pn);
+    for(std::size_t i = 0; i < ancestors.size(); ++i)
+    {
+        for(auto & e : ancestors[i]->InEdges())
+        {
+            if(found.Contains(e.GetSource())) continue;
+            found.Insert(e.GetSource());
+            ancestors.push_back(e.GetSource());
+        }
+    }
+    auto outcounts = g.GetNodeMap(0);
+    for(auto * pa : ancestors)
+    {
+        for(auto & e : pa->InEdges()) ++outcounts[e.GetSource()];
+    }
+    
+    //now sort them such that successors come first (Kahn's algorithm in reverse direction)
+    ret.reserve(ancestors.size());
+    for(auto * pa : ancestors)
+    {
+        if(outcounts[pa] == 0) ret.push_back(pa);
+    }
+    for(std::size_t i = 0; i < ret.size(); ++i)
+    {
+        for(auto & e : ret[i]->InEdges())
+        {
+            if(--outcounts[e.GetSource()] == 0) ret.push_back(e.GetSource());
+        }
+    }
+    if(ret.size() != ancestors.size()) ret.clear();
+    return ret;
+}
+
+template<class graph_t>
+void ReachabilityIndex::InsertEdge(const graph_t & g, const typename graph_t::node_t * from,
+                                   const typename graph_t::node_t * to)
+{
+    if(Dense_)
+    {
+        //Every node that could reach 'from' before can now reach 'to' and everything 'to' could reach before
+        auto added = Matrix_[to];
+        added.Insert(to);
+        for(auto & n : g.Nodes())
+        {
+            if(&n == from || Matrix_[n].Contains(from)) Matrix_[n] |= added;
+        }
+        return;
+    }
+
+    //for the compressed representation, the graph must stay acyclic
+    if(from == to || Reaches(to, from))
+    {
+        *this = ReachabilityIndex(ReachabilityMatrix(g));
+        return;
+    }
+    if(Reaches(from, to)) return; //nothing changes
+    
+    std::vector<int> best(ChainStarts_.size() - 1, std::numeric_limits<int>::max()), touched;
+    for(auto * pn : AncestorsReverseTopological(g, from)) ComputeLabel(pn, best, touched);
+    if(DeadEntries_ > Entries_.size() / 2) CompactEntries(g);
+}
+
+template<class graph_t>
+void ReachabilityIndex::RemoveEdge(const graph_t & g, const typename graph_t::node_t * from,
+                                   const typename graph_t::node_t * to)
+{
+    auto affected = AncestorsReverseTopological(g, from);
+    if(affected.empty()) //cyclic graph; only the dense representation is possible, and we need to start over
+    {
+        assert(Dense_);
+        Matrix_ = ReachabilityMatrix(g);
+        return;
+    }
+    
+    if(Dense_)
+    {
+        for(auto * pn : affected) ComputeRow(pn);
+        return;
+    }
+    
+    //if the edge was part of a chain, and is not doubled, the chain decomposition is broken
+    auto & lfrom = Labels_[from], & lto = Labels_[to];
+    if(lfrom.Chain == lto.Chain && lfrom.Pos + 1 == lto.Pos)
+    {
+        bool doubled = false;
+        for(auto & e : from->OutEdges()) doubled |= (e.GetTarget() == to);
+        if(!doubled)
+        {
+            *this = Compressed(g);
+            return;
+        }
+    }
+    
+    std::vector<int> best(ChainStarts_.size() - 1, std::numeric_limits<int>::max()), touched;
+    for(auto * pn : affected) ComputeLabel(pn, best, touched);
+    if(DeadEntries_ > Entries_.size() / 2) CompactEntries(g);
+}
+
+/// Removes all edges from \p g which are not necessary for keeping the connectivity (cf. \ref PruneEdges), using the
+/// precomputed index \p reach of \p g instead of calculating a dense reachability matrix. \p g must be acyclic.
+template<class graph_t>
+void PruneEdges(graph_t & g, const ReachabilityIndex & reach)
+{
+    std::vector<const typename graph_t::node_t *> targets;
+    for(auto & n : g.Nodes())
+    {
+        targets.clear();
+        for(auto & e : n.OutEdges()) targets.push_back(e.GetTarget());
+
+        for(auto it = n.OutEdgesBegin(), itend = n.OutEdgesEnd(); it != itend; )
+        {
+            auto & edge = *(it++);
+            auto * tgt = edge.GetTarget();
+
+            //the edge is redundant if its target can be reached through another successor or if it is a duplicate
+            bool redundant = false, seen = false;
+            for(auto * pother : targets)
+            {
+                if(pother == tgt) redundant = seen, seen = true;
+                else redundant = reach.Reaches(pother, tgt);
+                if(redundant) break;
+            }
+
+            if(redundant)
+            {
+                targets.erase(std::find(targets.begin(), targets.end(), tgt));
+                g.RemoveEdge(&edge);
+            }
+        }
+    }
+}
+
+}} //namespace Ladybirds::graph
+
+#endif // LADYBIRDS_GRAPH_REACHABILITYINDEX_H
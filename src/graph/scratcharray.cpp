@@ -0,0 +1,170 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "scratcharray.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#if CFG_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Ladybirds { namespace graph {
+
+namespace {
+std::string gDir;
+std::size_t gBudget = 0;
+std::atomic<std::size_t> gBytesInMemory{0}, gBytesMapped{0};
+}
+
+bool ScratchSpace::Configure(const std::string & dir, std::size_t budget)
+{
+    if(!dir.empty())
+    {
+#if CFG_HAVE_MMAP
+        struct stat st;
+        if(stat(dir.c_str(), &st) != 0) return false;
+        if(!S_ISDIR(st.st_mode)) { errno = ENOTDIR; return false; }
+#else
+        errno = ENOSYS;
+        return false;
+#endif
+    }
+    gDir = dir;
+    gBudget = budget;
+    return true;
+}
+
+const std::string & ScratchSpace::GetDir() { return gDir; }
+std::size_t ScratchSpace::GetBudget() { return gBudget; }
+std::size_t ScratchSpace::GetBytesInMemory() { return gBytesInMemory.load(std::memory_order_relaxed); }
+std::size_t ScratchSpace::GetBytesMapped() { return gBytesMapped.load(std::memory_order_relaxed); }
+
+
+void ScratchStorage::Reserve(std::size_t bytes)
+{
+    if(bytes <= Capacity_) return;
+    std::size_t capacity = std::max({bytes, 2*Capacity_, std::size_t(64)});
+
+#if CFG_HAVE_MMAP
+    if(IsMapped())
+    {
+        // the contents stay in the file, only the mapping is replaced
+        void * p = MAP_FAILED;
+        if(ftruncate(File_, capacity) == 0)
+        {
+            munmap(pData_, Capacity_);
+            p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, File_, 0);
+        }
+        if(p == MAP_FAILED) throw std::bad_alloc();
+        gBytesMapped += capacity - Capacity_;
+        pData_ = static_cast<char *>(p);
+        Capacity_ = capacity;
+        return;
+    }
+
+    if(!gDir.empty() && gBytesInMemory.load(std::memory_order_relaxed) - Capacity_ + capacity > gBudget)
+    {
+        // move out of core; if that fails, stay in memory and let the kernel decide
+        std::vector<char> path(gDir.begin(), gDir.end());
+        const char name[] = "/ladybirds-XXXXXX";
+        path.insert(path.end(), name, name + sizeof(name));
+        int file = mkstemp(path.data());
+        if(file >= 0)
+        {
+            unlink(path.data()); // the file lives as long as it is open
+            void * p = MAP_FAILED;
+            if(ftruncate(file, capacity) == 0)
+            {
+                p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+            }
+            if(p != MAP_FAILED)
+            {
+                if(Size_ > 0) std::memcpy(p, pData_, Size_);
+                std::free(pData_);
+                gBytesInMemory -= Capacity_;
+                gBytesMapped += capacity;
+                pData_ = static_cast<char *>(p);
+                Capacity_ = capacity;
+                File_ = file;
+                return;
+            }
+            close(file);
+        }
+    }
+#endif
+
+    void * p = std::realloc(pData_, capacity);
+    if(!p) throw std::bad_alloc();
+    gBytesInMemory += capacity - Capacity_;
+    pData_ = static_cast<char *>(p);
+    Capacity_ = capacity;
+}
+
+void ScratchStorage::Append(const void * p, std::size_t bytes)
+{
+    if(bytes == 0) return;
+    std::memcpy(Grow(bytes), p, bytes);
+}
+
+char * ScratchStorage::Grow(std::size_t bytes)
+{
+    if(Size_ + bytes > Capacity_) Reserve(Size_ + bytes);
+    char * ret = pData_ + Size_;
+    Size_ += bytes;
+    return ret;
+}
+
+void ScratchStorage::ShrinkToFit()
+{
+    if(IsMapped() || Size_ == Capacity_) return;
+    if(Size_ == 0)
+    {
+        Release();
+        return;
+    }
+    if(void * p = std::realloc(pData_, Size_))
+    {
+        gBytesInMemory -= Capacity_ - Size_;
+        pData_ = static_cast<char *>(p);
+        Capacity_ = Size_;
+    }
+}
+
+void ScratchStorage::Swap(ScratchStorage & other) noexcept
+{
+    std::swap(pData_, other.pData_);
+    std::swap(Size_, other.Size_);
+    std::swap(Capacity_, other.Capacity_);
+    std::swap(File_, other.File_);
+}
+
+void ScratchStorage::Release()
+{
+#if CFG_HAVE_MMAP
+    if(IsMapped())
+    {
+        munmap(pData_, Capacity_);
+        close(File_);
+        gBytesMapped -= Capacity_;
+    }
+    else
+#endif
+    {
+        std::free(pData_);
+        gBytesInMemory -= Capacity_;
+    }
+    pData_ = nullptr;
+    Size_ = Capacity_ = 0;
+    File_ = -1;
+}
+
+}} //namespace Ladybirds::graph
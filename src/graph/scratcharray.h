@@ -0,0 +1,112 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef GRAPH_SCRATCHARRAY_H
+#define GRAPH_SCRATCHARRAY_H
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+
+namespace Ladybirds { namespace graph {
+
+//! Settings of the out-of-core mode, shared by all ScratchArray objects of the process.
+/** Without a scratch directory (the default), all arrays stay in memory. With one, the arrays are kept in memory as
+ ** long as all of them together take at most the budget; an array that would exceed it moves to a memory-mapped file
+ ** in the directory. The pages of such a file are written back and dropped by the kernel under memory pressure, so
+ ** the resident memory of the spilled arrays is bounded by what is being accessed rather than by their size. The files
+ ** are unlinked right after creation, so nothing is left behind, even if the process is killed. **/
+class ScratchSpace
+{
+public:
+    //! Enables the out-of-core mode with files in \p dir (empty: disabled) and \p budget bytes for the arrays kept in
+    //! memory. Returns false (with errno set) if the mode is not available on this platform or \p dir is unusable.
+    static bool Configure(const std::string & dir, std::size_t budget);
+
+    static const std::string & GetDir();
+    static std::size_t GetBudget();
+    //! Returns the bytes of all arrays kept in memory
+    static std::size_t GetBytesInMemory();
+    //! Returns the bytes of all scratch files
+    static std::size_t GetBytesMapped();
+};
+
+//! \internal Untyped storage of ScratchArray
+class ScratchStorage
+{
+    char * pData_ = nullptr;
+    std::size_t Size_ = 0, Capacity_ = 0; // in bytes
+    int File_ = -1; // descriptor of the scratch file, -1 if the storage is in memory
+
+public:
+    ScratchStorage() = default;
+    ScratchStorage(const ScratchStorage & other) { Append(other.pData_, other.Size_); }
+    ScratchStorage(ScratchStorage && other) noexcept { Swap(other); }
+    ScratchStorage & operator=(ScratchStorage other) noexcept { Swap(other); return *this; }
+    ~ScratchStorage() { Release(); }
+
+    inline char * GetData() const { return pData_; }
+    inline std::size_t GetSize() const { return Size_; }
+    inline std::size_t GetCapacity() const { return Capacity_; }
+    inline bool IsMapped() const { return File_ >= 0; }
+
+    //! Makes room for at least \p bytes in total, moving the storage into a scratch file if it exceeds the budget.
+    //! Throws std::bad_alloc if neither memory nor the scratch file can hold them.
+    void Reserve(std::size_t bytes);
+    //! Appends \p bytes bytes from \p p, which must not point into this storage
+    void Append(const void * p, std::size_t bytes);
+    //! Appends \p bytes uninitialized bytes and returns a pointer to them
+    char * Grow(std::size_t bytes);
+    void Clear() { Size_ = 0; }
+    //! Gives back the unused capacity if the storage is in memory
+    void ShrinkToFit();
+    void Swap(ScratchStorage & other) noexcept;
+
+private:
+    void Release();
+};
+
+//! An append-only array of trivially copyable elements which moves out of core when memory runs short.
+/** Behaves like a std::vector that can only grow at its end, but keeps its elements in a memory-mapped scratch file
+ ** instead of the heap once the arrays together exceed the budget of the out-of-core mode (cf. ScratchSpace). Such an
+ ** array is best filled and read in order, e.g. in topological order of a graph. Pointers and iterators into the array
+ ** are invalidated whenever it grows, just as for a vector. **/
+template<typename t>
+class ScratchArray
+{
+    static_assert(std::is_trivially_copyable<t>::value, "ScratchArray elements are copied bytewise");
+    ScratchStorage Storage_;
+
+public:
+    using value_type = t;
+    using iterator = t *;
+    using const_iterator = const t *;
+
+    inline std::size_t size() const { return Storage_.GetSize() / sizeof(t); }
+    inline std::size_t capacity() const { return Storage_.GetCapacity() / sizeof(t); }
+    inline bool empty() const { return Storage_.GetSize() == 0; }
+
+    inline t * data() { return reinterpret_cast<t *>(Storage_.GetData()); }
+    inline const t * data() const { return reinterpret_cast<const t *>(Storage_.GetData()); }
+    inline t * begin() { return data(); }
+    inline t * end() { return data() + size(); }
+    inline const t * begin() const { return data(); }
+    inline const t * end() const { return data() + size(); }
+    inline t & operator[](std::size_t i) { return data()[i]; }
+    inline const t & operator[](std::size_t i) const { return data()[i]; }
+
+    inline void push_back(const t & elem) { new(Storage_.Grow(sizeof(t))) t(elem); }
+    //! Appends the elements [\p first, \p last) of another array
+    inline void append(const t * first, const t * last) { Storage_.Append(first, (last - first) * sizeof(t)); }
+    inline void reserve(std::size_t n) { Storage_.Reserve(n * sizeof(t)); }
+    inline void clear() { Storage_.Clear(); }
+    inline void shrink_to_fit() { Storage_.ShrinkToFit(); }
+
+    //! Returns whether the elements are in a scratch file
+    inline bool IsMapped() const { return Storage_.IsMapped(); }
+    //! Returns the bytes allocated on the heap, i.e. 0 if the elements are in a scratch file
+    inline std::size_t GetHeapBytes() const { return IsMapped() ? 0 : Storage_.GetCapacity(); }
+};
+
+}} //namespace Ladybirds::graph
+
+#endif // GRAPH_SCRATCHARRAY_H
@@ -0,0 +1,87 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef INTERNED_H
+#define INTERNED_H
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace Ladybirds {
+
+//! Hash of a vector of hashable elements (e.g. dimensions), for interning vectors
+struct VectorHash
+{
+    template<typename t> std::size_t operator()(const std::vector<t> & vec) const
+    {
+        std::size_t ret = vec.size();
+        for(auto & elem : vec) ret ^= std::hash<t>()(elem) + 0x9e3779b9 + (ret << 6) + (ret >> 2);
+        return ret;
+    }
+};
+
+//! An immutable value of type \p t, of which each distinct value is stored only once (hash-consing).
+/** The values are kept in a table per type that all objects share, and an Interned is just a pointer to its entry, so
+ ** copying one or comparing two takes constant time, however large the value. This suits values that are equal for
+ ** many objects, such as the dimensions of the interfaces of all instances of a kernel. Entries are never removed
+ ** (they live until the end of the process), and creating an Interned from a value takes a lookup under a mutex, so
+ ** it is safe from several threads. The table does not belong to any program; cf. GetTableBytes. **/
+template<typename t, typename hash_t = std::hash<t>>
+class Interned
+{
+    const t * pValue_;
+
+    struct Table
+    {
+        std::mutex Mutex;
+        std::unordered_set<t, hash_t> Values;
+    };
+    static Table & GetTable() { static Table table; return table; }
+
+    static const t * Intern(t && value)
+    {
+        auto & table = GetTable();
+        std::lock_guard<std::mutex> lock(table.Mutex);
+        return &*table.Values.insert(std::move(value)).first;
+    }
+    static const t * Empty() { static const t * pempty = Intern(t()); return pempty; }
+
+public:
+    inline Interned() : pValue_(Empty()) {} ///< The default-constructed value
+    inline Interned(t value) : pValue_(Intern(std::move(value))) {}
+
+    inline const t & operator*() const { return *pValue_; }
+    inline const t * operator->() const { return pValue_; }
+    inline operator const t &() const { return *pValue_; }
+
+    //! Compares the entries, which is the same as comparing the values
+    inline bool operator==(const Interned & other) const { return pValue_ == other.pValue_; }
+    inline bool operator!=(const Interned & other) const { return pValue_ != other.pValue_; }
+
+    //! Returns the number of distinct values of the type so far
+    static std::size_t GetTableSize()
+    {
+        auto & table = GetTable();
+        std::lock_guard<std::mutex> lock(table.Mutex);
+        return table.Values.size();
+    }
+    //! Returns the bytes taken by the table of the type, with \p valbytes(value) for what each value allocates
+    template<typename fn_t> static std::size_t GetTableBytes(fn_t valbytes)
+    {
+        auto & table = GetTable();
+        std::lock_guard<std::mutex> lock(table.Mutex);
+        std::size_t ret = table.Values.bucket_count() * sizeof(void*)
+                        + table.Values.size() * (sizeof(t) + 2*sizeof(void*));
+        for(auto & value : table.Values) ret += valbytes(value);
+        return ret;
+    }
+};
+
+//! Interned vector of dimensions, as used for the interfaces of the tasks (cf. spec::Iface)
+using InternedDimVec = Interned<std::vector<int>, VectorHash>;
+
+} //namespace Ladybirds
+
+#endif // INTERNED_H
@@ -1,12 +1,15 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
 #include "kernel.h"
+#include <algorithm>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace Ladybirds { namespace spec {
 
+constexpr int WorkEstimate::Unknown;
+
 Kernel::Kernel(const Kernel& other)
  : Name(other.Name), FunctionName(other.FunctionName), CodeFile(other.CodeFile), SourceCode(other.SourceCode),
    Packets(other.Packets)
@@ -27,14 +30,66 @@ Kernel::Kernel(const Kernel& other)
 }
 
 
+bool WorkEstimate::Loop::LoadStoreMembers(loadstore::LoadStore & ls)
+{
+    return ls.IO("begin", Begin.Value)
+         & ls.IO("beginderived", Begin.Derived, false, -1, -1)
+         & ls.IO("end", End.Value)
+         & ls.IO("endderived", End.Derived, false, -1, -1)
+         & ls.IO("step", Step)
+         & ls.IO("inclusive", Inclusive)
+         & ls.IO("parent", Parent, false, -1, -1)
+         & ls.IO("ops", Ops, true, 0, 0)
+         & ls.IO("reads", Reads, true, 0)
+         & ls.IO("writes", Writes, true, 0)
+         & ls.IO("whole", Whole, true, 0);
+}
+
+
 bool Kernel::LoadStoreMembers(loadstore::LoadStore& ls)
 {
-    return ls.IO("name", Name)
+    // the buddies of each packet, by their indices in Packets
+    std::vector<std::vector<int>> buddies;
+    if(ls.IsStoring())
+    {
+        buddies.resize(Packets.size());
+        for(size_t i = 0; i < Packets.size(); ++i)
+        {
+            for(auto *pbuddy : Packets[i].Buddies_)
+            {
+                if(pbuddy >= Packets.data() && pbuddy < Packets.data() + Packets.size())
+                    buddies[i].push_back(pbuddy - Packets.data());
+            }
+            std::sort(buddies[i].begin(), buddies[i].end());
+        }
+    }
+    
+    bool ret = ls.IO("name", Name)
          & ls.IO("func", FunctionName, false, Name)
          & ls.IO("codefile", CodeFile, false, Name + ".c")
          & ls.IO("source", SourceCode, false)
          & ls.IO_Register("packets", Packets)
-         & ls.IO("parameters", Params);
+         & ls.IO("parameters", Params)
+         & ls.IO("derivedparams", DerivedParams, false)
+         & ls.IO("work", Work.Loops, false)
+         & ls.IO("buddies", buddies, false);
+    if(ls.IsStoring()) return ret;
+    
+    for(auto & packet : Packets) packet.Kernel_ = this;
+    for(auto & param : Params) param.Kernel_ = this;
+    for(size_t i = 0; i < buddies.size() && i < Packets.size(); ++i)
+    {
+        for(int buddy : buddies[i])
+        {
+            if(buddy < 0 || buddy >= (int) Packets.size())
+            {
+                ls.Error("Invalid buddy of packet %s", Packets[i].GetName().c_str());
+                ret = false;
+            }
+            else Packets[i].Buddies_.insert(&Packets[buddy]);
+        }
+    }
+    return ret;
 }
 
 Packet* Kernel::PacketByName(const std::string& name)
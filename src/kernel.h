@@ -3,6 +3,7 @@
 #ifndef KERNEL_H
 #define KERNEL_H
 
+#include <climits>
 #include <string>
 #include <vector>
 
@@ -11,6 +12,31 @@
 
 namespace Ladybirds { namespace spec {
 
+//! Static estimate of the work of a kernel, from the loops and statements in its body (cf. pass EstimateCosts)
+struct WorkEstimate
+{
+    //! Value of a derived parameter that could not be evaluated for a call
+    static constexpr int Unknown = INT_MIN;
+    
+    //! A loop bound: the constant Value, or the derived parameter with index Derived (if it is not negative)
+    struct Bound { int Value = 0, Derived = -1; };
+    //! A loop, together with the operations and packet accesses of the statements directly in its body
+    struct Loop : public loadstore::LoadStorableCompound
+    {
+        Bound Begin, End;       //!< The loop variable runs from Begin to End (inclusive if Inclusive) ...
+        int Step = 0;           //!< ... in steps of Step. 0: the number of iterations is unknown and taken as one
+        bool Inclusive = false;
+        int Parent = -1;        //!< Index of the enclosing loop (-1 for the kernel body)
+        double Ops = 0;         //!< Number of arithmetic and logic operations, function calls etc.
+        std::vector<double> Reads, Writes; //!< Number of element accesses to each packet
+        std::vector<double> Whole; //!< Number of times each packet is passed to a function (and thus fully accessed)
+        
+        virtual bool LoadStoreMembers(loadstore::LoadStore & ls) override;
+    };
+    //! The loops, each after the one enclosing it. The first entry stands for the kernel body.
+    std::vector<Loop> Loops;
+};
+
 //!Class for representing a kernel (i.e. a function with a certain amount of work)
 class Kernel : public loadstore::Referenceable
 {
@@ -38,6 +64,8 @@ public:
     std::vector<Packet> Params;
     //! The formulae for the derived parameters (i.e. numbers that can be calculated from the parameters) of the kernel
     std::vector<std::string> DerivedParams;
+    //! Estimate of the work done by the kernel, if it was possible to derive one from its body
+    WorkEstimate Work;
     
     //! Is this kernel object actually a meta-kernel?
     virtual bool IsMetaKernel() const { return false; }
@@ -75,7 +75,7 @@ public:
     };
     
 public:
-    void *UserContext; ///< Free for the user to store any context useful during storing or loading.
+    void *UserContext = nullptr; ///< Free for the user to store any context useful during storing or loading.
     
 protected:
     enum OperationType{Store, Load};
@@ -279,12 +279,18 @@ public:
         bool IO(const char * name, Table<std::vector<T>> & vec, bool required = true);
     //!@}
         
-    template<typename T, typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type* = nullptr>
-        bool IO_Register(const char * name, std::vector<T>& vec, bool required = true);
+    template<typename T, typename alloc_t,
+             typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type* = nullptr>
+        bool IO_Register(const char * name, std::vector<T, alloc_t>& vec, bool required = true);
     template<typename T, typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type* = nullptr>
         bool IO_Register(const char * name, std::vector<std::unique_ptr<T>>& vec, bool required = true);
     template<typename T, typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type* = nullptr>
         bool IO_Register(const char * name, graph::ContainerRange<graph::PresDeque<T>> vec, bool required = true);
+    //! Like IO_Register, but when loading, the elements are read into the existing ones of \p vec, which must already
+    //! have the stored size (for objects that cannot be created on their own, like the interfaces of a task).
+    template<typename T, typename alloc_t,
+             typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type* = nullptr>
+        bool IO_RegisterInPlace(const char * name, std::vector<T, alloc_t>& vec, bool required = true);
     template<typename T, typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type* = nullptr>
         bool IORef(const char* name, std::vector<T*>& vec, bool required = true);
     template<typename T, typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type* = nullptr>
@@ -299,8 +305,8 @@ private:
     //! \internal Helper function template for reading/writing arrays.
     //! Only declared as a private member in order to make it inaccessible to outside
     template<typename T, typename param_t, 
-             bool (LoadStore::*loadfun)(param_t), bool (LoadStore::*storefun)(param_t)=loadfun>
-    bool IoHelper(const char * name, std::vector<T>& vec, bool required);
+             bool (LoadStore::*loadfun)(param_t), bool (LoadStore::*storefun)(param_t)=loadfun, typename alloc_t>
+    bool IoHelper(const char * name, std::vector<T, alloc_t>& vec, bool required);
     //! \internal Helper function template for reading/writing tables.
     //! Only declared as a private member in order to make it inaccessible to outside
     template<typename T, typename param_t, 
@@ -311,8 +317,15 @@ private:
     inline bool VecBoolStore(std::vector<bool>::reference ref) { bool b = ref; return RawIO(b); }
     inline bool RawIO(bool && var) { assert(IsStoring()); return RawIO(var); }
     //! \internal Helper such that the array template for vector<unique_ptr<LoadStorableCompound>> fits as well
-    template<typename T> inline bool RawUPIO(std::unique_ptr<T> & var) {return RawIO(*var); }
-    template<typename T> inline bool RawUPIOReg(std::unique_ptr<T> & var) {return RawIO_Register(*var); }
+    template<typename T> inline bool RawUPIO(std::unique_ptr<T> & var) {return RawIO(*Materialize(var)); }
+    template<typename T> inline bool RawUPIOReg(std::unique_ptr<T> & var) {return RawIO_Register(*Materialize(var)); }
+    //! \internal When loading, creates the object of an empty unique_ptr (if its type can be default-constructed)
+    template<typename T> static inline T * Materialize(std::unique_ptr<T> & var)
+        { return Materialize(var, std::is_default_constructible<T>()); }
+    template<typename T> static inline T * Materialize(std::unique_ptr<T> & var, std::true_type)
+        { if(!var) var = std::make_unique<T>(); return var.get(); }
+    template<typename T> static inline T * Materialize(std::unique_ptr<T> & var, std::false_type)
+        { assert(var && "loading not supported"); return var.get(); }
     template<typename T> inline bool AnonymousIO(T & var) { return IO(nullptr, var); }
     template<typename T> inline bool RawHandleIO(T *&ref) { return RawIOHandle(ref, UserContext); }
 };
@@ -394,8 +407,9 @@ const char * EnumStringInterface<enumtype, typecheck>::Get() const
 
 
     
-template<typename T, typename param_t, bool (LoadStore::*loadfun)(param_t), bool (LoadStore::*storefun)(param_t)>
-bool LoadStore::IoHelper(const char * name, std::vector<T>& vec, bool required)
+template<typename T, typename param_t, bool (LoadStore::*loadfun)(param_t), bool (LoadStore::*storefun)(param_t),
+         typename alloc_t>
+bool LoadStore::IoHelper(const char * name, std::vector<T, alloc_t>& vec, bool required)
 {
     if(name && !PrepareNamedVar(name, required)) return !required;
     
@@ -483,8 +497,8 @@ inline bool LoadStore::IO(const char * name, std::vector<std::vector<T>> & vec,
 }
 
 
-template<typename T, typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type*>
-inline bool LoadStore::IO_Register(const char * name, std::vector<T>& vec, bool required/* = true*/)
+template<typename T, typename alloc_t, typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type*>
+inline bool LoadStore::IO_Register(const char * name, std::vector<T, alloc_t>& vec, bool required/* = true*/)
 {
     return IoHelper<T, Referenceable&, &LoadStore::RawIO_Register>(name, vec, required);
 }
@@ -513,6 +527,32 @@ inline bool LoadStore::IO_Register(const char * name, graph::ContainerRange<grap
     return FlushNamedVar(name, true) && ret;
 }
 
+template<typename T, typename alloc_t, typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type*>
+bool LoadStore::IO_RegisterInPlace(const char * name, std::vector<T, alloc_t>& vec, bool required/* = true*/)
+{
+    if(name && !PrepareNamedVar(name, required)) return !required;
+    
+    auto iter = vec.begin();
+    auto callback = [&iter, &vec](LoadStore & ls)
+    {
+        if(iter == vec.end())
+        {
+            ls.Error("More elements than expected (%d)", (int) vec.size());
+            return false;
+        }
+        return ls.RawIO_Register(*iter++);
+    };
+    
+    bool ret = RawArrayIO(vec.size(), callback);
+    if(ret && iter != vec.end())
+    {
+        Error("Fewer elements than expected (%d)", (int) vec.size());
+        ret = false;
+    }
+    if(!ret) Error("while processing element %s", name);
+    return FlushNamedVar(name, true) && ret;
+}
+
 template<typename T, typename std::enable_if<std::is_base_of<Referenceable, T>::value>::type*>
 bool LoadStore::IORef(const char* name, std::vector< T* >& vec, bool required)
 {
@@ -17,8 +17,10 @@ class LuaDump : public loadstore::LoadStore
     using Referenceable = loadstore::Referenceable;
     enum HandleType { Handle = 0, Managed, LuaMem };
     
-private:
+protected:
     lua_State * Lua_;
+    
+private:
     int NumErrors_ = 0;
     int ErrorIndex_ = 0;
     std::unordered_map<void*, const char*> TempObjects_;
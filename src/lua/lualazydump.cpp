@@ -0,0 +1,150 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "lualazydump.h"
+
+#include "luaenv.h"
+
+namespace Ladybirds { namespace lua {
+
+// Besides the events, the metatable maps each table of the dump to its object (as light userdata) while the table is
+// still to be filled, and to true afterwards. It also holds the owner and the revision counter at the time of the dump.
+
+LuaLazyDump::LuaLazyDump(lua_State * lua, int owner, const unsigned * revision) : LuaDump(lua)
+{
+    owner = lua_absindex(lua, owner);
+
+    constexpr luaL_Reg events[] =
+    {
+        { "__index",    &IndexEvent    },
+        { "__newindex", &NewIndexEvent },
+        { "__pairs",    &PairsEvent    },
+        { nullptr,      nullptr        }
+    };
+    lua_createtable(lua, 0, 6);
+    Meta_ = lua_gettop(lua);
+    luaL_setfuncs(lua, events, 0);
+
+    lua_pushvalue(lua, owner);
+    lua_setfield(lua, Meta_, "owner");
+    lua_pushlightuserdata(lua, const_cast<unsigned*>(revision));
+    lua_setfield(lua, Meta_, "revision");
+    lua_pushinteger(lua, *revision);
+    lua_setfield(lua, Meta_, "counter");
+}
+
+bool LuaLazyDump::RawIORef(loadstore::Referenceable *& ref, const char * type, bool required)
+{
+    if(!ref)
+    {
+        lua_pushnil(Lua_); //for the "FlushNamedVar" function later on
+        if(!required) return true;
+
+        Error("Tried to reference null pointer.");
+        return false;
+    }
+
+    PushTable(*ref);
+    return true;
+}
+
+bool LuaLazyDump::RawIO_Register(loadstore::Referenceable & obj)
+{
+    PushTable(obj);
+    return true;
+}
+
+void LuaLazyDump::PushTable(loadstore::Referenceable & obj)
+{
+    //like LuaDump, keep one table per object in the registry, such that all references to it give the same table
+    lua_pushlightuserdata(Lua_, &obj);
+    if(lua_rawget(Lua_, LUA_REGISTRYINDEX) == LUA_TNIL)
+    {
+        lua_pop(Lua_, 1);
+        lua_newtable(Lua_);
+        lua_pushlightuserdata(Lua_, &obj);
+        lua_pushvalue(Lua_, -2);
+        lua_rawset(Lua_, LUA_REGISTRYINDEX);
+    }
+
+    //unless the table is already known to this dump (filled or to be filled), it is to be filled on first use
+    lua_pushvalue(Lua_, -1);
+    if(lua_rawget(Lua_, Meta_) != LUA_TNIL)
+    {
+        lua_pop(Lua_, 1);
+        return;
+    }
+    lua_pop(Lua_, 1);
+    lua_pushvalue(Lua_, -1);
+    lua_pushlightuserdata(Lua_, &obj);
+    lua_rawset(Lua_, Meta_);
+    lua_pushvalue(Lua_, Meta_);
+    lua_setmetatable(Lua_, -2);
+}
+
+void LuaLazyDump::Fill(lua_State * lua, int index)
+{
+    index = lua_absindex(lua, index);
+    if(!lua_getmetatable(lua, index)) return;
+    int meta = lua_gettop(lua);
+
+    lua_pushvalue(lua, index);
+    if(lua_rawget(lua, meta) != LUA_TLIGHTUSERDATA)
+    {
+        lua_settop(lua, meta - 1);
+        return;
+    }
+    auto pobj = static_cast<loadstore::Referenceable*>(lua_touserdata(lua, -1));
+
+    lua_getfield(lua, meta, "revision");
+    lua_getfield(lua, meta, "counter");
+    if(lua_tointeger(lua, -1) != *static_cast<const unsigned*>(lua_touserdata(lua, -2)))
+    {
+        luaL_error(lua, "The exported objects have been changed since the export. Export them again.");
+        return;
+    }
+    lua_settop(lua, meta);
+
+    //mark the table as filled first, such that references to its own object inside do not fill it again
+    lua_pushvalue(lua, index);
+    lua_pushboolean(lua, true);
+    lua_rawset(lua, meta);
+    luaL_getmetatable(lua, pobj->GetTypeString()); //the metatable LuaDump would give it (or none)
+    lua_setmetatable(lua, index);
+
+    bool ok;
+    {
+        lua_pushvalue(lua, index);
+        LuaLazyDump ld(lua, meta);
+        ok = pobj->LoadStoreMembers(ld);
+    }
+    lua_settop(lua, meta - 1);
+    if(!ok) luaL_error(lua, "Unable to export object of type %s", pobj->GetTypeString());
+}
+
+int LuaLazyDump::IndexEvent(lua_State * lua)
+{
+    Fill(lua, 1);
+    lua_settop(lua, 2);
+    lua_gettable(lua, 1);
+    return 1;
+}
+
+int LuaLazyDump::NewIndexEvent(lua_State * lua)
+{
+    Fill(lua, 1);
+    lua_settop(lua, 3);
+    lua_settable(lua, 1);
+    return 0;
+}
+
+int LuaLazyDump::PairsEvent(lua_State * lua)
+{
+    Fill(lua, 1);
+    lua_settop(lua, 1);
+    lua_getglobal(lua, "pairs");
+    lua_insert(lua, 1);
+    lua_call(lua, 1, 3);
+    return 3;
+}
+
+}} //namespace Ladybirds::lua
@@ -0,0 +1,47 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LUALAZYDUMP_H
+#define LUALAZYDUMP_H
+
+#include "luadump.h"
+
+namespace Ladybirds { namespace lua {
+
+//! Stores objects into Lua tables like LuaDump, but fills the table of a registered object only when it is first used.
+/** Instead of the members of an object passed to RawIO_Register or RawIORef, an empty table is stored, which has a
+ *  metatable that calls LoadStoreMembers of the object on the first read or write of a field, or on pairs(), and then
+ *  removes itself. So a script only pays for the objects it touches, while the tables look the same as with LuaDump;
+ *  only raw accesses (rawget, next) do not see the members of objects not touched yet.
+ *  As those objects are only read later, they have to live and stay unchanged as long as the tables are used: the
+ *  owner given to the constructor (e.g. the managed program) is kept alive by the tables, and if the revision counter
+ *  given to the constructor changes, filling a table raises a Lua error. **/
+class LuaLazyDump : public LuaDump
+{
+private:
+    int Meta_; ///< Absolute stack index of the metatable shared by the tables of all objects of the dump
+
+public:
+    //! Prepares a dump; the metatable is pushed to the stack and has to stay there while this object is used.
+    /** \p owner is the stack index of the Lua value that owns the objects, \p revision counts changes to them. **/
+    LuaLazyDump(lua_State * lua, int owner, const unsigned * revision);
+
+    virtual bool RawIORef(loadstore::Referenceable *& ref, const char * type, bool required) override;
+    virtual bool RawIO_Register(loadstore::Referenceable& obj) override;
+
+private:
+    //! For filling a table: continues the dump with the metatable at stack index \p meta
+    LuaLazyDump(lua_State * lua, int meta) : LuaDump(lua), Meta_(meta) {}
+
+    //! Pushes the table for \p obj, creating an empty one if there is none yet
+    void PushTable(loadstore::Referenceable & obj);
+    //! Fills the table at stack index \p index with the members of its object, unless that is done already
+    static void Fill(lua_State * lua, int index);
+
+    static int IndexEvent(lua_State * lua);
+    static int NewIndexEvent(lua_State * lua);
+    static int PairsEvent(lua_State * lua);
+};
+
+}} //namespace Ladybirds::lua
+
+#endif // LUALAZYDUMP_H
@@ -2,14 +2,33 @@
 
 #include "pass.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
 #include <deque>
+#include <thread>
 
+#include <sys/resource.h>
+#include <time.h>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+#include "binaryloadstore.h"
+#include "cmdlineoptions.h"
 #include "loadstore.h"
 #include "luadump.h"
 #include "luaenv.h"
 #include "luaload.h"
+#include "memstats.h"
 #include "msgui.h"
+#include "parse/parsecache.h"
 #include "program.h"
+#include "spacedivision.h"
+#include "taskgroup.h"
+#include "tools.h"
 
 
 namespace Ladybirds {
@@ -23,8 +42,8 @@ static auto & GetPassList()
     return passlist;
 }
 
-Pass::Pass(std::string name, Pass::Function fn, Requires req, Destroys dest)
- : Name_(name), Function_(fn), Requires_(req), Destroys_(dest)
+Pass::Pass(std::string name, Pass::Function fn, Requires req, Destroys dest, Access access, ResultIO resultio)
+ : Name_(name), Function_(fn), Requires_(req), Destroys_(dest), Access_(access), ResultIO_(resultio)
 {
     GetPassList().push_back(this);
 }
@@ -41,6 +60,7 @@ impl::Program & Pass::GetProgram(lua_State * lua)
             lua_error(lua);
         }
         lua_pop(lua, 1);
+        RecordSizes(*pprog, false);
         return pprog;
     };
     
@@ -105,12 +125,51 @@ void Pass::LoadExtraArgs(lua_State * lua, loadstore::LoadStorableCompound & argo
     }
 }
 
+/// \internal Renumbers the tasks of \p prog densely if too many of them have been removed, such that maps and sets
+/// over the tasks do not waste space (and time) on the gaps. Compaction moves the tasks in memory, so it is only
+/// done while no task pointers are held by the results of other passes (cf. TaskTopoSort, which reorders the tasks).
+static void CompactTasksIfFragmented(impl::Program &prog)
+{
+    constexpr double maxfragmentation = 0.25;
+    static const char * const pointerholders[] = {"CalcSuccessorMatrix", "LoadMapping", "PopulateGroups",
+                                                  "TaskTopoSort"};
+    
+    if(prog.TaskGraph.GetNodeFragmentation() <= maxfragmentation) return;
+    for(auto * passname : pointerholders)
+    {
+        if(prog.PassesPerformed.count(passname) != 0) return;
+    }
+    
+    gMsgUI.Verbose("Compacting task list (%.0f%% of the ID range are gaps).",
+                   100*prog.TaskGraph.GetNodeFragmentation());
+    prog.TaskGraph.Compact();
+}
+
 int Pass::FinishImpl(lua_State *lua, impl::Program &prog, bool success)
 {
-    if(success) prog.PassesPerformed.insert(Name_);
+    ++prog.Revision; //even if the pass failed, it may have changed the program
+    if(success)
+    {
+        prog.PassesPerformed.insert(Name_);
+        CompactTasksIfFragmented(prog);
+    }
+    RecordSizes(prog, true);
     return 1;
 }
 
+void Pass::RecordSizes(const impl::Program & prog, bool after)
+{
+    auto & stats = GetPassStats();
+    if(stats.empty()) return;
+    
+    int nbuffers = prog.ExternalBuffers.size();
+    for(auto & division : prog.Divisions) nbuffers += division.Buffers.size();
+    stats.back().Tasks[after] = prog.GetTasks().size();
+    stats.back().Dependencies[after] = prog.Dependencies.size();
+    stats.back().Buffers[after] = nbuffers;
+    if(tools::gCmdLineOptions.TimePasses) stats.back().ProgramKB[after] = impl::GetMemStats(prog).Total / 1024;
+}
+
 
 int Pass::Finish(lua_State *lua, impl::Program &prog, bool success)
 {
@@ -139,29 +198,392 @@ int Pass::Run(lua_State * lua)
     CheckDependencies(lua, prog);
     
     assert(Function_);
-    bool res = (*Function_)(prog);
+    bool res = ApplyCached(prog, GetCachePath(prog, nullptr), nullptr, [&]{ return (*Function_)(prog); });
 
     return Finish(lua, prog, res);
 }
 
+bool Pass::Prepare(lua_State * lua, Application & app)
+{
+    if(!Function_) return false; // a derived class with its own Run
+    
+    auto & prog = GetProgram(lua);
+    CheckDependencies(lua, prog);
+    
+    auto fn = Function_;
+    auto cachepath = GetCachePath(prog, nullptr);
+    app.Execute = [this, fn, &prog, cachepath]
+        { return ApplyCached(prog, cachepath, nullptr, [&]{ return (*fn)(prog); }); };
+    app.Finish = [this, &prog](lua_State * lua, bool success) { return Finish(lua, prog, success); };
+    return true;
+}
+
+namespace {
+/// \internal A cache entry of a pass result (cf. Pass::ApplyCached): the return value, then the program changes
+struct CachedResult : public loadstore::LoadStorableCompound
+{
+    Pass::ResultIO IO;
+    impl::Program & Prog;
+    loadstore::LoadStorableCompound * pRetval;
+    
+    CachedResult(Pass::ResultIO io, impl::Program & prog, loadstore::LoadStorableCompound * pretval)
+        : IO(io), Prog(prog), pRetval(pretval) {}
+    virtual bool LoadStoreMembers(loadstore::LoadStore & ls) override
+    { // the return value comes first, such that a damaged entry is noticed before the program is changed
+        return (!pRetval || ls.IO("returns", *pRetval)) && (*IO)(Prog, ls);
+    }
+};
+} //namespace ::
+
+std::string Pass::GetCachePath(impl::Program & prog, loadstore::LoadStorableCompound * args)
+{
+    auto & dir = tools::gCmdLineOptions.PassCache;
+    if(dir.empty() || !ResultIO_ || !prog.IsStorable()) return "";
+    
+    static const std::string stamp = parse::GetCompilerStamp();
+    if(stamp.empty()) return ""; // could not identify the compiler, don't cache
+    
+    loadstore::BinaryStore progstore, argstore;
+    bool ok = progstore.RawIO(prog) && (!args || argstore.RawIO(*args));
+    std::string key = stamp + '\0' + Name_ + '\0' + argstore.GetData() + '\0' + progstore.GetData();
+    if(!ok || progstore.GetErrorCount() != 0 || argstore.GetErrorCount() != 0) return "";
+    
+    llvm::sys::fs::create_directories(dir);
+    llvm::SmallString<128> path(dir);
+    llvm::sys::path::append(path, Name_ + '-' + parse::HashString(key) + ".lbpass");
+    return path.str().str();
+}
+
+bool Pass::ApplyCached(impl::Program & prog, const std::string & cachepath, loadstore::LoadStorableCompound * retval,
+                       const std::function<bool()> & fn)
+{
+    if(cachepath.empty()) return fn();
+    
+    std::string data;
+    if(parse::ReadFile(cachepath, data))
+    {
+        CachedResult entry(ResultIO_, prog, retval);
+        loadstore::BinaryLoad ld(std::move(data), true);
+        if(ld.GetErrorCount() == 0 && ld.RawIO(entry) && ld.GetErrorCount() == 0)
+        {
+            gMsgUI.Verbose("%s: took the result from %s", Name_.c_str(), cachepath.c_str());
+            return true;
+        }
+        gMsgUI.Warning("Ignoring damaged pass cache entry %s: %s", cachepath.c_str(), ld.GetFirstError().c_str());
+    }
+    
+    if(!fn()) return false;
+    CachedResult entry(ResultIO_, prog, retval);
+    loadstore::BinaryStore ls;
+    if(!ls.RawIO(entry) || ls.GetErrorCount() != 0 || !parse::WriteFileAtomic(cachepath, ls.GetData()))
+        gMsgUI.Warning("Unable to store the result of %s in %s", Name_.c_str(), cachepath.c_str());
+    return true;
+}
+
+bool Pass::DependsOn(const Pass & earlier) const
+{
+    auto contains = [](const std::vector<std::string> & list, const std::string & str)
+        { return std::find(list.begin(), list.end(), str) != list.end(); };
+    auto intersect = [&contains](const std::vector<std::string> & list1, const std::vector<std::string> & list2)
+        { return std::any_of(list1.begin(), list1.end(), [&](auto & str) { return contains(list2, str); }); };
+    
+    if(&earlier == this || !Access_.Declared || !earlier.Access_.Declared) return true;
+    
+    // the results of passes as recorded in Program::PassesPerformed
+    if(contains(Requires_, earlier.Name_) || contains(Destroys_, earlier.Name_) || contains(earlier.Destroys_, Name_)
+       || intersect(Requires_, earlier.Destroys_) || intersect(Destroys_, earlier.Requires_)) return true;
+    
+    return intersect(Access_.Writes, earlier.Access_.Reads) || intersect(Access_.Writes, earlier.Access_.Writes)
+        || intersect(Access_.Reads, earlier.Access_.Writes);
+}
+
+/// \internal Peak resident set size of the compiler so far, in kB
+static long PeakRss()
+{
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+/// \internal Largest amount of working data reported by the pass being applied (cf. RecordScratchBytes)
+static std::atomic<std::size_t> gScratchBytes(0);
+
+void RecordScratchBytes(std::size_t bytes)
+{
+    auto prev = gScratchBytes.load(std::memory_order_relaxed);
+    while(prev < bytes && !gScratchBytes.compare_exchange_weak(prev, bytes, std::memory_order_relaxed)) {}
+}
+
 static int LuaPassInterface(lua_State * lua)
 {
     void * p = lua_touserdata(lua, lua_upvalueindex(1));
-    return static_cast<Pass*>(p)->Run(lua);
+    auto & stats = GetPassStats();
+    stats.emplace_back();
+    stats.back().Name = static_cast<Pass*>(p)->GetName();
+    auto wallstart = std::chrono::steady_clock::now();
+    auto cpustart = std::clock();
+    long rssstart = PeakRss();
+    gScratchBytes.store(0, std::memory_order_relaxed);
+    auto & sections = gen::GetSectionStats();
+    long splitstart = sections.Split.load(std::memory_order_relaxed);
+    long mergedstart = sections.Merged.load(std::memory_order_relaxed);
+    
+    int ret = static_cast<Pass*>(p)->Run(lua);
+    
+    // pseudo passes (like Tools) do not work on a program and are not worth listing
+    auto & last = stats.back();
+    if(last.Tasks[0] < 0 && last.Tasks[1] < 0)
+    {
+        stats.pop_back();
+        return ret;
+    }
+    last.Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallstart).count();
+    last.Cpu = double(std::clock() - cpustart) / CLOCKS_PER_SEC;
+    last.PeakRss = PeakRss() - rssstart;
+    last.ScratchKB = gScratchBytes.load(std::memory_order_relaxed) / 1024;
+    last.SectionsSplit = sections.Split.load(std::memory_order_relaxed) - splitstart;
+    last.SectionsMerged = sections.Merged.load(std::memory_order_relaxed) - mergedstart;
+    return ret;
 }
 
 bool RegisterPasses(lua_State * lua)
 {
     auto & passlist = GetPassList();
-    lua_createtable(lua, 0, passlist.size());
+    lua_createtable(lua, 0, passlist.size() + 1);
     for(auto ppass : passlist)
     {
         lua_pushlightuserdata(lua, ppass);
         lua_pushcclosure(lua, &LuaPassInterface, 1);
         lua_setfield(lua, -2, ppass->GetName().c_str());
     }
+    lua_pushcfunction(lua, &RunPipeline);
+    lua_setfield(lua, -2, "RunPipeline");
     lua_setglobal(lua, "Ladybirds");
     return true;
 }
 
+/// \internal CPU time used by the calling thread so far, in seconds
+static double ThreadCpuTime()
+{
+    timespec ts;
+    return clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0 ? ts.tv_sec + 1e-9*ts.tv_nsec : 0;
+}
+
+/// \internal Lua C function for RunPipeline: prepares the pass in upvalue 1 with the arguments at stack index 1 into
+/// the Pass::Application in upvalue 2. Passes that cannot be prepared are applied right away; their result is returned.
+static int PreparePass(lua_State * lua)
+{
+    auto ppass = static_cast<Pass*>(lua_touserdata(lua, lua_upvalueindex(1)));
+    auto papp = static_cast<Pass::Application*>(lua_touserdata(lua, lua_upvalueindex(2)));
+    if(ppass->Prepare(lua, *papp)) return 0;
+    
+    auto wallstart = std::chrono::steady_clock::now();
+    double cpustart = ThreadCpuTime();
+    int ret = ppass->Run(lua);
+    auto & stats = GetPassStats().back();
+    stats.Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallstart).count();
+    stats.Cpu = ThreadCpuTime() - cpustart;
+    return ret;
+}
+
+int RunPipeline(lua_State * lua)
+{
+    luaL_checktype(lua, 1, LUA_TTABLE);
+    lua_settop(lua, 1);
+    if(lua_rawgeti(lua, 1, 1) != LUA_TUSERDATA) luaL_argerror(lua, 1, "the first element must be the program");
+    if(lua_rawgeti(lua, 1, 2) != LUA_TTABLE) luaL_argerror(lua, 1, "the second element must be the list of passes");
+    const int progidx = 2, listidx = 3;
+    
+    // look up the passes and their dependencies
+    auto & passlist = GetPassList();
+    std::vector<Pass*> passes(luaL_len(lua, listidx));
+    std::vector<int> waves(passes.size(), 0);
+    for(size_t i = 0; i < passes.size(); ++i)
+    {
+        lua_rawgeti(lua, listidx, i+1);
+        if(lua_istable(lua, -1)) lua_rawgeti(lua, -1, 1);
+        else lua_pushvalue(lua, -1);
+        const char * name = lua_tostring(lua, -1);
+        auto it = std::find_if(passlist.begin(), passlist.end(),
+                               [name](Pass * ppass) { return name && ppass->GetName() == name; });
+        if(it == passlist.end()) return luaL_error(lua, "Pipeline entry %d is not a known pass", int(i+1));
+        passes[i] = *it;
+        lua_pop(lua, 2);
+        
+        for(size_t j = 0; j < i; ++j)
+        {
+            if(passes[i]->DependsOn(*passes[j])) waves[i] = std::max(waves[i], waves[j] + 1);
+        }
+    }
+    
+    lua_createtable(lua, passes.size(), 0);
+    const int resultidx = lua_gettop(lua);
+    bool success = true;
+    int nwaves = passes.empty() ? 0 : *std::max_element(waves.begin(), waves.end()) + 1;
+    for(int wave = 0; wave < nwaves && success; ++wave)
+    {
+        std::vector<size_t> members;
+        for(size_t i = 0; i < passes.size(); ++i) if(waves[i] == wave) members.push_back(i);
+        
+        // prepare the passes in the given order, each with a table of its arguments and the program
+        std::deque<Pass::Application> apps;
+        std::vector<size_t> prepared;
+        auto & stats = GetPassStats();
+        size_t firststats = stats.size();
+        for(size_t i : members)
+        {
+            stats.emplace_back();
+            stats.back().Name = passes[i]->GetName();
+            
+            apps.emplace_back();
+            lua_pushlightuserdata(lua, passes[i]);
+            lua_pushlightuserdata(lua, &apps.back());
+            lua_pushcclosure(lua, &PreparePass, 2);
+            lua_newtable(lua);
+            lua_rawgeti(lua, listidx, i+1);
+            if(lua_istable(lua, -1))
+            {
+                for(lua_pushnil(lua); lua_next(lua, -2); )
+                {
+                    if(lua_isinteger(lua, -2) && lua_tointeger(lua, -2) == 1)
+                    { // the name of the pass
+                        lua_pop(lua, 1);
+                        continue;
+                    }
+                    lua_pushvalue(lua, -2);
+                    lua_insert(lua, -2);
+                    lua_settable(lua, -5);
+                }
+            }
+            lua_pop(lua, 1);
+            lua_pushvalue(lua, progidx);
+            lua_rawseti(lua, -2, 1);
+            
+            int top = lua_gettop(lua) - 2;
+            lua_call(lua, 1, LUA_MULTRET);
+            if(lua_gettop(lua) > top)
+            { // applied by Run already
+                lua_settop(lua, top + 1);
+                success &= bool(lua_toboolean(lua, -1));
+                lua_rawseti(lua, resultidx, i+1);
+            }
+            else prepared.push_back(i);
+        }
+        
+        // execute the prepared ones concurrently (in the apps with an Execute function)
+        std::vector<Pass::Application*> jobs;
+        for(auto & app : apps) if(app.Execute) jobs.push_back(&app);
+        std::vector<char> results(jobs.size());
+        std::vector<double> walls(jobs.size()), cpus(jobs.size());
+        long rssstart = PeakRss();
+        auto work = [&](size_t job)
+        {
+            auto wallstart = std::chrono::steady_clock::now();
+            double cpustart = ThreadCpuTime();
+            results[job] = jobs[job]->Execute();
+            walls[job] = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallstart).count();
+            cpus[job] = ThreadCpuTime() - cpustart;
+        };
+        std::vector<std::thread> threads;
+        for(size_t job = 1; job < jobs.size(); ++job) threads.emplace_back(work, job);
+        if(!jobs.empty()) work(0);
+        for(auto & thread : threads) thread.join();
+        
+        // finish them in the given order
+        for(size_t job = 0; job < jobs.size(); ++job)
+        {
+            jobs[job]->Finish(lua, results[job]);
+            success &= bool(results[job]);
+            lua_rawseti(lua, resultidx, prepared[job]+1);
+        }
+        
+        // Finish recorded the sizes after the wave in the last statistics entry
+        size_t job = 0;
+        for(size_t k = 0; k < members.size(); ++k)
+        {
+            auto & entry = stats[firststats + k];
+            if(job == jobs.size() || prepared[job] != members[k]) continue; // applied by Run
+            entry.Wall = walls[job], entry.Cpu = cpus[job];
+            entry.PeakRss = job == 0 ? PeakRss() - rssstart : 0; // the whole wave is counted for the first one
+            entry.Tasks[1] = stats.back().Tasks[1], entry.Dependencies[1] = stats.back().Dependencies[1];
+            entry.Buffers[1] = stats.back().Buffers[1];
+            ++job;
+        }
+    }
+    
+    lua_pushboolean(lua, success);
+    lua_insert(lua, resultidx);
+    return 2;
+}
+
+bool ForEachDivision(impl::Program & prog, const std::function<bool(impl::TaskDivision & div)> & fn)
+{
+    auto & divisions = prog.Divisions;
+    if(divisions.size() <= 1) return divisions.empty() || fn(divisions.front());
+    
+    std::vector<MsgUI::Buffer> buffers(divisions.size());
+    std::vector<char> results(divisions.size());
+    std::atomic<size_t> next(0);
+    auto work = [&]
+    {
+        for(size_t i; (i = next++) < divisions.size(); )
+        {
+            MsgUI::Buffer::Scope scope(buffers[i]);
+            results[i] = fn(divisions[i]);
+        }
+    };
+    
+    size_t nthreads = std::min<size_t>(divisions.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < nthreads; ++i) threads.emplace_back(work);
+    work();
+    for(auto & thread : threads) thread.join();
+    
+    for(auto & buffer : buffers) gMsgUI.Print(buffer);
+    return std::all_of(results.begin(), results.end(), [](char res) { return res != 0; });
+}
+
+std::vector<PassStats> & GetPassStats()
+{
+    static std::vector<PassStats> stats;
+    return stats;
+}
+
+bool PassStats::LoadStoreMembers(loadstore::LoadStore & ls)
+{
+    return ls.IO("name", Name)
+         & ls.IO("wall", Wall)
+         & ls.IO("cpu", Cpu)
+         & ls.IO("peakrss", PeakRss)
+         & ls.IO("tasksbefore", Tasks[0], false, -1) & ls.IO("tasksafter", Tasks[1], false, -1)
+         & ls.IO("depsbefore", Dependencies[0], false, -1) & ls.IO("depsafter", Dependencies[1], false, -1)
+         & ls.IO("buffersbefore", Buffers[0], false, -1) & ls.IO("buffersafter", Buffers[1], false, -1)
+         & ls.IO("programkbbefore", ProgramKB[0], false, -1) & ls.IO("programkbafter", ProgramKB[1], false, -1)
+         & ls.IO("scratchkb", ScratchKB, false, 0)
+         & ls.IO("sectionssplit", SectionsSplit, false, 0) & ls.IO("sectionsmerged", SectionsMerged, false, 0);
+}
+
+void PrintPassStats(std::ostream & strm)
+{
+    auto sizes = [](const int (&counts)[2])
+    {
+        if(counts[0] < 0) return counts[1] < 0 ? std::string("-") : std::to_string(counts[1]);
+        if(counts[1] < 0 || counts[1] == counts[0]) return std::to_string(counts[0]);
+        return strprintf("%d -> %d", counts[0], counts[1]);
+    };
+    
+    strm << strprintf("%-24s %9s %9s %12s %16s %16s %16s %20s %12s %20s\n", "Pass", "Wall [s]", "CPU [s]",
+                      "RSS + [kB]", "Tasks", "Dependencies", "Buffers", "Program [kB]", "Scratch [kB]",
+                      "Sections split/merged");
+    PassStats total;
+    for(auto & s : GetPassStats())
+    {
+        strm << strprintf("%-24s %9.3f %9.3f %12d %16s %16s %16s %20s %12d %20s\n", s.Name.c_str(), s.Wall, s.Cpu,
+                          s.PeakRss, sizes(s.Tasks).c_str(), sizes(s.Dependencies).c_str(), sizes(s.Buffers).c_str(),
+                          sizes(s.ProgramKB).c_str(), s.ScratchKB,
+                          strprintf("%d/%d", s.SectionsSplit, s.SectionsMerged).c_str());
+        total.Wall += s.Wall, total.Cpu += s.Cpu, total.PeakRss += s.PeakRss;
+    }
+    strm << strprintf("%-24s %9.3f %9.3f %12d\n", "Total", total.Wall, total.Cpu, total.PeakRss);
+}
+
 }} //namespace Ladybirds::tools
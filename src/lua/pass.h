@@ -4,13 +4,17 @@
 #define LADYBIRDS_TOOLS_PASS_H
 
 #include <assert.h>
+#include <functional>
+#include <memory>
+#include <ostream>
 #include <string>
 #include <vector>
 
+#include "loadstore.h"
+
 struct lua_State;
 
-namespace Ladybirds { namespace impl { struct Program; }}
-namespace Ladybirds { namespace loadstore { class LoadStorableCompound; }}
+namespace Ladybirds { namespace impl { struct Program; class TaskDivision; }}
 
 namespace Ladybirds {
 namespace lua {
@@ -24,30 +28,70 @@ namespace lua {
  *  before this pass can be applied. Destroys is a list of passes the results of which get invalidated by this pass.
  *  Essentially, they are simple string vectors; however, for programming comfort, they are declared as proper classes,
  *  such that the constructor of Pass can be called as <tt> Pass(..., Pass::Requires{...}, Pass::Destroys{...});</tt>
+ *  
+ *  Access describes which parts of the program the pass reads and writes (by names like "Tasks", "TaskCosts" or
+ *  "CodeFiles"), such that RunPipeline can run passes concurrently that neither depend on each other nor write
+ *  anything that the other one reads or writes. A pass without an Access declaration is assumed to access everything.
+ *  
+ *  A pass given a ResultIO function can have its results cached between runs (cf. -pass-cache): The cache entry for an
+ *  application is found by a hash over the pass name, its arguments and the stored program (as by pass StoreProgram),
+ *  so only programs before grouping can be cached. The ResultIO stores what the pass changed in the program, and
+ *  applies these changes again when loading them.
  **/
 class Pass
 {
 public:
     class Requires : public std::vector<std::string> {using std::vector<std::string>::vector;};
     class Destroys : public std::vector<std::string> {using std::vector<std::string>::vector;};
+    struct Access
+    {
+        std::vector<std::string> Reads, Writes;
+        bool Declared;
+        
+        Access() : Declared(false) {}
+        Access(std::vector<std::string> reads, std::vector<std::string> writes)
+            : Reads(std::move(reads)), Writes(std::move(writes)), Declared(true) {}
+    };
     using Function = bool (*) (impl::Program & prog);
+    /// Loads or stores the changes the pass made to \p prog (cf. -pass-cache). Loading must not change \p prog when
+    /// it fails, e.g. by reading everything before applying it.
+    using ResultIO = bool (*) (impl::Program & prog, loadstore::LoadStore & ls);
+    
+    /// An application of a pass split up for RunPipeline: Execute runs the pass function and may be called on another
+    /// thread than the one of the Lua state; Finish then pushes the result and updates the program like Run does.
+    struct Application
+    {
+        std::function<bool()> Execute;
+        std::function<int(lua_State * lua, bool success)> Finish;
+    };
     
 private:
     std::string Name_;
     Function Function_;
     Requires Requires_;
     Destroys Destroys_;
+    Access Access_;
+    ResultIO ResultIO_;
     
 public:
-    Pass(std::string name, Function fn, Requires req = {}, Destroys dest = {});
+    Pass(std::string name, Function fn, Requires req = {}, Destroys dest = {}, Access access = {},
+         ResultIO resultio = nullptr);
     virtual ~Pass() {}
     
     const std::string GetName() const { return Name_; }
     
     virtual int Run(lua_State * lua);
+    /// Like Run, but leaves executing the pass function and finishing to \p app. Returns false if the pass can only
+    /// be applied as a whole by Run (e.g. because it works on the Lua state); nothing has been done then.
+    virtual bool Prepare(lua_State * lua, Application & app);
+    
+    /// Returns true if this pass has to be applied after \p earlier, which comes before it in a pipeline
+    bool DependsOn(const Pass & earlier) const;
     
 protected:
     impl::Program & GetProgram(lua_State * lua);
+    /// Records the sizes of \p prog before or \p after the current application of the pass (cf. GetPassStats)
+    static void RecordSizes(const impl::Program & prog, bool after);
     void CheckDependencies(lua_State * lua, impl::Program & prog);
     void LoadExtraArgs(lua_State * lua, loadstore::LoadStorableCompound & argobj);
     int Finish(lua_State * lua, impl::Program & prog, bool success);
@@ -55,13 +99,62 @@ protected:
     int Finish(lua_State * lua, impl::Program & prog, std::nullptr_t);
     //TODO: For completeness, more Finish functions with different "return" types should exist
     
+    /// Returns the path of the cache entry for applying the pass with \p args to \p prog as it is now, or an empty
+    /// string if the result is not cached (no -pass-cache, no ResultIO or a program that cannot be stored)
+    std::string GetCachePath(impl::Program & prog, loadstore::LoadStorableCompound * args);
+    /// Applies the pass by taking its result (the changes of \p prog and \p retval) from the cache entry at
+    /// \p cachepath, or else by calling \p fn and storing its result there. Returns whether the pass succeeded.
+    bool ApplyCached(impl::Program & prog, const std::string & cachepath, loadstore::LoadStorableCompound * retval,
+                     const std::function<bool()> & fn);
+    
 private:
     int FinishImpl(lua_State * lua, impl::Program & prog, bool success);
 };
 
-/// Inserts a table "passes" in the lua environment given by \p lua. The table contains all passes that are available.
+/// Inserts a table "passes" in the lua environment given by \p lua. The table contains all passes that are available,
+/// and RunPipeline as function of the same name.
 bool RegisterPasses(lua_State * lua);
 
+/// Lua function Ladybirds.RunPipeline{prog, {pass, {pass, args...}, ...}}: Applies the given passes (by name, and with
+/// the arguments given in the table of a pass) to prog like calling them one after the other, but each pass only waits
+/// for the earlier ones it depends on (cf. Pass::DependsOn). The passes are applied in waves: those of a wave are
+/// prepared and finished in the order given, and executed concurrently in between. So the program ends up as with
+/// the sequential calls. No further waves are started once a pass has failed. Returns true if all passes succeeded,
+/// and a list with the result of each pass (nil for those not applied).
+int RunPipeline(lua_State * lua);
+
+/// Calls \p fn for every division of \p prog, concurrently, and returns true if all calls returned true.
+/** For passes that work on each division on its own. The messages of every call are collected (cf. MsgUI::Buffer) and
+ *  printed in the order of the divisions afterwards, such that the output is the same as with a sequential loop.
+ *  Unlike such a loop, \p fn is called for all divisions even if it failed for one. **/
+bool ForEachDivision(impl::Program & prog, const std::function<bool(impl::TaskDivision & div)> & fn);
+
+/// Resources used by one application of a pass, and the sizes of the program before and after it
+struct PassStats : public loadstore::LoadStorableCompound
+{
+    std::string Name;
+    double Wall = 0, Cpu = 0; ///< Wall clock and CPU time, in seconds
+    int PeakRss = 0;          ///< Increase of the peak resident set size of the compiler, in kB
+    /// Number of tasks, dependencies and buffers before and after the pass (-1: no program known)
+    int Tasks[2] = {-1, -1}, Dependencies[2] = {-1, -1}, Buffers[2] = {-1, -1};
+    /// Memory taken by the program before and after the pass, in kB (cf. impl::MemStats; -1: not measured, which it
+    /// only is with -timepasses)
+    int ProgramKB[2] = {-1, -1};
+    int ScratchKB = 0; ///< Largest working data reported by the pass (cf. RecordScratchBytes), in kB
+    /// Sections of space divisions split by overlapping assignments and merged again (cf. gen::GetSectionStats)
+    int SectionsSplit = 0, SectionsMerged = 0;
+    
+    virtual bool LoadStoreMembers(loadstore::LoadStore & ls) override;
+};
+
+/// Reports \p bytes of working data (e.g. of an opt::Schedule, cf. its GetHeapBytes) used by the pass that is being
+/// applied. The largest amount reported is kept as PassStats::ScratchKB; passes applied by RunPipeline are not covered.
+void RecordScratchBytes(std::size_t bytes);
+/// The statistics of all passes applied so far, in the order of their application
+std::vector<PassStats> & GetPassStats();
+/// Prints GetPassStats as a table, together with the totals (cf. -time-passes)
+void PrintPassStats(std::ostream & strm);
+
 template<class argT> class PassWithArgs : public Pass
 {
 public:
@@ -71,8 +164,9 @@ private:
     Function Function_;
     
 public:
-    PassWithArgs(std::string name, Function fn, Requires req = {}, Destroys dest = {})
-        : Pass(std::move(name), nullptr, req, dest), Function_(fn) {}
+    PassWithArgs(std::string name, Function fn, Requires req = {}, Destroys dest = {}, Access access = {},
+                 ResultIO resultio = nullptr)
+        : Pass(std::move(name), nullptr, req, dest, access, resultio), Function_(fn) {}
     
     virtual int Run(lua_State * lua)
     {
@@ -83,9 +177,26 @@ public:
         LoadExtraArgs(lua, argobj);
         
         assert(Function_);
-        bool res = (*Function_)(prog, argobj);
+        bool res = ApplyCached(prog, GetCachePath(prog, &argobj), nullptr, [&]{ return (*Function_)(prog, argobj); });
         return Finish(lua, prog, res);
     }
+    
+    virtual bool Prepare(lua_State * lua, Application & app)
+    {
+        auto & prog = GetProgram(lua);
+        CheckDependencies(lua, prog);
+        
+        auto pargobj = std::make_shared<argT>();
+        LoadExtraArgs(lua, *pargobj);
+        
+        assert(Function_);
+        auto fn = Function_;
+        auto cachepath = GetCachePath(prog, pargobj.get());
+        app.Execute = [this, fn, &prog, pargobj, cachepath]
+            { return ApplyCached(prog, cachepath, nullptr, [&]{ return (*fn)(prog, *pargobj); }); };
+        app.Finish = [this, &prog](lua_State * lua, bool success) { return Finish(lua, prog, success); };
+        return true;
+    }
 };
 
 template<class argT, typename retT> class PassWithArgsAndRet : public Pass
@@ -97,8 +208,9 @@ private:
     Function Function_;
     
 public:
-    PassWithArgsAndRet(std::string name, Function fn, Requires req = {}, Destroys dest = {})
-        : Pass(std::move(name), nullptr, req, dest), Function_(fn) {}
+    PassWithArgsAndRet(std::string name, Function fn, Requires req = {}, Destroys dest = {}, Access access = {},
+                       ResultIO resultio = nullptr)
+        : Pass(std::move(name), nullptr, req, dest, access, resultio), Function_(fn) {}
     
     virtual int Run(lua_State * lua)
     {
@@ -110,9 +222,29 @@ public:
         
         assert(Function_);
         retT retobj;
-        bool res = (*Function_)(prog, argobj, retobj);
+        bool res = ApplyCached(prog, GetCachePath(prog, &argobj), &retobj,
+                               [&]{ return (*Function_)(prog, argobj, retobj); });
         return res ? Finish(lua, prog, retobj) : Finish(lua, prog, nullptr);
      }
+    
+    virtual bool Prepare(lua_State * lua, Application & app)
+    {
+        auto & prog = GetProgram(lua);
+        CheckDependencies(lua, prog);
+        
+        auto pargobj = std::make_shared<argT>();
+        LoadExtraArgs(lua, *pargobj);
+        
+        assert(Function_);
+        auto fn = Function_;
+        auto pretobj = std::make_shared<retT>();
+        auto cachepath = GetCachePath(prog, pargobj.get());
+        app.Execute = [this, fn, &prog, pargobj, pretobj, cachepath]
+            { return ApplyCached(prog, cachepath, pretobj.get(), [&]{ return (*fn)(prog, *pargobj, *pretobj); }); };
+        app.Finish = [this, &prog, pretobj](lua_State * lua, bool success)
+            { return success ? Finish(lua, prog, *pretobj) : Finish(lua, prog, nullptr); };
+        return true;
+    }
 };
 
 
@@ -1,34 +1,70 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include "graph/scratcharray.h"
 #include "lua/luaenv.h"
 #include "lua/pass.h"
 #include "parse/cinterface.h"
 #include "cmdlineoptions.h"
 #include "msgui.h"
 #include "program.h"
+#include "server.h"
 
+using Ladybirds::tools::gCmdLineOptions;
 
-int main(int argc, char **argv)
+/// Runs the backend given on the command line in \p lua, which must have the passes registered
+static int RunBackend(Ladybirds::lua::LuaEnv & lua)
 {
-    using Ladybirds::tools::gCmdLineOptions;
-    gCmdLineOptions.Initialize(argc, argv);
-    if(gCmdLineOptions.Verbose) gMsgUI.open(stderr, stdout);
-    
+    std::size_t budget = std::size_t(std::max(gCmdLineOptions.MemBudget, 0)) << 20;
+    if(!Ladybirds::graph::ScratchSpace::Configure(gCmdLineOptions.ScratchDir, budget))
+    {
+        gMsgUI.Error("Unable to keep arrays in '%s': %s", gCmdLineOptions.ScratchDir.c_str(), std::strerror(errno));
+        return 1;
+    }
+
     if(gCmdLineOptions.Backend.empty())
     { //no backend which knows what to do; as a fallback, we just parse (and translate) the lb file
         Ladybirds::impl::Program prog;
         Ladybirds::parse::CSpecOptions opt(gCmdLineOptions.ProgramSpec);
         opt.Instrumentation = gCmdLineOptions.Instrumentation;
+        opt.ExtraSpecifications = gCmdLineOptions.ExtraSpecs;
+        for(auto & spec : opt.ExtraSpecifications) opt.ExtraTranslationOutputs.push_back(spec + ".c");
         return Ladybirds::parse::LoadCSpec(opt, prog) ? 0 : 1;
     }
-    
-    Ladybirds::lua::LuaEnv lua;
-    if(!Ladybirds::lua::RegisterPasses(lua)) return 1;
 
     bool success = lua.DoFile((gResourceDir + "share/ladybirds/codegen/common/init.lua").c_str(),
                               "Code generator initialisation failed:")
-        && lua.DoFile((gCmdLineOptions.Backend + "/main.lua").c_str(), "Error in the backend:");
-    
+        && lua.DoFile((gCmdLineOptions.Backend + "/main.lua").c_str(), "Error in the backend:")
+        && lua.DoString("finishoutputs()", "Unable to update the list of generated files:");
+
+    if(gCmdLineOptions.TimePasses) Ladybirds::lua::PrintPassStats(std::cout);
     return success ? 0 : 1;
 }
 
+int main(int argc, char **argv)
+{
+    gCmdLineOptions.Initialize(argc, argv);
+    if(gCmdLineOptions.Verbose) gMsgUI.open(stderr, stdout);
+    if(!gCmdLineOptions.ServerSocket.empty()) return Ladybirds::tools::RunOnServer(gCmdLineOptions.ServerSocket);
+
+    auto lua = std::make_unique<Ladybirds::lua::LuaEnv>();
+    if(!Ladybirds::lua::RegisterPasses(*lua)) return 1;
+    if(gCmdLineOptions.ServeSocket.empty()) return RunBackend(*lua);
+
+    // As a server, load the libraries of init.lua once; every request runs in its own copy of this environment and
+    // closes it afterwards, such that finalizers run as in a normal compilation.
+    lua->DoString("require('lfs') require('lua_fastache')", "Unable to preload the Lua libraries:");
+    std::string parsecache = gCmdLineOptions.ParseCache;
+    if(parsecache.empty() && !gUserDir.empty()) parsecache = gUserDir + "parsecache";
+    return Ladybirds::tools::Serve(gCmdLineOptions.ServeSocket, parsecache, [&lua]
+    {
+        int ret = RunBackend(*lua);
+        lua.reset();
+        return ret;
+    });
+}
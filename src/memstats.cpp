@@ -0,0 +1,140 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "memstats.h"
+
+#include "graph/scratcharray.h"
+#include "spec/platform.h"
+#include "interned.h"
+#include "kernel.h"
+#include "metakernel.h"
+#include "program.h"
+#include "task.h"
+#include "taskfamily.h"
+#include "taskgroup.h"
+#include "tools.h"
+
+namespace Ladybirds { namespace impl {
+
+using spec::Dependency;
+using spec::Kernel;
+using spec::Task;
+
+bool MemStats::LoadStoreMembers(loadstore::LoadStore & ls)
+{
+    return ls.IO("tasks", Tasks) & ls.IO("ifaces", Ifaces) & ls.IO("dependencies", Dependencies)
+         & ls.IO("reachability", Reachability) & ls.IO("levels", Levels) & ls.IO("families", Families)
+         & ls.IO("groups", Groups) & ls.IO("buffers", Buffers) & ls.IO("kernels", Kernels) & ls.IO("other", Other)
+         & ls.IO("platform", Platform) & ls.IO("total", Total) & ls.IO("arenareserved", ArenaReserved)
+         & ls.IO("interned", Interned) & ls.IO("scratch", Scratch);
+}
+
+/// \internal Bytes of the interfaces of \p task (the list and what the interfaces allocate)
+static std::size_t IfaceBytes(const Task & task)
+{
+    std::size_t ret = HeapBytes(task.Ifaces);
+    for(auto & iface : task.Ifaces) ret += iface.GetHeapBytes();
+    return ret;
+}
+
+static std::size_t DependencyBytes(const std::vector<Dependency> & deps)
+{
+    std::size_t ret = HeapBytes(deps);
+    for(auto & dep : deps) ret += dep.GetHeapBytes();
+    return ret;
+}
+
+static std::size_t FamilyBytes(const std::vector<spec::TaskFamily> & families)
+{
+    std::size_t ret = HeapBytes(families);
+    for(auto & family : families)
+    {
+        ret += HeapBytes(family.Domain) + HeapBytes(family.Shifts);
+        for(auto & shift : family.Shifts)
+        {
+            ret += HeapBytes(shift.Steps);
+            for(auto & steps : shift.Steps) ret += HeapBytes(steps);
+        }
+    }
+    return ret;
+}
+
+/// \internal Bytes allocated by \p kernel, without the object itself. The packets are only counted by their names.
+static std::size_t KernelBytes(const Kernel & kernel)
+{
+    std::size_t ret = HeapBytes(kernel.Name) + HeapBytes(kernel.FunctionName) + HeapBytes(kernel.CodeFile)
+                    + HeapBytes(kernel.SourceCode) + HeapBytes(kernel.Packets) + HeapBytes(kernel.Params)
+                    + HeapBytes(kernel.DerivedParams) + HeapBytes(kernel.Work.Loops);
+    for(auto & packet : kernel.Packets) ret += HeapBytes(packet.GetName());
+    for(auto & param : kernel.Params) ret += HeapBytes(param.GetName());
+    for(auto & formula : kernel.DerivedParams) ret += HeapBytes(formula);
+    for(auto & loop : kernel.Work.Loops) ret += HeapBytes(loop.Reads) + HeapBytes(loop.Writes) + HeapBytes(loop.Whole);
+
+    if(!kernel.IsMetaKernel()) return ret;
+    auto & meta = static_cast<const spec::MetaKernel &>(kernel);
+    ret += HeapBytes(meta.Tasks) + DependencyBytes(meta.Dependencies) + FamilyBytes(meta.Families);
+    for(auto & uptask : meta.Tasks) ret += sizeof(Task) + uptask->GetHeapBytes() + IfaceBytes(*uptask);
+    for(auto * ptask : {meta.Inputs.get(), meta.Outputs.get()})
+    {
+        if(ptask) ret += sizeof(Task) + ptask->GetHeapBytes() + IfaceBytes(*ptask);
+    }
+    return ret;
+}
+
+MemStats GetMemStats(const Program & prog, const spec::Platform * pplatform)
+{
+    MemStats ret;
+
+    std::size_t tasks = prog.TaskGraph.GetHeapBytes() + prog.MainTask.GetHeapBytes(), ifaces = IfaceBytes(prog.MainTask);
+    for(auto & task : prog.GetTasks())
+    {
+        tasks += task.GetHeapBytes();
+        ifaces += IfaceBytes(task);
+    }
+    ret.Tasks = tasks;
+    ret.Ifaces = ifaces;
+    ret.Dependencies = DependencyBytes(prog.Dependencies) + DependencyBytes(prog.SpecialDependencies);
+    ret.Reachability = prog.TaskReachability.GetHeapBytes();
+    ret.Levels = prog.TaskLevels.GetHeapBytes();
+    ret.Families = FamilyBytes(prog.TaskFamilies);
+
+    std::size_t groups = HeapBytes(prog.Groups) + HeapBytes(prog.Channels) + prog.Channels.size() * sizeof(Channel);
+    for(auto & upgroup : prog.Groups) groups += sizeof(TaskGroup) + upgroup->GetHeapBytes();
+    ret.Groups = groups;
+
+    std::size_t buffers = prog.ExternalBuffers.GetHeapBytes() + HeapBytes(prog.Divisions);
+    for(auto & division : prog.Divisions) buffers += division.GetHeapBytes();
+    ret.Buffers = buffers;
+
+    std::size_t kernels = prog.Kernels.bucket_count() * sizeof(void*)
+                        + prog.Kernels.size() * (sizeof(*prog.Kernels.begin()) + sizeof(void*))
+                        + HeapBytes(prog.NativeKernels) + HeapBytes(prog.SpecialKernels) + HeapBytes(prog.MetaKernels);
+    for(auto & entry : prog.Kernels) kernels += HeapBytes(entry.first);
+    for(auto * pkernels : {&prog.NativeKernels, &prog.SpecialKernels})
+    {
+        for(auto & upkernel : *pkernels) kernels += sizeof(Kernel) + KernelBytes(*upkernel);
+    }
+    for(auto & upmeta : prog.MetaKernels) kernels += sizeof(spec::MetaKernel) + KernelBytes(*upmeta);
+    ret.Kernels = kernels;
+
+    std::size_t other = HeapBytes(prog.Definitions) + HeapBytes(prog.CodeFiles) + HeapBytes(prog.AuxFiles)
+                      + HeapBytes(prog.MappedFiles) + prog.Types.bucket_count() * sizeof(void*)
+                      + prog.Types.size() * (sizeof(*prog.Types.begin()) + sizeof(void*))
+                      + prog.PassesPerformed.size() * (sizeof(std::string) + 4*sizeof(void*));
+    for(auto & def : prog.Definitions) other += HeapBytes(def.Identifier) + HeapBytes(def.Value);
+    for(auto * pfiles : {&prog.CodeFiles, &prog.AuxFiles}) for(auto & file : *pfiles) other += HeapBytes(file);
+    for(auto & file : prog.MappedFiles) other += HeapBytes(file.Packet) + HeapBytes(file.Filename);
+    for(auto & entry : prog.Types) other += HeapBytes(entry.first);
+    for(auto & name : prog.PassesPerformed) other += HeapBytes(name);
+    ret.Other = other;
+
+    if(pplatform) ret.Platform = sizeof(spec::Platform) + pplatform->GetHeapBytes();
+
+    ret.Total = ret.Tasks + ret.Ifaces + ret.Dependencies + ret.Reachability + ret.Levels + ret.Families + ret.Groups
+              + ret.Buffers + ret.Kernels + ret.Other + ret.Platform;
+    ret.ArenaReserved = prog.Memory.GetBytesReserved();
+    ret.Interned = InternedDimVec::GetTableBytes([](auto & dims) { return HeapBytes(dims); });
+    ret.Scratch = graph::ScratchSpace::GetBytesMapped();
+    return ret;
+}
+
+}} //namespace Ladybirds::impl
@@ -0,0 +1,48 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_IMPL_MEMSTATS_H
+#define LADYBIRDS_IMPL_MEMSTATS_H
+
+#include "loadstore.h"
+
+namespace Ladybirds {
+namespace spec { struct Platform; }
+namespace impl {
+struct Program;
+
+/** The memory taken by the parts of a program, in bytes, as returned by GetMemStats (and by pass MemStats).
+ *
+ *  Each category is the deep size of its structures, i.e. the objects together with what they allocate themselves.
+ *  Allocator overhead is not included, and hash tables and trees are estimated by their number of entries. The tasks,
+ *  their interface lists and the external buffers are taken from the arena of the program (Program::Memory), which
+ *  reserves memory in large chunks; ArenaReserved tells how much. It is not part of the total, nor is Interned, as the
+ *  interned dimensions of the interfaces are shared by all programs of the process. Neither is Scratch, the part of the
+ *  arrays (e.g. of Reachability) that the out-of-core mode has moved to memory-mapped files (cf. graph::ScratchSpace).
+ **/
+struct MemStats : public loadstore::LoadStorableCompound
+{
+    double Tasks = 0;        ///< Slots of the task graph, the parameters, names and type costs of the tasks
+    double Ifaces = 0;       ///< Interface lists of the tasks, with their position hints
+    double Dependencies = 0; ///< Program::Dependencies and SpecialDependencies, with the indices of their anchors
+    double Reachability = 0; ///< Program::TaskReachability
+    double Levels = 0;       ///< Program::TaskLevels
+    double Families = 0;     ///< Program::TaskFamilies
+    double Groups = 0;       ///< Task groups with their operations and ports, and the channels between them
+    double Buffers = 0;      ///< Buffers of the divisions and external buffers, and the lists of the divisions
+    double Kernels = 0;      ///< Kernels and meta-kernels, with the tasks and dependencies of the latter
+    double Other = 0;        ///< Definitions, lists of files, types and pass names
+    double Platform = 0;     ///< The platform, if one is given (cf. spec::Platform::GetHeapBytes)
+    double Total = 0;        ///< Sum of all categories above
+    double ArenaReserved = 0; ///< Bytes reserved by the arena of the program, including its free blocks
+    double Interned = 0;     ///< Table of interned dimensions of the interfaces (cf. InternedDimVec)
+    double Scratch = 0;      ///< Scratch files of all arrays out of core, shared by all programs of the process
+
+    virtual bool LoadStoreMembers(loadstore::LoadStore & ls) override;
+};
+
+/// Returns the memory taken by \p prog, and by \p pplatform if not null. Takes time linear in the size of the program.
+MemStats GetMemStats(const Program & prog, const spec::Platform * pplatform = nullptr);
+
+}} //namespace Ladybirds::impl
+
+#endif // LADYBIRDS_IMPL_MEMSTATS_H
@@ -37,38 +37,75 @@ Space IndicesAbsToRel(const Space & abs, const Space & absfull, const Space & re
     return rel;
 }
 
-template<typename T> T & deref(T & arg) { return arg; }
-template<typename T> T & deref(T * arg) { return *arg; }
-template<typename T> struct SelfMap { T at(T arg) const {return arg;} };
+/// \internal A dependency defining (part of) an interface, together with the interface where the data originates
+/// (i.e. its From interface, or where that one ends up after expansion)
+struct Definition
+{
+    const Dependency *pDep;
+    Iface *pOrigin;
+};
+inline const Dependency & GetDep(const Dependency & def) { return def; }
+inline const Dependency & GetDep(const Definition & def) { return *def.pDep; }
+inline Iface * GetOrigin(const Dependency & def) { return def.From.TheIface; }
+inline Iface * GetOrigin(const Definition & def) { return def.pOrigin; }
 
 
-/// \internal Given a dependency \p use transporting data away from a interface and a set of dependencies \p def providing
-/// the interface with this data, creates a set of dependencies from the data origin (given by the elements in \p def)
-/// to the destination (given by \p use.To) such that the interface \p use.From and \p defs[].To is bypassed.
-/// These "direct data connections" are then appended to \p results.
-template<typename T, typename TUseMap, typename TDefMap>
-void ExpandDependency(const Dependency & use, const std::vector<T> & defs, MetaKernel::DepList & results,
-                      TUseMap & usemap, TDefMap & defmap)
+/// \internal Given a dependency \p use transporting data away from a interface and a set of dependencies \p defs
+/// providing the interface with this data, creates a set of dependencies from the data origin (cf. GetOrigin) to the
+/// destination \p pto (which replaces \p use.To) such that the interface \p use.From and \p defs[].To is bypassed.
+/// These "direct data connections" are then passed to \p sink.
+template<typename T, typename TSink>
+void ExpandDependency(const Dependency & use, const std::vector<T> & defs, Iface * pto, TSink && sink)
 {
     gen::SpaceDivision<const Dependency*> sdiv(use.From.Index);
     sdiv.AssignSection(use.From.Index, nullptr);
     for(auto & elem : defs)
     {
-        auto & def = deref(elem);
+        auto & def = GetDep(elem);
         sdiv.AssignSection(def.To.Index, &def);
         for(auto & secpair : sdiv.GetSections().equal_range(&def))
         {
-            results.emplace_back(
-                Dependency::Anchor(usemap.at(def.From.TheIface), 
-                                   IndicesAbsToRel(secpair.second, def.To.Index, def.From.Index)),
-                Dependency::Anchor(defmap.at(use.To.TheIface), 
-                                   IndicesAbsToRel(secpair.second, use.From.Index, use.To.Index)));
+            sink(Dependency(Dependency::Anchor(GetOrigin(elem),
+                                               IndicesAbsToRel(secpair.second, def.To.Index, def.From.Index)),
+                            Dependency::Anchor(pto, IndicesAbsToRel(secpair.second, use.From.Index, use.To.Index))));
         }
         sdiv.Unassign(&def); if(sdiv.GetSections().empty()) break;
     }
     assert(sdiv.GetSections().empty());
 }
 
+/// \internal Index of \p iface in the interface list of its task
+inline int IfaceIndex(const Iface & iface) { return &iface - iface.GetTask()->Ifaces.data(); }
+
+/// \internal Position of an interface within a metakernel: the index of its task in MetaKernel::Tasks (or InputsIdx or
+/// OutputsIdx) and the index of the interface in that task
+struct IfaceRef { int Task, Iface; };
+constexpr int InputsIdx = -1, OutputsIdx = -2;
+
+/// \internal The interfaces of the dependencies of a metakernel, as positions. Computed once for each metakernel, such
+/// that the corresponding interfaces of its instances are found by indexing.
+struct DepLayout
+{
+    std::vector<IfaceRef> From, To;
+    
+    DepLayout(const MetaKernel & mk)
+    {
+        unordered_map<const Task*, int> taskindices;
+        taskindices.reserve(mk.Tasks.size() + 2);
+        for(int i = 0, n = mk.Tasks.size(); i < n; ++i) taskindices[mk.Tasks[i].get()] = i;
+        taskindices[mk.Inputs.get()] = InputsIdx;
+        taskindices[mk.Outputs.get()] = OutputsIdx;
+        
+        From.reserve(mk.Dependencies.size());
+        To.reserve(mk.Dependencies.size());
+        for(auto & dep : mk.Dependencies)
+        {
+            From.push_back({taskindices.at(dep.From.TheIface->GetTask()), IfaceIndex(*dep.From.TheIface)});
+            To.push_back({taskindices.at(dep.To.TheIface->GetTask()), IfaceIndex(*dep.To.TheIface)});
+        }
+    }
+};
+
 void FillD2D(unordered_map<const Iface*, Iface*> &d2d, const Task & taskFrom, Task & TaskTo)
 {
     auto & fromifaces = taskFrom.Ifaces;
@@ -89,6 +126,19 @@ D2DMap CreateD2DMap(const MetaKernel & mkFrom, MetaKernel & mkTo)
     FillD2D(d2d, *mkFrom.Outputs, *mkTo.Outputs);
     return d2d;
 }
+
+using RebaseMap = unordered_map<const TaskPath*, std::shared_ptr<const TaskPath>>;
+
+/// \internal Returns the path \p ppath, relative to the meta-kernel an instance is expanded from, with the path of that
+/// instance (i.e. \p rebased[nullptr]) as prefix. The paths created so far are kept in \p rebased, so all tasks of a
+/// nested instance share the same one.
+std::shared_ptr<const TaskPath> Rebase(const TaskPath * ppath, RebaseMap & rebased)
+{
+    auto it = rebased.find(ppath);
+    if(it != rebased.end()) return it->second;
+    auto parent = Rebase(ppath->Parent.get(), rebased);
+    return rebased[ppath] = std::make_shared<const TaskPath>(std::move(parent), ppath->Name);
+}
 } //namespace ::
 
 MetaKernel::MetaKernel ( const MetaKernel& other )
@@ -97,7 +147,8 @@ MetaKernel::MetaKernel ( const MetaKernel& other )
    Inputs(std::make_unique<Task>(this, "<meta-kernel inputs>",
                                  other.Inputs->GetParameters(), other.Inputs->GetDerivedParameters())),
    Outputs(std::make_unique<Task>(this, "<meta-kernel outputs>", 
-                                  other.Outputs->GetParameters(), other.Outputs->GetDerivedParameters()))
+                                  other.Outputs->GetParameters(), other.Outputs->GetDerivedParameters())),
+   Families(other.Families)
 {
     // Now copy dependencies. Problem here: Have to update iface pointers
     D2DMap d2d = CreateD2DMap(other, *this);
@@ -163,130 +214,227 @@ void AdjustBufferHints(Task & target, Task & source, Task & parent)
 
 MetaKernel::TaskList::iterator MetaKernel::Expand(TaskList::iterator itTask)
 {
-    auto uptask = std::move(*itTask);
-    auto retpos = itTask - Tasks.begin();
-    Tasks.erase(itTask);
+    auto pos = itTask - Tasks.begin();
+    auto * pkernel = (*itTask)->GetKernel();
+    assert(pkernel->IsMetaKernel());
+    auto * pmk = static_cast<const MetaKernel*>(pkernel);
     
-    Task * ptask = uptask.get();
-    assert(ptask);
-    const MetaKernel & mk = *static_cast<MetaKernel*>(ptask->GetKernel());
-    assert(mk.IsMetaKernel());
+    std::vector<const MetaKernel*> expansions(Tasks.size(), nullptr);
+    expansions[pos] = pmk;
+    ExpandInstances(expansions);
+    return Tasks.begin() + pos + pmk->Tasks.size();
+}
+
+void MetaKernel::ExpandInstances(const std::vector<const MetaKernel*> & expansions)
+{
+    assert(expansions.size() == Tasks.size());
     
-    //Copy all tasks from expansion target to this meta-kernel, adjusting the buffer position hints
-    //Cannot move because we can only destroy the task, but not the meta-kernel it instantiates
-    std::string nameprefix = ptask->Name + '.';
-    auto oldsize = Tasks.size();
-    Tasks.reserve(oldsize + mk.Tasks.size());
-    for(auto & upTask : mk.Tasks)
+    // The instances to replace, in the order of Tasks. Until it is expanded, an instance collects the dependencies
+    // between its interfaces and the outside: those providing its inputs (by interface) and those using its outputs.
+    struct Instance
+    {
+        Task * pTask;
+        const MetaKernel * pMk;
+        const DepLayout * pLayout;
+        size_t Base; // index of the first of its tasks in the new task list
+        std::vector<DepList> Inputs;
+        DepList Outputs;
+    };
+    std::vector<Instance> instances;
+    unordered_map<const MetaKernel*, DepLayout> layouts;
+    unordered_map<const Task*, int> instindices;
+    size_t newsize = 0;
+    std::vector<size_t> newindices(Tasks.size() + 1); // index of each task (or of its first one) in the new list
+    for(size_t i = 0; i < Tasks.size(); ++i)
     {
-        Tasks.push_back(std::make_unique<Task>(*upTask));
-        Tasks.back()->Name.insert(0, nameprefix);
-        AdjustBufferHints(*Tasks.back(), *upTask, *ptask);
+        newindices[i] = newsize;
+        auto * pmk = expansions[i];
+        if(!pmk)
+        {
+            ++newsize;
+            continue;
+        }
+        auto itlayout = layouts.find(pmk);
+        if(itlayout == layouts.end()) itlayout = layouts.emplace(pmk, DepLayout(*pmk)).first;
+        instindices[Tasks[i].get()] = instances.size();
+        instances.push_back(Instance{Tasks[i].get(), pmk, &itlayout->second, newsize, {}, {}});
+        instances.back().Inputs.resize(Tasks[i]->Ifaces.size());
+        newsize += pmk->Tasks.size();
     }
+    newindices.back() = newsize;
+    if(instances.empty()) return;
     
-    //Correspondency maps for interfaces
-    D2DMap d2d;
-    for(auto i = mk.Tasks.size(); i-- > 0; )
-        FillD2D(d2d, *mk.Tasks[i], *Tasks[oldsize+i]);
-
-    unordered_map<const Iface*, const Iface*> outifaces, inifaces;
-    int nifaces = ptask->Ifaces.size();
-    outifaces.reserve(nifaces); inifaces.reserve(nifaces);
-    for(int i = 0; i < nifaces; ++i)
+    // Passes a dependency on to the first of the instances at its ends that is still to be expanded (instances are
+    // expanded in order, so the dependencies created later only touch instances that come later), or keeps it.
+    DepList newdeps;
+    newdeps.reserve(Dependencies.size());
+    auto instanceof = [&instindices](const Iface * piface)
     {
-        outifaces[&mk.Outputs->Ifaces[i]] = &ptask->Ifaces[i];
-        inifaces[&ptask->Ifaces[i]]  = &mk.Inputs->Ifaces[i];
+        const Task * ptask = piface->GetTask();
+        if(!ptask->GetKernel()->IsMetaKernel()) return -1;
+        auto it = instindices.find(ptask);
+        return it == instindices.end() ? -1 : it->second;
+    };
+    auto route = [&](Dependency && dep)
+    {
+        int ifrom = instanceof(dep.From.TheIface), ito = instanceof(dep.To.TheIface);
+        assert(ifrom < 0 || ifrom != ito);
+        if(ifrom < 0 && ito < 0) newdeps.push_back(std::move(dep));
+        else if(ito < 0 || (ifrom >= 0 && ifrom < ito)) instances[ifrom].Outputs.push_back(std::move(dep));
+        else instances[ito].Inputs[IfaceIndex(*dep.To.TheIface)].push_back(std::move(dep));
+    };
+    for(auto & dep : Dependencies) route(std::move(dep));
+    
+    //Copy the tasks of the instantiated meta-kernels in place of the instances, adjusting the buffer position hints.
+    //Cannot move because we can only destroy the instances, but not the meta-kernels they instantiate
+    //The names stay the same, only the paths get the instance as prefix
+    TaskList newtasks;
+    newtasks.reserve(newsize);
+    RebaseMap rebased;
+    auto itinst = instances.begin();
+    for(size_t i = 0; i < Tasks.size(); ++i)
+    {
+        if(!expansions[i])
+        {
+            newtasks.push_back(std::move(Tasks[i]));
+            continue;
+        }
+        Task * ptask = itinst->pTask;
+        rebased.clear();
+        rebased[nullptr] = std::make_shared<const TaskPath>(ptask->Path, ptask->Name);
+        for(auto & upTask : itinst->pMk->Tasks)
+        {
+            newtasks.push_back(std::make_unique<Task>(*upTask));
+            newtasks.back()->Path = Rebase(upTask->Path.get(), rebased);
+            AdjustBufferHints(*newtasks.back(), *upTask, *ptask);
+        }
+        ++itinst;
     }
     
-    //Move all dependencies between this metakernel and the target inputs/outputs to separate containers
-    unordered_map<const Iface*, std::vector<Dependency>> outer_inputs;
-    std::deque<Dependency> outer_outputs;
-    auto newend = std::remove_if(Dependencies.begin(), Dependencies.end(), [&](auto & dep)
+    for(auto & inst : instances)
+    {
+        const MetaKernel & mk = *inst.pMk;
+        const DepLayout & layout = *inst.pLayout;
+        auto resolve = [&](IfaceRef ref) { return &newtasks[inst.Base + ref.Task]->Ifaces[ref.Iface]; };
+        
+        //Now process dependencies of mk
+        size_t nifaces = inst.pTask->Ifaces.size();
+        std::vector<std::vector<Definition>> inner_outputs(nifaces);
+        std::vector<DepList> inner_outputs_extra(nifaces); //lists of temporary dependencies
+        for(size_t idep = 0, ndeps = mk.Dependencies.size(); idep < ndeps; ++idep)
         {
-            Iface *fromiface = dep.From.TheIface, *toiface = dep.To.TheIface;
-            if(toiface->GetTask() == ptask)
-            {
-                assert(fromiface->GetTask() != ptask);
-                outer_inputs[inifaces.at(toiface)].push_back(std::move(dep));
-                return true;
+            const Dependency & innerdep = mk.Dependencies[idep];
+            IfaceRef from = layout.From[idep], to = layout.To[idep];
+            if(from.Task == InputsIdx)
+            { // dependencies using input packets: extract and add to this object's dependencies
+                auto & defs = inst.Inputs[from.Iface];
+                if(to.Task == OutputsIdx)
+                {   // special case: Input goes directly to output. This happens for untouched inouts.
+                    // In this case, we need two extractions, one for the input and one for the output interface.
+                    // The first extraction happens here, to a special container for the resulting (temporary)
+                    // dependencies.
+                    auto & extra = inner_outputs_extra[to.Iface];
+                    ExpandDependency(innerdep, defs, innerdep.To.TheIface,
+                                     [&extra](Dependency && dep) { extra.push_back(std::move(dep)); });
+                }
+                else ExpandDependency(innerdep, defs, resolve(to), route);
             }
-            if(fromiface->GetTask() == ptask)
-            {
-                outer_outputs.push_back(std::move(dep));
-                return true;
+            else if(to.Task == OutputsIdx)
+            { //dependencies defining values of output packets: store in a container for later extraction
+                inner_outputs[to.Iface].push_back({&innerdep, resolve(from)});
             }
-            return false;
-        });
-    Dependencies.erase(newend, Dependencies.end());
-    
-    //Now process dependencies of mk
-    unordered_map<const Iface*, std::vector<const Dependency*>> inner_outputs;
-    unordered_map<const Iface*, DepList> inner_outputs_extra; //list of temporary dependencies
-    
-    Dependencies.reserve(Dependencies.size() + mk.Dependencies.size());
-    for(const Dependency & innerdep : mk.Dependencies)
-    {
-        if(innerdep.From.TheIface->GetTask() == mk.Inputs.get())
-        { // dependencies using input packets: extract and add to this object's dependencies
-            SelfMap<Iface*> selfmap;
-            if(innerdep.To.TheIface->GetTask() == mk.Outputs.get())
-            {   // special case: Input goes directly to output. This happens for untouched inouts.
-                // In this case, we need two extractions, one for the input and one for the output interface.
-                // The first extraction happens here, to a special container for the resulting (temporary) dependencies.
-                ExpandDependency(innerdep, outer_inputs.at(innerdep.From.TheIface),
-                                 inner_outputs_extra[outifaces.at(innerdep.To.TheIface)], selfmap, selfmap);
+            else
+            { // internal dependencies (i.e. between different tasks of mk): just copy to this object's dependencies
+                route(Dependency(Dependency::Anchor(resolve(from), innerdep.From.Index),
+                                 Dependency::Anchor(resolve(to), innerdep.To.Index)));
             }
-            else ExpandDependency(innerdep, outer_inputs.at(innerdep.From.TheIface), Dependencies, selfmap, d2d);
         }
-        else if(innerdep.To.TheIface->GetTask() == mk.Outputs.get())
-        { //dependencies defining values of output packets: store in a container for later extraction
-            inner_outputs[outifaces.at(innerdep.To.TheIface)].push_back(&innerdep);
+        
+        for(size_t i = 0; i < nifaces; ++i)
+        {
+            auto & lst = inner_outputs[i];
+            lst.reserve(lst.size() + inner_outputs_extra[i].size());
+            for(auto & dep : inner_outputs_extra[i]) lst.push_back({&dep, dep.From.TheIface});
         }
-        else
-        { // internal dependencies (i.e. between different tasks of mk): just copy to this object's dependencies
-            Dependencies.emplace_back(Dependency::Anchor(d2d.at(innerdep.From.TheIface), innerdep.From.Index),
-                                      Dependency::Anchor(d2d.at(innerdep.To.TheIface), innerdep.To.Index));
+        
+        // now extract output dependencies:
+        // do this separately because it is easier to iterate over all possible defs for one use than the other way
+        for(const Dependency & use : inst.Outputs)
+        {
+            ExpandDependency(use, inner_outputs[IfaceIndex(*use.From.TheIface)], use.To.TheIface, route);
         }
+        inst.Inputs.clear();
+        inst.Outputs.clear();
     }
     
-    for(auto & pair : inner_outputs_extra)
+    Dependencies = std::move(newdeps);
+    Tasks = std::move(newtasks); // also destroys the instances
+    
+    //The families now range over the contents of the instances in their iterations (the shifts of which are fitted
+    //anew). The families of an expanded meta-kernel are kept for its instances outside of these.
+    FamilyList families;
+    for(auto & fam : Families)
     {
-        auto & lst = inner_outputs[pair.first];
-        lst.reserve(lst.size()+pair.second.size());
-        for(auto & dep : pair.second)
-        {
-            lst.push_back(&dep);
-            d2d[dep.From.TheIface] = dep.From.TheIface;
-        }
+        fam.Period = newindices[fam.First + fam.Period] - newindices[fam.First];
+        fam.First = newindices[fam.First];
+        if(fam.Fit(Tasks)) families.push_back(std::move(fam));
     }
-    
-    // now extract output dependencies:
-    // do this separately because it is easier to iterate over all possible defs for one use than the other way round
-    for(const Dependency & use : outer_outputs)
+    size_t nown = families.size(), ifam = 0;
+    for(auto & inst : instances)
     {
-        SelfMap<Iface*> selfmap;
-        ExpandDependency(use, inner_outputs.at(use.From.TheIface), Dependencies, d2d, selfmap);
+        while(ifam < nown && families[ifam].First + families[ifam].GetTaskCount() <= inst.Base) ++ifam;
+        if(ifam < nown && families[ifam].First <= inst.Base) continue;
+        for(auto & fam : inst.pMk->Families)
+        {
+            families.push_back(fam);
+            families.back().First += inst.Base;
+        }
     }
-    
-    return Tasks.begin()+retpos;
+    std::sort(families.begin(), families.end(),
+              [](const TaskFamily & a, const TaskFamily & b) { return a.First < b.First; });
+    Families = std::move(families);
 }
 
 void MetaKernel::Flatten()
 {
-    for(auto it = Tasks.begin(); it != Tasks.end(); )
+    FlatCopies copies;
+    Flatten(copies);
+}
+
+void MetaKernel::Flatten(FlatCopies & copies)
+{
+    // Expand each instance into the flattened copy of its meta-kernel, which is made only once. So every task is
+    // copied only once, and all instances are expanded in a single pass over the tasks and dependencies.
+    std::vector<const MetaKernel*> expansions(Tasks.size(), nullptr);
+    bool any = false;
+    for(size_t i = 0; i < Tasks.size(); ++i)
     {
-        if((*it)->GetKernel()->IsMetaKernel()) it = Expand(it);
-        else ++it;
+        auto * pkernel = Tasks[i]->GetKernel();
+        if(!pkernel->IsMetaKernel()) continue;
+        auto * pmk = static_cast<const MetaKernel*>(pkernel);
+        auto & upcopy = copies[pmk];
+        if(!upcopy)
+        {
+            upcopy = std::make_unique<MetaKernel>(*pmk);
+            upcopy->Flatten(copies);
+        }
+        expansions[i] = upcopy.get();
+        any = true;
     }
+    if(any) ExpandInstances(expansions);
 }
 
 bool MetaKernel::LoadStoreMembers(loadstore::LoadStore &ls)
 {
+    // the interface tasks get their kernel (this one) and interfaces while being loaded
+    if(ls.IsLoading()) Inputs = std::make_unique<Task>(), Outputs = std::make_unique<Task>();
+    
     return Kernel::LoadStoreMembers(ls)
         & ls.IO_Register("tasks", Tasks)
         & ls.IO_Register("inputs", *Inputs)
         & ls.IO_Register("outputs", *Outputs)
-        & ls.IO("dependencies", Dependencies);
+        & ls.IO("dependencies", Dependencies)
+        & ls.IO("families", Families, false);
 }
 
 
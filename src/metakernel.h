@@ -4,10 +4,12 @@
 #define LADYBIRDS_SPEC_METAKERNEL_H
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include "dependency.h"
 #include "kernel.h"
 #include "task.h"
+#include "taskfamily.h"
 
 namespace Ladybirds { namespace spec {
 
@@ -16,10 +18,12 @@ class MetaKernel : public Kernel
 public:
     using TaskList = std::vector<std::unique_ptr<Task>>;
     using DepList = std::vector<Dependency>;
+    using FamilyList = std::vector<TaskFamily>;
     
     TaskList Tasks;
     std::unique_ptr<Task> Inputs, Outputs;
     DepList Dependencies;
+    FamilyList Families; ///< Loops over the tasks (cf. TaskFamily), disjoint and sorted by TaskFamily::First
 
 public:
     //! Creates an *uninitialized* metakernel. After setting up input/output packets, call InitInterface.
@@ -36,12 +40,21 @@ public:
     
     //! Replaces the meta-kernel instance at \p it with its contents (i.e. its internal tasks and dependencies).
     /** The object pointed to by \p it must be task of this meta-kernel, and must be an instance of a meta-kernel.
-        Returns an iterator to the task following \p it. All iterators at or after \p it are invalidated. **/ 
+        Returns an iterator to the task following the inserted ones. All iterators are invalidated. **/ 
     TaskList::iterator Expand(TaskList::iterator itTask);
     //! Recursively expands all meta-kernel instance in this meta-kernel's task list (cf. Expand()).
+    /** Runs in time linear in the size of the result: each instantiated meta-kernel is flattened only once. **/
     void Flatten();
     
     virtual bool LoadStoreMembers(loadstore::LoadStore& ls) override;
+    
+private:
+    using FlatCopies = std::unordered_map<const MetaKernel*, std::unique_ptr<MetaKernel>>;
+    //! Flattens, using (and adding to) the flattened copies of the meta-kernels in \p copies
+    void Flatten(FlatCopies & copies);
+    //! Replaces each task with a non-null entry in \p expansions (same size as Tasks) with the contents of that
+    //! meta-kernel, keeping the order of the tasks
+    void ExpandInstances(const std::vector<const MetaKernel*> & expansions);
 };
 
 }} // namespace Ladybirds::spec
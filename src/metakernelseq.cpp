@@ -14,6 +14,7 @@
 #include "range.h"
 #include "spacedivision.h"
 #include "task.h"
+#include "taskfamily.h"
 #include "tools.h"
 
 namespace Ladybirds { namespace parse {
@@ -169,6 +170,19 @@ MetaKernelSeq::MetaKernelSeq(spec::MetaKernel * pmetakernel)
 }
 
 
+void MetaKernelSeq::AddLoop(const std::vector<size_t> & starts, size_t end)
+{
+    if(starts.size() < 2) return;
+    size_t period = starts[1] - starts[0];
+    if(period == 0) return;
+    for(size_t i = 1; i < starts.size(); ++i)
+    {
+        if((i + 1 < starts.size() ? starts[i+1] : end) - starts[i] != period) return;
+    }
+    Loops.push_back(Loop{starts[0], (int) period, (int) starts.size()});
+}
+
+
 namespace {
 
 Space IndicesAbsToRel(const Space & abs, const Space & ref, const std::vector<int> & relvdims)
@@ -252,7 +266,7 @@ bool MetaKernelSeq::TranslateToMetaKernel(std::string& errors)
             auto & vardefs = defs.at(&var);
             
             auto subdiv = vardefs.SubDivision(arg.GetIndices());
-            for(auto secpair : subdiv.GetSections())
+            for(const auto & secpair : subdiv.GetSections())
             {
                 auto *pdef = secpair.first;
                 const Space & defrange = secpair.second;
@@ -308,6 +322,34 @@ bool MetaKernelSeq::TranslateToMetaKernel(std::string& errors)
             }
         }
     }
+    
+    // Describe the loops whose iterations repeat the same tasks as task families. As the inner loops come first, a
+    // loop whose first iteration is exactly an inner family replaces it by a family with one more dimension.
+    // (There is one task for each operation, so the loops also give the task indices.)
+    for(auto & loop : Loops)
+    {
+        spec::TaskFamily fam;
+        fam.Domain = {loop.Count};
+        fam.First = loop.First, fam.Period = loop.Period;
+        if(!fam.Fit(mk.Tasks)) continue;
+        
+        auto itinner = std::find_if(mk.Families.begin(), mk.Families.end(), [&loop](const spec::TaskFamily & f)
+            { return f.First == loop.First && f.GetTaskCount() == (size_t) loop.Period; });
+        if(itinner != mk.Families.end())
+        {
+            spec::TaskFamily nested = fam;
+            nested.Period = itinner->Period;
+            nested.Domain.insert(nested.Domain.end(), itinner->Domain.begin(), itinner->Domain.end());
+            if(nested.Fit(mk.Tasks)) fam = std::move(nested);
+        }
+        size_t end = fam.First + fam.GetTaskCount();
+        mk.Families.erase(std::remove_if(mk.Families.begin(), mk.Families.end(),
+                              [&](const spec::TaskFamily & f) { return f.First >= fam.First && f.First < end; }),
+                          mk.Families.end());
+        mk.Families.push_back(std::move(fam));
+    }
+    std::sort(mk.Families.begin(), mk.Families.end(),
+              [](const spec::TaskFamily & a, const spec::TaskFamily & b) { return a.First < b.First; });
     return errors.empty();
 }
 
@@ -33,12 +33,19 @@ public:
         const spec::Packet * pVar = nullptr;
         int ParentIfaceIndex = -1;
     };
+    //! A loop over generator variables, each iteration of which added Period operations, starting at operation First
+    struct Loop
+    {
+        size_t First;
+        int Period, Count;
+    };
     
 public:
     std::deque<spec::Packet> Variables;
     std::unordered_map<const clang::ValueDecl *, Declaration> DeclMap;
     std::unordered_set<const clang::ValueDecl *> GenVars;
     std::vector<KernelCall> Operations;
+    std::vector<Loop> Loops; ///< Candidates for task families (cf. spec::TaskFamily), inner loops before outer ones
     spec::MetaKernel * pMetaKernel; ///< Points to the graph representation of the metakernel, which is to be created
     
 public:
@@ -46,6 +53,9 @@ public:
     MetaKernelSeq ( const MetaKernelSeq &other ) = delete; //disabled by default
     MetaKernelSeq &operator= ( const MetaKernelSeq &other ) = delete; //dito
     
+    //! Records a loop whose iterations started at the operations \p starts and which ended before operation \p end,
+    //! if all iterations added the same number of operations
+    void AddLoop(const std::vector<size_t> & starts, size_t end);
     //! Converts the metakernel from a sequential representation to a graph representation, and stores it in pMetaKernel
     bool TranslateToMetaKernel(std::string& errors);
 };
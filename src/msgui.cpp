@@ -5,8 +5,11 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <string>
+#include <utility>
 
 MsgUI gMsgUI(stderr);
+thread_local MsgUI::Buffer * MsgUI::pBuffer_ = nullptr;
 
 class MsgUI::OutputImpl : private std::basic_streambuf<char, std::char_traits<char> >
 {
@@ -61,6 +64,31 @@ int MsgUI::OutputImpl::sync()
 
 
 
+/// \internal Returns \p msg formatted with \p args like vprintf
+static std::string FormatMsg(const char * msg, va_list args)
+{
+    va_list copy;
+    va_copy(copy, args);
+    int size = vsnprintf(nullptr, 0, msg, copy);
+    va_end(copy);
+    if(size < 0) return msg;
+    std::string ret(size + 1, '\0');
+    vsnprintf(&ret[0], ret.size(), msg, args);
+    ret.resize(size);
+    return ret;
+}
+
+MsgUI::Buffer::Scope::Scope(Buffer & buffer) : pPrevious_(pBuffer_)
+{
+    pBuffer_ = &buffer;
+}
+
+MsgUI::Buffer::Scope::~Scope()
+{
+    pBuffer_ = pPrevious_;
+}
+
+
 MsgUI::MsgUI(FILE *outfile, FILE *verboseFile) 
 {
     open(outfile, verboseFile);
@@ -83,7 +111,7 @@ std::ostream & MsgUI::Fatal(const char *msg, ...)
     va_list va; va_start(va, msg);
     PrintMsg("Fatal error", msg, va);
     va_end(va);
-    return Output_->Stream();
+    return pBuffer_ ? pBuffer_->Output_ : Output_->Stream();
 }
 
 std::ostream & MsgUI::Error(const char *msg, ...)
@@ -95,10 +123,11 @@ std::ostream & MsgUI::Error(const char *msg, ...)
     constexpr int limit = 1000;
     if(++NumErrors_ > limit)
     {
+        if(pBuffer_) Print(*pBuffer_);
         fprintf(Output_->FileHandle(), "More than %d errors. Exiting.\n", limit);
         exit(1);
     }
-    return Output_->Stream();
+    return pBuffer_ ? pBuffer_->Output_ : Output_->Stream();
 }
 
 std::ostream & MsgUI::Warning(const char *msg, ...)
@@ -106,7 +135,7 @@ std::ostream & MsgUI::Warning(const char *msg, ...)
     va_list va; va_start(va, msg);
     PrintMsg("Warning", msg, va);
     va_end(va);
-    return Output_->Stream();
+    return pBuffer_ ? pBuffer_->Output_ : Output_->Stream();
 }
 
 std::ostream & MsgUI::Info(const char *msg, ...)
@@ -114,27 +143,60 @@ std::ostream & MsgUI::Info(const char *msg, ...)
     va_list va; va_start(va, msg);
     PrintMsg("Info", msg, va);
     va_end(va);
-    return Output_->Stream();
+    return pBuffer_ ? pBuffer_->Output_ : Output_->Stream();
 }
 
 std::ostream & MsgUI::Verbose(const char *msg, ...)
 {
     auto f = Verbose_->FileHandle();
-    if(!f || !msg) return Verbose_->Stream();
+    if(!f || !msg) return (f && pBuffer_) ? pBuffer_->Verbose_ : Verbose_->Stream();
     va_list va; va_start(va, msg);
-    vfprintf(f, msg, va);
+    if(pBuffer_) pBuffer_->Verbose_ << FormatMsg(msg, va) << '\n';
+    else
+    {
+        flockfile(f); // keeps the lines of concurrent parsers (cf. parse::LoadCSpec) apart
+        vfprintf(f, msg, va);
+        fputc('\n', f);
+        funlockfile(f);
+    }
     va_end(va);
-    fputc('\n', f);
-    return Output_->Stream();
+    return pBuffer_ ? pBuffer_->Output_ : Output_->Stream();
 }
 
 void MsgUI::PrintMsg(const char *classification, const char *msg, va_list args)
 {
     if(!msg) return;
+    if(pBuffer_)
+    {
+        pBuffer_->Output_ << classification << ": " << FormatMsg(msg, args) << '\n';
+        return;
+    }
     
     auto f = Output_->FileHandle();
+    flockfile(f);
     fputs(classification, f);
     fputs(": ", f);
     vfprintf(f, msg, args);
     fputc('\n', f);
+    funlockfile(f);
+}
+
+void MsgUI::Print(Buffer & buffer)
+{
+    auto output = buffer.Output_.str(), verbose = buffer.Verbose_.str();
+    buffer.Output_.str(""), buffer.Verbose_.str("");
+    if(pBuffer_ && pBuffer_ != &buffer)
+    {
+        pBuffer_->Output_ << output;
+        pBuffer_->Verbose_ << verbose;
+        return;
+    }
+    
+    for(auto pair : {std::make_pair(Output_->FileHandle(), &output), std::make_pair(Verbose_->FileHandle(), &verbose)})
+    {
+        if(!pair.first || pair.second->empty()) continue;
+        flockfile(pair.first);
+        fwrite(pair.second->data(), 1, pair.second->size(), pair.first);
+        funlockfile(pair.first);
+    }
 }
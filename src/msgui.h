@@ -3,17 +3,40 @@
 #ifndef MSGUI_H
 #define MSGUI_H
 
+#include <atomic>
 #include <cstdio>
 #include <iostream>
 #include <memory>
+#include <sstream>
 
 
 class MsgUI
 {
+public:
+    //! Collects the messages of a thread instead of printing them right away, such that the messages of work done
+    //! concurrently can be printed in a fixed order (cf. Print). Messages go to the buffer of the innermost Scope.
+    class Buffer
+    {
+        friend class MsgUI;
+        std::ostringstream Output_, Verbose_;
+        
+    public:
+        class Scope
+        {
+            Buffer * pPrevious_;
+        public:
+            explicit Scope(Buffer & buffer);
+            ~Scope();
+            Scope(const Scope &) = delete;
+            Scope & operator=(const Scope &) = delete;
+        };
+    };
+
 private:
     class OutputImpl;
     std::unique_ptr<OutputImpl> Output_, Verbose_;
-    int NumErrors_ = 0;
+    std::atomic<int> NumErrors_{0};
+    static thread_local Buffer * pBuffer_;
 
 public:
     MsgUI(FILE *outfile, FILE *verboseFile = nullptr);
@@ -27,6 +50,9 @@ public:
     std::ostream & Info(const char * msg = nullptr, ...);
     std::ostream & Verbose(const char * msg = nullptr, ...);
     
+    //! Prints the messages collected in \p buffer (to the buffer of the calling thread, if it has one) and clears them
+    void Print(Buffer & buffer);
+    
 private:
     void PrintMsg(const char * classification, const char * msg, va_list args);
 };
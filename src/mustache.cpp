@@ -0,0 +1,234 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "mustache.h"
+
+#include <cstddef>
+
+using std::string;
+using std::vector;
+
+namespace Ladybirds {
+namespace tools {
+
+const MustacheValue MustacheValue::Nil;
+
+namespace {
+/// \internal Returns \p str without leading and trailing white space
+string Trim(const string & str)
+{
+    auto begin = str.find_first_not_of(" \t\r\n"), end = str.find_last_not_of(" \t\r\n");
+    return begin == string::npos ? string() : str.substr(begin, end + 1 - begin);
+}
+
+/// \internal Splits a dotted name into its parts; "." yields none
+vector<string> SplitPath(const string & name)
+{
+    vector<string> path;
+    if(name == ".") return path;
+    for(size_t pos = 0; ; )
+    {
+        size_t dot = name.find('.', pos);
+        path.push_back(name.substr(pos, dot - pos));
+        if(dot == string::npos) return path;
+        pos = dot + 1;
+    }
+}
+} //namespace ::
+
+
+/// The state while rendering: the stack of values that names are looked up in, and the innermost list iteration
+struct MustacheTemplate::Context
+{
+    vector<const MustacheValue*> Stack;
+    bool InList = false, LastItem = false;
+
+    const MustacheValue & Lookup(const vector<string> & path) const
+    {
+        if(path.empty()) return *Stack.back();
+
+        const MustacheValue * pval = nullptr;
+        for(auto it = Stack.rbegin(); it != Stack.rend() && !pval; ++it)
+        {
+            auto itfield = (*it)->Fields.find(path.front());
+            if(itfield != (*it)->Fields.end()) pval = itfield->second;
+        }
+        for(size_t i = 1; i < path.size() && pval; ++i)
+        {
+            auto itfield = pval->Fields.find(path[i]);
+            pval = (itfield == pval->Fields.end()) ? nullptr : itfield->second;
+        }
+        return pval ? *pval : MustacheValue::Nil;
+    }
+};
+
+
+bool MustacheTemplate::Parse(const string & text, string & error)
+{
+    Nodes_.clear();
+    string open = "«", close = "»";
+    vector<vector<Node>*> nested = { &Nodes_ }; // the node lists of the open sections
+    vector<string> names = { "" };               // the names of the open sections
+    auto addtext = [&nested](const string & str)
+    {
+        if(str.empty()) return;
+        auto & nodes = *nested.back();
+        if(nodes.empty() || nodes.back().Type != Node::Kind::Text) nodes.push_back({ Node::Kind::Text, str, {}, {} });
+        else nodes.back().Text += str;
+    };
+
+    size_t pos = 0;
+    while(pos < text.size())
+    {
+        size_t tagbegin = text.find(open, pos);
+        if(tagbegin == string::npos) break;
+        addtext(text.substr(pos, tagbegin - pos));
+        size_t contentbegin = tagbegin + open.size();
+
+        if(text.compare(contentbegin, 1, "!") == 0)
+        { // comments end at the matching closing delimiter
+            int depth = 1;
+            pos = contentbegin;
+            while(depth > 0)
+            {
+                size_t nextopen = text.find(open, pos), nextclose = text.find(close, pos);
+                if(nextclose == string::npos)
+                {
+                    error = "Unterminated comment";
+                    return false;
+                }
+                if(nextopen < nextclose) ++depth, pos = nextopen + open.size();
+                else --depth, pos = nextclose + close.size();
+            }
+            continue;
+        }
+
+        size_t tagend = text.find(close, contentbegin);
+        if(tagend == string::npos)
+        {
+            error = "Unterminated tag " + text.substr(tagbegin, 20);
+            return false;
+        }
+        pos = tagend + close.size();
+        string tag = Trim(text.substr(contentbegin, tagend - contentbegin));
+        char sigil = tag.empty() ? '\0' : tag[0];
+
+        if(sigil == '=' && tag.size() > 1 && tag.back() == '=')
+        {
+            string delims = Trim(tag.substr(1, tag.size() - 2));
+            size_t space = delims.find_first_of(" \t");
+            if(space == string::npos)
+            {
+                error = "Invalid delimiters " + tag;
+                return false;
+            }
+            open = delims.substr(0, space), close = Trim(delims.substr(space));
+            continue;
+        }
+
+        if(sigil == '#' || sigil == '^' || sigil == ':')
+        {
+            string name = (sigil == ':') ? ":" : Trim(tag.substr(1));
+            auto type = (sigil == '#') ? Node::Kind::Section
+                      : (sigil == '^') ? Node::Kind::Inverted : Node::Kind::Separator;
+            nested.back()->push_back({ type, "", sigil == ':' ? vector<string>() : SplitPath(name), {} });
+            nested.push_back(&nested.back()->back().Children);
+            names.push_back(name);
+        }
+        else if(sigil == '/')
+        {
+            string name = Trim(tag.substr(1));
+            if(nested.size() == 1 || names.back() != name)
+            {
+                error = "Unexpected closing tag " + tag + (nested.size() == 1 ? "" : ", expected /" + names.back());
+                return false;
+            }
+            nested.pop_back();
+            names.pop_back();
+        }
+        else
+        {
+            if(sigil == '&' || sigil == '{') tag = Trim(tag.substr(1));
+            if(sigil == '{' && !tag.empty() && tag.back() == '}') tag.pop_back();
+            nested.back()->push_back({ Node::Kind::Variable, "", SplitPath(Trim(tag)), {} });
+        }
+    }
+    if(nested.size() > 1)
+    {
+        error = "Unclosed section " + names.back();
+        return false;
+    }
+    if(pos < text.size()) addtext(text.substr(pos));
+    return true;
+}
+
+void MustacheTemplate::CollectNames(std::unordered_set<string> & names) const
+{
+    CollectNames(Nodes_, names);
+}
+
+void MustacheTemplate::CollectNames(const vector<Node> & nodes, std::unordered_set<string> & names)
+{
+    for(auto & node : nodes)
+    {
+        names.insert(node.Path.begin(), node.Path.end());
+        CollectNames(node.Children, names);
+    }
+}
+
+void MustacheTemplate::Render(const MustacheValue & model, string & out) const
+{
+    Context ctx;
+    ctx.Stack.push_back(&model);
+    Render(Nodes_, ctx, out);
+}
+
+void MustacheTemplate::Render(const vector<Node> & nodes, Context & ctx, string & out)
+{
+    for(auto & node : nodes)
+    {
+        switch(node.Type)
+        {
+            case Node::Kind::Text:
+                out += node.Text;
+                break;
+            case Node::Kind::Variable:
+            {
+                auto & val = ctx.Lookup(node.Path);
+                if(val.Type == MustacheValue::Kind::Scalar) out += val.Text;
+                break;
+            }
+            case Node::Kind::Separator:
+                if(ctx.InList && !ctx.LastItem) Render(node.Children, ctx, out);
+                break;
+            case Node::Kind::Inverted:
+                if(!ctx.Lookup(node.Path).IsTruthy()) Render(node.Children, ctx, out);
+                break;
+            case Node::Kind::Section:
+            {
+                auto & val = ctx.Lookup(node.Path);
+                if(!val.IsTruthy()) break;
+                if(val.Items.empty())
+                {
+                    ctx.Stack.push_back(&val);
+                    Render(node.Children, ctx, out);
+                    ctx.Stack.pop_back();
+                    break;
+                }
+
+                bool inlist = ctx.InList, lastitem = ctx.LastItem;
+                ctx.InList = true;
+                for(size_t i = 0; i < val.Items.size(); ++i)
+                {
+                    ctx.LastItem = (i + 1 == val.Items.size());
+                    ctx.Stack.push_back(val.Items[i]);
+                    Render(node.Children, ctx, out);
+                    ctx.Stack.pop_back();
+                }
+                ctx.InList = inlist, ctx.LastItem = lastitem;
+                break;
+            }
+        }
+    }
+}
+
+}} // namespace Ladybirds::tools
@@ -0,0 +1,68 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_TOOLS_MUSTACHE_H
+#define LADYBIRDS_TOOLS_MUSTACHE_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Ladybirds {
+namespace tools {
+
+//! A value of a view model for MustacheTemplate, which does not change any more while templates are rendered with it.
+/** Values are referenced by pointer, such that they can be shared (and even cyclic) like Lua tables. **/
+struct MustacheValue
+{
+    enum class Kind : char { Nil, Scalar, Table };
+    Kind Type = Kind::Nil;  ///< Nil is also used for false
+    std::string Text;       ///< Of a scalar, as it is written
+    std::unordered_map<std::string, const MustacheValue*> Fields; ///< Of a table, only non-nil ones (false is Nil)
+    std::vector<const MustacheValue*> Items; ///< Of a table, its array part
+
+    //! Whether sections on this value are rendered: not for nil and for tables without items and fields
+    inline bool IsTruthy() const { return Type == Kind::Scalar || !Fields.empty() || !Items.empty(); }
+
+    //! The value used for nil (and missing fields)
+    static const MustacheValue Nil;
+};
+
+//! A mustache template with the syntax accepted by lua-fastache, which the backends use, to be rendered from C++
+/** By default, tags are delimited by « and » (a tag «=<open> <close>=» changes that). There are variables («name»,
+ *  «a.b.c», «.» for the current item), sections («#name»...«/name»), inverted sections («^name»...«/name»),
+ *  separators («:»...«/:», rendered for every item of a list but the last one) and comments («!...», which may
+ *  contain further tags and end at the matching »). The text around tags is kept as it is, without removing
+ *  standalone lines, and values are not escaped. **/
+class MustacheTemplate
+{
+private:
+    struct Node
+    {
+        enum class Kind : char { Text, Variable, Section, Inverted, Separator } Type;
+        std::string Text;               ///< Of a text
+        std::vector<std::string> Path;  ///< Of a variable or section, empty for "."
+        std::vector<Node> Children;     ///< Of a section
+    };
+    struct Context;
+
+    std::vector<Node> Nodes_;
+
+public:
+    //! Parses \p text, replacing the template. Returns false and sets \p error on syntax errors.
+    bool Parse(const std::string & text, std::string & error);
+
+    //! Adds all names that the template looks up (every part of a dotted name) to \p names
+    void CollectNames(std::unordered_set<std::string> & names) const;
+
+    //! Renders the template with the view model \p model and appends the result to \p out
+    void Render(const MustacheValue & model, std::string & out) const;
+
+private:
+    static void CollectNames(const std::vector<Node> & nodes, std::unordered_set<std::string> & names);
+    static void Render(const std::vector<Node> & nodes, Context & ctx, std::string & out);
+};
+
+}} // namespace Ladybirds::tools
+
+#endif // LADYBIRDS_TOOLS_MUSTACHE_H
@@ -3,8 +3,11 @@
 #include "bankassignment.h"
 
 #include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <random>
 #include <stack>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -14,6 +17,7 @@
 #include "lua/luaload.h"
 #include "msgui.h"
 #include "program.h"
+#include "recordfile.h"
 #include "task.h"
 #include "taskgroup.h"
 #include "tools.h"
@@ -52,6 +56,9 @@ public:
 
 class BufferRelationGraph : public graph::Graph<BufferNode> {};
 
+/// Number of groups the banks are divided into (on MPPA, groups are right and left). Bank i belongs to group i%2.
+constexpr int nBankGroups = 2;
+
 
 
 static int CountPenaltyEdges(BufferNode * pn, long & penalties)
@@ -76,8 +83,8 @@ static int CountPenaltyEdges(BufferNode * pn, long & penalties)
 
 
 
-BankAssignment::BankAssignment(impl::Program &prog, int nbanks)
-  : Prog_(prog), BankCount_(nbanks), upBufferGraph_(std::make_unique<BufferRelationGraph>())
+BankAssignment::BankAssignment(impl::Program &prog, const spec::Platform::Cluster &clusterinfo)
+  : Prog_(prog), BankCount_(clusterinfo.nBanks), BankCapacity_(clusterinfo.BankSize), upBufferGraph_(std::make_unique<BufferRelationGraph>())
 {
 }
 
@@ -102,27 +109,47 @@ public:
 
 bool Ladybirds::opt::BankAssignment::LoadOverlaps(const char* filename)
 {
-    //load timings from lua file
-    lua::LuaEnv lua;
-    if(!lua.DoFile(filename)) return false;
-
-    lua::LuaLoad load(lua);
-    lua_pushglobaltable(lua);
-
+    spec::TaskNameIndex tasks;
+    for(auto & t : Prog_.GetTasks()) tasks.Add(t);
     std::vector<TaskTiming> timings;
-    if(!load.IO("Timings", timings)) return false;
     
-    //fill the pTask pointers (from the task name strings)
+    tools::RecordFile file;
+    if(file.Open(filename, "timings"))
+    { //record file with lines "<task> <start> <stop>", looking up the tasks while reading
+        bool ok = true;
+        while(file.Next())
+        {
+            TaskTiming ti;
+            if(file.Size() != 3)
+            {
+                file.Error("Expected '<task> <start> <stop>'");
+                ok = false;
+                continue;
+            }
+            if(!(file.Number(1, ti.Start) & file.Number(2, ti.Stop))) ok = false;
+            else if(!(ti.pTask = tasks.Find(file[0]))) gMsgUI.Warning("Task not found: %s", file[0]);
+            else timings.push_back(std::move(ti));
+        }
+        if(!ok) return false;
+    }
+    else
     {
-        unordered_map<std::string, spec::Task*> tasks;
-        for(auto & t : Prog_.GetTasks()) tasks[t.Name] = &t;
+        //load timings from lua file
+        lua::LuaEnv lua;
+        if(!lua.DoFile(filename)) return false;
+
+        lua::LuaLoad load(lua);
+        lua_pushglobaltable(lua);
+        if(!load.IO("Timings", timings)) return false;
+        
+        //fill the pTask pointers (from the task name strings)
         for(auto & ti : timings)
         {
-            if(!(ti.pTask = tasks[ti.TaskName])) gMsgUI.Warning("Task not found: %s", ti.TaskName.c_str());
+            if(!(ti.pTask = tasks.Find(ti.TaskName))) gMsgUI.Warning("Task not found: %s", ti.TaskName.c_str());
         }
+        auto it = std::remove_if(timings.begin(), timings.end(), [](const auto & ti){return !ti.pTask;});
+        timings.erase(it, timings.end());
     }
-    auto it = std::remove_if(timings.begin(), timings.end(), [](const auto & ti){return !ti.pTask;});
-    timings.erase(it, timings.end());
     
     //determine overlap for each task pair and, if bigger than threshold, add the pair to the overlap list
     constexpr long threshold = 200;
@@ -147,7 +174,8 @@ bool Ladybirds::opt::BankAssignment::LoadOverlaps(const char* filename)
         std::ofstream strm("ov.txt");
         for(auto & ov : TaskOverlaps_)
         {
-            strm << "    \"" << ov.Task1->Name << "\" -- \"" << ov.Task2->Name << "\" [label=\"" << ov.Overlap << "\"]\n";
+            strm << "    \"" << ov.Task1->GetFullName() << "\" -- \"" << ov.Task2->GetFullName()
+                 << "\" [label=\"" << ov.Overlap << "\"]\n";
         }
     }
     return true;
@@ -201,11 +229,12 @@ void BankAssignment::CreateBufferGraph(impl::TaskDivision &div)
     }
 }
 
-void BankAssignment::GenerateBufferGraphFile()
+void BankAssignment::GenerateBufferGraphFile(int number)
 {
     assert(upBufferGraph_ && "Has CreateBufferGraph() been called before GenerateBufferGraphFile()?");
     
-    std::ofstream bufferGraphFile(strprintf("buffergraph%d.dot", ++DumpCounter_));
+    DumpCounter_ = (number > 0) ? number : DumpCounter_ + 1;
+    std::ofstream bufferGraphFile(strprintf("buffergraph%d.dot", DumpCounter_));
     using std::endl;
 
     bufferGraphFile << "graph \"Buffer Graph\"" << endl << "{" << endl;
@@ -260,7 +289,7 @@ bool BankAssignment::AssignBanks(int correction)
     {
         auto &tr = *node.pBuffer;
         tr.MemBank = -1;
-        if(tr.Size > InitialBankCapacity)
+        if(tr.Size > BankCapacity_)
         {
             ret = false;
             gMsgUI.Error("Buffer is too big to fit in any memory bank (%ld Bytes).", tr.Size);
@@ -269,12 +298,12 @@ bool BankAssignment::AssignBanks(int correction)
     }
     if(!ret) return false;
     
-    if(totalsize > BankCount_*InitialBankCapacity)
+    if(totalsize > (long) BankCount_*BankCapacity_)
     {
         gMsgUI.Error("Insufficient memory on the target platform. Program demands %ld Bytes.", totalsize);
         return false;
     }
-    if(totalsize > BankCount_*InitialBankCapacity*0.9 && correction == 0)
+    if(totalsize > BankCount_*BankCapacity_*0.9 && correction == 0)
     {
         gMsgUI.Warning("Program is using more than 90%% of the memory on the platform. This may be hard to map.");
     }
@@ -294,9 +323,9 @@ bool BankAssignment::AssignBanks(int correction)
         };
         
         auto nodecmp = Ladybirds::gen::MultiCritCmp(
-            [correction](NodeCharacter & b1, NodeCharacter & b2)
+            [correction, capacity = BankCapacity_](NodeCharacter & b1, NodeCharacter & b2)
                 {return -b1->AccessTaskCount - (-b2->AccessTaskCount) + 
-                        ((b1->pBuffer->Size - b2->pBuffer->Size)<<correction)/InitialBankCapacity;},
+                        ((b1->pBuffer->Size - b2->pBuffer->Size)<<correction)/capacity;},
             [](NodeCharacter & b1, NodeCharacter & b2) {return b1.Neighbours - b2.Neighbours;},
             [](NodeCharacter & b1, NodeCharacter & b2) {return b1.Penalty - b2.Penalty;},
             [](NodeCharacter & b1, NodeCharacter & b2) {return b1->pBuffer->Size - b2->pBuffer->Size;});
@@ -320,21 +349,19 @@ bool BankAssignment::AssignBanks(int correction)
         long Penalty;
         long GroupPenalty;
         long Reward;
-        int Capacity = InitialBankCapacity;
-        int FreeSpace = InitialBankCapacity;
+        int Capacity;
+        int FreeSpace;
         int ID = -1;
         GroupCharacteristics * pGroup = nullptr;
     };
     std::vector<BankCharacteristics> banks(nbanks);
-    banks[0].Capacity = banks[0].FreeSpace = 5 * 1024;
-
-    constexpr int ngroups = 2;
-    std::vector<GroupCharacteristics> groups(ngroups);
+    std::vector<GroupCharacteristics> groups(nBankGroups);
     
     for(int i = 0; i < nbanks; ++i)
     {
         banks[i].ID = i;
-        banks[i].pGroup = &groups[i%ngroups];
+        banks[i].pGroup = &groups[i%nBankGroups];
+        banks[i].Capacity = banks[i].FreeSpace = (i == 0) ? std::min(FirstBankCapacity, BankCapacity_) : BankCapacity_;
     }
     
     
@@ -418,6 +445,175 @@ bool BankAssignment::AssignBanks(int correction)
     return ret;
 }
 
+namespace {
+/// \internal Bank assignment problem in flat arrays, so that several starts can be refined in parallel
+struct BankProblem
+{
+    struct Neighbor { int Node; long Penalty, GroupPenalty; };
+    std::vector<std::vector<Neighbor>> Neighbors;
+    std::vector<int> Sizes, Capacities;
+    
+    /// Cost of putting node \p i into each bank, given the banks of all other nodes in \p assignment
+    void BankCosts(int i, const std::vector<int> & assignment, /*out*/ std::vector<long> & costs) const
+    {
+        costs.assign(Capacities.size(), 0);
+        std::vector<long> groupcosts(nBankGroups, 0);
+        for(auto & nb : Neighbors[i])
+        {
+            int bank = assignment[nb.Node];
+            if(bank < 0) continue;
+            costs[bank] += nb.Penalty;
+            groupcosts[bank%nBankGroups] += nb.GroupPenalty;
+        }
+        for(int b = 0, n = costs.size(); b < n; ++b) costs[b] += groupcosts[b%nBankGroups];
+    }
+    
+    long Cost(const std::vector<int> & assignment) const
+    {
+        long ret = 0;
+        for(int i = 0, n = Neighbors.size(); i < n; ++i) for(auto & nb : Neighbors[i])
+        {
+            if(nb.Node >= i) continue; // count every edge once
+            int b1 = assignment[i], b2 = assignment[nb.Node];
+            if(b1 == b2) ret += nb.Penalty;
+            if(b1 % nBankGroups == b2 % nBankGroups) ret += nb.GroupPenalty;
+        }
+        return ret;
+    }
+    
+    /// Moves single nodes to the bank where they cause the lowest cost, as long as this improves the assignment
+    void Refine(/*inout*/ std::vector<int> & assignment) const
+    {
+        std::vector<int> freespace(Capacities);
+        for(int i = 0, n = assignment.size(); i < n; ++i) freespace[assignment[i]] -= Sizes[i];
+        
+        std::vector<long> costs;
+        constexpr int maxpasses = 50;
+        for(int pass = 0; pass < maxpasses; ++pass)
+        {
+            bool improved = false;
+            for(int i = 0, n = assignment.size(); i < n; ++i)
+            {
+                BankCosts(i, assignment, costs);
+                int cur = assignment[i], best = cur;
+                for(int b = 0, nbanks = costs.size(); b < nbanks; ++b)
+                {
+                    if(b != cur && freespace[b] >= Sizes[i] && costs[b] < costs[best]) best = b;
+                }
+                if(best == cur) continue;
+                freespace[cur] += Sizes[i];
+                freespace[best] -= Sizes[i];
+                assignment[i] = best;
+                improved = true;
+            }
+            if(!improved) break;
+        }
+    }
+    
+    /// Assigns the nodes to random banks with enough space, largest nodes first. Returns false if a node did not fit.
+    bool RandomAssignment(std::minstd_rand & rng, /*out*/ std::vector<int> & assignment) const
+    {
+        int n = Sizes.size(), nbanks = Capacities.size();
+        std::vector<int> order(n), freespace(Capacities);
+        for(int i = 0; i < n; ++i) order[i] = i;
+        std::shuffle(order.begin(), order.end(), rng);
+        std::stable_sort(order.begin(), order.end(), [this](int i1, int i2) { return Sizes[i1] > Sizes[i2]; });
+        
+        assignment.assign(n, -1);
+        for(int i : order)
+        {
+            int first = std::uniform_int_distribution<int>(0, nbanks-1)(rng);
+            for(int k = 0; k < nbanks && assignment[i] < 0; ++k)
+            {
+                int b = (first + k) % nbanks;
+                if(freespace[b] >= Sizes[i]) assignment[i] = b, freespace[b] -= Sizes[i];
+            }
+            if(assignment[i] < 0) return false;
+        }
+        return true;
+    }
+};
+} //namespace ::
+
+bool BankAssignment::RefineAssignment(int nstarts, unsigned nthreads)
+{
+    // Set up the problem
+    BankProblem problem;
+    std::vector<BufferNode*> nodes;
+    auto indices = upBufferGraph_->GetNodeMap(-1);
+    for(auto & n : upBufferGraph_->Nodes())
+    {
+        if(n.pBuffer->MemBank < 0) return false;
+        indices[n] = nodes.size();
+        nodes.push_back(&n);
+        problem.Sizes.push_back(n.pBuffer->Size);
+    }
+    problem.Neighbors.resize(nodes.size());
+    for(auto & e : upBufferGraph_->Edges())
+    {
+        int i1 = indices[e.GetSource()], i2 = indices[e.GetTarget()];
+        if(e.Penalty <= 0 && e.GroupPenalty <= 0) continue;
+        problem.Neighbors[i1].push_back({i2, e.Penalty, e.GroupPenalty});
+        problem.Neighbors[i2].push_back({i1, e.Penalty, e.GroupPenalty});
+    }
+    problem.Capacities.assign(BankCount_, BankCapacity_);
+    problem.Capacities[0] = std::min(FirstBankCapacity, BankCapacity_);
+    
+    std::vector<int> initial;
+    for(auto * pn : nodes) initial.push_back(pn->pBuffer->MemBank);
+    long initialcost = problem.Cost(initial);
+    
+    // Refine all starts in parallel. Start 0 is the current assignment, the others are random.
+    if(nstarts < 1) nstarts = 1;
+    if(nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min<unsigned>(nthreads, nstarts);
+    struct Candidate { std::vector<int> Assignment; long Cost = -1; int Start = -1; };
+    std::vector<Candidate> bests(nthreads);
+    std::atomic<int> next(0);
+    auto worker = [&](Candidate & best)
+    {
+        std::vector<int> assignment;
+        for(int start; (start = next++) < nstarts; )
+        {
+            std::minstd_rand rng(start);
+            if(start == 0) assignment = initial;
+            else if(!problem.RandomAssignment(rng, assignment)) continue;
+            problem.Refine(assignment);
+            long cost = problem.Cost(assignment);
+            if(best.Cost < 0 || cost < best.Cost || (cost == best.Cost && start < best.Start))
+                best.Assignment = assignment, best.Cost = cost, best.Start = start;
+        }
+    };
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < nthreads; ++i) threads.emplace_back(worker, std::ref(bests[i]));
+    worker(bests[0]);
+    for(auto & th : threads) th.join();
+    
+    auto * pbest = &bests[0];
+    for(auto & cand : bests)
+    {
+        if(cand.Cost >= 0 && (cand.Cost < pbest->Cost || (cand.Cost == pbest->Cost && cand.Start < pbest->Start)))
+            pbest = &cand;
+    }
+    for(int i = 0, n = nodes.size(); i < n; ++i) nodes[i]->pBuffer->MemBank = pbest->Assignment[i];
+    gMsgUI.Verbose("Bank assignment refinement: conflict cost %ld -> %ld (best of %d starts: %d)",
+                   initialcost, pbest->Cost, nstarts, pbest->Start);
+    return true;
+}
+
+long BankAssignment::GetConflictCost() const
+{
+    long ret = 0;
+    for(auto & e : upBufferGraph_->Edges())
+    {
+        int b1 = e.GetSource()->pBuffer->MemBank, b2 = e.GetTarget()->pBuffer->MemBank;
+        if(b1 < 0 || b2 < 0) continue;
+        if(b1 == b2) ret += e.Penalty;
+        if(b1 % nBankGroups == b2 % nBankGroups) ret += e.GroupPenalty;
+    }
+    return ret;
+}
+
 void BankAssignment::PrintAssignmentInfo(std::ostream & strm)
 {
     std::vector<std::vector<const BufferNode*>> banks(BankCount_+1); //one additional "virtual bank" for unassigned buffers
@@ -440,7 +636,7 @@ void BankAssignment::PrintAssignmentInfo(std::ostream & strm)
     for(int i = 0; i < BankCount_; ++i)
     {
         strm << "Bank " << i << ":\t";
-        auto free = InitialBankCapacity - printbank(banks[i+1]);
+        auto free = BankCapacity_ - printbank(banks[i+1]);
         strm << "Free: " << free << endl;
         allfree += free;
     }
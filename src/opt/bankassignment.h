@@ -7,6 +7,7 @@
 #include <memory>
 #include <vector>
 #include "../graph/graph.h"
+#include "../spec/platform.h"
 
 namespace Ladybirds{
     
@@ -20,8 +21,9 @@ class BankAssignment
 private:
     impl::Program & Prog_;
     
-    static constexpr int InitialBankCapacity = 116*1024;
+    static constexpr int FirstBankCapacity = 5*1024; ///< Bank 0 is mostly taken by code and system data on the MPPA
     int BankCount_;
+    int BankCapacity_;
 
     struct TaskOverlap { spec::Task *Task1, *Task2; unsigned long Overlap; };
     std::vector<TaskOverlap> TaskOverlaps_;
@@ -31,17 +33,29 @@ private:
     int DumpCounter_ = 0;
     
 public:
-    BankAssignment(impl::Program & prog, int nbanks);
+    BankAssignment(impl::Program & prog, const spec::Platform::Cluster & clusterinfo);
     BankAssignment(const BankAssignment &) = delete;   // by default
     BankAssignment &operator=(const BankAssignment &) = delete; // dito
     ~BankAssignment();
 
     bool LoadOverlaps(const char * filename);
+    /// Uses the task overlaps that \p other has loaded, such that several divisions can be assigned concurrently
+    inline void CopyOverlaps(const BankAssignment & other) { TaskOverlaps_ = other.TaskOverlaps_; }
     void CreateBufferGraph(impl::TaskDivision &div);
 
     bool AssignBanks(int correction = 0);
+    /// Improves the current bank assignment by local search, starting from it and from \p nstarts-1 random
+    /// assignments on \p nthreads threads (0: one per hardware thread), and keeps the one with the lowest conflict cost.
+    /** Each start is refined by passes that move single buffers to the bank with enough space where they cause the
+     *  lowest conflict cost, as long as this reduces the cost (a greedy variant of Kernighan-Lin/Fiduccia-Mattheyses
+     *  refinement). Returns false if the current assignment is incomplete. **/
+    bool RefineAssignment(int nstarts, unsigned nthreads = 0);
+    /// Returns the weighted overlap of buffers in the same bank (and in the same group of banks) for the current
+    /// assignment, i.e. the sum of Penalty (and GroupPenalty) of all edges whose buffers share a bank (group)
+    long GetConflictCost() const;
 
-    void GenerateBufferGraphFile();
+    /// Writes the buffer graph to buffergraph<number>.dot (number 0: one more than for the previous file)
+    void GenerateBufferGraphFile(int number = 0);
     void PrintAssignmentInfo(std::ostream & strm);
 };
 
@@ -10,6 +10,7 @@
 
 #include "../gen/multicritcmp.h"
 #include "../graph/edgeregister.h"
+#include "../graph/reachabilityindex.h"
 #include "../loadstore.h"
 #include "../lua/luaenv.h"
 #include "../lua/luaload.h"
@@ -54,47 +55,83 @@ class CacheIndexOpt::BufferRelationGraph : public graph::Graph<BufferNode> {};
 
 CacheIndexOpt::CacheIndexOpt(const spec::Platform::Cluster & clusterinfo, const spec::Platform::CacheConfig & cacheinfo)
             : ClusterInfo_(std::move(clusterinfo)), CacheConfig_(std::move(cacheinfo)) {}
+CacheIndexOpt::CacheIndexOpt(const spec::Platform::Cluster & clusterinfo,
+                             const std::vector<spec::Platform::CacheConfig> & levels, int pagesize)
+            : ClusterInfo_(clusterinfo)
+{
+    assert(!levels.empty());
+    int range = INT_MAX, associativity = INT_MAX;
+    for(auto & level : levels)
+    {
+        int levelrange = level.LineCount*level.WordSize;
+        if(pagesize > 0 && levelrange > pagesize) levelrange = std::max(pagesize, level.WordSize);
+        if(levelrange < range)
+        {
+            range = levelrange;
+            CacheConfig_.WordSize = level.WordSize;
+        }
+        associativity = std::min(associativity, level.Associativity);
+    }
+    CacheConfig_.LineCount = range / CacheConfig_.WordSize;
+    CacheConfig_.Associativity = associativity;
+}
 CacheIndexOpt::~CacheIndexOpt(){}
 
 
-bool CacheIndexOpt::Optimize(impl::TaskDivision &div)
+bool CacheIndexOpt::Optimize(impl::TaskDivision &div, const graph::ReachabilityIndex * preach)
 {
-    CreateBufferGraph(div);
+    CreateBufferGraph(div, preach);
+    if(upBufferGraph_->Nodes().empty()) return true;
     return FillBankInfo()
         && RunOptimization();
 }
 
 
 
-void CacheIndexOpt::CreateBufferGraph(impl::TaskDivision & div)
+void CacheIndexOpt::CreateBufferGraph(impl::TaskDivision & div, const graph::ReachabilityIndex * preach)
 {
     upBufferGraph_ = std::make_unique<BufferRelationGraph>();
     
     //add nodes, and insert them in a buffer to node map
-    graph::ItemMap<BufferNode*> buffermap(div.Buffers);
+    //external buffers are provided on invocation, so their addresses cannot be chosen
+    graph::ItemMap<BufferNode*> buffermap(div.Buffers, nullptr);
     for(auto & tr : div.Buffers)
     {
-        buffermap[tr] = upBufferGraph_->EmplaceNode(&tr);
+        if(!tr.pExternalSource) buffermap[tr] = upBufferGraph_->EmplaceNode(&tr);
     }
     
     //now add penalty edges
     graph::UniEdgeRegister<BufferRelationGraph> edges(upBufferGraph_.get());
-    for(auto & pt : div.GetTasks())
+    auto addpenalties = [&](const Task * pt1, const Task * pt2)
     {
-        for(auto i1 = pt->Ifaces.size(); i1-- > 0; )
+        for(auto i1 = pt1->Ifaces.size(); i1-- > 0; )
         {
-            const Buffer * tr1 = pt->Ifaces[i1].GetBuffer();
+            const Buffer * tr1 = pt1->Ifaces[i1].GetBuffer();
             BufferNode * tn1 = buffermap[tr1];
+            if(!tn1) continue;
             
-            for(auto i2 = i1; i2-- > 0; )
+            for(auto i2 = (pt1 == pt2) ? i1 : pt2->Ifaces.size(); i2-- > 0; )
             {
-                const Buffer * tr2 = pt->Ifaces[i2].GetBuffer();
-                if(tr1 == tr2) continue; //in case of buddies, multiple interfaces can be linked to the same buffer
+                const Buffer * tr2 = pt2->Ifaces[i2].GetBuffer();
+                //in case of buddies, multiple interfaces can be linked to the same buffer
+                if(tr1 == tr2 || !buffermap[tr2]) continue;
                 
                 auto * edge = edges(tn1, buffermap[tr2]);
                 edge->Penalty++;
             }
         }
+    };
+    
+    auto & tasks = div.GetTasks();
+    for(auto it1 = tasks.begin(); it1 != tasks.end(); ++it1)
+    {
+        addpenalties(*it1, *it1);
+        if(!preach) continue;
+        for(auto it2 = tasks.begin(); it2 != it1; ++it2)
+        {
+            if((*it1)->Group != (*it2)->Group && !preach->Reaches(*it1, *it2) && !preach->Reaches(*it2, *it1))
+                addpenalties(*it1, *it2);
+        }
     }
 }
 
@@ -145,8 +182,7 @@ CacheIndexOpt::ColorInfo CacheIndexOpt::GetColors()
     else
     {
         int coloroffset = (CacheConfig_.LineCount/ncolors)*CacheConfig_.WordSize;
-        constexpr int idealoffset = 256;
-        if(coloroffset > idealoffset) coloroffset = idealoffset; //we don't want to waste too much space...
+        if(coloroffset > MaxColorOffset_) coloroffset = MaxColorOffset_; //we don't want to waste too much space...
         else gMsgUI.Warning("Many constraints between buffers. Reducing the cache index distances.");
         
         ncolors = CacheConfig_.LineCount*CacheConfig_.WordSize/coloroffset; //if more colors fit into the space, use them
@@ -161,18 +197,20 @@ bool CacheIndexOpt::RunOptimization()
     const auto colors = GetColors();
     
     // 1st step: Delete nodes and put them on the stack (deleting is done by setting the Ignore member to true)
-    for(int i = upBufferGraph_->Nodes().count(); i-- > 0; )
+    // Both criteria do not change while deleting, so the deletion order is obtained by a single (stable) sort
+    auto nodecmp = Ladybirds::gen::MultiCritCmp(
+        [this](BufferNode & n1, BufferNode & n2)
+            {return -Banks_[n1.pBuffer->MemBank].FreeSpace + Banks_[n2.pBuffer->MemBank].FreeSpace;},
+        [](BufferNode & n1, BufferNode& n2) {return n1.EdgeCount() - n2.EdgeCount();});
+    std::vector<BufferNode*> order;
+    order.reserve(upBufferGraph_->Nodes().size());
+    for(auto & n : upBufferGraph_->Nodes()) order.push_back(&n);
+    std::stable_sort(order.begin(), order.end(), [&nodecmp](BufferNode * pn1, BufferNode * pn2)
+                                                  { return nodecmp(*pn1, *pn2); });
+    for(auto * pn : order)
     {
-        auto nodecmp = Ladybirds::gen::MultiCritCmp(
-            [this](BufferNode & n1, BufferNode & n2)
-                {return -Banks_[n1.pBuffer->MemBank].FreeSpace + Banks_[n2.pBuffer->MemBank].FreeSpace;},
-            [](BufferNode & n1, BufferNode& n2) {return n1.EdgeCount() - n2.EdgeCount();});
-        auto lowestDegree = gen::MinElementIf(upBufferGraph_->NodesBegin(), upBufferGraph_->NodesEnd(),
-                                                [](auto & n) { return !n.Ignore; }, nodecmp);
-        stack.push(&*lowestDegree);
-        lowestDegree->Ignore = true;
-        //gMsgUI.Verbose("Removing: %d (tasks=%d, neighbours=%ld, penalty=%ld, size=%ld)", lowestDegree->GetID()-1,
-        //    lowestDegree->AccessTaskCount, lowestDegree.Neighbours, lowestDegree.Penalty, lowestDegree->pBuffer->Size);
+        stack.push(pn);
+        pn->Ignore = true;
     }
     
 
@@ -214,12 +252,14 @@ bool CacheIndexOpt::RunOptimization()
             nextcolor();
         }
         
+        //up to Associativity buffers can share a cache index without evicting each other
+        auto excess = [&](int c) { return std::max(0, conflicts[c] + 1 - CacheConfig_.Associativity); };
         int bestcolor = color, bestconflicts = INT_MAX, bestpos = startpos;
         for(int i = colors.count; i > 0; i--)
         {
             if(pos - startpos > bank.FreeSpace) break; //see if it still fits into the bank
             
-            if(conflicts[color] < bestconflicts)
+            if(bestconflicts == INT_MAX || excess(color) < excess(bestcolor))
             {
                 bestcolor = color;
                 bestconflicts = conflicts[color];
@@ -237,7 +277,7 @@ bool CacheIndexOpt::RunOptimization()
         bank.FreeSpace -= bestpos-startpos;
         bank.Slots.push_back({bestpos, bestpos+pn->pBuffer->Size});
         
-        if(bestconflicts > CacheConfig_.Associativity)
+        if(bestconflicts >= CacheConfig_.Associativity)
             gMsgUI.Warning("Buffer %d: Cache index conflict with %d other buffers (cache associativity: %d)."
                            "This may significantly slow down execution.",
                            pn->GetID()-1, bestconflicts, CacheConfig_.Associativity);
@@ -11,6 +11,7 @@
 
 namespace Ladybirds{
     
+namespace graph { class ReachabilityIndex; }
 namespace impl { class Buffer; struct Program; class TaskDivision; }
 namespace spec { class Task; struct Platform; }
     
@@ -32,16 +33,31 @@ private:
         std::vector<Slot> Slots;
     };
     std::vector<BankInfo> Banks_;
+    int MaxColorOffset_ = 256;
     
 public:
     //! Initializes the optimization
     CacheIndexOpt(const spec::Platform::Cluster & clusterinfo, const spec::Platform::CacheConfig & cacheinfo);
+    //! Initializes the optimization for a hierarchy of caches (e.g. L1 and L2 of a host CPU)
+    /** For physically indexed caches, only the address bits below the page size can be controlled, so the index range
+     *  of each level is limited to \p pagesize (if positive). The optimization uses the level with the smallest index
+     *  range and the lowest associativity of all levels: Addresses with different indices in this level also have
+     *  different indices in the other levels, as long as their index ranges are multiples of it. **/
+    CacheIndexOpt(const spec::Platform::Cluster & clusterinfo, const std::vector<spec::Platform::CacheConfig> & levels,
+                  int pagesize = 0);
     CacheIndexOpt(const CacheIndexOpt &) = delete;   // by default
     CacheIndexOpt &operator=(const CacheIndexOpt &) = delete; // dito
     ~CacheIndexOpt(); //defined in cacheindexopt.cpp to be able to properly deallocate the graph
     
     //! Runs the optimization and provides the info that GenerateBufferGraphFile and PrintAssignmentInfo can give out
-    bool Optimize(impl::TaskDivision &div);
+    /** Buffers are kept apart if they are used by the same task. If \p preach is given, this also holds for buffers
+     *  used by tasks of different groups that may run concurrently, as they matter for shared caches. **/
+    bool Optimize(impl::TaskDivision &div, const graph::ReachabilityIndex * preach = nullptr);
+
+    //! Sets the largest distance (in bytes) between the positions of two consecutive cache index colors
+    inline void SetMaxColorOffset(int offset) { MaxColorOffset_ = offset; }
+    //! Returns the range of addresses (in bytes) the cache indices repeat after, i.e. the alignment buffers need
+    inline int GetIndexRange() const { return CacheConfig_.LineCount*CacheConfig_.WordSize; }
 
     void GenerateBufferGraphFile();
     void PrintAssignmentInfo(std::ostream & strm);
@@ -49,7 +65,7 @@ public:
 private:
     struct ColorInfo {int count; int offset; int gap;};
     
-    void CreateBufferGraph(impl::TaskDivision &div);
+    void CreateBufferGraph(impl::TaskDivision &div, const graph::ReachabilityIndex * preach);
     bool FillBankInfo();
     ColorInfo GetColors();
     bool RunOptimization();
@@ -195,7 +195,12 @@ IfaceAssignment::IfaceAssignment(const Program &prog, const Platform &pf, const
       DmaSchedules_(pf.GetDmaControllers().size())
 {
     MemOccs_.reserve(pf.GetMemories().size());
-    for(auto &mem : pf.GetMemories()) MemOccs_.emplace_back(mem.Size*95/100);
+    MemPreOccs_.reserve(pf.GetMemories().size());
+    for(auto &mem : pf.GetMemories())
+    {
+        MemOccs_.emplace_back(mem.Size*95/100);
+        MemPreOccs_.emplace_back(mem.Size*95/100);
+    }
 }
 
 IfaceAssignment::~IfaceAssignment() {} //For destruction of incomplete type (in class declaration) of Ifacegraph
@@ -224,6 +229,45 @@ std::vector<IfaceAssignment::FullIF*> IfaceAssignment::CalcAssignmentOrder(int w
     return ret;
 }
 
+/// \internal Inserts jobs into DMA schedules and, if active, removes them again when destroyed
+/** This way, a what-if evaluation sees its own transfers (which may compete for the same DMA controller), and
+ *  undoing them only takes O(log n) per transfer instead of copying the schedules. **/
+class DmaUndoLog
+{
+    std::vector<std::pair<IndexedInsertionSchedule*, std::size_t>> Checkpoints_;
+    bool Active_;
+    
+public:
+    DmaUndoLog(bool active) : Active_(active) {}
+    DmaUndoLog(const DmaUndoLog &) = delete;
+    ~DmaUndoLog()
+    {
+        for(auto it = Checkpoints_.rbegin(); it != Checkpoints_.rend(); ++it) it->first->Rollback(it->second);
+    }
+    
+    InsertionSchedule::Job Insert(IndexedInsertionSchedule &dmas, Time arrival, Time deadline, Time duration)
+    {
+        if(Active_) Checkpoints_.emplace_back(&dmas, dmas.GetCheckpoint());
+        auto job = dmas.TryInsertion(arrival, deadline, duration);
+        dmas.PerformInsertion(job);
+        return job;
+    }
+    
+    /// Inserts the transfers of \p size bytes over all hops of \p route (cf. Platform::Routing), one after the other.
+    /// Returns the time at which the data has arrived.
+    Time InsertRoute(std::vector<IndexedInsertionSchedule> &dmaschedules,
+                     const std::vector<const Platform::HwConnection*> &route, Time arrival, Time deadline, long size)
+    {
+        for(auto *pconn : route)
+        {
+            auto &dmas = dmaschedules[pconn->Controllers.front()->Index]; //TODO: Multiple DMA controllers
+            arrival = Insert(dmas, arrival, deadline, pconn->DmaCost(size)).SchedEnd;
+        }
+        return arrival;
+    }
+};
+
+
 /** \internal Evaluates the option of assigning \p fi to the memory given by \p conn.
  *  Returns true if the assignment is possible, false otherwise. Arguments:
  *  * \p conn: The HwConnection from the core executing the task holding fi to the memory to be evaluated
@@ -235,7 +279,7 @@ std::vector<IfaceAssignment::FullIF*> IfaceAssignment::CalcAssignmentOrder(int w
 bool IfaceAssignment::EvalAssignment(FullIF& fi, const spec::Platform::HwConnection &memconn,
                                     Time &taskend, Time &succdelaysum, bool makechanges)
 {
-    auto &connmap = Platform_.GetConnMap();
+    auto &routing = Platform_.GetRouting();
     auto &iface = fi.Spec;
     auto &task = *iface.GetTask();
     auto &sched = Timings_[task];
@@ -260,6 +304,11 @@ bool IfaceAssignment::EvalAssignment(FullIF& fi, const spec::Platform::HwConnect
         }
     }
     
+    if(!makechanges && MemOccs_[pmem->pMem->Index].LeastAvail(sched.Start, sched.End) < size) return false;
+    
+    // Transfers are inserted into the DMA schedules right away, and removed again at the end unless makechanges
+    DmaUndoLog dmalog(!makechanges);
+    
     // Calculate when the task can start, i.e. when the packet has been transported to the selected memory
     // On the way, see if we can reuse existing memory, thereby saving more of it
     Time taskstart = 0;
@@ -275,27 +324,21 @@ bool IfaceAssignment::EvalAssignment(FullIF& fi, const spec::Platform::HwConnect
             continue; //no transport necessary
         }
         
-        auto *pconn = connmap[ptheirmem][pmem];
-        if(!pconn) return false;
+        auto route = routing.GetRoute(*ptheirmem->pMem, *pmem->pMem);
+        if(route.empty()) return false;
         
         auto transferstart = Timings_[pdef->Full.Spec.GetTask()].End;
-        auto transfertime = pconn->DmaCost(pdef->Size);
-        //TODO: Handle the case that multiple "in edges" compete for the same DMA controller
-        auto dmasched = DmaSchedules_[pconn->Controllers.front()->Index].
-                        TryInsertion(transferstart, sched.Start, transfertime);
-        taskstart = std::max(taskstart, dmasched.SchedEnd);
+        auto arrival = dmalog.InsertRoute(DmaSchedules_, route, transferstart, sched.Start, pdef->Size);
+        taskstart = std::max(taskstart, arrival);
     }
-    
-    if(!makechanges && MemOccs_[pmem->pMem->Index].LeastAvail(sched.Start, sched.End) < size) return false;
 
     // Now calculate the costs for the task itself, and when it finishes
     Time memcost = iface.Writes*memconn.WriteCost + iface.Reads*memconn.ReadCost;
-    Time taskdur =  task.Cost + memcost;
+    Time taskdur =  task.GetCost(TaskMapping_[task]->Type->Name) + memcost;
     taskstart = std::max(taskstart, sched.Start); //cannot start sooner due to other possible dependencies
     taskend = taskstart + taskdur;
 
     // Outputs: If the corresponding interfaces have already been mapped, they are more important and must be optimised
-    auto &outconnections = connmap[pmem];
     succdelaysum = 0;
     for(auto &partif : fi.OutParts)
     {
@@ -307,13 +350,11 @@ bool IfaceAssignment::EvalAssignment(FullIF& fi, const spec::Platform::HwConnect
             Time nextstartsched = Timings_[pu->Full.Spec.GetTask()].Start;
             if(ptheirmem != pmem)
             {
-                auto *pconn = outconnections[ptheirmem];
-                if(!pconn) return false;
+                auto route = routing.GetRoute(*pmem->pMem, *ptheirmem->pMem);
+                if(route.empty()) return false;
                 
-                //TODO: Handle the case that multiple "out edges" compete for the same DMA controller
-                auto dmasched = DmaSchedules_[pconn->Controllers.front()->Index].
-                    TryInsertion(taskend, nextstartsched, pconn->DmaCost(partif.Size));
-                succdelaysum += std::max<Time>(dmasched.SchedEnd-nextstartsched, 0);
+                auto arrival = dmalog.InsertRoute(DmaSchedules_, route, taskend, nextstartsched, partif.Size);
+                succdelaysum += std::max<Time>(arrival-nextstartsched, 0);
             }
         }
     }
@@ -352,7 +393,9 @@ void IfaceAssignment::ScheduleDMAs(FullIF &fi, Platform::ComponentNode *pmem)
     auto &iface = fi.Spec;
     auto &task = *iface.GetTask();
     auto &connmap = Platform_.GetConnMap();
+    auto &routing = Platform_.GetRouting();
     auto &schedstart = Timings_[task].Start;
+    DmaUndoLog dmalog(false);
     
     // Schedule DMAs for all input edges
     Time taskstart = 0;
@@ -363,26 +406,22 @@ void IfaceAssignment::ScheduleDMAs(FullIF &fi, Platform::ComponentNode *pmem)
         if(!ptheirmem) continue;
         if(ptheirmem == pmem) continue; //no transport necessary
         
-        auto *pconn = connmap[ptheirmem][pmem];
-        assert(pconn);
+        auto route = routing.GetRoute(*ptheirmem->pMem, *pmem->pMem);
+        assert(!route.empty());
         
         auto transferstart = Timings_[pdef->Full.Spec.GetTask()].End;
-        auto transfertime = pconn->DmaCost(pdef->Size);
-        auto dmacntrl = DmaSchedules_[pconn->Controllers.front()->Index]; //TODO: Multiple DMA controllers
-        auto dmasched = dmacntrl.TryInsertion(transferstart, schedstart, transfertime);
-        taskstart = std::max(taskstart, dmasched.SchedEnd);
-        dmacntrl.PerformInsertion(dmasched);
+        auto arrival = dmalog.InsertRoute(DmaSchedules_, route, transferstart, schedstart, pdef->Size);
+        taskstart = std::max(taskstart, arrival);
     }
 
     // Now calculate when the task finishes
     auto pmemconn = connmap[TaskMapping_[task]->pNode][pmem]; assert(pmemconn);
     Time memcost = iface.Writes*pmemconn->WriteCost + iface.Reads*pmemconn->ReadCost;
-    Time taskdur =  task.Cost + memcost;
+    Time taskdur =  task.GetCost(TaskMapping_[task]->Type->Name) + memcost;
     taskstart = std::max(taskstart, schedstart); //cannot start sooner due to other possible dependencies
     Time taskend = taskstart + taskdur;
 
     // Outputs: If the corresponding interfaces have already been mapped, they are more important and must be optimised
-    auto &outconnections = connmap[pmem];
     for(auto &partif : fi.OutParts)
     {
         for(auto &pu : partif.Uses)
@@ -391,13 +430,11 @@ void IfaceAssignment::ScheduleDMAs(FullIF &fi, Platform::ComponentNode *pmem)
             if(!ptheirmem) continue; //not yet mapped
             if(ptheirmem == pmem) continue; //no transfer necessary
             
-            auto *pconn = outconnections[ptheirmem];
-            assert(pconn);
+            auto route = routing.GetRoute(*pmem->pMem, *ptheirmem->pMem);
+            assert(!route.empty());
             
-            auto dmacntrl = DmaSchedules_[pconn->Controllers.front()->Index]; //TODO: Multiple DMA controllers
             Time nextstartsched = Timings_[pu->Full.Spec.GetTask()].Start;
-            auto dmasched = dmacntrl.TryInsertion(taskend, nextstartsched,  pconn->DmaCost(partif.Size));
-            dmacntrl.PerformInsertion(dmasched);
+            dmalog.InsertRoute(DmaSchedules_, route, taskend, nextstartsched, partif.Size);
         }
     }
 }
@@ -436,7 +473,19 @@ bool IfaceAssignment::CalcAssignment(int weight, const Schedule &schedule)
     
     if(!PreAssignment(order, weight)) return false;
     
-    return false;
+    //TODO: Refine the preassignment of interfaces that still have several options
+    return true;
+}
+
+IfaceAssignment::IfaceMapping IfaceAssignment::GetIfaceMapping() const
+{
+    IfaceMapping ret;
+    for(auto &t : upGraph_->Tasks) for(auto &fi : t.Interfaces)
+    {
+        auto *pmem = fi.pMem ? fi.pMem : fi.pPremem;
+        if(pmem) ret[&fi.Spec] = pmem->pMem;
+    }
+    return ret;
 }
 
 
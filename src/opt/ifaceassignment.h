@@ -36,7 +36,7 @@ class IfaceAssignment
 public:
     using IfaceMapping = Schedule::IfaceMapping;
     using SpillMapping = Schedule::SpillMapping;
-    using TaskMapping = graph::ItemMap<spec::Platform::Core*>;
+    using TaskMapping = graph::ItemMap<const spec::Platform::Core*>;
     
 private:
     const impl::Program &Program_;
@@ -45,8 +45,8 @@ private:
     std::unique_ptr<IFGraph> upGraph_;
     
     graph::ItemMap<Schedule::TaskTimings> Timings_;
-    std::vector<gen::OccupationChart<long>> MemOccs_, MemPreOccs_;
-    std::vector<opt::InsertionSchedule> DmaSchedules_;
+    std::vector<gen::OccupationChart<long, gen::SegmentTreeChart>> MemOccs_, MemPreOccs_;
+    std::vector<opt::IndexedInsertionSchedule> DmaSchedules_;
     
     
 public:
@@ -56,6 +56,9 @@ public:
     ~IfaceAssignment();
     
     bool CalcAssignment(int weight, const Schedule &schedule);
+    /// Returns the memory each interface has been assigned to by CalcAssignment.
+    /** Interfaces that have not been fixed yet are reported with their preliminary memory. **/
+    IfaceMapping GetIfaceMapping() const;
     
 private:
     std::vector<FullIF* > CalcAssignmentOrder(int weight, const Schedule& schedule);
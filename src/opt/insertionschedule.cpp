@@ -86,4 +86,233 @@ void InsertionSchedule::PerformInsertion(const Job& job)
 
 
 
+IndexedInsertionSchedule::Job IndexedInsertionSchedule::TryInsertion(Time arrival, Time deadline, Time duration) const
+{
+    int njobs = Nodes_.size();
+    int i = FirstEndingAfter(arrival); // inserting any sooner would not make the job start any sooner
+    Time prevend = EndBefore(i);
+    
+    // The new job finishes no sooner the later it is inserted, so take the first point that keeps all deadlines
+    for(; ; ++i)
+    {
+        Time start = std::max(prevend, arrival), end = start + duration;
+        if(i == njobs || end <= LatestEnd(i)) return {arrival, std::max(deadline, end), start, end};
+        prevend = EndBefore(i+1);
+    }
+}
+
+void IndexedInsertionSchedule::PerformInsertion(const Job &job)
+{
+    Seed_ ^= Seed_ << 13, Seed_ ^= Seed_ >> 17, Seed_ ^= Seed_ << 5;
+    
+    Node node;
+    node.Release = job.SchedStart;
+    node.Duration = job.SchedEnd - job.SchedStart;
+    node.Arrival = job.Arrival;
+    node.Deadline = job.Deadline;
+    node.Priority = Seed_;
+    Nodes_.push_back(node);
+    int n = Nodes_.size() - 1;
+    Update(n);
+    
+    int left, right, pos = FirstEndingAfter(job.SchedStart);
+    Positions_.push_back(pos);
+    Split(Root_, pos, left, right);
+    Root_ = Merge(Merge(left, n), right);
+}
+
+void IndexedInsertionSchedule::Rollback(std::size_t checkpoint)
+{
+    assert(checkpoint <= Nodes_.size());
+    while(Nodes_.size() > checkpoint)
+    {
+        // Undoing in reverse order of insertion, the last job is still at the position it has been inserted at
+        int left, mid, right;
+        Split(Root_, Positions_.back(), left, mid);
+        Split(mid, 1, mid, right);
+        assert(mid == int(Nodes_.size()) - 1);
+        Root_ = Merge(left, right);
+        Nodes_.pop_back();
+        Positions_.pop_back();
+    }
+}
+
+IndexedInsertionSchedule::Job IndexedInsertionSchedule::operator[](int i) const
+{
+    assert(i >= 0 && i < int(Nodes_.size()));
+    int n = Root_;
+    for(int skip = i; ; )
+    {
+        auto &node = Nodes_[n];
+        int nleft = SizeOf(node.Left);
+        if(skip == nleft) break;
+        if(skip < nleft) n = node.Left;
+        else skip -= nleft + 1, n = node.Right;
+    }
+    
+    auto &node = Nodes_[n];
+    Time start = std::max(EndBefore(i), node.Release);
+    return {node.Arrival, node.Deadline, start, start + node.Duration};
+}
+
+void IndexedInsertionSchedule::Update(int n)
+{
+    auto &node = Nodes_[n];
+    node.Size = 1;
+    node.Sum = node.Duration;
+    node.MaxRelease = node.Release;
+    node.MinDeadline = node.Deadline - node.Duration;
+    if(node.Left >= 0)
+    {
+        auto &left = Nodes_[node.Left];
+        node.Size += left.Size;
+        node.MaxRelease = std::max(left.MaxRelease, node.Release - left.Sum);
+        node.MinDeadline = std::min(left.MinDeadline, node.MinDeadline - left.Sum);
+        node.Sum += left.Sum;
+    }
+    if(node.Right >= 0)
+    {
+        auto &right = Nodes_[node.Right];
+        node.Size += right.Size;
+        node.MaxRelease = std::max(node.MaxRelease, right.MaxRelease - node.Sum);
+        node.MinDeadline = std::min(node.MinDeadline, right.MinDeadline - node.Sum);
+        node.Sum += right.Sum;
+    }
+}
+
+int IndexedInsertionSchedule::Merge(int left, int right)
+{
+    if(left < 0) return right;
+    if(right < 0) return left;
+    
+    if(Nodes_[left].Priority > Nodes_[right].Priority)
+    {
+        int merged = Merge(Nodes_[left].Right, right);
+        Nodes_[left].Right = merged;
+        Update(left);
+        return left;
+    }
+    else
+    {
+        int merged = Merge(left, Nodes_[right].Left);
+        Nodes_[right].Left = merged;
+        Update(right);
+        return right;
+    }
+}
+
+// Splits the subtree n such that left contains its first count jobs, and right the remaining ones
+void IndexedInsertionSchedule::Split(int n, int count, int &left, int &right)
+{
+    if(n < 0)
+    {
+        left = right = -1;
+        return;
+    }
+    
+    int nleft = SizeOf(Nodes_[n].Left);
+    if(nleft < count)
+    {
+        int splitleft;
+        Split(Nodes_[n].Right, count - nleft - 1, splitleft, right);
+        Nodes_[n].Right = splitleft;
+        left = n;
+    }
+    else
+    {
+        int splitright;
+        Split(Nodes_[n].Left, count, left, splitright);
+        Nodes_[n].Left = splitright;
+        right = n;
+    }
+    Update(n);
+}
+
+// Returns the time at which the first i jobs are finished
+Time IndexedInsertionSchedule::EndBefore(int i) const
+{
+    Time t = 0;
+    for(int n = Root_, skip = i; n >= 0 && skip > 0; )
+    {
+        auto &node = Nodes_[n];
+        int nleft = SizeOf(node.Left);
+        if(skip <= nleft)
+        {
+            n = node.Left;
+            continue;
+        }
+        
+        // The whole left subtree and the node itself are finished before
+        if(node.Left >= 0)
+        {
+            auto &left = Nodes_[node.Left];
+            t = left.Sum + std::max(t, left.MaxRelease);
+        }
+        t = std::max(t, node.Release) + node.Duration;
+        skip -= nleft + 1;
+        n = node.Right;
+    }
+    return t;
+}
+
+// Returns the latest time at which a job inserted before position i can finish without making any job miss its deadline
+Time IndexedInsertionSchedule::LatestEnd(int i) const
+{
+    Time tailmin = Time_Infinite; // latest end for the jobs from position i that have been seen so far
+    for(int n = Root_, skip = i; n >= 0; )
+    {
+        auto &node = Nodes_[n];
+        int nleft = SizeOf(node.Left);
+        if(skip > nleft)
+        {
+            skip -= nleft + 1;
+            n = node.Right;
+            continue;
+        }
+        
+        // The node itself and its right subtree come after position i, and before the jobs seen so far
+        Time sum = node.Duration, mindeadline = node.Deadline - node.Duration;
+        if(node.Right >= 0)
+        {
+            auto &right = Nodes_[node.Right];
+            mindeadline = std::min(mindeadline, right.MinDeadline - sum);
+            sum += right.Sum;
+        }
+        tailmin = std::min(mindeadline, tailmin - sum);
+        
+        if(skip == nleft) break;
+        n = node.Left;
+    }
+    return tailmin;
+}
+
+// Returns the position of the first job that finishes later than t (or the number of jobs if there is none)
+int IndexedInsertionSchedule::FirstEndingAfter(Time t) const
+{
+    int pos = 0;
+    Time before = 0; // end of all jobs before the current subtree
+    for(int n = Root_; n >= 0; )
+    {
+        auto &node = Nodes_[n];
+        Time leftend = before;
+        if(node.Left >= 0)
+        {
+            auto &left = Nodes_[node.Left];
+            leftend = left.Sum + std::max(before, left.MaxRelease);
+            if(leftend > t)
+            {
+                n = node.Left;
+                continue;
+            }
+        }
+        
+        Time end = std::max(leftend, node.Release) + node.Duration;
+        if(end > t) return pos + SizeOf(node.Left);
+        before = end;
+        pos += SizeOf(node.Left) + 1;
+        n = node.Right;
+    }
+    return pos;
+}
+
 }} //namespace Ladybirds::opt
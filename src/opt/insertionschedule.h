@@ -31,6 +31,73 @@ public:
     /// Actually perform an insertion that has been analysed with TryInsertion before.
     /** \p job *must* be the exact return value from a previous call to TryInsertion. **/
     void PerformInsertion(const Job &job);
+    
+    /// Returns the bytes allocated for the jobs
+    std::size_t GetHeapBytes() const { return Jobs_.capacity() * sizeof(Job); }
+};
+
+/**
+ * A schedule like InsertionSchedule, but indexed such that insertions take logarithmic time.
+ *
+ * The jobs are stored in a randomized balanced search tree (treap) in order of their execution. Instead of absolute
+ * times, each job only keeps the time it was released at, and the actual times follow from the jobs before it (a job
+ * starts when it has been released and its predecessor is finished). Each subtree stores the total duration of its
+ * jobs together with the maximum release and the minimum deadline relative to its start, so that the end times of
+ * jobs and the latest possible end of a job inserted at some point can be computed in O(log n). Inserting a job
+ * delays the ones after it without touching them.
+ *
+ * Unlike InsertionSchedule, which maximizes the total slack of all jobs, TryInsertion chooses the earliest point of
+ * insertion that keeps all existing deadlines, and so finishes the new job as early as possible.
+ **/
+class IndexedInsertionSchedule
+{
+public:
+    using Job = InsertionSchedule::Job;
+    
+private:
+    struct Node
+    {
+        Time Release, Duration, Arrival, Deadline;
+        unsigned Priority;
+        int Left = -1, Right = -1;
+        int Size = 1; ///< Number of jobs in the subtree
+        Time Sum; ///< Total duration of the jobs in the subtree
+        Time MaxRelease; ///< Maximum of (release of job j - duration of the jobs before j in the subtree)
+        Time MinDeadline; ///< Minimum of (deadline of job j - duration of the jobs up to and including j)
+    };
+    
+    std::vector<Node> Nodes_; ///< In order of insertion
+    std::vector<int> Positions_; ///< Position at which each job has been inserted
+    int Root_ = -1;
+    unsigned Seed_ = 2463534242u;
+    
+public:
+    /// Check possibility of inserting a job into the schedule while respecting all deadlines of existing jobs.
+    /** If the new job's deadline cannot be met, it will be extended, which can be checked in the return value. **/
+    Job TryInsertion(Time arrival, Time deadline, Time duration) const;
+    /// Actually perform an insertion that has been analysed with TryInsertion before.
+    /** \p job *must* be the exact return value from a previous call to TryInsertion. **/
+    void PerformInsertion(const Job &job);
+    
+    std::size_t size() const { return Nodes_.size(); }
+    /// Returns the bytes allocated for the tree and the positions
+    std::size_t GetHeapBytes() const { return Nodes_.capacity() * sizeof(Node) + Positions_.capacity() * sizeof(int); }
+    
+    /// Returns a checkpoint to which the schedule can be reset with Rollback
+    std::size_t GetCheckpoint() const { return Nodes_.size(); }
+    /// Removes all jobs inserted since \p checkpoint was taken, in O(log n) per removed job
+    void Rollback(std::size_t checkpoint);
+    /// Returns the job at position \p i in order of execution (with its current start and end time)
+    Job operator[](int i) const;
+    
+private:
+    inline int SizeOf(int n) const { return n < 0 ? 0 : Nodes_[n].Size; }
+    void Update(int n);
+    int Merge(int left, int right);
+    void Split(int n, int count, int &left, int &right);
+    Time EndBefore(int i) const;
+    Time LatestEnd(int i) const;
+    int FirstEndingAfter(Time t) const;
 };
 
 }} //namespace Ladybirds::opt
@@ -0,0 +1,117 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "milp.h"
+
+#include <cmath>
+
+#if CFG_HAVE_HIGHS
+#include "Highs.h"
+#endif //CFG_HAVE_HIGHS
+
+namespace Ladybirds {
+namespace opt {
+
+
+int Milp::FindViolation(const std::vector<double> &values, double tol) const
+{
+    if(values.size() != Columns.size()) return 0;
+    for(int i = 0, n = Columns.size(); i < n; ++i)
+    {
+        auto &col = Columns[i];
+        double v = values[i];
+        if(v < col.Lower - tol || v > col.Upper + tol) return i;
+        if(col.Integer && std::abs(v - std::round(v)) > tol) return i;
+    }
+    for(int i = 0, n = Rows.size(); i < n; ++i)
+    {
+        double sum = 0;
+        for(auto &entry : Rows[i].Entries) sum += entry.second * values[entry.first];
+        if(sum < Rows[i].Lower - tol || sum > Rows[i].Upper + tol) return Columns.size() + i;
+    }
+    return -1;
+}
+
+#if CFG_HAVE_HIGHS
+
+bool HaveMilpSolver() { return true; }
+
+MilpResult SolveMilp(const Milp &model, const std::vector<double> *pstart, double timelimit, bool verbose)
+{
+    MilpResult ret;
+    const int ncols = model.Columns.size(), nrows = model.Rows.size();
+
+    HighsLp lp;
+    lp.num_col_ = ncols;
+    lp.num_row_ = nrows;
+    lp.sense_ = ObjSense::kMinimize;
+    lp.col_cost_.reserve(ncols), lp.col_lower_.reserve(ncols), lp.col_upper_.reserve(ncols);
+    lp.integrality_.reserve(ncols);
+    for(auto &col : model.Columns)
+    {
+        lp.col_cost_.push_back(col.Cost);
+        lp.col_lower_.push_back(col.Lower); // HiGHS takes infinity as no bound as well
+        lp.col_upper_.push_back(col.Upper);
+        lp.integrality_.push_back(col.Integer ? HighsVarType::kInteger : HighsVarType::kContinuous);
+    }
+    auto &matrix = lp.a_matrix_;
+    matrix.format_ = MatrixFormat::kRowwise;
+    matrix.num_col_ = ncols;
+    matrix.num_row_ = nrows;
+    matrix.start_.assign(1, 0);
+    for(auto &row : model.Rows)
+    {
+        lp.row_lower_.push_back(row.Lower);
+        lp.row_upper_.push_back(row.Upper);
+        for(auto &entry : row.Entries)
+        {
+            matrix.index_.push_back(entry.first);
+            matrix.value_.push_back(entry.second);
+        }
+        matrix.start_.push_back(matrix.index_.size());
+    }
+
+    Highs highs;
+    highs.setOptionValue("output_flag", verbose);
+    highs.setOptionValue("time_limit", timelimit);
+    if(highs.passModel(std::move(lp)) == HighsStatus::kError) return ret;
+    if(pstart)
+    {
+        HighsSolution start;
+        start.col_value = *pstart;
+        start.value_valid = true;
+        highs.setSolution(start);
+    }
+    if(highs.run() == HighsStatus::kError) return ret;
+
+    auto &info = highs.getInfo();
+    bool havesolution = (info.primal_solution_status == kSolutionStatusFeasible);
+    switch(highs.getModelStatus())
+    {
+        case HighsModelStatus::kOptimal: ret.TheStatus = MilpResult::Status::Optimal; break;
+        case HighsModelStatus::kInfeasible: ret.TheStatus = MilpResult::Status::Infeasible; break;
+        default:
+            ret.TheStatus = havesolution ? MilpResult::Status::Feasible : MilpResult::Status::NoSolution;
+    }
+    if(havesolution)
+    {
+        ret.Values = highs.getSolution().col_value;
+        ret.Objective = info.objective_function_value;
+    }
+    ret.Bound = info.mip_dual_bound;
+    return ret;
+}
+
+#else //CFG_HAVE_HIGHS
+
+bool HaveMilpSolver() { return false; }
+
+MilpResult SolveMilp(const Milp &, const std::vector<double> *, double, bool)
+{
+    MilpResult ret;
+    ret.TheStatus = MilpResult::Status::Unavailable;
+    return ret;
+}
+
+#endif //CFG_HAVE_HIGHS
+
+}} //namespace Ladybirds::opt
@@ -0,0 +1,81 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_OPT_MILP_H
+#define LADYBIRDS_OPT_MILP_H
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace Ladybirds {
+namespace opt {
+
+/**
+ * A mixed integer linear program, independent of the solver (cf. SolveMilp).
+ *
+ * Minimizes the sum of the costs of the columns (variables), subject to their bounds and to lower and upper bounds on
+ * linear combinations of them (rows). Columns may be restricted to integers.
+ **/
+struct Milp
+{
+    static constexpr double Infinity = std::numeric_limits<double>::infinity();
+
+    struct Column
+    {
+        double Lower, Upper, Cost;
+        bool Integer;
+    };
+    struct Row
+    {
+        double Lower, Upper;
+        std::vector<std::pair<int, double>> Entries; ///< Column and coefficient
+    };
+
+    std::vector<Column> Columns;
+    std::vector<Row> Rows;
+
+    /// Adds a column and returns its index
+    int AddColumn(double lower, double upper, double cost = 0, bool integer = false)
+    {
+        Columns.push_back({lower, upper, cost, integer});
+        return int(Columns.size()) - 1;
+    }
+    int AddBinary(double cost = 0) { return AddColumn(0, 1, cost, true); } ///< Adds a 0-1 column
+    void AddRow(double lower, double upper, std::vector<std::pair<int, double>> entries)
+        { Rows.push_back({lower, upper, std::move(entries)}); }
+
+    /// Returns the index of the first column or row violated by \p values by more than \p tol (columns first, rows
+    /// counted after them), or -1 if the values are a feasible solution
+    int FindViolation(const std::vector<double> &values, double tol = 1e-6) const;
+};
+
+/// Result of SolveMilp
+struct MilpResult
+{
+    enum class Status
+    {
+        Optimal,     ///< Solved to optimality (within the default tolerances of the solver)
+        Feasible,    ///< A solution has been found, but it has not been proven optimal within the time limit
+        Infeasible,  ///< The program has no solution
+        NoSolution,  ///< No solution has been found within the time limit
+        Unavailable, ///< Ladybirds has been built without a solver
+        Failed,      ///< The solver failed for other reasons
+    };
+
+    Status TheStatus = Status::Failed;
+    std::vector<double> Values; ///< Value of each column (if a solution has been found)
+    double Objective = Milp::Infinity; ///< Objective value of the solution
+    double Bound = -Milp::Infinity;    ///< Proven lower bound of the objective
+};
+
+/// Returns whether a solver is available, i.e. whether ladybirds has been built with HiGHS (CMake option
+/// LADYBIRDS_WITH_HIGHS)
+bool HaveMilpSolver();
+
+/// Solves \p model within \p timelimit seconds, starting from the solution \p pstart if not null (which should be
+/// feasible, cf. Milp::FindViolation). If \p verbose, the log of the solver is printed.
+MilpResult SolveMilp(const Milp &model, const std::vector<double> *pstart, double timelimit, bool verbose = false);
+
+}} //namespace Ladybirds::opt
+
+#endif // LADYBIRDS_OPT_MILP_H
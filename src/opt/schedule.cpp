@@ -2,12 +2,20 @@
 
 #include "schedule.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <ostream>
 #include <queue>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
 #include "gen/spacemultidiv.h"
+#include "graph/graph-extra.h"
 #include "graph/graph.h"
+#include "opt/milp.h"
 #include "spec/platform.h"
 #include "dependency.h"
 #include "msgui.h"
@@ -46,6 +54,8 @@ public:
     {
         std::vector<TransitionImpl*> Uses;
         long Size;
+        int Mem = -1; // Memory holding the data
+        int Consumers = 0; // Number of edges consuming the data
         int RefCount;
     };
     
@@ -53,8 +63,14 @@ public:
     spec::Task *pSpec;
     gen::Space *pTransferDims;
     Time Duration = 0;
+    Time Isolated = 0; // Duration without contention for memory ports (cf. ContendedDuration)
+    std::vector<std::pair<int, Time>> Accesses; // Time spent accessing each memory (with an interface mapping)
+    std::vector<Time> TypeDurations; // Duration on each core type for Placement::EarliestFinish (cf. CoreTypes_)
     Time Alap = 0;
+    Time Rank = 0; // Upward rank: length of the longest path from the start of the task to the end of the program
+    Time DownRank = 0; // Downward rank: length of the longest path from the start of the program to the task
     Time Start = 0;
+    unsigned TieBreak = 0;
     int MemDiff = 0; // Difference in amount of memory used ("alive") before and after the task
     int TotalMemUse = 0;
     int OpenDependencies;
@@ -125,6 +141,30 @@ public:
         for(auto &n : Nodes()) if(n.Alap == 0) AlapRecurse(n, depcnt);
     }
     
+    template<typename commcost_t> void CalcUpwardRank(commcost_t commcost)
+    {
+        auto depcnt = GetNodeMap<int>();
+        for(auto &n : Nodes())
+        {
+            depcnt[n] = n.OutEdgeCount();
+            n.Rank = 0;
+        }
+        
+        for(auto &n : Nodes()) if(n.OutEdgeCount() == 0) RankRecurse(n, depcnt, commcost);
+    }
+    
+    template<typename commcost_t> void CalcDownwardRank(commcost_t commcost)
+    {
+        auto depcnt = GetNodeMap<int>();
+        for(auto &n : Nodes())
+        {
+            depcnt[n] = n.InEdgeCount();
+            n.DownRank = 0;
+        }
+        
+        for(auto &n : Nodes()) if(n.InEdgeCount() == 0) DownRankRecurse(n, depcnt, commcost);
+    }
+    
 private:
     void AlapRecurse(Schedule::Tasknode &n, graph::ItemMap<int> &depcnt)
     {
@@ -137,6 +177,31 @@ private:
             if(--depcnt[pnfrom] == 0) AlapRecurse(*pnfrom, depcnt);
         }
     };
+    
+    template<typename commcost_t>
+    void RankRecurse(Schedule::Tasknode &n, graph::ItemMap<int> &depcnt, commcost_t &commcost)
+    {
+        n.Rank += n.Duration;
+        for(auto &e : n.InEdges())
+        {
+            auto *pnfrom = e.GetSource();
+            auto rankcond = n.Rank + e.Offset + commcost(e);
+            if(pnfrom->Rank < rankcond) pnfrom->Rank = rankcond;
+            if(--depcnt[pnfrom] == 0) RankRecurse(*pnfrom, depcnt, commcost);
+        }
+    }
+    
+    template<typename commcost_t>
+    void DownRankRecurse(Schedule::Tasknode &n, graph::ItemMap<int> &depcnt, commcost_t &commcost)
+    {
+        for(auto &e : n.OutEdges())
+        {
+            auto *pnto = e.GetTarget();
+            auto rankcond = n.DownRank + n.Duration + e.Offset + commcost(e);
+            if(pnto->DownRank < rankcond) pnto->DownRank = rankcond;
+            if(--depcnt[pnto] == 0) DownRankRecurse(*pnto, depcnt, commcost);
+        }
+    }
 
 };
 
@@ -150,7 +215,8 @@ struct Schedule::SchedulingItem
     bool operator<(const SchedulingItem &other) const
     {
         if(ReadyTime != other.ReadyTime) return ReadyTime > other.ReadyTime;
-        else return Priority < other.Priority;
+        else if(Priority != other.Priority) return Priority < other.Priority;
+        else return pTasknode->TieBreak < other.pTasknode->TieBreak;
     }
     
     SchedulingItem(Tasknode &tn, long priority) : ReadyTime(tn.Start), Priority(priority), pTasknode(&tn) {}
@@ -168,28 +234,178 @@ Schedule::Schedule(Program &prog, Platform &pf)
 {
     MemOccs_.reserve(pf.GetMemories().size());
     for(auto &mem : pf.GetMemories()) MemOccs_.emplace_back(mem.Size*95/100);
+    MemLoads_.assign(pf.GetMemories().size(), gen::OccupationChart<long, gen::SegmentTreeChart>(Time_Infinite));
+    for(auto &mem : pf.GetMemories()) if(mem.Ports > 0) Contention_ = true;
     GroupOccs_.reserve(pf.GetGroups().size());
     for(auto &grp : pf.GetGroups())
     {
         auto memsize = Sum(grp.GetMemories(), [](auto *pm) { return pm->Size; });
         GroupOccs_.emplace_back(memsize*95/100);
     }
+    
+    auto &types = pf.GetCoreTypes();
+    for(auto &core : pf.GetCores())
+    {
+        auto it = std::find_if(types.begin(), types.end(), [&core](auto &type) { return &type == core.Type; });
+        CoreTypes_.push_back(it - types.begin());
+    }
+    CalcCoreConnections();
+}
+
+void Schedule::CalcCoreConnections()
+{
+    auto &cores = Platform_.GetCores();
+    auto &routing = Platform_.GetRouting();
+    
+    std::vector<std::vector<const Platform::ComponentNode*>> accessible(cores.size());
+    for(auto &core : cores) for(auto &e : core.pNode->OutEdges())
+    {
+        if(e.GetTarget()->pMem) accessible[core.Index].push_back(e.GetTarget());
+    }
+    
+    CoreLinks_.assign(cores.size(), std::vector<CoreLink>(cores.size()));
+    for(auto &from : cores) for(auto &to : cores)
+    {
+        auto &link = CoreLinks_[from.Index][to.Index];
+        for(auto *pfrommem : accessible[from.Index]) for(auto *ptomem : accessible[to.Index])
+        {
+            if(pfrommem == ptomem) link.SharedMem = true;
+            else if(routing.IsReachable(*pfrommem->pMem, *ptomem->pMem))
+                link.Routes.push_back(routing.GetCost(*pfrommem->pMem, *ptomem->pMem));
+        }
+    }
+    
+    int ndmas = 0;
+    AvgDmaFixCost_ = AvgDmaByteCost_ = 0;
+    for(auto &conn : Platform_.GetGraph().Edges())
+    {
+        if(conn.Controllers.empty()) continue;
+        ++ndmas;
+        AvgDmaFixCost_ += conn.FixCost;
+        AvgDmaByteCost_ += conn.WriteCost;
+    }
+    if(ndmas > 0) AvgDmaFixCost_ /= ndmas, AvgDmaByteCost_ /= ndmas;
+}
+
+// Time for transferring size bytes from a task on core fromcore to one on core tocore
+Time Schedule::CommCost(int fromcore, int tocore, long size) const
+{
+    auto &link = CoreLinks_[fromcore][tocore];
+    if(fromcore == tocore || link.SharedMem || size == 0) return 0;
+    if(link.Routes.empty()) return Time_Infinite;
+    return Min(link.Routes, [size](auto &cost) { return Time(cost.For(size)); });
+}
+
+// Time for transferring size bytes between two cores, averaged over all DMA connections of the platform (as in HEFT)
+Time Schedule::AvgCommCost(long size) const
+{
+    return size ? Time(AvgDmaFixCost_ + AvgDmaByteCost_*size) : 0;
+}
+
+// Duration of tn if it starts at start, given the tasks and transfers already scheduled: Where more of them access a
+// memory at the same time than it has ports, they share its bandwidth, so the time tn spends accessing it grows in
+// proportion. As list scheduling places one task after the other, only the new task is slowed down by the overlap.
+Time Schedule::ContendedDuration(const Tasknode &tn, Time start) const
+{
+    auto &mems = Platform_.GetMemories();
+    Time ret = tn.Isolated;
+    for(auto &access : tn.Accesses)
+    {
+        int ports = mems[access.first].Ports;
+        if(ports <= 0 || access.second <= 0) continue;
+        auto &load = MemLoads_[access.first];
+        long users = load.GetCapacity() - load.LeastAvail(start, start + std::max<Time>(tn.Isolated, 1)) + 1;
+        if(users > ports) ret += access.second * (users - ports) / ports;
+    }
+    return ret;
+}
+
+// Chooses the core on which tn finishes first, respecting the transfer times from its predecessors, among the cores
+// on which it has a duration (cf. CalcTaskDurations). Returns the start time on that core.
+Time Schedule::PlaceEarliestFinish(Tasknode &tn, Time ready)
+{
+    auto &cores = Platform_.GetCores();
+    Time bestsched = Time_Infinite, bestfinish = Time_Infinite;
+    int bestcore = tn.Processors.front();
+    
+    for(int cid = 0, ncores = cores.size(); cid < ncores; ++cid)
+    {
+        Time dura = tn.TypeDurations.empty() ? tn.Duration : tn.TypeDurations[CoreTypes_[cid]];
+        if(dura == Time_Infinite) continue;
+        
+        Time sched = ready;
+        for(auto &e : tn.InEdges())
+        {
+            auto &pred = *e.GetSource();
+            auto comm = CommCost(pred.Processors.front(), cid, e.Size);
+            if(comm == Time_Infinite) { sched = Time_Infinite; break; }
+            sched = std::max(sched, pred.Start + pred.Duration + comm);
+        }
+        
+        // The task must fit into a gap of the core's schedule and into the memory of all groups of the core
+        for(Time prev = -1; sched != prev && sched < Time_Infinite; )
+        {
+            prev = sched;
+            sched = CoreOccs_[cid].Available(sched, dura, &tn);
+            for(auto *pg : cores[cid].Groups)
+                sched = std::max(sched, GroupOccs_[pg->Index].Available(sched, dura, tn.TotalMemUse));
+        }
+        
+        if(sched < Time_Infinite && sched + dura < bestfinish)
+            bestsched = sched, bestfinish = sched + dura, bestcore = cid;
+    }
+    
+    tn.Processors.assign({bestcore});
+    if(!tn.TypeDurations.empty()) tn.Duration = tn.TypeDurations[CoreTypes_[bestcore]];
+    return bestsched;
 }
 
 Schedule::~Schedule() {} //For destruction of incomplete type (in class declaration) of Taskgraph
 
+std::size_t Schedule::GetHeapBytes() const
+{
+    std::size_t ret = HeapBytes(CoreOccs_) + HeapBytes(MemOccs_) + HeapBytes(GroupOccs_) + HeapBytes(RuntimeOccEnds_)
+                    + HeapBytes(MemLoads_) + HeapBytes(Transitions) + HeapBytes(CoreTypes_) + HeapBytes(CoreLinks_);
+    for(auto & occ : CoreOccs_) ret += occ.GetHeapBytes();
+    for(auto & occ : MemOccs_) ret += occ.GetHeapBytes();
+    for(auto & occ : MemLoads_) ret += occ.GetHeapBytes();
+    for(auto & occ : GroupOccs_) ret += occ.GetHeapBytes();
+    for(auto & ends : RuntimeOccEnds_) ret += ends.size() * (sizeof(*ends.begin()) + 4*sizeof(void*));
+    for(auto & trans : Transitions) ret += trans.GetHeapBytes();
+    for(auto & links : CoreLinks_)
+    {
+        ret += HeapBytes(links);
+        for(auto & link : links) ret += HeapBytes(link.Routes);
+    }
+    if(upGraph_)
+    {
+        ret += sizeof(Taskgraph) + upGraph_->GetHeapBytes();
+        for(auto & node : upGraph_->Nodes())
+        {
+            ret += HeapBytes(node.TypeDurations) + HeapBytes(node.DataDist) + HeapBytes(node.Processors)
+                 + HeapBytes(node.Accesses);
+            for(auto & dists : node.DataDist)
+            {
+                ret += HeapBytes(dists);
+                for(auto & use : dists) ret += HeapBytes(use.Uses);
+            }
+        }
+    }
+    return ret;
+}
+
 
-void Schedule::BuildGraph(IfaceMapping *pdm, SpillMapping *psm)
+bool Schedule::BuildGraph(IfaceMapping *pdm, SpillMapping *psm)
 {
     assert((!pdm) == (!psm));
     upGraph_->Clear();
     
     // Insert task nodes for tasks
     auto nodemap = InsertTaskNodes();
-    CalcTaskDurations(pdm);
+    if(!CalcTaskDurations(pdm)) return false;
     
     // Insert task nodes for data transfers and edges between them. Also, fill Transitions
-    CalcTransitions(nodemap, pdm, psm);
+    if(!CalcTransitions(nodemap, pdm, psm)) return false;
     
     // Take Transitions and build uses and edges between nodes
     CalcDataDist();
@@ -197,8 +413,15 @@ void Schedule::BuildGraph(IfaceMapping *pdm, SpillMapping *psm)
     // Insert remaining edges from transitions
     InsertTransitionEdges(nodemap);
     
+    for(auto &e : upGraph_->Edges()) if(e.FromDist) ++e.FromDist->Consumers;
+    
     // Calculate memory statistics for all nodes
-    for(auto &n : upGraph_->Nodes()) n.CalcMemStats();
+    for(auto &n : upGraph_->Nodes())
+    {
+        n.CalcMemStats();
+        n.Isolated = n.Duration;
+    }
+    return true;
 }
 
 graph::ItemMap<Schedule::Tasknode*> Schedule::InsertTaskNodes()
@@ -209,35 +432,55 @@ graph::ItemMap<Schedule::Tasknode*> Schedule::InsertTaskNodes()
     for(auto &t : Program_.GetTasks())
 {
         auto *pn = graph.EmplaceNode(t);
-        pn->Processors.assign({t.Group->GetBinding()->Index});
+        auto *pcore = pTaskCores_ ? (*pTaskCores_)[t] : t.Group->GetBinding();
+        pn->Processors.assign({pcore->Index});
         ret[t] = pn;
     }
     return ret;
 }
     
+// Calculates the duration of each task on its core from its cost on the type of that core and from its memory
+// accesses, the time of which is also recorded per memory for the contention model. Without an interface mapping, the durations on the other core types are calculated as well: Tasks may only
+// be moved to other core types on which they have a cost of their own (Task::TypeCosts), as their (default) Cost may
+// not hold for them.
 bool Schedule::CalcTaskDurations(IfaceMapping *pdm)
 {
     auto &connmap = Platform_.GetConnMap();
+    auto &types = Platform_.GetCoreTypes();
     for(auto &n : upGraph_->Nodes())
     {
         if(!n.pSpec) continue;
         
-        Time dura = n.pSpec->Cost;
+        auto &core = Platform_.GetCores()[n.Processors.front()];
+        double cost = n.pSpec->GetCost(core.Type->Name);
+        if(cost < 0)
+        {
+            if(!Quiet_) gMsgUI.Error("Task '%s' cannot run on core '%s' of type '%s', to which it is mapped",
+                                     n.pSpec->GetFullName().c_str(), core.Name.c_str(), core.Type->Name.c_str());
+            return false;
+        }
+        
+        Time dura = 0;
+        n.Accesses.clear();
         for(auto &d : n.pSpec->Ifaces)
         {
             int rcost, wcost;
             if(pdm)
             {
                 auto *pmem = pdm->at(&d);
-                auto &core = Platform_.GetCores()[n.Processors.front()];
                 auto *hwconn = connmap[core.pNode][pmem->pNode];
                 if(!hwconn)
                 {
-                    gMsgUI.Error("Cannot access memory '%s' from core '%s' although the mapping says so",
+                    if(!Quiet_) gMsgUI.Error("Cannot access memory '%s' from core '%s' although the mapping says so",
                                  pmem->Name.c_str(), core.Name.c_str());
                     return false;
                 }
                 rcost = hwconn->ReadCost, wcost = hwconn->WriteCost;
+                Time access = Time(rcost)*d.Reads + Time(wcost)*d.Writes;
+                auto it = std::find_if(n.Accesses.begin(), n.Accesses.end(),
+                                       [pmem](auto &entry) { return entry.first == pmem->Index; });
+                if(it == n.Accesses.end()) n.Accesses.emplace_back(pmem->Index, access);
+                else it->second += access;
             }
             else
             {
@@ -245,7 +488,18 @@ bool Schedule::CalcTaskDurations(IfaceMapping *pdm)
             }
             dura += rcost*d.Reads + wcost*d.Writes;
         }
-        n.Duration = dura;
+        n.Duration = Time(cost) + dura;
+        
+        n.TypeDurations.clear();
+        if(pdm) continue;
+        n.TypeDurations.assign(types.size(), Time_Infinite);
+        n.TypeDurations[CoreTypes_[core.Index]] = n.Duration;
+        for(auto &entry : n.pSpec->TypeCosts)
+        {
+            auto it = std::find_if(types.begin(), types.end(),
+                                   [&entry](auto &type) { return type.Name == entry.first; });
+            if(it != types.end() && entry.second >= 0) n.TypeDurations[it - types.begin()] = Time(entry.second) + dura;
+        }
     }
     return true;
 }
@@ -260,68 +514,77 @@ bool Schedule::CalcTransitions(const graph::ItemMap<Tasknode*> &nodemap, IfaceMa
         return true;
     }    
     
-    auto connect = [this](Platform::Memory *pfrommem, Platform::Memory *ptomem, long size)
+    // Tasks and uses point into Transitions, so it must not be reallocated. There are at most two per dependency.
+    Transitions.clear();
+    Transitions.reserve(2*Program_.Dependencies.size());
+    
+    // Appends a transfer task for each hop of the route from pfrommem to ptomem to transfers. Consecutive transfers
+    // are connected by an edge for the data held in the memory between them.
+    auto connect = [this](Platform::Memory *pfrommem, Platform::Memory *ptomem, long size,
+                          std::vector<Tasknode*> &transfers)
     {
         assert(pfrommem && ptomem);
-        auto *pconn = Platform_.GetConnMap()[pfrommem->pNode][ptomem->pNode];
-        if(!pconn)
+        auto route = Platform_.GetRouting().GetRoute(*pfrommem, *ptomem);
+        if(route.empty())
         {
             gMsgUI.Fatal("Cannot transfer data from memory '%s' from memory '%s' although the mapping says so",
                             pfrommem->Name.c_str(), ptomem->Name.c_str());
-            return (Tasknode*) nullptr;
+            return false;
         }
         
-        auto newtask = upGraph_->EmplaceNode();
-        newtask->Duration = pconn->DmaCost(size);
-        
-        newtask->Processors.reserve(pconn->Controllers.size());
-        for(auto pctrl : pconn->Controllers) newtask->Processors.push_back(pctrl->Index + DmaIndexBase_);
-        
-        return newtask;
+        for(auto *pconn : route)
+        {
+            auto newtask = upGraph_->EmplaceNode();
+            newtask->Duration = pconn->DmaCost(size);
+            newtask->Accesses = {{pconn->GetSource()->pMem->Index, newtask->Duration},
+                                 {pconn->GetTarget()->pMem->Index, newtask->Duration}};
+            
+            newtask->Processors.reserve(pconn->Controllers.size());
+            for(auto pctrl : pconn->Controllers) newtask->Processors.push_back(pctrl->Index + DmaIndexBase_);
+            
+            if(!transfers.empty())
+            {
+                auto *pprev = transfers.back();
+                int mem = pconn->GetSource()->pMem->Index;
+                auto pe = upGraph_->EmplaceEdge(pprev, newtask, nullptr);
+                pe->Size = size;
+                pe->Mem = mem;
+                pprev->DataDist.resize(1);
+                pprev->DataDist[0].emplace_back();
+                auto &u = pprev->DataDist[0].back();
+                u.Size = size;
+                u.Mem = mem;
+                pe->FromDist = &u;
+            }
+            transfers.push_back(newtask);
+        }
+        return true;
     };
     
+    std::vector<Tasknode*> transfers;
+    
     for(auto &dep : Program_.Dependencies)
     {
         auto *pfrommem = pdm->at(dep.From.TheIface), *ptomem = pdm->at(dep.To.TheIface);
         auto *pspillmem = psm->at(&dep);
-        assert(pfrommem && ptomem && pspillmem);
+        assert(pfrommem && ptomem);
             
-        if(!pspillmem)
+        if(!pspillmem && pfrommem == ptomem)
         {
-            if(pfrommem == ptomem)
-            {
-                Transitions.emplace_back(dep, pfrommem->Index);
-                continue;
-            }
-            else
-            {
-                auto newtask = connect(pfrommem, ptomem, dep.GetMemSize());
-                if(!newtask) return false;
-                Transitions.emplace_back(dep, newtask, pfrommem->Index);
-                Transitions.emplace_back(newtask, dep, ptomem->Index);
-                newtask->pTransferDims = &Transitions.back().From.Index;
-            }
-        }
-        else
-        {
-            auto size = dep.GetMemSize();
-            
-            auto newtask1 = connect(pfrommem, pspillmem, size), newtask2 = connect(pspillmem, ptomem, size);
-            if(!newtask1 || !newtask2) return false;
-            
-            Transitions.emplace_back(dep, newtask1, pfrommem->Index);
-            Transitions.emplace_back(newtask2, dep, ptomem->Index);
-            newtask1->pTransferDims = newtask2->pTransferDims = &Transitions.back().From.Index;
-            
-            auto pe = upGraph_->EmplaceEdge(newtask1, newtask2, nullptr);
-            pe->Size = size;
-            pe->Mem = pspillmem->Index;
-            newtask1->DataDist.resize(1);
-            newtask1->DataDist[0].emplace_back();
-            auto &u = newtask1->DataDist[0].back();
-            u.Size = size;
-            pe->FromDist = &u;
+            Transitions.emplace_back(dep, pfrommem->Index);
+            continue;
         }
+        
+        // the data goes over all hops of the route, through the spill memory if there is one
+        auto size = dep.GetMemSize();
+        transfers.clear();
+        if(!pspillmem && !connect(pfrommem, ptomem, size, transfers)) return false;
+        if(pspillmem && !(connect(pfrommem, pspillmem, size, transfers) && connect(pspillmem, ptomem, size, transfers)))
+            return false;
+        
+        Transitions.emplace_back(dep, transfers.front(), pfrommem->Index);
+        Transitions.emplace_back(transfers.back(), dep, ptomem->Index);
+        for(auto *ptransfer : transfers) ptransfer->pTransferDims = &Transitions.back().From.Index;
     }
     
     return true;
@@ -363,6 +626,7 @@ void Schedule::CalcDataDist()
             use.Size = sec.second.GetVolume()*basesize;
             use.Uses.reserve(sec.first->size());
             use.Uses.assign(sec.first->begin(), sec.first->end());
+            use.Mem = use.Uses.front()->Mem;
             use.RefCount = use.Uses.size();
         }
     };
@@ -397,8 +661,9 @@ void Schedule::InsertTransitionEdges(const graph::ItemMap<Tasknode*> &nodemap)
             {
                 for(auto *pdep : u.Uses)
                 {
-                    auto *pto = pdep->To.TheIface->GetTask();
-                    auto pedge = upGraph_->EmplaceEdge(&n, nodemap[pto], pdep);
+                    // The data either goes to a task or (if the data has to be transferred) to a transfer task
+                    auto *pto = pdep->To.TheIface ? nodemap[pdep->To.TheIface->GetTask()] : pdep->pSubstNode;
+                    auto pedge = upGraph_->EmplaceEdge(&n, pto, pdep);
                     pedge->FromDist = &u;
                     pedge->Mem = pdep->Mem;
                 }
@@ -407,7 +672,7 @@ void Schedule::InsertTransitionEdges(const graph::ItemMap<Tasknode*> &nodemap)
     }
 }
 
-bool Schedule::ReverseListScheduling(long (*priority)(Tasknode&))
+bool Schedule::ReverseListScheduling(const std::function<long(Tasknode&)> &priority)
 {
     // Initialize ready list and unfulfilled dependency count
     std::priority_queue<SchedulingItem> readylist;
@@ -462,7 +727,7 @@ bool Schedule::ReverseListScheduling(long (*priority)(Tasknode&))
     
     if(lefttoschedule > 0)
     {
-        gMsgUI.Error("List scheduling failed: Not all tasks could be scheduled.");
+        if(!Quiet_) gMsgUI.Error("List scheduling failed: Not all tasks could be scheduled.");
         return false;
     }
     
@@ -476,12 +741,12 @@ bool Schedule::CalcAlap()
     
     return ReverseListScheduling([](Tasknode &n){ return long(n.OutEdgeCount());})
         || ReverseListScheduling([](Tasknode &n){ return long(n.InEdgeCount());})
-        || ReverseListScheduling([](Tasknode &n){ return long(std::rand());})
+        || ReverseListScheduling([this](Tasknode &n){ return long(Rng_());})
         || ReverseListScheduling([](Tasknode &n){ return -n.Alap;});
 }
 
 
-bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm, bool prerun)
+bool Schedule::ListScheduling(const Strategy &strategy, IfaceMapping *pdm, SpillMapping *psm, bool prerun)
 {
     auto &graph = *upGraph_.get();
     constexpr auto infinite = decltype(CoreOccs_)::value_type::Infinite;
@@ -491,13 +756,25 @@ bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm,
         Tasknode *pTasknode;
         long Amount;
     };
-    auto priority = [weight,prerun](Tasknode &tn)
+    auto weight = strategy.Weight;
+    auto urgency = [&strategy](Tasknode &tn)
     {
-        if(tn.pSpec) return (tn.MemDiff<<weight) - tn.Alap;
+        switch(strategy.Prio)
+        {
+            case Priority::UpwardRank: return tn.Rank;
+            case Priority::CriticalPath: return tn.Rank + tn.DownRank;
+            default: return -tn.Alap;
+        }
+    };
+    bool placecores = !pdm && strategy.Place == Placement::EarliestFinish;
+    auto priority = [weight,prerun,&strategy,&urgency](Tasknode &tn)
+    {
+        bool memaware = (strategy.Prio == Priority::MemDiff);
+        if(tn.pSpec) return (memaware ? long(tn.MemDiff)<<weight : 0L) + urgency(tn);
         else
         {
-            if(prerun) return (tn.TotalMemUse/2<<weight) - tn.Alap;
-            else return std::numeric_limits<long>::max()/2 - tn.Alap;
+            if(prerun) return (memaware ? long(tn.TotalMemUse/2)<<weight : 0L) + urgency(tn);
+            else return std::numeric_limits<long>::max()/2 + urgency(tn);
         }
     };
     
@@ -506,16 +783,20 @@ bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm,
     for(auto &n : graph.Nodes())
     {
         n.Start = 0;
+        n.Duration = n.Isolated;
         n.OpenDependencies = n.InEdgeCount();
         if(n.OpenDependencies == 0)
         {
             readylist.emplace(n, priority(n));
         }
-        for(auto &dd : n.DataDist) for(auto &u : dd) u.RefCount = u.Uses.size();
+        for(auto &dd : n.DataDist) for(auto &u : dd) u.RefCount = u.Consumers;
     }
     for(auto &co : CoreOccs_) co.Clear();
     for(auto &go : GroupOccs_) go.Clear();
     for(auto &mo : MemOccs_) mo.Clear();
+    for(auto &ml : MemLoads_) ml.Clear();
+    if(prerun) for(auto &ends : RuntimeOccEnds_) ends.clear();
+    OverflowMem_ = -1;
 
     std::vector<long> memalloc, memfree;
     std::vector<std::vector<MemRequirement>> memrequirements(MemOccs_.size());
@@ -532,6 +813,7 @@ bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm,
         
         // Find out when we can schedule the task
         Time sched = next.ReadyTime;
+        if(placecores) sched = PlaceEarliestFinish(tn, sched);
         for(auto cid : tn.Processors) sched = std::max(sched, CoreOccs_[cid].Available(sched, tn.Duration, &tn));
         
         if(!pdm)
@@ -566,7 +848,7 @@ bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm,
                     for(auto &e : tn.InEdges()) //TODO: schedule task later if time is still needed for data transport
                     {
                         auto &from = *e.GetSource();
-                        if(!from.pSpec && size_t(e.FromDist->RefCount) == e.FromDist->Uses.size())
+                        if(!from.pSpec && e.FromDist && e.FromDist->RefCount == e.FromDist->Consumers)
                         { // from is a transport task, and the memory has not been allocated yet by another task
                             memalloc[e.Mem] += e.Size;
                         }
@@ -577,7 +859,7 @@ bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm,
             { // trying to schedule a transport task, and we are not doing a prerun, so allocate output memory
                 for(auto &dd : tn.DataDist)
                     for(auto &u : dd)
-                        memalloc[u.Uses.front()->Mem] += u.Size;
+                        memalloc[u.Mem] += u.Size;
             }
             
             for(auto i = memalloc.size(); i-- > 0; )
@@ -588,11 +870,24 @@ bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm,
                     if(sched == infinite)
                     {
                         memrequirements[i].push_back(MemRequirement({&tn, memalloc[i]}));
+                        OverflowMem_ = i;
                         break;
                     }
                 }
             }
         }
+        
+        // Slow the task down by the accesses it overlaps with, which may push it out of its slot on the processors
+        if(pdm && Contention_ && sched < infinite)
+        {
+            for(Time prev = -1; prev != sched && sched < infinite; )
+            {
+                prev = sched;
+                tn.Duration = ContendedDuration(tn, sched);
+                for(auto cid : tn.Processors)
+                    sched = std::max(sched, CoreOccs_[cid].Available(sched, tn.Duration, &tn));
+            }
+        }
 
         // Can we schedule the task now, or not yet?
         if(!readylist.empty() && readylist.top().ReadyTime < sched)
@@ -608,6 +903,10 @@ bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm,
         
         auto endsched = sched+tn.Duration;
         for(auto cid : tn.Processors) CoreOccs_[cid].Occupy(sched, endsched, &tn);
+        if(Contention_ && endsched > sched)
+        {
+            for(auto &access : tn.Accesses) MemLoads_[access.first].Occupy(sched, endsched, 1);
+        }
         if(!pdm)
         { //No transportation tasks without memory mapping, so we only have "real" tasks here
             for(auto *pg : Platform_.GetCores()[tn.Processors.front()].Groups)
@@ -617,7 +916,7 @@ bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm,
         {
             for(auto &e : tn.InEdges())
             {
-                if(--e.FromDist->RefCount == 0)
+                if(e.FromDist && --e.FromDist->RefCount == 0) // edges added for the order carry no data
                     memfree[e.Mem] += e.Size;
             }
             
@@ -653,7 +952,7 @@ bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm,
     
     if(lefttoschedule > 0)
     {
-        gMsgUI.Error("List scheduling failed: Not all tasks could be scheduled.");
+        if(!Quiet_) gMsgUI.Error("List scheduling failed: Not all tasks could be scheduled.");
         return false;
     }
     
@@ -663,13 +962,29 @@ bool Schedule::ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm,
 
 bool Schedule::CalcSchedule(int weight, IfaceMapping *pdm, SpillMapping *psm)
 {
-    BuildGraph(pdm, psm);
+    Strategy strategy;
+    strategy.Weight = weight;
+    return CalcSchedule(strategy, pdm, psm);
+}
+
+bool Schedule::CalcSchedule(const Strategy &strategy, IfaceMapping *pdm, SpillMapping *psm)
+{
+    LastStrategy_ = strategy, pLastIfaces_ = pdm, pLastSpills_ = psm;
+    if(!BuildGraph(pdm, psm)) return false;
 
     auto &graph = *upGraph_.get();
+    Rng_.seed(strategy.Seed ? strategy.Seed : std::minstd_rand::default_seed);
+    for(auto &n : graph.Nodes()) n.TieBreak = strategy.Seed ? Rng_() : 0;
     if(!CalcAlap()) return false;
+    if(strategy.Prio == Priority::UpwardRank || strategy.Prio == Priority::CriticalPath)
+    {
+        auto commcost = [this](Dependency &e) { return AvgCommCost(e.Size); };
+        graph.CalcUpwardRank(commcost);
+        if(strategy.Prio == Priority::CriticalPath) graph.CalcDownwardRank(commcost);
+    }
     
     // Do one first list scheduling run in which buffers "temporarily disappear" between transfer and consumer tasks
-    if(!ListScheduling(weight, pdm, psm, true)) return false;
+    if(!ListScheduling(strategy, pdm, psm, true)) return false;
     if(!pdm) return true;
     
     // Check the obtained schedule on when the transfer tasks can be scheduled while respecting memory constraints,
@@ -687,7 +1002,358 @@ bool Schedule::CalcSchedule(int weight, IfaceMapping *pdm, SpillMapping *psm)
     }
     
     // Now perform a complete list scheduling with the help of the previously inserted dependencies
-    return ListScheduling(weight, pdm, psm, false);
+    return ListScheduling(strategy, pdm, psm, false);
+}
+
+bool Schedule::CalcScheduleWithSpills(const Strategy &strategy, IfaceMapping &dm, SpillMapping &sm)
+{
+    for(auto &dep : Program_.Dependencies) sm.emplace(&dep, nullptr); // keeps spills that are already present
+    
+    // Failed runs are expected until enough data has been spilled, so only report the final result
+    bool quiet = Quiet_, ret;
+    Quiet_ = true;
+    while(!(ret = CalcSchedule(strategy, &dm, &sm)) && OverflowMem_ >= 0)
+    {
+        Platform::Memory *pspillmem;
+        auto *pdep = ChooseSpill(OverflowMem_, dm, sm, pspillmem);
+        if(!pdep) break;
+        
+        sm[pdep] = pspillmem;
+        if(!quiet) gMsgUI.Verbose("Spilling data from '%s' to '%s' via memory '%s'.", 
+                                  pdep->From.TheIface->GetFullName().c_str(),
+                                  pdep->To.TheIface->GetFullName().c_str(), pspillmem->Name.c_str());
+    }
+    Quiet_ = quiet;
+    
+    if(!ret && !Quiet_)
+    {
+        if(OverflowMem_ >= 0) 
+        {
+            gMsgUI.Error("Memory '%s' overflows, and none of its data can be spilled to another memory.",
+                         Platform_.GetMemories()[OverflowMem_].Name.c_str());
+        }
+        else gMsgUI.Error("List scheduling failed: Not all tasks could be scheduled.");
+    }
+    return ret;
+}
+
+// Chooses the dependency to spill from memory mem: the one with the largest size times idle time (as of the last list
+// scheduling run) for which there is a memory to spill to. Returns nullptr if there is none.
+const spec::Dependency *Schedule::ChooseSpill(int mem, const IfaceMapping &dm, const SpillMapping &sm,
+                                              Platform::Memory *&rpspillmem) const
+{
+    auto &routing = Platform_.GetRouting();
+    auto nodes = Program_.TaskGraph.GetNodeMap<const Tasknode*>(nullptr);
+    for(auto &n : upGraph_->Nodes()) if(n.pSpec) nodes[n.pSpec] = &n;
+    
+    const spec::Dependency *pret = nullptr;
+    double bestscore = -1;
+    for(auto &dep : Program_.Dependencies)
+    {
+        if(sm.at(&dep)) continue; // already spilled
+        auto *pfrommem = dm.at(dep.From.TheIface), *ptomem = dm.at(dep.To.TheIface);
+        if(pfrommem->Index != mem && ptomem->Index != mem) continue;
+        
+        auto *pfrom = nodes[dep.From.TheIface->GetTask()], *pto = nodes[dep.To.TheIface->GetTask()];
+        auto idle = std::max<Time>(pto->Start - (pfrom->Start + pfrom->Duration), 0);
+        auto size = dep.GetMemSize();
+        double score = double(size) * double(idle + 1);
+        if(score <= bestscore) continue;
+        
+        // Spill to the largest memory (other than the ones on both ends) that can hold the data and be reached by DMA
+        Platform::Memory *pspillmem = nullptr;
+        for(auto &node : Platform_.GetGraph().Nodes())
+        {
+            auto *pmem = node.pMem;
+            if(!pmem || pmem == pfrommem || pmem == ptomem || pmem->Size*95/100 < size) continue;
+            if(pspillmem && pmem->Size <= pspillmem->Size) continue;
+            if(!routing.IsReachable(*pfrommem, *pmem) || !routing.IsReachable(*pmem, *ptomem)) continue;
+            pspillmem = pmem;
+        }
+        if(!pspillmem) continue;
+        
+        pret = &dep, rpspillmem = pspillmem, bestscore = score;
+    }
+    return pret;
+}
+
+// Formulation: start time s and, with MoveTasks, a choice among the cores sharing a memory with the current one for
+// each node; one order variable for each pair of nodes that may use the same processor at the same time (i.e. that
+// are not ordered by the graph or by their earliest and latest starts), which is only enforced (by a big M) if both
+// use that processor. The makespan is minimized.
+bool Schedule::CalcExactSchedule(const ExactOptions &options, ExactResult &result)
+{
+    result = ExactResult();
+    result.Heuristic = GetMakespan();
+    if(!HaveMilpSolver())
+    {
+        gMsgUI.Error("Exact scheduling needs an MILP solver. Configure ladybirds with -DLADYBIRDS_WITH_HIGHS=ON.");
+        return false;
+    }
+    
+    auto &graph = *upGraph_.get();
+    auto csr = graph.Freeze();
+    using Index = decltype(csr)::Index;
+    const Index n = csr.NodeCount();
+    const Time ub = result.Heuristic;
+    const bool move = options.MoveTasks && !pLastIfaces_;
+    std::vector<Tasknode*> nodes(n);
+    for(auto &tn : graph.Nodes()) nodes[csr.GetIndex(&tn)] = &tn;
+    
+    // the processors and durations each node may take, the current ones first
+    struct Choice
+    {
+        std::vector<int> Processors;
+        Time Duration;
+        int Column = -1; // binary choosing it, if there is more than one
+    };
+    std::vector<std::vector<Choice>> choices(n);
+    std::vector<Time> mindura(n);
+    Time maxdura = 0;
+    for(Index i = 0; i < n; ++i)
+    {
+        auto &tn = *nodes[i];
+        if(!move || !tn.pSpec || tn.TypeDurations.empty()) choices[i].push_back({tn.Processors, tn.Isolated});
+        else
+        {   // the task may have been moved by Placement::EarliestFinish, which does not update Isolated
+            int cur = tn.Processors.front();
+            choices[i].push_back({tn.Processors, tn.TypeDurations[CoreTypes_[cur]]});
+            for(int cid = 0, ncores = CoreTypes_.size(); cid < ncores; ++cid)
+            {
+                Time dura = tn.TypeDurations[CoreTypes_[cid]];
+                if(cid != cur && dura != Time_Infinite && CoreLinks_[cur][cid].SharedMem)
+                    choices[i].push_back({{cid}, dura});
+            }
+        }
+        mindura[i] = Min(choices[i], [](auto &c) { return c.Duration; });
+        for(auto &c : choices[i]) maxdura = std::max(maxdura, c.Duration);
+    }
+    
+    // earliest starts and the longest paths to the end, with the shortest durations
+    std::vector<Index> order;
+    if(!graph::TopologicalOrder(csr, order)) return false;
+    std::vector<Time> est(n, 0), tail(n, 0);
+    for(Index i : order) for(Index succ : csr.Successors(i)) est[succ] = std::max(est[succ], est[i] + mindura[i]);
+    for(auto it = order.rbegin(); it != order.rend(); ++it)
+    {
+        tail[*it] = mindura[*it];
+        for(Index succ : csr.Successors(*it)) tail[*it] = std::max(tail[*it], mindura[*it] + tail[succ]);
+    }
+    Time lb = n ? *std::max_element(tail.begin(), tail.end()) : 0;
+    const double bigm = double(ub + maxdura);
+    
+    Milp model;
+    std::vector<double> start;
+    auto addcolumn = [&](double lower, double upper, double value, bool integer)
+    {
+        start.push_back(value);
+        return model.AddColumn(lower, upper, 0, integer);
+    };
+    int cmax = addcolumn(lb, ub, ub, false);
+    model.Columns[cmax].Cost = 1;
+    std::vector<int> scol(n);
+    for(Index i = 0; i < n; ++i)
+    {
+        auto &tn = *nodes[i];
+        scol[i] = addcolumn(est[i], ub - tail[i], tn.Start, false);
+        if(choices[i].size() < 2) continue;
+        std::vector<std::pair<int, double>> one;
+        for(std::size_t k = 0; k < choices[i].size(); ++k)
+        {
+            choices[i][k].Column = addcolumn(0, 1, k == 0, true);
+            one.emplace_back(choices[i][k].Column, 1);
+        }
+        model.AddRow(1, 1, std::move(one));
+    }
+    
+    // adds factor times the duration of node i to a row, or to its constant part if the duration is fixed
+    auto addduration = [&](Index i, double factor, std::vector<std::pair<int, double>> &entries, double &constant)
+    {
+        if(choices[i].size() < 2) constant += factor * choices[i].front().Duration;
+        else for(auto &c : choices[i]) entries.emplace_back(c.Column, factor * c.Duration);
+    };
+    for(Index i = 0; i < n; ++i)
+    {
+        // makespan and successors after the end of the node
+        std::vector<std::pair<int, double>> entries{{cmax, 1}, {scol[i], -1}};
+        double constant = 0;
+        addduration(i, -1, entries, constant);
+        model.AddRow(-constant, Milp::Infinity, entries);
+        for(Index succ : csr.Successors(i))
+        {
+            entries[0].first = scol[succ];
+            model.AddRow(-constant, Milp::Infinity, entries);
+        }
+    }
+    
+    // nodes on a common processor do not overlap, unless the graph or their time windows order them anyway
+    auto reach = graph::ReachabilityMatrix(csr);
+    auto shareprocs = [](const Choice &a, const Choice &b)
+    {
+        return std::any_of(a.Processors.begin(), a.Processors.end(), [&b](int p)
+                           { return std::find(b.Processors.begin(), b.Processors.end(), p) != b.Processors.end(); });
+    };
+    for(Index i = 0; i < n; ++i) for(Index j = i+1; j < n; ++j)
+    {
+        auto &ni = *nodes[i], &nj = *nodes[j];
+        if(reach[ni].Contains(nj) || reach[nj].Contains(ni)) continue;
+        if(ub - tail[i] + mindura[i] <= est[j] || ub - tail[j] + mindura[j] <= est[i]) continue;
+        int ocol = -1;
+        for(auto &ci : choices[i]) for(auto &cj : choices[j])
+        {
+            if(!shareprocs(ci, cj)) continue;
+            if(ocol < 0) ocol = addcolumn(0, 1, ni.Start + choices[i].front().Duration <= nj.Start, true);
+            // with o = 1, i comes first: s_j - s_i >= d_i; else s_i - s_j >= d_j, both relaxed unless both chosen
+            std::vector<std::pair<int, double>> first{{scol[j], 1}, {scol[i], -1}, {ocol, -bigm}};
+            std::vector<std::pair<int, double>> second{{scol[i], 1}, {scol[j], -1}, {ocol, bigm}};
+            double relax = 0;
+            for(auto *pc : {&ci, &cj})
+            {
+                if(pc->Column < 0) continue;
+                first.emplace_back(pc->Column, -bigm), second.emplace_back(pc->Column, -bigm);
+                relax += bigm;
+            }
+            model.AddRow(double(ci.Duration) - bigm - relax, Milp::Infinity, std::move(first));
+            model.AddRow(double(cj.Duration) - relax, Milp::Infinity, std::move(second));
+        }
+    }
+    
+    int violation = model.FindViolation(start);
+    if(violation >= 0 && !Quiet_)
+        gMsgUI.Warning("Exact scheduling: the list schedule violates constraint %d; starting without it.", violation);
+    if(!Quiet_) gMsgUI.Verbose("Exact scheduling: %zu variables, %zu constraints.",
+                               model.Columns.size(), model.Rows.size());
+    auto solution = SolveMilp(model, violation < 0 ? &start : nullptr, options.TimeLimit, options.Verbose);
+    if(solution.TheStatus == MilpResult::Status::Failed)
+    {
+        if(!Quiet_) gMsgUI.Error("Exact scheduling: the solver failed.");
+        return false;
+    }
+    if(solution.TheStatus == MilpResult::Status::Infeasible && !Quiet_)
+        gMsgUI.Warning("Exact scheduling: the solver found no schedule, not even the one it started from.");
+    result.Bound = solution.Bound > lb ? Time(std::ceil(solution.Bound - 1e-6)) : lb;
+    
+    if(!solution.Values.empty() && solution.Objective < ub - 0.5)
+    {
+        // move the nodes to the processors of the solution and chain them on each processor in their order there
+        std::vector<std::vector<std::pair<Time, Index>>> procorder(CoreOccs_.size());
+        std::vector<Index> toposition(n);
+        for(Index k = 0; k < n; ++k) toposition[order[k]] = k;
+        for(Index i = 0; i < n; ++i)
+        {
+            auto &tn = *nodes[i];
+            auto it = std::find_if(choices[i].begin(), choices[i].end(),
+                                   [&](auto &c) { return c.Column < 0 || solution.Values[c.Column] > 0.5; });
+            tn.Processors = it->Processors;
+            tn.Duration = tn.Isolated = it->Duration;
+            for(int p : tn.Processors) procorder[p].emplace_back(std::llround(solution.Values[scol[i]]), i);
+        }
+        std::vector<std::pair<Tasknode*, Tasknode*>> chain;
+        for(auto &onproc : procorder)
+        {
+            std::sort(onproc.begin(), onproc.end(), [&toposition](auto &a, auto &b)
+                      { return std::tie(a.first, toposition[a.second]) < std::tie(b.first, toposition[b.second]); });
+            for(std::size_t k = 1; k < onproc.size(); ++k)
+                chain.emplace_back(nodes[onproc[k-1].second], nodes[onproc[k].second]);
+        }
+        for(auto &link : chain) graph.EmplaceEdge(link.first, link.second, nullptr);
+        
+        Strategy strategy = LastStrategy_;
+        strategy.Place = Placement::Fixed;
+        bool quiet = Quiet_;
+        Quiet_ = true;
+        result.Improved = ListScheduling(strategy, pLastIfaces_, pLastSpills_, !pLastIfaces_)
+                       && GetMakespan() < ub;
+        Quiet_ = quiet;
+        if(!result.Improved && !CalcSchedule(LastStrategy_, pLastIfaces_, pLastSpills_)) return false;
+    }
+    
+    Time makespan = GetMakespan();
+    result.Gap = makespan > 0 ? double(makespan - std::min(result.Bound, makespan)) / double(makespan) : 0;
+    if(!Quiet_)
+    {
+        gMsgUI.Verbose("Exact scheduling: makespan %ld (list scheduling: %ld), lower bound %ld, gap %.1f%%%s.",
+                       long(makespan), long(ub), long(result.Bound), 100*result.Gap,
+                       solution.TheStatus == MilpResult::Status::Optimal ? "" : " (time limit reached)");
+    }
+    return true;
+}
+
+std::unique_ptr<Schedule> Schedule::CalcBestSchedule(Program &prog, Platform &pf, 
+                                                     const std::vector<Strategy> &strategies,
+                                                     IfaceMapping *pdm, SpillMapping *psm, unsigned nthreads)
+{
+    pf.GetConnMap(); // computed on first use, so make sure that the runs do not compute it concurrently
+    pf.GetRouting();
+    
+    if(nthreads == 0) nthreads = std::max(1u, std::thread::hardware_concurrency());
+    nthreads = std::min<std::size_t>(nthreads, strategies.size());
+    
+    struct Candidate
+    {
+        std::unique_ptr<Schedule> upSchedule;
+        Time Makespan = Time_Infinite;
+        std::size_t Index = 0;
+        
+        bool IsBetter(const Candidate &other) const
+        {
+            return upSchedule
+                && (!other.upSchedule || std::tie(Makespan, Index) < std::tie(other.Makespan, other.Index));
+        }
+    };
+    std::vector<Candidate> bests(nthreads);
+    std::atomic<std::size_t> next(0);
+    
+    auto work = [&](Candidate &best)
+    {
+        for(std::size_t i; (i = next++) < strategies.size(); )
+        {
+            Candidate cand;
+            cand.upSchedule = std::make_unique<Schedule>(prog, pf);
+            cand.upSchedule->Quiet_ = true;
+            if(!cand.upSchedule->CalcSchedule(strategies[i], pdm, psm)) continue;
+            cand.Makespan = cand.upSchedule->GetMakespan();
+            cand.Index = i;
+            if(cand.IsBetter(best)) best = std::move(cand);
+        }
+    };
+    
+    std::vector<std::thread> threads;
+    threads.reserve(nthreads);
+    for(unsigned i = 1; i < nthreads; ++i) threads.emplace_back(work, std::ref(bests[i]));
+    if(nthreads > 0) work(bests[0]);
+    for(auto &th : threads) th.join();
+    
+    Candidate ret;
+    for(auto &cand : bests) if(cand.IsBetter(ret)) ret = std::move(cand);
+    if(!ret.upSchedule) return nullptr;
+    
+    ret.upSchedule->Quiet_ = false;
+    gMsgUI.Verbose("Best of %zu scheduling strategies: #%zu with makespan %ld.", 
+                   strategies.size(), ret.Index, long(ret.Makespan));
+    return std::move(ret.upSchedule);
+}
+
+std::vector<Schedule::Strategy> Schedule::MakePortfolio(int maxweight, int nseeds)
+{
+    std::vector<Strategy> ret;
+    for(int seed = 0; seed < nseeds; ++seed)
+    {
+        Strategy strategy;
+        strategy.Seed = seed;
+        for(strategy.Weight = 0; strategy.Weight <= maxweight; ++strategy.Weight) ret.push_back(strategy);
+        strategy.Weight = 0;
+        for(auto prio : {Priority::Alap, Priority::UpwardRank, Priority::CriticalPath})
+        {
+            strategy.Prio = prio;
+            strategy.Place = Placement::Fixed;
+            ret.push_back(strategy);
+            if(prio == Priority::Alap) continue;
+            strategy.Place = Placement::EarliestFinish;
+            ret.push_back(strategy);
+        }
+    }
+    return ret;
 }
 
 graph::ItemMap<Schedule::TaskTimings> Schedule::GetTaskTimings() const
@@ -701,6 +1367,107 @@ graph::ItemMap<Schedule::TaskTimings> Schedule::GetTaskTimings() const
     return ret;
 }
 
+graph::ItemMap<const Platform::Core*> Schedule::GetTaskCores() const
+{
+    auto ret = Program_.TaskGraph.GetNodeMap<const Platform::Core*>(nullptr);
+    
+    for(auto &n : upGraph_->Nodes())
+    {
+        if(n.pSpec) ret[n.pSpec] = &Platform_.GetCores()[n.Processors.front()];
+    }
+    return ret;
+}
+
+std::vector<long> Schedule::GetPeakOccupancy() const
+{
+    std::vector<long> ret;
+    ret.reserve(MemOccs_.size());
+    for(auto &mo : MemOccs_) ret.push_back(mo.GetCapacity() - mo.LeastAvail(0, Time_Infinite));
+    return ret;
+}
+
+std::vector<long> Schedule::GetGroupPeakOccupancy() const
+{
+    std::vector<long> ret;
+    ret.reserve(GroupOccs_.size());
+    for(auto &go : GroupOccs_) ret.push_back(go.GetCapacity() - go.LeastAvail(0, Time_Infinite));
+    return ret;
+}
+
+/// \internal Quotes \p s as a JSON string
+static std::string JsonQuote(const std::string &s)
+{
+    std::string ret("\"");
+    for(char c : s)
+    {
+        if(c == '"' || c == '\\') ret += '\\';
+        if((unsigned char) c < 0x20) ret += strprintf("\\u%04x", c);
+        else ret += c;
+    }
+    return ret += '"';
+}
+
+void Schedule::WriteTrace(std::ostream &strm) const
+{
+    enum { CorePid, DmaPid, MemPid };
+    const char *sep = "\n";
+    auto meta = [&](const char *what, int pid, int tid, const std::string &name)
+    {
+        strm << sep << strprintf(R"(  {"name": "%s", "ph": "M", "pid": %d, "tid": %d, "args": {"name": %s}})",
+                                 what, pid, tid, JsonQuote(name).c_str());
+        sep = ",\n";
+    };
+    
+    strm << "{\"traceEvents\": [";
+    meta("process_name", CorePid, 0, "Cores");
+    meta("process_name", DmaPid, 0, "DMA controllers");
+    meta("process_name", MemPid, 0, "Memory occupation");
+    for(auto &core : Platform_.GetCores()) meta("thread_name", CorePid, core.Index, core.Name);
+    for(auto &dma : Platform_.GetDmaControllers()) meta("thread_name", DmaPid, dma.Index, dma.Name);
+    
+    std::vector<Time> events = {0};
+    for(auto &n : upGraph_->Nodes())
+    {
+        auto name = n.pSpec ? n.pSpec->GetFullName() : strprintf("transfer (%ld bytes)", n.OutEdgesBegin()->Size);
+        for(auto proc : n.Processors)
+        {
+            bool isdma = proc >= DmaIndexBase_;
+            strm << sep << strprintf(R"(  {"name": %s, "cat": "%s", "ph": "X", "ts": %ld, "dur": %ld, )"
+                                     R"("pid": %d, "tid": %d})",
+                                     JsonQuote(name).c_str(), isdma ? "transfer" : "task", (long) n.Start,
+                                     (long) n.Duration, isdma ? DmaPid : CorePid, isdma ? proc-DmaIndexBase_ : proc);
+        }
+        events.push_back(n.Start);
+        events.push_back(n.Start+n.Duration);
+    }
+    std::sort(events.begin(), events.end());
+    events.erase(std::unique(events.begin(), events.end()), events.end());
+    
+    auto counter = [&](const std::string &name, const gen::OccupationChart<long, gen::SegmentTreeChart> &chart)
+    {
+        if(chart.LeastAvail(0, Time_Infinite) == chart.GetCapacity()) return; // never used
+        long last = -1;
+        for(auto t : events)
+        {
+            long occ = chart[t];
+            if(occ == last) continue;
+            strm << sep << strprintf(R"(  {"name": %s, "ph": "C", "ts": %ld, "pid": %d, "args": {"bytes": %ld}})",
+                                     JsonQuote(name).c_str(), (long) t, MemPid, occ);
+            last = occ;
+        }
+    };
+    for(auto &mem : Platform_.GetMemories()) counter(mem.Name, MemOccs_[mem.Index]);
+    for(auto &grp : Platform_.GetGroups()) counter(strprintf("group %d", grp.Index), GroupOccs_[grp.Index]);
+    strm << "\n], \"displayTimeUnit\": \"ns\"}\n";
+}
+
+Time Schedule::GetMakespan() const
+{
+    Time ret = 0;
+    for(auto &n : upGraph_->Nodes()) ret = std::max(ret, n.Start+n.Duration);
+    return ret;
+}
+
 }} //namespace Ladybirds::opt
 
 
@@ -3,7 +3,10 @@
 #ifndef SCHEDULE_H
 #define SCHEDULE_H
 
+#include <functional>
+#include <iosfwd>
 #include <memory>
+#include <random>
 #include <set>
 #include <vector>
 #include <unordered_map>
@@ -41,40 +44,163 @@ public:
         Time Start, End, Slack;
     };
     
+    /// Priority by which list scheduling picks the next task among those that are ready
+    enum class Priority
+    {
+        MemDiff,    ///< ALAP time, combined with the memory freed by the task (as scaled by the weight)
+        Alap,       ///< ALAP time only
+        UpwardRank, ///< Length of the longest path from the task to the end of the program (HEFT)
+        CriticalPath, ///< Upward rank plus the length of the longest path from the start of the program to the task
+    };
+    
+    /// How list scheduling chooses the processors of a task
+    enum class Placement
+    {
+        Fixed,          ///< Use the core the task's group has been bound to
+        /// Use the core on which the task finishes first (HEFT), among the cores of the type of its group's core and
+        /// of the types on which the task has a cost of its own (spec::Task::TypeCosts)
+        EarliestFinish,
+    };
+    
+    /// Parameters of a single list scheduling run
+    struct Strategy
+    {
+        int Weight = 0; ///< Weight of the memory difference for Priority::MemDiff (as a binary logarithm)
+        Priority Prio = Priority::MemDiff;
+        Placement Place = Placement::Fixed; ///< Only effective without an interface mapping
+        unsigned Seed = 0; ///< Seed for breaking ties between equal priorities (0: no random tie-breaking)
+    };
+    
+    /// Parameters of CalcExactSchedule
+    struct ExactOptions
+    {
+        double TimeLimit = 60; ///< Seconds the solver may take
+        /// Whether tasks may move to other cores that share a memory with theirs (only without an interface mapping)
+        bool MoveTasks = false;
+        bool Verbose = false; ///< Whether to print the log of the solver
+    };
+    
+    /// Outcome of CalcExactSchedule
+    struct ExactResult
+    {
+        bool Improved = false; ///< Whether the schedule has been replaced by the one of the solver
+        Time Heuristic = 0;    ///< Makespan of the list schedule the solver started from
+        Time Bound = 0;        ///< Proven lower bound of the makespan
+        double Gap = 0;        ///< Relative gap between the makespan of the final schedule and the bound
+    };
+    
 private:
     impl::Program &Program_;
     spec::Platform &Platform_;
     
     int DmaIndexBase_;
     std::vector<gen::SingleOccupationChart<Tasknode>> CoreOccs_;
-    std::vector<gen::OccupationChart<long>> MemOccs_;
-    std::vector<gen::OccupationChart<long>> GroupOccs_;
+    std::vector<gen::OccupationChart<long, gen::SegmentTreeChart>> MemOccs_;
+    std::vector<gen::OccupationChart<long, gen::SegmentTreeChart>> GroupOccs_;
+    /// Number of tasks and transfers accessing each memory at any time, for memories with limited ports (cf.
+    /// Platform::Memory::Ports; only used with an interface mapping)
+    std::vector<gen::OccupationChart<long, gen::SegmentTreeChart>> MemLoads_;
+    bool Contention_ = false; ///< Whether any memory has limited ports
     
     std::vector<std::map<Time, Tasknode*>> RuntimeOccEnds_;
     
     std::unique_ptr<Taskgraph> upGraph_;
     std::vector<TransitionImpl> Transitions;
     
+    std::vector<int> CoreTypes_; ///< For each core, the index of its type in Platform::GetCoreTypes()
+    struct CoreLink
+    {
+        bool SharedMem = false; ///< Whether both cores can access a common memory, so no transfer is needed
+        std::vector<spec::Platform::Routing::PathCost> Routes; ///< DMA routes between memories of the cores
+    };
+    std::vector<std::vector<CoreLink>> CoreLinks_;
+    double AvgDmaFixCost_ = 0, AvgDmaByteCost_ = 0;
+    
+    int OverflowMem_ = -1; ///< Memory that has been too full for a task in the last list scheduling run
+    
+    const graph::ItemMap<const spec::Platform::Core*> *pTaskCores_ = nullptr; ///< Overrides the group bindings
+    
+    std::minstd_rand Rng_;
+    Strategy LastStrategy_; ///< Arguments of the last call to CalcSchedule, for recalculating the schedule
+    IfaceMapping *pLastIfaces_ = nullptr;
+    SpillMapping *pLastSpills_ = nullptr;
+    bool Quiet_ = false; ///< Whether to suppress error messages (for portfolio runs, in which failures are expected)
+    
 public:
     /// Constructs an empty schedule for program \p prog on platform \p pf.
     /** All necessary lists and charts are created, but still empty. **/
     Schedule(impl::Program &prog, spec::Platform &pf);
     ~Schedule();
     
+    /// Places each task on the core given by \p ptaskcores instead of the binding of its group (nullptr: bindings).
+    /** The map must outlive all subsequent calls to CalcSchedule. **/
+    inline void SetTaskCores(const graph::ItemMap<const spec::Platform::Core*> *ptaskcores)
+        { pTaskCores_ = ptaskcores; }
+    inline void SetQuiet(bool quiet) { Quiet_ = quiet; }
+    
     bool CalcSchedule(int weight, IfaceMapping *pdm, SpillMapping *psm);
+    bool CalcSchedule(const Strategy &strategy, IfaceMapping *pdm, SpillMapping *psm);
+    /// Calculates a schedule that fits into the memories, spilling data to other memories where necessary.
+    /** Whenever a memory overflows, the dependency with the largest product of size and idle time that lives in it is
+     *  moved to the largest memory reachable by DMA from both ends (i.e., the next memory level), and the schedule is
+     *  recalculated. The spills are added to \p sm. Fails if the memories overflow without any data left to spill. **/
+    bool CalcScheduleWithSpills(const Strategy &strategy, IfaceMapping &dm, /*inout*/ SpillMapping &sm);
+    /// Improves the schedule by solving the scheduling problem exactly, as a mixed integer linear program.
+    /** Must follow a successful CalcSchedule (or CalcScheduleWithSpills, or come from CalcBestSchedule), whose
+     *  schedule serves as the starting solution and bounds the makespan. The program decides the order of the tasks
+     *  and transfers on each processor and, with ExactOptions::MoveTasks, the cores of the tasks. It leaves out the
+     *  capacity of the memories and the contention for their ports, so the schedule is then recalculated by list
+     *  scheduling with the tasks in the order of the solution, which enforces both; the bound of the solver remains
+     *  valid for it. The schedule is only replaced if this shortens it. Needs an MILP solver (cf. HaveMilpSolver) and
+     *  fails without one. **/
+    bool CalcExactSchedule(const ExactOptions &options, ExactResult &result);
     graph::ItemMap<TaskTimings> GetTaskTimings() const;
+    /// Returns the maximum amount of memory allocated in each memory module (only used with an interface mapping)
+    std::vector<long> GetPeakOccupancy() const;
+    /// Returns the maximum amount of memory allocated in each platform group (only used without an interface mapping)
+    std::vector<long> GetGroupPeakOccupancy() const;
+    /// Returns the core on which each task has been scheduled (which differs from the binding of its group if the
+    /// schedule has been calculated with Placement::EarliestFinish)
+    graph::ItemMap<const spec::Platform::Core*> GetTaskCores() const;
+    Time GetMakespan() const;
+    /// Returns the bytes allocated for the charts, the task graph and the transitions of the schedule (cf. MemStats)
+    std::size_t GetHeapBytes() const;
+    /// Writes the schedule in the Chrome trace event format (as read by chrome://tracing or Perfetto).
+    /** There is one track per core and DMA controller, and a counter for the occupation of each memory module (or of
+     *  each platform group, without an interface mapping). Times are given in the cost units of the platform. **/
+    void WriteTrace(std::ostream &strm) const;
+    
+    /// Calculates a schedule for each of the given \p strategies and returns the one with the shortest makespan.
+    /** The schedules are calculated in parallel on \p nthreads threads (0: one per hardware thread). Returns nullptr
+     *  if no strategy yields a valid schedule. Apart from the const accesses to \p prog, \p pf, \p pdm and \p psm,
+     *  the runs share no data. Among strategies with equal makespan, the first one is chosen. **/
+    static std::unique_ptr<Schedule> CalcBestSchedule(impl::Program &prog, spec::Platform &pf,
+                                                      const std::vector<Strategy> &strategies,
+                                                      IfaceMapping *pdm, SpillMapping *psm, unsigned nthreads = 0);
+    /// Returns a portfolio of strategies for CalcBestSchedule
+    /** For each of the \p nseeds seeds, the portfolio contains one strategy per priority and, for Priority::MemDiff,
+     *  one per weight from 0 to \p maxweight. The rank-based priorities are also combined with
+     *  Placement::EarliestFinish. **/
+    static std::vector<Strategy> MakePortfolio(int maxweight, int nseeds);
     
 private:
-    void BuildGraph(IfaceMapping *pdm, SpillMapping *psm);
+    bool BuildGraph(IfaceMapping *pdm, SpillMapping *psm);
     graph::ItemMap<Schedule::Tasknode*> InsertTaskNodes();
     bool CalcTaskDurations(IfaceMapping *pdm);
     void CalcDataDist();
     bool CalcTransitions(const graph::ItemMap<Tasknode*> &nodemap, IfaceMapping *pdm, SpillMapping *psm);
     void InsertTransitionEdges(const graph::ItemMap<Tasknode*> &nodemap);
     void CalcDependencies();
-    bool ReverseListScheduling(long (*priority)(Tasknode&));
+    void CalcCoreConnections();
+    Time CommCost(int fromcore, int tocore, long size) const;
+    Time ContendedDuration(const Tasknode &tn, Time start) const;
+    Time AvgCommCost(long size) const;
+    Time PlaceEarliestFinish(Tasknode &tn, Time ready);
+    const spec::Dependency *ChooseSpill(int mem, const IfaceMapping &dm, const SpillMapping &sm,
+                                        spec::Platform::Memory *&rpspillmem) const;
+    bool ReverseListScheduling(const std::function<long(Tasknode&)> &priority);
     bool CalcAlap();
-    bool ListScheduling(int weight, IfaceMapping *pdm, SpillMapping *psm, bool prerun);
+    bool ListScheduling(const Strategy &strategy, IfaceMapping *pdm, SpillMapping *psm, bool prerun);
 };
 
 
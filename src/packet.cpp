@@ -3,6 +3,7 @@
 #include "packet.h"
 
 #include <memory>
+#include <tuple>
 
 #include "tools.h"
 
@@ -48,11 +49,25 @@ bool Packet::LoadStoreMembers(loadstore::LoadStore& ls)
         & ls.IO("basetype", btname)
         & ls.IO("arraydims", ArrayDims_, false, /*min=*/1)
         & ls.IO("basetypesize", btsize, false, /*min=*/0)
-        & ls.IO("paramstring", paramstring, false))) return false;
+        & ls.IO("paramstring", paramstring, false)
+        & ls.IO("splitdim", SplitDim_, false, -1)
+        & ls.IO("halo", Halo_, false, 0))) return false;
     
     if(ls.IsLoading())
     {
-        BaseType_ = BaseType::FromString(btname);
+        // A program being loaded provides its types as context (cf. Program::LoadStoreMembers)
+        if(auto *ptypes = static_cast<BaseTypeMap*>(ls.UserContext))
+        {
+            auto it = ptypes->find(btname);
+            if(it == ptypes->end())
+            {
+                int size = btsize > 0 ? btsize : BaseType::FromString(btname)->Size;
+                it = ptypes->emplace(std::piecewise_construct, std::forward_as_tuple(btname),
+                                     std::forward_as_tuple(btname, size)).first;
+            }
+            BaseType_ = &it->second;
+        }
+        else BaseType_ = BaseType::FromString(btname);
         ComputeSizeof();
         if(btsize != 0 && btsize != BaseType_->Size) ls.Error("basetypesize is not consistent with internal database");
     }
@@ -4,6 +4,7 @@
 #define PACKET_H
 
 #include <array>
+#include <cassert>
 #include <string>
 #include <unordered_set>
 
@@ -36,6 +37,8 @@ private:
     Kernel * Kernel_ = nullptr;
     int NumBytes_ = -1;
     BuddyList Buddies_;
+    int SplitDim_ = -1;
+    int Halo_ = 0;
 
 public:
     //! Name of the packet
@@ -52,6 +55,10 @@ public:
     inline const Kernel * GetKernel() const {return Kernel_;}
     //! The buddies of the packet
     inline const BuddyList & GetBuddies() const { return Buddies_; }
+    //! The dimension along which the packet is partitioned when the kernel is split (cf. pass SplitTasks), or -1
+    inline int GetSplitDim() const { return SplitDim_; }
+    //! The number of elements on each side of a part an input needs beyond it along the split dimension (stencils)
+    inline int GetHalo() const { return Halo_; }
 
     //! Set if it is input, output or both
     inline void SetAccessType(AccessType access) { Access_ = access; }
@@ -60,6 +67,10 @@ public:
     bool AddBuddy(Packet * newbuddy);
     //! Sets the kernel for the packet
     inline void SetKernel(Kernel * pk) { Kernel_ = pk; }
+    //! Sets split dimension and halo (cf. GetSplitDim and GetHalo)
+    inline void SetSplit(int dim, int halo = 0) { SplitDim_ = dim; Halo_ = halo; }
+    //! Replaces the base type by an equivalent one (e.g. the entry of another program's type map)
+    inline void SetBaseType(const BaseType * type) { assert(type->Size == BaseType_->Size); BaseType_ = type; }
         
     
     Packet() = default;
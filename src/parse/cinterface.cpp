@@ -2,8 +2,12 @@
 
 #include "cinterface.h"
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <clang/Config/config.h>
 #include <clang/Driver/Driver.h>
 #include <clang/Tooling/Tooling.h>
@@ -13,6 +17,7 @@
 #include "graph/itemset.h"
 #include "cmdlineoptions.h"
 #include "clanghandlerfactory.h"
+#include "prefixheader.h"
 #include "dependency.h"
 #include "metakernel.h"
 #include "msgui.h"
@@ -29,13 +34,18 @@
 
 using std::string;
 using std::vector;
+using Ladybirds::graph::Arena;
 using Ladybirds::graph::ItemMap;
 using Ladybirds::graph::ItemSet;
+using Ladybirds::parse::ClangHandlerFactory;
+using Ladybirds::parse::CSpecOptions;
+using Ladybirds::parse::PrefixHeader;
 using Ladybirds::spec::Dependency;
 using Ladybirds::spec::Task;
 using Ladybirds::spec::Iface;
 using Ladybirds::spec::Kernel;
 using Ladybirds::spec::MetaKernel;
+using Ladybirds::spec::Packet;
 using Ladybirds::spec::TaskGraph;
 using Ladybirds::impl::Program;
 
@@ -71,12 +81,241 @@ static std::string GetClangResourceDir()
 #endif //CFG_HAVE_DLFCN
 }
 
+/// \internal Parses the .lb file given by \p opts with Clang arguments \p args into \p prog, in the active arena
+static bool ParseFile(CSpecOptions & opts, const vector<string> & args, Program & prog)
+{
+    clang::tooling::FixedCompilationDatabase compilation(".", args);
+    vector<string> sources = { opts.SpecificationFile };
+
+    clang::tooling::ClangTool tool(compilation, sources);
+    for(auto & file : opts.VirtualFiles) tool.mapVirtualFile(file.first, file.second);
+    PrefixHeader prefix(opts, args, Ladybirds::tools::gCmdLineOptions.PchDir);
+    prefix.Apply(tool);
+
+    // Start extraction of information
+    ClangHandlerFactory fact(opts, prog);
+    auto upaction = clang::tooling::newFrontendActionFactory(&fact);
+    return tool.run(upaction.get()) == 0;
+}
+
+/// \internal Returns true if the kernel declared as \p decl can be replaced by the definition \p def in tasks
+static bool HaveSameInterface(const Kernel & decl, const Kernel & def)
+{
+    auto samepackets = [](const vector<Packet> & a, const vector<Packet> & b)
+    {
+        if(a.size() != b.size()) return false;
+        for(size_t i = 0; i < a.size(); ++i)
+        {
+            if(a[i].GetAccessType() != b[i].GetAccessType() || a[i].GetArrayDims() != b[i].GetArrayDims()
+                || a[i].GetBaseType().Name != b[i].GetBaseType().Name) return false;
+        }
+        return true;
+    };
+    // the formulae of the derived parameters may name the parameters differently
+    return samepackets(decl.Packets, def.Packets) && samepackets(decl.Params, def.Params)
+        && decl.DerivedParams.size() == def.DerivedParams.size();
+}
+
+/// \internal Merges the programs \p parts parsed from the files given by \p partopts into \p prog, parsed from the
+/// file given by \p opts, and takes over their \p arenas. Each kernel only declared in one of the files (cf.
+/// CSpecOptions::DeclaredKernels) is replaced by its definition from another one. Returns false (with errors) if a
+/// declared kernel is not defined or differs from its definition, or if a kernel is defined or invoked more than once.
+static bool MergeFiles(CSpecOptions & opts, vector<CSpecOptions> & partopts,
+                       vector<std::unique_ptr<Program>> & parts, vector<std::unique_ptr<Arena>> & arenas,
+                       Program & prog)
+{
+    bool ok = true;
+    // the types of the packets of the other files are replaced by those of prog
+    for(size_t i = 0; i < parts.size(); ++i)
+    {
+        for(auto & type : parts[i]->Types)
+        {
+            auto ittype = prog.Types.find(type.first);
+            if(ittype == prog.Types.end())
+                ittype = prog.Types.emplace(std::piecewise_construct, std::forward_as_tuple(type.first),
+                                            std::forward_as_tuple(type.first, type.second.Size)).first;
+            else if(ittype->second.Size != type.second.Size)
+            {
+                gMsgUI.Error("Type '%s' has a size of %d bytes in %s, but of %d bytes in %s", type.first.c_str(),
+                             ittype->second.Size, opts.SpecificationFile.c_str(), type.second.Size,
+                             partopts[i].SpecificationFile.c_str());
+                ok = false;
+            }
+        }
+    }
+    if(!ok) return false;
+    auto retype = [&prog](Kernel & kernel)
+    {
+        for(auto & packet : kernel.Packets) packet.SetBaseType(&prog.Types.at(packet.GetBaseType().Name));
+        for(auto & param : kernel.Params) param.SetBaseType(&prog.Types.at(param.GetBaseType().Name));
+    };
+    for(auto & uppart : parts)
+    {
+        for(auto & upkernel : uppart->NativeKernels) retype(*upkernel);
+        for(auto & upmk : uppart->MetaKernels) retype(*upmk);
+    }
+
+    // collect the definitions and the declarations of all files, and the single invoke
+    std::unordered_map<string, std::pair<Kernel*, const string*>> definitions; // with the file defining them
+    std::unordered_map<Kernel*, const string*> declarations;                  // dito for declaring them
+    const string * invokefile = nullptr;
+    auto collect = [&](Program & part, const CSpecOptions & fileopts)
+    {
+        std::unordered_set<string> declared(fileopts.DeclaredKernels.begin(), fileopts.DeclaredKernels.end());
+        auto define = [&](Kernel * pkernel)
+        {
+            auto res = definitions.emplace(pkernel->Name, std::make_pair(pkernel, &fileopts.SpecificationFile));
+            if(res.second) return;
+            gMsgUI.Error("Kernel '%s' is defined in %s and again in %s", pkernel->Name.c_str(),
+                         res.first->second.second->c_str(), fileopts.SpecificationFile.c_str());
+            ok = false;
+        };
+        for(auto & upkernel : part.NativeKernels)
+        {
+            if(declared.count(upkernel->Name)) declarations.emplace(upkernel.get(), &fileopts.SpecificationFile);
+            else define(upkernel.get());
+        }
+        for(auto & upmk : part.MetaKernels) define(upmk.get());
+
+        if(!part.MainTask.GetKernel()) return;
+        if(invokefile)
+        {
+            gMsgUI.Error("The program is invoked in %s and again in %s; only one invoke is supported",
+                         invokefile->c_str(), fileopts.SpecificationFile.c_str());
+            ok = false;
+        }
+        invokefile = &fileopts.SpecificationFile;
+        if(&part != &prog) prog.MainTask = std::move(part.MainTask);
+    };
+    collect(prog, opts);
+    for(size_t i = 0; i < parts.size(); ++i) collect(*parts[i], partopts[i]);
+
+    std::unordered_map<Kernel*, Kernel*> replacements;
+    for(auto & decl : declarations)
+    {
+        auto & name = decl.first->Name;
+        auto itdef = definitions.find(name);
+        if(itdef == definitions.end())
+        {
+            gMsgUI.Error("Kernel '%s' is declared in %s, but none of the files of the program defines it",
+                         name.c_str(), decl.second->c_str());
+            ok = false;
+        }
+        else if(!HaveSameInterface(*decl.first, *itdef->second.first))
+        {
+            gMsgUI.Error("Kernel '%s' is declared in %s with another interface than its definition in %s",
+                         name.c_str(), decl.second->c_str(), itdef->second.second->c_str());
+            ok = false;
+        }
+        else replacements[decl.first] = itdef->second.first;
+    }
+    if(!ok) return false;
+
+    // let the tasks use the definitions, then move these into prog and drop the declarations
+    auto rebind = [&replacements](Task & task)
+    {
+        auto it = replacements.find(task.GetKernel());
+        if(it != replacements.end()) task.RebindKernel(it->second);
+    };
+    rebind(prog.MainTask);
+    auto rebindall = [&rebind](Program & part)
+    {
+        for(auto & upmk : part.MetaKernels)
+        {
+            for(auto & uptask : upmk->Tasks) rebind(*uptask);
+        }
+    };
+    rebindall(prog);
+    for(auto & uppart : parts) rebindall(*uppart);
+
+    Program::NativeKernelList natives;
+    std::swap(natives, prog.NativeKernels);
+    auto takenatives = [&](Program::NativeKernelList & list)
+    {
+        for(auto & upkernel : list)
+        {
+            if(!replacements.count(upkernel.get())) prog.NativeKernels.push_back(std::move(upkernel));
+        }
+    };
+    takenatives(natives);
+    for(auto & uppart : parts)
+    {
+        takenatives(uppart->NativeKernels);
+        for(auto & upmk : uppart->MetaKernels) prog.MetaKernels.push_back(std::move(upmk));
+    }
+    prog.Kernels.clear();
+    for(auto & upkernel : prog.NativeKernels) prog.Kernels[upkernel->Name] = upkernel.get();
+    for(auto & upmk : prog.MetaKernels) prog.Kernels[upmk->Name] = upmk.get();
+
+    for(auto & uparena : arenas) prog.Memory.Adopt(std::move(uparena));
+    return true;
+}
+
+/// \internal Parses the .lb files given by \p opts with Clang arguments \p args into \p prog, by a pool of threads.
+/// The first file is parsed into \p prog directly, each other one into a program with an arena of its own (as arenas
+/// are not thread-safe), which are merged into \p prog afterwards unless CSpecOptions::OnlyParse is set.
+static bool ParseFiles(CSpecOptions & opts, const vector<string> & args, Program & prog)
+{
+    size_t nfiles = 1 + opts.ExtraSpecifications.size();
+    vector<CSpecOptions> partopts;
+    partopts.reserve(nfiles - 1);
+    for(size_t i = 1; i < nfiles; ++i)
+    {
+        partopts.push_back(opts);
+        auto & popts = partopts.back();
+        popts.SpecificationFile = opts.ExtraSpecifications[i-1];
+        popts.TranslationOutput = i <= opts.ExtraTranslationOutputs.size() ? opts.ExtraTranslationOutputs[i-1] : "";
+        popts.ExtraSpecifications.clear();
+        popts.ExtraTranslationOutputs.clear();
+    }
+    vector<std::unique_ptr<Arena>> arenas(nfiles - 1); // declared before the programs, such that they outlive them
+    vector<std::unique_ptr<Program>> parts(nfiles - 1);
+    vector<char> success(nfiles, 0);
+
+    std::atomic<size_t> next(0);
+    auto work = [&]
+    {
+        for(size_t i; (i = next++) < nfiles; )
+        {
+            if(i == 0)
+            {
+                Arena::Scope scope(prog.Memory);
+                success[0] = ParseFile(opts, args, prog);
+                continue;
+            }
+            arenas[i-1] = std::make_unique<Arena>();
+            Arena::Scope scope(*arenas[i-1]);
+            parts[i-1] = std::make_unique<Program>();
+            success[i] = ParseFile(partopts[i-1], args, *parts[i-1]);
+        }
+    };
+    size_t nthreads = std::min<size_t>(nfiles, std::max(1u, std::thread::hardware_concurrency()));
+    vector<std::thread> threads;
+    for(size_t i = 1; i < nthreads; ++i) threads.emplace_back(work);
+    work();
+    for(auto & thread : threads) thread.join();
+    if(std::find(success.begin(), success.end(), 0) != success.end()) return false;
+
+    opts.ExtraTranslations.clear();
+    for(auto & popts : partopts)
+    {
+        opts.ExtraTranslations.push_back(std::move(popts.Translation));
+        opts.InputFiles.insert(opts.InputFiles.end(), popts.InputFiles.begin(), popts.InputFiles.end());
+    }
+    std::sort(opts.InputFiles.begin(), opts.InputFiles.end());
+    opts.InputFiles.erase(std::unique(opts.InputFiles.begin(), opts.InputFiles.end()), opts.InputFiles.end());
+
+    return opts.OnlyParse || MergeFiles(opts, partopts, parts, arenas, prog);
+}
+
 namespace Ladybirds { namespace parse {
 
 /// Loads a Ladybirds C specification from the .lb file given in \p prog.Source into \p prog.
 /// Fills kernels, meta-kernels, task graph, dependencies, reachability matrix, types, main task
 bool LoadCSpec(CSpecOptions & opts, impl::Program &prog)
 {
+    graph::Arena::Scope scope(prog.Memory); //tasks created while parsing and flattening live in the program's arena
+    
     // "Command line arguments" for our compiler frontend
     vector<string> args;
     auto &clangparams = Ladybirds::tools::gCmdLineOptions.ClangParams;
@@ -92,15 +331,7 @@ bool LoadCSpec(CSpecOptions & opts, impl::Program &prog)
     // Now insert the other arguments. We do that after the resource dir so it can be overridden by the command line
     args.insert(args.end(), clangparams.begin(), clangparams.end());
 
-    clang::tooling::FixedCompilationDatabase compilation(".", args);
-    vector<string> sources = { opts.SpecificationFile };
-
-    clang::tooling::ClangTool tool(compilation, sources);
-
-    // Start extraction of information
-    Ladybirds::parse::ClangHandlerFactory fact(opts, prog);
-    auto upaction = clang::tooling::newFrontendActionFactory(&fact);
-    if(tool.run(upaction.get()) != 0) return false;
+    if(!ParseFiles(opts, args, prog)) return false;
     
     if(opts.OnlyParse) return true;
     
@@ -111,6 +342,19 @@ bool LoadCSpec(CSpecOptions & opts, impl::Program &prog)
         MetaKernel mk = *static_cast<MetaKernel*>(pkernel);
         mk.Flatten();
 
+        //mark the tasks of the families, which thereby keep track of them in the task graph
+        for(size_t i = 0; i < mk.Families.size(); ++i)
+        {
+            auto & fam = mk.Families[i];
+            for(size_t pos = 0, n = fam.GetTaskCount(); pos < n; ++pos)
+            {
+                auto & task = *mk.Tasks[fam.First + pos];
+                task.Family = i;
+                task.FamilyPos = pos;
+            }
+        }
+        prog.TaskFamilies = std::move(mk.Families);
+        
         //construct task graph and reachability matrix
         BuildTaskGraph(mk, prog.TaskGraph);
         
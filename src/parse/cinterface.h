@@ -3,6 +3,7 @@
 #ifndef CINTERFACE_H
 #define CINTERFACE_H
 
+#include <unordered_map>
 #include <vector>
 #include <string>
 
@@ -23,9 +24,17 @@ struct CSpecOptions
     
     std::string SpecificationFile; ///< Input .lb file
     std::string TranslationOutput; ///< empty means no output
+    std::vector<std::string> ExtraSpecifications; ///< Further .lb files of the program (cf. LoadCSpec)
+    std::vector<std::string> ExtraTranslationOutputs; ///< One for each of ExtraSpecifications, or none for no output
     bool OnlyParse = false; ///< If true, don't load the parsed program into the internal representation
     bool Instrumentation = false; ///< If true, inject instrumentation code for counting packet accesses
     PacketDeclTransformKind PacketDeclTransform = None;
+    std::unordered_map<std::string, std::string> VirtualFiles; ///< Files only given in memory (e.g. generated
+                                                               ///< headers): contents by absolute path
+    std::vector<std::string> InputFiles; ///< Filled by the parser: all files read for the translation unit, sorted
+    std::string Translation; ///< Filled by the parser: the rewritten C code, as written to TranslationOutput
+    std::vector<std::string> ExtraTranslations; ///< Filled by the parser: dito for each of ExtraSpecifications
+    std::vector<std::string> DeclaredKernels; ///< Filled by the parser: kernels only declared, not defined in the file
     
     CSpecOptions() = default;
     CSpecOptions(std::string specfile) ///< Simple constructor for the non-backend translation
@@ -38,6 +47,9 @@ struct CSpecOptions
 
 /// Parses a Ladybirds C specification from a .lb file and rewrites it to C code, producing a .lb.c file.
 /// If \p onlyparse is set, that was it; otherwise also loads the parsed program into the internal representation \p prog.
+/// A program can consist of several .lb files (cf. CSpecOptions::ExtraSpecifications), which are parsed concurrently as
+/// translation units of their own and merged into \p prog. Kernels and meta-kernels used in one file can be defined in
+/// another one, in which case they are declared in the former. Each file is rewritten to its own C file.
 bool LoadCSpec(CSpecOptions &options, impl::Program &prog);
 
 }} //namespace Ladybirds::parse
@@ -9,6 +9,7 @@
 #include <clang/AST/Stmt.h>
 
 #include "parse/cinterface.h"
+#include "kernel.h"
 #include "packet.h"
 #include "program.h"
 #include "tools.h"
@@ -233,6 +234,14 @@ bool ClangHandler::KernelCallParser::GenerateOperationFromCall(const clang::Call
         auto * pexp = exppair.first;
         
         clang::APValue val;
+        if(exppair.second > (int) ki.DimExpressions)
+        {
+            // loop bound for the work estimate (cf. WorkEstimator), which need not be positive or known
+            bool known = pexp->EvaluateWithSubstitution(val, *ClangHandler_.Context_, ki.FunDecl, substargs)
+                         && val.isInt();
+            derivedparams[exppair.second-1] = known ? val.getInt().getSExtValue() : spec::WorkEstimate::Unknown;
+            continue;
+        }
         if(!pexp->EvaluateWithSubstitution(val, *ClangHandler_.Context_, ki.FunDecl, substargs))
         {
             ClangHandler_.RaiseError(pexp, "Cannot evaluate this expression for kernel instantiation");
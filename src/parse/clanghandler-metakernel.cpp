@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include <clang/AST/Attr.h>
@@ -119,6 +120,7 @@ class ClangHandler::MetakernelVisitor
 {
 private:
     clang_ext::EvalState State_;
+    std::unordered_set<const clang::Expr*> GenvarExprs_; //expressions that passed GenvarExprVisitor, checked only once
     bool Error_ = false;
     int LoopRepeatLevel_ = 0; //Keep track of whether we are repeating evaluation of code
     // Idea: Each loop increases this counter before its second iteration and decreases it after its last iteration
@@ -215,6 +217,7 @@ public:
         clang::APValue value;
         if(auto * init = fs->getInit()) Visit(init);
         
+        std::vector<size_t> starts; //first operation of each iteration, to find task families (cf. AddLoop)
         int niterations;
         for(niterations = 0; niterations < 1024; niterations++)
         {
@@ -237,6 +240,7 @@ public:
             if(value.getInt().getBoolValue() == false) break; //loop is finished!
             
             //Execute loop body
+            starts.push_back(Metakernel_.Operations.size());
             if(auto * body = fs->getBody())
             {
                                 Error_ = false;
@@ -253,13 +257,15 @@ public:
         }
         
         if(niterations > 0) --LoopRepeatLevel_;
+        if(!Error_) Metakernel_.AddLoop(starts, Metakernel_.Operations.size());
         State_.EndBlock();
     }
 
     virtual bool EvaluateExpr(const clang::Expr * expr, clang::APValue & val) override
     {
         //cerr << "Now evaluating expression: " << decl2str(expr, ClangHandler_.Context_->getSourceManager()) << endl;
-        bool valid = GenvarExprVisitor(ClangHandler_).Test(expr);
+        bool valid = GenvarExprs_.count(expr) || GenvarExprVisitor(ClangHandler_).Test(expr);
+        if(valid) GenvarExprs_.insert(expr);
         
         //Still try to evaluate, even if there is an error, to avoid uninitialized generator variables
         if(!State_.Evaluate(expr, val))
@@ -0,0 +1,248 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "clanghandler.h"
+
+#include <unordered_map>
+
+#include <clang/AST/Expr.h>
+#include <clang/AST/Stmt.h>
+
+#include "kernel.h"
+#include "packet.h"
+
+using clang::BinaryOperator;
+using clang::Expr;
+using clang::FunctionDecl;
+using clang::Stmt;
+using clang::VarDecl;
+using clang::dyn_cast;
+using clang::dyn_cast_or_null;
+using clang::isa;
+using Ladybirds::spec::Kernel;
+using Ladybirds::spec::WorkEstimate;
+
+namespace Ladybirds{ namespace parse {
+
+/////////////////
+// Estimating the work of kernels
+
+/// Walks the body of a kernel and sums up the operations and packet accesses of its statements per loop.
+/** Counting loops (for loops with a simple increment and condition on the same variable) with bounds that depend
+ *  only on parameters and constants get their bounds as derived parameters, such that the number of iterations is
+ *  known for each call. Other loops are taken to run once, and the branches of an if statement half of the time. **/
+class ClangHandler::WorkEstimator
+{
+    enum { Read = 1, Write = 2 };
+
+    ClangHandler & ClangHandler_;
+    KernelExpressions & KernelExp_;
+    WorkEstimate & Work_;
+    size_t NumPackets_;
+    std::unordered_map<const clang::Decl*, int> Packets_; // index of the packet for each packet argument
+
+public:
+    WorkEstimator(ClangHandler & ch, KernelExpressions & ke, Kernel & kernel)
+        : ClangHandler_(ch), KernelExp_(ke), Work_(kernel.Work), NumPackets_(kernel.Packets.size())
+    {
+        auto params = ke.FunDecl->parameters();
+        for(size_t i = 0; i < NumPackets_; ++i) Packets_[params[kernel.Params.size() + i]] = i;
+    }
+
+    void Run(const Stmt * pbody)
+    {
+        Work_.Loops.clear();
+        AddLoop(WorkEstimate::Loop());
+        Count(pbody, 0, 1);
+    }
+
+private:
+    int AddLoop(WorkEstimate::Loop loop)
+    {
+        loop.Reads.assign(NumPackets_, 0);
+        loop.Writes.assign(NumPackets_, 0);
+        loop.Whole.assign(NumPackets_, 0);
+        Work_.Loops.push_back(std::move(loop));
+        return Work_.Loops.size() - 1;
+    }
+
+    static const VarDecl * AsVar(const Expr * pexpr)
+    {
+        auto * pdre = pexpr ? dyn_cast<clang::DeclRefExpr>(pexpr->IgnoreParenImpCasts()) : nullptr;
+        return pdre ? dyn_cast<VarDecl>(pdre->getDecl()) : nullptr;
+    }
+
+    int PacketIndex(const Expr * pexpr) const
+    {
+        auto it = Packets_.find(AsVar(pexpr));
+        return it == Packets_.end() ? -1 : it->second;
+    }
+
+    /// Tests whether \p pstmt only refers to kernel parameters and constants, like DimExprVisitor, but silently
+    bool IsParamExpr(const Stmt * pstmt) const
+    {
+        if(auto * pdre = dyn_cast<clang::DeclRefExpr>(pstmt))
+        {
+            auto * pvar = dyn_cast<VarDecl>(pdre->getDecl());
+            if(pvar && KernelExp_.Params.count(pvar) == 0 && !pdre->isIntegerConstantExpr(*ClangHandler_.Context_))
+                return false;
+        }
+        for(auto * pchild : pstmt->children()) if(pchild && !IsParamExpr(pchild)) return false;
+        return true;
+    }
+
+    bool MakeBound(const Expr * pexpr, WorkEstimate::Bound & bound)
+    {
+        Expr::EvalResult res;
+        if(pexpr->EvaluateAsInt(res, *ClangHandler_.Context_))
+        {
+            bound.Value = res.Val.getInt().getSExtValue();
+            return true;
+        }
+        if(!IsParamExpr(pexpr)) return false;
+        bound.Derived = KernelExp_.Expressions.emplace(pexpr, KernelExp_.Expressions.size()+1).first->second - 1;
+        return true;
+    }
+
+    /// Recognizes loops like for(int i = A; i < B; i += C), with the same variable in all three parts
+    bool ParseFor(const clang::ForStmt * pfor, WorkEstimate::Loop & loop)
+    {
+        const VarDecl * pvar = nullptr;
+        const Expr * pbegin = nullptr;
+        if(auto * pds = dyn_cast_or_null<clang::DeclStmt>(pfor->getInit()))
+        {
+            if(pds->isSingleDecl() && (pvar = dyn_cast<VarDecl>(pds->getSingleDecl()))) pbegin = pvar->getInit();
+        }
+        else if(auto * pbo = dyn_cast_or_null<BinaryOperator>(pfor->getInit()))
+        {
+            if(pbo->getOpcode() == clang::BO_Assign) pvar = AsVar(pbo->getLHS()), pbegin = pbo->getRHS();
+        }
+        if(!pvar || !pbegin) return false;
+
+        if(auto * puo = dyn_cast_or_null<clang::UnaryOperator>(pfor->getInc()))
+        {
+            if(!puo->isIncrementDecrementOp() || AsVar(puo->getSubExpr()) != pvar) return false;
+            loop.Step = puo->isIncrementOp() ? 1 : -1;
+        }
+        else if(auto * pcao = dyn_cast_or_null<clang::CompoundAssignOperator>(pfor->getInc()))
+        {
+            Expr::EvalResult res;
+            if(AsVar(pcao->getLHS()) != pvar || !pcao->getRHS()->EvaluateAsInt(res, *ClangHandler_.Context_))
+                return false;
+            int step = res.Val.getInt().getSExtValue();
+            if(pcao->getOpcode() == clang::BO_AddAssign) loop.Step = step;
+            else if(pcao->getOpcode() == clang::BO_SubAssign) loop.Step = -step;
+            else return false;
+        }
+        else return false;
+
+        auto * pcond = pfor->getCond() ? dyn_cast<BinaryOperator>(pfor->getCond()->IgnoreParenImpCasts()) : nullptr;
+        if(!pcond || !pcond->isComparisonOp() || loop.Step == 0) return false;
+        auto opc = pcond->getOpcode();
+        const Expr * pend = pcond->getRHS();
+        if(AsVar(pcond->getRHS()) == pvar) opc = BinaryOperator::reverseComparisonOp(opc), pend = pcond->getLHS();
+        else if(AsVar(pcond->getLHS()) != pvar) return false;
+
+        if(opc == clang::BO_EQ) return false;
+        if(opc != clang::BO_NE && (opc == clang::BO_LT || opc == clang::BO_LE) != (loop.Step > 0)) return false;
+        loop.Inclusive = (opc == clang::BO_LE || opc == clang::BO_GE);
+        return MakeBound(pbegin, loop.Begin) && MakeBound(pend, loop.End);
+    }
+
+    void Count(const Stmt * pstmt, int loop, double weight)
+    {
+        if(!pstmt) return;
+
+        if(auto * pexpr = dyn_cast<Expr>(pstmt)) return CountExpr(pexpr, loop, weight, Read);
+        if(auto * pfor = dyn_cast<clang::ForStmt>(pstmt))
+        {
+            Count(pfor->getInit(), loop, weight);
+            WorkEstimate::Loop parsed;
+            if(!ParseFor(pfor, parsed)) parsed = WorkEstimate::Loop();
+            parsed.Parent = loop;
+            int inner = AddLoop(std::move(parsed));
+            Count(pfor->getCond(), inner, weight);
+            Count(pfor->getInc(), inner, weight);
+            Count(pfor->getBody(), inner, weight);
+            return;
+        }
+        if(isa<clang::WhileStmt>(pstmt) || isa<clang::DoStmt>(pstmt))
+        {
+            WorkEstimate::Loop unknown;
+            unknown.Parent = loop;
+            int inner = AddLoop(std::move(unknown));
+            for(auto * pchild : pstmt->children()) Count(pchild, inner, weight);
+            return;
+        }
+        if(auto * pif = dyn_cast<clang::IfStmt>(pstmt))
+        {
+            Count(pif->getCond(), loop, weight);
+            Count(pif->getThen(), loop, weight/2);
+            Count(pif->getElse(), loop, weight/2);
+            return;
+        }
+        for(auto * pchild : pstmt->children()) Count(pchild, loop, weight);
+    }
+
+    void CountExpr(const Expr * pexpr, int loop, double weight, int access)
+    {
+        pexpr = pexpr->IgnoreParens();
+        auto & ops = Work_.Loops[loop].Ops;
+
+        if(auto * pbo = dyn_cast<BinaryOperator>(pexpr))
+        {
+            if(pbo->getOpcode() != clang::BO_Comma && pbo->getOpcode() != clang::BO_Assign) ops += weight;
+            if(pbo->isAssignmentOp())
+            {
+                CountExpr(pbo->getLHS(), loop, weight, pbo->isCompoundAssignmentOp() ? Read|Write : Write);
+                CountExpr(pbo->getRHS(), loop, weight, Read);
+                return;
+            }
+        }
+        else if(auto * puo = dyn_cast<clang::UnaryOperator>(pexpr))
+        {
+            if(puo->isIncrementDecrementOp() || puo->isArithmeticOp()) ops += weight;
+            if(puo->isIncrementDecrementOp()) return CountExpr(puo->getSubExpr(), loop, weight, Read|Write);
+            if(puo->getOpcode() == clang::UO_AddrOf) return CountExpr(puo->getSubExpr(), loop, weight, 0);
+        }
+        else if(isa<clang::ConditionalOperator>(pexpr)) ops += weight;
+        else if(auto * pase = dyn_cast<clang::ArraySubscriptExpr>(pexpr))
+        {
+            // one element access for the outermost subscript (i.e. a[i][j], but not a[i] in it)
+            const Expr * pbase = pase;
+            while(auto * psub = dyn_cast<clang::ArraySubscriptExpr>(pbase->IgnoreParenImpCasts()))
+            {
+                CountExpr(psub->getIdx(), loop, weight, Read);
+                pbase = psub->getBase();
+            }
+            int packet = PacketIndex(pbase);
+            if(packet < 0) return CountExpr(pbase, loop, weight, Read);
+            if(access & Read) Work_.Loops[loop].Reads[packet] += weight;
+            if(access & Write) Work_.Loops[loop].Writes[packet] += weight;
+            return;
+        }
+        else if(auto * pce = dyn_cast<clang::CallExpr>(pexpr))
+        {
+            ops += weight;
+            for(auto * parg : pce->arguments())
+            {
+                int packet = PacketIndex(parg);
+                if(packet >= 0) Work_.Loops[loop].Whole[packet] += weight;
+                else CountExpr(parg, loop, weight, Read);
+            }
+            return;
+        }
+
+        for(auto * pchild : pexpr->children())
+        {
+            if(auto * pchildexpr = dyn_cast_or_null<Expr>(pchild)) CountExpr(pchildexpr, loop, weight, Read);
+            else Count(pchild, loop, weight);
+        }
+    }
+};
+
+void ClangHandler::EstimateWork(const FunctionDecl * functionDecl, Kernel * pkernel, KernelExpressions * pke)
+{
+    WorkEstimator(*this, *pke, *pkernel).Run(functionDecl->getBody());
+}
+
+}} //namespace Ladybirds::parse
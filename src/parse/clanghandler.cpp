@@ -8,8 +8,12 @@
 #include <clang/AST/RecursiveASTVisitor.h>
 #include <clang/Frontend/CompilerInstance.h>
 #include <clang/Lex/Lexer.h>
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
@@ -77,6 +81,7 @@ void ClangHandler::HandleTranslationUnit(ASTContext& context)
     
     Context_ = &context;
     Rewriter_.setSourceMgr(context.getSourceManager(), context.getLangOpts());
+    RecordInputFiles();
     
     Parse();
     if(!Context_->getDiagnostics().hasErrorOccurred()) WriteTransformedCode();
@@ -109,6 +114,30 @@ void ClangHandler::Parse()
     matchFinder.matchAST(*Context_);
 }
 
+void ClangHandler::RecordInputFiles()
+{
+    auto & sourceman = Context_->getSourceManager();
+    auto & files = Options_.InputFiles;
+    files.clear();
+    auto record = [&](const clang::SrcMgr::SLocEntry & entry)
+    {
+        if(!entry.isFile()) return;
+        // memory buffers like the predefines have no file name; the prefix header (cf. PrefixHeader) is only virtual
+        auto name = sourceman.getFilename(clang::SourceLocation::getFromRawEncoding(entry.getOffset())).str();
+        if(name.empty()) return;
+        llvm::SmallString<128> abspath(name); // virtual files are known by absolute paths
+        llvm::sys::fs::make_absolute(abspath);
+        llvm::sys::path::remove_dots(abspath, true);
+        if(Options_.VirtualFiles.count(abspath.str().str())) files.push_back(abspath.str().str());
+        else if(llvm::sys::fs::exists(name)) files.push_back(std::move(name));
+    };
+    for(unsigned i = 0, n = sourceman.local_sloc_entry_size(); i < n; ++i) record(sourceman.getLocalSLocEntry(i));
+    // the files read through a precompiled header
+    for(unsigned i = 0, n = sourceman.loaded_sloc_entry_size(); i < n; ++i) record(sourceman.getLoadedSLocEntry(i));
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+}
+
 void ClangHandler::WriteTransformedCode() const
 {
     if(Options_.TranslationOutput.empty()) return; //no output required
@@ -116,18 +145,28 @@ void ClangHandler::WriteTransformedCode() const
     auto & sourceman = Rewriter_.getSourceMgr();
     auto fid = sourceman.getMainFileID();
 
+    // kept in memory as well, such that the parse cache does not have to read it back
+    auto & code = Options_.Translation;
+    code.clear();
+    llvm::raw_string_ostream codeStream(code);
+    if(Options_.Instrumentation) codeStream << "#define __LADYBIDRS_INSTRUMENTATION_AT_WORK__\n";
+    Rewriter_.WriteWithAnnotations(fid, codeStream);
+    codeStream.flush();
+
     std::error_code err;
     llvm::raw_fd_ostream fileStream(Options_.TranslationOutput, err);
+    if(!err)
+    {
+        fileStream << code;
+        fileStream.close();
+        err = fileStream.error();
+    }
     if(err)
     {
         auto & diag = Context_->getDiagnostics();
         auto msgid = diag.getCustomDiagID(clang::DiagnosticsEngine::Fatal, "Unable to write to '%0': %1");
         diag.Report(msgid) << Options_.TranslationOutput << err.message();
-        return;
     }
-    
-    if(Options_.Instrumentation) fileStream << "#define __LADYBIDRS_INSTRUMENTATION_AT_WORK__\n";
-    Rewriter_.WriteWithAnnotations(fid, fileStream);
 }
 
 
@@ -265,21 +304,24 @@ void ClangHandler::ProcessKernelFunction(const FunctionDecl *functionDecl)
 {
     assert(functionDecl);
     
-    bool isforwarddecl = false;
+    Kernel * pkernel;
     if(!functionDecl->isThisDeclarationADefinition())
     {
         if(functionDecl->hasBody()) return; //we have already parsed or will later parse the proper definition
-        isforwarddecl = true; //No definition in this translation unit. We will need to create some kind of dummy.
-    }
-    
-    if(isforwarddecl)
-    {
-        RaiseError(functionDecl->getLocation(), "Sorry, multi-file support not implemented yet. "
-            "Please add a definition for this function.") << functionDecl->getSourceRange(); //TODO
+        if(!functionDecl->isFirstDecl()) return; //the first declaration has already made the placeholder
+        
+        // No definition in this translation unit: some other file of the program has to provide it (cf. LoadCSpec).
+        // Until then, calls refer to a plain kernel with the declared interface, which is replaced when merging.
+        auto kernel = std::make_unique<Kernel>();
+        auto name = functionDecl->getName();
+        kernel->Name = name.drop_front(name.startswith("_lb_metakernel_") ? 15 : 11).str();
+        GenerateKernelFromFunctionDecl(functionDecl, kernel.get());
+        
+        Options_.DeclaredKernels.push_back(kernel->Name);
+        Program_.Kernels[kernel->Name] = pkernel = kernel.get();
+        Program_.NativeKernels.push_back(std::move(kernel));
     }
-    
-    Kernel * pkernel;
-    if (functionDecl->getName().startswith("_lb_metakernel_"))
+    else if (functionDecl->getName().startswith("_lb_metakernel_"))
     {
         // Handle metakernel
         auto upmk = std::make_unique<spec::MetaKernel>();
@@ -478,6 +520,26 @@ bool ClangHandler::GenerateKernelFromFunctionDecl(const FunctionDecl *functionDe
                             ret = false;
                         }
                     }
+                    else if(anno.startswith("split="))
+                    {
+                        // "split=<dim>" from splitalong(dim) or "split=<dim>,<extent>" from halo(dim, extent)
+                        auto spec = anno.drop_front(6).split(',');
+                        int dim = -1, halo = 0;
+                        if(spec.first.trim().getAsInteger(10, dim) || dim < 0
+                           || int(packet.GetArrayDims().size()) <= dim
+                           || (!spec.second.empty() && (spec.second.trim().getAsInteger(10, halo) || halo < 0)))
+                        {
+                            RaiseError(attr->getLocation(), "Invalid split specification '%0' (need an array "
+                                       "dimension and a non-negative halo extent)") << attr->getRange() << anno;
+                            ret = false;
+                        }
+                        else if(packet.GetSplitDim() >= 0)
+                        {
+                            RaiseError(attr->getLocation(), "Redefinition of split dimension") << attr->getRange();
+                            ret = false;
+                        }
+                        else packet.SetSplit(dim, halo);
+                    }
                 }
             }
         }
@@ -530,6 +592,9 @@ bool ClangHandler::GenerateKernelFromFunctionDecl(const FunctionDecl *functionDe
         }
     }
     
+    pke->DimExpressions = pke->Expressions.size();
+    if(!pkernel->IsMetaKernel() && functionDecl->hasBody()) EstimateWork(functionDecl, pkernel, pke);
+    
     pkernel->DerivedParams.resize(pke->Expressions.size());
     for(auto pair : pke->Expressions)
     {
@@ -35,9 +35,10 @@ private:
     {
         const clang::FunctionDecl * FunDecl;
         std::set<const clang::Decl*> Params;
-        std::map<const clang::Expr*, int, ExprCmp> Expressions;
+        std::unordered_map<const clang::Expr*, int, ExprHash, ExprHash> Expressions;
+        size_t DimExpressions = 0; // the first expressions are array dimensions, the others loop bounds
         inline KernelExpressions(const clang::FunctionDecl * fundecl, clang::ASTContext *pctx)
-            : FunDecl(fundecl), Expressions(ExprCmp(*pctx)) {}
+            : FunDecl(fundecl), Expressions(0, ExprHash(*pctx), ExprHash(*pctx)) {}
     };
     struct DimExprVisitor;
     
@@ -67,6 +68,8 @@ public:
 private:
     //! Parses the given Ladybirds C specification file. Errors are communicated through the Clang diag interface
     void Parse();
+    //! Stores the names of all files read for the translation unit in CSpecOptions::InputFiles (cf. ParseCache)
+    void RecordInputFiles();
     //! Writes the transformed code to \p filename. Errors are communicated through the Clang diag interface
     void WriteTransformedCode() const;
     
@@ -79,6 +82,7 @@ private:
     void ProcessKernelFunction(const clang::FunctionDecl *functionDecl);
     bool TransformKernelDecl(const clang::FunctionDecl *functionDecl, spec::Kernel *pkernel);
     bool GenerateKernelFromFunctionDecl(const clang::FunctionDecl *functionDecl, spec::Kernel *kernel );
+    void EstimateWork(const clang::FunctionDecl *functionDecl, spec::Kernel *pkernel, KernelExpressions *pke);
 
     void ProcessInvoke(const clang::CallExpr * callExpr);
     void ProcessMetakernelBody(const clang::FunctionDecl& kernelDecl, MetaKernelSeq& kernelSeq);
@@ -94,6 +98,9 @@ private:
 
     //! \internal Internal class for visiting all statements in a metakernel
     class MetakernelVisitor;
+
+    //! \internal Internal class for estimating the work of a kernel from its body
+    class WorkEstimator;
 };
 
 template<unsigned N>
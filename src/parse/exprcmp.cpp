@@ -6,6 +6,7 @@
 
 #include <clang/AST/Expr.h>
 #include <clang/AST/Stmt.h>
+#include <llvm/ADT/Hashing.h>
 
 using clang::cast;
 using clang::Expr;
@@ -20,6 +21,14 @@ static inline int ptrcmp(const void *p1, const void *p2)
     return 0;
 }
 
+/// \internal Returns the hash of a floating-point value, with all NaNs alike and +0 like -0 (as ExprCmp::Compare
+/// treats floating literals)
+static inline llvm::hash_code hashfloat(const llvm::APFloat & val)
+{
+    if(val.isNaN() || val.isZero()) return llvm::hash_value(int(val.getCategory()));
+    return llvm::hash_value(val);
+}
+
 bool ExprCmp::NumericallyIdentical(const clang::Expr *pexpr1, const clang::Expr *pexpr2) const
 {
     assert(pexpr1 && pexpr2);
@@ -164,4 +173,63 @@ int ExprCmp::Compare(const clang::Expr *pexpr1, const clang::Expr *pexpr2) const
     }
 }
 
+/**
+ *  Expressions of different classes compare equal if they evaluate to the same constant (cf. NumericallyIdentical),
+ *  so those are hashed by their value only. As Compare compares children recursively, this also holds for subtrees.
+ **/
+std::size_t ExprHash::operator() (const clang::Expr *pexpr) const
+{
+    assert(pexpr);
+
+    pexpr = pexpr->IgnoreParenImpCasts();
+
+    clang::Expr::EvalResult res;
+    if(pexpr->EvaluateAsRValue(res, Cmp_.GetContext()))
+    {
+        auto & val = res.Val;
+        auto kind = llvm::hash_value(int(val.getKind()));
+        switch(val.getKind())
+        {
+            case clang::APValue::Int:          return llvm::hash_combine(kind, val.getInt());
+            case clang::APValue::ComplexInt:   return llvm::hash_combine(kind, val.getComplexIntReal(),
+                                                                         val.getComplexIntImag());
+            case clang::APValue::Float:        return llvm::hash_combine(kind, hashfloat(val.getFloat()));
+            case clang::APValue::ComplexFloat: return llvm::hash_combine(kind, hashfloat(val.getComplexFloatReal()),
+                                                                         hashfloat(val.getComplexFloatImag()));
+            default: break; // not compared numerically
+        }
+    }
+
+    llvm::hash_code hash = llvm::hash_value(int(pexpr->getStmtClass()));
+    for(auto *pchild : pexpr->children())
+    {
+        auto psubexpr = static_cast<const clang::Expr*>(pchild);
+        hash = llvm::hash_combine(hash, psubexpr ? (*this)(psubexpr) : 0);
+    }
+
+    // the same data as compared by ExprCmp::Compare
+    switch(pexpr->getStmtClass())
+    {
+        default:
+            return hash;
+        case Stmt::BinaryOperatorClass:
+            return llvm::hash_combine(hash, int(cast<clang::BinaryOperator>(pexpr)->getOpcode()));
+        case Stmt::CStyleCastExprClass:
+            return llvm::hash_combine(hash, cast<clang::CStyleCastExpr>(pexpr)->getTypeAsWritten()
+                                                                              .getCanonicalType().getTypePtr());
+        case Stmt::CharacterLiteralClass:
+            return llvm::hash_combine(hash, cast<clang::CharacterLiteral>(pexpr)->getValue());
+        case Stmt::DeclRefExprClass:
+            return llvm::hash_combine(hash, cast<clang::DeclRefExpr>(pexpr)->getDecl());
+        case Stmt::FloatingLiteralClass:
+            return llvm::hash_combine(hash, hashfloat(cast<clang::FloatingLiteral>(pexpr)->getValue()));
+        case Stmt::IntegerLiteralClass:
+            return llvm::hash_combine(hash, cast<clang::IntegerLiteral>(pexpr)->getValue());
+        case Stmt::StringLiteralClass:
+            return llvm::hash_combine(hash, cast<clang::StringLiteral>(pexpr)->getBytes());
+        case Stmt::UnaryOperatorClass:
+            return llvm::hash_combine(hash, int(cast<clang::UnaryOperator>(pexpr)->getOpcode()));
+    }
+}
+
 }} //namespace Ladybirds::parse
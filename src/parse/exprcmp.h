@@ -3,6 +3,8 @@
 #ifndef LADYBIRDS_PARSE_EXPRMAP_H
 #define LADYBIRDS_PARSE_EXPRMAP_H
 
+#include <cstddef>
+
 namespace clang
 {
     class ASTContext;
@@ -22,6 +24,8 @@ private:
     
 public:
     inline ExprCmp(const clang::ASTContext & ctx) : Ctx_(ctx) {}
+
+    inline const clang::ASTContext & GetContext() const { return Ctx_; }
     
     /// Returns true if \p *pexpr1 is considered less than \p *pexpr2. 
     inline bool operator() (const clang::Expr *pexpr1, const clang::Expr *pexpr2) const
@@ -34,6 +38,29 @@ public:
     bool NumericallyIdentical(const clang::Expr *pexpr1, const clang::Expr *pexpr2) const;
 };
 
+/**
+ * \brief Hash and equality of clang Expr objects, such that they can be used as keys of unordered containers.
+ * Two expressions for which ExprCmp::Compare returns 0 have the same hash: expressions that evaluate to a numeric
+ * constant are hashed by their value, all others by their structure (class, children and the data compared by
+ * ExprCmp::Compare). Compared to an ordered container, this avoids comparing the trees of about log(n) keys (and
+ * evaluating their constant parts again) for every lookup.
+ */
+class ExprHash
+{
+private:
+    ExprCmp Cmp_;
+
+public:
+    inline ExprHash(const clang::ASTContext & ctx) : Cmp_(ctx) {}
+
+    /// Returns the hash of \p *pexpr
+    std::size_t operator() (const clang::Expr *pexpr) const;
+
+    /// Returns true if \p *pexpr1 and \p *pexpr2 are considered equal by ExprCmp::Compare
+    inline bool operator() (const clang::Expr *pexpr1, const clang::Expr *pexpr2) const
+        { return (Cmp_.Compare(pexpr1, pexpr2) == 0); }
+};
+
 
 }} //namespace Ladybirds::parse
 
@@ -0,0 +1,234 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "parsecache.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include "binaryloadstore.h"
+#include "cmdlineoptions.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+
+using std::string;
+using std::vector;
+
+namespace Ladybirds { namespace parse {
+
+bool ReadFile(const string & path, string & contents)
+{
+    auto buf = llvm::MemoryBuffer::getFile(path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if(!buf) return false;
+    contents = (*buf)->getBuffer().str();
+    return true;
+}
+
+bool WriteFileAtomic(const string & path, const string & contents)
+{
+    int fd;
+    llvm::SmallString<128> temppath;
+    if(llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, temppath)) return false;
+    {
+        llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+        os << contents;
+        os.close();
+        if(os.has_error())
+        {
+            os.clear_error();
+            llvm::sys::fs::remove(temppath);
+            return false;
+        }
+    }
+    if(llvm::sys::fs::rename(temppath, path))
+    {
+        llvm::sys::fs::remove(temppath);
+        return false;
+    }
+    return true;
+}
+
+string HashString(const string & contents)
+{
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016" PRIx64, llvm::xxHash64(contents));
+    return buf;
+}
+
+string GetCompilerStamp()
+{
+    string exe = llvm::sys::fs::getMainExecutable("ladybirds", (void*) &gResourceDir);
+    llvm::sys::fs::file_status exestat;
+    if(exe.empty() || llvm::sys::fs::status(exe, exestat)) return "";
+    return exe + '\0' + std::to_string(exestat.getSize()) + '\0'
+         + std::to_string(exestat.getLastModificationTime().time_since_epoch().count());
+}
+
+bool ReadSource(const CSpecOptions & opts, const string & path, string & contents)
+{
+    auto it = opts.VirtualFiles.find(path);
+    if(it == opts.VirtualFiles.end()) return ReadFile(path, contents);
+    contents = it->second;
+    return true;
+}
+
+
+namespace {
+constexpr const char * EntryFormat = "lbpc2"; ///< To be changed whenever the contents of an entry change
+
+/// \internal Appends \p s to \p key, terminated such that different sequences of strings give different keys
+void AddToKey(string & key, const string & s)
+{
+    key += s;
+    key += '\0';
+}
+
+/// \internal The contents of a cache entry
+struct Entry : public loadstore::LoadStorableCompound
+{
+    const CSpecOptions & Opts;
+    vector<string> Sources;  ///< The files read by Clang
+    vector<string> Hashes;   ///< Of the contents of Sources, by HashString
+    string Translation;      ///< The rewritten C code
+    vector<string> ExtraTranslations; ///< Dito for the further files of the program (cf. CSpecOptions)
+    impl::Program * Prog = nullptr;
+    bool Stale = false;      ///< Set when loading if a source has changed since the entry was stored
+
+    Entry(const CSpecOptions & opts) : Opts(opts) {}
+
+    virtual bool LoadStoreMembers(loadstore::LoadStore & ls) override
+    {
+        if(!(ls.IO("sources", Sources) & ls.IO("hashes", Hashes))) return false;
+        if(ls.IsLoading())
+        {
+            Stale = Sources.size() != Hashes.size();
+            string contents;
+            for(size_t i = 0; i < Sources.size() && !Stale; ++i)
+            {
+                Stale = !ReadSource(Opts, Sources[i], contents) || HashString(contents) != Hashes[i];
+            }
+            if(Stale) return false; // the program is not even looked at
+        }
+        return ls.IO("translation", Translation) & ls.IO("extratranslations", ExtraTranslations)
+             & ls.IO_Register("program", *Prog);
+    }
+};
+} //namespace ::
+
+
+ParseCache::ParseCache(CSpecOptions & opts, const vector<string> & clangparams, const string & dir)
+  : Opts_(opts)
+{
+    if(dir.empty()) return;
+
+    // The key covers everything but the files read by Clang, which are only known after parsing (cf. Entry)
+    string key;
+    AddToKey(key, EntryFormat);
+    string exe = GetCompilerStamp();
+    if(exe.empty()) return; // could not identify the compiler, don't cache
+    AddToKey(key, exe);
+
+    llvm::SmallString<128> cwd;
+    if(llvm::sys::fs::current_path(cwd)) return;
+    AddToKey(key, cwd.str().str());
+    AddToKey(key, opts.SpecificationFile);
+    AddToKey(key, opts.TranslationOutput);
+    AddToKey(key, std::to_string(opts.ExtraSpecifications.size()));
+    for(auto & spec : opts.ExtraSpecifications) AddToKey(key, spec);
+    for(auto & output : opts.ExtraTranslationOutputs) AddToKey(key, output);
+    AddToKey(key, std::to_string(opts.OnlyParse) + std::to_string(opts.Instrumentation)
+                  + std::to_string(opts.PacketDeclTransform));
+    for(auto & param : clangparams) AddToKey(key, param);
+
+    llvm::sys::fs::create_directories(dir);
+    llvm::SmallString<128> path(dir);
+    llvm::sys::path::append(path, HashString(key) + ".lbpc");
+    Path_ = path.str().str();
+}
+
+ParseCache::Result ParseCache::Load(impl::Program & prog)
+{
+    string data;
+    if(!IsEnabled() || !ReadFile(Path_, data)) return Miss;
+
+    Entry entry(Opts_);
+    entry.Prog = &prog;
+    loadstore::BinaryLoad ld(std::move(data), true);
+    bool ok = ld.GetErrorCount() == 0 && ld.RawIO(entry) && ld.GetErrorCount() == 0;
+    if(entry.Stale) return Miss;
+    if(!ok)
+    {
+        gMsgUI.Warning("Ignoring damaged parse cache entry %s: %s", Path_.c_str(), ld.GetFirstError().c_str());
+        return Failed;
+    }
+
+    if(entry.ExtraTranslations.size() != Opts_.ExtraSpecifications.size())
+    {
+        gMsgUI.Warning("Ignoring damaged parse cache entry %s: wrong number of translations", Path_.c_str());
+        return Failed;
+    }
+    auto write = [](const string & path, const string & code)
+    {
+        if(path.empty() || WriteFileAtomic(path, code)) return true;
+        gMsgUI.Error("Unable to write to '%s'", path.c_str());
+        return false;
+    };
+    if(!write(Opts_.TranslationOutput, entry.Translation)) return Failed;
+    for(size_t i = 0; i < Opts_.ExtraTranslationOutputs.size(); ++i)
+    {
+        if(!write(Opts_.ExtraTranslationOutputs[i], entry.ExtraTranslations[i])) return Failed;
+    }
+    Opts_.Translation = std::move(entry.Translation);
+    Opts_.ExtraTranslations = std::move(entry.ExtraTranslations);
+    gMsgUI.Verbose("Loaded parsed program from %s", Path_.c_str());
+    return Hit;
+}
+
+bool ParseCache::Store(impl::Program & prog)
+{
+    if(!IsEnabled()) return true;
+
+    Entry entry(Opts_);
+    entry.Prog = &prog;
+    entry.Sources = Opts_.InputFiles;
+    string contents;
+    for(auto & src : entry.Sources)
+    {
+        if(!ReadSource(Opts_, src, contents))
+        {
+            gMsgUI.Warning("Not caching the parsed program: cannot read %s", src.c_str());
+            return false;
+        }
+        entry.Hashes.push_back(HashString(contents));
+    }
+    entry.Translation = Opts_.Translation;
+    entry.ExtraTranslations = Opts_.ExtraTranslations;
+
+    loadstore::BinaryStore ls;
+    bool ok = ls.RawIO(entry);
+    string data = ls.GetData();
+    if(!ok || ls.GetErrorCount() != 0 || ls.GetForwardRefCount() != 0)
+    {
+        gMsgUI.Warning("Not caching the parsed program: it cannot be stored");
+        return false;
+    }
+    if(!WriteFileAtomic(Path_, data))
+    {
+        gMsgUI.Warning("Unable to write parse cache entry %s", Path_.c_str());
+        return false;
+    }
+    return true;
+}
+
+}} //namespace Ladybirds::parse
@@ -0,0 +1,66 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_PARSE_PARSECACHE_H
+#define LADYBIRDS_PARSE_PARSECACHE_H
+
+#include <string>
+#include <vector>
+
+#include "cinterface.h"
+
+namespace Ladybirds {
+
+namespace impl {struct Program; }
+
+namespace parse {
+
+//! Persistent cache of parsed programs, such that unchanged specifications are not parsed by Clang again.
+/** The entry for a parse is found by a key over the options, the Clang parameters, the working directory and the
+ *  executable. It records all files Clang read for the parse (cf. CSpecOptions::InputFiles) with a hash of their
+ *  contents, and is only used if none of them has changed. Besides the program (stored by loadstore::BinaryStore),
+ *  the entry contains the rewritten C code, which is written to CSpecOptions::TranslationOutput on a hit (dito for
+ *  the further files of a program, cf. CSpecOptions::ExtraSpecifications).
+ *  Files only given in memory (CSpecOptions::VirtualFiles) are checked by their contents there. **/
+class ParseCache
+{
+public:
+    enum Result
+    {
+        Miss,  ///< No valid entry; the program is untouched
+        Hit,   ///< The program was loaded from the cache
+        Failed ///< The entry was damaged; the program may be partially loaded and should be discarded
+    };
+
+private:
+    CSpecOptions & Opts_;
+    std::string Path_; ///< Of the entry file, empty if the cache is disabled
+
+public:
+    //! Creates the cache for parsing with \p opts and Clang parameters \p clangparams, stored in directory \p dir.
+    //! If \p dir is empty, the cache is disabled, i.e. Load always misses and Store does nothing.
+    ParseCache(CSpecOptions & opts, const std::vector<std::string> & clangparams, const std::string & dir);
+
+    inline bool IsEnabled() const { return !Path_.empty(); }
+
+    //! Loads the program parsed with the options into \p prog (which must be empty), if it is in the cache
+    Result Load(impl::Program & prog);
+    //! Stores \p prog, just parsed with the options, in the cache. Returns false (with a warning) on failure.
+    bool Store(impl::Program & prog);
+};
+
+//! Reads the file at \p path into \p contents. Returns false if it cannot be read.
+bool ReadFile(const std::string & path, std::string & contents);
+//! Like ReadFile, but takes the contents from \p opts.VirtualFiles if \p path is one of them
+bool ReadSource(const CSpecOptions & opts, const std::string & path, std::string & contents);
+//! Writes \p contents to the file at \p path, replacing it in one step (so concurrent runs never see a partial file).
+//! Returns false on failure.
+bool WriteFileAtomic(const std::string & path, const std::string & contents);
+//! Returns a hash of \p contents as a string of hex digits
+std::string HashString(const std::string & contents);
+//! Returns a string that changes with the executable of the compiler (path, size, modification time), or an empty
+//! string if the executable cannot be found
+std::string GetCompilerStamp();
+
+}} //namespace Ladybirds::parse
+
+#endif // LADYBIRDS_PARSE_PARSECACHE_H
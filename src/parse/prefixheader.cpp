@@ -0,0 +1,242 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "prefixheader.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <clang/Basic/Diagnostic.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Frontend/CompilerInstance.h>
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Lex/HeaderSearch.h>
+#include <clang/Lex/Preprocessor.h>
+#include <clang/Tooling/ArgumentsAdjusters.h>
+#include <clang/Tooling/CompilationDatabase.h>
+#include <clang/Tooling/Tooling.h>
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
+#include "binaryloadstore.h"
+#include "cinterface.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "parsecache.h"
+
+using std::string;
+using std::vector;
+
+namespace Ladybirds { namespace parse {
+
+namespace {
+constexpr const char * PchFormat = "lbpch1"; ///< To be changed whenever the way of precompiling changes
+
+/// \internal Returns the leading lines of \p text that are empty, line comments or #include directives, up to the
+/// last #include directive (i.e. empty if there is none)
+string GetIncludePrefix(const string & text)
+{
+    size_t end = 0;
+    for(size_t pos = 0; pos < text.size(); )
+    {
+        size_t eol = text.find('\n', pos);
+        eol = (eol == string::npos) ? text.size() : eol + 1;
+        auto line = llvm::StringRef(text).slice(pos, eol).trim();
+        if(line.endswith("\\")) break; // continued lines are not worth the trouble
+        if(line.startswith("#"))
+        {
+            if(!line.drop_front().ltrim().startswith("include")) break;
+            end = eol;
+        }
+        else if(!line.empty() && !line.startswith("//")) break;
+        pos = eol;
+    }
+    return text.substr(0, end);
+}
+
+/// \internal Returns \p path as absolute path without "." and ".." (as used for CSpecOptions::VirtualFiles)
+string GetAbsolutePath(llvm::StringRef path)
+{
+    llvm::SmallString<128> abspath(path);
+    llvm::sys::fs::make_absolute(abspath);
+    llvm::sys::path::remove_dots(abspath, true);
+    return abspath.str().str();
+}
+
+/// \internal Returns a string that changes whenever the file at \p path changes, or an empty one if there is no file
+string GetStamp(const CSpecOptions & opts, const string & path)
+{
+    auto it = opts.VirtualFiles.find(path);
+    if(it != opts.VirtualFiles.end()) return "=" + HashString(it->second);
+
+    llvm::sys::fs::file_status stat;
+    if(llvm::sys::fs::status(path, stat)) return "";
+    return std::to_string(stat.getSize()) + ":"
+         + std::to_string(stat.getLastModificationTime().time_since_epoch().count());
+}
+
+/// \internal The description of the inputs of a precompiled header
+struct PchInfo : public loadstore::LoadStorableCompound
+{
+    vector<string> Files;  ///< All files read for the precompiled header, except the prefix header itself
+    vector<string> Stamps; ///< Of Files, by GetStamp
+    bool Usable = true;    ///< Whether all Files have include guards, i.e. whether the header can be used at all
+
+    virtual bool LoadStoreMembers(loadstore::LoadStore & ls) override
+    {
+        return ls.IO("files", Files) & ls.IO("stamps", Stamps) & ls.IO("usable", Usable);
+    }
+};
+
+/// \internal Precompiles the prefix header, recording its inputs in a PchInfo
+class BuildAction : public clang::GeneratePCHAction
+{
+private:
+    PchInfo & Info_;
+    const string & HeaderPath_;
+
+public:
+    BuildAction(PchInfo & info, const string & headerpath) : Info_(info), HeaderPath_(headerpath) {}
+
+protected:
+    virtual void EndSourceFileAction() override
+    {
+        auto & ci = getCompilerInstance();
+        auto & headersearch = ci.getPreprocessor().getHeaderSearchInfo();
+        auto & sourceman = ci.getSourceManager();
+        for(auto it = sourceman.fileinfo_begin(), end = sourceman.fileinfo_end(); it != end; ++it)
+        {
+            const clang::FileEntry * file = it->first;
+            string path = GetAbsolutePath(file->getName());
+            if(path == HeaderPath_) continue;
+            Info_.Files.push_back(std::move(path));
+            // the specification includes the file again after the precompiled header
+            if(!headersearch.isFileMultipleIncludeGuarded(file)) Info_.Usable = false;
+        }
+        GeneratePCHAction::EndSourceFileAction();
+    }
+};
+
+/// \internal Creates BuildAction objects for a ClangTool
+class BuildActionFactory : public clang::tooling::FrontendActionFactory
+{
+private:
+    PchInfo & Info_;
+    const string & HeaderPath_;
+
+public:
+    BuildActionFactory(PchInfo & info, const string & headerpath) : Info_(info), HeaderPath_(headerpath) {}
+    virtual std::unique_ptr<clang::FrontendAction> create() override
+    {
+        return std::make_unique<BuildAction>(Info_, HeaderPath_);
+    }
+};
+} //namespace ::
+
+
+PrefixHeader::PrefixHeader(const CSpecOptions & opts, const vector<string> & args, const string & dir)
+  : Opts_(opts), Args_(args)
+{
+    if(dir.empty()) return;
+
+    string specpath = GetAbsolutePath(opts.SpecificationFile), spec;
+    string compiler = GetCompilerStamp();
+    llvm::SmallString<128> cwd;
+    if(compiler.empty() || llvm::sys::fs::current_path(cwd) || !ReadSource(opts, specpath, spec)) return;
+    Header_ = GetIncludePrefix(spec);
+    if(Header_.empty()) return;
+    if(Header_.back() != '\n') Header_ += '\n';
+    HeaderPath_ = specpath + ".prefix.h"; // next to the specification, such that quoted includes find the same files
+
+    // The arguments may contain relative paths
+    string key = string(PchFormat) + '\0' + compiler + '\0' + cwd.str().str() + '\0' + HeaderPath_ + '\0' + Header_;
+    for(auto & arg : args) (key += '\0') += arg;
+
+    llvm::sys::fs::create_directories(dir);
+    llvm::SmallString<128> path(dir);
+    llvm::sys::path::append(path, HashString(key) + ".pch");
+    PchPath_ = path.str().str();
+}
+
+bool PrefixHeader::Apply(clang::tooling::ClangTool & tool)
+{
+    if(HeaderPath_.empty()) return false;
+
+    bool usable = false;
+    if(!IsUpToDate(usable) && !Build(usable)) return false;
+    if(!usable) return false;
+
+    // Clang checks that the prefix header is still there
+    tool.mapVirtualFile(HeaderPath_, Header_);
+    tool.appendArgumentsAdjuster(clang::tooling::getInsertArgumentAdjuster({"-include-pch", PchPath_},
+                                                                           clang::tooling::ArgumentInsertPosition::END));
+    gMsgUI.Verbose("Using precompiled header %s", PchPath_.c_str());
+    return true;
+}
+
+bool PrefixHeader::IsUpToDate(bool & usable) const
+{
+    string data;
+    if(!ReadFile(PchPath_ + ".info", data)) return false;
+
+    PchInfo info;
+    loadstore::BinaryLoad ld(std::move(data), true);
+    if(ld.GetErrorCount() != 0 || !ld.RawIO(info) || ld.GetErrorCount() != 0) return false;
+    if(info.Files.size() != info.Stamps.size()) return false;
+    for(size_t i = 0; i < info.Files.size(); ++i)
+    {
+        if(GetStamp(Opts_, info.Files[i]) != info.Stamps[i]) return false;
+    }
+    if(info.Usable && !llvm::sys::fs::exists(PchPath_)) return false;
+    usable = info.Usable;
+    return true;
+}
+
+bool PrefixHeader::Build(bool & usable)
+{
+    vector<string> args = Args_;
+    args.push_back("-xc++-header"); // comes after the "-xc++" of the Clang arguments
+    clang::tooling::FixedCompilationDatabase compilation(".", args);
+    clang::tooling::ClangTool tool(compilation, { HeaderPath_ });
+    tool.mapVirtualFile(HeaderPath_, Header_);
+    for(auto & file : Opts_.VirtualFiles) tool.mapVirtualFile(file.first, file.second);
+
+    clang::IgnoringDiagConsumer quiet; // errors in the headers are reported when parsing the specification
+    tool.setDiagnosticConsumer(&quiet);
+    llvm::SmallString<128> temppath;
+    llvm::sys::fs::createUniquePath(PchPath_ + ".%%%%%%.tmp", temppath, false);
+    tool.clearArgumentsAdjusters(); // the default ones would only check the syntax and drop the output file
+    tool.appendArgumentsAdjuster(clang::tooling::getInsertArgumentAdjuster({"-o", temppath.str().str()},
+                                                                           clang::tooling::ArgumentInsertPosition::END));
+
+    PchInfo info;
+    BuildActionFactory factory(info, HeaderPath_);
+    if(tool.run(&factory) != 0 || !llvm::sys::fs::exists(temppath))
+    {
+        llvm::sys::fs::remove(temppath);
+        return false;
+    }
+
+    for(auto & file : info.Files) info.Stamps.push_back(GetStamp(Opts_, file));
+    if(!info.Usable) llvm::sys::fs::remove(temppath);
+    else if(llvm::sys::fs::rename(temppath, PchPath_))
+    {
+        llvm::sys::fs::remove(temppath);
+        return false;
+    }
+
+    loadstore::BinaryStore ls;
+    bool ok = ls.RawIO(info);
+    if(!ok || ls.GetErrorCount() != 0 || !WriteFileAtomic(PchPath_ + ".info", ls.GetData())) return false;
+
+    if(info.Usable) gMsgUI.Verbose("Precompiled the headers of %s into %s", Opts_.SpecificationFile.c_str(),
+                                   PchPath_.c_str());
+    else gMsgUI.Verbose("Not precompiling the headers of %s, as not all of them have include guards",
+                        Opts_.SpecificationFile.c_str());
+    usable = info.Usable;
+    return true;
+}
+
+}} //namespace Ladybirds::parse
@@ -0,0 +1,50 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_PARSE_PREFIXHEADER_H
+#define LADYBIRDS_PARSE_PREFIXHEADER_H
+
+#include <string>
+#include <vector>
+
+namespace clang { namespace tooling { class ClangTool; }}
+
+namespace Ladybirds { namespace parse {
+
+struct CSpecOptions;
+
+//! Precompiled header for the #include lines at the start of a specification (its prefix), which usually pull in
+//! ladybirds.h, configuration headers and system headers, such that they are not parsed again for every run.
+/** The leading lines of the specification that are empty, line comments or #include directives make up the prefix.
+ *  It is given to Clang as a virtual header next to the specification, so quoted includes find the same files, and
+ *  precompiled into a file in the directory given to the constructor. The precompiled header is rebuilt when the
+ *  prefix, the Clang arguments, the compiler or one of the included files changes (by size and modification time, as
+ *  Clang checks them too). As the specification includes the headers again after the precompiled header, it is only
+ *  used if all of them have include guards (or #pragma once); otherwise, that is remembered as well. **/
+class PrefixHeader
+{
+private:
+    const CSpecOptions & Opts_;
+    const std::vector<std::string> & Args_;
+    std::string HeaderPath_; ///< Of the virtual header with the prefix, empty if nothing is to be precompiled
+    std::string Header_;     ///< The prefix
+    std::string PchPath_;    ///< Of the precompiled header; the description of its inputs is next to it
+
+public:
+    //! Prepares precompiling the prefix of the specification parsed with \p opts and Clang arguments \p args in
+    //! directory \p dir. If \p dir is empty, nothing is precompiled.
+    PrefixHeader(const CSpecOptions & opts, const std::vector<std::string> & args, const std::string & dir);
+
+    //! Lets \p tool, which parses the specification, use the precompiled header, building it first if necessary.
+    //! Returns false if it cannot be used; \p tool is unchanged then. This object must live as long as \p tool.
+    bool Apply(clang::tooling::ClangTool & tool);
+
+private:
+    //! Returns true if the precompiled header and the description of its inputs are up to date, and sets \p usable
+    bool IsUpToDate(bool & usable) const;
+    //! Builds the precompiled header and the description of its inputs. Returns false on failure.
+    bool Build(bool & usable);
+};
+
+}} //namespace Ladybirds::parse
+
+#endif // LADYBIRDS_PARSE_PREFIXHEADER_H
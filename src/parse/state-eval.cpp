@@ -8,12 +8,65 @@
 
 #include "state-eval.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <deque>
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 using namespace clang;
 
 namespace clang_ext {
 
+namespace {
+/// \internal Integer expression of the form Constant + sum of the coefficient times the value of the variable of Terms
+struct AffineForm
+{
+  int64_t Constant = 0;
+  std::vector<std::pair<const VarDecl *, int64_t>> Terms;
+
+  void Add(const AffineForm &other, int64_t factor) {
+    Constant += factor * other.Constant;
+    for (auto &term : other.Terms) {
+      auto it = std::find_if(Terms.begin(), Terms.end(), [&](auto &t) { return t.first == term.first; });
+      if (it == Terms.end()) Terms.emplace_back(term.first, factor * term.second);
+      else it->second += factor * term.second;
+    }
+  }
+  /// Makes the constant and each coefficient at least as large as the magnitude of that of \p other
+  void Cover(const AffineForm &other) {
+    Constant = std::max(Constant, std::abs(other.Constant));
+    for (auto &term : other.Terms) {
+      auto it = std::find_if(Terms.begin(), Terms.end(), [&](auto &t) { return t.first == term.first; });
+      if (it == Terms.end()) Terms.emplace_back(term.first, std::abs(term.second));
+      else it->second = std::max(it->second, std::abs(term.second));
+    }
+  }
+  /// Returns true if the constant and the coefficients are small enough for computing with them without overflow
+  bool IsSmall() const {
+    return std::abs(Constant) <= MaxConstant && std::all_of(Terms.begin(), Terms.end(),
+                                                            [](auto &t) { return std::abs(t.second) <= MaxCoeff; });
+  }
+  static constexpr int64_t MaxConstant = INT64_C(1) << 40, MaxCoeff = INT64_C(1) << 20;
+  static constexpr int MaxTerms = 4; ///< Such that MaxConstant + MaxTerms * MaxCoeff * MaxConstant < 2^63
+};
+
+/// \internal What is known about an expression, for evaluating it again quickly (cf. EvalState::Evaluate)
+struct ExprInfo
+{
+  bool Cacheable = false; ///< Free of side effects, and only depending on the integer variables in Vars
+  std::vector<const VarDecl *> Vars;
+  bool Affine = false; ///< Forms[0] gives the value (or, if Compare is set, the operands of a comparison)
+  BinaryOperatorKind Compare = BO_Comma; ///< BO_Comma for none
+  AffineForm Forms[2];
+  AffineForm Bound; ///< Bounds the magnitude of all subexpressions of the forms (cf. AffineForm::Cover)
+  unsigned MinWidth = 64; ///< The smallest integer width of these subexpressions
+  std::map<std::vector<int64_t>, APValue> Values; ///< Of earlier evaluations, by the values of Vars
+};
+} //namespace ::
+
 class EvalState::Impl {
 public:
   Expr::EvalStatus Status;
@@ -21,14 +74,168 @@ public:
   CallStackFrame Frame;
   std::deque<BlockScopeRAII> Scopes;
   const ASTContext &Context_;
+  std::unordered_map<const Expr *, ExprInfo> Exprs_;
 
   Impl(const ASTContext &Ctx, const FunctionDecl *pFn) :
        Info(Ctx, Status, EvalInfo::EM_ConstantExpressionUnevaluated),
        Frame(Info, clang::SourceLocation(), pFn, /*This*/nullptr, CallRef()),
        Context_(Ctx)
        {}
+
+  ExprInfo &GetInfo(const Expr *expr);
+  bool IsFrameVar(const VarDecl *var) const;
+  bool CollectVars(const Stmt *stmt, std::vector<const VarDecl *> &vars) const;
+  bool GetAffineForm(const Expr *expr, AffineForm &form, ExprInfo &info) const;
+  bool GetAffineFormOfNode(const Expr *expr, AffineForm &form, ExprInfo &info) const;
+  bool GetVarValues(const ExprInfo &info, std::vector<int64_t> &values);
 };
 
+/// \internal Returns true if \p var is a local variable of the evaluated function (e.g. a genvar), whose value is kept
+/// in the frame
+bool EvalState::Impl::IsFrameVar(const VarDecl *var) const
+{
+    return var->hasLocalStorage() && !isa<ParmVarDecl>(var) && !var->getType()->isReferenceType()
+        && Frame.Callee && Frame.Callee->Equals(var->getDeclContext());
+}
+
+/// \internal Adds the frame variables used in \p stmt to \p vars. Returns false if \p stmt uses other variables that may
+/// change (i.e. whose value is not simply that of a constant declaration).
+bool EvalState::Impl::CollectVars(const Stmt *stmt, std::vector<const VarDecl *> &vars) const
+{
+    if (!stmt) return true;
+    if (auto *dre = dyn_cast<DeclRefExpr>(stmt)) {
+        auto *var = dyn_cast<VarDecl>(dre->getDecl());
+        if (!var) return true; // enum constants, functions
+        if (IsFrameVar(var)) {
+            if (!var->getType()->isIntegerType()) return false;
+            if (std::find(vars.begin(), vars.end(), var) == vars.end()) vars.push_back(var);
+            return true;
+        }
+        return !var->hasLocalStorage() && var->getType().isConstQualified();
+    }
+    if (isa<LambdaExpr>(stmt) || isa<CXXThisExpr>(stmt) || isa<StmtExpr>(stmt)) return false;
+    for (auto *child : stmt->children()) {
+        if (!CollectVars(child, vars)) return false;
+    }
+    return true;
+}
+
+/// \internal Tries to write \p expr, a signed integer expression of at most 64 bits, as affine form of the frame
+/// variables it uses, updating the bounds in \p info. Returns false if it is not affine (or not simple enough to be
+/// recognised as such).
+bool EvalState::Impl::GetAffineForm(const Expr *expr, AffineForm &form, ExprInfo &info) const
+{
+    if (!GetAffineFormOfNode(expr, form, info) || !form.IsSmall()) return false;
+    info.Bound.Cover(form);
+    info.MinWidth = std::min(info.MinWidth, Context_.getIntWidth(expr->getType()));
+    return true;
+}
+
+/// \internal Does the work of GetAffineForm for the top node of \p expr
+bool EvalState::Impl::GetAffineFormOfNode(const Expr *expr, AffineForm &form, ExprInfo &info) const
+{
+    expr = expr->IgnoreParens();
+    auto type = expr->getType();
+    if (!type->isSignedIntegerType() || Context_.getIntWidth(type) > 64) return false;
+
+    if (auto *lit = dyn_cast<IntegerLiteral>(expr)) {
+        if (lit->getValue().getMinSignedBits() > 64) return false;
+        form.Constant = lit->getValue().getSExtValue();
+        return true;
+    }
+    if (auto *dre = dyn_cast<DeclRefExpr>(expr)) {
+        auto *var = dyn_cast<VarDecl>(dre->getDecl());
+        if (var && IsFrameVar(var)) {
+            form.Terms.emplace_back(var, 1);
+            return true;
+        }
+    }
+    if (auto *cast = dyn_cast<ImplicitCastExpr>(expr)) {
+        // reading a variable, or widening conversions between signed types, which keep the value
+        auto kind = cast->getCastKind();
+        auto *sub = cast->getSubExpr();
+        if (kind == CK_LValueToRValue || kind == CK_NoOp
+            || (kind == CK_IntegralCast && sub->getType()->isSignedIntegerType()
+                && Context_.getIntWidth(sub->getType()) <= Context_.getIntWidth(type)))
+            return GetAffineForm(sub, form, info);
+        return false;
+    }
+    if (auto *unop = dyn_cast<UnaryOperator>(expr)) {
+        if (unop->getOpcode() != UO_Minus && unop->getOpcode() != UO_Plus) return false;
+        AffineForm sub;
+        if (!GetAffineForm(unop->getSubExpr(), sub, info)) return false;
+        form.Add(sub, unop->getOpcode() == UO_Minus ? -1 : 1);
+        return true;
+    }
+    if (auto *binop = dyn_cast<BinaryOperator>(expr)) {
+        auto op = binop->getOpcode();
+        if (op != BO_Add && op != BO_Sub && op != BO_Mul) return false;
+        AffineForm lhs, rhs;
+        if (!GetAffineForm(binop->getLHS(), lhs, info) || !GetAffineForm(binop->getRHS(), rhs, info)) return false;
+        if (op == BO_Mul) { // one of the factors has to be constant
+            if (!lhs.Terms.empty() && !rhs.Terms.empty()) return false;
+            if (lhs.Terms.empty() && (!rhs.Terms.empty() || std::abs(lhs.Constant) < std::abs(rhs.Constant)))
+                std::swap(lhs, rhs);
+            if (std::abs(rhs.Constant) > AffineForm::MaxCoeff && std::abs(lhs.Constant) > AffineForm::MaxCoeff)
+                return false; // the product might overflow
+            form.Add(lhs, rhs.Constant);
+        }
+        else {
+            form.Add(lhs, 1);
+            form.Add(rhs, op == BO_Sub ? -1 : 1);
+        }
+        return true;
+    }
+
+    // anything else must be a constant, e.g. a const global variable or a sizeof
+    std::vector<const VarDecl *> vars;
+    Expr::EvalResult res;
+    if (!CollectVars(expr, vars) || !vars.empty() || !expr->EvaluateAsInt(res, Context_)) return false;
+    if (res.Val.getInt().getMinSignedBits() > 64) return false;
+    form.Constant = res.Val.getInt().getSExtValue();
+    return true;
+}
+
+/// \internal Analyses \p expr when it is evaluated for the first time
+ExprInfo &EvalState::Impl::GetInfo(const Expr *expr)
+{
+    auto res = Exprs_.emplace(expr, ExprInfo());
+    auto &info = res.first->second;
+    if (!res.second) return info;
+
+    if (expr->HasSideEffects(Context_) || !CollectVars(expr, info.Vars)) return info;
+    info.Cacheable = true;
+
+    // Evaluate checks with Bound that no subexpression overflows. For that check not to overflow itself, there may only
+    // be few variables (besides the small coefficients, cf. AffineForm::IsSmall).
+    auto *inner = expr->IgnoreParenImpCasts();
+    auto *binop = dyn_cast<BinaryOperator>(inner);
+    if (binop && binop->isComparisonOp() && binop->getOpcode() != BO_Cmp) {
+        info.Affine = GetAffineForm(binop->getLHS(), info.Forms[0], info)
+                   && GetAffineForm(binop->getRHS(), info.Forms[1], info)
+                   && expr->getType()->isIntegerType() && (inner == expr || isa<ImplicitCastExpr>(expr));
+        info.Compare = binop->getOpcode();
+    }
+    else info.Affine = GetAffineForm(expr, info.Forms[0], info);
+
+    info.Affine = info.Affine && info.Bound.Terms.size() <= AffineForm::MaxTerms;
+    return info;
+}
+
+/// \internal Stores the current values of the variables of \p info in \p values. Returns false if one of them has no
+/// value of at most 40 bits (cf. AffineForm::MaxConstant; e.g. at the end of its lifetime), in which case the
+/// expression has to be evaluated the normal way.
+bool EvalState::Impl::GetVarValues(const ExprInfo &info, std::vector<int64_t> &values)
+{
+    values.clear();
+    for (auto *var : info.Vars) {
+        APValue *val = Info.CurrentCall->getCurrentTemporary(var);
+        if (!val || !val->isInt() || val->getInt().getMinSignedBits() > 41) return false;
+        values.push_back(val->getInt().getSExtValue());
+    }
+    return true;
+}
+
 EvalState::EvalState(ASTContext & Ctx, const FunctionDecl *pFn) : pImpl(new Impl(Ctx, pFn)) {}
 EvalState::~EvalState() { delete pImpl; }
 
@@ -50,8 +257,46 @@ bool EvalState::Evaluate(const Stmt *stmt, APValue &Value)
 
 bool EvalState::Evaluate(const Expr *expr, APValue &Value)
 {
-    return EvaluateAsRValue(pImpl->Info, expr, Value);
+    auto &info = pImpl->GetInfo(expr);
+    std::vector<int64_t> values;
+    if (!info.Cacheable || !pImpl->GetVarValues(info, values)) return EvaluateAsRValue(pImpl->Info, expr, Value);
+
+    if (info.Affine) {
+        // the values are at most MaxConstant as well, so nothing overflows here (cf. AffineForm::MaxTerms)
+        int64_t bound = info.Bound.Constant, results[2];
+        auto valueOf = [&](const VarDecl *var) {
+            return values[std::find(info.Vars.begin(), info.Vars.end(), var) - info.Vars.begin()];
+        };
+        for (auto &term : info.Bound.Terms) bound += term.second * std::abs(valueOf(term.first));
+        for (int i = 0; i < 2; ++i) {
+            results[i] = info.Forms[i].Constant;
+            for (auto &term : info.Forms[i].Terms) results[i] += term.second * valueOf(term.first);
+        }
+        // otherwise, a subexpression may overflow, which the evaluator reports
+        if (info.MinWidth >= 64 || bound < (INT64_C(1) << (info.MinWidth - 1))) {
+            int64_t result = results[0];
+            switch (info.Compare) {
+                case BO_LT: result = results[0] < results[1]; break;
+                case BO_GT: result = results[0] > results[1]; break;
+                case BO_LE: result = results[0] <= results[1]; break;
+                case BO_GE: result = results[0] >= results[1]; break;
+                case BO_EQ: result = results[0] == results[1]; break;
+                case BO_NE: result = results[0] != results[1]; break;
+                default: break;
+            }
+            Value = APValue(pImpl->Context_.MakeIntValue(result, expr->getType()));
+            return true;
+        }
+    }
+
+    auto it = info.Values.find(values);
+    if (it != info.Values.end()) {
+        Value = it->second;
+        return true;
+    }
+    if (!EvaluateAsRValue(pImpl->Info, expr, Value)) return false;
+    info.Values.emplace(std::move(values), Value);
+    return true;
 }
 
 } // namespace clang_ext
-
@@ -31,6 +31,9 @@ public:
     /// Evaluate an expression based on the information in this state object
     /// and save the side effects like variable assigment etc. in it.
     /// Differs from Evaluate(Stmt&) in that the result of the expression is stored in \p Value.
+    /// Expressions without side effects are remembered with their values by the values of the local variables they
+    /// use (e.g. genvars), and affine integer expressions (and comparisons of them) are computed in closed form from
+    /// these values, such that the expressions of a loop body are not interpreted again in every iteration.
     bool Evaluate(const clang::Expr *expr, clang::APValue &Value);
 
     /// EvaluateWithState - Evaluate a statement based on the information in this state object
@@ -0,0 +1,98 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <climits>
+#include <unordered_set>
+
+#include "lua/pass.h"
+#include "buffer.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "packet.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Buffer;
+using Ladybirds::impl::Program;
+using Ladybirds::impl::TaskGroup;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Packet;
+
+namespace {
+
+struct AlignArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Alignment = 64;  ///< Minimum alignment of all buffers, e.g. a cache line or the SIMD width
+    int Separation = 128; ///< Alignment of buffers written by threads, to keep them apart from buffers of other threads
+    int HugePages = 0;   ///< Buffers of at least this size are aligned to huge pages (0: never)
+    int HugePageSize = 2*1024*1024;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("alignment", Alignment, false, 64)
+             & ls.IO("separation", Separation, false, 128)
+             & ls.IO("hugepages", HugePages, false, 0)
+             & ls.IO("hugepagesize", HugePageSize, false, 2*1024*1024);
+    }
+};
+
+bool AlignBuffers(Program &prog, AlignArgs &args);
+
+/** Pass AlignBuffers: Sets the alignment (Buffer::Alignment) of all buffers allocated by the program and pads their
+ *  sizes to a multiple of it, such that no two buffers share a cache line. If the tasks are spread over more than one
+ *  group, buffers written by a group are aligned to separation instead, which also keeps buffers written concurrently
+ *  by different threads out of the cache lines that are prefetched together. Buffers of at least hugepages bytes are
+ *  aligned to hugepagesize. Run this before BufferAllocation or BufferPacking, which keep the alignments. **/
+Ladybirds::lua::PassWithArgs<AlignArgs> AlignBuffersPass("AlignBuffers", &AlignBuffers,
+                                                         Pass::Requires{"BufferPreallocation", "PopulateGroups"});
+
+
+/// \internal Checks if \p n is a positive power of two
+inline bool IsPowerOfTwo(int n) { return n > 0 && (n & (n-1)) == 0; }
+
+bool AlignBuffers(Program &prog, AlignArgs &args)
+{
+    if(!IsPowerOfTwo(args.Alignment) || !IsPowerOfTwo(args.Separation)
+       || (args.HugePages > 0 && !IsPowerOfTwo(args.HugePageSize)))
+    {
+        gMsgUI.Error("AlignBuffers: Alignments and the huge page size must be powers of two.");
+        return false;
+    }
+
+    for(auto &div : prog.Divisions)
+    {
+        std::unordered_set<const Buffer*> written;
+        if(div.GetGroups().size() > 1)
+        {
+            for(auto *pt : div.GetTasks()) for(auto &iface : pt->Ifaces)
+            {
+                if(iface.GetPacket()->GetAccessType() != Packet::in) written.insert(iface.GetBuffer());
+            }
+        }
+
+        int nhuge = 0;
+        for(auto &buffer : div.Buffers)
+        {
+            if(buffer.pExternalSource) continue;
+            int alignment = std::max(buffer.Alignment, written.count(&buffer) ? args.Separation : args.Alignment);
+            if(args.HugePages > 0 && buffer.Size >= args.HugePages)
+            {
+                alignment = std::max(alignment, args.HugePageSize);
+                ++nhuge;
+            }
+            if(buffer.Size > INT_MAX - alignment)
+            {
+                gMsgUI.Error("AlignBuffers: Buffer of %d bytes is too large to be padded.", buffer.Size);
+                return false;
+            }
+            buffer.Alignment = alignment;
+            buffer.Size = (buffer.Size + alignment-1) / alignment * alignment;
+        }
+        if(nhuge > 0) gMsgUI.Verbose("AlignBuffers: %d buffers aligned to huge pages", nhuge);
+    }
+    return true;
+}
+
+} //namespace ::
@@ -7,8 +7,10 @@
 
 #include <algorithm>
 #include <list>
+#include <map>
 #include <numeric>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -39,6 +41,171 @@ namespace std {
 
 namespace{
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Packing of arrays into a common table
+
+/// \internal Suffix automaton over one or several sequences (generalized by restarting from the initial state), i.e.
+/// the smallest automaton accepting all their substrings. Find returns where a sequence occurs as a substring.
+template<typename ItemRep>
+class SuffixAutomaton
+{
+    struct State
+    {
+        int Len = 0, Link = -1;
+        int FirstEnd = -1; ///< Position after the end of the first occurrence (in the order of the added items)
+        std::map<ItemRep, int> Next;
+    };
+    std::vector<State> States_ = std::vector<State>(1);
+    int Last_ = 0;
+    int Pos_ = 0; ///< Number of items added so far
+
+    int Clone(int q, int len)
+    {
+        States_.push_back(States_[q]);
+        States_.back().Len = len;
+        return States_.size() - 1;
+    }
+
+public:
+    /// Starts a new sequence, such that no substring spans the borders between the sequences
+    inline void Restart() { Last_ = 0; }
+
+    void Add(ItemRep c)
+    {
+        ++Pos_;
+        int p = Last_;
+        auto it = States_[p].Next.find(c);
+        if(it != States_[p].Next.end()) // the substring exists already (generalized case)
+        {
+            int q = it->second;
+            if(States_[q].Len == States_[p].Len + 1) { Last_ = q; return; }
+            int clone = Clone(q, States_[p].Len + 1);
+            for(; p != -1 && States_[p].Next[c] == q; p = States_[p].Link) States_[p].Next[c] = clone;
+            States_[q].Link = clone;
+            Last_ = clone;
+            return;
+        }
+        int cur = States_.size();
+        States_.emplace_back();
+        States_[cur].Len = States_[Last_].Len + 1;
+        States_[cur].FirstEnd = Pos_;
+        for(; p != -1 && !States_[p].Next.count(c); p = States_[p].Link) States_[p].Next[c] = cur;
+        if(p == -1) States_[cur].Link = 0;
+        else
+        {
+            int q = States_[p].Next[c];
+            if(States_[p].Len + 1 == States_[q].Len) States_[cur].Link = q;
+            else
+            {
+                int clone = Clone(q, States_[p].Len + 1);
+                for(; p != -1 && States_[p].Next[c] == q; p = States_[p].Link) States_[p].Next[c] = clone;
+                States_[q].Link = States_[cur].Link = clone;
+            }
+        }
+        Last_ = cur;
+    }
+
+    /// Returns the position after the end of the first occurrence of \p seq, or -1 if it does not occur
+    template<typename seq_t> int Find(const seq_t & seq) const
+    {
+        int s = 0;
+        for(auto c : seq)
+        {
+            auto it = States_[s].Next.find(c);
+            if(it == States_[s].Next.end()) return -1;
+            s = it->second;
+        }
+        return s == 0 ? 0 : States_[s].FirstEnd;
+    }
+};
+
+/// \internal Length of the longest suffix of \p a that is a prefix of \p b (but not all of \p b)
+template<typename str_t> size_t GetOverlap(const str_t & a, const str_t & b, const std::vector<int> & bprefix)
+{
+    // a runs through the Knuth-Morris-Pratt automaton of b, with failure function bprefix
+    size_t matched = 0;
+    for(size_t i = a.size() > b.size() ? a.size() - b.size() + 1 : 0; i < a.size(); ++i)
+    {
+        while(matched > 0 && (matched == b.size() || b[matched] != a[i])) matched = bprefix[matched - 1];
+        if(b[matched] == a[i]) ++matched;
+    }
+    return matched < b.size() ? matched : 0;
+}
+
+/** \internal Packs \p arrays into \p table, such that each array is a substring of it, starting at the position given
+ *  in \p offsets, and table is as short as a greedy shortest common superstring gets: Arrays contained in others are
+ *  dropped (found with a suffix automaton), then the pair with the longest suffix/prefix overlap is merged repeatedly.
+ *  The latter compares all pairs, i.e. takes quadratic time in the number of arrays not contained in others. **/
+template<typename str_t> void PackArrays(const std::vector<str_t> & arrays, str_t & table, std::vector<int> & offsets)
+{
+    std::vector<int> bylength(arrays.size());
+    std::iota(bylength.begin(), bylength.end(), 0);
+    std::stable_sort(bylength.begin(), bylength.end(),
+                     [&](int i, int j) { return arrays[i].size() > arrays[j].size(); });
+
+    // drop the arrays that are substrings of longer ones
+    SuffixAutomaton<typename str_t::value_type> kept;
+    std::vector<int> pieces;
+    for(int i : bylength)
+    {
+        if(arrays[i].empty() || kept.Find(arrays[i]) >= 0) continue;
+        kept.Restart();
+        for(auto c : arrays[i]) kept.Add(c);
+        pieces.push_back(i);
+    }
+
+    // greedy merging along the longest overlaps
+    int n = pieces.size();
+    std::vector<std::tuple<size_t, int, int>> overlaps; // (overlap, from, to) for all overlapping pairs
+    for(int b = 0; b < n; ++b)
+    {
+        auto & sb = arrays[pieces[b]];
+        std::vector<int> prefix(sb.size(), 0);
+        for(size_t i = 1, k = 0; i < sb.size(); ++i)
+        {
+            while(k > 0 && sb[i] != sb[k]) k = prefix[k - 1];
+            if(sb[i] == sb[k]) ++k;
+            prefix[i] = k;
+        }
+        for(int a = 0; a < n; ++a)
+        {
+            if(a == b) continue;
+            size_t ov = GetOverlap(arrays[pieces[a]], sb, prefix);
+            if(ov > 0) overlaps.emplace_back(ov, a, b);
+        }
+    }
+    std::stable_sort(overlaps.begin(), overlaps.end(),
+                     [](auto & o1, auto & o2) { return std::get<0>(o1) > std::get<0>(o2); });
+    std::vector<int> succ(n, -1), pred(n, -1), overlapsucc(n, 0), chainhead(n);
+    std::iota(chainhead.begin(), chainhead.end(), 0);
+    auto gethead = [&](int i) { while(chainhead[i] != i) i = chainhead[i] = chainhead[chainhead[i]]; return i; };
+    for(auto & o : overlaps)
+    {
+        int a = std::get<1>(o), b = std::get<2>(o);
+        if(succ[a] >= 0 || pred[b] >= 0 || gethead(a) == gethead(b)) continue; // b must not be the head of a's chain
+        succ[a] = b, pred[b] = a, overlapsucc[a] = std::get<0>(o);
+        chainhead[gethead(b)] = gethead(a);
+    }
+
+    table.clear();
+    for(int i = 0; i < n; ++i)
+    {
+        if(pred[i] >= 0) continue;
+        size_t skip = 0;
+        for(int j = i; j >= 0; skip = overlapsucc[j], j = succ[j]) table.append(arrays[pieces[j]], skip);
+    }
+
+    SuffixAutomaton<typename str_t::value_type> packed;
+    for(auto c : table) packed.Add(c);
+    offsets.resize(arrays.size());
+    for(size_t i = 0; i < arrays.size(); ++i)
+    {
+        int end = packed.Find(arrays[i]);
+        assert(end >= 0);
+        offsets[i] = end - arrays[i].size();
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // ArrayMerger class
 
@@ -56,6 +223,8 @@ public:
         int Bits;
         bool Signed;
         std::vector<ArrayRep> Arrays;
+        ArrayRep Table;           ///< Only when packing: a table containing all arrays ...
+        std::vector<int> Offsets; ///< ... at these positions
     };
     
 private:
@@ -143,9 +312,13 @@ public:
         return res.first->second;
     }
     
-    void Finalize(std::vector<int> &finaltypes, std::vector<std::vector<int>> &indices, std::vector<Data> &data)
+    /// Merges compatible types and returns the type each handle ended up in, the index each array of a handle got in
+    /// that type, and the arrays of each type. If \p pack is set, the arrays of each type are also packed into one
+    /// table (cf. PackArrays). Returns the number of bytes this saves compared to storing all arrays on their own.
+    long Finalize(std::vector<int> &finaltypes, std::vector<std::vector<int>> &indices, std::vector<Data> &data,
+                  bool pack = false)
     {
-        if(Types_.empty()) return;
+        if(Types_.empty()) return 0;
         
         // determine the necessary element size for each array
         for(auto &t: Types_)
@@ -201,11 +374,24 @@ public:
             for(auto &entry : t.Arrays) sys.Arrays[entry.second] = std::move(entry.first);
         }
         
+        long saved = 0;
+        if(pack)
+        {
+            for(auto &sys : data)
+            {
+                PackArrays(sys.Arrays, sys.Table, sys.Offsets);
+                long total = 0;
+                for(auto &arr : sys.Arrays) total += arr.size();
+                saved += (total - (long) sys.Table.size()) * (sys.Bits/8);
+            }
+        }
+        
         finaltypes.clear(); finaltypes.reserve(Handles_.size());
         for(auto *ptype : Handles_) finaltypes.push_back(ptype->Index);
         
         Handles_.clear();
         Types_.clear();
+        return saved;
     }
     
     const char *GetErrorDescription(int err)
@@ -277,8 +463,9 @@ public:
         std::vector<int> finaltypes;
         std::vector<std::vector<int>> indices;
         std::vector<Data> data;
+        bool pack = lua_toboolean(lua, 2);
         
-        ArrayMerger::Finalize(finaltypes, indices, data);
+        long saved = ArrayMerger::Finalize(finaltypes, indices, data, pack);
         
         auto exportarray = [lua](auto &arr, auto fn)
         {
@@ -296,20 +483,28 @@ public:
         };
         exportidxarray(finaltypes);
         exportarray(indices, exportidxarray);
-        exportarray(data, [lua,exportarray](auto &t)
+        exportarray(data, [lua,exportarray,pack](auto &t)
         {
-            lua_createtable(lua, 0, 3);
+            lua_createtable(lua, 0, pack ? 5 : 3);
             lua_pushinteger(lua, t.Bits);   lua_setfield(lua, -2, "bits");
             lua_pushboolean(lua, t.Signed); lua_setfield(lua, -2, "signed");
             exportarray(t.Arrays, [lua, exportarray](auto &arr){exportarray(arr, [lua](lua_Integer i){lua_pushinteger(lua, i);});});
             lua_setfield(lua, -2, "arrays");
+            if(!pack) return;
+            exportarray(t.Table, [lua](lua_Integer i){lua_pushinteger(lua, i);});
+            lua_setfield(lua, -2, "table");
+            exportarray(t.Offsets, [lua](lua_Integer i){lua_pushinteger(lua, i);}); // 0-based, for C
+            lua_setfield(lua, -2, "offsets");
         });
-        return 3;
+        lua_pushinteger(lua, saved);
+        return 4;
     }
 };
 
 
-/// CreateArrayMergerPass: Pseudo pass returning new ArrayMerger object
+/// CreateArrayMergerPass: Pseudo pass returning new ArrayMerger object. Its method finalize(pack) returns the type of
+/// each handle, the indices of the arrays of each handle and the arrays of each type, and with pack = true also a
+/// table per type into which the arrays are packed (table and offsets, cf. ArrayMerger::Finalize) and the bytes saved.
 class CreateArrayMergerPass : public Ladybirds::lua::Pass
 {
     using Pass::Pass;
@@ -4,6 +4,7 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "lua/pass.h"
 #include "opt/bankassignment.h"
@@ -20,41 +21,71 @@ using std::deque;
 using std::unordered_map;
 using Ladybirds::spec::Task;
 using Ladybirds::lua::Pass;
-using Ladybirds::lua::PassWithArgs;
+using Ladybirds::lua::PassWithArgsAndRet;
 
 namespace {
 
 struct BankAssignmentArgs : public Ladybirds::loadstore::LoadStorableCompound
 {
     std::string TimingSpec;
+    Ladybirds::spec::Platform::Cluster ClusterInfo = {16, 16, 116*1024}; // MPPA data by default
+    int Starts = 0; ///< Number of starts for refining the bank assignment (0: no refinement)
+    int Threads = 0; ///< Number of threads for the refinement, 0 for one per hardware thread
     virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
-        {return ls.IO("timingspec", TimingSpec); }
+    {
+        return ls.IO("timingspec", TimingSpec)
+             & ls.IO("cores", ClusterInfo.nCores, false, 16)
+             & ls.IO("banks", ClusterInfo.nBanks, false, 16)
+             & ls.IO("banksize", ClusterInfo.BankSize, false, 116*1024)
+             & ls.IO("starts", Starts, false, 0)
+             & ls.IO("threads", Threads, false, 0);
+    }
+};
+struct BankAssignmentRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double ConflictCost = 0;
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+        {return ls.IO("conflictcost", ConflictCost); }
 };
-bool AssignBanks(Ladybirds::impl::Program &prog, BankAssignmentArgs & args);
+bool AssignBanks(Ladybirds::impl::Program &prog, BankAssignmentArgs & args, BankAssignmentRets & rets);
 
-/// Pass AssignBanks: Based on a measured task start and end times (timingspec), assign all buffers to memory banks
-PassWithArgs<BankAssignmentArgs> AssignBanksPass("AssignBanks", &AssignBanks, 
-                                                 Pass::Requires{"BufferPreallocation"});
+/// Pass AssignBanks: Based on a measured task start and end times (timingspec), assign all buffers to memory banks.
+/// The cluster (cores, banks, banksize) defaults to the MPPA. If starts is given, the assignment is refined by local
+/// search from that many starting points (cf. opt::BankAssignment::RefineAssignment). Returns a table with the field
+/// conflictcost, the weighted overlap of the buffers sharing a bank (cf. opt::BankAssignment::GetConflictCost).
+PassWithArgsAndRet<BankAssignmentArgs, BankAssignmentRets> AssignBanksPass("AssignBanks", &AssignBanks, 
+                                                                          Pass::Requires{"BufferPreallocation"});
 
 
-bool AssignBanks(Ladybirds::impl::Program &prog, BankAssignmentArgs & args)
+bool AssignBanks(Ladybirds::impl::Program &prog, BankAssignmentArgs & args, BankAssignmentRets & rets)
 {
-    Ladybirds::opt::BankAssignment ba(prog, 16);
-    if(!ba.LoadOverlaps(args.TimingSpec.c_str())) return false;
+    if(args.ClusterInfo.nBanks <= 0 || args.ClusterInfo.BankSize <= 0)
+    {
+        gMsgUI.Error("AssignBanks needs a positive number of banks and bank size.");
+        return false;
+    }
+    Ladybirds::opt::BankAssignment overlaps(prog, args.ClusterInfo);
+    if(!overlaps.LoadOverlaps(args.TimingSpec.c_str())) return false;
     
     //MPPA data. TODO: make configurable
     Ladybirds::spec::Platform::CacheConfig cacheinfo = {64, 2, 64};
-    Ladybirds::spec::Platform::Cluster clusterinfo = {16, 16, 116*1024};
-    Ladybirds::opt::CacheIndexOpt cio(clusterinfo, cacheinfo);
 
-    bool ret = true;
-    for(auto &div : prog.Divisions) 
+    // The divisions are assigned concurrently, each with its own optimizers; the costs are summed up in their order
+    std::vector<double> costs(prog.Divisions.size(), 0);
+    bool ret = Ladybirds::lua::ForEachDivision(prog, [&](Ladybirds::impl::TaskDivision & div)
     {
+        int index = &div - prog.Divisions.data();
+        Ladybirds::opt::BankAssignment ba(prog, args.ClusterInfo);
+        ba.CopyOverlaps(overlaps);
         ba.CreateBufferGraph(div);
-        if(gMsgUI.IsVerbose()) ba.GenerateBufferGraphFile();
+        if(gMsgUI.IsVerbose()) ba.GenerateBufferGraphFile(index + 1);
         
-        ret = ba.AssignBanks() && cio.Optimize(div) && ret;
-    }
+        bool assigned = ba.AssignBanks() && (args.Starts <= 0 || ba.RefineAssignment(args.Starts, args.Threads));
+        if(assigned) costs[index] = ba.GetConflictCost();
+        Ladybirds::opt::CacheIndexOpt cio(args.ClusterInfo, cacheinfo);
+        return assigned && cio.Optimize(div);
+    });
+    for(double cost : costs) rets.ConflictCost += cost;
     return ret;
 }
 
@@ -0,0 +1,177 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include "lua/pass.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+#include "tools.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::impl::TaskGroup;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct AutoGroupArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Groups = 0; ///< Target number of groups
+    double Imbalance = 0.1; ///< How much the cost of a group may exceed the average while merging along dependencies
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("groups", Groups) & ls.IO("imbalance", Imbalance, false, 0.1);
+    }
+};
+
+bool AutoGroup(Program &prog, AutoGroupArgs &args);
+
+/** Pass AutoGroup: Merges all tasks that are not yet in a group into (at most) the given number of groups.
+ *  Like in the coarsening phase of multilevel graph partitioning, dependencies are contracted in the order of
+ *  decreasing data size (Dependency::GetMemSize), as long as the cost (Task::Cost, cf. LoadCost) of the merged group
+ *  does not exceed the average group cost by more than the given imbalance. If more groups are left than requested,
+ *  the cheapest group is repeatedly merged with the group it exchanges most data with. Without any task costs, all
+ *  tasks count as equally expensive. Run PopulateGroups afterwards to create the division, ports and channels. **/
+Ladybirds::lua::PassWithArgs<AutoGroupArgs> AutoGroupPass("AutoGroup", &AutoGroup);
+
+
+/// \internal Disjoint sets of tasks with their accumulated cost
+class Clustering
+{
+    std::vector<int> Parents_;
+    std::vector<double> Costs_;
+    int NumClusters_;
+
+public:
+    explicit Clustering(std::vector<double> costs)
+        : Parents_(costs.size()), Costs_(std::move(costs)), NumClusters_(Costs_.size())
+    {
+        std::iota(Parents_.begin(), Parents_.end(), 0);
+    }
+
+    int Find(int i)
+    {
+        while(Parents_[i] != i) i = Parents_[i] = Parents_[Parents_[i]];
+        return i;
+    }
+    /// Merges the clusters with representatives \p i and \p j
+    void Merge(int i, int j)
+    {
+        if(Costs_[i] < Costs_[j]) std::swap(i, j);
+        Parents_[j] = i;
+        Costs_[i] += Costs_[j];
+        --NumClusters_;
+    }
+    inline double GetCost(int i) const { return Costs_[i]; }
+    inline int GetNumClusters() const { return NumClusters_; }
+    inline bool IsRoot(int i) const { return Parents_[i] == i; }
+};
+
+/// \internal A dependency between two tasks to be grouped, by their indices
+struct Edge
+{
+    int From, To;
+    long Size;
+};
+
+
+bool AutoGroup(Program &prog, AutoGroupArgs &args)
+{
+    if(args.Groups <= 0)
+    {
+        gMsgUI.Error("AutoGroup needs a positive number of groups.");
+        return false;
+    }
+
+    std::vector<Task*> tasks;
+    std::unordered_map<const Task*, int> indices;
+    std::vector<double> costs;
+    for(auto &t : prog.GetTasks()) if(!t.Group) tasks.push_back(&t);
+    if(tasks.empty()) return true;
+    // as in LoadMapping, order by IDs, which are ultimately determined by the source code
+    std::sort(tasks.begin(), tasks.end(), [](Task * pt1, Task * pt2) { return pt1->GetID() < pt2->GetID();});
+    for(auto *pt : tasks)
+    {
+        indices[pt] = costs.size();
+        costs.push_back(pt->Cost);
+    }
+
+    if(std::all_of(costs.begin(), costs.end(), [](double c) { return c == 0; }))
+    {
+        gMsgUI.Verbose("AutoGroup: No task costs given, assuming equal costs for all tasks");
+        costs.assign(costs.size(), 1);
+    }
+    double maxcost = *std::max_element(costs.begin(), costs.end());
+    double limit = std::max(maxcost, std::accumulate(costs.begin(), costs.end(), 0.0)/args.Groups*(1+args.Imbalance));
+
+    std::vector<Edge> edges;
+    for(auto &dep : prog.Dependencies)
+    {
+        auto itfrom = indices.find(dep.From.TheIface->GetTask()), itto = indices.find(dep.To.TheIface->GetTask());
+        if(itfrom == indices.end() || itto == indices.end() || itfrom->second == itto->second) continue;
+        edges.push_back(Edge{itfrom->second, itto->second, dep.GetMemSize()});
+    }
+    std::stable_sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.Size > b.Size; });
+
+    // Contract the heaviest dependencies first, keeping the groups balanced
+    Clustering clusters(std::move(costs));
+    for(auto &e : edges)
+    {
+        if(clusters.GetNumClusters() <= args.Groups) break;
+        int a = clusters.Find(e.From), b = clusters.Find(e.To);
+        if(a != b && clusters.GetCost(a) + clusters.GetCost(b) <= limit) clusters.Merge(a, b);
+    }
+
+    // Merge the cheapest remaining groups until the target is reached
+    int ntasks = tasks.size();
+    std::vector<long> volume(ntasks);
+    while(clusters.GetNumClusters() > args.Groups)
+    {
+        int cheapest = -1, second = -1;
+        for(int i = 0; i < ntasks; ++i)
+        {
+            if(!clusters.IsRoot(i)) continue;
+            if(cheapest < 0 || clusters.GetCost(i) < clusters.GetCost(cheapest)) second = cheapest, cheapest = i;
+            else if(second < 0 || clusters.GetCost(i) < clusters.GetCost(second)) second = i;
+        }
+
+        volume.assign(ntasks, 0);
+        for(auto &e : edges)
+        {
+            int a = clusters.Find(e.From), b = clusters.Find(e.To);
+            if(a == cheapest && b != cheapest) volume[b] += e.Size;
+            else if(b == cheapest && a != cheapest) volume[a] += e.Size;
+        }
+        int partner = std::max_element(volume.begin(), volume.end()) - volume.begin();
+        clusters.Merge(cheapest, volume[partner] > 0 ? partner : second);
+    }
+
+    // Create the groups, ordered by their first task
+    int id = prog.Groups.size();
+    std::unordered_map<int, TaskGroup*> groups;
+    for(int i = 0; i < ntasks; ++i)
+    {
+        auto &pgroup = groups[clusters.Find(i)];
+        if(!pgroup)
+        {
+            prog.Groups.push_back(std::make_unique<TaskGroup>(id, strprintf("group%d", id)));
+            pgroup = prog.Groups.back().get();
+            ++id;
+        }
+        tasks[i]->Group = pgroup;
+        pgroup->AddTask(tasks[i]);
+    }
+
+    gMsgUI.Verbose("AutoGroup: Merged %d tasks into %d groups", ntasks, (int) groups.size());
+    return true;
+}
+
+} //namespace ::
@@ -0,0 +1,281 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lua/luaenv.h"
+#include "lua/luaload.h"
+#include "lua/pass.h"
+#include "dependency.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+#include "tools.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::impl::TaskGroup;
+using Ladybirds::lua::Pass;
+
+namespace {
+
+/// A hardware thread of the host, with the ids of the resources it shares with others
+struct CpuEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Cpu = -1;    ///< Number of the CPU, as used for the affinity masks
+    int Socket = 0;  ///< Package (and typically NUMA node)
+    int L2 = -1;     ///< Identifier of the L2 cache, -1 if the CPU does not share it with other cores
+    int Core = -1;   ///< Identifier of the physical core within the socket, shared by SMT siblings (-1: unique)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("cpu", Cpu) & ls.IO("socket", Socket, false, 0)
+             & ls.IO("l2", L2, false, -1) & ls.IO("core", Core, false, -1);
+    }
+};
+
+struct BindArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Topology; ///< Lua file with a table cpus of CpuEntry, if empty the topology is read from /sys
+    double SmtPenalty = 1; ///< Weight of running heavy groups on the same physical core vs. their communication
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("topology", Topology, false) & ls.IO("smtpenalty", SmtPenalty, false, 1.0);
+    }
+};
+
+struct BindingEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Group;
+    int Cpu = 0;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("group", Group) & ls.IO("cpu", Cpu);
+    }
+};
+
+struct BindRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<BindingEntry> Bindings;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("bindings", Bindings);
+    }
+};
+
+bool BindGroups(Program &prog, BindArgs &args, BindRets &rets);
+
+/** Pass BindGroups: Binds the groups to the hardware threads of a host, such that groups exchanging much data
+ *  (Dependency::GetMemSize) share an L2 cache or at least a socket, while groups with much work (Task::Cost, or the
+ *  number of tasks) avoid sharing a physical core through SMT. The topology is either given as a Lua file defining a
+ *  table cpus, with the fields cpu, socket, l2 and core for each hardware thread, or read from /sys on Linux.
+ *  Groups are placed greedily, every hardware thread gets a group before any gets a second one. If the program has
+ *  several divisions, each division is kept on one socket (the sockets are assigned round-robin in the order of the
+ *  divisions), such that its threads share a NUMA node. Returns a table with
+ *  the field bindings, which lists group and cpu for every group. If no topology is available, the list is empty. **/
+Ladybirds::lua::PassWithArgsAndRet<BindArgs, BindRets>
+    BindGroupsPass("BindGroups", &BindGroups, Pass::Requires{"PopulateGroups"});
+
+
+/// \internal Parses a Linux CPU list such as "0-3,8,10-11"
+std::vector<int> ParseCpuList(const std::string &list)
+{
+    std::vector<int> ret;
+    std::istringstream strm(list);
+    std::string range;
+    while(std::getline(strm, range, ','))
+    {
+        int first, last;
+        char dash;
+        std::istringstream rstrm(range);
+        if(!(rstrm >> first)) continue;
+        if(!(rstrm >> dash >> last)) last = first;
+        for(int cpu = first; cpu <= last; ++cpu) ret.push_back(cpu);
+    }
+    return ret;
+}
+
+/// \internal Reads an integer from the file \p path, or returns \p fallback if that fails
+int ReadSysInt(const std::string &path, int fallback)
+{
+    std::ifstream strm(path);
+    int val;
+    return (strm >> val) ? val : fallback;
+}
+
+/// \internal Reads the topology of the online CPUs of this host from /sys
+bool ReadHostTopology(std::vector<CpuEntry> &cpus)
+{
+    std::ifstream strm("/sys/devices/system/cpu/online");
+    std::string online;
+    if(!std::getline(strm, online)) return false;
+
+    for(int cpu : ParseCpuList(online))
+    {
+        std::string base = strprintf("/sys/devices/system/cpu/cpu%d/", cpu);
+        cpus.emplace_back();
+        auto &entry = cpus.back();
+        entry.Cpu = cpu;
+        entry.Socket = ReadSysInt(base + "topology/physical_package_id", 0);
+        entry.Core = ReadSysInt(base + "topology/core_id", -1);
+        for(int index = 0; ; ++index)
+        {   // the L2 cache is identified by the first CPU sharing it
+            std::string cache = base + strprintf("cache/index%d/", index);
+            int level = ReadSysInt(cache + "level", -1);
+            if(level < 0) break;
+            if(level != 2) continue;
+            std::ifstream sstrm(cache + "shared_cpu_list");
+            std::string shared;
+            if(std::getline(sstrm, shared))
+            {
+                auto sharing = ParseCpuList(shared);
+                if(!sharing.empty()) entry.L2 = sharing.front();
+            }
+            break;
+        }
+    }
+    return !cpus.empty();
+}
+
+/// \internal Loads the topology from the Lua file \p filename
+bool LoadTopology(const std::string &filename, std::vector<CpuEntry> &cpus)
+{
+    Ladybirds::lua::LuaEnv lua;
+    if(!lua.DoFile(filename.c_str())) return false;
+    Ladybirds::lua::LuaLoad load(lua);
+    lua_pushglobaltable(lua);
+    return load.IO("cpus", cpus);
+}
+
+/// \internal Relative cost of communication between two hardware threads
+double Distance(const CpuEntry &a, const CpuEntry &b)
+{
+    if(a.Socket != b.Socket) return 4;
+    if(a.Cpu == b.Cpu || (a.Core >= 0 && a.Core == b.Core)) return 0;
+    if(a.L2 >= 0 && a.L2 == b.L2) return 1;
+    return 2;
+}
+
+/// \internal Checks if two hardware threads belong to the same physical core
+inline bool SameCore(const CpuEntry &a, const CpuEntry &b)
+{
+    return a.Cpu == b.Cpu || (a.Socket == b.Socket && a.Core >= 0 && a.Core == b.Core);
+}
+
+bool BindGroups(Program &prog, BindArgs &args, BindRets &rets)
+{
+    rets.Bindings.clear();
+    std::vector<CpuEntry> cpus;
+    if(!args.Topology.empty())
+    {
+        if(!LoadTopology(args.Topology, cpus)) return false;
+    }
+    else if(!ReadHostTopology(cpus))
+    {
+        gMsgUI.Warning("BindGroups: Cannot read the host topology, please specify a topology file.");
+        return true;
+    }
+    if(cpus.empty()) return true;
+
+    int ngroups = prog.Groups.size();
+    std::unordered_map<const TaskGroup*, int> indices;
+    for(int i = 0; i < ngroups; ++i) indices[prog.Groups[i].get()] = i;
+
+    // with several divisions, the groups of each division may only use the hardware threads of its socket
+    std::vector<int> sockets, groupsockets(ngroups, -1);
+    for(auto &cpu : cpus) sockets.push_back(cpu.Socket);
+    std::sort(sockets.begin(), sockets.end());
+    sockets.erase(std::unique(sockets.begin(), sockets.end()), sockets.end());
+    if(prog.Divisions.size() > 1)
+    {
+        for(int g = 0; g < ngroups; ++g)
+        {
+            auto *pdiv = prog.Groups[g]->GetDivision();
+            if(pdiv) groupsockets[g] = sockets[(pdiv - prog.Divisions.data()) % sockets.size()];
+        }
+    }
+    auto allowed = [&](int g, int c) { return groupsockets[g] < 0 || cpus[c].Socket == groupsockets[g]; };
+
+    // loads and communication volumes of the groups
+    std::vector<double> loads(ngroups, 0), counts(ngroups, 0);
+    for(auto &t : prog.GetTasks())
+    {
+        auto it = indices.find(t.Group);
+        if(it == indices.end()) continue;
+        loads[it->second] += t.Cost;
+        counts[it->second] += 1;
+    }
+    if(std::all_of(loads.begin(), loads.end(), [](double l) { return l == 0; })) loads = counts;
+
+    std::vector<std::vector<double>> volumes(ngroups, std::vector<double>(ngroups, 0));
+    for(auto &dep : prog.Dependencies)
+    {
+        auto itfrom = indices.find(dep.From.TheIface->GetTask()->Group);
+        auto itto = indices.find(dep.To.TheIface->GetTask()->Group);
+        if(itfrom == indices.end() || itto == indices.end() || itfrom->second == itto->second) continue;
+        volumes[itfrom->second][itto->second] += dep.GetMemSize();
+        volumes[itto->second][itfrom->second] += dep.GetMemSize();
+    }
+    double maxload = std::max(1e-9, *std::max_element(loads.begin(), loads.end()));
+    double maxvolume = 1e-9;
+    for(auto &row : volumes) for(double v : row) maxvolume = std::max(maxvolume, v);
+
+    // Place the group communicating most with the placed ones next (the heaviest group first)
+    std::vector<int> placement(ngroups, -1), usage(cpus.size(), 0);
+    std::vector<double> attraction(ngroups, 0);
+    for(int nplaced = 0; nplaced < ngroups; ++nplaced)
+    {
+        int next = -1;
+        for(int g = 0; g < ngroups; ++g)
+        {
+            if(placement[g] >= 0) continue;
+            if(next < 0 || attraction[g] > attraction[next]
+               || (attraction[g] == attraction[next] && loads[g] > loads[next])) next = g;
+        }
+
+        int minusage = -1;
+        for(int c = 0, ncpus = cpus.size(); c < ncpus; ++c)
+        {
+            if(allowed(next, c) && (minusage < 0 || usage[c] < minusage)) minusage = usage[c];
+        }
+        int best = -1;
+        double bestcost = 0;
+        for(int c = 0, ncpus = cpus.size(); c < ncpus; ++c)
+        {
+            if(usage[c] != minusage || !allowed(next, c)) continue;
+            double cost = 0;
+            for(int h = 0; h < ngroups; ++h)
+            {
+                if(placement[h] < 0) continue;
+                auto &other = cpus[placement[h]];
+                cost += volumes[next][h]/maxvolume * Distance(cpus[c], other);
+                if(SameCore(cpus[c], other)) cost += args.SmtPenalty * loads[next]*loads[h] / (maxload*maxload);
+            }
+            if(best < 0 || cost < bestcost) best = c, bestcost = cost;
+        }
+
+        placement[next] = best;
+        ++usage[best];
+        for(int g = 0; g < ngroups; ++g) attraction[g] += volumes[next][g];
+    }
+
+    for(int g = 0; g < ngroups; ++g)
+    {
+        rets.Bindings.emplace_back();
+        rets.Bindings.back().Group = prog.Groups[g]->GetName();
+        rets.Bindings.back().Cpu = cpus[placement[g]].Cpu;
+        gMsgUI.Verbose("BindGroups: %s -> CPU %d", prog.Groups[g]->GetName().c_str(), cpus[placement[g]].Cpu);
+    }
+    return true;
+}
+
+} //namespace ::
@@ -1,14 +1,21 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <algorithm>
+#include <climits>
+#include <iterator>
 #include <numeric>
+#include <set>
 #include <unordered_map>
 #include <vector>
 
 #include "gen/multicritcmp.h"
+#include "graph/degeneracy.h"
 #include "graph/graph.h"
+#include "graph/graph-extra.h"
 #include "graph/itemset.h"
 #include "lua/pass.h"
 #include "msgui.h"
+#include "packet.h"
 #include "program.h"
 #include "task.h"
 #include "taskgroup.h"
@@ -16,6 +23,8 @@
 
 using Ladybirds::impl::Buffer;
 using Ladybirds::graph::ItemSet;
+using Ladybirds::spec::Iface;
+using Ladybirds::spec::Packet;
 using Ladybirds::spec::Task;
 using Ladybirds::spec::TaskGraph;
 using Ladybirds::impl::TaskDivision;
@@ -25,9 +34,21 @@ using Ladybirds::lua::Pass;
 
 namespace {
 bool BufferAllocation(Program & prog);
+/// BufferAllocation: Merges buffers with disjoint lifetimes into one. An input buffer whose last use is a task with an
+/// output packet declared as its buddy is preferably merged with that output, i.e. overwritten in place.
 Pass BufferAllocationPass("BufferAllocation", &BufferAllocation,
                            Pass::Requires{"BufferPreallocation", "CalcSuccessorMatrix", "PopulateGroups"});
 
+bool BufferPacking(Program & prog);
+/// BufferPacking: Alternative to BufferAllocation. Instead of merging buffers with disjoint lifetimes, keeps all
+/// buffers and assigns them offsets (BankOffset) within one memory arena per division, such that buffers with
+/// overlapping lifetimes do not overlap in memory. Offsets respect the alignment of each buffer (cf. AlignBuffers).
+/// The arena size is reported together with the size BufferAllocation would need.
+Pass BufferPackingPass("BufferPacking", &BufferPacking,
+                       Pass::Requires{"BufferPreallocation", "CalcSuccessorMatrix", "PopulateGroups"});
+
+constexpr int PackingAlignment = 8; ///< Minimum alignment of buffers within the arena (as in the generated definitions)
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Class definitions for Buffer graph
@@ -44,6 +65,7 @@ public:
     Buffer * pFinalBuffer = nullptr;
     ItemSet Accesses;
     std::vector<const Task*> LastAccesses;
+    BufferNode * pAlias = nullptr; ///< Buffer that may share memory with this one (cf. FindInPlaceAliases)
     
 public:
     BufferNode(const Buffer * pbuffer, const TaskGraph & tg)
@@ -97,7 +119,7 @@ void FillLastAccesses(BufferGraph & g,  const std::vector<Task*> &tasks, const T
     auto lastaccesses = taskgraph.GetNodeSet();
     
     auto succCounts = taskgraph.GetNodeMap(size_t());
-    for(auto & t : taskgraph.Nodes()) succCounts[t] = reachmap[t].ElementCount();
+    for(auto & t : taskgraph.Nodes()) succCounts[t] = reachmap.SuccessorCount(&t);
     
     for(auto & trn : g.Nodes())
     {
@@ -120,7 +142,7 @@ void FillLastAccesses(BufferGraph & g,  const std::vector<Task*> &tasks, const T
         
         for(; it != accesses.end(); ++it)
         {
-            if(!reachmap[*it].Intersects(lastaccesses))
+            if(!reachmap.ReachesAny(*it, lastaccesses))
             {
                 lastaccesses.Insert(*it);
                 trn.LastAccesses.push_back(*it);
@@ -129,11 +151,69 @@ void FillLastAccesses(BufferGraph & g,  const std::vector<Task*> &tasks, const T
     }
 }
 
+/// \internal Checks if \p iface covers its whole buffer, such that the buffer starts with the packet
+bool CoversBuffer(const Iface & iface)
+{
+    return iface.GetBufferOffset() == 0 && iface.GetBufferDims() == iface.GetDimensions();
+}
+
+/// Pairs input buffers that are last used by a task with an output buffer of the same task that may overwrite them.
+/** The kernel must declare the output packet a buddy of the input packet (cf. Packet::GetBuddies), i.e. it must be
+ *  written correctly even if it shares its memory with the input. Both packets must take up their whole buffers, all
+ *  other accesses to the input buffer must come before the task, and all other accesses to the output buffer after
+ *  it. Each buffer is paired at most once. Returns the number of pairs. **/
+int FindInPlaceAliases(BufferGraph & g, TaskDivision & div, const Program::ReachabilityMap & reachmap)
+{
+    Ladybirds::graph::ItemMap<BufferNode*> buffermap(div.Buffers, nullptr);
+    for(auto & n : g.Nodes()) buffermap[n.pBuffer] = &n;
+    
+    auto usedonce = [](const Task * ptask, const Buffer * ptr)
+    {
+        return std::count_if(ptask->Ifaces.begin(), ptask->Ifaces.end(),
+                             [ptr](const Iface & iface){ return iface.GetBuffer() == ptr; }) == 1;
+    };
+    
+    int npairs = 0;
+    for(auto *ptask : div.GetTasks())
+    {
+        for(auto & outiface : ptask->Ifaces)
+        {
+            if(outiface.GetPacket()->GetAccessType() != Packet::out || !CoversBuffer(outiface)) continue;
+            auto *pout = buffermap[outiface.GetBuffer()];
+            if(!pout || pout->pAlias || !usedonce(ptask, pout->pBuffer)) continue;
+            
+            auto laterall = [&](BufferNode & n)
+            {
+                return std::all_of(div.GetTasks().begin(), div.GetTasks().end(), [&](const Task * pt)
+                    { return pt == ptask || !n.Accesses.Contains(pt) || reachmap.Reaches(ptask, pt); });
+            };
+            if(!laterall(*pout)) continue;
+            
+            for(auto *pbuddy : outiface.GetBuddies())
+            {
+                if(pbuddy->GetPacket()->GetAccessType() != Packet::in || !CoversBuffer(*pbuddy)) continue;
+                auto *pin = buffermap[pbuddy->GetBuffer()];
+                if(!pin || pin == pout || pin->pAlias || !usedonce(ptask, pin->pBuffer)) continue;
+                if(pin->LastAccesses.size() != 1 || pin->LastAccesses[0] != ptask) continue;
+                
+                pin->pAlias = pout;
+                pout->pAlias = pin;
+                ++npairs;
+                break;
+            }
+        }
+    }
+    return npairs;
+}
+
+/// \internal Checks if an edge between \p tn1 and \p tn2 is needed, i.e. they are not allowed to share memory
+inline bool NeedsEdge(BufferNode & tn1, BufferNode & tn2) { return tn1.pAlias != &tn2; }
+
 bool AllBefore(BufferNode & tn1, BufferNode & tn2, const Program::ReachabilityMap & reachmap)
 {
     for(const Task * pt : tn1.LastAccesses)
     {
-        if(!reachmap[pt].Contains(tn2.Accesses)) return false;
+        if(!reachmap.ReachesAll(pt, tn2.Accesses)) return false;
     }
     return true;
 }
@@ -149,23 +229,92 @@ bool HasConflicts(BufferNode & tn1, BufferNode & tn2,
 }
 
 
-void AddBufferGraphEdges(BufferGraph & g, const TaskGraph & taskgraph, const Program::ReachabilityMap & reachmap)
+/// Adds conflict edges by checking every pair of buffers (used if the task graph has no topological order)
+void AddBufferGraphEdgesPairwise(BufferGraph & g, const TaskGraph & taskgraph,
+                                 const Program::ReachabilityMap & reachmap)
 {
     for(auto it1 = g.NodesBegin(), itend = g.NodesEnd(); it1 != itend; ++it1)
     {
         for(auto it2 = it1; ++it2 != itend; )
         {
-            if(HasConflicts(*it1, *it2, taskgraph, reachmap)) g.EmplaceEdge(&*it1, &*it2);
+            if(NeedsEdge(*it1, *it2) && HasConflicts(*it1, *it2, taskgraph, reachmap)) g.EmplaceEdge(&*it1, &*it2);
         }
     }
 }
 
 
-bool BuildBufferGraph(Program &prog, TaskDivision &div, BufferGraph &g)
+/// Adds conflict edges by sweeping over the use intervals of the buffers along a topological order of the tasks.
+/** Since a task can only reach tasks that come later in the order, buffers whose intervals (from the first to the
+ *  last access) overlap always conflict. Only the pairs with disjoint intervals need the exact check, and only in one
+ *  direction (cf. AllBefore). Returns false if the task graph has no topological order. **/
+bool AddBufferGraphEdgesSweep(BufferGraph & g, TaskDivision & div, const TaskGraph & taskgraph,
+                              const Program::ReachabilityMap & reachmap)
+{
+    auto & topo = Ladybirds::graph::cached::TopologicalOrder(taskgraph);
+    if(!topo.IsComplete) return false;
+    auto positions = taskgraph.GetNodeMap(0);
+    for(int i = 0, n = topo.Order.size(); i < n; ++i) positions[topo.Order[i]] = i;
+    
+    struct UseInterval
+    {
+        BufferNode * pNode;
+        int First = INT_MAX, Last = -1;
+    };
+    std::vector<UseInterval> intervals;
+    intervals.reserve(g.Nodes().size());
+    Ladybirds::graph::ItemMap<int> indices(div.Buffers, -1);
+    for(auto & n : g.Nodes())
+    {
+        indices[n.pBuffer] = intervals.size();
+        intervals.push_back(UseInterval{&n});
+    }
+    for(auto *ptask : div.GetTasks())
+    {
+        int pos = positions[ptask];
+        for(auto &iface : ptask->Ifaces)
+        {
+            auto *ptr = iface.GetBuffer();
+            if(ptr->pExternalSource) continue;
+            auto & interval = intervals[indices[ptr]];
+            interval.First = std::min(interval.First, pos);
+            interval.Last = std::max(interval.Last, pos);
+        }
+    }
+    std::stable_sort(intervals.begin(), intervals.end(),
+                     [](const UseInterval & i1, const UseInterval & i2) { return i1.First < i2.First; });
+    
+    std::vector<UseInterval*> active, finished; // buffers that started earlier and are still in use / not any more
+    for(auto & cur : intervals)
+    {
+        auto itend = std::partition(active.begin(), active.end(),
+                                    [&cur](UseInterval * pi) { return pi->Last >= cur.First; });
+        finished.insert(finished.end(), itend, active.end());
+        active.erase(itend, active.end());
+        
+        for(auto * pi : active) if(NeedsEdge(*pi->pNode, *cur.pNode)) g.EmplaceEdge(pi->pNode, cur.pNode);
+        for(auto * pi : finished)
+        {
+            if(!AllBefore(*pi->pNode, *cur.pNode, reachmap)) g.EmplaceEdge(pi->pNode, cur.pNode);
+        }
+        active.push_back(&cur);
+    }
+    return true;
+}
+
+
+/// Builds the conflict graph of the buffers in \p div. If \p inplace is set, buffers that may be overwritten in place
+/// by a task's output (cf. FindInPlaceAliases) do not conflict with that output.
+bool BuildBufferGraph(Program &prog, TaskDivision &div, BufferGraph &g, bool inplace)
 {
     if(!AddBufferGraphNodes(g, div, prog.TaskGraph)) return false;
     FillLastAccesses(g, div.GetTasks(), prog.TaskGraph, prog.TaskReachability);
-    AddBufferGraphEdges(g, prog.TaskGraph, prog.TaskReachability);
+    if(inplace)
+    {
+        int npairs = FindInPlaceAliases(g, div, prog.TaskReachability);
+        if(npairs > 0) gMsgUI.Verbose("%d input buffers may be overwritten in place by outputs", npairs);
+    }
+    if(!AddBufferGraphEdgesSweep(g, div, prog.TaskGraph, prog.TaskReachability))
+        AddBufferGraphEdgesPairwise(g, prog.TaskGraph, prog.TaskReachability);
     return true;
 }
 
@@ -173,38 +322,25 @@ bool BuildBufferGraph(Program &prog, TaskDivision &div, BufferGraph &g)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // buffer allocation functionality for one division
 //
-bool AllocateBuffers(Program & prog, TaskDivision & div)
+
+/// Merges the buffers of graph \p g by coloring, storing the merged buffers in \p newbuffers and the buffer for each
+/// node in its pFinalBuffer member
+void ColorBuffers(BufferGraph & g, /*out*/ Program::BufferList & newbuffers)
 {
-    BufferGraph g;
-    if(!BuildBufferGraph(prog, div, g)) return false;
-    
     // First step: Determine order in which the nodes are to be colored.
     // Approach here: Determine node with smallest degree. Put it at the end of the list and remove it
     // from the graph. Then determine the next node with the smallest degree in the graph and put it one position 
     // before the end of the list, remove it from the graph and so on.
-    std::vector<BufferNode*> order; order.reserve(g.Nodes().size());
-    auto edgecounts = g.GetNodeMap(int());
-    for(auto & n : g.Nodes())
-    {
-        order.push_back(&n);
-        edgecounts[n] = n.EdgeCount();
-    }
-    
-    for(auto it = order.rbegin(), itend = order.rend(); it != itend; ++it )
-    {
-        std::partial_sort(it, it+1, itend,
-                          [&edgecounts](auto pn1, auto pn2){return edgecounts[pn1] < edgecounts[pn2];});
-        
-        for(auto & e : (*it)->InEdges())  --edgecounts[e.GetSource()];
-        for(auto & e : (*it)->OutEdges()) --edgecounts[e.GetTarget()];
-    }
+    std::vector<BufferNode*> nodes; nodes.reserve(g.Nodes().size());
+    for(auto & n : g.Nodes()) nodes.push_back(&n); // in the order of the node indices of the CSR snapshot
+    std::vector<BufferNode*> order; order.reserve(nodes.size());
+    for(auto i : Ladybirds::graph::SmallestLastOrder(g.Freeze())) order.push_back(nodes[i]);
 
 
     // Second step: Go through the list of nodes (beginning with the last one, i.e. "most" neighbors) and assign each
     // one a color (i.e. one of the final, "merged" buffers, which are to be allocated in the end).
     // If no such buffer exists that would fit, create a new one.
-    Program::BufferList newbuffers;
-    std::deque<std::deque<int>> bufferaccesses;
+    std::deque<std::set<long>> bufferaccesses; // IDs of the last accesses to each color
     for(auto * pn : order)
     {
         // Which colors are valid, i.e. not taken by a neighbor node?
@@ -216,44 +352,65 @@ bool AllocateBuffers(Program & prog, TaskDivision & div)
         auto refsize = pn->pBuffer->Size;
         auto refid = pn->LastAccesses[0]->GetID();
         auto proximity = [refid, &bufferaccesses](Buffer & tr)
-        {
-            return std::min_element(bufferaccesses[tr.GetID()-1].begin(), bufferaccesses[tr.GetID()-1].end(), 
-                [refid](int i1, int i2){ return std::abs(i1-refid) < std::abs(i2-refid); });
+        {   // distance to the closest access, looked up in the sorted set of accesses
+            auto & accesses = bufferaccesses[tr.GetID()-1];
+            auto it = accesses.lower_bound(refid);
+            long ret = LONG_MAX;
+            if(it != accesses.end()) ret = *it - refid;
+            if(it != accesses.begin()) ret = std::min(ret, refid - *std::prev(it));
+            return ret;
         };
         auto nodecmp = Ladybirds::gen::MultiCritCmp(
             [refsize](Buffer & t1, Buffer & t2)
                 {return std::abs(t1.Size-refsize) - std::abs(t2.Size-refsize);},
             [refid, proximity](Buffer & t1, Buffer & t2)
-                {return proximity(t1) < proximity(t2);});
+                {return (proximity(t1) > proximity(t2)) - (proximity(t1) < proximity(t2));});
                 //as a minor criterium: assign larger buffers first to avoid "dead end" situations later on
-        auto itselect = Ladybirds::gen::MinElementIf(newbuffers.begin(), newbuffers.end(),
-                                                [&valid](auto & tr) { return valid.Contains(tr); }, nodecmp);
+        //only visit the valid colors instead of testing every color for validity
+        Buffer * pselect = nullptr;
+        if(pn->pAlias && pn->pAlias->pFinalBuffer && valid.Contains(pn->pAlias->pFinalBuffer))
+        {   // reuse the buffer in place
+            pselect = pn->pAlias->pFinalBuffer;
+        }
+        else
+        {
+            for(auto & tr : valid.Elements(newbuffers)) if(!pselect || nodecmp(tr, *pselect)) pselect = &tr;
+        }
 
-        if(itselect == newbuffers.end())
+        if(!pselect)
         {
             pn->pFinalBuffer = &*newbuffers.emplace(*pn->pBuffer); //use this buffer as a template for the new one
             bufferaccesses.emplace_back();
         }
         else
         {
-            pn->pFinalBuffer = &*itselect;
-            if(pn->pBuffer->Size > itselect->Size) itselect->Size = pn->pBuffer->Size;
+            pn->pFinalBuffer = pselect;
+            if(pn->pBuffer->Size > pselect->Size) pselect->Size = pn->pBuffer->Size;
+            if(pn->pBuffer->Alignment > pselect->Alignment) pselect->Alignment = pn->pBuffer->Alignment;
+            if(pselect->Alignment > 0)
+                pselect->Size = (pselect->Size + pselect->Alignment-1) / pselect->Alignment * pselect->Alignment;
         }
-        bufferaccesses[pn->pFinalBuffer->GetID()-1].push_back(refid);
+        bufferaccesses[pn->pFinalBuffer->GetID()-1].insert(refid);
     }
+}
+
+size_t TotalBytes(Program::BufferList & tl)
+{
+    return std::accumulate(tl.begin(), tl.end(), size_t(0),
+                           [](auto s, auto & t){return t.pExternalSource ? s :  s+t.Size;});
+}
+
+bool AllocateBuffers(Program & prog, TaskDivision & div)
+{
+    BufferGraph g;
+    if(!BuildBufferGraph(prog, div, g, true)) return false;
     
-    auto bufferstats = [](Program::BufferList & tl)
-    {
-        auto totalbytes = std::accumulate(tl.begin(), tl.end(), size_t(0),
-                                          [](auto s, auto & t){return t.pExternalSource ? s :  s+t.Size;});
-        std::cout << tl.size() << " Buffers, in total " << totalbytes << " bytes";
-    };
+    Program::BufferList newbuffers;
+    ColorBuffers(g, newbuffers);
     
-    std::cout << "Buffer merging statistics:\n\tbefore:";
-    bufferstats(div.Buffers);
-    std::cout << "\n\tafter:";
-    bufferstats(newbuffers);
-    std::cout << std::endl;
+    gMsgUI.Info("Buffer merging statistics:\n\tbefore: %zu Buffers, in total %zu bytes\n\tafter: %zu Buffers, in total "
+                "%zu bytes", size_t(div.Buffers.size()), TotalBytes(div.Buffers), size_t(newbuffers.size()),
+                TotalBytes(newbuffers));
     
     Ladybirds::graph::ItemMap<Buffer*> old2new(div.Buffers);
     for(auto & n : g.Nodes()) old2new[n.pBuffer] = n.pFinalBuffer;
@@ -271,6 +428,66 @@ bool AllocateBuffers(Program & prog, TaskDivision & div)
 }
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// buffer packing functionality for one division
+//
+bool PackBuffers(Program & prog, TaskDivision & div)
+{
+    BufferGraph g;
+    if(!BuildBufferGraph(prog, div, g, false)) return false; // packing places aliases anywhere, so keep them apart
+    
+    // Best-fit decreasing: Place the largest buffers first, each one in the smallest gap between the conflicting
+    // buffers placed so far that can hold it (or on top of all of them)
+    std::vector<BufferNode*> order; order.reserve(g.Nodes().size());
+    for(auto & n : g.Nodes()) order.push_back(&n);
+    std::stable_sort(order.begin(), order.end(),
+                     [](auto pn1, auto pn2){ return pn1->pBuffer->Size > pn2->pBuffer->Size; });
+    
+    auto offsets = g.GetNodeMap(-1);
+    std::vector<std::pair<int, int>> occupied; // ranges [begin, end) of conflicting buffers that are already placed
+    int arenasize = 0;
+    for(auto * pn : order)
+    {
+        occupied.clear();
+        auto addrange = [&](BufferNode * ptn)
+            { if(offsets[ptn] >= 0) occupied.emplace_back(offsets[ptn], offsets[ptn] + ptn->pBuffer->Size); };
+        for(auto & e : pn->OutEdges()) addrange(e.GetTarget());
+        for(auto & e : pn->InEdges()) addrange(e.GetSource());
+        std::sort(occupied.begin(), occupied.end());
+        
+        int size = pn->pBuffer->Size, bestoffset = -1, bestgap = 0, pos = 0;
+        int alignment = std::max(PackingAlignment, pn->pBuffer->Alignment);
+        auto alignup = [alignment](int offset) { return (offset + alignment-1) / alignment * alignment; };
+        for(auto & range : occupied)
+        {
+            int start = alignup(pos), gap = range.first - start;
+            if(gap >= size && (bestoffset < 0 || gap < bestgap)) bestoffset = start, bestgap = gap;
+            pos = std::max(pos, range.second);
+        }
+        if(bestoffset < 0) bestoffset = alignup(pos);
+        
+        offsets[pn] = bestoffset;
+        arenasize = std::max(arenasize, bestoffset + size);
+    }
+    
+    // Compare to the coloring of BufferAllocation
+    Program::BufferList colored;
+    ColorBuffers(g, colored);
+    gMsgUI.Info("Buffer packing statistics:\n\tcoloring: %zu Buffers, in total %zu bytes\n\tpacking: %zu Buffers in an "
+                "arena of %d bytes", size_t(colored.size()), TotalBytes(colored), size_t(g.Nodes().size()), arenasize);
+    
+    Ladybirds::graph::ItemMap<int> bufferoffsets(div.Buffers, -1);
+    for(auto & n : g.Nodes()) bufferoffsets[n.pBuffer] = offsets[n];
+    for(auto & buffer : div.Buffers)
+    {
+        if(bufferoffsets[buffer] < 0) continue;
+        buffer.MemBank = 0;
+        buffer.BankOffset = bufferoffsets[buffer];
+    }
+    return true;
+}
+
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // main buffer allocation function
@@ -278,11 +495,12 @@ bool AllocateBuffers(Program & prog, TaskDivision & div)
 
 bool BufferAllocation(Program & prog)
 {
-    for(auto & div : prog.Divisions)
-    {
-        if(!AllocateBuffers(prog, div)) return false;
-    }
-    return true;
+    return Ladybirds::lua::ForEachDivision(prog, [&prog](TaskDivision & div) { return AllocateBuffers(prog, div); });
+}
+
+bool BufferPacking(Program & prog)
+{
+    return Ladybirds::lua::ForEachDivision(prog, [&prog](TaskDivision & div) { return PackBuffers(prog, div); });
 }
 
 } // anonymous namespace
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <deque>
+#include <functional>
 #include <unordered_set>
 #include <unordered_map>
 #include <numeric>
@@ -12,6 +13,7 @@
 #include "graph/graph.h"
 #include "lua/pass.h"
 #include "basetype.h"
+#include "loadstore.h"
 #include "msgui.h"
 #include "kernel.h"
 #include "program.h"
@@ -33,8 +35,32 @@ using Ladybirds::lua::Pass;
 
 namespace {
 
-bool BufferPreallocation(Program &prog);
-Pass BufferPreallocationPass("BufferPreallocation", &BufferPreallocation, Pass::Requires{"CalcSuccessorMatrix"});
+struct PreallocationArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    bool PadRows = false; ///< Whether to pad the rows of buffers read in column blocks (see below)
+    int LineSize = 64;    ///< Size of a cache line in bytes
+    int Sets = 64, Ways = 8; ///< Geometry of the cache whose set conflicts are avoided
+    double MaxGrowth = 0.125; ///< Largest relative increase of a buffer size by padding
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("padrows", PadRows, false)
+             & ls.IO("linesize", LineSize, false, 64)
+             & ls.IO("sets", Sets, false, 64) & ls.IO("ways", Ways, false, 8)
+             & ls.IO("maxgrowth", MaxGrowth, false, 0.125, 0);
+    }
+};
+
+bool BufferPreallocation(Program &prog, PreallocationArgs &args);
+
+/** Pass BufferPreallocation: Determines what buffers are necessary and calculates for each interface which buffer it
+ *  accesses at which indices. Buffers are laid out row-major. With padrows set, the innermost dimension of a
+ *  (non-external) buffer is padded by whole cache lines if an interface only covers a column block of its rows and
+ *  these rows, being a multiple of the cache set stride (sets*linesize) apart, would map to fewer sets than needed to
+ *  hold them in ways ways. The padding is chosen as small as possible and at most grows the buffer by maxgrowth. As
+ *  the kernels receive the strides of their packets (cf. Iface::GetBufferDimsAdj), they need no changes. **/
+Ladybirds::lua::PassWithArgs<PreallocationArgs>
+    BufferPreallocationPass("BufferPreallocation", &BufferPreallocation, Pass::Requires{"CalcSuccessorMatrix"});
 
     
     
@@ -185,7 +211,7 @@ bool CheckIfaceOutput(const IfaceNode & n, Task * mainentry, const Program::Reac
                 //and that one only reads, then there is no problem
                 Task *pwriter = pdep1->To.TheIface->GetTask(), *preader = pdep2->To.TheIface->GetTask();
                 if(pdep2->To.TheIface->GetPacket()->GetAccessType() == Packet::in
-                   && (pwriter == mainentry || reachmap[preader].Contains(pwriter))) continue; 
+                   && (pwriter == mainentry || reachmap.Reaches(preader, pwriter))) continue; 
                 
                 if(newerror)
                 {
@@ -251,16 +277,58 @@ Space GetIndexSpace(vector<Iface*> & gang)
     return s;
 }
 
+/// \internal Greatest common divisor of \p a and \p b
+long Gcd(long a, long b) { while(b != 0) a %= b, std::swap(a, b); return a; }
+
+/** \internal Returns the number of elements by which to pad the innermost dimension of a buffer with dimensions
+ * \p dim and elements of \p elemsize bytes, such that the rows of the column blocks which the interfaces of \p gang
+ * access do not conflict in the cache (cf. PreallocationArgs), or 0 if no (admissible) padding helps. **/
+int GetRowPadding(vector<Iface*> & gang, const std::vector<int> & dim, int elemsize, const PreallocationArgs & args)
+{
+    if(!args.PadRows || dim.size() < 2 || dim.back() <= 1) return 0;
+    long setstride = (long) args.Sets * args.LineSize;
+    auto distinctsets = [&](long pitch) { return std::min(setstride / Gcd(pitch, setstride), (long) args.Sets); };
+
+    // the most rows of a column block accessed by any interface (only rows along the second innermost dimension,
+    // the outer ones are at least as far apart)
+    long rows = 0;
+    for(Iface * pd : gang)
+    {
+        auto & ph = pd->PosHint;
+        auto itidx = ph.rbegin();
+        if(itidx->size() < dim.back()) rows = std::max(rows, (long) (++itidx)->size());
+    }
+    long needed = std::min((rows + args.Ways - 1) / args.Ways, (long) args.Sets);
+    long pitch = (long) dim.back() * elemsize;
+    if(rows == 0 || distinctsets(pitch) >= needed) return 0;
+
+    long total = std::accumulate(dim.begin(), dim.end(), 1L, std::multiplies<long>());
+    int step = std::max((args.LineSize + elemsize - 1) / elemsize, 1);
+    for(int pad = step; ; pad += step)
+    {
+        if(double(total / dim.back() * pad) > args.MaxGrowth * total) return 0;
+        if(distinctsets(pitch + (long) pad * elemsize) >= needed) return pad;
+    }
+}
+
 /** \internal Determines the required size of \p pbuffer such that it can hold all interfaces.
  * Then, determines the position of each interface inside the buffer and the according displacement vectors
  * (to be passed on to the actual tasks later during execution). Finally, sets up the interfaces accordingly. **/
-void AdjustIndices(vector<Iface*> & gang, Buffer * pbuffer)
+void AdjustIndices(vector<Iface*> & gang, Buffer * pbuffer, const PreallocationArgs & args)
 {
     auto s = GetIndexSpace(gang);
     auto origin = s.GetOrigin();
     s.DisplaceNeg(origin);
-    auto spbufferdim = std::make_shared<std::vector<int>>();
-    auto dim = *spbufferdim = s.GetDimensions();
+    auto dim = s.GetDimensions();
+    int elemsizeof = gang[0]->GetPacket()->GetBaseType().Size;
+    for(Iface * pd : gang) pd->PosHint.DisplaceNeg(origin);
+    if(!pbuffer->pExternalSource)
+    {
+        int pad = GetRowPadding(gang, dim, elemsizeof, args);
+        if(pad > 0) gMsgUI.Verbose("Padding rows of %s by %d elements", IfaceId(gang[0]).c_str(), pad);
+        dim.back() += pad;
+    }
+    Ladybirds::InternedDimVec bufferdim(dim);
     
     //Calculate multiplication vector for all dimensions
     std::vector<int> mulvec(dim.size());
@@ -270,14 +338,12 @@ void AdjustIndices(vector<Iface*> & gang, Buffer * pbuffer)
         mulvec[i] = mul;
         mul *= dim[i];
     }
-    int elemsizeof = gang[0]->GetPacket()->GetBaseType().Size;
     pbuffer->Size = mul*elemsizeof;
     
     //Calculate offset and displacement vectors for each interface, and set up the interface accordingly
     for(Iface * pd : gang)
     {
         auto & ph = pd->PosHint;
-        ph.DisplaceNeg(origin);
         auto offset = ph.GetOrigin();
         
         std::vector<int> dispvec = pd->GetDimensions();
@@ -294,15 +360,20 @@ void AdjustIndices(vector<Iface*> & gang, Buffer * pbuffer)
             *itdisp = mul;
             ++itidx, mul = *(itdim++);
         }
-        pd->SetBuffer(pbuffer, spbufferdim, std::move(dispvec),
+        pd->SetBuffer(pbuffer, bufferdim, std::move(dispvec),
                        std::inner_product(offset.begin(), offset.end(), mulvec.begin(), 0)*elemsizeof);
     }
 }
 
 
-/** Determines what buffers are necessary and calculates for each interface which buffer it accesses at which indices **/
-bool BufferPreallocation(Program &prog)
+bool BufferPreallocation(Program &prog, PreallocationArgs &args)
 {
+    if(args.PadRows && (args.LineSize <= 0 || args.Sets <= 0 || args.Ways <= 0))
+    {
+        gMsgUI.Error("BufferPreallocation: Line size, number of sets and ways must be positive.");
+        return false;
+    }
+
     for(Iface & d : prog.MainTask.Ifaces) d.PosHint = Space(d.GetDimensions());
     
     IfaceGraph dg;
@@ -331,7 +402,7 @@ bool BufferPreallocation(Program &prog)
         
         vector<Iface*> gang;
         GetBufferGang(n, pbuffer, gang);
-        AdjustIndices(gang, pbuffer);
+        AdjustIndices(gang, pbuffer, args);
     }
     return ret;
 }
@@ -0,0 +1,120 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#include "lua/pass.h"
+#include "opt/cacheindexopt.h"
+#include "spec/platform.h"
+#include "buffer.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::lua::Pass;
+using Ladybirds::opt::CacheIndexOpt;
+using Ladybirds::spec::Platform;
+
+namespace {
+
+struct CacheLayoutArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int LineSize = 64;   ///< Size of a cache line in bytes
+    int L1Sets = 64, L1Ways = 8;
+    int L2Sets = 1024, L2Ways = 16; ///< If L2Sets is 0, only the L1 cache is considered
+    int PageSize = 4096; ///< Page size of the host, limits the address bits that can be controlled (0: no limit)
+    int MaxOffset = 256; ///< Largest distance between two consecutive cache index colors (cf. CacheIndexOpt)
+    bool Concurrent = false; ///< Also separate the buffers of tasks that may run concurrently in different groups
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("linesize", LineSize, false, 64)
+             & ls.IO("l1sets", L1Sets, false, 64) & ls.IO("l1ways", L1Ways, false, 8)
+             & ls.IO("l2sets", L2Sets, false, 1024) & ls.IO("l2ways", L2Ways, false, 16)
+             & ls.IO("pagesize", PageSize, false, 4096)
+             & ls.IO("maxoffset", MaxOffset, false, 256)
+             & ls.IO("concurrent", Concurrent, false);
+    }
+};
+
+struct CacheLayoutRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int ArenaSize = 0; ///< Size of the largest arena (over all divisions)
+    int Alignment = 0; ///< Alignment the arena needs for the cache indices to be as calculated
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("arenasize", ArenaSize) & ls.IO("alignment", Alignment);
+    }
+};
+
+bool CacheLayout(Program &prog, CacheLayoutArgs &args, CacheLayoutRets &rets);
+
+/** Pass CacheLayout: Alternative to BufferPacking for host platforms. Places all (non-external) buffers of each
+ *  division one after the other in a common arena, padding and staggering their start addresses such that buffers
+ *  used by the same task map to different sets of the host caches (cf. opt::CacheIndexOpt). With concurrent set,
+ *  this also holds for buffers of tasks in different groups that may run at the same time, which matters for caches
+ *  shared between cores or hardware threads. The buffer offsets are stored like those of BufferPacking (BankOffset,
+ *  with MemBank 0). Returns a table with the fields arenasize and alignment, which the arena must be aligned to. **/
+Ladybirds::lua::PassWithArgsAndRet<CacheLayoutArgs, CacheLayoutRets>
+    CacheLayoutPass("CacheLayout", &CacheLayout, Pass::Requires{"BufferAllocation"});
+
+
+/// \internal Checks if \p n is a positive power of two
+inline bool IsPowerOfTwo(int n) { return n > 0 && (n & (n-1)) == 0; }
+
+bool CacheLayout(Program &prog, CacheLayoutArgs &args, CacheLayoutRets &rets)
+{
+    if(!IsPowerOfTwo(args.LineSize) || !IsPowerOfTwo(args.L1Sets) || args.L1Ways <= 0
+        || (args.L2Sets != 0 && (!IsPowerOfTwo(args.L2Sets) || args.L2Ways <= 0))
+        || (args.PageSize != 0 && !IsPowerOfTwo(args.PageSize)) || args.MaxOffset < args.LineSize)
+    {
+        gMsgUI.Error("CacheLayout: Line size, set counts and page size must be powers of two, the number of ways "
+                     "must be positive, and maxoffset must be at least one line.");
+        return false;
+    }
+
+    std::vector<Platform::CacheConfig> levels = {{args.LineSize, args.L1Ways, args.L1Sets}};
+    if(args.L2Sets > 0) levels.push_back({args.LineSize, args.L2Ways, args.L2Sets});
+
+    rets.ArenaSize = 0;
+    int idiv = 0;
+    for(auto &div : prog.Divisions)
+    {
+        // Each buffer is padded by less than one index range, so reserve that much space for each of them
+        long size = 0;
+        int maxrange = args.LineSize*std::max(args.L1Sets, args.L2Sets);
+        for(auto &buffer : div.Buffers)
+        {
+            if(buffer.pExternalSource) continue;
+            buffer.MemBank = 0;
+            size += buffer.Size + maxrange;
+        }
+        if(size > INT_MAX)
+        {
+            gMsgUI.Error("CacheLayout: The buffers of division %d do not fit into an arena.", idiv);
+            return false;
+        }
+        ++idiv;
+
+        Platform::Cluster arena = {1, 1, (int) size};
+        CacheIndexOpt cio(arena, levels, args.PageSize);
+        cio.SetMaxColorOffset(args.MaxOffset);
+        if(!cio.Optimize(div, args.Concurrent ? &prog.TaskReachability : nullptr)) return false;
+        rets.Alignment = cio.GetIndexRange();
+
+        for(auto &buffer : div.Buffers)
+        {
+            if(!buffer.pExternalSource) rets.ArenaSize = std::max(rets.ArenaSize, buffer.BankOffset + buffer.Size);
+        }
+    }
+
+    gMsgUI.Verbose("CacheLayout: Arena of %d bytes, aligned to %d bytes", rets.ArenaSize, rets.Alignment);
+    return true;
+}
+
+} //namespace ::
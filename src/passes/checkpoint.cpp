@@ -0,0 +1,103 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <string>
+#include <system_error>
+
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "binaryloadstore.h"
+#include "lua/luadump.h"
+#include "lua/luaenv.h"
+#include "lua/pass.h"
+#include "msgui.h"
+#include "program.h"
+
+using std::string;
+using Ladybirds::impl::Program;
+using Ladybirds::lua::Pass;
+
+namespace {
+
+struct CheckpointArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    string Filename;
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override {return ls.IO("filename", Filename); }
+};
+
+
+bool StoreProgram(Program & prog, CheckpointArgs & args);
+Ladybirds::lua::PassWithArgs<CheckpointArgs> StoreProgramPass("StoreProgram", &StoreProgram);
+
+//! Stores \p prog in binary form (cf. loadstore::BinaryStore) in the file \p args.Filename, from where it can be loaded
+//! by pass LoadProgram, e.g. to continue compiling in another process or to try several mappings without repeating
+//! the passes before. Only programs before grouping can be stored (cf. Program::LoadStoreMembers).
+bool StoreProgram(Program & prog, CheckpointArgs & args)
+{
+    if(!prog.IsStorable())
+    {
+        gMsgUI.Error("Programs can only be stored before their tasks are grouped and buffers are allocated.");
+        return false;
+    }
+
+    Ladybirds::loadstore::BinaryStore ls;
+    bool ok = ls.RawIO(prog);
+    string data = ls.GetData();
+    if(!ok || ls.GetErrorCount() != 0) return false;
+    if(ls.GetForwardRefCount() != 0)
+    {
+        gMsgUI.Error("The program cannot be stored, as it refers to objects before they are defined.");
+        return false;
+    }
+
+    std::error_code err;
+    llvm::raw_fd_ostream os(args.Filename, err);
+    if(!err)
+    {
+        os << data;
+        os.close();
+        err = os.error();
+    }
+    if(err)
+    {
+        gMsgUI.Error("Unable to write to '%s': %s", args.Filename.c_str(), err.message().c_str());
+        return false;
+    }
+    return true;
+}
+
+
+/// Loading pass: Loads a program stored by pass StoreProgram from the file passed as argument filename and returns it
+class LoadProgramPass : public Pass
+{
+    using Pass::Pass;
+    virtual int Run(lua_State * lua) override;
+};
+LoadProgramPass MyPass("LoadProgram", nullptr);
+
+int LoadProgramPass::Run(lua_State * lua)
+{
+    CheckpointArgs args;
+    LoadExtraArgs(lua, args);
+    lua_settop(lua, 0); // we have all arguments now
+
+    auto buf = llvm::MemoryBuffer::getFile(args.Filename, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if(!buf)
+    {
+        gMsgUI.Error("Unable to read '%s': %s", args.Filename.c_str(), buf.getError().message().c_str());
+        return 0;
+    }
+
+    Ladybirds::lua::LuaDump ld(lua);
+    auto *pprog = ld.CreateManaged<Program>();
+    Ladybirds::loadstore::BinaryLoad bl((*buf)->getBuffer().str());
+    if(!bl.RawIO(*pprog) || bl.GetErrorCount() != 0)
+    {
+        gMsgUI.Error("Unable to load a program from '%s'", args.Filename.c_str());
+        return 0;
+    }
+    RecordSizes(*pprog, true);
+    return 1;
+}
+
+} //namespace ::
@@ -0,0 +1,172 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "lua/pass.h"
+#include "dependency.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+
+
+using Ladybirds::gen::Space;
+using Ladybirds::impl::Program;
+using Ladybirds::spec::Dependency;
+using Ladybirds::spec::Iface;
+
+namespace {
+
+struct CoalesceArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore &) override { return true; }
+};
+
+struct CoalesceRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Before = 0; ///< Number of dependencies before
+    int After = 0;  ///< Number of dependencies after
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("before", Before) & ls.IO("after", After);
+    }
+};
+
+bool CoalesceDependencies(Program &prog, CoalesceArgs &args, CoalesceRets &rets);
+
+/** Pass CoalesceDependencies: Merges dependencies between the same pair of interfaces whose regions are adjacent on
+ *  both sides, such that the elements keep their correspondence. This is the case if the source regions differ only
+ *  in one dimension, in which the second follows the first directly, the destination regions likewise, and the two
+ *  dimensions are at the same position among the dimensions of size greater than one. Merged dependencies are merged
+ *  again, so that a transfer split into tiles (e.g. by expanding the dependencies of a meta-kernel) becomes one
+ *  dependency per box. The merged dependency takes the place of the first one. Must be applied before
+ *  PopulateGroups. Returns a table with the number of dependencies before and after. **/
+Ladybirds::lua::PassWithArgsAndRet<CoalesceArgs, CoalesceRets>
+    CoalesceDependenciesPass("CoalesceDependencies", &CoalesceDependencies);
+
+
+/// \internal Returns the dimension in which \p b follows \p a directly if they are equal in all other dimensions,
+/// else -1
+int AdjacentDim(const Space &a, const Space &b)
+{
+    if(a.Dimensions() != b.Dimensions()) return -1;
+    int ret = -1;
+    for(int d = 0, n = a.Dimensions(); d < n; ++d)
+    {
+        if(a[d] == b[d]) continue;
+        if(ret >= 0 || a[d].end() != b[d].begin()) return -1;
+        ret = d;
+    }
+    return ret;
+}
+
+/// \internal Position of dimension \p dim of \p s among the dimensions of size greater than one
+int EffectivePos(const Space &s, int dim)
+{
+    return std::count_if(s.begin(), s.begin() + dim, [](auto &r) { return r.size() != 1; });
+}
+
+/// \internal Merges \p b into \p a if the source and destination regions of \p b follow those of \p a directly, the
+/// source regions in dimension \p dim. Returns whether it did.
+bool TryMerge(Dependency &a, const Dependency &b, int dim)
+{
+    if(AdjacentDim(a.From.Index, b.From.Index) != dim) return false;
+    int todim = AdjacentDim(a.To.Index, b.To.Index);
+    if(todim < 0) return false;
+
+    Space from = a.From.Index, to = a.To.Index;
+    from[dim] |= b.From.Index[dim];
+    to[todim] |= b.To.Index[todim];
+    if(EffectivePos(from, dim) != EffectivePos(to, todim)
+       || from.GetEffectiveDimensions() != to.GetEffectiveDimensions()) return false;
+    a.From.Index = std::move(from);
+    a.To.Index = std::move(to);
+    return true;
+}
+
+/// \internal Orders regions by all dimensions except \p dim, and then by the beginning in \p dim
+struct SpaceOrder
+{
+    int Dim;
+
+    bool operator()(const Space &a, const Space &b) const
+    {
+        if(a.Dimensions() != b.Dimensions()) return a.Dimensions() < b.Dimensions();
+        for(int d = 0, n = a.Dimensions(); d < n; ++d)
+        {
+            if(d == Dim || a[d] == b[d]) continue;
+            return a[d].begin() != b[d].begin() ? a[d].begin() < b[d].begin() : a[d].end() < b[d].end();
+        }
+        return Dim < a.Dimensions() && a[Dim].begin() < b[Dim].begin();
+    }
+};
+
+bool CoalesceDependencies(Program &prog, CoalesceArgs &, CoalesceRets &rets)
+{
+    if(prog.PassesPerformed.count("PopulateGroups"))
+    {
+        gMsgUI.Error("CoalesceDependencies must be applied before PopulateGroups.");
+        return false;
+    }
+
+    auto &deps = prog.Dependencies;
+    rets.Before = deps.size();
+    std::map<std::pair<const Iface*, const Iface*>, std::vector<int>> byifaces;
+    for(int i = 0, n = deps.size(); i < n; ++i) byifaces[{deps[i].From.TheIface, deps[i].To.TheIface}].push_back(i);
+
+    std::vector<bool> merged(deps.size(), false);
+    for(auto &entry : byifaces)
+    {
+        auto &list = entry.second;
+        if(list.size() < 2) continue;
+        int ndims = deps[list.front()].From.Index.Dimensions();
+        // sweep along each dimension in turn until nothing changes, as merging along one may enable another
+        for(bool changed = true; changed && list.size() > 1; )
+        {
+            changed = false;
+            for(int dim = 0; dim < ndims; ++dim)
+            {
+                SpaceOrder order{dim};
+                std::sort(list.begin(), list.end(), [&](int a, int b)
+                          { return order(deps[a].From.Index, deps[b].From.Index); });
+                std::vector<int> kept{list.front()};
+                for(auto it = list.begin() + 1; it != list.end(); ++it)
+                {
+                    int &into = kept.back();
+                    if(!TryMerge(deps[into], deps[*it], dim))
+                    {
+                        kept.push_back(*it);
+                        continue;
+                    }
+                    if(*it < into) // keep the earlier position in the list of dependencies
+                    {
+                        std::swap(deps[*it].From.Index, deps[into].From.Index);
+                        std::swap(deps[*it].To.Index, deps[into].To.Index);
+                        std::swap(*it, into);
+                    }
+                    merged[*it] = changed = true;
+                }
+                list = std::move(kept);
+            }
+        }
+    }
+
+    int next = 0;
+    for(int i = 0, n = deps.size(); i < n; ++i)
+    {
+        if(merged[i]) continue;
+        if(next != i) deps[next] = std::move(deps[i]);
+        ++next;
+    }
+    deps.erase(deps.begin() + next, deps.end());
+    rets.After = deps.size();
+
+    gMsgUI.Verbose("CoalesceDependencies: %d dependencies merged into %d", rets.Before, rets.After);
+    return true;
+}
+
+} //namespace ::
@@ -0,0 +1,163 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "lua/pass.h"
+#include "dependency.h"
+#include "dependencyindex.h"
+#include "kernel.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct CoarsenArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double MinCost = 0; ///< Cost up to which a chunk takes further tasks
+    int MaxTasks = 0;   ///< Maximum number of tasks per chunk (0: no limit)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("mincost", MinCost) & ls.IO("maxtasks", MaxTasks, false, 0);
+    }
+};
+
+struct ChunkEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<std::string> Tasks; ///< Names of the tasks, in the order in which they must run
+    double Cost = 0;                ///< Sum of their costs
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("tasks", Tasks) & ls.IO("cost", Cost);
+    }
+};
+
+struct CoarsenRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<ChunkEntry> Chunks;
+    int Tasks = 0; ///< Number of tasks in the chunks
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("chunks", Chunks) & ls.IO("tasks", Tasks);
+    }
+};
+
+bool CoarsenTasks(Program &prog, CoarsenArgs &args, CoarsenRets &rets);
+
+/** Pass CoarsenTasks: Finds chunks of consecutive instances of the same kernel that run as one task each (like the
+ *  chains of FuseChains), such that the runtime overhead per task is paid once per chunk. Consecutive are the instances
+ *  of the same template task in subsequent iterations of a task family (cf. spec::TaskFamily), and tasks outside of
+ *  families that directly follow each other. The instances may be independent or depend on each other. A chunk takes
+ *  further tasks while the sum of their costs (Task::Cost, cf. LoadCost and EstimateCosts) is below mincost and it has
+ *  less than maxtasks tasks (if given). Tasks of different groups are never merged, so the pass can be used before and
+ *  after grouping. No task outside of a chunk depends on a task of it and is needed by another one of it, so running
+ *  the chunk as a whole once all its inputs are there cannot deadlock. Returns a table with the field chunks, which
+ *  lists tasks and cost of every chunk of at least two tasks, and tasks, the number of tasks in chunks. **/
+Ladybirds::lua::PassWithArgsAndRet<CoarsenArgs, CoarsenRets>
+    CoarsenTasksPass("CoarsenTasks", &CoarsenTasks, Pass::Requires{"TaskTopoSort", "CalcSuccessorMatrix"});
+
+
+/// \internal A chunk being built
+struct Chunk
+{
+    std::vector<const Task*> Tasks;
+    double Cost = 0;
+    int Order = 0; ///< Position of its first task, for listing the chunks in the order of the tasks
+};
+
+bool CoarsenTasks(Program &prog, CoarsenArgs &args, CoarsenRets &rets)
+{
+    if(args.MinCost <= 0)
+    {
+        gMsgUI.Error("CoarsenTasks: mincost must be positive.");
+        return false;
+    }
+    auto tasks = prog.GetTasks();
+    if(std::all_of(tasks.begin(), tasks.end(), [](const Task &t) { return t.Cost == 0; }) && !tasks.empty())
+    {
+        gMsgUI.Error("CoarsenTasks: No task has a cost. Load the costs (LoadCost) or estimate them (EstimateCosts).");
+        return false;
+    }
+
+    auto &reach = prog.TaskReachability;
+    auto &depindex = prog.GetDependencyIndex();
+    // t can join the chunk unless one of its predecessors outside the chunk depends on the chunk (as the tasks come in
+    // topological order, the chunk cannot depend on t or on successors of t)
+    auto canjoin = [&](const Chunk &chunk, const Task &t)
+    {
+        auto *plast = chunk.Tasks.back();
+        if(t.Group != plast->Group || t.Cost >= args.MinCost) return false;
+        if(t.Family >= 0 && t.FamilyPos != plast->FamilyPos + prog.TaskFamilies[t.Family].Period) return false;
+        for(auto *pdep : depindex.GetInDeps(t))
+        {
+            auto *ppred = pdep->From.TheIface->GetTask();
+            if(ppred == &prog.MainTask
+               || std::find(chunk.Tasks.begin(), chunk.Tasks.end(), ppred) != chunk.Tasks.end()) continue;
+            if(std::any_of(chunk.Tasks.begin(), chunk.Tasks.end(), [&](auto *pt) { return reach.Reaches(pt, ppred); }))
+                return false;
+        }
+        return true;
+    };
+
+    // the chunks being built, by kernel, family and template task (-1 outside of families)
+    using Key = std::tuple<const Ladybirds::spec::Kernel*, int, int>;
+    std::map<Key, Chunk> open;
+    std::vector<Chunk> done;
+    auto close = [&](std::map<Key, Chunk>::iterator it)
+    {
+        if(it->second.Tasks.size() > 1) done.push_back(std::move(it->second));
+        open.erase(it);
+    };
+
+    int order = 0;
+    const Task *pprev = nullptr;
+    Key prevkey;
+    for(auto &t : tasks)
+    {
+        int templ = t.Family >= 0 ? t.FamilyPos % prog.TaskFamilies[t.Family].Period : -1;
+        Key key(t.GetKernel(), t.Family, templ);
+        // tasks outside of families only join the task right before them
+        if(pprev && pprev->Family < 0 && key != prevkey && open.count(prevkey)) close(open.find(prevkey));
+        pprev = &t, prevkey = key;
+
+        auto it = open.find(key);
+        if(it != open.end() && !canjoin(it->second, t)) close(it), it = open.end();
+        if(it == open.end()) it = open.emplace(key, Chunk()).first, it->second.Order = order;
+        ++order;
+
+        auto &chunk = it->second;
+        chunk.Tasks.push_back(&t);
+        chunk.Cost += t.Cost;
+        if(chunk.Cost >= args.MinCost || (args.MaxTasks > 0 && (int) chunk.Tasks.size() >= args.MaxTasks)) close(it);
+    }
+    while(!open.empty()) close(open.begin());
+    std::sort(done.begin(), done.end(), [](const Chunk &a, const Chunk &b) { return a.Order < b.Order; });
+
+    rets.Chunks.clear();
+    rets.Tasks = 0;
+    for(auto &chunk : done)
+    {
+        rets.Chunks.emplace_back();
+        auto &entry = rets.Chunks.back();
+        for(auto *pt : chunk.Tasks) entry.Tasks.push_back(pt->GetFullName());
+        entry.Cost = chunk.Cost;
+        rets.Tasks += chunk.Tasks.size();
+    }
+    gMsgUI.Verbose("CoarsenTasks: %d tasks in %d chunks", rets.Tasks, (int) rets.Chunks.size());
+    return true;
+}
+
+} //namespace ::
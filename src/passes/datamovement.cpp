@@ -0,0 +1,257 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "lua/pass.h"
+#include "buffer.h"
+#include "dependency.h"
+#include "kernel.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Buffer;
+using Ladybirds::impl::Program;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct DataMovementArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Limit = 50;   ///< Maximum number of rows of each list, the largest ones first (0: all)
+    int Points = 200; ///< Maximum number of points of the live bytes over the topological order
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("limit", Limit, false, 50) & ls.IO("points", Points, false, 200);
+    }
+};
+
+struct ChannelVolume : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string From, To;           ///< Full names of the interfaces
+    std::string FromGroup, ToGroup;
+    int Bytes = 0;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("from", From) & ls.IO("to", To) & ls.IO("fromgroup", FromGroup) & ls.IO("togroup", ToGroup)
+             & ls.IO("bytes", Bytes);
+    }
+};
+
+struct GroupTraffic : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string From, To; ///< Names of the groups
+    int Channels = 0;
+    double Bytes = 0;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("from", From) & ls.IO("to", To) & ls.IO("channels", Channels) & ls.IO("bytes", Bytes);
+    }
+};
+
+struct BufferUse : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Iface;    ///< Full name of the first interface using the buffer
+    int Division = 0, Id = 0;
+    int Size = 0;
+    int First = 0, Last = 0; ///< Positions of the first and the last task using the buffer in the topological order
+    int Users = 0;        ///< Number of interfaces using the buffer
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("iface", Iface) & ls.IO("division", Division) & ls.IO("id", Id) & ls.IO("size", Size)
+             & ls.IO("first", First) & ls.IO("last", Last) & ls.IO("users", Users);
+    }
+};
+
+struct KernelIntensity : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Kernel;
+    int Tasks = 0;
+    double Cost = 0, Bytes = 0; ///< Sums over the tasks: Task::Cost and the sizes of the interfaces
+    double Intensity = 0;       ///< Cost / Bytes
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("kernel", Kernel) & ls.IO("tasks", Tasks) & ls.IO("cost", Cost) & ls.IO("bytes", Bytes)
+             & ls.IO("intensity", Intensity);
+    }
+};
+
+struct DataMovementRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Dependencies = 0, CrossGroupChannels = 0, BufferCount = 0;
+    double DependencyBytes = 0, CrossGroupBytes = 0, BufferBytes = 0;
+    double PeakBytes = 0; ///< Largest sum of the sizes of the buffers in use at one position of the topological order
+    int PeakStep = 0;     ///< The position, ...
+    std::string PeakTask; ///< ... and the task there
+    int Steps = 0;        ///< Number of positions, i.e. tasks
+    std::vector<double> Live; ///< Live bytes over the topological order, the maximum of each of up to points ranges
+    std::vector<ChannelVolume> Channels;
+    std::vector<GroupTraffic> Groups;
+    std::vector<BufferUse> Buffers;
+    std::vector<KernelIntensity> Kernels;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("dependencies", Dependencies) & ls.IO("dependencybytes", DependencyBytes)
+             & ls.IO("crossgroupchannels", CrossGroupChannels) & ls.IO("crossgroupbytes", CrossGroupBytes)
+             & ls.IO("buffercount", BufferCount) & ls.IO("bufferbytes", BufferBytes)
+             & ls.IO("peakbytes", PeakBytes) & ls.IO("peakstep", PeakStep) & ls.IO("peaktask", PeakTask)
+             & ls.IO("steps", Steps) & ls.IO("live", Live)
+             & ls.IO("channels", Channels) & ls.IO("groups", Groups) & ls.IO("buffers", Buffers)
+             & ls.IO("kernels", Kernels);
+    }
+};
+
+bool DataMovement(Program &prog, DataMovementArgs &args, DataMovementRets &rets);
+
+/** Pass DataMovement: Analyzes the data volumes of the program, for the report (cf. printreport). Returns a table with
+ *  the number and the total size of the dependencies (Dependency::GetMemSize), of the channels between groups and of
+ *  the (non-external) buffers, the largest channels, the traffic between each pair of groups, the largest buffers
+ *  with the positions of their first and last use in the topological order of the tasks, and the peak of the live
+ *  bytes (the sizes of the buffers between their first and last use) together with its course over the order. If
+ *  task costs are known (cf. LoadCost, EstimateCosts), it also lists the arithmetic intensity of each kernel, i.e.,
+ *  the cost of its tasks per byte of their interfaces, the lowest first. **/
+Ladybirds::lua::PassWithArgsAndRet<DataMovementArgs, DataMovementRets> DataMovementPass("DataMovement",
+    &DataMovement, Pass::Requires{"TaskTopoSort", "BufferPreallocation", "PopulateGroups"});
+
+
+/// \internal Sorts \p list by decreasing \p key and truncates it to \p limit entries (if positive)
+template<typename T, typename F> void SortAndLimit(std::vector<T> &list, F key, int limit)
+{
+    std::stable_sort(list.begin(), list.end(), [&key](const T &a, const T &b) { return key(a) > key(b); });
+    if(limit > 0 && list.size() > (size_t) limit) list.resize(limit);
+}
+
+bool DataMovement(Program &prog, DataMovementArgs &args, DataMovementRets &rets)
+{
+    for(auto &dep : prog.Dependencies)
+    {
+        ++rets.Dependencies;
+        rets.DependencyBytes += dep.GetMemSize();
+    }
+
+    std::map<std::pair<std::string, std::string>, GroupTraffic> traffic;
+    for(auto &upchan : prog.Channels)
+    {
+        if(!upchan->IsValid()) continue;
+        auto *pdep = upchan->Dep;
+        const Task *pfrom = pdep->From.TheIface->GetTask(), *pto = pdep->To.TheIface->GetTask();
+        rets.Channels.emplace_back();
+        auto &chan = rets.Channels.back();
+        chan.From = pdep->From.TheIface->GetFullName(), chan.To = pdep->To.TheIface->GetFullName();
+        chan.FromGroup = pfrom->Group->GetName(), chan.ToGroup = pto->Group->GetName();
+        chan.Bytes = pdep->GetMemSize();
+        ++rets.CrossGroupChannels;
+        rets.CrossGroupBytes += chan.Bytes;
+
+        auto &entry = traffic[std::make_pair(chan.FromGroup, chan.ToGroup)];
+        entry.From = chan.FromGroup, entry.To = chan.ToGroup;
+        ++entry.Channels;
+        entry.Bytes += chan.Bytes;
+    }
+    for(auto &entry : traffic) rets.Groups.push_back(entry.second);
+    SortAndLimit(rets.Channels, [](const ChannelVolume &c) { return c.Bytes; }, args.Limit);
+    SortAndLimit(rets.Groups, [](const GroupTraffic &g) { return g.Bytes; }, args.Limit);
+
+    // use intervals of the buffers along the topological order (cf. BufferPacking)
+    std::vector<const Task*> order;
+    std::unordered_map<const Task*, int> positions;
+    for(auto &t : prog.GetTasks())
+    {
+        positions[&t] = order.size();
+        order.push_back(&t);
+    }
+    rets.Steps = order.size();
+    std::unordered_map<const Buffer*, size_t> indices;
+    int idiv = 0;
+    for(auto &div : prog.Divisions)
+    {
+        for(auto *ptask : div.GetTasks())
+        {
+            int pos = positions.at(ptask);
+            for(auto &iface : ptask->Ifaces)
+            {
+                auto *pbuffer = iface.GetBuffer();
+                if(!pbuffer || pbuffer->pExternalSource) continue;
+                auto it = indices.find(pbuffer);
+                if(it == indices.end())
+                {
+                    it = indices.emplace(pbuffer, rets.Buffers.size()).first;
+                    rets.Buffers.emplace_back();
+                    auto &use = rets.Buffers.back();
+                    use.Iface = iface.GetFullName(), use.Division = idiv, use.Id = pbuffer->GetID();
+                    use.Size = pbuffer->Size, use.First = use.Last = pos;
+                }
+                auto &use = rets.Buffers[it->second];
+                use.First = std::min(use.First, pos), use.Last = std::max(use.Last, pos);
+                ++use.Users;
+            }
+        }
+        ++idiv;
+    }
+
+    std::vector<double> live(order.size() + 1, 0);
+    for(auto &use : rets.Buffers)
+    {
+        ++rets.BufferCount;
+        rets.BufferBytes += use.Size;
+        live[use.First] += use.Size, live[use.Last + 1] -= use.Size;
+    }
+    for(size_t i = 1; i < live.size(); ++i) live[i] += live[i-1];
+    live.pop_back();
+    for(size_t i = 0; i < live.size(); ++i)
+    {
+        if(live[i] > rets.PeakBytes) rets.PeakBytes = live[i], rets.PeakStep = i;
+    }
+    if(!order.empty()) rets.PeakTask = order[rets.PeakStep]->GetFullName();
+    size_t npoints = std::min(live.size(), (size_t) std::max(args.Points, 1));
+    for(size_t i = 0; i < npoints; ++i)
+    {
+        auto begin = live.begin() + i*live.size()/npoints, end = live.begin() + (i+1)*live.size()/npoints;
+        rets.Live.push_back(*std::max_element(begin, end));
+    }
+    SortAndLimit(rets.Buffers, [](const BufferUse &b) { return b.Size; }, args.Limit);
+
+    // arithmetic intensity, if there are costs
+    std::map<const Ladybirds::spec::Kernel*, KernelIntensity> kernels;
+    bool costs = false;
+    for(auto *ptask : order)
+    {
+        auto &entry = kernels[ptask->GetKernel()];
+        entry.Kernel = ptask->GetKernel()->Name;
+        ++entry.Tasks;
+        entry.Cost += ptask->Cost;
+        for(auto &iface : ptask->Ifaces) entry.Bytes += iface.GetMemSize();
+        if(ptask->Cost != 0) costs = true;
+    }
+    if(costs)
+    {
+        for(auto &entry : kernels)
+        {
+            auto &ki = entry.second;
+            ki.Intensity = ki.Bytes > 0 ? ki.Cost / ki.Bytes : 0;
+            rets.Kernels.push_back(ki);
+        }
+        SortAndLimit(rets.Kernels, [](const KernelIntensity &k) { return -k.Intensity; }, args.Limit);
+    }
+
+    gMsgUI.Verbose("DataMovement: %.0f bytes in %d channels between groups, peak of %.0f live bytes at task %s",
+                   rets.CrossGroupBytes, rets.CrossGroupChannels, rets.PeakBytes, rets.PeakTask.c_str());
+    return true;
+}
+
+} //namespace ::
@@ -0,0 +1,246 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "graph/arena.h"
+#include "lua/pass.h"
+#include "spec/platform.h"
+#include "dependency.h"
+#include "kernel.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "packet.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::impl::TaskGroup;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Dependency;
+using Ladybirds::spec::Packet;
+using Ladybirds::spec::Platform;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct DuplicateArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    Platform *pPlatform = nullptr;
+    double SyncCost = 0; ///< Cost of waiting for the completion of a task in another group
+    double MaxCost = 0;  ///< Only tasks up to this cost are duplicated (0: no limit)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IOHandle("platform", pPlatform, nullptr)
+             & ls.IO("synccost", SyncCost, false, 0, 0)
+             & ls.IO("maxcost", MaxCost, false, 0, 0);
+    }
+};
+
+struct DuplicateRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    Ladybirds::loadstore::LoadStore::Table<std::vector<std::string>> Copies; ///< Names of the copies, by original task
+    double Saved = 0; ///< Estimated communication and synchronization cost saved, minus the recomputation cost
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("copies", Copies) & ls.IO("saved", Saved, false, 0, -DBL_MAX);
+    }
+};
+
+bool DuplicateTasks(Program &prog, DuplicateArgs &args, DuplicateRets &rets);
+
+/** Pass DuplicateTasks: Replicates cheap producer tasks into the groups of their consumers, such that these do not wait
+ *  for a task in another group and read its results from remote memory. A task is copied into another group if its
+ *  cost (Task::Cost, cf. LoadCost and EstimateCosts), plus the cost of fetching its own inputs from groups other than
+ *  that one, is below the cost of sending its outputs to the consumers there: synccost per consumer plus the transfer
+ *  cost estimated from the HwConnection costs of the platform (the mean cost of a DMA route between two memories (cf.
+ *  Platform::Routing), or, without DMA, the reads at the difference between the most and the least expensive memory
+ *  access). Only tasks without inout packets are duplicated, as they do not modify data in place. The copies are
+ *  named after the original with a suffix _dup<n> and take over the dependencies to the consumers in their group;
+ *  the original keeps the others. Tasks are treated in reverse topological order, such that copies as consumers may
+ *  lead to further duplication of their producers. The grouping (e.g. AutoGroup or LoadMapping) must have been done,
+ *  PopulateGroups not yet. Afterwards run TaskTopoSort again (and EliminateDead for originals that lost all
+ *  consumers). Returns a table with the fields copies, listing the copies made of each task, and saved, the estimated
+ *  cost saving. **/
+Ladybirds::lua::PassWithArgsAndRet<DuplicateArgs, DuplicateRets>
+    DuplicateTasksPass("DuplicateTasks", &DuplicateTasks, Pass::Requires{"TaskTopoSort"},
+                       Pass::Destroys{"TaskTopoSort", "CalcSuccessorMatrix"});
+
+
+/// \internal Estimates the cost of transferring data between tasks of different groups from the connection costs of
+/// a platform
+class TransferCost
+{
+    Platform::Routing::PathCost Dma_; ///< Mean cost of a DMA route, if there is any
+    bool HasDma_ = false;
+    double ReadPenalty_ = 0;          ///< Extra cost of a read from the most expensive memory
+
+public:
+    explicit TransferCost(const Platform &pf)
+    {
+        auto &routing = pf.GetRouting();
+        long nroutes = 0;
+        for(auto &from : pf.GetMemories())
+        {
+            for(auto &to : pf.GetMemories())
+            {
+                if(&from == &to || !routing.IsReachable(from, to)) continue;
+                auto &cost = routing.GetCost(from, to);
+                Dma_.Fix += cost.Fix, Dma_.PerByte += cost.PerByte;
+                ++nroutes;
+            }
+        }
+        if((HasDma_ = nroutes > 0)) Dma_.Fix /= nroutes, Dma_.PerByte /= nroutes;
+
+        int minread = -1, maxread = 0;
+        for(auto &conn : pf.GetGraph().Edges())
+        {
+            if(!conn.GetSource()->pCore) continue;
+            minread = minread < 0 ? conn.ReadCost : std::min(minread, conn.ReadCost);
+            maxread = std::max(maxread, conn.ReadCost);
+        }
+        ReadPenalty_ = std::max(maxread - minread, 0);
+    }
+
+    double operator()(const Dependency &dep) const
+    {
+        long nbytes = dep.GetMemSize();
+        if(HasDma_) return Dma_.For(nbytes);
+        return ReadPenalty_ * (nbytes / dep.From.TheIface->GetPacket()->GetBaseType().Size);
+    }
+};
+
+
+/// \internal Returns true if \p t may be computed several times, i.e. only reads its inputs
+bool IsDuplicable(const Task &t)
+{
+    return std::none_of(t.Ifaces.begin(), t.Ifaces.end(),
+                        [](auto &iface) { return iface.GetPacket()->GetAccessType() == Packet::inout; });
+}
+
+bool DuplicateTasks(Program &prog, DuplicateArgs &args, DuplicateRets &rets)
+{
+    if(prog.PassesPerformed.count("PopulateGroups"))
+    {
+        gMsgUI.Error("DuplicateTasks must be applied before PopulateGroups.");
+        return false;
+    }
+    Ladybirds::graph::Arena::Scope scope(prog.Memory); // the copies live in the program's arena
+    TransferCost transfer(*args.pPlatform);
+
+    // dependencies by position in prog.Dependencies, which grows while copying
+    std::unordered_map<const Task*, std::vector<std::size_t>> indeps, outdeps;
+    for(std::size_t i = 0; i < prog.Dependencies.size(); ++i)
+    {
+        auto &dep = prog.Dependencies[i];
+        indeps[dep.To.TheIface->GetTask()].push_back(i);
+        outdeps[dep.From.TheIface->GetTask()].push_back(i);
+    }
+    std::unordered_map<const TaskGroup*, int> grouppos;
+    for(auto &upgroup : prog.Groups) grouppos.emplace(upgroup.get(), grouppos.size());
+    std::unordered_set<std::string> names;
+    for(auto &t : prog.GetTasks()) names.insert(t.GetFullName());
+
+    std::vector<Task*> order;
+    for(auto &t : prog.GetTasks()) order.push_back(&t);
+    std::reverse(order.begin(), order.end());
+
+    rets.Copies.clear();
+    rets.Saved = 0;
+    int ncopies = 0;
+    for(Task *porig : order)
+    {
+        if(!IsDuplicable(*porig) || (args.MaxCost > 0 && porig->Cost > args.MaxCost)) continue;
+
+        // outgoing dependencies by consuming group, in the order of Program::Groups for a reproducible result
+        std::map<std::pair<int, TaskGroup*>, std::vector<std::size_t>> bygroup;
+        for(auto i : outdeps[porig])
+        {
+            TaskGroup *pgroup = prog.Dependencies[i].To.TheIface->GetTask()->Group;
+            if(pgroup && pgroup != porig->Group) bygroup[{grouppos.at(pgroup), pgroup}].push_back(i);
+        }
+
+        for(auto &entry : bygroup)
+        {
+            TaskGroup *pgroup = entry.first.second;
+            std::unordered_set<const Task*> consumers;
+            double comm = 0, recompute = porig->Cost;
+            for(auto i : entry.second)
+            {
+                comm += transfer(prog.Dependencies[i]);
+                consumers.insert(prog.Dependencies[i].To.TheIface->GetTask());
+            }
+            comm += args.SyncCost * consumers.size();
+            for(auto i : indeps[porig])
+            {
+                Task *pfrom = prog.Dependencies[i].From.TheIface->GetTask();
+                if(pfrom != &prog.MainTask && pfrom->Group != pgroup)
+                    recompute += transfer(prog.Dependencies[i]) + args.SyncCost;
+            }
+            if(recompute >= comm) continue;
+
+            Task *pcopy = prog.TaskGraph.EmplaceNode(*porig);
+            std::string base = porig->Name + "_dup";
+            for(int n = 1; ; ++n)
+            {
+                pcopy->Name = base + std::to_string(n);
+                if(names.insert(pcopy->GetFullName()).second) break;
+            }
+            pcopy->Cost = porig->Cost;
+            pcopy->TypeCosts = porig->TypeCosts;
+            pcopy->Group = pgroup;
+            pgroup->AddTask(pcopy);
+
+            auto counterpart = [&](const Dependency::Anchor &anchor)
+            {
+                return Dependency::Anchor(&pcopy->Ifaces[anchor.TheIface - porig->Ifaces.data()], anchor.Index);
+            };
+            for(auto i : std::vector<std::size_t>(indeps[porig]))
+            {
+                Dependency dep(prog.Dependencies[i].From, counterpart(prog.Dependencies[i].To));
+                prog.Dependencies.push_back(std::move(dep));
+                indeps[pcopy].push_back(prog.Dependencies.size() - 1);
+                outdeps[prog.Dependencies.back().From.TheIface->GetTask()].push_back(prog.Dependencies.size() - 1);
+            }
+            auto &origout = outdeps[porig];
+            for(auto i : entry.second)
+            {
+                auto &dep = prog.Dependencies[i];
+                dep.From = counterpart(dep.From);
+                origout.erase(std::find(origout.begin(), origout.end(), i));
+                outdeps[pcopy].push_back(i);
+            }
+
+            rets.Copies[porig->GetFullName()].push_back(pcopy->GetFullName());
+            rets.Saved += comm - recompute;
+            ++ncopies;
+        }
+    }
+
+    // the task graph follows the dependencies, as after loading a program (cf. Program::LoadStoreMembers)
+    if(ncopies > 0)
+    {
+        prog.TaskGraph.ClearEdges();
+        auto adjacency = prog.TaskGraph.GetNodeMap(prog.TaskGraph.GetNodeSet());
+        for(auto &dep : prog.Dependencies)
+        {
+            Task *pfrom = dep.From.TheIface->GetTask(), *pto = dep.To.TheIface->GetTask();
+            if(pfrom == &prog.MainTask || pto == &prog.MainTask || adjacency[pfrom].Contains(pto)) continue;
+            prog.TaskGraph.EmplaceEdge(pfrom, pto);
+            adjacency[pfrom].Insert(pto);
+        }
+    }
+    gMsgUI.Verbose("DuplicateTasks: %d copies of %d tasks, saving an estimated cost of %g",
+                   ncopies, (int) rets.Copies.size(), rets.Saved);
+    return true;
+}
+
+} //namespace ::
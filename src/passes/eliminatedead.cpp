@@ -0,0 +1,129 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lua/pass.h"
+#include "dependency.h"
+#include "dependencyindex.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "packet.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::impl::TaskGroup;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Dependency;
+using Ladybirds::spec::Packet;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct EliminateArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    bool KeepSinks = true; ///< Whether tasks without outputs count as live
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("keepsinks", KeepSinks, false, true);
+    }
+};
+
+struct EliminateRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<std::string> Tasks; ///< Names of the removed tasks
+    int Dependencies = 0;           ///< Number of removed dependencies
+    double Bytes = 0;               ///< Amount of data these dependencies carried
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("tasks", Tasks) & ls.IO("dependencies", Dependencies) & ls.IO("bytes", Bytes, false, 0, 0);
+    }
+};
+
+bool EliminateDead(Program &prog, EliminateArgs &args, EliminateRets &rets);
+
+/** Pass EliminateDead: Removes the tasks whose results are never used, together with their dependencies. Live are
+ *  the tasks that deliver data to the main task (i.e. to the outputs of the program), unless keepsinks is false the
+ *  tasks without any output or inout packets (which only exist for their side effects), and, recursively, all tasks
+ *  providing data for a live task. Removed tasks leave their groups; groups left empty are removed unless they belong
+ *  to a division. As BufferPreallocation sizes the buffers after the interfaces that remain connected, it then only
+ *  allocates the live regions of arrays of which dead tasks had used the rest. Must be applied before PopulateGroups.
+ *  Returns a table with the fields tasks, the names of the removed tasks, dependencies, the number of removed
+ *  dependencies, and bytes, the amount of data they carried. **/
+Ladybirds::lua::PassWithArgsAndRet<EliminateArgs, EliminateRets>
+    EliminateDeadPass("EliminateDead", &EliminateDead, Pass::Requires{}, Pass::Destroys{"CalcSuccessorMatrix"});
+
+
+bool EliminateDead(Program &prog, EliminateArgs &args, EliminateRets &rets)
+{
+    if(prog.PassesPerformed.count("PopulateGroups"))
+    {
+        gMsgUI.Error("EliminateDead must be applied before PopulateGroups.");
+        return false;
+    }
+
+    // backward liveness from the main task and from the tasks without outputs
+    auto &depindex = prog.GetDependencyIndex();
+    auto live = prog.TaskGraph.GetNodeSet();
+    std::vector<const Task*> worklist;
+    auto markproducers = [&](const Task &t)
+    {
+        for(auto *pdep : depindex.GetInDeps(t))
+        {
+            auto *pfrom = pdep->From.TheIface->GetTask();
+            if(pfrom != &prog.MainTask && !live.Contains(pfrom)) live.Insert(pfrom), worklist.push_back(pfrom);
+        }
+    };
+    markproducers(prog.MainTask);
+    for(auto &t : prog.GetTasks())
+    {
+        auto isinput = [](auto &iface) { return iface.GetPacket()->GetAccessType() == Packet::in; };
+        if(args.KeepSinks && !live.Contains(&t) && std::all_of(t.Ifaces.begin(), t.Ifaces.end(), isinput))
+            live.Insert(&t), worklist.push_back(&t);
+    }
+    while(!worklist.empty())
+    {
+        const Task *pt = worklist.back();
+        worklist.pop_back();
+        markproducers(*pt);
+    }
+
+    auto isdead = [&](const Task *pt) { return pt != &prog.MainTask && !live.Contains(pt); };
+    rets.Tasks.clear();
+    rets.Dependencies = 0;
+    rets.Bytes = 0;
+    for(auto &dep : prog.Dependencies)
+    {
+        if(!isdead(dep.To.TheIface->GetTask())) continue;
+        ++rets.Dependencies;
+        rets.Bytes += dep.GetMemSize();
+    }
+    auto itnewend = std::remove_if(prog.Dependencies.begin(), prog.Dependencies.end(),
+                                   [&](const Dependency &dep) { return isdead(dep.To.TheIface->GetTask()); });
+    prog.Dependencies.erase(itnewend, prog.Dependencies.end());
+
+    std::vector<Task*> dead;
+    for(auto &t : prog.GetTasks()) if(!live.Contains(&t)) dead.push_back(&t);
+    for(auto *pt : dead)
+    {
+        rets.Tasks.push_back(pt->GetFullName());
+        if(pt->Group) pt->Group->RemoveTask(pt);
+        prog.TaskGraph.RemoveNode(pt);
+    }
+    auto itgroupend = std::remove_if(prog.Groups.begin(), prog.Groups.end(), [](const std::unique_ptr<TaskGroup> &up)
+                                     { return up->GetTaskCount() == 0 && !up->GetDivision(); });
+    prog.Groups.erase(itgroupend, prog.Groups.end());
+
+    gMsgUI.Verbose("EliminateDead: removed %d tasks and %d dependencies (%.0f bytes)",
+                   (int) rets.Tasks.size(), rets.Dependencies, rets.Bytes);
+    return true;
+}
+
+} //namespace ::
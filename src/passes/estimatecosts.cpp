@@ -0,0 +1,126 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "lua/pass.h"
+#include "kernel.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "tools.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::spec::Packet;
+using Ladybirds::spec::Task;
+using Ladybirds::spec::WorkEstimate;
+
+namespace {
+
+struct EstimateCostsArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double OpCost = 1;      ///< Cost of one operation
+    double AccessCost = 0;  ///< Cost of one access to a packet element
+    bool Overwrite = false; ///< Whether to replace costs and access counts that are already set (e.g. by LoadCost)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("opcost", OpCost, false, 1.0)
+             & ls.IO("accesscost", AccessCost, false, 0.0)
+             & ls.IO("overwrite", Overwrite, false, false);
+    }
+};
+
+bool EstimateCosts(Program &prog, EstimateCostsArgs &args);
+
+/** Pass EstimateCosts: Sets the costs of the tasks (Task::Cost) and the access counts of their interfaces
+ *  (Iface::Reads and Iface::Writes) from the work estimates the parser derived from the kernel bodies (cf.
+ *  Kernel::Work), such that scheduling and mapping have reasonable inputs without a profiling run. The cost of a task
+ *  is opcost times its number of operations plus accesscost times its number of element accesses. Unless overwrite
+ *  is set, only costs that are still 0 and interfaces without any accesses are set. Tasks with loops whose number of
+ *  iterations cannot be determined statically (e.g. while loops or for loops with bounds depending on other loops)
+ *  count those loops as running once. **/
+Ladybirds::lua::PassWithArgs<EstimateCostsArgs> EstimateCostsPass("EstimateCosts", &EstimateCosts,
+    Ladybirds::lua::Pass::Requires{}, Ladybirds::lua::Pass::Destroys{},
+    Ladybirds::lua::Pass::Access{{"Tasks", "Kernels", "TaskCosts", "IfaceAccesses"},
+                                 {"TaskCosts", "IfaceAccesses"}});
+
+
+/// \internal Sets \p value to \p bound as evaluated for \p task, or returns false if it is not known
+bool BoundValue(const WorkEstimate::Bound &bound, const Task &task, long &value)
+{
+    if(bound.Derived < 0)
+    {
+        value = bound.Value;
+        return true;
+    }
+    auto &derived = task.GetDerivedParameters();
+    if(bound.Derived >= (int) derived.size() || derived[bound.Derived] == WorkEstimate::Unknown) return false;
+    value = derived[bound.Derived];
+    return true;
+}
+
+/// \internal Number of iterations of \p loop in \p task (1 if not known)
+double Iterations(const WorkEstimate::Loop &loop, const Task &task)
+{
+    long begin, end;
+    if(loop.Step == 0 || !BoundValue(loop.Begin, task, begin) || !BoundValue(loop.End, task, end)) return 1;
+    long span = (loop.Step > 0 ? end - begin : begin - end) + loop.Inclusive, step = std::abs(loop.Step);
+    return span > 0 ? (span + step - 1) / step : 0;
+}
+
+bool EstimateCosts(Program &prog, EstimateCostsArgs &args)
+{
+    int ncosts = 0, nifaces = 0, nmissing = 0;
+    for(auto &t : prog.GetTasks())
+    {
+        auto &loops = t.GetKernel()->Work.Loops;
+        if(loops.empty())
+        {
+            ++nmissing;
+            continue;
+        }
+
+        // number of runs of each loop body, and the resulting totals
+        std::vector<double> runs(loops.size());
+        double ops = 0;
+        std::vector<double> reads(t.Ifaces.size(), 0), writes(t.Ifaces.size(), 0);
+        for(size_t i = 0; i < loops.size(); ++i)
+        {
+            auto &loop = loops[i];
+            runs[i] = (loop.Parent < 0 ? 1 : runs[loop.Parent]) * Iterations(loop, t);
+            ops += runs[i] * loop.Ops;
+            for(size_t p = 0; p < t.Ifaces.size(); ++p)
+            {
+                double whole = runs[i] * loop.Whole[p] * Product(t.Ifaces[p].GetDimensions());
+                auto access = t.Ifaces[p].GetPacket()->GetAccessType();
+                reads[p] += runs[i] * loop.Reads[p] + (access != Packet::out ? whole : 0);
+                writes[p] += runs[i] * loop.Writes[p] + (access != Packet::in ? whole : 0);
+            }
+        }
+
+        double accesses = 0;
+        for(size_t p = 0; p < t.Ifaces.size(); ++p)
+        {
+            auto &iface = t.Ifaces[p];
+            accesses += reads[p] + writes[p];
+            if(!args.Overwrite && (iface.Reads != 0 || iface.Writes != 0)) continue;
+            iface.Reads = std::lround(reads[p]), iface.Writes = std::lround(writes[p]);
+            ++nifaces;
+        }
+        if(args.Overwrite || t.Cost == 0)
+        {
+            t.Cost = args.OpCost * ops + args.AccessCost * accesses;
+            ++ncosts;
+        }
+    }
+
+    gMsgUI.Verbose("EstimateCosts: Set %d task costs and the access counts of %d interfaces", ncosts, nifaces);
+    if(nmissing > 0) gMsgUI.Warning("EstimateCosts: No estimate for %d tasks (their kernels have no body)", nmissing);
+    return true;
+}
+
+} //namespace ::
@@ -1,14 +1,26 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <memory>
+
 #include "lua/luadump.h"
 #include "lua/luaenv.h"
+#include "lua/lualazydump.h"
 #include "lua/pass.h"
 #include "program.h"
 
 using Ladybirds::impl::Program;
 using Ladybirds::lua::Pass;
 
-/// Export pass: Stores the information contained in a Program object into lua tables for code generation
+struct ExportArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    bool Lazy = false;
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override {return ls.IO("lazy", Lazy, false);}
+};
+
+/// Export pass: Stores the information contained in a Program object into lua tables for code generation.
+/** With lazy=true, the tables of the tasks, interfaces, kernels, buffers etc. are only filled when the backend first
+ *  uses them (cf. LuaLazyDump). They keep the program alive, but must not be used anymore once another pass has been
+ *  applied to the program. **/
 class ExportPass : public Pass
 {
 public:
@@ -22,10 +34,28 @@ ExportPass MyExportPass("Export", nullptr);
 
 int ExportPass::Run(lua_State * lua)
 {
+    // put the program first, below the arguments, such that it stays on the stack (cf. LuaLazyDump)
+    if(lua_istable(lua, 1))
+    {
+        if(lua_getfield(lua, 1, "program") == LUA_TNIL)
+        {
+            lua_pop(lua, 1);
+            lua_rawgeti(lua, 1, 1);
+        }
+        if(lua_isnil(lua, -1)) lua_pop(lua, 1); //let GetProgram complain
+        else lua_insert(lua, 1);
+    }
     auto & prog = GetProgram(lua);
     CheckDependencies(lua, prog);
     
-    Ladybirds::lua::LuaDump ld(lua);
+    ExportArgs args;
+    if(lua_istable(lua, 2)) LoadExtraArgs(lua, args);
+    lua_settop(lua, 1);
+    
+    std::unique_ptr<Ladybirds::lua::LuaDump> upld;
+    if(args.Lazy) upld = std::make_unique<Ladybirds::lua::LuaLazyDump>(lua, 1, &prog.Revision);
+    else upld = std::make_unique<Ladybirds::lua::LuaDump>(lua);
+    auto & ld = *upld;
     
     //export the program to lua
     if(!ld.RawIO(prog)) return 0;
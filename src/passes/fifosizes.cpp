@@ -0,0 +1,246 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+#include "lua/pass.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Channel;
+using Ladybirds::impl::Program;
+using Ladybirds::impl::TaskGroup;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct FifoArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double Slack = 0; ///< Relative increase of the iteration period accepted in exchange for smaller FIFOs
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("slack", Slack, false, 0, 0);
+    }
+};
+
+struct FifoRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<int> Capacities; ///< Capacity of each channel in tokens, in the order of Program::Channels
+    double Period = 0;           ///< Iteration period with unbounded FIFOs (the inverse of the maximal throughput)
+    double SizedPeriod = 0;      ///< Iteration period with the calculated capacities
+    int Tokens = 0;              ///< Sum of the capacities
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("capacities", Capacities) & ls.IO("period", Period, false, 0)
+             & ls.IO("sizedperiod", SizedPeriod, false, 0) & ls.IO("tokens", Tokens);
+    }
+};
+
+bool FifoSizes(Program &prog, FifoArgs &args, FifoRets &rets);
+
+/** Pass FifoSizes: Calculates small FIFO capacities for the channels of a process network in which every group is a
+ *  process running its operations in order, and every channel carries one token per iteration (as in the DAL
+ *  backend). The network is modelled as a homogeneous synchronous dataflow graph whose actors are the tasks, taking
+ *  their costs (Task::Cost, cf. LoadCost and EstimateCosts; 1 each if no task has a cost). The sequence of each
+ *  process is a cycle with one initial token, and a channel of capacity c adds a reverse edge with c tokens. The
+ *  iteration period is the maximum cycle ratio of this graph (computed by Howard's policy iteration). Starting with a
+ *  capacity of 1, the capacities of the channels on the critical cycle are increased one token at a time until the
+ *  period is at most the period with unbounded FIFOs, plus slack (relative). Returns a table with the fields
+ *  capacities (in the order of the channels in Export), period, sizedperiod, the period achieved with the
+ *  capacities, and tokens, their sum. **/
+Ladybirds::lua::PassWithArgsAndRet<FifoArgs, FifoRets>
+    FifoSizesPass("FifoSizes", &FifoSizes, Pass::Requires{"PopulateGroups"});
+
+
+/// \internal Edge of the dataflow graph: the target can fire once the source has fired, Tokens iterations earlier
+struct FlowEdge
+{
+    int From, To;
+    double Weight; ///< Cost of the source actor
+    int Tokens;
+    int Channel;   ///< Index of the channel whose capacity this edge models, or -1
+};
+
+/// \internal Maximum cycle ratio (sum of weights / sum of tokens) of a graph in which every node has an outgoing edge
+/// and every cycle carries tokens, after Howard's policy iteration. Also returns the edges of a critical cycle.
+class CycleRatio
+{
+    const std::vector<FlowEdge> &Edges_;
+    std::vector<std::vector<int>> Out_; ///< Outgoing edges of each node
+    std::vector<int> Policy_;           ///< Chosen outgoing edge of each node
+    std::vector<double> Ratio_, Pot_;   ///< Cycle ratio reached by each node under the policy, and its potential
+
+    static constexpr double Eps = 1e-9;
+
+    /// \internal Computes Ratio_ and Pot_ of the current policy, and returns the start of its most critical cycle
+    int Evaluate()
+    {
+        int n = Out_.size(), best = -1;
+        std::vector<int> state(n, 0); // 0: unvisited, 1: on the current walk, 2: done
+        std::vector<int> walk;
+        for(int start = 0; start < n; ++start)
+        {
+            if(state[start]) continue;
+            walk.clear();
+            int v = start;
+            while(state[v] == 0) state[v] = 1, walk.push_back(v), v = Edges_[Policy_[v]].To;
+            if(state[v] == 1)
+            {   // closed a new cycle at v
+                double weight = 0;
+                int tokens = 0, u = v;
+                do weight += Edges_[Policy_[u]].Weight, tokens += Edges_[Policy_[u]].Tokens, u = Edges_[Policy_[u]].To;
+                while(u != v);
+                Ratio_[v] = weight / std::max(tokens, 1), Pot_[v] = 0, state[v] = 2;
+                if(best < 0 || Ratio_[v] > Ratio_[best] + Eps) best = v;
+            }
+            // the nodes of the walk before v take the ratio and the potential of their successors
+            for(auto it = walk.rbegin(); it != walk.rend(); ++it)
+            {
+                if(state[*it] == 2) continue;
+                auto &e = Edges_[Policy_[*it]];
+                Ratio_[*it] = Ratio_[e.To];
+                Pot_[*it] = e.Weight - Ratio_[e.To] * e.Tokens + Pot_[e.To];
+                state[*it] = 2;
+            }
+        }
+        return best;
+    }
+
+public:
+    CycleRatio(int nnodes, const std::vector<FlowEdge> &edges)
+        : Edges_(edges), Out_(nnodes), Policy_(nnodes, -1), Ratio_(nnodes), Pot_(nnodes)
+    {
+        for(int i = 0, m = edges.size(); i < m; ++i) Out_[edges[i].From].push_back(i);
+    }
+
+    /// Returns the maximum cycle ratio and stores the edges of a cycle achieving it in \p cycle
+    double Calc(std::vector<int> &cycle)
+    {
+        for(int v = 0, n = Out_.size(); v < n; ++v)
+        {
+            assert(!Out_[v].empty());
+            Policy_[v] = *std::max_element(Out_[v].begin(), Out_[v].end(),
+                                           [&](int a, int b) { return Edges_[a].Weight < Edges_[b].Weight; });
+        }
+        for(int iter = 0, maxiter = 100 * (Edges_.size() + 1); iter < maxiter; ++iter)
+        {
+            Evaluate();
+            bool changed = false;
+            for(int v = 0, n = Out_.size(); v < n; ++v) // first, move to edges that reach more critical cycles
+            {
+                for(int i : Out_[v])
+                {
+                    double ratio = Ratio_[Edges_[i].To];
+                    if(ratio > Ratio_[v] + Eps) Policy_[v] = i, Ratio_[v] = ratio, changed = true;
+                }
+            }
+            if(changed) continue;
+            for(int v = 0, n = Out_.size(); v < n; ++v) // then, to edges with higher potentials within the same ratio
+            {
+                for(int i : Out_[v])
+                {
+                    auto &e = Edges_[i];
+                    if(Ratio_[e.To] < Ratio_[v] - Eps) continue;
+                    double pot = e.Weight - Ratio_[e.To] * e.Tokens + Pot_[e.To];
+                    if(pot > Pot_[v] + Eps * (1 + std::abs(Pot_[v]))) Policy_[v] = i, Pot_[v] = pot, changed = true;
+                }
+            }
+            if(!changed) break;
+        }
+        int best = Evaluate();
+        cycle.clear();
+        if(best < 0) return 0;
+        int u = best;
+        do cycle.push_back(Policy_[u]), u = Edges_[Policy_[u]].To;
+        while(u != best);
+        return Ratio_[best];
+    }
+};
+
+
+bool FifoSizes(Program &prog, FifoArgs &args, FifoRets &rets)
+{
+    // the actors are the tasks, numbered by group and position
+    std::unordered_map<const Task*, int> index;
+    std::vector<double> costs;
+    bool anycost = false;
+    for(auto &upgroup : prog.Groups)
+    {
+        for(auto &upop : upgroup->GetOperations())
+        {
+            index.emplace(upop->TheTask, costs.size());
+            costs.push_back(std::max(upop->TheTask->Cost, 0.0));
+            anycost = anycost || upop->TheTask->Cost > 0;
+        }
+    }
+    if(!anycost) std::fill(costs.begin(), costs.end(), 1.0);
+
+    std::vector<FlowEdge> edges;
+    for(auto &upgroup : prog.Groups)
+    {
+        auto &ops = upgroup->GetOperations();
+        for(std::size_t i = 0; i < ops.size(); ++i)
+        {
+            int from = index.at(ops[i]->TheTask), to = index.at(ops[(i+1) % ops.size()]->TheTask);
+            edges.push_back({from, to, costs[from], i+1 == ops.size() ? 1 : 0, -1});
+        }
+    }
+    const int nchannels = prog.Channels.size();
+    std::vector<int> backedge(nchannels);
+    for(int c = 0; c < nchannels; ++c)
+    {
+        const Channel &chan = *prog.Channels[c];
+        int from = index.at(chan.From->GetIface()->GetTask()), to = index.at(chan.To->GetIface()->GetTask());
+        edges.push_back({from, to, costs[from], 0, -1});
+    }
+
+    std::vector<int> cycle;
+    {
+        CycleRatio unbounded(costs.size(), edges);
+        rets.Period = costs.empty() ? 0 : unbounded.Calc(cycle);
+    }
+    for(int c = 0; c < nchannels; ++c)
+    {
+        const Channel &chan = *prog.Channels[c];
+        int from = index.at(chan.From->GetIface()->GetTask()), to = index.at(chan.To->GetIface()->GetTask());
+        backedge[c] = edges.size();
+        edges.push_back({to, from, costs[to], 1, c});
+    }
+
+    // enlarge the FIFOs on the critical cycle until the period is reached; no capacity needs to exceed the number of
+    // actors, as every actor costs at most the period (it lies on the cycle of its process)
+    double target = rets.Period * (1 + args.Slack) * (1 + 1e-9);
+    CycleRatio sized(costs.size(), edges);
+    rets.SizedPeriod = costs.empty() ? 0 : sized.Calc(cycle);
+    while(rets.SizedPeriod > target)
+    {
+        auto it = std::find_if(cycle.begin(), cycle.end(), [&](int e)
+                               { return edges[e].Channel >= 0 && edges[e].Tokens <= (int) costs.size(); });
+        if(it == cycle.end())
+        {
+            gMsgUI.Error("FifoSizes: The critical cycle cannot be relieved by larger FIFOs.");
+            return false;
+        }
+        ++edges[*it].Tokens;
+        rets.SizedPeriod = sized.Calc(cycle);
+    }
+
+    rets.Capacities.resize(nchannels);
+    rets.Tokens = 0;
+    for(int c = 0; c < nchannels; ++c) rets.Tokens += rets.Capacities[c] = edges[backedge[c]].Tokens;
+    gMsgUI.Verbose("FifoSizes: %d tokens in %d FIFOs for an iteration period of %g (unbounded: %g)",
+                   rets.Tokens, nchannels, rets.SizedPeriod, rets.Period);
+    return true;
+}
+
+} //namespace ::
@@ -0,0 +1,157 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "lua/pass.h"
+#include "buffer.h"
+#include "dependency.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "packet.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Buffer;
+using Ladybirds::impl::Program;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct FuseArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int ScratchLimit = 256*1024; ///< Largest buffer that is moved to the scratch memory of a chain (0: none)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("scratchlimit", ScratchLimit, false, 256*1024);
+    }
+};
+
+/// An interface of a chain whose buffer is only used within the chain
+struct ScratchEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Task, Packet;
+    int Buffer = 0; ///< Number of the buffer within the chain, interfaces with the same number share it
+    int Size = 0;   ///< Size of the buffer in bytes
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("task", Task) & ls.IO("packet", Packet) & ls.IO("buffer", Buffer) & ls.IO("size", Size);
+    }
+};
+
+struct ChainEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<std::string> Tasks; ///< Names of the tasks, in the order in which they must run
+    std::vector<ScratchEntry> Scratch;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("tasks", Tasks) & ls.IO("scratch", Scratch);
+    }
+};
+
+struct FuseRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<ChainEntry> Chains;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("chains", Chains);
+    }
+};
+
+bool FuseChains(Program &prog, FuseArgs &args, FuseRets &rets);
+
+/** Pass FuseChains: Finds linear chains of tasks within the groups, where each task but the last has the next one as
+ *  its only successor, and each task but the first has the previous one as its only predecessor (cf. Dependencies;
+ *  the inputs and outputs of the metakernel do not count). A chain can run as one fused task without changing the
+ *  order of anything else. Buffers of at most scratchlimit bytes that no task outside the chain uses, such as the
+ *  intermediate packets passed along it, can live in scratch memory of the group that is reused by all its chains.
+ *  Returns a table with the field chains, which lists tasks and scratch for every chain of at least two tasks. The
+ *  scratch entries name the task and packet of each such interface, together with the number and size of its buffer
+ *  within the chain. **/
+Ladybirds::lua::PassWithArgsAndRet<FuseArgs, FuseRets>
+    FuseChainsPass("FuseChains", &FuseChains, Pass::Requires{"PopulateGroups", "BufferPreallocation"});
+
+
+bool FuseChains(Program &prog, FuseArgs &args, FuseRets &rets)
+{
+    std::unordered_map<const Task*, std::vector<const Task*>> preds, succs;
+    for(auto &t : prog.GetTasks()) preds[&t], succs[&t];
+    for(auto &dep : prog.Dependencies)
+    {
+        const Task *pfrom = dep.From.TheIface->GetTask(), *pto = dep.To.TheIface->GetTask();
+        if(pfrom == pto || preds.count(pfrom) == 0 || preds.count(pto) == 0) continue;
+        auto &list = preds[pto];
+        if(std::find(list.begin(), list.end(), pfrom) != list.end()) continue;
+        list.push_back(pfrom);
+        succs[pfrom].push_back(pto);
+    }
+    auto linked = [&](const Task *pfrom, const Task *pto)
+    {
+        return succs[pfrom].size() == 1 && preds[pto].size() == 1 && succs[pfrom].front() == pto
+            && pfrom->Group == pto->Group && pfrom->Group;
+    };
+
+    // the tasks of all buffers, to see which ones are only used within one chain
+    std::unordered_map<const Buffer*, std::unordered_set<const Task*>> users;
+    for(auto &t : prog.GetTasks()) for(auto &iface : t.Ifaces)
+    {
+        if(iface.GetBuffer()) users[iface.GetBuffer()].insert(&t);
+    }
+    users.erase(nullptr);
+
+    rets.Chains.clear();
+    int nfused = 0, nscratch = 0;
+    for(auto &t : prog.GetTasks())
+    {
+        const Task *phead = &t;
+        if(preds[phead].size() == 1 && linked(preds[phead].front(), phead)) continue; // not the start of a chain
+        std::vector<const Task*> chain = {phead};
+        while(succs[chain.back()].size() == 1 && linked(chain.back(), succs[chain.back()].front()))
+        {
+            chain.push_back(succs[chain.back()].front());
+        }
+        if(chain.size() < 2) continue;
+
+        rets.Chains.emplace_back();
+        auto &entry = rets.Chains.back();
+        std::unordered_set<const Task*> members(chain.begin(), chain.end());
+        std::unordered_map<const Buffer*, int> numbers;
+        for(auto *pt : chain)
+        {
+            entry.Tasks.push_back(pt->GetFullName());
+            for(auto &iface : pt->Ifaces)
+            {
+                const Buffer *pbuf = iface.GetBuffer();
+                if(!pbuf || pbuf->pExternalSource || pbuf->Size > args.ScratchLimit) continue;
+                auto &used = users[pbuf];
+                if(!std::all_of(used.begin(), used.end(), [&](const Task *p) { return members.count(p) != 0; }))
+                    continue;
+
+                auto it = numbers.emplace(pbuf, numbers.size()).first;
+                entry.Scratch.emplace_back();
+                auto &scratch = entry.Scratch.back();
+                scratch.Task = pt->GetFullName();
+                scratch.Packet = iface.GetPacket()->GetName();
+                scratch.Buffer = it->second;
+                scratch.Size = pbuf->Size;
+            }
+        }
+        nfused += chain.size();
+        nscratch += numbers.size();
+    }
+    gMsgUI.Verbose("FuseChains: %d tasks in %d chains, %d buffers in scratch memory",
+                   nfused, (int) rets.Chains.size(), nscratch);
+    return true;
+}
+
+} //namespace ::
@@ -0,0 +1,240 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lua/pass.h"
+#include "spec/platform.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::impl::TaskGroup;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Platform;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct BoundArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    Platform *pPlatform = nullptr;
+    double SyncCost = 0; ///< Worst-case time from the end of a task to the wake-up of a waiting group
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IOHandle("platform", pPlatform, nullptr, false) & ls.IO("synccost", SyncCost, false, 0, 0);
+    }
+};
+
+struct PathEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Task, Group;
+    double Start = 0, End = 0, Wcet = 0;
+    std::string Via;   ///< How the task was reached from the previous entry: "order", "sync" or "start"
+    double Comm = 0;   ///< Transfer time of the data from the previous entry (via "sync")
+    std::string Link;  ///< The memories of that transfer ("from->to"), empty if none was needed
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("task", Task) & ls.IO("group", Group) & ls.IO("start", Start) & ls.IO("end", End)
+             & ls.IO("wcet", Wcet) & ls.IO("via", Via) & ls.IO("comm", Comm) & ls.IO("link", Link);
+    }
+};
+
+struct BoundRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double Bound = 0;             ///< Upper bound of the makespan
+    int Estimated = 0;            ///< Number of tasks without a WCET, for which their cost was taken
+    std::vector<PathEntry> Path;  ///< The critical path, from the first task to the last
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("bound", Bound) & ls.IO("estimated", Estimated) & ls.IO("path", Path);
+    }
+};
+
+bool LatencyBound(Program &prog, BoundArgs &args, BoundRets &rets);
+
+/** Pass LatencyBound: Calculates an upper bound of the makespan of one run of the program when every group runs its
+ *  operations in their order on a core of its own (as pthreads-dynamic with -staticorder). Each task takes its
+ *  worst-case execution time (Task::Wcet, cf. LoadCost), or its cost if it has none. A task waiting for a task of
+ *  another group starts at the earliest synccost after that one ended, plus the time to transfer their data: zero if
+ *  the cores the groups are bound to share a memory, else the most expensive route of the platform between memories
+ *  of the two cores (cf. Platform::GetRouting), as the bound must hold wherever the data is placed. Without a
+ *  platform, transfers are free. Since the order within each group is fixed, a task cannot start later than this if
+ *  no task exceeds its WCET, which makes the bound safe. Returns a table with the fields bound, estimated, the number
+ *  of tasks without a WCET, and path, the critical path, listing task, group, start, end and wcet of each task, and
+ *  via, comm and link, how it waits for the previous one. **/
+Ladybirds::lua::PassWithArgsAndRet<BoundArgs, BoundRets>
+    LatencyBoundPass("LatencyBound", &LatencyBound, Pass::Requires{"PopulateGroups"});
+
+
+/// \internal Worst-case transfer between two bound cores: its time for \p size bytes, and the memories it takes
+struct Transfer
+{
+    double Time = 0;
+    std::string Link;
+};
+
+Transfer WorstTransfer(const Platform &platform, const Platform::Core &from, const Platform::Core &to, long size)
+{
+    Transfer ret;
+    if(&from == &to || size == 0) return ret;
+    auto &routing = platform.GetRouting();
+    bool reachable = false;
+    for(auto &efrom : from.pNode->OutEdges()) for(auto &eto : to.pNode->OutEdges())
+    {
+        auto *pfrom = efrom.GetTarget()->pMem, *pto = eto.GetTarget()->pMem;
+        if(!pfrom || !pto) continue;
+        if(pfrom == pto) return Transfer(); // the consumer reads the data where it was written
+        if(!routing.IsReachable(*pfrom, *pto)) continue;
+        double time = routing.GetCost(*pfrom, *pto).For(size);
+        if(!reachable || time > ret.Time) ret.Time = time, ret.Link = pfrom->Name + "->" + pto->Name;
+        reachable = true;
+    }
+    if(!reachable) ret.Time = -1;
+    return ret;
+}
+
+bool LatencyBound(Program &prog, BoundArgs &args, BoundRets &rets)
+{
+    // the tasks in the order of their groups, and the group order as edges from each task to the next
+    std::vector<const Task*> tasks;
+    std::vector<TaskGroup*> groups;
+    std::unordered_map<const Task*, int> index;
+    std::vector<int> next;
+    for(auto &upgroup : prog.Groups)
+    {
+        auto &ops = upgroup->GetOperations();
+        if(args.pPlatform && !ops.empty() && !upgroup->GetBinding())
+        {
+            gMsgUI.Error("LatencyBound: Group '%s' is not bound to a core. Pass a platform to LoadMapping.",
+                         upgroup->GetName().c_str());
+            return false;
+        }
+        for(std::size_t i = 0; i < ops.size(); ++i)
+        {
+            index.emplace(ops[i]->TheTask, tasks.size());
+            next.push_back(i+1 < ops.size() ? (int) tasks.size() + 1 : -1);
+            tasks.push_back(ops[i]->TheTask);
+            groups.push_back(upgroup.get());
+        }
+    }
+    const int ntasks = tasks.size();
+    if(ntasks == 0) return true;
+
+    // the waits for other groups, with their worst-case delays after the end of the source
+    struct Wait { int From; double Delay; Transfer Comm; };
+    std::vector<std::vector<Wait>> waits(ntasks);
+    std::vector<int> indegree(ntasks, 0);
+    for(int i = 0; i < ntasks; ++i) if(next[i] >= 0) ++indegree[next[i]];
+    for(auto &dep : prog.Dependencies)
+    {
+        auto itfrom = index.find(dep.From.TheIface->GetTask()), itto = index.find(dep.To.TheIface->GetTask());
+        if(itfrom == index.end() || itto == index.end() || itfrom->second == itto->second) continue;
+        int from = itfrom->second, to = itto->second;
+        if(groups[from] == groups[to])
+        {
+            if(from > to)
+            {
+                gMsgUI.Error("LatencyBound: Task %s runs before its predecessor %s in group %s.",
+                             tasks[to]->GetFullName().c_str(), tasks[from]->GetFullName().c_str(),
+                             groups[to]->GetName().c_str());
+                return false;
+            }
+            continue; // implied by the order of the group
+        }
+        Transfer comm;
+        if(args.pPlatform)
+        {
+            comm = WorstTransfer(*args.pPlatform, *groups[from]->GetBinding(), *groups[to]->GetBinding(),
+                                 dep.GetMemSize());
+            if(comm.Time < 0)
+            {
+                gMsgUI.Error("LatencyBound: No route for the data from %s to %s.",
+                             tasks[from]->GetFullName().c_str(), tasks[to]->GetFullName().c_str());
+                return false;
+            }
+        }
+        auto &list = waits[to];
+        auto it = std::find_if(list.begin(), list.end(), [from](const Wait &w) { return w.From == from; });
+        double delay = args.SyncCost + comm.Time;
+        if(it == list.end())
+        {
+            list.push_back({from, delay, std::move(comm)});
+            ++indegree[to];
+        }
+        else if(delay > it->Delay) *it = {from, delay, std::move(comm)};
+    }
+    std::vector<std::vector<int>> waiters(ntasks);
+    for(int i = 0; i < ntasks; ++i) for(auto &w : waits[i]) waiters[w.From].push_back(i);
+
+    // longest path in the order of the tasks becoming ready, remembering the predecessor that determined the start
+    rets.Estimated = 0;
+    std::vector<double> start(ntasks, 0), end(ntasks, 0), wcet(ntasks);
+    std::vector<int> prev(ntasks, -1), prevwait(ntasks, -1), ready;
+    std::vector<int> before(ntasks, -1);
+    for(int i = 0; i < ntasks; ++i)
+    {
+        if(next[i] >= 0) before[next[i]] = i;
+        wcet[i] = tasks[i]->Wcet > 0 ? tasks[i]->Wcet : std::max(tasks[i]->Cost, 0.0);
+        if(tasks[i]->Wcet <= 0) ++rets.Estimated;
+        if(indegree[i] == 0) ready.push_back(i);
+    }
+    int done = 0;
+    while(!ready.empty())
+    {
+        int t = ready.back();
+        ready.pop_back();
+        ++done;
+        if(before[t] >= 0) start[t] = end[before[t]], prev[t] = before[t];
+        prevwait[t] = -1;
+        for(int w = 0, n = waits[t].size(); w < n; ++w)
+        {
+            auto &wait = waits[t][w];
+            if(end[wait.From] + wait.Delay <= start[t]) continue;
+            start[t] = end[wait.From] + wait.Delay;
+            prev[t] = wait.From, prevwait[t] = w;
+        }
+        end[t] = start[t] + wcet[t];
+        if(next[t] >= 0 && --indegree[next[t]] == 0) ready.push_back(next[t]);
+        for(int succ : waiters[t]) if(--indegree[succ] == 0) ready.push_back(succ);
+    }
+    if(done < ntasks)
+    {
+        gMsgUI.Error("LatencyBound: The order of the groups contradicts the dependencies; the program would deadlock.");
+        return false;
+    }
+
+    int last = std::max_element(end.begin(), end.end()) - end.begin();
+    rets.Bound = end[last];
+    std::vector<PathEntry> path;
+    for(int t = last; t >= 0; t = prev[t])
+    {
+        PathEntry entry;
+        entry.Task = tasks[t]->GetFullName();
+        entry.Group = groups[t]->GetName();
+        entry.Start = start[t], entry.End = end[t], entry.Wcet = wcet[t];
+        entry.Via = prev[t] < 0 ? "start" : prevwait[t] < 0 ? "order" : "sync";
+        if(prevwait[t] >= 0)
+        {
+            auto &wait = waits[t][prevwait[t]];
+            entry.Comm = wait.Comm.Time;
+            entry.Link = wait.Comm.Link;
+        }
+        path.push_back(std::move(entry));
+    }
+    rets.Path.assign(path.rbegin(), path.rend());
+    gMsgUI.Verbose("LatencyBound: makespan at most %g, critical path of %d tasks (%d without a WCET)",
+                   rets.Bound, (int) rets.Path.size(), rets.Estimated);
+    return true;
+}
+
+} //namespace ::
@@ -0,0 +1,309 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "opt/ifaceassignment.h"
+#include "opt/schedule.h"
+#include "lua/pass.h"
+#include "spec/platform.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::lua::Pass;
+using Ladybirds::opt::IfaceAssignment;
+using Ladybirds::opt::Schedule;
+using Ladybirds::spec::Platform;
+
+namespace {
+
+struct ScheduleArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    Platform *pPlatform = nullptr;
+    int Weight = 0; ///< Weight of memory usage vs. ALAP time in the list scheduling priority
+    int Portfolio = 0; ///< Number of seeds for a portfolio search (cf. Schedule::MakePortfolio), 0 for a single run
+    int Threads = 0; ///< Number of threads for the portfolio search, 0 for one per hardware thread
+    std::string Trace; ///< File to write the final schedule to, in Chrome trace format (cf. Schedule::WriteTrace)
+    bool Exact = false; ///< Whether to improve the schedule by an exact solver (cf. Schedule::CalcExactSchedule)
+    double TimeLimit = 60; ///< Seconds the exact solver may take
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IOHandle("platform", pPlatform, nullptr)
+             & ls.IO("weight", Weight, false, 0)
+             & ls.IO("portfolio", Portfolio, false, 0)
+             & ls.IO("threads", Threads, false, 0)
+             & ls.IO("trace", Trace, false)
+             & ls.IO("exact", Exact, false, false)
+             & ls.IO("timelimit", TimeLimit, false, 60, 0);
+    }
+};
+
+struct TimingEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Task, Core;
+    double Start = 0, End = 0, Slack = 0;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("task", Task) & ls.IO("core", Core)
+             & ls.IO("start", Start) & ls.IO("end", End) & ls.IO("slack", Slack);
+    }
+};
+
+struct IfaceMemEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Iface, Memory;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("iface", Iface) & ls.IO("memory", Memory);
+    }
+};
+
+struct SpillEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string From, To, Memory;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("from", From) & ls.IO("to", To) & ls.IO("memory", Memory);
+    }
+};
+
+struct PeakEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Memory;
+    int Peak = 0, Size = 0;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("memory", Memory) & ls.IO("peak", Peak) & ls.IO("size", Size);
+    }
+};
+
+struct ScheduleRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<TimingEntry> Timings;
+    double Makespan = 0;
+    double Heuristic = 0; ///< Makespan of the list schedule (with exact only)
+    double Bound = 0;     ///< Proven lower bound of the makespan (with exact only)
+    double Gap = 0;       ///< Relative gap between makespan and bound (with exact only)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("timings", Timings) & ls.IO("makespan", Makespan) & ls.IO("heuristic", Heuristic, false)
+             & ls.IO("bound", Bound, false) & ls.IO("gap", Gap, false);
+    }
+};
+
+struct AssignmentRets : public ScheduleRets
+{
+    std::vector<IfaceMemEntry> IfaceMemories;
+    std::vector<SpillEntry> Spills;
+    std::vector<PeakEntry> Peaks;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ScheduleRets::LoadStoreMembers(ls) & ls.IO("ifacememories", IfaceMemories)
+             & ls.IO("spills", Spills) & ls.IO("peaks", Peaks);
+    }
+};
+
+bool ListSchedule(Program &prog, ScheduleArgs &args, ScheduleRets &rets);
+void ExportTimings(const Program &prog, const Schedule &sched, ScheduleRets &rets);
+bool RunExact(const Program &prog, Schedule &sched, const ScheduleArgs &args, bool movetasks, ScheduleRets &rets);
+bool AssignIfaces(Program &prog, ScheduleArgs &args, AssignmentRets &rets);
+
+/** Pass ListSchedule: Calculates a static schedule of the bound groups on the given platform (cf. opt::Schedule).
+ *  If portfolio is given, a portfolio of weights, priorities and tie-breaking seeds is tried in parallel, and the
+ *  schedule with the shortest makespan is kept. Returns a table with the fields timings, which lists core, start, end
+ *  and slack of each task, and makespan. Portfolio strategies may move tasks to other cores of the same type, or
+ *  of a type on which the task has a cost of its own (Task::TypeCosts, cf. LoadCost).
+ *  If trace is given, the schedule is also written to this file in Chrome trace format. With exact, the schedule is
+ *  then improved by solving the scheduling problem as a mixed integer linear program, starting from the list schedule,
+ *  for at most timelimit seconds (default: 60; cf. Schedule::CalcExactSchedule, which needs ladybirds to be built
+ *  with HiGHS). Tasks may then move to cores sharing a memory with theirs if portfolio is given. The table
+ *  additionally holds heuristic, the makespan of the list schedule, bound, a proven lower bound of the makespan, and
+ *  gap, the relative difference between makespan and bound. **/
+Ladybirds::lua::PassWithArgsAndRet<ScheduleArgs, ScheduleRets>
+    ListSchedulePass("ListSchedule", &ListSchedule, Pass::Requires{"LoadMapping"});
+
+/** Pass AssignIfaces: Schedules the program like ListSchedule and then assigns the task interfaces to memories of
+ *  the platform (cf. opt::IfaceAssignment). Finally, the program is rescheduled with this assignment such that it fits
+ *  into the memories, spilling data where necessary (cf. Schedule::CalcScheduleWithSpills). The returned table
+ *  contains the same fields as for ListSchedule (for the final schedule), and additionally ifacememories, a list of
+ *  interface names with the memory they have been assigned to, spills, a list of the dependencies (from and to
+ *  interface) that are spilled to another memory, and peaks, the maximum occupation and the size of each memory.
+ *  Tasks always stay on the cores their groups are bound to. The trace of the final schedule includes the DMA
+ *  transfers and the memory occupation. With the assignment, tasks and transfers that access a memory with limited
+ *  ports (cf. addmem{ports=}) at the same time as others slow down accordingly. With exact, the final schedule, with
+ *  its DMA transfers, is improved as in ListSchedule. **/
+Ladybirds::lua::PassWithArgsAndRet<ScheduleArgs, AssignmentRets>
+    AssignIfacesPass("AssignIfaces", &AssignIfaces, Pass::Requires{"LoadMapping"});
+
+
+/// \internal Checks that every task is in a group that is bound to a core of the platform, as opt::Schedule needs it
+bool CheckBindings(const Program &prog)
+{
+    bool ret = true;
+    for(auto &t : prog.GetTasks())
+    {
+        if(!t.Group || !t.Group->GetBinding())
+        {
+            gMsgUI.Error("Task '%s' is not bound to a processing element. Pass a platform to LoadMapping.",
+                         t.GetFullName().c_str());
+            ret = false;
+        }
+    }
+    return ret;
+}
+
+/// \internal Performs the list scheduling requested by \p args and stores its results in \p rets
+std::unique_ptr<Schedule> RunSchedule(Program &prog, ScheduleArgs &args, ScheduleRets &rets, bool fixedcores)
+{
+    if(!CheckBindings(prog)) return nullptr;
+
+    std::unique_ptr<Schedule> upsched;
+    if(args.Portfolio > 0)
+    {
+        auto strategies = Schedule::MakePortfolio(args.Weight, args.Portfolio);
+        if(fixedcores)
+        {
+            strategies.erase(std::remove_if(strategies.begin(), strategies.end(), 
+                                            [](auto &s) { return s.Place != Schedule::Placement::Fixed; }),
+                             strategies.end());
+        }
+        upsched = Schedule::CalcBestSchedule(prog, *args.pPlatform, strategies, nullptr, nullptr, args.Threads);
+    }
+    else
+    {
+        upsched = std::make_unique<Schedule>(prog, *args.pPlatform);
+        if(!upsched->CalcSchedule(args.Weight, nullptr, nullptr)) upsched.reset();
+    }
+    if(!upsched)
+    {
+        gMsgUI.Error("List scheduling failed.");
+        return nullptr;
+    }
+
+    Ladybirds::lua::RecordScratchBytes(sizeof(Schedule) + upsched->GetHeapBytes());
+    ExportTimings(prog, *upsched, rets);
+    return upsched;
+}
+
+/// \internal Writes \p sched to the trace file given in \p args, if any
+bool WriteTrace(const Schedule &sched, const ScheduleArgs &args)
+{
+    if(args.Trace.empty()) return true;
+    std::ofstream strm(args.Trace);
+    if(!strm.is_open())
+    {
+        perror(args.Trace.c_str());
+        return false;
+    }
+    sched.WriteTrace(strm);
+    return strm.good();
+}
+
+void ExportTimings(const Program &prog, const Schedule &sched, ScheduleRets &rets)
+{
+    auto tt = sched.GetTaskTimings();
+    auto cores = sched.GetTaskCores();
+    rets.Timings.clear();
+    rets.Timings.reserve(prog.GetTasks().size());
+    for(auto &t : prog.GetTasks())
+    {
+        rets.Timings.emplace_back();
+        auto &entry = rets.Timings.back();
+        entry.Task = t.GetFullName();
+        entry.Core = cores[t]->Name;
+        entry.Start = tt[t].Start, entry.End = tt[t].End, entry.Slack = tt[t].Slack;
+    }
+    rets.Makespan = sched.GetMakespan();
+}
+
+/// \internal Improves \p sched with the exact solver if \p args ask for it, and exports the result to \p rets
+bool RunExact(const Program &prog, Schedule &sched, const ScheduleArgs &args, bool movetasks, ScheduleRets &rets)
+{
+    if(!args.Exact) return true;
+    Schedule::ExactOptions options;
+    options.TimeLimit = args.TimeLimit;
+    options.MoveTasks = movetasks;
+    Schedule::ExactResult result;
+    if(!sched.CalcExactSchedule(options, result)) return false;
+    ExportTimings(prog, sched, rets);
+    rets.Heuristic = result.Heuristic;
+    rets.Bound = result.Bound;
+    rets.Gap = result.Gap;
+    return true;
+}
+
+bool ListSchedule(Program &prog, ScheduleArgs &args, ScheduleRets &rets)
+{
+    auto upsched = RunSchedule(prog, args, rets, false);
+    return upsched && RunExact(prog, *upsched, args, args.Portfolio > 0, rets) && WriteTrace(*upsched, args);
+}
+
+bool AssignIfaces(Program &prog, ScheduleArgs &args, AssignmentRets &rets)
+{
+    auto upsched = RunSchedule(prog, args, rets, true);
+    if(!upsched) return false;
+
+    auto mapping = upsched->GetTaskCores();
+    IfaceAssignment assignment(prog, *args.pPlatform, mapping);
+    if(!assignment.CalcAssignment(args.Weight, *upsched))
+    {
+        gMsgUI.Error("Interface assignment failed.");
+        return false;
+    }
+
+    auto ifacemapping = assignment.GetIfaceMapping();
+    for(auto &t : prog.GetTasks()) for(auto &iface : t.Ifaces)
+    {
+        rets.IfaceMemories.emplace_back();
+        rets.IfaceMemories.back().Iface = iface.GetFullName();
+        rets.IfaceMemories.back().Memory = ifacemapping.at(&iface)->Name;
+    }
+
+    // Reschedule with the memories now known, so that the schedule reflects the transfers and fits into memory
+    Schedule::SpillMapping spills;
+    Schedule::Strategy strategy;
+    strategy.Weight = args.Weight;
+    Schedule memsched(prog, *args.pPlatform);
+    if(!memsched.CalcScheduleWithSpills(strategy, ifacemapping, spills)) return false;
+    ExportTimings(prog, memsched, rets);
+    if(!RunExact(prog, memsched, args, false, rets)) return false;
+    
+    for(auto &dep : prog.Dependencies)
+    {
+        auto *pspillmem = spills.at(&dep);
+        if(!pspillmem) continue;
+        rets.Spills.emplace_back();
+        auto &spill = rets.Spills.back();
+        spill.From = dep.From.TheIface->GetFullName();
+        spill.To = dep.To.TheIface->GetFullName();
+        spill.Memory = pspillmem->Name;
+    }
+    
+    auto peaks = memsched.GetPeakOccupancy();
+    for(auto &mem : args.pPlatform->GetMemories())
+    {
+        rets.Peaks.emplace_back();
+        rets.Peaks.back().Memory = mem.Name;
+        rets.Peaks.back().Peak = peaks[mem.Index];
+        rets.Peaks.back().Size = mem.Size;
+    }
+    return WriteTrace(memsched, args);
+}
+
+} //namespace ::
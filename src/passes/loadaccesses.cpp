@@ -1,7 +1,9 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <algorithm>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "lua/luaenv.h"
 #include "lua/luaload.h"
@@ -9,6 +11,7 @@
 #include "loadstore.h"
 #include "msgui.h"
 #include "program.h"
+#include "recordfile.h"
 #include "task.h"
 
 
@@ -74,14 +77,68 @@ public:
         for(auto &t : Taskgraph.Nodes())
         {
             TaskAccessesLoader tal(t);
-            ret &= ls.IO(t.Name.c_str(), tal);
+            ret &= ls.IO(t.GetFullName().c_str(), tal);
         }
         return ret;
     }
 };
 
+/// \internal Loads the record file \p file of the instrumentation runtime (cf. ladybirds.h), in which every line holds
+/// the full name of a task followed by the name, read and write count of each of its packets. The tasks are looked up
+/// as the lines are read, so only the line being read is held in memory.
+bool LoadAccessRecords(Ladybirds::impl::Program &prog, Ladybirds::tools::RecordFile & file)
+{
+    Ladybirds::spec::TaskNameIndex tasks;
+    for(auto & t : prog.GetTasks()) tasks.Add(t);
+    std::unordered_set<const Task*> given;
+    
+    bool ret = true;
+    int nunknown = 0;
+    while(file.Next())
+    {
+        auto * ptask = tasks.Find(file[0]);
+        if(!ptask)
+        {
+            ++nunknown;
+            continue;
+        }
+        if(file.Size() != 3 * int(ptask->Ifaces.size()) + 1)
+        {
+            file.Error("Invalid access statistics for %s. Expected: name reads writes, for each of its %d packets",
+                       ptask->GetFullName().c_str(), int(ptask->Ifaces.size()));
+            ret = false;
+            continue;
+        }
+        for(int i = 1; i < file.Size(); i += 3)
+        {
+            auto itiface = std::find_if(ptask->Ifaces.begin(), ptask->Ifaces.end(),
+                                        [&](auto & iface){ return iface.GetName() == file[i]; });
+            if(itiface == ptask->Ifaces.end())
+            {
+                file.Error("Task %s has no packet %s", ptask->GetFullName().c_str(), file[i]);
+                ret = false;
+            }
+            else ret &= file.Number(i+1, itiface->Reads) & file.Number(i+2, itiface->Writes);
+        }
+        given.insert(ptask);
+    }
+    
+    if(nunknown > 0) gMsgUI.Warning("%s: Access statistics of %d unknown task instances ignored", 
+                                    file.GetFilename().c_str(), nunknown);
+    for(auto & t : prog.GetTasks())
+    {
+        if(given.count(&t) != 0) continue;
+        gMsgUI.Error("No access statistics for task %s", t.GetFullName().c_str());
+        ret = false;
+    }
+    return ret;
+}
+
 bool LoadAccesses(Ladybirds::impl::Program &prog, AccessArgs &args)
 {
+    Ladybirds::tools::RecordFile file;
+    if(file.Open(args.Filename, "accesses")) return LoadAccessRecords(prog, file);
+    
     Ladybirds::lua::LuaEnv lua;
     if(!lua.DoFile(args.Filename.c_str())) return false;
     lua_getglobal(lua, "accesses");
@@ -1,7 +1,9 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <cstring>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "lua/luaenv.h"
 #include "lua/luaload.h"
@@ -9,6 +11,7 @@
 #include "loadstore.h"
 #include "msgui.h"
 #include "program.h"
+#include "recordfile.h"
 #include "task.h"
 
 
@@ -21,37 +24,185 @@ struct CostArgs : public Ladybirds::loadstore::LoadStorableCompound
     virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override {return ls.IO("filename", Filename); }
 };
 
+/// Costs by core type (spec::Platform::CoreType::Name), the empty name standing for Task::Cost
+template<typename T> using ByType = std::unordered_map<std::string, T>;
+using CostTable = std::unordered_map<std::string, double>;
+
 static bool LoadCost(Ladybirds::impl::Program &prog, CostArgs & args);
+static bool LoadCostTables(const std::string & filename, ByType<CostTable> & costs, ByType<CostTable> & kernelcosts,
+                           CostTable & wcets, CostTable & kernelwcets);
+
+/** Pass LoadCost: Loads the costs of the tasks (Task::Cost) from filename, either a record file (cf.
+ *  tools::RecordFile) of kind "costs" or a Lua file defining a table costs (by full task name) and/or a table
+ *  kernelcosts (by kernel name, for all tasks without a cost of their own). For heterogeneous platforms, costs on
+ *  particular core types (Task::TypeCosts) are given by an optional fourth field of the records, or in a Lua table
+ *  coretypecosts, which contains tables costs and kernelcosts per core type name. A negative cost means that the task
+ *  cannot run on cores of that type (cf. opt::Schedule). Worst-case execution times (Task::Wcet, cf. LatencyBound) are
+ *  given by the records "wcet <task> <time>" and "kernelwcet <kernel> <time>", or the Lua tables wcets and kernelwcets,
+ *  in the same way as the costs; tasks without one keep their current value. A file may give only WCETs, in which case
+ *  the costs are left unchanged. **/
+Ladybirds::lua::PassWithArgs<CostArgs> LoadCostPass("LoadCost", &LoadCost, Ladybirds::lua::Pass::Requires{},
+    Ladybirds::lua::Pass::Destroys{}, Ladybirds::lua::Pass::Access{{"Tasks", "Kernels"}, {"TaskCosts"}});
+
+/// \internal Sets the cost of \p t on cores of type \p coretype (empty: Task::Cost)
+static void SetCost(Task & t, const std::string & coretype, double cost)
+{
+    if(coretype.empty()) t.Cost = cost;
+    else t.TypeCosts[coretype] = cost;
+}
 
-Ladybirds::lua::PassWithArgs<CostArgs> LoadCostPass("LoadCost", &LoadCost);
+/// \internal Reads the record file \p file, with lines "task <full name> <cost> [<core type>]" and
+/// "kernel <name> <cost> [<core type>]", into \p kernelcosts and directly into the tasks, which are looked up in
+/// \p tasks while reading, and the lines "wcet <full name> <time>" and "kernelwcet <name> <time>" into \p wcets and
+/// \p kernelwcets. Returns false on errors.
+static bool LoadCostRecords(Ladybirds::tools::RecordFile & file, const Ladybirds::spec::TaskNameIndex & tasks,
+                            ByType<std::unordered_set<const Task*>> & given, ByType<CostTable> & kernelcosts,
+                            CostTable & wcets, CostTable & kernelwcets)
+{
+    bool ret = true;
+    while(file.Next())
+    {
+        bool istask = strcmp(file[0], "task") == 0;
+        bool iswcet = strcmp(file[0], "wcet") == 0, iskernelwcet = strcmp(file[0], "kernelwcet") == 0;
+        double cost;
+        if(iswcet || iskernelwcet)
+        {
+            if(file.Size() != 3)
+            {
+                file.Error("Expected 'wcet <name> <time>' or 'kernelwcet <name> <time>'");
+                ret = false;
+            }
+            else if(!file.Number(2, cost)) ret = false;
+            else (iswcet ? wcets : kernelwcets)[file[1]] = cost;
+            continue;
+        }
+        if((file.Size() != 3 && file.Size() != 4) || (!istask && strcmp(file[0], "kernel") != 0))
+        {
+            file.Error("Expected 'task <name> <cost> [<core type>]' or 'kernel <name> <cost> [<core type>]'");
+            ret = false;
+            continue;
+        }
+        if(!file.Number(2, cost))
+        {
+            ret = false;
+            continue;
+        }
+        std::string coretype = file.Size() == 4 ? file[3] : "";
+        if(!istask) kernelcosts[coretype][file[1]] = cost;
+        else if(auto * ptask = tasks.Find(file[1]))
+        {
+            SetCost(*ptask, coretype, cost);
+            given[coretype].insert(ptask);
+        }
+    }
+    return ret;
+}
 
 static bool LoadCost(Ladybirds::impl::Program &prog, CostArgs & args)
+{
+    Ladybirds::spec::TaskNameIndex tasks;
+    for(auto & t : prog.GetTasks()) tasks.Add(t);
+    ByType<std::unordered_set<const Task*>> given;
+    ByType<CostTable> costs, kernelcosts;
+    CostTable wcets, kernelwcets;
+    
+    Ladybirds::tools::RecordFile file;
+    if(file.Open(args.Filename, "costs"))
+    {
+        if(!LoadCostRecords(file, tasks, given, kernelcosts, wcets, kernelwcets)) return false;
+    }
+    else if(!LoadCostTables(args.Filename, costs, kernelcosts, wcets, kernelwcets)) return false;
+    
+    //the WCETs by task name first, then by kernel for the others
+    std::unordered_set<const Task*> wcetgiven;
+    for(auto & entry : wcets)
+    {
+        if(auto * ptask = tasks.Find(entry.first))
+        {
+            ptask->Wcet = entry.second;
+            wcetgiven.insert(ptask);
+        }
+    }
+    if(!kernelwcets.empty()) for(auto & t : prog.GetTasks())
+    {
+        if(wcetgiven.count(&t) != 0) continue;
+        auto it = kernelwcets.find(t.GetKernel()->Name);
+        if(it != kernelwcets.end()) t.Wcet = it->second;
+    }
+    if(given.empty() && costs.empty() && kernelcosts.empty()) return true; //only WCETs
+    
+    //look up the tasks of the costs tables by name, then fall back to the kernel costs for the others
+    for(auto & typecosts : costs) for(auto & entry : typecosts.second)
+    {
+        if(auto * ptask = tasks.Find(entry.first))
+        {
+            SetCost(*ptask, typecosts.first, entry.second);
+            given[typecosts.first].insert(ptask);
+        }
+    }
+    auto & defaultkernelcosts = kernelcosts[""];
+    for(auto & t : prog.GetTasks())
+    {
+        if(given[""].count(&t) != 0) continue;
+        auto it = defaultkernelcosts.find(t.GetKernel()->Name);
+        if(it != defaultkernelcosts.end()) t.Cost = it->second;
+        else gMsgUI.Warning("No cost defined for task %s, nor for its kernel %s",
+                            t.GetFullName().c_str(), t.GetKernel()->Name.c_str());
+    }
+    for(auto & typecosts : kernelcosts)
+    {
+        if(typecosts.first.empty()) continue;
+        auto & typegiven = given[typecosts.first];
+        for(auto & t : prog.GetTasks())
+        {
+            if(typegiven.count(&t) != 0) continue;
+            auto it = typecosts.second.find(t.GetKernel()->Name);
+            if(it != typecosts.second.end()) t.TypeCosts[typecosts.first] = it->second;
+        }
+    }
+    return true;
+}
+
+/// \internal The tables costs and kernelcosts of one core type in the Lua table coretypecosts
+struct TypeCostTables : public Ladybirds::loadstore::LoadStorableCompound
+{
+    CostTable Costs, KernelCosts;
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("costs", Costs, false, -DBL_MAX) & ls.IO("kernelcosts", KernelCosts, false, -DBL_MAX);
+    }
+};
+
+/// \internal Loads the tables costs, kernelcosts, coretypecosts, wcets and kernelwcets of the Lua file \p filename
+static bool LoadCostTables(const std::string & filename, ByType<CostTable> & costs, ByType<CostTable> & kernelcosts,
+                           CostTable & wcets, CostTable & kernelwcets)
 {
     Ladybirds::lua::LuaEnv lua;
-    if(!lua.DoFile(args.Filename.c_str())) return false;
+    if(!lua.DoFile(filename.c_str())) return false;
     lua_getglobal(lua, "costs");
     lua_getglobal(lua, "kernelcosts");
-    bool havecosts = !lua_isnil(lua, -2), havekernelcosts = !lua_isnil(lua, -1);
-    if(!havecosts && !havekernelcosts)
+    lua_getglobal(lua, "coretypecosts");
+    lua_getglobal(lua, "wcets");
+    lua_getglobal(lua, "kernelwcets");
+    bool havecosts = !lua_isnil(lua, -5), havekernelcosts = !lua_isnil(lua, -4), havetypecosts = !lua_isnil(lua, -3);
+    bool havewcets = !lua_isnil(lua, -2), havekernelwcets = !lua_isnil(lua, -1);
+    if(!havecosts && !havekernelcosts && !havetypecosts && !havewcets && !havekernelwcets)
     {
-        gMsgUI.Error("Cost specification neither defines 'costs' table nor a 'kernelcosts' table");
+        gMsgUI.Error("Cost specification defines none of the tables 'costs', 'kernelcosts', 'coretypecosts', 'wcets' "
+                     "and 'kernelwcets'");
         return false;
     }
         
     Ladybirds::lua::LuaLoad load(lua);
-    std::unordered_map<std::string, double> costs, kernelcosts;
-
     lua_pushglobaltable(lua);
-    if(havecosts && !load.IO("costs", costs)) return false;
-    if(havekernelcosts && !load.IO("kernelcosts", kernelcosts)) return false;
-    
-    for(auto & t : prog.GetTasks())
+    Ladybirds::loadstore::LoadStore::Table<TypeCostTables> typecosts;
+    if(!((!havecosts || load.IO("costs", costs[""])) && (!havekernelcosts || load.IO("kernelcosts", kernelcosts[""]))
+         && (!havetypecosts || load.IO("coretypecosts", typecosts)) && (!havewcets || load.IO("wcets", wcets))
+         && (!havekernelwcets || load.IO("kernelwcets", kernelwcets)))) return false;
+    for(auto & entry : typecosts)
     {
-        auto it = costs.find(t.Name);
-        if(it != costs.end() || (it = kernelcosts.find(t.GetKernel()->Name)) != kernelcosts.end())
-            t.Cost = it->second;
-        else gMsgUI.Warning("No cost defined for task %s, nor for its kernel %s",
-                            t.Name.c_str(), t.GetKernel()->Name.c_str());
+        costs[entry.first] = std::move(entry.second.Costs);
+        kernelcosts[entry.first] = std::move(entry.second.KernelCosts);
     }
     return true;
 }
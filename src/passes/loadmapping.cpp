@@ -1,8 +1,12 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <cstdlib>
+#include <map>
 #include <memory>
+#include <regex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "opt/bankassignment.h"
 #include "opt/cacheindexopt.h"
@@ -33,8 +37,68 @@ struct MappingArgs : public Ladybirds::loadstore::LoadStorableCompound
 
 bool LoadMapping(Ladybirds::impl::Program &prog, MappingArgs & args);
 
+/** Pass LoadMapping: Loads the groups of the tasks from the mapping file filename, and binds them to the cores of the
+ *  same names of platform, if given. The file assigns tasks by their full names in the table grouping
+ *  (["name"] = "group"), and/or by the list rules, whose entries select tasks by pattern, a glob over the full name
+ *  ('*' for any characters, '?' for one), or regex (ECMAScript, matching the whole name), optionally restricted by
+ *  range = {first, last} to the tasks whose name ends in an index ("[i]") within these bounds. A rule assigns the
+ *  tasks to group, or distributes them over the list groups, in the order of the tasks, either round-robin (the
+ *  default) or in contiguous blocks (distribute = "block"). Names in grouping take precedence, then the first
+ *  matching rule. The rules are evaluated here for all tasks at once, so their cost is linear in the number of tasks.
+ *  The optional table divisions lists the groups of each division. **/
 Ladybirds::lua::PassWithArgs<MappingArgs> LoadMappingPass("LoadMapping", &LoadMapping);
 
+
+namespace {
+
+//! A pattern rule of a mapping file (see above)
+struct MappingRule : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Pattern, Regex;
+    std::vector<int> Range;          ///< {first, last} index, or empty for any
+    std::string Group;
+    std::vector<std::string> Groups;
+    std::string Distribute;          ///< "roundrobin" or "block"
+    
+    std::regex Compiled;
+    std::vector<Task*> Matched;
+    
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("pattern", Pattern, false) & ls.IO("regex", Regex, false) & ls.IO("range", Range, false)
+             & ls.IO("group", Group, false) & ls.IO("groups", Groups, false)
+             & ls.IO("distribute", Distribute, false, "roundrobin");
+    }
+};
+
+//! Returns whether \p name matches the glob \p pattern ('*' matches any sequence of characters, '?' any one)
+bool GlobMatch(const std::string & pattern, const std::string & name)
+{
+    std::size_t p = 0, n = 0, star = std::string::npos, resume = 0;
+    while(n < name.size())
+    {
+        if(p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) ++p, ++n;
+        else if(p < pattern.size() && pattern[p] == '*') star = p++, resume = n;
+        else if(star != std::string::npos) p = star + 1, n = ++resume;
+        else return false;
+    }
+    while(p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
+}
+
+//! Returns the index at the end of \p name ("...[i]") in \p index, or false if there is none
+bool LastIndex(const std::string & name, long & index)
+{
+    if(name.empty() || name.back() != ']') return false;
+    auto open = name.rfind('[');
+    if(open == std::string::npos || open + 2 > name.size() - 1) return false;
+    char * end;
+    index = std::strtol(name.c_str() + open + 1, &end, 10);
+    return end == name.c_str() + name.size() - 1;
+}
+
+} //namespace ::
+
 bool LoadMapping(Ladybirds::impl::Program &prog, MappingArgs & args)
 {
     Ladybirds::lua::LuaEnv lua;
@@ -47,19 +111,29 @@ bool LoadMapping(Ladybirds::impl::Program &prog, MappingArgs & args)
      * Sorting is done directly in lua, because this is easier and groups are correctly sorted even when the group name
      * is an integer. */
     if(!lua.DoFile(args.Filename.c_str()) || !lua.DoString(R"(
-            if grouping == nil then error("Mapping specification doesn't define 'grouping' table"); end
+            if grouping == nil and rules == nil then
+                error("Mapping specification defines neither a 'grouping' nor a 'rules' table");
+            end
                                                               
             Groups = {};
             local groupmap = {};
-            for taskname,groupname in pairs(grouping) do
+            local getgroup = function(groupname)
                 local group = groupmap[groupname];
                 if group == nil then
                     group = {name=groupname, tasks={}};
                     groupmap[groupname] = group;
                     Groups[#Groups+1] = group;
                 end
+                return group;
+            end
+            for taskname,groupname in pairs(grouping or {}) do
+                local group = getgroup(groupname);
                 group.tasks[#group.tasks+1] = taskname;
             end
+            for _,rule in ipairs(rules or {}) do
+                if rule.group ~= nil then getgroup(rule.group); end
+                for _,groupname in ipairs(rule.groups or {}) do getgroup(groupname); end
+            end
             
             table.sort(Groups, function(a,b) return a.name < b.name; end);
         )", "while processing the mapping file")) return false;
@@ -79,33 +153,92 @@ bool LoadMapping(Ladybirds::impl::Program &prog, MappingArgs & args)
 
     std::vector<groupdesc> groupdescs;
     std::vector<std::vector<std::string>> divdescs;
+    std::vector<MappingRule> rules;
     if(!load.IO("Groups", groupdescs) ||
-        !load.IO("divisions", divdescs, false))
+        !load.IO("divisions", divdescs, false) ||
+        !load.IO("rules", rules, false))
         return false;
     
     //create a name to task index dictionary
-    std::unordered_map<string, Task*> tasks; //task indices
+    Ladybirds::spec::TaskNameIndex tasks; //task indices
     for(auto & t : prog.GetTasks())
     {
-        auto it = tasks.emplace(t.Name, &t);
-        if(!it.second) gMsgUI.Warning("Ambiguous task name: %s", t.Name.c_str());
+        if(!tasks.Add(t)) gMsgUI.Warning("Ambiguous task name: %s", t.GetFullName().c_str());
     }
     
-    std::unordered_map<std::string, Ladybirds::impl::TaskGroup *> groups;
-    
-    //finally, create the groups
-    int id = 0;
-    for(auto & gd : groupdescs)
+    //convert task names to real tasks using our dictionary
+    std::vector<std::vector<Task*>> grouptasklists(groupdescs.size());
+    std::unordered_set<const Task*> named;
+    for(std::size_t g = 0; g < groupdescs.size(); ++g)
     {
-        //first of all, convert task names to real tasks using our dictionary
-        std::vector<Task*> grouptasks;
-        grouptasks.reserve(gd.tasks.size());
+        auto & gd = groupdescs[g];
+        grouptasklists[g].reserve(gd.tasks.size());
         for(auto & s : gd.tasks)
         {
-            auto it = tasks.find(s);
-            if(it != tasks.end()) grouptasks.push_back(it->second);
+            if(auto * ptask = tasks.Find(s)) grouptasklists[g].push_back(ptask), named.insert(ptask);
             else gMsgUI.Warning("Task '%s', as specified in grouping table, does not exist", s.c_str());
         }
+    }
+    
+    //then apply the rules to the remaining tasks: the first matching rule takes each task, in the order of the tasks
+    if(!rules.empty())
+    {
+        std::map<std::string, std::size_t> groupindices;
+        for(std::size_t g = 0; g < groupdescs.size(); ++g) groupindices.emplace(groupdescs[g].name, g);
+        for(auto & rule : rules)
+        {
+            if(rule.Pattern.empty() == rule.Regex.empty() || rule.Group.empty() == rule.Groups.empty()
+               || (rule.Distribute != "roundrobin" && rule.Distribute != "block")
+               || (!rule.Range.empty() && rule.Range.size() != 2))
+            {
+                gMsgUI.Error("Invalid mapping rule: it needs either a pattern or a regex, either a group or a list of "
+                             "groups, a range of two indices if any, and distribute 'roundrobin' or 'block'");
+                return false;
+            }
+            if(!rule.Group.empty()) rule.Groups = {rule.Group};
+            try { if(!rule.Regex.empty()) rule.Compiled = std::regex(rule.Regex); }
+            catch(std::regex_error & e)
+            {
+                gMsgUI.Error("Invalid regular expression '%s' in mapping rule: %s", rule.Regex.c_str(), e.what());
+                return false;
+            }
+        }
+        for(auto & t : prog.GetTasks())
+        {
+            if(named.count(&t)) continue;
+            std::string name = t.GetFullName();
+            long index = 0;
+            bool indexed = LastIndex(name, index);
+            for(auto & rule : rules)
+            {
+                if(!rule.Range.empty() && (!indexed || index < rule.Range[0] || index > rule.Range[1])) continue;
+                if(rule.Regex.empty() ? !GlobMatch(rule.Pattern, name) : !std::regex_match(name, rule.Compiled))
+                    continue;
+                rule.Matched.push_back(&t);
+                break;
+            }
+        }
+        for(auto & rule : rules)
+        {
+            const auto & spec = rule.Regex.empty() ? rule.Pattern : rule.Regex;
+            if(rule.Matched.empty()) gMsgUI.Warning("Mapping rule '%s' matches no task", spec.c_str());
+            std::size_t n = rule.Matched.size(), ngroups = rule.Groups.size();
+            for(std::size_t i = 0; i < n; ++i)
+            {
+                auto & gname = rule.Groups[rule.Distribute == "block" ? i * ngroups / n : i % ngroups];
+                grouptasklists[groupindices.at(gname)].push_back(rule.Matched[i]);
+            }
+        }
+    }
+    
+    std::unordered_map<std::string, Ladybirds::impl::TaskGroup *> groups;
+    
+    //finally, create the groups
+    int id = 0;
+    for(std::size_t g = 0; g < groupdescs.size(); ++g)
+    {
+        auto & gd = groupdescs[g];
+        auto & grouptasks = grouptasklists[g];
         if(grouptasks.empty()) continue;
         
         //again, eliminate any randomness from lua description
@@ -18,8 +18,12 @@ struct ProjectInfoArgs : public Ladybirds::loadstore::LoadStorableCompound
 bool LoadProjectInfo(Ladybirds::impl::Program &prog, ProjectInfoArgs & args);
 
 /// Pass LoadProjectInfo: Loads all the "project information", i.e. the information relevant for code generation
-/** (i.e. which auxiliary files need to be copied, which code files need to be copied and added to the Makefile, ...)**/
-Ladybirds::lua::PassWithArgs<ProjectInfoArgs> LoadProjectInfoPass("LoadProjectInfo", &LoadProjectInfo);
+/** (i.e. which auxiliary files need to be copied, which code files need to be copied and added to the Makefile, ...)
+ *  mappedfiles binds external packets of the main meta-kernel to files, e.g. mappedfiles = {{packet="In",
+ *  file="input.bin"}}. The backends that support it map these files into memory as the buffers of the packets. **/
+Ladybirds::lua::PassWithArgs<ProjectInfoArgs> LoadProjectInfoPass("LoadProjectInfo", &LoadProjectInfo,
+    Ladybirds::lua::Pass::Requires{}, Ladybirds::lua::Pass::Destroys{},
+    Ladybirds::lua::Pass::Access{{}, {"CodeFiles", "AuxFiles", "MappedFiles"}});
 
 
 bool LoadProjectInfo(Ladybirds::impl::Program &prog, ProjectInfoArgs & args)
@@ -31,7 +35,8 @@ bool LoadProjectInfo(Ladybirds::impl::Program &prog, ProjectInfoArgs & args)
     lua_pushglobaltable(lua);
     
     return ld.IO("auxfiles", prog.AuxFiles, false)
-         & ld.IO("codefiles", prog.CodeFiles, false);
+         & ld.IO("codefiles", prog.CodeFiles, false)
+         & ld.IO("mappedfiles", prog.MappedFiles, false);
 }
 
 } //namespace ::
@@ -0,0 +1,41 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "lua/pass.h"
+#include "spec/platform.h"
+#include "loadstore.h"
+#include "memstats.h"
+#include "program.h"
+
+using Ladybirds::impl::MemStats;
+using Ladybirds::impl::Program;
+using Ladybirds::spec::Platform;
+
+namespace {
+
+struct MemStatsArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    Platform *pPlatform = nullptr;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IOHandle("platform", pPlatform, nullptr, false);
+    }
+};
+
+bool GetMemStats(Program &prog, MemStatsArgs &args, MemStats &rets);
+
+/** Pass MemStats: Returns the memory taken by the program, and by the platform if one is given as platform, in bytes
+ *  per category (cf. Ladybirds::impl::MemStats): tasks, ifaces, dependencies, reachability, levels, families, groups,
+ *  buffers, kernels, other, platform, their sum as total, arenareserved and interned (the dimensions shared by all
+ *  programs). The program is not changed. With -timepasses, the totals before and after every pass are printed as
+ *  well. **/
+Ladybirds::lua::PassWithArgsAndRet<MemStatsArgs, MemStats> MemStatsPass("MemStats", &GetMemStats);
+
+
+bool GetMemStats(Program &prog, MemStatsArgs &args, MemStats &rets)
+{
+    rets = Ladybirds::impl::GetMemStats(prog, args.pPlatform);
+    return true;
+}
+
+} //namespace ::
@@ -1,5 +1,6 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <algorithm>
 #include <assert.h>
 #include <numeric>
 #include <unordered_set>
@@ -8,6 +9,7 @@
 
 #include "spacedivision.h"
 #include "lua/pass.h"
+#include "msgui.h"
 #include "program.h"
 #include "taskgroup.h"
 #include "tools.h"
@@ -29,15 +31,54 @@ struct MergePortsArgs : public Ladybirds::loadstore::LoadStorableCompound
 {
     std::vector<int> InLimits;
     std::vector<int> OutLimits;
+    double ReadCost = 1; ///< Cost for transferring one byte
+    double StartupCost = 0; ///< Fix cost of each transfer
     virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
-        { return ls.IO("inlimits", InLimits, false) & ls.IO("outlimits", OutLimits, false); }
+    {
+        return ls.IO("inlimits", InLimits, false) & ls.IO("outlimits", OutLimits, false)
+             & ls.IO("readcost", ReadCost, false, 1) & ls.IO("startupcost", StartupCost, false, 0);
+    }
+};
+struct MergePortsRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double CostBefore = 0, CostAfter = 0;
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+        { return ls.IO("costbefore", CostBefore) & ls.IO("costafter", CostAfter); }
 };
-bool MergePorts(Program &prog, MergePortsArgs & args);
+bool MergePorts(Program &prog, MergePortsArgs & args, MergePortsRets & rets);
 
 /** Pass MergePortsByBuffer: Deletes all channels and merges/prunes the ports such that loading/storing data from/to
  a non-volatile memory can be performed efficiently, i.e. without (at least ideally without) loading/storing data twice
- and without too many small load/store operations.**/
-Ladybirds::lua::PassWithArgs<MergePortsArgs> MergePortsPass("MergePortsByBuffer", &MergePorts);
+ and without too many small load/store operations.
+ Each transfer is estimated to take startupcost plus readcost per byte. Two ports are merged into one transfer of their
+ envelope if the unused bytes it transfers in addition cost at most as much as the saved startup, so with a positive
+ startupcost, neighboring or strided regions are combined into bursts. Returns a table with the estimated total
+ transfer cost before (costbefore) and after (costafter) pruning and merging. **/
+Ladybirds::lua::PassWithArgsAndRet<MergePortsArgs, MergePortsRets> MergePortsPass("MergePortsByBuffer", &MergePorts);
+
+bool PlacePorts(Program &prog);
+
+/** Pass PlacePorts: Sets the positions of the ports of all channels within the buffers of their interfaces, like
+ *  MergePortsByBuffer does, but keeps the channels and does not merge anything. Afterwards, the exported ports describe
+ *  the region of the buffer that is transferred (dims, bufferdims and offset, with the last dimension in bytes). **/
+Ladybirds::lua::Pass PlacePortsPass("PlacePorts", &PlacePorts, Ladybirds::lua::Pass::Requires{"PopulateGroups"});
+
+/// \internal Cost model for the transfers of ports
+struct TransferCost
+{
+    double PerByte, Startup;
+    
+    inline double operator()(const Port &p) const
+        { return Startup + PerByte*p.Position.GetVolume()*p.BufferBaseTypeSize; }
+    
+    //! Adds up the costs of the valid ports in [\p itstart, \p itend)
+    template<class iterator> double Total(iterator itstart, iterator itend) const
+    {
+        double ret = 0;
+        for(auto it = itstart; it != itend; ++it) if((*it)->IsValid()) ret += (*this)(**it);
+        return ret;
+    }
+};
 
 bool IsWithinLimits(const Space &s, const std::vector<int> &limits)
 {
@@ -102,7 +143,7 @@ struct PortMergeInfo
     bool SameIface;
     Space ResultingPos;
     int ResultingSize;
-    int Cost;
+    double Cost; ///< Cost of the additionally transferred bytes minus the saved startup cost
     
     // compare two different merge options: the "smaller" merge option is more favorable
     bool operator <(const PortMergeInfo &other) const
@@ -114,7 +155,7 @@ struct PortMergeInfo
 };
 
 template<class iterator>
-auto FindMergeOptions(iterator itstart, iterator itend)
+auto FindMergeOptions(iterator itstart, iterator itend, const TransferCost &cost)
 {
     std::vector<PortMergeInfo> ret;
     int nports = itend-itstart;
@@ -131,7 +172,8 @@ auto FindMergeOptions(iterator itstart, iterator itend)
 
             PortMergeInfo info = {&p2, &p1, p1.GetIface() == p2.GetIface(), p1.Position | p2.Position, 0, 0};
             info.ResultingSize = info.ResultingPos.GetVolume();
-            info.Cost = info.ResultingSize - p1.Position.GetVolume() - p2.Position.GetVolume();
+            int extra = info.ResultingSize - p1.Position.GetVolume() - p2.Position.GetVolume();
+            info.Cost = extra*p1.BufferBaseTypeSize*cost.PerByte - cost.Startup;
             ret.push_back(std::move(info));
         }
     }
@@ -139,7 +181,7 @@ auto FindMergeOptions(iterator itstart, iterator itend)
 }
 
 template<class iterator>
-void MergePortList(iterator itstart, iterator itend, const std::vector<int> &limits)
+void MergePortList(iterator itstart, iterator itend, const std::vector<int> &limits, const TransferCost &cost)
 {
     const PortMergeInfo *performedmerge;
     do
@@ -147,8 +189,9 @@ void MergePortList(iterator itstart, iterator itend, const std::vector<int> &lim
         performedmerge = nullptr;
         std::unordered_set<const Port*> mergedports;
 
-        auto mergeoptions = FindMergeOptions(itstart, itend);
+        auto mergeoptions = FindMergeOptions(itstart, itend, cost);
         std::sort(itstart, itend);
+        std::stable_sort(mergeoptions.begin(), mergeoptions.end()); // most favorable options first
         if(gDbgOut) std::cout << mergeoptions.size() << " merge options" << std::endl;
         for(auto &mergeoption : mergeoptions)
         {
@@ -173,8 +216,19 @@ void MergePortList(iterator itstart, iterator itend, const std::vector<int> &lim
 }
 
 
+/// \internal Sets the position of \p port within the buffer of its iface, given the \p anchor of its dependency
+void PlacePort(Port &port, const Dependency::Anchor &anchor)
+{
+    auto &iface = *port.GetIface();
+    port.Position = anchor.Index;
+    if(gDbgOut) std::cout << "Index: " << port.Position << ", PosHint: " << iface.PosHint << std::endl;
+    port.Position.Displace(iface.PosHint.GetOrigin());
+    port.BufferDims = &iface.GetBufferDims();
+    port.BufferBaseTypeSize = iface.GetPacket()->GetBaseType().Size;
+}
+
 template<class operations>
-void MergeByBuffers(TaskGroup &grp, std::vector<int> &limits)
+void MergeByBuffers(TaskGroup &grp, std::vector<int> &limits, const TransferCost &cost, MergePortsRets &rets)
 {
     //collect all inputs/outputs referring to same buffer
     std::unordered_map<const Buffer*, std::vector<Port*>> opmap;
@@ -189,11 +243,7 @@ void MergeByBuffers(TaskGroup &grp, std::vector<int> &limits)
                 upport->Invalidate();
                 continue;
             }
-            upport->Position = operations::getanchor(*chan->Dep).Index;
-            if(gDbgOut) std::cout << "Index: " << upport->Position << ", PosHint: " << iface.PosHint << std::endl;
-            upport->Position.Displace(iface.PosHint.GetOrigin());
-            upport->BufferDims = &iface.GetBufferDims();
-            upport->BufferBaseTypeSize = iface.GetPacket()->GetBaseType().Size;
+            PlacePort(*upport, operations::getanchor(*chan->Dep));
             upport->Disconnect();
             opmap[iface.GetBuffer()].push_back(upport.get());
         }
@@ -203,21 +253,23 @@ void MergeByBuffers(TaskGroup &grp, std::vector<int> &limits)
     for(auto &entry : opmap)
     {
         auto &ports = entry.second;
+        rets.CostBefore += cost.Total(ports.begin(), ports.end());
         if(ports.size() > 1)
         {
             limits[0] = d1limit / ports[0]->BufferBaseTypeSize;
             if(gDbgOut) std::cout << "Pruning " << *entry.second[0]->GetIface() << std::endl;
             PrunePortList(operations::mergebegin(ports), operations::mergeend(ports));
             if(gDbgOut) std::cout << "Merging" << std::endl;
-            MergePortList(operations::mergebegin(ports), operations::mergeend(ports), limits);
+            MergePortList(operations::mergebegin(ports), operations::mergeend(ports), limits, cost);
         }
+        rets.CostAfter += cost.Total(ports.begin(), ports.end());
     }
     limits[0] = d1limit;
 }
 
 
 
-bool MergePorts(Program &prog, MergePortsArgs &args)
+bool MergePorts(Program &prog, MergePortsArgs &args, MergePortsRets &rets)
 {
     struct inops
     {
@@ -236,18 +288,33 @@ bool MergePorts(Program &prog, MergePortsArgs &args)
     
     if(args.InLimits.empty()) args.InLimits.push_back(0);
     if(args.OutLimits.empty()) args.OutLimits.push_back(0);
+    TransferCost cost = {args.ReadCost, args.StartupCost};
+    rets.CostBefore = rets.CostAfter = 0;
     for(auto &div : prog.Divisions)
     {
         for(auto pgrp : div.GetGroups())
         {
-            MergeByBuffers<inops>(*pgrp, args.InLimits);
-            MergeByBuffers<outops>(*pgrp, args.OutLimits);
+            MergeByBuffers<inops>(*pgrp, args.InLimits, cost, rets);
+            MergeByBuffers<outops>(*pgrp, args.OutLimits, cost, rets);
             pgrp->PortCleanup();
         }
     }
 
     prog.Channels.clear();
     
+    gMsgUI.Verbose("MergePortsByBuffer: Estimated transfer cost %g before and %g after merging",
+                   rets.CostBefore, rets.CostAfter);
+    return true;
+}
+
+bool PlacePorts(Program &prog)
+{
+    for(auto &upchan : prog.Channels)
+    {
+        if(!upchan->IsValid() || !upchan->Dep) continue;
+        PlacePort(*upchan->From, upchan->Dep->From);
+        PlacePort(*upchan->To, upchan->Dep->To);
+    }
     return true;
 }
 
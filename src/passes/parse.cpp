@@ -2,10 +2,16 @@
 
 #include <string>
 
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
 #include "lua/luadump.h"
 #include "lua/luaenv.h"
 #include "lua/pass.h"
 #include "parse/cinterface.h"
+#include "parse/parsecache.h"
+#include "cmdlineoptions.h"
 #include "program.h"
 
 
@@ -13,6 +19,7 @@ using std::string;
 using Ladybirds::impl::Program;
 using Ladybirds::lua::Pass;
 using Ladybirds::parse::CSpecOptions;
+using Ladybirds::parse::ParseCache;
 
 namespace Ladybirds { namespace loadstore { namespace open {
     static constexpr EnumOptionsList<CSpecOptions::PacketDeclTransformKind, 3> mypackdecllist = { {
@@ -34,12 +41,45 @@ struct ParseArgs : public Ladybirds::loadstore::LoadStorableCompound, public Lad
         Ladybirds::loadstore::EnumStringInterface<CSpecOptions::PacketDeclTransformKind> packtrans(PacketDeclTransform);
         return ls.IO("filename", SpecificationFile)
              & ls.IO("output", TranslationOutput, false)
-             & ls.IO("packetdecltransform", packtrans, false, "none");
+             & ls.IO("sources", ExtraSpecifications, false)
+             & ls.IO("packetdecltransform", packtrans, false, "none")
+             & LoadVirtualFiles(ls);
+    }
+
+    /// Lets the further .lb files of the program ("sources", cf. CSpecOptions::ExtraSpecifications) be rewritten next
+    /// to the output for the main file, each to its own file named after it (i.e. dir/file.lb.c)
+    void SetExtraOutputs()
+    {
+        if(TranslationOutput.empty()) return;
+        auto dir = llvm::sys::path::parent_path(TranslationOutput);
+        for(auto & src : ExtraSpecifications)
+        {
+            llvm::SmallString<128> path(dir);
+            llvm::sys::path::append(path, llvm::sys::path::filename(src) + ".c");
+            ExtraTranslationOutputs.push_back(path.str().str());
+        }
+    }
+
+    /// Loads the optional table "files" of generated files given in memory (cf. CSpecOptions::VirtualFiles) mapping
+    /// their paths to their contents. The parser knows them by absolute paths.
+    bool LoadVirtualFiles(Ladybirds::loadstore::LoadStore & ls)
+    {
+        Ladybirds::loadstore::LoadStore::Table<string> files;
+        if(!ls.IO("files", files, false)) return false;
+        for(auto & file : files)
+        {
+            llvm::SmallString<128> path(file.first);
+            llvm::sys::fs::make_absolute(path);
+            llvm::sys::path::remove_dots(path, true);
+            VirtualFiles[path.str().str()] = std::move(file.second);
+        }
+        return true;
     }
 };
 bool LoadProjectInfo(Ladybirds::impl::Program &prog, ParseArgs  args);
 
-/// Parsing pass: Parses a .lb file, the path to which is provided as an argument, and returns a program object
+/// Parsing pass: Parses a .lb file, the path to which is provided as an argument, and returns a program object.
+/// Further .lb files of the program can be given as "sources" (cf. LoadCSpec).
 class ParsePass : public Pass
 {
     using Pass::Pass;
@@ -52,13 +92,27 @@ int ParsePass::Run(lua_State * lua)
     ParseArgs args;
     LoadExtraArgs(lua, args);
     lua_settop(lua, 0); // we have all arguments now
+    args.SetExtraOutputs();
     
 
     Ladybirds::lua::LuaDump ld(lua);
     auto *pprog = ld.CreateManaged<Program>();
     
-    // Finally parse the .lb file
-    if(!LoadCSpec(args, *pprog)) return 0;
+    // Take the program from the cache if the .lb file and its headers are unchanged, or else parse the .lb file
+    auto & cmdline = Ladybirds::tools::gCmdLineOptions;
+    ParseCache cache(args, cmdline.ClangParams, cmdline.ParseCache);
+    auto cached = cache.Load(*pprog);
+    if(cached == ParseCache::Failed) // start over with a fresh program
+    {
+        lua_pop(lua, 1);
+        pprog = ld.CreateManaged<Program>();
+    }
+    if(cached != ParseCache::Hit)
+    {
+        if(!LoadCSpec(args, *pprog)) return 0;
+        cache.Store(*pprog);
+    }
+    RecordSizes(*pprog, true);
     
     std::cout << pprog->GetTasks().size() << " tasks, " << pprog->Dependencies.size() << " dependencies" << std::endl;
     return 1;
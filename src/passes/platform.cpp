@@ -1,11 +1,20 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <cstdlib>
 #include <fstream>
 
+#include <unistd.h>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+
 #include "graph/graph-dump.h"
 #include "lua/methodinterface.h"
 #include "lua/luadump.h"
 #include "lua/pass.h"
+#include "msgui.h"
+#include "spec/hostplatform.h"
 #include "spec/platform.h"
 #include "tools.h"
 
@@ -155,3 +164,71 @@ class PlatformPass : public Ladybirds::lua::Pass
     };
 };
 static PlatformPass MyPlatformPass("CreatePlatform", nullptr);
+
+
+struct HostPlatformArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    bool Cache, Recalibrate;
+    Ladybirds::spec::HostPlatformOptions Options;
+    virtual bool LoadStoreMembers(LoadStore &ls) override
+    {
+        return ls.IO("cache", Cache, false, true)
+             & ls.IO("recalibrate", Recalibrate, false, false)
+             & ls.IO("scale", Options.Scale, false, 1.0)
+             & ls.IO("calibrate", Options.Calibrate, false, true);
+    }
+};
+
+/** HostPlatform: Pseudo pass returning a platform that describes the machine the compiler runs on, for the pthreads
+ *  backends (cf. spec::BuildHostPlatform). As measuring the costs takes a moment, the platform is cached as a Lua
+ *  script in ~/.ladybirds/hostplatform-<hostname>.lua, which can also be edited by hand. Arguments (all optional):
+ *  cache (default true), recalibrate (measure again even if there is a cached platform), scale (cost units per
+ *  nanosecond) and calibrate (measure the costs at all, else they are guessed). **/
+class HostPlatformPass : public Ladybirds::lua::Pass
+{
+    using Pass::Pass;
+    virtual int Run(lua_State *lua) override
+    {
+        if(lua_gettop(lua) == 0) lua_newtable(lua);
+        HostPlatformArgs args;
+        LoadExtraArgs(lua, args);
+        lua_settop(lua, 0);
+        
+        std::string cachepath;
+        const char *home = getenv("HOME");
+        char hostname[256] = "";
+        if(args.Cache && home && gethostname(hostname, sizeof(hostname) - 1) == 0)
+        {
+            llvm::SmallString<128> path(home);
+            llvm::sys::path::append(path, ".ladybirds", strprintf("hostplatform-%s.lua", hostname));
+            cachepath = path.str().str();
+        }
+        
+        PlatformIface.CreateMetaTable(lua, Platform::TypeString);
+        if(!cachepath.empty() && !args.Recalibrate && llvm::sys::fs::exists(cachepath))
+        {
+            if(luaL_loadfile(lua, cachepath.c_str()) == 0 && lua_pcall(lua, 0, 1, 0) == 0
+               && lua_isuserdata(lua, -1))
+            {
+                gMsgUI.Verbose("HostPlatform: took the platform from %s", cachepath.c_str());
+                return 1;
+            }
+            gMsgUI.Warning("Ignoring damaged host platform %s: %s", cachepath.c_str(),
+                           lua_isstring(lua, -1) ? lua_tostring(lua, -1) : "it does not return a platform");
+            lua_settop(lua, 0);
+        }
+        
+        Ladybirds::lua::LuaDump ld(lua);
+        auto *ppf = ld.CreateManaged<Platform>();
+        if(!Ladybirds::spec::BuildHostPlatform(*ppf, args.Options)) luaL_error(lua, "HostPlatform failed");
+        if(cachepath.empty()) return 1;
+        
+        llvm::sys::fs::create_directories(llvm::sys::path::parent_path(cachepath));
+        std::ofstream strm(cachepath);
+        strm << "-- platform of host " << hostname << " as measured by Ladybirds.HostPlatform\n";
+        ppf->WriteScript(strm);
+        if(!strm.good()) gMsgUI.Warning("Unable to write the host platform to %s", cachepath.c_str());
+        return 1;
+    };
+};
+static HostPlatformPass MyHostPlatformPass("HostPlatform", nullptr);
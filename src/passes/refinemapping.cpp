@@ -0,0 +1,311 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "opt/schedule.h"
+#include "lua/pass.h"
+#include "spec/platform.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::impl::TaskGroup;
+using Ladybirds::lua::Pass;
+using Ladybirds::opt::Schedule;
+using Ladybirds::opt::Time;
+using Ladybirds::spec::Platform;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct RefineArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    Platform *pPlatform = nullptr;
+    std::string Filename; ///< File to write the refined mapping to
+    int Iterations = 1000; ///< Number of moves to try
+    int Seed = 1;
+    int Weight = 0; ///< Weight of memory usage vs. ALAP time in the list scheduling priority
+    double Temperature = 0.05; ///< Initial annealing temperature, relative to the initial makespan
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IOHandle("platform", pPlatform, nullptr)
+             & ls.IO("filename", Filename)
+             & ls.IO("iterations", Iterations, false, 1000)
+             & ls.IO("seed", Seed, false, 1)
+             & ls.IO("weight", Weight, false, 0)
+             & ls.IO("temperature", Temperature, false, 0.05);
+    }
+};
+
+struct RefineRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double InitialMakespan = 0, Makespan = 0;
+    int Accepted = 0; ///< Number of moves that have been accepted
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("initialmakespan", InitialMakespan) & ls.IO("makespan", Makespan) & ls.IO("accepted", Accepted);
+    }
+};
+
+bool RefineMapping(Program &prog, RefineArgs &args, RefineRets &rets);
+
+/** Pass RefineMapping: Improves the current mapping of tasks to groups by simulated annealing.
+ *  Each move either relocates a task to another group or swaps the groups of two tasks, and is evaluated by list
+ *  scheduling the program on the platform (cf. opt::Schedule). Mappings are rated by makespan first and by the peak
+ *  memory occupation of the platform groups second. Tasks only move between groups that belong to the same division,
+ *  and only to groups bound to cores of the type of their initial group or of a type on which they have a cost of
+ *  their own (Task::TypeCosts, cf. LoadCost) that is not negative. No group is left empty. The best mapping found is
+ *  written to filename in the format read by LoadMapping (which must be run again to use it); the program itself is
+ *  left as it is. Returns a table with the fields initialmakespan, makespan (of the refined mapping) and accepted. **/
+Ladybirds::lua::PassWithArgsAndRet<RefineArgs, RefineRets>
+    RefineMappingPass("RefineMapping", &RefineMapping, Pass::Requires{"LoadMapping"});
+
+
+/// \internal Rating of a mapping: makespan and peak group memory, compared lexicographically
+using Score = std::pair<Time, long>;
+
+/// \internal Assignment of tasks to groups that can be modified and rated by list scheduling
+class MappingSearch
+{
+    Program &Program_;
+    std::vector<Task*> Tasks_;
+    std::vector<TaskGroup*> Groups_;
+    std::vector<std::vector<int>> Compatible_; ///< For each group, the other groups its tasks may move to (cf. CanMove)
+    std::vector<const Platform::CoreType*> HomeTypes_; ///< For each task, the core type of its initial group
+    std::vector<int> Assignment_, GroupSizes_;
+    Ladybirds::graph::ItemMap<const Platform::Core*> Cores_;
+    Schedule Schedule_;
+    Schedule::Strategy Strategy_;
+
+public:
+    MappingSearch(Program &prog, Platform &pf, int weight);
+
+    /// Schedules the program with the current assignment. Returns false if it cannot be scheduled.
+    bool Evaluate(/*out*/ Score &score);
+    /// Applies a random relocation or swap. Returns false if there is no possible move of the chosen kind.
+    bool RandomMove(std::minstd_rand &rng, /*out*/ std::vector<std::pair<int, int>> &undo);
+    /// Moves task number \p itask to group number \p igroup
+    void Move(int itask, int igroup);
+    /// Checks if task number \p itask may run on the core type of group number \p igroup
+    bool CanMove(int itask, int igroup) const;
+
+    inline const std::vector<int> & GetAssignment() const { return Assignment_; }
+    void SetAssignment(const std::vector<int> &assignment);
+    bool Write(const std::string &filename) const;
+};
+
+MappingSearch::MappingSearch(Program &prog, Platform &pf, int weight)
+    : Program_(prog), Cores_(prog.TaskGraph.GetNodeMap<const Platform::Core*>(nullptr)), Schedule_(prog, pf)
+{
+    // tasks move to groups of other core types only if some task has a cost there, otherwise all moves would fail
+    std::unordered_set<std::string> typeswithcosts;
+    for(auto &t : prog.GetTasks()) for(auto &entry : t.TypeCosts) typeswithcosts.insert(entry.first);
+    
+    for(auto &upg : prog.Groups) Groups_.push_back(upg.get());
+    Compatible_.resize(Groups_.size());
+    for(int i = 0, n = Groups_.size(); i < n; ++i) for(int j = 0; j < n; ++j)
+    {
+        auto *ptype = Groups_[j]->GetBinding()->Type;
+        if(i != j && (Groups_[i]->GetBinding()->Type == ptype || typeswithcosts.count(ptype->Name) != 0)
+            && Groups_[i]->GetDivision() == Groups_[j]->GetDivision())
+        {
+            Compatible_[i].push_back(j);
+        }
+    }
+
+    GroupSizes_.assign(Groups_.size(), 0);
+    for(auto &t : prog.GetTasks())
+    {
+        int igroup = 0;
+        while(Groups_[igroup] != t.Group) ++igroup;
+        Tasks_.push_back(&t);
+        HomeTypes_.push_back(t.Group->GetBinding()->Type);
+        Assignment_.push_back(igroup);
+        ++GroupSizes_[igroup];
+        Cores_[t] = t.Group->GetBinding();
+    }
+
+    Strategy_.Weight = weight;
+    Schedule_.SetTaskCores(&Cores_);
+    Schedule_.SetQuiet(true); // infeasible mappings are expected during the search
+}
+
+bool MappingSearch::Evaluate(Score &score)
+{
+    if(!Schedule_.CalcSchedule(Strategy_, nullptr, nullptr)) return false;
+    long peak = 0;
+    for(auto p : Schedule_.GetGroupPeakOccupancy()) peak = std::max(peak, p);
+    score = Score(Schedule_.GetMakespan(), peak);
+    return true;
+}
+
+void MappingSearch::Move(int itask, int igroup)
+{
+    --GroupSizes_[Assignment_[itask]];
+    ++GroupSizes_[igroup];
+    Assignment_[itask] = igroup;
+    Cores_[Tasks_[itask]] = Groups_[igroup]->GetBinding();
+}
+
+bool MappingSearch::CanMove(int itask, int igroup) const
+{
+    auto *ptype = Groups_[igroup]->GetBinding()->Type;
+    return ptype == HomeTypes_[itask] || (Tasks_[itask]->TypeCosts.count(ptype->Name) != 0
+                                          && Tasks_[itask]->GetCost(ptype->Name) >= 0);
+}
+
+bool MappingSearch::RandomMove(std::minstd_rand &rng, std::vector<std::pair<int, int>> &undo)
+{
+    undo.clear();
+    int ntasks = Tasks_.size();
+    int itask = std::uniform_int_distribution<int>(0, ntasks-1)(rng);
+    int from = Assignment_[itask];
+    auto &targets = Compatible_[from];
+    if(targets.empty()) return false;
+
+    if(std::uniform_int_distribution<int>(0, 1)(rng) == 0)
+    { // relocate the task, unless it is the last one in its group
+        if(GroupSizes_[from] == 1) return false;
+        int to = targets[std::uniform_int_distribution<int>(0, targets.size()-1)(rng)];
+        if(!CanMove(itask, to)) return false;
+        undo.emplace_back(itask, from);
+        Move(itask, to);
+        return true;
+    }
+
+    // swap with a random task in a compatible group
+    int iother = std::uniform_int_distribution<int>(0, ntasks-1)(rng);
+    int to = Assignment_[iother];
+    if(std::find(targets.begin(), targets.end(), to) == targets.end()) return false;
+    if(!CanMove(itask, to) || !CanMove(iother, from)) return false;
+    undo.emplace_back(itask, from);
+    undo.emplace_back(iother, to);
+    Move(itask, to);
+    Move(iother, from);
+    return true;
+}
+
+void MappingSearch::SetAssignment(const std::vector<int> &assignment)
+{
+    for(int i = 0, n = Tasks_.size(); i < n; ++i) Move(i, assignment[i]);
+}
+
+/// \internal Quotes \p s as a lua string literal
+std::string LuaQuote(const std::string &s)
+{
+    std::string ret("\"");
+    for(char c : s)
+    {
+        if(c == '"' || c == '\\') ret += '\\';
+        ret += c;
+    }
+    return ret += '"';
+}
+
+bool MappingSearch::Write(const std::string &filename) const
+{
+    std::ofstream strm(filename);
+    if(!strm.is_open())
+    {
+        perror(filename.c_str());
+        return false;
+    }
+
+    strm << "grouping = {\n";
+    for(int i = 0, n = Tasks_.size(); i < n; ++i)
+    {
+        strm << "    [" << LuaQuote(Tasks_[i]->GetFullName()) << "] = "
+             << LuaQuote(Groups_[Assignment_[i]]->GetName()) << ",\n";
+    }
+    strm << "}\n";
+
+    if(!Program_.Divisions.empty())
+    {
+        strm << "\ndivisions = {\n";
+        for(auto &div : Program_.Divisions)
+        {
+            strm << "    {";
+            for(auto *pg : div.GetGroups())
+            {
+                strm << LuaQuote(pg->GetName()) << ", ";
+            }
+            strm << "},\n";
+        }
+        strm << "}\n";
+    }
+    return strm.good();
+}
+
+
+bool RefineMapping(Program &prog, RefineArgs &args, RefineRets &rets)
+{
+    for(auto &t : prog.GetTasks())
+    {
+        if(!t.Group || !t.Group->GetBinding())
+        {
+            gMsgUI.Error("Task '%s' is not bound to a processing element. Pass a platform to LoadMapping.",
+                         t.GetFullName().c_str());
+            return false;
+        }
+    }
+
+    MappingSearch search(prog, *args.pPlatform, args.Weight);
+    Score current;
+    if(!search.Evaluate(current))
+    {
+        gMsgUI.Error("List scheduling failed for the initial mapping.");
+        return false;
+    }
+    rets.InitialMakespan = current.first;
+
+    auto best = current;
+    auto bestassignment = search.GetAssignment();
+    std::minstd_rand rng(args.Seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<std::pair<int, int>> undo;
+    rets.Accepted = 0;
+    for(int it = 0; it < args.Iterations && !prog.GetTasks().empty(); ++it)
+    {
+        if(!search.RandomMove(rng, undo)) continue;
+
+        Score score;
+        bool accept = search.Evaluate(score);
+        if(accept && score > current)
+        { // worse mappings are accepted with a probability that decreases with the temperature
+            double temperature = args.Temperature * rets.InitialMakespan * (args.Iterations-it) / args.Iterations;
+            double delta = score.first - current.first;
+            accept = delta > 0 && temperature > 0 && uniform(rng) < std::exp(-delta/temperature);
+        }
+
+        if(!accept)
+        {
+            for(auto u = undo.rbegin(); u != undo.rend(); ++u) search.Move(u->first, u->second);
+            continue;
+        }
+        ++rets.Accepted;
+        current = score;
+        if(current < best) best = current, bestassignment = search.GetAssignment();
+    }
+
+    search.SetAssignment(bestassignment);
+    rets.Makespan = best.first;
+    gMsgUI.Verbose("Refined mapping: makespan %ld -> %ld, %d moves accepted",
+                   (long) rets.InitialMakespan, (long) rets.Makespan, rets.Accepted);
+    return search.Write(args.Filename);
+}
+
+} //namespace ::
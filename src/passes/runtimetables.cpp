@@ -0,0 +1,204 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lua/pass.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "tools.h"
+
+
+using Ladybirds::impl::Program;
+
+namespace {
+
+struct TablesDep : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string From, To;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("from", From) & ls.IO("to", To);
+    }
+};
+
+struct TablesArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<std::vector<std::string>> Groups; ///< Names of the tasks of the operations of each group, in order
+    std::vector<TablesDep> Deps;  ///< Dependencies to wait for, by task name
+    int WordBits = 64;            ///< Bits of one bitfield word
+    int LineWords = 1;            ///< The words of each group start at a multiple of this, after the previous group
+    int VectorWords = 0;          ///< Words checked at once, 0 for one by one
+    bool CrossFirst = false;      ///< Whether the tasks with successors in other groups take the first bits
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("groups", Groups) & ls.IO("deps", Deps) & ls.IO("wordbits", WordBits, false, 64, 1, 64)
+             & ls.IO("linewords", LineWords, false, 1, 1) & ls.IO("vectorwords", VectorWords, false, 0, 0)
+             & ls.IO("crossfirst", CrossFirst, false, false);
+    }
+};
+
+struct OpTables : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Index = 0;            ///< Word of the bit of the task
+    std::string Bit;          ///< The bit within it, in hex
+    std::string Indices;      ///< Words (or vectors) to check before the task can run, comma-terminated
+    std::string Data;         ///< The required bits of each, likewise
+    int CheckStart = 0, CheckEnd = 0; ///< Range of these checks in the tables of the group
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("index", Index) & ls.IO("bit", Bit) & ls.IO("indices", Indices) & ls.IO("data", Data)
+             & ls.IO("checkstart", CheckStart) & ls.IO("checkend", CheckEnd);
+    }
+};
+
+struct GroupTables : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int LocalMin = 0, LocalMax = 0; ///< First and last word of the group
+    std::vector<OpTables> Ops;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("localmin", LocalMin) & ls.IO("localmax", LocalMax) & ls.IO("ops", Ops);
+    }
+};
+
+struct TablesRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Length = 0; ///< Number of words of the bitfield
+    std::vector<GroupTables> Groups;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("length", Length) & ls.IO("groups", Groups);
+    }
+};
+
+bool ExportRuntimeTables(Program &prog, TablesArgs &args, TablesRets &rets);
+
+/** Pass ExportRuntimeTables: Builds the dependency bitfield tables of the pthreads runtimes (pthreads-dynamic,
+ *  mppa_pthreads) for the operations given as groups, a list of lists of task names. Each task gets one bit of a word
+ *  of wordbits bits; the words of each group are its own, and start at a multiple of linewords after those of the
+ *  previous group. With crossfirst, the tasks with successors in other groups take the first bits of their group. Each
+ *  task then needs the bits of its predecessors in deps (a list of {from=, to=} task names; tasks without an
+ *  operation, e.g. the main task, have no bits), merged per word, or per vector of vectorwords words if it is not 0.
+ *  The checks of words of its own group come first, and both parts are in increasing order. Returns a table with
+ *  length, the number of words, and groups, which holds for each group localmin and localmax, its first and last word
+ *  (or vector), and ops, which gives for each operation index and bit (in hex) of its task, and indices and data, the
+ *  lists of checks as C initializers, which take the range [checkstart, checkend) of the checks of the group. **/
+Ladybirds::lua::PassWithArgsAndRet<TablesArgs, TablesRets>
+    ExportRuntimeTablesPass("ExportRuntimeTables", &ExportRuntimeTables);
+
+
+bool ExportRuntimeTables(Program &, TablesArgs &args, TablesRets &rets)
+{
+    struct OpRef { int Group, Op; };
+    std::unordered_map<std::string, OpRef> ops;
+    for(int g = 0, ng = args.Groups.size(); g < ng; ++g)
+    {
+        for(int i = 0, n = args.Groups[g].size(); i < n; ++i) ops.emplace(args.Groups[g][i], OpRef{g, i});
+    }
+    // the predecessors of each operation among the operations (the main task has no bit)
+    std::vector<std::vector<std::vector<OpRef>>> preds(args.Groups.size());
+    std::vector<std::vector<bool>> cross(args.Groups.size());
+    for(std::size_t g = 0; g < args.Groups.size(); ++g)
+    {
+        preds[g].resize(args.Groups[g].size());
+        cross[g].resize(args.Groups[g].size(), false);
+    }
+    for(auto &dep : args.Deps)
+    {
+        auto itfrom = ops.find(dep.From), itto = ops.find(dep.To);
+        if(itfrom == ops.end() || itto == ops.end()) continue;
+        auto from = itfrom->second, to = itto->second;
+        if(from.Group == to.Group && from.Op == to.Op) continue;
+        preds[to.Group][to.Op].push_back(from);
+        if(from.Group != to.Group) cross[from.Group][from.Op] = true;
+    }
+
+    // the bits, in the order of the operations (the tasks with successors in other groups first, with crossfirst)
+    std::vector<std::vector<int>> words(args.Groups.size());
+    std::vector<std::vector<std::uint64_t>> bits(args.Groups.size());
+    rets.Groups.assign(args.Groups.size(), GroupTables());
+    int word = 0;
+    for(std::size_t g = 0; g < args.Groups.size(); ++g)
+    {
+        int n = args.Groups[g].size(), bit = 0;
+        words[g].resize(n);
+        bits[g].resize(n);
+        rets.Groups[g].LocalMin = word;
+        for(int pass = args.CrossFirst ? 0 : 1; pass < 2; ++pass) for(int i = 0; i < n; ++i)
+        {
+            if(args.CrossFirst && cross[g][i] != (pass == 0)) continue;
+            words[g][i] = word;
+            bits[g][i] = std::uint64_t(1) << bit;
+            if(++bit >= args.WordBits) ++word, bit = 0;
+        }
+        rets.Groups[g].LocalMax = word;
+        word = (word / args.LineWords + 1) * args.LineWords;
+    }
+    rets.Length = word;
+
+    const int vectorwords = args.VectorWords;
+    auto hex = [](std::uint64_t w) { return strprintf("%#llx", (unsigned long long) w); };
+    for(std::size_t g = 0; g < args.Groups.size(); ++g)
+    {
+        auto &group = rets.Groups[g];
+        int localmin = group.LocalMin, localmax = group.LocalMax, checks = 0;
+        if(vectorwords > 0) localmin /= vectorwords, localmax /= vectorwords;
+        group.Ops.resize(args.Groups[g].size());
+        for(std::size_t i = 0; i < args.Groups[g].size(); ++i)
+        {
+            auto &op = group.Ops[i];
+            op.Index = words[g][i];
+            op.Bit = hex(bits[g][i]);
+
+            // the required bits per word, then per check (a word, or a vector of words)
+            std::map<int, std::uint64_t> required;
+            for(auto &pred : preds[g][i]) required[words[pred.Group][pred.Op]] |= bits[pred.Group][pred.Op];
+            std::map<int, std::string> data;
+            if(vectorwords == 0) for(auto &entry : required) data[entry.first] = hex(entry.second);
+            else
+            {
+                std::map<int, std::vector<std::uint64_t>> vectors;
+                for(auto &entry : required)
+                {
+                    auto &vector = vectors[entry.first / vectorwords];
+                    vector.resize(vectorwords, 0);
+                    vector[entry.first % vectorwords] = entry.second;
+                }
+                for(auto &entry : vectors)
+                {
+                    std::string list;
+                    for(auto w : entry.second) list += (list.empty() ? "{" : ", ") + hex(w);
+                    data[entry.first] = list + "}";
+                }
+            }
+
+            std::string otherindices, otherdata;
+            for(auto &entry : data)
+            {
+                bool local = entry.first >= localmin && entry.first <= localmax;
+                (local ? op.Indices : otherindices) += std::to_string(entry.first) + ", ";
+                (local ? op.Data : otherdata) += entry.second + ", ";
+            }
+            op.Indices += otherindices;
+            op.Data += otherdata;
+            op.CheckStart = checks;
+            checks += data.size();
+            op.CheckEnd = checks;
+        }
+    }
+    gMsgUI.Verbose("ExportRuntimeTables: %d words for %d groups", rets.Length, (int) rets.Groups.size());
+    return true;
+}
+
+} //namespace ::
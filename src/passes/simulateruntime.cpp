@@ -0,0 +1,314 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "lua/pass.h"
+#include "spec/platform.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::impl::TaskGroup;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Platform;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct SimPriority : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Task;
+    double Priority = 0;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("task", Task) & ls.IO("priority", Priority);
+    }
+};
+
+struct SimArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    Platform *pPlatform = nullptr;
+    std::vector<SimPriority> Priorities; ///< Order of the tasks within their groups (cf. TaskPriorities)
+    bool StaticOrder = false; ///< Whether every group runs its tasks strictly in order (cf. -staticorder)
+    double Wakeup = 0;        ///< Time from the end of a task to the wake-up of a group waiting for it
+    double Overhead = 0;      ///< Time of the runtime per task (finding it, marking it finished, waking others)
+    double Bandwidth = 0;     ///< Bytes per time unit of the shared memory, 0 for unlimited
+    double Scale = 1000;      ///< Cost units per millisecond
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IOHandle("platform", pPlatform, nullptr, false) & ls.IO("priorities", Priorities, false)
+             & ls.IO("staticorder", StaticOrder, false, false) & ls.IO("wakeup", Wakeup, false, 0, 0)
+             & ls.IO("overhead", Overhead, false, 0, 0) & ls.IO("bandwidth", Bandwidth, false, 0, 0)
+             & ls.IO("scale", Scale, false, 1000);
+    }
+};
+
+struct SimThread : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Group;
+    double Busy = 0;        ///< Running tasks
+    double Transfer = 0;    ///< Reading the inputs from other groups, including waiting for the shared memory
+    double Runtime = 0;     ///< Overhead of the runtime
+    double Dependencies = 0;///< Waiting for tasks of other groups to finish
+    double Wakeup = 0;      ///< Waiting for the wake-up after they have
+    double Idle = 0;        ///< After the last task of the group
+    double Utilization = 0; ///< Busy as a fraction of the makespan
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("group", Group) & ls.IO("busy", Busy) & ls.IO("transfer", Transfer) & ls.IO("runtime", Runtime)
+             & ls.IO("dependencies", Dependencies) & ls.IO("wakeup", Wakeup) & ls.IO("idle", Idle)
+             & ls.IO("utilization", Utilization);
+    }
+};
+
+struct SimRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double Makespan = 0;
+    std::vector<SimThread> Threads;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("makespan", Makespan) & ls.IO("threads", Threads);
+    }
+};
+
+bool SimulateRuntime(Program &prog, SimArgs &args, SimRets &rets);
+
+/** Pass SimulateRuntime: Simulates one run of the program as generated by pthreads-dynamic, with one thread per group.
+ *  Each thread runs the first task in the order of its group whose predecessors have finished (as GetNextTask), or,
+ *  with staticorder, always the next one. If there is none, it waits until a task of another group with a successor
+ *  in it finishes, plus wakeup. The order of the groups is by decreasing priority if priorities (as returned by
+ *  TaskPriorities) are given, else that of their operations. A task takes its cost (Task::Cost) plus overhead, and
+ *  the transfer of its inputs from other groups: with a platform, the cheapest route between memories of the cores the
+ *  groups are bound to (cf. Platform::GetRouting), and with bandwidth, the time to read them from the shared memory,
+ *  which serves one transfer at a time. Returns a table with the makespan and, for every group, threads with its
+ *  busy time, the times spent on transfers, runtime overhead, waiting for dependencies and for wake-ups, and idle at
+ *  the end, and its utilization. The times are in milliseconds, given scale cost units per millisecond. **/
+Ladybirds::lua::PassWithArgsAndRet<SimArgs, SimRets>
+    SimulateRuntimePass("SimulateRuntime", &SimulateRuntime, Pass::Requires{"PopulateGroups"});
+
+
+/// \internal Time to transfer \p size bytes written on core \p from to core \p to along the cheapest route between
+/// their memories, or -1 if there is none
+double CheapestTransfer(const Platform &platform, const Platform::Core &from, const Platform::Core &to, long size)
+{
+    if(&from == &to || size == 0) return 0;
+    auto &routing = platform.GetRouting();
+    double ret = -1;
+    for(auto &efrom : from.pNode->OutEdges()) for(auto &eto : to.pNode->OutEdges())
+    {
+        auto *pfrom = efrom.GetTarget()->pMem, *pto = eto.GetTarget()->pMem;
+        if(!pfrom || !pto || !routing.IsReachable(*pfrom, *pto)) continue;
+        double time = pfrom == pto ? 0 : routing.GetCost(*pfrom, *pto).For(size);
+        if(ret < 0 || time < ret) ret = time;
+    }
+    return ret;
+}
+
+bool SimulateRuntime(Program &prog, SimArgs &args, SimRets &rets)
+{
+    if(args.Scale <= 0)
+    {
+        gMsgUI.Error("SimulateRuntime: scale must be positive.");
+        return false;
+    }
+    std::unordered_map<std::string, double> priorities;
+    for(auto &entry : args.Priorities) priorities[entry.Task] = entry.Priority;
+
+    // the tasks of each group in the order of the runtime
+    std::vector<TaskGroup*> groups;
+    std::vector<std::vector<int>> orders;
+    std::vector<const Task*> tasks;
+    std::vector<int> groupof;
+    std::unordered_map<const Task*, int> index;
+    for(auto &upgroup : prog.Groups)
+    {
+        auto &ops = upgroup->GetOperations();
+        if(ops.empty()) continue;
+        if(args.pPlatform && !upgroup->GetBinding())
+        {
+            gMsgUI.Error("SimulateRuntime: Group '%s' is not bound to a core. Pass a platform to LoadMapping.",
+                         upgroup->GetName().c_str());
+            return false;
+        }
+        std::vector<int> order;
+        std::vector<double> prio;
+        for(auto &op : ops)
+        {
+            order.push_back(tasks.size());
+            index.emplace(op->TheTask, tasks.size());
+            tasks.push_back(op->TheTask);
+            groupof.push_back(groups.size());
+            auto it = priorities.find(op->TheTask->GetFullName());
+            prio.push_back(it == priorities.end() ? 0 : it->second);
+        }
+        int first = order.front();
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return prio[a-first] > prio[b-first]; });
+        groups.push_back(upgroup.get());
+        orders.push_back(std::move(order));
+    }
+    const int ntasks = tasks.size(), ngroups = groups.size();
+    rets.Threads.assign(ngroups, SimThread());
+    rets.Makespan = 0;
+    if(ntasks == 0) return true;
+
+    // the predecessors of each task, with the time to transfer their data if they are in other groups
+    struct Pred { int Task; double Transfer; long Bytes; };
+    std::vector<std::vector<Pred>> preds(ntasks);
+    std::vector<std::vector<int>> succgroups(ntasks);
+    for(auto &dep : prog.Dependencies)
+    {
+        auto itfrom = index.find(dep.From.TheIface->GetTask()), itto = index.find(dep.To.TheIface->GetTask());
+        if(itfrom == index.end() || itto == index.end() || itfrom->second == itto->second) continue;
+        int from = itfrom->second, to = itto->second;
+        bool cross = groupof[from] != groupof[to];
+        long bytes = cross ? dep.GetMemSize() : 0;
+        double transfer = 0;
+        if(cross && args.pPlatform)
+        {
+            transfer = CheapestTransfer(*args.pPlatform, *groups[groupof[from]]->GetBinding(),
+                                        *groups[groupof[to]]->GetBinding(), bytes);
+            if(transfer < 0)
+            {
+                gMsgUI.Error("SimulateRuntime: No route for the data from %s to %s.",
+                             tasks[from]->GetFullName().c_str(), tasks[to]->GetFullName().c_str());
+                return false;
+            }
+        }
+        auto &list = preds[to];
+        auto it = std::find_if(list.begin(), list.end(), [from](const Pred &p) { return p.Task == from; });
+        if(it == list.end()) list.push_back({from, transfer, bytes});
+        else it->Transfer += transfer, it->Bytes += bytes;
+        if(cross)
+        {
+            auto &succs = succgroups[from];
+            if(std::find(succs.begin(), succs.end(), groupof[to]) == succs.end()) succs.push_back(groupof[to]);
+        }
+    }
+
+    // discrete-event simulation: an event lets a thread finish its running task (if any) and look for the next one
+    struct Thread
+    {
+        std::size_t FirstCandidate = 0;
+        int Running = -1;
+        bool Waiting = false, Woken = false;
+        double WaitStart = 0, End = 0;
+    };
+    std::vector<Thread> threads(ngroups);
+    std::vector<bool> finished(ntasks, false), started(ntasks, false);
+    using Event = std::pair<double, int>;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    for(int g = 0; g < ngroups; ++g) events.push({0, g});
+    double busfree = 0;
+    int done = 0;
+    while(!events.empty())
+    {
+        double now = events.top().first;
+        int g = events.top().second;
+        events.pop();
+        auto &thread = threads[g];
+        auto &stats = rets.Threads[g];
+
+        if(thread.Running >= 0)
+        {
+            int t = thread.Running;
+            finished[t] = true;
+            ++done;
+            thread.Running = -1;
+            for(int succ : succgroups[t])
+            {
+                auto &waiter = threads[succ];
+                if(!waiter.Waiting || waiter.Woken) continue;
+                waiter.Woken = true;
+                events.push({now + args.Wakeup, succ});
+            }
+        }
+        if(thread.Waiting)
+        {
+            if(!thread.Woken) continue;
+            double waited = now - thread.WaitStart, wakeup = std::min(waited, args.Wakeup);
+            stats.Wakeup += wakeup;
+            stats.Dependencies += waited - wakeup;
+            thread.Waiting = false;
+            thread.Woken = false;
+        }
+
+        auto &order = orders[g];
+        while(thread.FirstCandidate < order.size() && finished[order[thread.FirstCandidate]]) ++thread.FirstCandidate;
+        if(thread.FirstCandidate == order.size())
+        {
+            thread.End = now;
+            continue;
+        }
+        int next = -1;
+        for(std::size_t i = thread.FirstCandidate; i < order.size(); ++i)
+        {
+            int t = order[i];
+            if(started[t]) continue;
+            if(std::all_of(preds[t].begin(), preds[t].end(), [&](const Pred &p) { return finished[p.Task]; }))
+            {
+                next = t;
+                break;
+            }
+            if(args.StaticOrder) break;
+        }
+        if(next < 0)
+        {
+            thread.Waiting = true;
+            thread.WaitStart = now;
+            continue;
+        }
+
+        double transfer = 0;
+        long bytes = 0;
+        for(auto &p : preds[next]) transfer += p.Transfer, bytes += p.Bytes;
+        if(args.Bandwidth > 0 && bytes > 0)
+        {
+            busfree = std::max(busfree, now) + bytes / args.Bandwidth;
+            transfer = std::max(transfer, busfree - now);
+        }
+        double cost = std::max(tasks[next]->Cost, 0.0);
+        stats.Busy += cost;
+        stats.Transfer += transfer;
+        stats.Runtime += args.Overhead;
+        started[next] = true;
+        thread.Running = next;
+        events.push({now + transfer + cost + args.Overhead, g});
+    }
+    if(done < ntasks)
+    {
+        gMsgUI.Error("SimulateRuntime: %d tasks never became ready; the order of the groups contradicts the "
+                     "dependencies, and the program would deadlock.", ntasks - done);
+        return false;
+    }
+
+    double makespan = 0;
+    for(auto &thread : threads) makespan = std::max(makespan, thread.End);
+    rets.Makespan = makespan / args.Scale;
+    for(int g = 0; g < ngroups; ++g)
+    {
+        auto &stats = rets.Threads[g];
+        stats.Group = groups[g]->GetName();
+        stats.Idle = (makespan - threads[g].End) / args.Scale;
+        stats.Utilization = makespan > 0 ? stats.Busy / makespan : 0;
+        for(double *ptime : {&stats.Busy, &stats.Transfer, &stats.Runtime, &stats.Dependencies, &stats.Wakeup})
+            *ptime /= args.Scale;
+    }
+    gMsgUI.Verbose("SimulateRuntime: makespan %g ms on %d threads", rets.Makespan, ngroups);
+    return true;
+}
+
+} //namespace ::
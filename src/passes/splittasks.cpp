@@ -0,0 +1,214 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "lua/pass.h"
+#include "dependency.h"
+#include "dependencyindex.h"
+#include "kernel.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "packet.h"
+#include "program.h"
+#include "task.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Iface;
+using Ladybirds::spec::Packet;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct SplitArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Cores = 0;      ///< Number of cores available to the program
+    int MaxParts = 0;   ///< Maximum number of parts per task (0: the number of cores)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("cores", Cores) & ls.IO("maxparts", MaxParts, false, 0);
+    }
+};
+
+/// The elements of a packet a part of a split task accesses: the range [From, To) along dimension Dim
+struct PartRange : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Packet;
+    int Dim = 0, From = 0, To = 0;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("packet", Packet) & ls.IO("dim", Dim) & ls.IO("from", From) & ls.IO("to", To);
+    }
+};
+
+struct SplitEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Task;
+    double Cost = 0;
+    std::vector<std::vector<PartRange>> Parts; ///< Per part, the ranges of the packets that are split
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("task", Task) & ls.IO("cost", Cost) & ls.IO("parts", Parts);
+    }
+};
+
+struct SplitRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<SplitEntry> Splits;
+    double Work = 0;         ///< Sum of the task costs
+    double CriticalPath = 0; ///< Cost of the most expensive dependency chain before splitting
+    double SplitPath = 0;    ///< Ditto, if the parts of each split task run in parallel
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("splits", Splits) & ls.IO("work", Work, false, 0) & ls.IO("criticalpath", CriticalPath, false, 0)
+            & ls.IO("splitpath", SplitPath, false, 0);
+    }
+};
+
+bool SplitTasks(Program &prog, SplitArgs &args, SplitRets &rets);
+
+/** Pass SplitTasks: Plans how to split the expensive tasks on the critical path into data-parallel parts. Only tasks
+ *  of kernels whose packets are annotated with splitalong(dim) or halo(dim, extent) qualify: Every output must be
+ *  split along some dimension, the inputs are either split too (optionally with a halo of extent elements on either
+ *  side, e.g. for stencils) or needed as a whole; all split packets must have the same extent along their split
+ *  dimension. The output range is cut into k equal blocks, where k is the number of cores the task would occupy if the
+ *  work (the sum of Task::Cost, cf. LoadCost and EstimateCosts) was evenly balanced over the given number of cores
+ *  (at most cores, resp. maxparts, and the extent). Only tasks on the critical path (the most expensive dependency
+ *  chain) are split. Returns a table with the field splits, which lists for every split task its cost and parts, each
+ *  with the ranges of its split packets, i.e. the narrowed dependency anchors, as well as work, criticalpath and
+ *  splitpath, the critical path if the parts run in parallel. **/
+Ladybirds::lua::PassWithArgsAndRet<SplitArgs, SplitRets>
+    SplitTasksPass("SplitTasks", &SplitTasks, Pass::Requires{"TaskTopoSort"});
+
+
+/// \internal Returns the extent along the split dimension shared by all split packets of \p t, or 0 if \p t cannot be
+/// split (i.e. some output is not split or the extents differ)
+int GetSplitExtent(const Task &t)
+{
+    int extent = 0;
+    bool anyout = false;
+    for(const Iface &iface : t.Ifaces)
+    {
+        const Packet *ppacket = iface.GetPacket();
+        if(ppacket->GetAccessType() != Packet::in) anyout = true;
+        if(ppacket->GetSplitDim() < 0)
+        {
+            if(ppacket->GetAccessType() != Packet::in) return 0;
+            continue;
+        }
+        auto &dims = iface.GetDimensions();
+        if(ppacket->GetSplitDim() >= (int) dims.size()) return 0;
+        int ext = dims[ppacket->GetSplitDim()];
+        if(extent != 0 && ext != extent) return 0;
+        extent = ext;
+    }
+    return anyout ? extent : 0;
+}
+
+
+bool SplitTasks(Program &prog, SplitArgs &args, SplitRets &rets)
+{
+    if(args.Cores <= 0)
+    {
+        gMsgUI.Error("SplitTasks needs a positive number of cores.");
+        return false;
+    }
+    int maxparts = args.MaxParts > 0 ? std::min(args.MaxParts, args.Cores) : args.Cores;
+
+    std::vector<const Task*> order;
+    for(auto &t : prog.GetTasks()) order.push_back(&t);
+    if(std::all_of(order.begin(), order.end(), [](const Task *pt) { return pt->Cost == 0; }) && !order.empty())
+    {
+        gMsgUI.Error("SplitTasks: No task has a cost. Load the costs (LoadCost) or estimate them (EstimateCosts).");
+        return false;
+    }
+
+    auto index = prog.TaskGraph.GetNodeMap<int>(-1);
+    for(int i = 0, n = order.size(); i < n; ++i) index[order[i]] = i;
+    auto &depindex = prog.GetDependencyIndex();
+
+    // longest chains ending (heads) and starting (tails) at each task; the tasks are sorted topologically
+    auto longestpaths = [&](const std::vector<double> &costs, std::vector<double> &heads, std::vector<double> &tails)
+    {
+        int n = order.size();
+        heads.assign(n, 0);
+        tails.assign(n, 0);
+        for(int i = 0; i < n; ++i)
+        {
+            double head = 0;
+            for(auto *pdep : depindex.GetInDeps(*order[i]))
+            {
+                auto *pfrom = pdep->From.TheIface->GetTask();
+                if(pfrom != &prog.MainTask && pfrom != order[i]) head = std::max(head, heads[index[pfrom]]);
+            }
+            heads[i] = head + costs[i];
+        }
+        for(int i = n; i-- > 0; )
+        {
+            double tail = 0;
+            for(auto *pdep : depindex.GetOutDeps(*order[i]))
+            {
+                auto *pto = pdep->To.TheIface->GetTask();
+                if(pto != &prog.MainTask && pto != order[i]) tail = std::max(tail, tails[index[pto]]);
+            }
+            tails[i] = tail + costs[i];
+        }
+        return n == 0 ? 0.0 : *std::max_element(heads.begin(), heads.end());
+    };
+
+    std::vector<double> costs, heads, tails;
+    for(auto *pt : order) costs.push_back(std::max(pt->Cost, 0.0));
+    rets.Work = std::accumulate(costs.begin(), costs.end(), 0.0);
+    rets.CriticalPath = longestpaths(costs, heads, tails);
+    double share = rets.Work / args.Cores;
+
+    rets.Splits.clear();
+    for(int i = 0, n = order.size(); i < n; ++i)
+    {
+        const Task &t = *order[i];
+        // on the critical path, as far as rounding errors allow to tell
+        if(heads[i] + tails[i] - costs[i] < rets.CriticalPath * (1 - 1e-9)) continue;
+        int extent = GetSplitExtent(t);
+        int k = std::min({maxparts, extent, (int) std::ceil(costs[i] / share - 1e-9)});
+        if(k < 2) continue;
+
+        rets.Splits.emplace_back();
+        auto &entry = rets.Splits.back();
+        entry.Task = t.GetFullName();
+        entry.Cost = costs[i];
+        for(int part = 0; part < k; ++part)
+        {
+            int from = (long) extent * part / k, to = (long) extent * (part + 1) / k;
+            entry.Parts.emplace_back();
+            for(const Iface &iface : t.Ifaces)
+            {
+                const Packet *ppacket = iface.GetPacket();
+                if(ppacket->GetSplitDim() < 0) continue;
+                int halo = ppacket->GetAccessType() == Packet::in ? ppacket->GetHalo() : 0;
+                PartRange range;
+                range.Packet = iface.GetName();
+                range.Dim = ppacket->GetSplitDim();
+                range.From = std::max(from - halo, 0);
+                range.To = std::min(to + halo, extent);
+                entry.Parts.back().push_back(std::move(range));
+            }
+        }
+        costs[i] /= k;
+    }
+    rets.SplitPath = longestpaths(costs, heads, tails);
+
+    gMsgUI.Verbose("SplitTasks: splitting %d tasks shortens the critical path from %g to %g (work per core: %g)",
+                   (int) rets.Splits.size(), rets.CriticalPath, rets.SplitPath, share);
+    return true;
+}
+
+} //namespace ::
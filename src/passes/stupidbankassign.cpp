@@ -55,14 +55,7 @@ bool AssignBanks(Ladybirds::impl::Program& prog, Ladybirds::impl::TaskDivision &
 //! If there are cyclic dependencies, an error message is printed and false is returned.
 bool StupidBankAssign(Ladybirds::impl::Program& prog)
 {
-    bool ret = true;
-    
-    for(auto & div : prog.Divisions)
-    {
-        ret = AssignBanks(prog, div) && ret;
-    }
-    
-    return ret;
+    return Ladybirds::lua::ForEachDivision(prog, [&prog](auto & div) { return AssignBanks(prog, div); });
 }
 
 } // namespace ::
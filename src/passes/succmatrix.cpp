@@ -1,7 +1,14 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
 #include "graph/graph-extra.h"
+#include "graph/reachabilityindex.h"
 #include "lua/pass.h"
+#include "loadstore.h"
 #include "program.h"
 
 
@@ -12,13 +19,70 @@ using Ladybirds::lua::Pass;
 
 
 bool CalcSuccessorMatrix(Program & prog);
-Pass CalcSuccessorMatrixPass("CalcSuccessorMatrix", &CalcSuccessorMatrix);
+bool SuccessorMatrixIO(Program & prog, Ladybirds::loadstore::LoadStore & ls);
+Pass CalcSuccessorMatrixPass("CalcSuccessorMatrix", &CalcSuccessorMatrix, Pass::Requires{}, Pass::Destroys{},
+                             Pass::Access{{"Tasks"}, {"TaskEdges", "TaskReachability"}}, &SuccessorMatrixIO);
 
 //! Calculates a matrix of strict successors for every task. Strict successors are important because they can never
-//! run at the same time.
+//! run at the same time. For large task graphs, a compressed index is built instead of the dense n×n matrix.
 bool CalcSuccessorMatrix(Program & prog)
 {
-    prog.TaskReachability = Ladybirds::graph::PruneEdges(prog.TaskGraph);
+    using Ladybirds::graph::ReachabilityIndex;
+    
+    if(prog.TaskGraph.Nodes().size() <= ReachabilityIndex::DefaultDenseLimit)
+    {
+        prog.TaskReachability = ReachabilityIndex(Ladybirds::graph::PruneEdges(prog.TaskGraph));
+        return true;
+    }
+    
+    prog.TaskReachability = ReachabilityIndex::Compressed(prog.TaskGraph);
+    if(prog.TaskReachability.IsDense()) //graph is cyclic
+        prog.TaskReachability = ReachabilityIndex(Ladybirds::graph::PruneEdges(prog.TaskGraph));
+    else Ladybirds::graph::PruneEdges(prog.TaskGraph, prog.TaskReachability);
+    return true;
+}
+
+//! The result of CalcSuccessorMatrix for the pass cache (cf. Pass::ResultIO): the edges left after pruning, as pairs of
+//! task positions in the task list, and the representation of the index. When loading, the other edges are removed
+//! and the index is built from the pruned graph, which saves the transitive reduction.
+bool SuccessorMatrixIO(Program & prog, Ladybirds::loadstore::LoadStore & ls)
+{
+    using Ladybirds::graph::ReachabilityIndex;
+    
+    auto positions = prog.TaskGraph.GetNodeMap(-1);
+    int ntasks = 0;
+    for(auto & t : prog.GetTasks()) positions[t] = ntasks++;
+    
+    std::vector<int> edges;
+    bool dense = prog.TaskReachability.IsDense();
+    if(ls.IsStoring())
+    {
+        for(auto & e : prog.TaskGraph.Edges())
+            edges.push_back(positions[e.GetSource()]), edges.push_back(positions[e.GetTarget()]);
+        return ls.IO("edges", edges) & ls.IO("dense", dense);
+    }
+    
+    if(!(ls.IO("edges", edges) & ls.IO("dense", dense))) return false;
+    std::map<std::pair<int, int>, int> kept; // number of edges to keep between two tasks
+    for(size_t i = 0; i + 1 < edges.size(); i += 2) ++kept[{edges[i], edges[i+1]}];
+    
+    // check that all edges to keep exist before removing anything
+    std::vector<decltype(&*prog.TaskGraph.EdgesBegin())> removed;
+    for(auto & e : prog.TaskGraph.Edges())
+    {
+        auto it = kept.find({positions[e.GetSource()], positions[e.GetTarget()]});
+        if(it == kept.end() || it->second == 0) removed.push_back(&e);
+        else --it->second;
+    }
+    if(edges.size() % 2 != 0 || std::any_of(kept.begin(), kept.end(), [](auto & entry){ return entry.second != 0; }))
+    {
+        ls.Error("The stored task edges do not match the task graph");
+        return false;
+    }
+    
+    for(auto * pedge : removed) prog.TaskGraph.RemoveEdge(pedge);
+    prog.TaskReachability = dense ? ReachabilityIndex(Ladybirds::graph::ReachabilityMatrix(prog.TaskGraph))
+                                  : ReachabilityIndex::Compressed(prog.TaskGraph);
     return true;
 }
 } //namespace ::
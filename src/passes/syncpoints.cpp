@@ -0,0 +1,203 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lua/pass.h"
+#include "dependency.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct SyncArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    bool Ordered = false; ///< The tasks of each group run one after the other, in the order of the group operations
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("ordered", Ordered, false);
+    }
+};
+
+struct SyncEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Task;
+    std::vector<std::string> Waits; ///< Names of the predecessors the task has to wait for
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("task", Task) & ls.IO("waits", Waits);
+    }
+};
+
+struct SyncRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<SyncEntry> Syncs;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("syncs", Syncs);
+    }
+};
+
+bool SyncPoints(Program &prog, SyncArgs &args, SyncRets &rets);
+
+/** Pass SyncPoints: Calculates for each task the minimal set of predecessors it has to wait for, i.e., the tasks it
+ *  depends on (cf. Program::Dependencies) whose completion is not already implied by another predecessor that can
+ *  only finish after them (cf. TaskReachability). With ordered set, the tasks of each group are assumed to run in the
+ *  order of the group operations, so predecessors in the same group need no waits at all, and neither do those
+ *  implied by the waits of earlier tasks in the group (tracked as a vector clock of the group progress). Returns a
+ *  table with the field syncs, which lists task and waits, a list of predecessor names, for every task. **/
+Ladybirds::lua::PassWithArgsAndRet<SyncArgs, SyncRets>
+    SyncPointsPass("SyncPoints", &SyncPoints, Pass::Requires{"CalcSuccessorMatrix", "PopulateGroups"});
+
+
+/// \internal Position of a task in the operations of its group
+struct OpPosition
+{
+    int Group = -1, Index = -1;
+};
+
+/// \internal Removes the waits implied by the vector clock \p clock of the group progress, or by the clocks of the
+/// other waits (\p clocks, which must contain all of \p preds)
+void PruneOrdered(const Program &prog, std::vector<const Task*> &preds, const std::vector<int> &clock,
+                  const std::unordered_map<const Task*, std::vector<int>> &clocks,
+                  const std::unordered_map<const Task*, OpPosition> &positions,
+                  const std::vector<std::vector<const Task*>> &orders)
+{
+    auto byclock = [&](const Task *pred)
+    {
+        auto &pos = positions.at(pred);
+        if(pos.Index < clock[pos.Group]) return true;
+        for(int g = 0, ngroups = clock.size(); g < ngroups; ++g)
+        {   // conservative: only the latest finished task of each group is checked
+            if(clock[g] > 0 && prog.TaskReachability.Reaches(pred, orders[g][clock[g]-1])) return true;
+        }
+        return false;
+    };
+    preds.erase(std::remove_if(preds.begin(), preds.end(), byclock), preds.end());
+
+    // two waits cannot imply each other, so all of them can be checked against the same list
+    auto byother = [&](const Task *pred)
+    {
+        auto &pos = positions.at(pred);
+        return std::any_of(preds.begin(), preds.end(), [&](const Task *other)
+            { return other != pred && clocks.at(other)[pos.Group] > pos.Index; });
+    };
+    std::vector<const Task*> kept;
+    std::copy_if(preds.begin(), preds.end(), std::back_inserter(kept), [&](const Task *p) { return !byother(p); });
+    preds = std::move(kept);
+}
+
+bool SyncPoints(Program &prog, SyncArgs &args, SyncRets &rets)
+{
+    std::unordered_map<const Task*, std::vector<const Task*>> preds;
+    for(auto &t : prog.GetTasks()) preds[&t];
+    for(auto &dep : prog.Dependencies)
+    {
+        const Task *pfrom = dep.From.TheIface->GetTask(), *pto = dep.To.TheIface->GetTask();
+        auto it = preds.find(pto);
+        if(pfrom == pto || it == preds.end() || preds.count(pfrom) == 0) continue;
+        if(std::find(it->second.begin(), it->second.end(), pfrom) == it->second.end()) it->second.push_back(pfrom);
+    }
+
+    // a predecessor is implied by another one it reaches, since that cannot finish before it
+    int ndeps = 0, nwaits = 0;
+    for(auto &entry : preds)
+    {
+        auto &list = entry.second;
+        ndeps += list.size();
+        std::vector<const Task*> kept;
+        for(auto *pred : list)
+        {
+            bool implied = std::any_of(list.begin(), list.end(), [&](const Task *other)
+                { return other != pred && prog.TaskReachability.Reaches(pred, other); });
+            if(!implied) kept.push_back(pred);
+        }
+        list = std::move(kept);
+    }
+
+    if(args.Ordered)
+    {
+        std::unordered_map<const Task*, OpPosition> positions;
+        std::vector<std::vector<const Task*>> orders;
+        for(auto &upgroup : prog.Groups)
+        {
+            orders.emplace_back();
+            for(auto &upop : upgroup->GetOperations())
+            {
+                positions[upop->TheTask] = {(int) orders.size()-1, (int) orders.back().size()};
+                orders.back().push_back(upop->TheTask);
+            }
+        }
+        for(auto &entry : preds)
+        {
+            if(positions.count(entry.first) == 0)
+            {
+                gMsgUI.Error("SyncPoints: Task '%s' is not in any group.", entry.first->GetFullName().c_str());
+                return false;
+            }
+        }
+
+        // walk through the groups in lockstep, as far as the waits allow
+        int ngroups = orders.size(), remaining = preds.size();
+        std::unordered_map<const Task*, std::vector<int>> clocks;
+        std::vector<int> next(ngroups, 0);
+        while(remaining > 0)
+        {
+            bool progress = false;
+            for(int g = 0; g < ngroups; ++g)
+            {
+                if(next[g] >= (int) orders[g].size()) continue;
+                const Task *pt = orders[g][next[g]];
+                auto &list = preds[pt];
+                if(!std::all_of(list.begin(), list.end(), [&](const Task *p) { return clocks.count(p) != 0; }))
+                    continue;
+
+                std::vector<int> clock = next[g] > 0 ? clocks[orders[g][next[g]-1]] : std::vector<int>(ngroups, 0);
+                PruneOrdered(prog, list, clock, clocks, positions, orders);
+                for(auto *pred : list)
+                {
+                    auto &predclock = clocks[pred];
+                    for(int h = 0; h < ngroups; ++h) clock[h] = std::max(clock[h], predclock[h]);
+                }
+                clock[g] = ++next[g];
+                clocks[pt] = std::move(clock);
+                --remaining;
+                progress = true;
+            }
+            if(!progress)
+            {
+                gMsgUI.Error("SyncPoints: The orders of the groups and the dependencies form a cycle.");
+                return false;
+            }
+        }
+    }
+
+    rets.Syncs.clear();
+    rets.Syncs.reserve(preds.size());
+    for(auto &t : prog.GetTasks())
+    {
+        rets.Syncs.emplace_back();
+        auto &entry = rets.Syncs.back();
+        entry.Task = t.GetFullName();
+        for(auto *pred : preds[&t]) entry.Waits.push_back(pred->GetFullName());
+        nwaits += entry.Waits.size();
+    }
+    gMsgUI.Verbose("SyncPoints: %d waits for %d task dependencies", nwaits, ndeps);
+    return true;
+}
+
+} //namespace ::
@@ -0,0 +1,101 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "lua/pass.h"
+#include "kernel.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskfamily.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct TaskFamiliesArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Limit = 50; ///< Maximum number of families listed, the largest ones first (0: all)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("limit", Limit, false, 50);
+    }
+};
+
+struct FamilyInfo : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string First;                ///< Full name of the first task
+    std::vector<std::string> Kernels; ///< Kernels of the template tasks
+    std::vector<int> Domain;
+    int Tasks = 0;
+    int Shifts = 0;                   ///< Number of interfaces of the template whose position changes
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("first", First) & ls.IO("kernels", Kernels) & ls.IO("domain", Domain) & ls.IO("tasks", Tasks)
+             & ls.IO("shifts", Shifts);
+    }
+};
+
+struct TaskFamiliesRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    int Count = 0;    ///< Number of families
+    int Tasks = 0;    ///< Number of tasks in families
+    int AllTasks = 0; ///< Number of tasks of the program
+    std::vector<FamilyInfo> Families;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("count", Count) & ls.IO("tasks", Tasks) & ls.IO("alltasks", AllTasks)
+             & ls.IO("families", Families);
+    }
+};
+
+bool TaskFamilies(Program &prog, TaskFamiliesArgs &args, TaskFamiliesRets &rets);
+
+/** Pass TaskFamilies: Lists the task families of the program, i.e. the loops over generator variables whose iterations
+ *  repeat the same tasks with shifted interface positions (cf. spec::TaskFamily). Returns the number of families and
+ *  of the tasks in them, and for the largest ones (at most limit) the first task, the kernels of the template, the
+ *  iteration domain, the number of tasks and the number of interfaces whose position changes. **/
+Ladybirds::lua::PassWithArgsAndRet<TaskFamiliesArgs, TaskFamiliesRets> TaskFamiliesPass("TaskFamilies",
+                                                                                          &TaskFamilies);
+
+
+bool TaskFamilies(Program &prog, TaskFamiliesArgs &args, TaskFamiliesRets &rets)
+{
+    rets.Count = prog.TaskFamilies.size();
+    rets.Families.resize(prog.TaskFamilies.size());
+    for(size_t i = 0; i < prog.TaskFamilies.size(); ++i)
+    {
+        auto & fam = prog.TaskFamilies[i];
+        auto & info = rets.Families[i];
+        info.Domain = fam.Domain;
+        info.Tasks = fam.GetTaskCount();
+        info.Shifts = fam.Shifts.size();
+        info.Kernels.resize(fam.Period);
+        rets.Tasks += info.Tasks;
+    }
+    for(const Task & t : prog.GetTasks())
+    {
+        ++rets.AllTasks;
+        if(t.Family < 0 || t.FamilyPos >= prog.TaskFamilies[t.Family].Period) continue; // not in the template
+        auto & info = rets.Families[t.Family];
+        if(t.FamilyPos == 0) info.First = t.GetFullName();
+        info.Kernels[t.FamilyPos] = t.GetKernel()->Name;
+    }
+
+    std::stable_sort(rets.Families.begin(), rets.Families.end(),
+                     [](const FamilyInfo & a, const FamilyInfo & b) { return a.Tasks > b.Tasks; });
+    if(args.Limit > 0 && rets.Families.size() > (size_t) args.Limit) rets.Families.resize(args.Limit);
+
+    gMsgUI.Verbose("TaskFamilies: %d families with %d of %d tasks", rets.Count, rets.Tasks, rets.AllTasks);
+    return true;
+}
+
+} //namespace ::
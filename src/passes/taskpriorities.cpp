@@ -0,0 +1,109 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "lua/pass.h"
+#include "dependency.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::lua::Pass;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct PriorityArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double CommCost = 0; ///< Cost per byte of a dependency between tasks of different groups
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("commcost", CommCost, false, 0.0);
+    }
+};
+
+struct PriorityEntry : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Task;
+    double Priority = 0;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("task", Task) & ls.IO("priority", Priority);
+    }
+};
+
+struct PriorityRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::vector<PriorityEntry> Priorities;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("priorities", Priorities);
+    }
+};
+
+bool TaskPriorities(Program &prog, PriorityArgs &args, PriorityRets &rets);
+
+/** Pass TaskPriorities: Calculates the upward rank of each task, i.e., the length of the longest path from the start
+ *  of the task to the end of the program, as used by list schedulers to prefer the tasks on the critical path.
+ *  The path length sums up the task costs (Task::Cost, cf. LoadCost) and, for dependencies between tasks of different
+ *  groups, their size (Dependency::GetMemSize) times commcost. Without any task costs, every task counts as 1.
+ *  Returns a table with the field priorities, which lists task and priority for every task. If all costs are positive,
+ *  ordering the tasks by decreasing priority respects all dependencies. **/
+Ladybirds::lua::PassWithArgsAndRet<PriorityArgs, PriorityRets>
+    TaskPrioritiesPass("TaskPriorities", &TaskPriorities, Pass::Requires{"TaskTopoSort"});
+
+
+bool TaskPriorities(Program &prog, PriorityArgs &args, PriorityRets &rets)
+{
+    std::vector<const Task*> order;
+    bool nocosts = true;
+    for(auto &t : prog.GetTasks())
+    {
+        order.push_back(&t);
+        if(t.Cost != 0) nocosts = false;
+    }
+    if(nocosts) gMsgUI.Verbose("TaskPriorities: No task costs given, assuming equal costs for all tasks");
+
+    std::vector<std::vector<const Ladybirds::spec::Dependency*>> outdeps(order.size());
+    auto index = prog.TaskGraph.GetNodeMap<int>(-1);
+    for(int i = 0, n = order.size(); i < n; ++i) index[order[i]] = i;
+    for(auto &dep : prog.Dependencies)
+    {
+        const Task *pfrom = dep.From.TheIface->GetTask(), *pto = dep.To.TheIface->GetTask();
+        if(pfrom != pto && index[pfrom] >= 0 && index[pto] >= 0) outdeps[index[pfrom]].push_back(&dep);
+    }
+
+    // the tasks are sorted topologically (TaskTopoSort), so all successors are done before a task
+    std::vector<double> ranks(order.size(), 0);
+    for(int i = order.size(); i-- > 0; )
+    {
+        double tail = 0;
+        for(auto *pdep : outdeps[i])
+        {
+            const Task *pto = pdep->To.TheIface->GetTask();
+            double comm = (pto->Group && pto->Group == order[i]->Group) ? 0 : args.CommCost * pdep->GetMemSize();
+            tail = std::max(tail, comm + ranks[index[pto]]);
+        }
+        ranks[i] = (nocosts ? 1 : std::max(order[i]->Cost, 0.0)) + tail;
+    }
+
+    rets.Priorities.clear();
+    rets.Priorities.reserve(order.size());
+    for(int i = 0, n = order.size(); i < n; ++i)
+    {
+        rets.Priorities.emplace_back();
+        rets.Priorities.back().Task = order[i]->GetFullName();
+        rets.Priorities.back().Priority = ranks[i];
+    }
+    return true;
+}
+
+} //namespace ::
@@ -1,13 +1,18 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <algorithm>
+#include <unordered_map>
 #include <unordered_set>
-#include <queue>
 #include <numeric>
 #include <iostream>
+#include <set>
+#include <tuple>
 
 #include "graph/graph-extra.h"
 #include "graph/itemmap.h"
 #include "lua/pass.h"
+#include "dependencyindex.h"
+#include "loadstore.h"
 #include "msgui.h"
 #include "kernel.h"
 #include "program.h"
@@ -15,6 +20,30 @@
 #include "taskgroup.h"
 #include "tools.h"
 
+namespace {
+/// Order in which TaskTopoSort arranges (and thus numbers) the tasks
+enum class TopoOrderKind
+{
+    Level, ///< Level by level, i.e. all tasks of one topological level before the next level
+    Dfs,   ///< Depth first, i.e. a task is followed by the successors that become ready with it
+    Locality ///< Greedily keeping the data that is produced but not yet fully consumed small (cf. GetLocalityOrder)
+};
+}
+
+namespace Ladybirds { namespace loadstore { namespace open {
+    static constexpr EnumOptionsList<TopoOrderKind, 3> mytopoorderlist = { {
+        { "level", TopoOrderKind::Level },
+        { "dfs", TopoOrderKind::Dfs },
+        { "locality", TopoOrderKind::Locality }
+    } };
+    
+    template<>
+    struct EnumOptions<TopoOrderKind>
+    {
+        static constexpr auto & list = mytopoorderlist;
+    };
+}}}//namespace Ladybirds::loadstore::open
+
 namespace {
 
 using std::vector;
@@ -22,68 +51,248 @@ using Ladybirds::spec::Task;
 using Ladybirds::impl::Program;
 using Ladybirds::lua::Pass;
 
+struct TopoSortArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    TopoOrderKind Order = TopoOrderKind::Level;
+    
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        Ladybirds::loadstore::EnumStringInterface<TopoOrderKind> order(Order);
+        return ls.IO("order", order, false, "level");
+    }
+};
 
-bool TaskTopoSort(Program & prog);
-Pass TaskTopoSortPass("TaskTopoSort", &TaskTopoSort, Pass::Requires{},
+bool TaskTopoSort(Program & prog, TopoSortArgs & args);
+/** Pass TaskTopoSort: Sorts the task list topologically and renumbers the tasks accordingly, such that maps and sets
+ *  over the tasks are accessed mostly sequentially by later passes. Also fills Program::TaskLevels.
+ *  The optional argument order selects between a level-by-level order ("level", the default), a depth-first
+ *  order ("dfs") that keeps producers and consumers close together, and an order that keeps the amount of produced but
+ *  not yet consumed data small ("locality"), such that it rather stays in the cache when the tasks run in this order
+ *  (e.g. in the single backend). **/
+Ladybirds::lua::PassWithArgs<TopoSortArgs> TaskTopoSortPass("TaskTopoSort", &TaskTopoSort, Pass::Requires{},
                       Pass::Destroys{"CalcSuccessorMatrix", "LoadMapping", "PopulateGroups"});
 
 
-/// \internal Sorts \p depgraph topologically and returns the order in \p order.
+/// \internal Sorts \p depgraph topologically, level by level, and returns the order in \p order.
 /// Returns true on success and false if the dependency graph is cyclic.
-bool GetTopologicalOrder(const Ladybirds::spec::TaskGraph & tg, /*out*/ vector<const Task *> & order)
+bool GetLevelOrder(const Ladybirds::spec::TaskGraph & tg, /*out*/ vector<const Task *> & order)
 {
     // basic idea: gradually "schedule" tasks (i.e. append them to order), starting with tasks without predecessors
-    // remove each scheduled task from the graph (of course not in real, we just alter a map called inEdgeCounts)
-    // when a node is removed, there may be new nodes without predecessor
+    // remove each scheduled task from the graph (of course not in real, we just alter a vector called inEdgeCounts)
+    // when a node is removed, there may be new nodes without predecessor. These are scheduled in the next round, in
+    // the order in which they appear in the graph.
+    auto csr = tg.Freeze();
+    using Index = decltype(csr)::Index;
+    assert(order.empty());
+    if(std::size_t(csr.NodeCount()) >= Ladybirds::graph::ParallelNodeLimit)
+    {
+        vector<Index> indices;
+        bool acyclic = Ladybirds::graph::ParallelLevelOrder(csr, indices);
+        order.reserve(indices.size());
+        for(Index i : indices) order.push_back(&csr.GetNode(i));
+        return acyclic;
+    }
     
-    auto inEdgeCounts = tg.GetNodeMap<int>(0); //create a map with the incoming edge count for each node
-    for(auto & t : tg.Nodes()) inEdgeCounts[t] = t.InEdgeCount();
+    vector<int> inEdgeCounts(csr.NodeCount()); //the incoming edge count for each node
+    vector<Index> candidates, next; //nodes that are ready to be scheduled in this and the next round
+    for(Index i = 0, n = csr.NodeCount(); i < n; ++i)
+    {
+        inEdgeCounts[i] = csr.InDegree(i);
+        if(inEdgeCounts[i] == 0) candidates.push_back(i);
+    }
     
-    assert(order.empty());
-    order.reserve(tg.Nodes().size());
+    order.reserve(csr.NodeCount());
     
-    std::queue<const Task*> candidates; //nodes that are ready to be scheduled
-    while(true)
+    while(!candidates.empty())
     {
-        for(auto & t : tg.Nodes())
+        for(Index cur : candidates)
         {
-            if(inEdgeCounts[t] == 0) //no further incoming edges, so the node is ready to be scheduled
+            order.push_back(&csr.GetNode(cur));
+            
+            //now all successors of the node have one dependency fulfilled, i.e. reduce the number of incoming edges
+            for(Index succ : csr.Successors(cur))
             {
-                candidates.push(&t);
-                inEdgeCounts[t] = -1; //don't add it twice to the candidate list
+                if(--inEdgeCounts[succ] == 0) next.push_back(succ);
             }
         }
-        if(candidates.empty()) break;
+        std::sort(next.begin(), next.end());
+        candidates.swap(next);
+        next.clear();
+    }
+    return order.size() == tg.Nodes().size();
+}
+
+
+/// \internal Sorts \p depgraph topologically, depth first, and returns the order in \p order.
+/// Returns true on success and false if the dependency graph is cyclic.
+bool GetDfsOrder(const Ladybirds::spec::TaskGraph & tg, /*out*/ vector<const Task *> & order)
+{
+    // same as GetLevelOrder, but the ready tasks are kept on a stack: the successors that become ready when a task is
+    // scheduled are scheduled next (in the order of the edges), such that chains of tasks stay together.
+    auto csr = tg.Freeze();
+    using Index = decltype(csr)::Index;
+    
+    vector<int> inEdgeCounts(csr.NodeCount());
+    vector<Index> candidates;
+    for(Index i = csr.NodeCount(); i-- > 0; )
+    {
+        inEdgeCounts[i] = csr.InDegree(i);
+        if(inEdgeCounts[i] == 0) candidates.push_back(i);
+    }
+    
+    assert(order.empty());
+    order.reserve(csr.NodeCount());
+    
+    while(!candidates.empty())
+    {
+        Index cur = candidates.back();
+        candidates.pop_back();
+        order.push_back(&csr.GetNode(cur));
         
-        do
+        auto succs = csr.Successors(cur);
+        for(auto it = succs.end(); it != succs.begin(); )
         {
-            auto cur = candidates.front(); //select a node and schedule it
-            candidates.pop();
-            order.push_back(cur);
-            
-            //now all successors of the node have one dependency fulfilled, i.e. reduce the number of incoming edges
-            for(auto & d : cur->OutEdges()) --inEdgeCounts[d.GetTarget()];
-            
-        } while(!candidates.empty());
-    }    
+            Index succ = *--it;
+            if(--inEdgeCounts[succ] == 0) candidates.push_back(succ);
+        }
+    }
     return order.size() == tg.Nodes().size();
 }
 
 
+/// \internal Sorts the tasks of \p prog topologically such that the data in flight stays small, and returns the order
+/// in \p order. Returns true on success and false if the dependency graph is cyclic.
+bool GetLocalityOrder(const Program & prog, /*out*/ vector<const Task *> & order)
+{
+    // Like a memory-aware list scheduler: among the ready tasks, the one is taken next that increases the amount of
+    // live data least, i.e. produces the fewest bytes and completes the consumption of the most bytes. The data of an
+    // interface is live from its producer until its last consumer. Among equal tasks, the one that became ready last
+    // is taken, as its inputs are the most recently produced ones (short reuse distance). Unlike a level-by-level
+    // order, which runs all instances of one stage of a wide fan-out before the next stage, this interleaves stages.
+    using Ladybirds::spec::Iface;
+    auto csr = prog.TaskGraph.Freeze();
+    using Index = decltype(csr)::Index;
+    auto & depindex = prog.GetDependencyIndex();
+    Index n = csr.NodeCount();
+    
+    // the producing interfaces with the number of distinct tasks that still have to consume their data
+    std::unordered_map<const Iface*, int> remaining;
+    vector<long> produced(n, 0), released(n, 0);
+    vector<char> done(n, 0);
+    auto consumers = [&](const Iface * piface)
+    {
+        vector<Index> ret;
+        for(auto * pdep : depindex.GetOutDeps(*piface))
+        {
+            auto * pto = pdep->To.TheIface->GetTask();
+            if(pto != &prog.MainTask) ret.push_back(csr.GetIndex(pto));
+        }
+        std::sort(ret.begin(), ret.end());
+        ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+        return ret;
+    };
+    for(auto * piface : depindex.GetProducers())
+    {
+        if(piface->GetTask() == &prog.MainTask) continue;
+        auto cons = consumers(piface);
+        if(cons.empty()) continue;
+        remaining[piface] = cons.size();
+        produced[csr.GetIndex(piface->GetTask())] += piface->GetMemSize();
+        if(cons.size() == 1) released[cons[0]] += piface->GetMemSize();
+    }
+    // the producing interfaces each task consumes from, each once
+    auto inputs = [&](Index i)
+    {
+        vector<const Iface*> ret;
+        for(auto * pdep : depindex.GetInDeps(csr.GetNode(i)))
+        {
+            if(remaining.count(pdep->From.TheIface)) ret.push_back(pdep->From.TheIface);
+        }
+        std::sort(ret.begin(), ret.end());
+        ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+        return ret;
+    };
+    
+    // ready tasks by increase of the live data, then by the time they became ready (latest first)
+    using Key = std::tuple<long, int, Index>;
+    std::set<Key> ready;
+    vector<int> readytime(n, 0);
+    int now = 0;
+    auto key = [&](Index i) { return Key(produced[i] - released[i], -readytime[i], i); };
+    
+    vector<int> inEdgeCounts(n);
+    for(Index i = 0; i < n; ++i)
+    {
+        inEdgeCounts[i] = csr.InDegree(i);
+        if(inEdgeCounts[i] == 0) ready.insert(key(i));
+    }
+    
+    assert(order.empty());
+    order.reserve(n);
+    while(!ready.empty())
+    {
+        Index cur = std::get<2>(*ready.begin());
+        ready.erase(ready.begin());
+        order.push_back(&csr.GetNode(cur));
+        done[cur] = 1;
+        ++now;
+        
+        // the last consumer of an interface releases its data
+        for(auto * piface : inputs(cur))
+        {
+            if(--remaining[piface] != 1) continue;
+            for(Index c : consumers(piface))
+            {
+                if(done[c]) continue;
+                bool isready = inEdgeCounts[c] == 0;
+                if(isready) ready.erase(key(c));
+                released[c] += piface->GetMemSize();
+                if(isready) ready.insert(key(c));
+            }
+        }
+        for(Index succ : csr.Successors(cur))
+        {
+            if(--inEdgeCounts[succ] != 0) continue;
+            readytime[succ] = now;
+            ready.insert(key(succ));
+        }
+    }
+    return order.size() == (size_t) n;
+}
+
+/// \internal Returns the topological level of each task in \p tg, i.e. the length of the longest path leading to it.
+/// \p tg must be sorted topologically.
+Program::LevelMap GetLevels(const Ladybirds::spec::TaskGraph & tg)
+{
+    auto ret = tg.GetNodeMap<int>(0);
+    for(auto & t : tg.Nodes())
+    {
+        int level = 0;
+        for(auto & e : t.InEdges()) level = std::max(level, ret[e.GetSource()] + 1);
+        ret[t] = level;
+    }
+    return ret;
+}
+
+
 //! Evaluates dependencies between the tasks and sorts the task list topologically.
 //! If there are cyclic dependencies, an error message is printed and false is returned.
-bool TaskTopoSort(Program & prog)
+bool TaskTopoSort(Program & prog, TopoSortArgs & args)
 {
     vector<const Task*> topoOrder;
-    if(!GetTopologicalOrder(prog.TaskGraph, topoOrder))
+    bool acyclic = (args.Order == TopoOrderKind::Dfs)      ? GetDfsOrder(prog.TaskGraph, topoOrder)
+                 : (args.Order == TopoOrderKind::Locality) ? GetLocalityOrder(prog, topoOrder)
+                                                           : GetLevelOrder(prog.TaskGraph, topoOrder);
+    if(!acyclic)
     {
         auto & strm = gMsgUI.Error("The program has cyclic dependencies between the tasks.");
         
-        auto sccs = StronglyConnected(prog.TaskGraph);
+        auto sccs = prog.TaskGraph.Nodes().size() >= Ladybirds::graph::ParallelNodeLimit
+                  ? Ladybirds::graph::ParallelStronglyConnected(prog.TaskGraph) : StronglyConnected(prog.TaskGraph);
         strm << sccs.size() << " (cyclic) strongly connected components:\n";
         for(auto & scc : sccs)
         {
-            for(auto * n : scc) strm << " " << n->Name;
+            for(auto * n : scc) strm << " " << n->GetFullName();
             strm << std::endl;
         }
         strm << std::endl;
@@ -91,6 +300,7 @@ bool TaskTopoSort(Program & prog)
     }
     
     prog.TaskGraph.ReorderNodes(topoOrder);
+    prog.TaskLevels = GetLevels(prog.TaskGraph);
     return true;
 }
 } //namespace ::
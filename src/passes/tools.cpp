@@ -1,13 +1,30 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "llvm/Support/Path.h"
 #include "llvm/Support/FileSystem.h"
 #include "lua/luadump.h"
 #include "lua/luaenv.h"
 #include "lua/pass.h"
+#include "parse/parsecache.h"
 #include "cmdlineoptions.h"
+#include "mustache.h"
 
 #define CHECK_ERRORS(lua, err, msg, ...) \
     if(err) luaL_error(lua, msg ": %s", __VA_ARGS__, err.message().c_str());
@@ -15,6 +32,8 @@
 namespace{
 
 using PathString = llvm::SmallString<128>;
+using Ladybirds::tools::MustacheTemplate;
+using Ladybirds::tools::MustacheValue;
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -41,14 +60,142 @@ void MakeRealPath(lua_State *lua, PathString &path)
     llvm::sys::path::remove_dots(path, true);
 }
 
+/// Converts Lua values into the view model of MustacheTemplate. Only the fields with one of the given names are
+/// taken over (and thus read, such that lazily filled tables are only filled as needed). A table that is reached
+/// several times is converted once.
+class ModelConverter
+{
+private:
+    lua_State *Lua_;
+    const std::unordered_set<std::string> & Names_;
+    std::deque<MustacheValue> Values_;
+    std::unordered_map<const void*, const MustacheValue*> Tables_;
+
+public:
+    ModelConverter(lua_State *lua, const std::unordered_set<std::string> & names) : Lua_(lua), Names_(names) {}
+
+    /// Returns the view model value of the Lua value at stack index \p index, which lives as long as this object
+    const MustacheValue * Convert(int index)
+    {
+        switch(lua_type(Lua_, index))
+        {
+            case LUA_TBOOLEAN:
+                if(!lua_toboolean(Lua_, index))
+                { // unlike nil, a false field hides the fields of the same name further out
+                    Values_.emplace_back();
+                    return &Values_.back();
+                }
+                // fall through
+            case LUA_TNUMBER:
+            case LUA_TSTRING:
+            {
+                Values_.emplace_back();
+                auto & val = Values_.back();
+                val.Type = MustacheValue::Kind::Scalar;
+                size_t len;
+                const char *str = luaL_tolstring(Lua_, index, &len); // as Lua prints numbers
+                val.Text.assign(str, len);
+                lua_pop(Lua_, 1);
+                return &val;
+            }
+            case LUA_TTABLE:
+                break;
+            default:
+                return &MustacheValue::Nil;
+        }
+
+        index = lua_absindex(Lua_, index);
+        auto & pval = Tables_[lua_topointer(Lua_, index)];
+        if(pval) return pval;
+        Values_.emplace_back();
+        auto & val = Values_.back();
+        val.Type = MustacheValue::Kind::Table;
+        pval = &val;
+
+        luaL_checkstack(Lua_, 4, "View model nested too deeply");
+        for(auto & name : Names_)
+        {
+            lua_getfield(Lua_, index, name.c_str());
+            auto pfield = Convert(-1);
+            lua_pop(Lua_, 1);
+            if(pfield != &MustacheValue::Nil) val.Fields.emplace(name, pfield);
+        }
+        for(lua_Integer i = 1, n = luaL_len(Lua_, index); i <= n; ++i)
+        {
+            lua_geti(Lua_, index, i);
+            val.Items.push_back(Convert(-1));
+            lua_pop(Lua_, 1);
+        }
+        return &val;
+    }
+};
+
+/// Makes \p to a symlink to \p from, replacing whatever is there unless it already is such a link (such that its
+/// timestamp does not change)
 int MkSymlink(lua_State *lua, const char *from, const char *to)
 {
+    char target[PATH_MAX];
+    ssize_t len = readlink(to, target, sizeof(target));
+    if(len >= 0 && llvm::StringRef(target, len) == from) return 0; //up to date
+    unlink(to);
     if(symlink(from, to) == 0) return 0; //success
     
     char err[256];
     (void) !strerror_r(errno, err, sizeof(err)); // There two versions of strerror_r with different return types...
     return luaL_error(lua, "Cannot create symlink from '%s'to '%s': %s", from, to, err);
 }
+/// Appends the fields of the table at stack index \p index with a string key and a number, string or boolean value to
+/// \p out, as type character, key and value, the latter two as length:text. Other fields are skipped.
+void PackFields(lua_State *lua, int index, std::string &out)
+{
+    auto append = [&out](const char *str, size_t len) { out += std::to_string(len); out += ':'; out.append(str, len); };
+    for(lua_pushnil(lua); lua_next(lua, index); lua_pop(lua, 1))
+    {
+        if(lua_type(lua, -2) != LUA_TSTRING) continue;
+        int type = lua_type(lua, -1);
+        if(type != LUA_TNUMBER && type != LUA_TSTRING && type != LUA_TBOOLEAN) continue;
+        
+        out += type == LUA_TNUMBER ? 'n' : type == LUA_TSTRING ? 's' : 'b';
+        size_t len;
+        const char *key = lua_tolstring(lua, -2, &len);
+        append(key, len);
+        if(type == LUA_TBOOLEAN) append(lua_toboolean(lua, -1) ? "1" : "0", 1);
+        else
+        {
+            const char *val = luaL_tolstring(lua, -1, &len); // numbers as Lua prints them, such that integers stay so
+            append(val, len);
+            lua_pop(lua, 1);
+        }
+    }
+}
+
+/// Pushes a table with the fields packed into \p data by PackFields. Returns false if \p data is malformed.
+bool UnpackFields(lua_State *lua, const std::string &data)
+{
+    lua_newtable(lua);
+    size_t pos = 0;
+    auto take = [&data, &pos](std::string &str)
+    {
+        size_t colon = data.find(':', pos);
+        if(colon == std::string::npos) return false;
+        size_t len = strtoul(data.c_str() + pos, nullptr, 10);
+        if(colon + 1 + len > data.size()) return false;
+        str = data.substr(colon + 1, len);
+        pos = colon + 1 + len;
+        return true;
+    };
+    std::string key, val;
+    while(pos < data.size())
+    {
+        char type = data[pos++];
+        if(!take(key) || !take(val)) return false;
+        if(type == 'b') lua_pushboolean(lua, val == "1");
+        else if(type != 'n' || lua_stringtonumber(lua, val.c_str()) == 0) lua_pushlstring(lua, val.data(), val.size());
+        lua_setfield(lua, -2, key.c_str());
+    }
+    return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Lua C functions
 
@@ -79,7 +226,7 @@ int MkPath(lua_State *lua)
     return 0;
 }
 
-/// Creates a symlink from \p from to \p to (1st and 2nd argument).
+/// Creates a symlink from \p from to \p to (1st and 2nd argument), replacing an existing file \p to.
 /// The link is relative to the symlink location (like ln -sr).
 int SymLink(lua_State *lua)
 {
@@ -121,6 +268,220 @@ int SymLink(lua_State *lua)
     return MkSymlink(lua, relpath.c_str(), to.c_str());
 }
 
+/// Renders templates concurrently. The only argument is a list of jobs {template=<path of the template file>,
+/// model=<view model>, output=<path>}; outputs that already have the rendered contents are not written again.
+/// Returns a list with true for each job whose output was written and false for the others.
+/// The view models are converted once beforehand (cf. ModelConverter), so the threads do not need the Lua state.
+int RenderAll(lua_State *lua)
+{
+    luaL_checktype(lua, 1, LUA_TTABLE);
+    struct Job
+    {
+        const MustacheTemplate * Template;
+        const MustacheValue * Model;
+        std::string Output;
+        bool Changed = false, Failed = false;
+    };
+    std::vector<Job> jobs(luaL_len(lua, 1));
+
+    std::unordered_map<std::string, MustacheTemplate> templates;
+    std::unordered_set<std::string> names;
+    for(size_t i = 0; i < jobs.size(); ++i)
+    {
+        lua_geti(lua, 1, i+1);
+        if(lua_getfield(lua, -1, "template") != LUA_TSTRING || lua_getfield(lua, -2, "output") != LUA_TSTRING)
+        {
+            return luaL_error(lua, "Render job %d needs a template and an output", int(i+1));
+        }
+        jobs[i].Output = lua_tostring(lua, -1);
+        std::string path = lua_tostring(lua, -2);
+        lua_pop(lua, 3);
+
+        auto res = templates.emplace(path, MustacheTemplate());
+        if(res.second)
+        {
+            std::string text, err;
+            if(!Ladybirds::parse::ReadFile(path, text))
+            {
+                return luaL_error(lua, "Cannot read template '%s'", path.c_str());
+            }
+            if(!res.first->second.Parse(text, err))
+            {
+                return luaL_error(lua, "Error in template '%s': %s", path.c_str(), err.c_str());
+            }
+            res.first->second.CollectNames(names);
+        }
+        jobs[i].Template = &res.first->second;
+    }
+
+    ModelConverter converter(lua, names);
+    for(size_t i = 0; i < jobs.size(); ++i)
+    {
+        lua_geti(lua, 1, i+1);
+        lua_getfield(lua, -1, "model");
+        jobs[i].Model = converter.Convert(-1);
+        lua_pop(lua, 2);
+    }
+
+    std::atomic<size_t> next(0);
+    auto work = [&jobs, &next]
+    {
+        for(size_t i; (i = next++) < jobs.size(); )
+        {
+            auto & job = jobs[i];
+            std::string text, old;
+            job.Template->Render(*job.Model, text);
+            if(Ladybirds::parse::ReadFile(job.Output, old) && old == text) continue;
+            job.Changed = true;
+            job.Failed = !Ladybirds::parse::WriteFileAtomic(job.Output, text);
+        }
+    };
+    size_t nthreads = std::min<size_t>(jobs.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i < nthreads; ++i) threads.emplace_back(work);
+    work();
+    for(auto & thread : threads) thread.join();
+
+    lua_createtable(lua, jobs.size(), 0);
+    for(size_t i = 0; i < jobs.size(); ++i)
+    {
+        if(jobs[i].Failed) return luaL_error(lua, "Unable to write '%s'", jobs[i].Output.c_str());
+        lua_pushboolean(lua, jobs[i].Changed);
+        lua_seti(lua, -2, i+1);
+    }
+    return 1;
+}
+
+/// Calls a function for every entry of a list, each call in a child process of its own (cf. fork), such that the calls
+/// work on copy-on-write copies of the Lua state and of the programs in it, and may change them freely. Arguments: the
+/// list, the function, the number of processes running at once (optional, default: one per hardware thread) and a
+/// function called in this process with the index and the result of each call as soon as it has finished (optional).
+/// A call returns a table, of which only the fields with string keys and number, string or boolean values are passed
+/// back. Returns the list of these results, in the order of the entries; the result of a call that failed is a table
+/// with the error message as error.
+int ForkEach(lua_State *lua)
+{
+    luaL_checktype(lua, 1, LUA_TTABLE);
+    luaL_checktype(lua, 2, LUA_TFUNCTION);
+    lua_Integer nprocs = luaL_optinteger(lua, 3, std::max(1u, std::thread::hardware_concurrency()));
+    bool ondone = !lua_isnoneornil(lua, 4);
+    if(ondone) luaL_checktype(lua, 4, LUA_TFUNCTION);
+    lua_settop(lua, 4);
+    lua_Integer njobs = luaL_len(lua, 1);
+    lua_createtable(lua, njobs, 0);
+    const int resultidx = lua_gettop(lua);
+    
+    struct Child
+    {
+        pid_t Pid;
+        int Fd;
+        lua_Integer Job;
+        std::string Data;
+    };
+    std::vector<Child> running;
+    auto killall = [&running]
+    {
+        for(auto & child : running)
+        {
+            kill(child.Pid, SIGKILL);
+            close(child.Fd);
+            waitpid(child.Pid, nullptr, 0);
+        }
+    };
+    
+    for(lua_Integer next = 1; next <= njobs || !running.empty(); )
+    {
+        while(next <= njobs && lua_Integer(running.size()) < std::max<lua_Integer>(nprocs, 1))
+        {
+            int fds[2];
+            fflush(stdout), fflush(stderr); // or the children would print what is buffered again
+            pid_t pid = pipe(fds) == 0 ? fork() : -1;
+            if(pid < 0)
+            {
+                int err = errno;
+                killall();
+                errno = err;
+                return luaL_error(lua, "Unable to start a process for entry %d: %s", int(next), strerror(errno));
+            }
+            if(pid == 0)
+            {
+                close(fds[0]);
+                std::string out;
+                lua_pushvalue(lua, 2);
+                lua_geti(lua, 1, next);
+                int status = 0;
+                if(lua_pcall(lua, 1, 1, 0) != LUA_OK)
+                {
+                    const char *msg = lua_isstring(lua, -1) ? lua_tostring(lua, -1) : "error object is not a string";
+                    lua_newtable(lua);
+                    lua_pushstring(lua, msg);
+                    lua_setfield(lua, -2, "error");
+                    status = 1;
+                }
+                if(lua_istable(lua, -1)) PackFields(lua, lua_gettop(lua), out);
+                for(size_t pos = 0; pos < out.size(); )
+                {
+                    ssize_t n = write(fds[1], out.data() + pos, out.size() - pos);
+                    if(n <= 0 && errno != EINTR) break;
+                    if(n > 0) pos += n;
+                }
+                fflush(stdout), fflush(stderr);
+                _exit(status); // no exit handlers, they belong to the parent
+            }
+            close(fds[1]);
+            running.push_back({pid, fds[0], next++, std::string()});
+        }
+        
+        std::vector<pollfd> polls;
+        for(auto & child : running) polls.push_back({child.Fd, POLLIN, 0});
+        if(poll(polls.data(), polls.size(), -1) < 0 && errno != EINTR)
+        {
+            killall();
+            return luaL_error(lua, "Waiting for the processes failed: %s", strerror(errno));
+        }
+        for(size_t i = polls.size(); i-- > 0; )
+        {
+            if(!polls[i].revents) continue;
+            auto & child = running[i];
+            char buf[4096];
+            ssize_t n = read(child.Fd, buf, sizeof(buf));
+            if(n > 0 || (n < 0 && errno == EINTR))
+            {
+                if(n > 0) child.Data.append(buf, n);
+                continue;
+            }
+            
+            // end of the output: the child has finished
+            close(child.Fd);
+            int status = 0;
+            waitpid(child.Pid, &status, 0);
+            bool ok = UnpackFields(lua, child.Data);
+            if(!ok || (child.Data.empty() && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)))
+            {
+                lua_pop(lua, 1);
+                lua_newtable(lua);
+                lua_pushstring(lua, WIFSIGNALED(status) ? strsignal(WTERMSIG(status)) : "no result");
+                lua_setfield(lua, -2, "error");
+            }
+            lua_Integer job = child.Job;
+            running.erase(running.begin() + i);
+            if(ondone)
+            {
+                lua_pushvalue(lua, 4);
+                lua_pushinteger(lua, job);
+                lua_pushvalue(lua, -3);
+                if(lua_pcall(lua, 2, 0, 0) != LUA_OK)
+                {
+                    killall();
+                    return lua_error(lua);
+                }
+            }
+            lua_seti(lua, resultidx, job);
+        }
+    }
+    return 1;
+}
+
 } //namespace ::
 
 
@@ -132,12 +493,14 @@ class ToolsPass : public Ladybirds::lua::Pass
     {
         constexpr luaL_Reg fntable[] = 
         {
-            { "realpath",  &RealPath },
-            { "basename",  &BaseName },
-            { "dirname",   &DirName  },
-            { "mkpath",    &MkPath   },
-            { "symlink",   &SymLink  },
-            { nullptr,     nullptr   }
+            { "realpath",  &RealPath  },
+            { "basename",  &BaseName  },
+            { "dirname",   &DirName   },
+            { "mkpath",    &MkPath    },
+            { "symlink",   &SymLink   },
+            { "renderall", &RenderAll },
+            { "forkeach",  &ForkEach  },
+            { nullptr,     nullptr    }
         };
         
         luaL_newlib(lua, fntable);
@@ -158,3 +521,23 @@ class CmdLinePass : public Ladybirds::lua::Pass
     };
 };
 static CmdLinePass MyCLPass("CmdLineArgs", nullptr);
+
+/// PassStatsPass: Pseudo pass returning a table with the statistics of the passes applied so far, as passes = {...}
+/// (cf. Ladybirds::lua::PassStats, e.g. for the report)
+class PassStatsPass : public Ladybirds::lua::Pass
+{
+    using Pass::Pass;
+    struct StatsList : public Ladybirds::loadstore::LoadStorableCompound
+    {
+        virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+            { return ls.IO("passes", Ladybirds::lua::GetPassStats()); }
+    };
+    virtual int Run(lua_State *lua) override
+    {
+        Ladybirds::lua::LuaDump ld(lua);
+        StatsList list;
+        if(ld.RawIO(list)) return 1;
+        else return luaL_error(lua, "Unable to export pass statistics to lua environment");
+    };
+};
+static PassStatsPass MyPSPass("PassStats", nullptr);
@@ -0,0 +1,625 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lua/pass.h"
+#include "opt/schedule.h"
+#include "spec/platform.h"
+#include "dependency.h"
+#include "kernel.h"
+#include "loadstore.h"
+#include "msgui.h"
+#include "program.h"
+#include "task.h"
+#include "taskgroup.h"
+#include "tools.h"
+
+
+using Ladybirds::impl::Program;
+using Ladybirds::lua::Pass;
+using Ladybirds::opt::Schedule;
+using Ladybirds::spec::Platform;
+using Ladybirds::spec::Task;
+
+namespace {
+
+struct TraceCostArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Filename; ///< Trace in the Chrome trace event format, as written by pthreads-dynamic with -trace
+    std::string Output;   ///< File to write the measured costs to, in the format of LoadCost (empty: none)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("filename", Filename) & ls.IO("output", Output, false);
+    }
+};
+
+struct TraceCostRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double Achieved = 0;  ///< Mean makespan of the traced invocations
+    double Predicted = 0; ///< Makespan of the traced schedule predicted from the measured costs (0: not possible)
+    int Instances = 0;    ///< Number of invocations the means are taken over
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("achieved", Achieved) & ls.IO("predicted", Predicted) & ls.IO("instances", Instances);
+    }
+};
+
+bool TraceCost(Program &prog, TraceCostArgs &args, TraceCostRets &rets);
+
+/** Pass TraceCost: Sets the costs of the tasks (Task::Cost) to their mean durations in a trace of the generated
+ *  program (cf. -trace in pthreads-dynamic, timestamps in µs). Tasks missing from the trace get the mean of the traced
+ *  tasks of their kernel. If output is given, the task and kernel costs are also written to this file as the tables
+ *  costs and kernelcosts (cf. LoadCost), for use in later compilations. The n-th last runs of all tasks are taken as
+ *  one invocation, the makespan of which is the time from the start of its first task to the end of its last one.
+ *  Returns a table with the mean makespan achieved, the makespan predicted for the same tracks and orders of the tasks
+ *  with the measured costs and the dependencies, and the number of invocations. **/
+Ladybirds::lua::PassWithArgsAndRet<TraceCostArgs, TraceCostRets> TraceCostPass("TraceCost", &TraceCost);
+
+
+struct CompareTimingsArgs : public Ladybirds::loadstore::LoadStorableCompound
+{
+    Platform *pPlatform = nullptr;
+    std::string Filename; ///< Trace of the generated program, as for TraceCost
+    double Scale = 0;     ///< Cost units per µs of the trace (0: fit to the task durations)
+    int Weight = 0;       ///< Weight for the list scheduling of the prediction (cf. ListSchedule)
+    int Outliers = 10;    ///< Number of tasks to report with the largest deviations
+    bool Refit = false;   ///< Whether to fit the costs of the platform connections to the measured times
+    std::string Output;   ///< File to write the platform with the refitted costs to, as a Lua script (empty: none)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IOHandle("platform", pPlatform, nullptr)
+             & ls.IO("filename", Filename)
+             & ls.IO("scale", Scale, false, 0.0)
+             & ls.IO("weight", Weight, false, 0)
+             & ls.IO("outliers", Outliers, false, 10)
+             & ls.IO("refit", Refit, false, false)
+             & ls.IO("output", Output, false);
+    }
+};
+
+struct KernelBias : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Kernel;
+    int Tasks = 0;
+    double Predicted = 0, Measured = 0; ///< Mean durations in cost units
+    double Bias = 0;                    ///< Measured / Predicted - 1
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("kernel", Kernel) & ls.IO("tasks", Tasks) & ls.IO("predicted", Predicted)
+             & ls.IO("measured", Measured) & ls.IO("bias", Bias);
+    }
+};
+
+struct TaskOutlier : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string Task;
+    double Predicted = 0, Measured = 0, Ratio = 0; ///< Ratio: Measured / Predicted
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("task", Task) & ls.IO("predicted", Predicted) & ls.IO("measured", Measured)
+             & ls.IO("ratio", Ratio);
+    }
+};
+
+struct ConnectionError : public Ladybirds::loadstore::LoadStorableCompound
+{
+    std::string From, To; ///< Names of the core or memory at either end
+    int Samples = 0;      ///< Number of dependencies (DMA) or tasks (core to memory) compared
+    double Predicted = 0, Measured = 0; ///< Mean communication times (DMA) or access times (core to memory)
+    double Error = 0;     ///< Mean of the absolute differences, relative to the mean predicted time
+    int FixCost = 0, ReadCost = 0, WriteCost = 0; ///< Refitted costs (only with refit)
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("from", From) & ls.IO("to", To) & ls.IO("samples", Samples)
+             & ls.IO("predicted", Predicted) & ls.IO("measured", Measured) & ls.IO("error", Error)
+             & ls.IO("fixcost", FixCost) & ls.IO("readcost", ReadCost) & ls.IO("writecost", WriteCost);
+    }
+};
+
+struct CompareTimingsRets : public Ladybirds::loadstore::LoadStorableCompound
+{
+    double Scale = 0;
+    double PredictedMakespan = 0, MeasuredMakespan = 0;
+    std::vector<std::string> CriticalPath; ///< Tasks on the critical path of the prediction
+    double PathPredicted = 0, PathMeasured = 0; ///< Sums of the durations of these tasks
+    std::vector<KernelBias> Kernels;
+    std::vector<TaskOutlier> Outliers;
+    std::vector<ConnectionError> Connections;
+
+    virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+    {
+        return ls.IO("scale", Scale) & ls.IO("predictedmakespan", PredictedMakespan)
+             & ls.IO("measuredmakespan", MeasuredMakespan) & ls.IO("criticalpath", CriticalPath)
+             & ls.IO("pathpredicted", PathPredicted) & ls.IO("pathmeasured", PathMeasured)
+             & ls.IO("kernels", Kernels) & ls.IO("outliers", Outliers) & ls.IO("connections", Connections);
+    }
+};
+
+bool CompareTimings(Program &prog, CompareTimingsArgs &args, CompareTimingsRets &rets);
+
+/** Pass CompareTimings: Compares the list schedule predicted for the current costs on the given platform (cf.
+ *  ListSchedule) with a trace of the generated program (as for TraceCost), to show where the cost model is wrong. The
+ *  measured times are converted to cost units by scale, which by default is fitted to the task durations by least
+ *  squares. Returns a table with the scale, the predicted and measured makespans, the critical path of the
+ *  prediction with the predicted and measured sums of its task durations, the bias of each kernel (mean measured over
+ *  mean predicted duration, minus 1), the tasks with the largest deviations, and the error of each platform connection:
+ *  for DMA connections, the predicted transfer times of the dependencies between cores compared to the gaps between
+ *  the end of the producer and the start of the consumer in the trace, and for a core with a single memory, the
+ *  predicted access times of its tasks compared to their measured durations minus Task::Cost. With refit, FixCost
+ *  and WriteCost of the DMA connections, and ReadCost and WriteCost of these core connections, are fitted to the
+ *  measurements by least squares, and if output is given, the platform with the refitted costs is written to this
+ *  file as a Lua script returning it. **/
+Ladybirds::lua::PassWithArgsAndRet<CompareTimingsArgs, CompareTimingsRets>
+    CompareTimingsPass("CompareTimings", &CompareTimings, Pass::Requires{"LoadMapping"});
+
+
+/// \internal A run of a task in the trace
+struct TraceRun
+{
+    double Start, End;
+    int Track;
+};
+
+/// \internal Finds the value of the field \p key in the JSON object on \p line (strings without the quotes)
+bool FindField(const std::string &line, const char *key, std::string &value)
+{
+    auto pos = line.find(strprintf("\"%s\": ", key));
+    if(pos == std::string::npos) return false;
+    pos += strlen(key) + 4;
+    if(pos < line.size() && line[pos] == '"')
+    {
+        auto end = line.find('"', pos+1);
+        if(end == std::string::npos) return false;
+        value = line.substr(pos+1, end-pos-1);
+    }
+    else value = line.substr(pos, line.find_first_of(",}", pos) - pos);
+    return true;
+}
+
+/// \internal Reads the task events of the trace in \p filename, one event per line, as the runs of each task
+bool ReadTrace(const std::string &filename, std::unordered_map<std::string, std::vector<TraceRun>> &runs)
+{
+    std::ifstream strm(filename);
+    if(!strm.is_open())
+    {
+        perror(filename.c_str());
+        return false;
+    }
+    std::string line, name, cat, ts, dur, tid;
+    while(std::getline(strm, line))
+    {
+        if(!FindField(line, "cat", cat) || cat != "task") continue;
+        if(!FindField(line, "name", name) || !FindField(line, "ts", ts) || !FindField(line, "dur", dur)
+           || !FindField(line, "tid", tid))
+        {
+            gMsgUI.Error("TraceCost: Unexpected event in %s: %s", filename.c_str(), line.c_str());
+            return false;
+        }
+        double start = atof(ts.c_str());
+        runs[name].push_back({start, start + atof(dur.c_str()), atoi(tid.c_str())});
+    }
+    for(auto &entry : runs)
+    {
+        std::sort(entry.second.begin(), entry.second.end(),
+                  [](const TraceRun &a, const TraceRun &b) { return a.Start < b.Start; });
+    }
+    return true;
+}
+
+/// \internal Predicts the makespan of \p orders (the tasks of each track, in the order they run) from the task costs
+/// and the dependencies between the tasks, or returns 0 if the orders contradict the dependencies
+double PredictMakespan(const Program &prog, const std::vector<std::vector<const Task*>> &orders)
+{
+    std::unordered_map<const Task*, std::vector<const Task*>> preds;
+    for(auto &order : orders) for(auto *pt : order) preds[pt];
+    for(auto &dep : prog.Dependencies)
+    {
+        const Task *pfrom = dep.From.TheIface->GetTask(), *pto = dep.To.TheIface->GetTask();
+        if(pfrom != pto && preds.count(pfrom) != 0 && preds.count(pto) != 0) preds[pto].push_back(pfrom);
+    }
+
+    std::unordered_map<const Task*, double> finish;
+    std::vector<size_t> next(orders.size(), 0);
+    std::vector<double> free(orders.size(), 0);
+    for(size_t remaining = preds.size(); remaining > 0; )
+    {
+        bool progress = false;
+        for(size_t i = 0; i < orders.size(); ++i)
+        {
+            if(next[i] >= orders[i].size()) continue;
+            const Task *pt = orders[i][next[i]];
+            double start = free[i];
+            bool ready = true;
+            for(auto *pred : preds[pt])
+            {
+                auto it = finish.find(pred);
+                if(it == finish.end()) ready = false;
+                else start = std::max(start, it->second);
+            }
+            if(!ready) continue;
+            free[i] = finish[pt] = start + pt->Cost;
+            ++next[i], --remaining;
+            progress = true;
+        }
+        if(!progress) return 0;
+    }
+    return *std::max_element(free.begin(), free.end());
+}
+
+bool TraceCost(Program &prog, TraceCostArgs &args, TraceCostRets &rets)
+{
+    std::unordered_map<std::string, std::vector<TraceRun>> runs;
+    if(!ReadTrace(args.Filename, runs)) return false;
+
+    // mean durations of the tasks and kernels
+    std::map<std::string, double> taskcosts, kernelcosts;
+    std::map<std::string, int> kerneltasks;
+    std::vector<const Task*> traced;
+    std::unordered_map<const Task*, const std::vector<TraceRun>*> taskruns;
+    size_t ninstances = 0;
+    for(auto &t : prog.GetTasks())
+    {
+        std::string name = t.GetFullName();
+        auto it = runs.find(name);
+        if(it == runs.end()) continue;
+        taskruns[&t] = &it->second;
+        double sum = 0;
+        for(auto &run : it->second) sum += run.End - run.Start;
+        double cost = sum / it->second.size();
+        taskcosts[name] = cost;
+        kernelcosts[t.GetKernel()->Name] += cost;
+        ++kerneltasks[t.GetKernel()->Name];
+        ninstances = traced.empty() ? it->second.size() : std::min(ninstances, it->second.size());
+        traced.push_back(&t);
+    }
+    if(traced.empty())
+    {
+        gMsgUI.Error("TraceCost: None of the tasks appear in %s.", args.Filename.c_str());
+        return false;
+    }
+    for(auto &entry : kernelcosts) entry.second /= kerneltasks[entry.first];
+
+    int nmissing = 0;
+    for(auto &t : prog.GetTasks())
+    {
+        std::string name = t.GetFullName();
+        auto it = taskcosts.find(name);
+        auto kit = kernelcosts.find(t.GetKernel()->Name);
+        if(it != taskcosts.end()) t.Cost = it->second;
+        else if(kit != kernelcosts.end()) t.Cost = kit->second, ++nmissing;
+        else
+        {
+            gMsgUI.Warning("TraceCost: Neither task %s nor its kernel %s appear in the trace.",
+                           name.c_str(), t.GetKernel()->Name.c_str());
+            ++nmissing;
+        }
+    }
+
+    // the makespans of the last ninstances invocations, and the orders of the tasks in the first of them
+    rets.Instances = ninstances;
+    rets.Achieved = 0;
+    for(size_t k = 0; k < ninstances; ++k)
+    {
+        double first = 0, last = 0;
+        for(size_t i = 0; i < traced.size(); ++i)
+        {
+            auto &list = *taskruns[traced[i]];
+            auto &run = list[list.size() - ninstances + k];
+            first = i == 0 ? run.Start : std::min(first, run.Start);
+            last = i == 0 ? run.End : std::max(last, run.End);
+        }
+        rets.Achieved += (last - first) / ninstances;
+    }
+    std::map<int, std::vector<std::pair<double, const Task*>>> tracks;
+    for(auto *pt : traced)
+    {
+        auto &list = *taskruns[pt];
+        auto &run = list[list.size() - ninstances];
+        tracks[run.Track].emplace_back(run.Start, pt);
+    }
+    std::vector<std::vector<const Task*>> orders;
+    for(auto &track : tracks)
+    {
+        std::sort(track.second.begin(), track.second.end());
+        orders.emplace_back();
+        for(auto &entry : track.second) orders.back().push_back(entry.second);
+    }
+    rets.Predicted = PredictMakespan(prog, orders);
+    gMsgUI.Verbose("TraceCost: %d tasks traced over %d invocations, %d costs derived from their kernels",
+                   (int) traced.size(), rets.Instances, nmissing);
+
+    if(args.Output.empty()) return true;
+    std::ofstream strm(args.Output);
+    if(!strm.is_open())
+    {
+        perror(args.Output.c_str());
+        return false;
+    }
+    strm << "-- mean durations in µs, measured from " << args.Filename << "\ncosts = {\n";
+    for(auto &entry : taskcosts) strm << strprintf("    [\"%s\"] = %.3f,\n", entry.first.c_str(), entry.second);
+    strm << "}\nkernelcosts = {\n";
+    for(auto &entry : kernelcosts) strm << strprintf("    [\"%s\"] = %.3f,\n", entry.first.c_str(), entry.second);
+    strm << "}\n";
+    return strm.good();
+}
+
+/// \internal Fits y ~ a*x1 + b*x2 by least squares, or returns false if the samples do not determine a and b
+bool FitTwo(const std::vector<double> &x1, const std::vector<double> &x2, const std::vector<double> &y,
+            double &a, double &b)
+{
+    double s11 = 0, s12 = 0, s22 = 0, s1y = 0, s2y = 0;
+    for(size_t i = 0; i < y.size(); ++i)
+    {
+        s11 += x1[i]*x1[i], s12 += x1[i]*x2[i], s22 += x2[i]*x2[i];
+        s1y += x1[i]*y[i], s2y += x2[i]*y[i];
+    }
+    double det = s11*s22 - s12*s12;
+    if(det <= 1e-9 * s11 * s22 || det == 0) return false;
+    a = (s1y*s22 - s2y*s12) / det;
+    b = (s2y*s11 - s1y*s12) / det;
+    return true;
+}
+
+/// \internal Name of the core or memory of \p pnode
+const std::string & NodeName(const Platform::ComponentNode *pnode)
+{
+    return pnode->pCore ? pnode->pCore->Name : pnode->pMem->Name;
+}
+
+/// \internal Writes \p pf as a Lua script that creates it, with the costs in \p refitted for the connections there
+bool WritePlatform(const Platform &pf, const std::unordered_map<const Platform::HwConnection*,
+                   const ConnectionError*> &refitted, const std::string &filename, const std::string &tracename)
+{
+    std::ofstream strm(filename);
+    if(!strm.is_open())
+    {
+        perror(filename.c_str());
+        return false;
+    }
+    strm << "-- platform with connection costs refitted by CompareTimings to " << tracename << "\n";
+    pf.WriteScript(strm, [&refitted](const Platform::HwConnection &conn, int &fixcost, int &readcost, int &writecost)
+    {
+        auto it = refitted.find(&conn);
+        if(it != refitted.end()) fixcost = it->second->FixCost, readcost = it->second->ReadCost,
+                                 writecost = it->second->WriteCost;
+    });
+    return strm.good();
+}
+
+bool CompareTimings(Program &prog, CompareTimingsArgs &args, CompareTimingsRets &rets)
+{
+    for(auto &t : prog.GetTasks())
+    {
+        if(!t.Group || !t.Group->GetBinding())
+        {
+            gMsgUI.Error("CompareTimings: Task '%s' is not bound to a processing element. Pass a platform to "
+                         "LoadMapping.", t.GetFullName().c_str());
+            return false;
+        }
+    }
+    Schedule sched(prog, *args.pPlatform);
+    if(!sched.CalcSchedule(args.Weight, nullptr, nullptr))
+    {
+        gMsgUI.Error("CompareTimings: List scheduling failed.");
+        return false;
+    }
+    auto timings = sched.GetTaskTimings();
+    auto cores = sched.GetTaskCores();
+    auto predicted = [&timings](const Task *pt) { return double(timings[*pt].End - timings[*pt].Start); };
+
+    std::unordered_map<std::string, std::vector<TraceRun>> runs;
+    if(!ReadTrace(args.Filename, runs)) return false;
+    std::unordered_map<const Task*, double> measured; // mean durations, in cost units once the scale is known
+    std::vector<const Task*> traced;
+    std::unordered_map<const Task*, const std::vector<TraceRun>*> taskruns;
+    size_t ninstances = 0;
+    for(auto &t : prog.GetTasks())
+    {
+        auto it = runs.find(t.GetFullName());
+        if(it == runs.end()) continue;
+        taskruns[&t] = &it->second;
+        double sum = 0;
+        for(auto &run : it->second) sum += run.End - run.Start;
+        measured[&t] = sum / it->second.size();
+        ninstances = traced.empty() ? it->second.size() : std::min(ninstances, it->second.size());
+        traced.push_back(&t);
+    }
+    if(traced.empty())
+    {
+        gMsgUI.Error("CompareTimings: None of the tasks appear in %s.", args.Filename.c_str());
+        return false;
+    }
+    // the run of a task in the k-th of the last ninstances invocations (cf. TraceCost)
+    auto instance = [&taskruns, ninstances](const Task *pt, size_t k) -> const TraceRun &
+        { auto &list = *taskruns.at(pt); return list[list.size() - ninstances + k]; };
+
+    rets.Scale = args.Scale;
+    if(rets.Scale <= 0)
+    {
+        double pm = 0, mm = 0;
+        for(auto *pt : traced) pm += predicted(pt) * measured[pt], mm += measured[pt] * measured[pt];
+        rets.Scale = pm > 0 ? pm / mm : 1;
+    }
+    for(auto &entry : measured) entry.second *= rets.Scale;
+
+    rets.PredictedMakespan = sched.GetMakespan();
+    rets.MeasuredMakespan = 0;
+    for(size_t k = 0; k < ninstances; ++k)
+    {
+        double first = instance(traced[0], k).Start, last = instance(traced[0], k).End;
+        for(auto *pt : traced)
+            first = std::min(first, instance(pt, k).Start), last = std::max(last, instance(pt, k).End);
+        rets.MeasuredMakespan += (last - first) * rets.Scale / ninstances;
+    }
+
+    // bias per kernel, the largest outliers first
+    std::map<std::string, KernelBias> kernels;
+    for(auto *pt : traced)
+    {
+        auto &bias = kernels[pt->GetKernel()->Name];
+        bias.Kernel = pt->GetKernel()->Name;
+        ++bias.Tasks;
+        bias.Predicted += predicted(pt), bias.Measured += measured[pt];
+    }
+    for(auto &entry : kernels)
+    {
+        auto &bias = entry.second;
+        bias.Predicted /= bias.Tasks, bias.Measured /= bias.Tasks;
+        bias.Bias = bias.Predicted > 0 ? bias.Measured / bias.Predicted - 1 : 0;
+        rets.Kernels.push_back(bias);
+    }
+    std::stable_sort(rets.Kernels.begin(), rets.Kernels.end(),
+                     [](const KernelBias &a, const KernelBias &b) { return std::abs(a.Bias) > std::abs(b.Bias); });
+
+    for(auto *pt : traced)
+    {
+        if(predicted(pt) <= 0 || measured[pt] <= 0) continue;
+        rets.Outliers.emplace_back();
+        auto &outlier = rets.Outliers.back();
+        outlier.Task = pt->GetFullName(), outlier.Predicted = predicted(pt), outlier.Measured = measured[pt];
+        outlier.Ratio = outlier.Measured / outlier.Predicted;
+    }
+    std::stable_sort(rets.Outliers.begin(), rets.Outliers.end(), [](const TaskOutlier &a, const TaskOutlier &b)
+        { return std::abs(std::log(a.Ratio)) > std::abs(std::log(b.Ratio)); });
+    if(rets.Outliers.size() > (size_t) std::max(args.Outliers, 0)) rets.Outliers.resize(std::max(args.Outliers, 0));
+
+    // critical path of the prediction: from the last task back along the predecessors (by dependency or on the same
+    // core) that end last before it starts
+    std::unordered_map<const Task*, std::vector<const Task*>> preds;
+    for(auto &dep : prog.Dependencies)
+    {
+        const Task *pfrom = dep.From.TheIface->GetTask(), *pto = dep.To.TheIface->GetTask();
+        if(pfrom != pto && pfrom != &prog.MainTask && pto != &prog.MainTask) preds[pto].push_back(pfrom);
+    }
+    std::map<const Platform::Core*, std::vector<std::pair<Ladybirds::opt::Time, const Task*>>> coreorders;
+    for(auto &t : prog.GetTasks()) coreorders[cores[t]].emplace_back(timings[t].Start, &t);
+    for(auto &entry : coreorders)
+    {
+        std::sort(entry.second.begin(), entry.second.end());
+        auto &order = entry.second;
+        for(size_t i = 1; i < order.size(); ++i) preds[order[i].second].push_back(order[i-1].second);
+    }
+    const Task *pcur = nullptr;
+    for(auto &t : prog.GetTasks()) if(!pcur || timings[t].End > timings[*pcur].End) pcur = &t;
+    std::vector<const Task*> path;
+    while(pcur)
+    {
+        path.push_back(pcur);
+        const Task *pnext = nullptr;
+        for(auto *pred : preds[pcur])
+        {
+            if(timings[*pred].End <= timings[*pcur].Start && (!pnext || timings[*pred].End > timings[*pnext].End))
+                pnext = pred;
+        }
+        pcur = pnext;
+    }
+    for(auto it = path.rbegin(); it != path.rend(); ++it)
+    {
+        rets.CriticalPath.push_back((*it)->GetFullName());
+        if(measured.count(*it) == 0) continue;
+        rets.PathPredicted += predicted(*it), rets.PathMeasured += measured[*it];
+    }
+
+    // samples of the platform connections: x1, x2 and the measured and predicted times
+    struct Samples { std::vector<double> X1, X2, Measured, Predicted; };
+    std::unordered_map<const Platform::HwConnection*, Samples> samples;
+    std::unordered_map<const Platform::Core*, std::vector<const Platform::HwConnection*>> memconns;
+    for(auto &core : args.pPlatform->GetCores()) for(auto &e : core.pNode->OutEdges())
+    {
+        if(e.GetTarget()->pMem) memconns[&core].push_back(&e);
+    }
+    auto &connmap = args.pPlatform->GetConnMap();
+    for(auto &dep : prog.Dependencies)
+    {
+        const Task *pfrom = dep.From.TheIface->GetTask(), *pto = dep.To.TheIface->GetTask();
+        if(measured.count(pfrom) == 0 || measured.count(pto) == 0 || cores[*pfrom] == cores[*pto]) continue;
+        long size = dep.GetMemSize();
+        const Platform::HwConnection *pbest = nullptr;
+        bool shared = false;
+        for(auto *pfromconn : memconns[cores[*pfrom]]) for(auto *ptoconn : memconns[cores[*pto]])
+        {
+            auto *pfrommem = pfromconn->GetTarget(), *ptomem = ptoconn->GetTarget();
+            if(pfrommem == ptomem) shared = true;
+            else if(auto *pconn = connmap[pfrommem][ptomem])
+            {
+                if(!pbest || pconn->DmaCost(size) < pbest->DmaCost(size)) pbest = pconn;
+            }
+        }
+        if(shared || !pbest) continue;
+        double gap = 0;
+        for(size_t k = 0; k < ninstances; ++k) gap += instance(pto, k).Start - instance(pfrom, k).End;
+        auto &entry = samples[pbest];
+        entry.X1.push_back(1), entry.X2.push_back(size);
+        entry.Measured.push_back(std::max(gap / ninstances, 0.0) * rets.Scale);
+        entry.Predicted.push_back(pbest->DmaCost(size));
+    }
+    for(auto *pt : traced)
+    {
+        auto &conns = memconns[cores[*pt]];
+        if(conns.size() != 1) continue; // the memory accessed is only known with a single one
+        double reads = 0, writes = 0;
+        for(auto &iface : pt->Ifaces) reads += iface.Reads, writes += iface.Writes;
+        auto &entry = samples[conns.front()];
+        entry.X1.push_back(reads), entry.X2.push_back(writes);
+        entry.Measured.push_back(measured[pt] - pt->Cost);
+        entry.Predicted.push_back(conns.front()->AccessCost(reads, writes));
+    }
+
+    std::vector<const Platform::HwConnection*> fitted; // the connection of each entry in rets.Connections
+    for(auto &conn : args.pPlatform->GetGraph().Edges())
+    {
+        auto it = samples.find(&conn);
+        if(it == samples.end()) continue;
+        auto &smp = it->second;
+        fitted.push_back(&conn);
+        rets.Connections.emplace_back();
+        auto &err = rets.Connections.back();
+        err.From = NodeName(conn.GetSource()), err.To = NodeName(conn.GetTarget());
+        err.Samples = smp.Measured.size();
+        double deviation = 0;
+        for(size_t i = 0; i < smp.Measured.size(); ++i)
+        {
+            err.Predicted += smp.Predicted[i] / err.Samples, err.Measured += smp.Measured[i] / err.Samples;
+            deviation += std::abs(smp.Measured[i] - smp.Predicted[i]) / err.Samples;
+        }
+        err.Error = err.Predicted > 0 ? deviation / err.Predicted : 0;
+        err.FixCost = conn.FixCost, err.ReadCost = conn.ReadCost, err.WriteCost = conn.WriteCost;
+        if(!args.Refit) continue;
+
+        // DMA: measured ~ FixCost + WriteCost*bytes; core to memory: measured ~ ReadCost*reads + WriteCost*writes.
+        // If the samples do not determine both costs, the current ones are scaled to the measured mean.
+        double a, b;
+        bool dma = !conn.Controllers.empty();
+        if(!FitTwo(smp.X1, smp.X2, smp.Measured, a, b))
+        {
+            double factor = err.Predicted > 0 ? err.Measured / err.Predicted : 1;
+            a = (dma ? conn.FixCost : conn.ReadCost) * factor, b = conn.WriteCost * factor;
+        }
+        (dma ? err.FixCost : err.ReadCost) = std::max(std::lround(a), 0L);
+        err.WriteCost = std::max(std::lround(b), 0L);
+    }
+    if(args.Output.empty()) return true;
+    if(!args.Refit) gMsgUI.Warning("CompareTimings: Writing %s without refitting the costs.", args.Output.c_str());
+    std::unordered_map<const Platform::HwConnection*, const ConnectionError*> refitted;
+    for(size_t i = 0; i < rets.Connections.size(); ++i) refitted[fitted[i]] = &rets.Connections[i];
+    if(!WritePlatform(*args.pPlatform, refitted, args.Output, args.Filename)) return false;
+    gMsgUI.Verbose("CompareTimings: Refitted platform written to %s", args.Output.c_str());
+    return true;
+}
+
+} //namespace ::
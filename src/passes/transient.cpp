@@ -1,17 +1,21 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <cmath>
 #include <functional>
 #include <limits>
 #include <map>
 #include <numeric>
-#include <queue>
+#include <thread>
 #include <unordered_set>
-#include <unordered_map>
 #include <vector>
 
+#include "dependencyindex.h"
 #include "graph/graph.h"
 #include "graph/itemmap.h"
+#include "graph/reachabilityindex.h"
 #include "lua/pass.h"
 #include "msgui.h"
 #include "program.h"
@@ -22,6 +26,7 @@
 
 using Ladybirds::gen::Space;
 using Ladybirds::gen::SpaceDivision;
+using Ladybirds::impl::DependencyIndex;
 using Ladybirds::impl::Port;
 using Ladybirds::impl::Program;
 using Ladybirds::spec::Dependency;
@@ -40,139 +45,182 @@ constexpr bool gDbgOut = false;
 struct TransientArgs : public Ladybirds::loadstore::LoadStorableCompound
 {
     double ReadCost = 0, WriteCost = 0, StartupCost = 0, MaxBurstCost = 0;
-    bool Greedy = false;
+    bool Greedy = false, Pareto = false;
     
     virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
     { return ls.IO("readcost", ReadCost)
            & ls.IO("writecost", WriteCost, false)
            & ls.IO("startupcost", StartupCost)
            & ls.IO("greedy", Greedy, false, false)
+           & ls.IO("pareto", Pareto, false, false)
            & ls.IO("maxburstcost", MaxBurstCost, false, 0, 0);
     }
 };
 struct TransientRets : public Ladybirds::loadstore::LoadStorableCompound
 {
+    /// A grouping that cannot be improved in total cost without a higher maximum burst cost, and vice versa
+    struct ParetoPoint : public Ladybirds::loadstore::LoadStorableCompound
+    {
+        double MaxBurstCost = -1;
+        double TotalCost = -1;
+        
+        virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
+        { return ls.IO("maxburstcost", MaxBurstCost) & ls.IO("totalcost", TotalCost); }
+    };
+    
     double MaxBurstCost = -1;
     double TotalCost = -1;
+    std::vector<ParetoPoint> ParetoFront; ///< By decreasing maximum burst cost; only with pareto = true
     
     virtual bool LoadStoreMembers(Ladybirds::loadstore::LoadStore & ls) override
     { return ls.IO("maxburstcost", MaxBurstCost, false)
-           & ls.IO("totalcost", TotalCost, false);
+           & ls.IO("totalcost", TotalCost, false)
+           & ls.IO("paretofront", ParetoFront, false);
     }    
 };
 bool GroupForTransient(Program &prog, TransientArgs &args, TransientRets &rets);
 
 /** Pass GroupForTransient: Groups the tasks such for transient single core computing.
  The goal is to minimize the overall energy needed to accomplish the task, but also to minimize the bust energy,
- i.e. the energy that must be stored by a capacitor such that each group can run without interruption. **/
+ i.e. the energy that must be stored by a capacitor such that each group can run without interruption.
+ With pareto = true, all groupings that are optimal for some limit on the burst energy are determined and returned
+ as paretofront; the program is grouped with the best one within maxburstcost (or with the smallest burst energy). **/
 Ladybirds::lua::PassWithArgsAndRet<TransientArgs, TransientRets> 
     GroupForTransientPass("GroupForTransient", &GroupForTransient,
-        Pass::Requires{}, Pass::Destroys{"CalcSuccessorMatrix", "LoadMapping", "PopulateGroups"});
-
-using OutDepMap = std::unordered_map<const Iface*, std::deque<const Dependency*>>;
-
-OutDepMap GetOutDeps(const Program::DepList &deps)
-{
-    OutDepMap ret;
-    for(auto &dep : deps) ret[dep.From.TheIface].push_back(&dep);
-    return ret;
-}
-
-
-/// \internal The actual working horse of EstablishExecutionOrder. Uses a greedy heuristic implemented recursively.
-void ScheduleNodes(const Task &t, const std::vector<const Task*> &alltasks, const ItemMap<ItemMap<int>> &weights,
-                   ItemMap<int> &depctr, std::vector<const Task*> &order)
-{
-    for(auto & e : t.OutEdges()) --depctr[e.GetTarget()];
-    depctr[t] = -1;
-    
-    auto &tweights = weights[t];
-    auto taskcmp = [&tweights](auto pt1, auto pt2){ return tweights[pt1] < tweights[pt2]; };
-    std::priority_queue<const Task*, std::vector<const Task*>, decltype(taskcmp)> candidates(taskcmp, alltasks);
-    
-    while(!candidates.empty())
-    {
-        auto pcand = candidates.top();
-        candidates.pop();
-        
-        if(tweights[pcand] < 0) break;
-        if(depctr[pcand] != 0) continue;
-        
-        order.push_back(pcand);
-        ScheduleNodes(*pcand, alltasks, weights, depctr, order);
-    }
-}
+        Pass::Requires{}, Pass::Destroys{"CalcSuccessorMatrix", "LoadMapping", "PopulateGroups", "TaskTopoSort"});
 
+/// \internal For each task, the tasks that should preferably follow it together with a weight, i.e. the data volume
+/// they consume from it or share with it as input (cf. EstablishExecutionOrder). Tasks without a relation are missing.
+using WeightList = std::vector<std::pair<const Task*, int>>;
 
-/** \internal Determines a single core execution order which is supposed to allow a small burst energy.
- *  Then reorders the nodes in the task graph accordingly.
- **/
-void EstablishExecutionOrder(Program &prog, const OutDepMap &outdeps)
+/// \internal Calculates the weights for EstablishExecutionOrder, sorted by decreasing weight
+ItemMap<WeightList> CalcOrderWeights(const Program &prog, const DependencyIndex &depindex)
 {
-    auto &tg = prog.TaskGraph;
-    
-    auto * rootnode = tg.EmplaceNode();
-    
-    auto weights = tg.GetNodeMap(tg.GetNodeMap(int(-1)));
-    auto addweigth = [](int &weight, int add) { if (weight < 0) weight = add; else weight += add; };
+    auto weights = prog.TaskGraph.GetNodeMap<WeightList>();
     
     for(auto &dep : prog.Dependencies)
     {
-        auto &fromiface = *dep.From.TheIface, &toiface = *dep.To.TheIface;
+        auto &fromiface = *dep.From.TheIface;
         auto &type = fromiface.GetPacket()->GetBaseType();
-        addweigth(weights[fromiface.GetTask()][toiface.GetTask()], dep.From.Index.GetVolume() * type.Size);
+        weights[fromiface.GetTask()].emplace_back(dep.To.TheIface->GetTask(), dep.From.Index.GetVolume() * type.Size);
     }
     
-    for(auto &entry : outdeps)
+    // consumers of overlapping parts of the same output; sorted by the start in the first dimension, such that only
+    // pairs that overlap there need to be compared (all of them for scalars)
+    std::vector<const Dependency*> deps;
+    auto getbegin = [](const Dependency *pdep)
+        { return pdep->From.Index.Dimensions() > 0 ? pdep->From.Index[0].begin() : 0; };
+    auto getend = [](const Dependency *pdep)
+        { return pdep->From.Index.Dimensions() > 0 ? pdep->From.Index[0].end() : 1; };
+    for(auto *pfrom : depindex.GetProducers())
     {
-        auto basesize = entry.first->GetPacket()->GetBaseType().Size;
-        auto &deps = entry.second;
+        auto basesize = pfrom->GetPacket()->GetBaseType().Size;
+        auto outdeps = depindex.GetOutDeps(*pfrom);
+        deps.assign(outdeps.begin(), outdeps.end());
+        Sort(deps, getbegin);
+        
         for(auto it = deps.begin(), itend = deps.end(); it != itend; ++it)
         {
             auto task1 = (*it)->To.TheIface->GetTask();
-            auto &targetweigths = weights[task1];
-            
-            for(auto it2 = deps.begin(); it2 != it; ++it2)
+            auto end = getend(*it);
+            for(auto it2 = std::next(it); it2 != itend && getbegin(*it2) < end; ++it2)
             {
                 auto task2 = (*it2)->To.TheIface->GetTask();
                 if(task1 == task2) continue;
                 
                 auto weight = ((*it)->From.Index & (*it2)->From.Index).GetVolume() * basesize;
-                addweigth(targetweigths[task2], weight);
-                addweigth(weights[task2][task1], weight);
+                if(weight == 0) continue;
+                weights[task1].emplace_back(task2, weight);
+                weights[task2].emplace_back(task1, weight);
             }
         }
     }
-
-    auto depctr = tg.GetNodeMap(0);
-    for(auto &n : tg.Nodes())
+    
+    // combine the entries for the same task and sort by weight (by position for equal weights)
+    for(auto &t : prog.TaskGraph.Nodes())
     {
-        auto nin = n.InEdgeCount();
-        if(nin == 0 && &n != rootnode)
+        auto &tweights = weights[t];
+        Sort(tweights, [](auto &entry) { return entry.first->GetID(); });
+        auto itout = tweights.begin();
+        for(auto it = tweights.begin(), itend = tweights.end(); it != itend; ++it)
         {
-            tg.EmplaceEdge(rootnode, &n);
-            weights[rootnode][n] = 0;
-            nin = 1;
+            if(itout != tweights.begin() && std::prev(itout)->first == it->first)
+                std::prev(itout)->second += it->second;
+            else
+                *itout++ = *it;
         }
-        depctr[n] = nin;
+        tweights.erase(itout, tweights.end());
+        std::stable_sort(tweights.begin(), tweights.end(), [](auto &a, auto &b) { return a.second > b.second; });
     }
+    return weights;
+}
+
+/** \internal Determines a single core execution order which is supposed to allow a small burst energy.
+ *  Then reorders the nodes in the task graph accordingly.
+ *
+ *  Greedy heuristic: after a task, the ready task with the highest weight for it follows (cf. CalcOrderWeights). If it
+ *  has none (left), the same is done for the task before, and so on. Tasks without predecessors start the order and
+ *  are used where no scheduled task has a ready candidate. The candidates of each task are sorted only once, and the
+ *  scheduled tasks are kept on an explicit stack, such that large programs do not exhaust the call stack.
+ **/
+void EstablishExecutionOrder(Program &prog)
+{
+    auto &tg = prog.TaskGraph;
+    auto weights = CalcOrderWeights(prog, prog.GetDependencyIndex());
     
-    std::vector<const Task*> alltasks, order;
+    std::vector<const Task*> order, ready;
     order.reserve(tg.Nodes().size());
+    auto depctr = tg.GetNodeMap(0);
+    for(auto &t : tg.Nodes())
+    {
+        depctr[t] = t.InEdgeCount();
+        if(depctr[t] == 0) ready.push_back(&t);
+    }
     
-    alltasks.reserve(tg.Nodes().size());
-    for(auto &t : tg.Nodes()) alltasks.push_back(&t);
+    struct Frame
+    {
+        const WeightList *pCandidates;
+        std::size_t Next;
+    };
+    std::vector<Frame> stack;
+    auto schedule = [&](const Task &t)
+    {
+        for(auto &e : t.OutEdges())
+        {
+            if(--depctr[e.GetTarget()] == 0) ready.push_back(e.GetTarget());
+        }
+        depctr[t] = -1;
+        order.push_back(&t);
+        stack.push_back({&weights[t], 0});
+    };
     
-    ScheduleNodes(*rootnode, alltasks, weights, depctr, order);
+    std::size_t nextready = 0;
+    while(order.size() < tg.Nodes().size())
+    {
+        if(stack.empty())
+        {
+            while(depctr[ready[nextready]] != 0) ++nextready; //there is a ready task, as the graph is acyclic
+            schedule(*ready[nextready]);
+            continue;
+        }
+        
+        auto &frame = stack.back();
+        if(frame.Next == frame.pCandidates->size())
+        {
+            stack.pop_back();
+            continue;
+        }
+        auto pcand = (*frame.pCandidates)[frame.Next++].first;
+        if(depctr[pcand] == 0) schedule(*pcand);
+    }
     
     if(gDbgOut)
     {
         auto &strm = gMsgUI.Info("New order:");
-        for(auto *pt : order) strm << pt->Name << " ";
+        for(auto *pt : order) strm << pt->GetFullName() << " ";
         strm << std::endl;
     }
     
-    tg.RemoveNode(rootnode);
     tg.ReorderNodes(order);
 }
 
@@ -185,22 +233,24 @@ struct DepCost
     TaskGraph::ID_t FromID;
 };
 
-/// \internal calculates the DepCosts for all edges
-auto CalcDepCosts(OutDepMap &outdeps, double readcost, double writecost)
+/// \internal calculates the DepCosts for all edges, by position in the dependency list
+auto CalcDepCosts(const Program::DepList &alldeps, const DependencyIndex &depindex, double readcost, double writecost)
 {
-    std::unordered_map<const Dependency*, DepCost> ret;
+    std::vector<DepCost> ret(alldeps.size());
+    std::vector<const Dependency*> deps;
     
-    for(auto &entry : outdeps)
+    for(auto *pfrom : depindex.GetProducers())
     {
-        auto basesize = entry.first->GetPacket()->GetBaseType().Size;
+        auto basesize = pfrom->GetPacket()->GetBaseType().Size;
         double itemreadcost = readcost*basesize, itemwritecost=writecost*basesize;
-        auto fromid = entry.first->GetTask()->GetID();
+        auto fromid = pfrom->GetTask()->GetID();
         auto gettoid = [](const auto *pdep){return pdep->To.TheIface->GetTask()->GetID(); };
         
-        auto &deps = entry.second;
+        auto outdeps = depindex.GetOutDeps(*pfrom);
+        deps.assign(outdeps.begin(), outdeps.end());
         Sort(deps, gettoid);
         
-        SpaceDivision<const Dependency*> sd((Space(entry.first->GetDimensions()))), sd2 = sd;
+        SpaceDivision<const Dependency*> sd((Space(pfrom->GetDimensions()))), sd2 = sd;
         for(auto *pdep : deps) sd.AssignSection(pdep->From.Index, pdep);
         
         for(auto it = deps.begin(), itend = deps.end(); it < itend; ++it)
@@ -208,24 +258,24 @@ auto CalcDepCosts(OutDepMap &outdeps, double readcost, double writecost)
             auto pdep = *it;
             DepCost::ReadCostMap rcmap;
             sd2.Clear();
-            for(auto it2 = it, it2end = std::prev(deps.begin()); it2 != it2end; )
+            for(auto it2 = it; ; --it2)
             {
                 auto pdep2 = *it2;
                 sd2.AssignSection(pdep2->From.Index, pdep2);
                 
                 auto toid = gettoid(pdep2);
-                if(--it2 != it2end && gettoid(*it2) == toid) continue;
+                if(it2 != deps.begin() && gettoid(*std::prev(it2)) == toid) continue;
                 
                 auto cost = sd2.GetEnvelope(pdep).GetVolume()*itemreadcost;
                 rcmap.emplace_hint(rcmap.begin(), toid, cost);
-                if(cost == 0) break;
+                if(cost == 0 || it2 == deps.begin()) break;
             }
             
-            ret.emplace(pdep, DepCost({
+            ret[depindex.GetPosition(*pdep)] = DepCost({
                 /*ReadCost*/  std::move(rcmap),
                 /*WriteCost*/ sd.GetEnvelope(pdep).GetVolume()*itemwritecost,
                 /*FromID*/ fromid
-            }));
+            });
         }
     }
     return ret;
@@ -236,17 +286,11 @@ using DistanceTable = ItemMap<ItemMap<double>>;
  *  The return value is a NodeMap of NodeMaps. CalcDistanceTable(...)[task1][task2] means energy for a burst that 
  *  starts on task1 and ends on task2.
  **/
-DistanceTable CalcDistanceTable(const TaskGraph &tg, const Program::DepList &deps, OutDepMap &ifaceoutdeps,
+DistanceTable CalcDistanceTable(const TaskGraph &tg, const Program::DepList &deps, const DependencyIndex &depindex,
                        double readcost, double writecost, double startupcost)
 {
-    auto depcosts = CalcDepCosts(ifaceoutdeps, readcost, writecost);
-    auto outdeps = tg.GetNodeMap<std::deque<const DepCost*>>(), indeps = outdeps;
-    for(auto &dep : deps)
-    {
-        auto *pcosts = &depcosts[&dep];
-        outdeps[dep.From.TheIface->GetTask()].push_back(pcosts);
-        indeps[dep.To.TheIface->GetTask()].push_back(pcosts);
-    }
+    auto depcosts = CalcDepCosts(deps, depindex, readcost, writecost);
+    auto getcosts = [&](const Dependency *pdep) -> const DepCost & { return depcosts[depindex.GetPosition(*pdep)]; };
     
     DistanceTable ret = tg.GetNodeMap(tg.GetNodeMap(std::numeric_limits<double>::infinity()));
     for(auto it1 = tg.NodesBegin(), itend = tg.NodesEnd(); it1 != itend; ++it1)
@@ -258,10 +302,11 @@ DistanceTable CalcDistanceTable(const TaskGraph &tg, const Program::DepList &dep
             auto &t = *it2;
             cost += t.Cost;
             
-            for(auto *pdc : outdeps[t])
-                cost += pdc->WriteCost;
-            for(auto *pdc : indeps[t])
+            for(auto *pdep : depindex.GetOutDeps(t))
+                cost += getcosts(pdep).WriteCost;
+            for(auto *pdep : depindex.GetInDeps(t))
             {
+                auto *pdc = &getcosts(pdep);
                 if(pdc->FromID >= minid)
                 { //Creation and consumption in same burst: No read cost. Moreover, remove write cost we added before
                     cost -= pdc->WriteCost;
@@ -363,11 +408,11 @@ double GetRealMaxBurstCost(const TaskGraph &tg,  const DistanceTable &dist, cons
 }
 
 /// \internal Optimally partitions the program into bursts (groups) using a shortest path algorithm
-void FindOptimalBursts(TaskGraph &tg, const Program::DepList &deps, OutDepMap &outdeps,
+void FindOptimalBursts(TaskGraph &tg, const Program::DepList &deps, const DependencyIndex &depindex,
                        double readcost, double writecost, double startupcost, double maxburstcost,
                        std::vector<const Task*> &groupends, TransientRets &rets)
 {
-    auto dist = CalcDistanceTable(tg, deps, outdeps, readcost, writecost, startupcost);
+    auto dist = CalcDistanceTable(tg, deps, depindex, readcost, writecost, startupcost);
     if(gDbgOut)
     {
         gMsgUI.Info("Distance table:");
@@ -400,11 +445,11 @@ void FindOptimalBursts(TaskGraph &tg, const Program::DepList &deps, OutDepMap &o
 }
 
 /// \internal Partitions the program into bursts (groups) following a greedy algorithm
-void FindGreedyBursts(TaskGraph &tg, const Program::DepList &deps, OutDepMap &outdeps,
+void FindGreedyBursts(TaskGraph &tg, const Program::DepList &deps, const DependencyIndex &depindex,
                        double readcost, double writecost, double startupcost, double maxburstcost,
                        std::vector<const Task*> &groupends, TransientRets &rets)
 {
-    auto dist = CalcDistanceTable(tg, deps, outdeps, readcost, writecost, startupcost);
+    auto dist = CalcDistanceTable(tg, deps, depindex, readcost, writecost, startupcost);
     if(gDbgOut)
     {
         gMsgUI.Info("Distance table:");
@@ -442,6 +487,102 @@ void FindGreedyBursts(TaskGraph &tg, const Program::DepList &deps, OutDepMap &ou
     rets.MaxBurstCost = maxburstcost;
 }
 
+/// \internal Determines the pareto front of the groupings of the (ordered) program for FindParetoBursts
+/** Every finite entry of \p dist is a candidate limit for the burst cost. The optimal grouping for a limit has a real
+ *  maximum burst cost M (at most the limit), and is optimal for all limits from M on as well. So, going through the
+ *  candidates in decreasing order, the next one of interest is the largest below M. This is repeated until no grouping
+ *  is possible any more. As we do not know M in advance, the shortest paths for the next few candidates are calculated
+ *  in parallel (and the ones made superfluous by the results are skipped). **/
+std::vector<std::pair<TransientRets::ParetoPoint, std::vector<const Task*>>>
+    FindParetoFront(const TaskGraph &tg, const DistanceTable &dist)
+{
+    std::vector<double> limits;
+    for(auto it1 = tg.NodesBegin(), itend = tg.NodesEnd(); it1 != itend; ++it1)
+    {
+        auto &n1_dists = dist[*it1];
+        for(auto it2 = it1; it2 != itend; ++it2)
+        {
+            if(std::isfinite(n1_dists[*it2])) limits.push_back(n1_dists[*it2]);
+        }
+    }
+    std::sort(limits.begin(), limits.end(), std::greater<double>());
+    limits.erase(std::unique(limits.begin(), limits.end()), limits.end());
+    
+    using Result = std::pair<TransientRets::ParetoPoint, std::vector<const Task*>>;
+    auto solve = [&tg, &dist](double limit, Result &res)
+    {
+        auto combine = [limit](double d1, double d2)
+            { return d2 > limit ? std::numeric_limits<double>::infinity() : d1 + d2; };
+        res.first.TotalCost = FindShortestPath(tg, dist, combine, &res.second);
+        if(std::isfinite(res.first.TotalCost)) res.first.MaxBurstCost = GetRealMaxBurstCost(tg, dist, res.second);
+    };
+    
+    std::vector<Result> front, results;
+    std::size_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    for(std::size_t next = 0; next < limits.size(); )
+    {
+        std::size_t count = std::min(nthreads, limits.size() - next);
+        results.assign(count, Result());
+        std::atomic<std::size_t> counter{0};
+        auto work = [&]()
+        {
+            for(std::size_t i; (i = counter++) < count; ) solve(limits[next + i], results[i]);
+        };
+        std::vector<std::thread> threads;
+        for(std::size_t i = 1; i < count; ++i) threads.emplace_back(work);
+        work();
+        for(auto &thread : threads) thread.join();
+        
+        for(auto &res : results)
+        {
+            if(!std::isfinite(res.first.TotalCost)) return front; // no grouping with smaller limits either
+            if(!front.empty() && res.first.MaxBurstCost >= front.back().first.MaxBurstCost) continue;
+            if(!front.empty() && res.first.TotalCost <= front.back().first.TotalCost) front.pop_back();
+            front.push_back(std::move(res));
+        }
+        
+        next += count;
+        while(next < limits.size() && limits[next] >= front.back().first.MaxBurstCost) ++next;
+    }
+    return front;
+}
+
+/// \internal Partitions the program into bursts (groups) optimally for all limits of the burst cost
+/// (cf. FindParetoFront), and chooses the grouping with the smallest total cost within \p maxburstcost, or with the smallest burst cost.
+bool FindParetoBursts(TaskGraph &tg, const Program::DepList &deps, const DependencyIndex &depindex,
+                      double readcost, double writecost, double startupcost, double maxburstcost,
+                      std::vector<const Task*> &groupends, TransientRets &rets)
+{
+    auto dist = CalcDistanceTable(tg, deps, depindex, readcost, writecost, startupcost);
+    auto front = FindParetoFront(tg, dist);
+    
+    for(auto &point : front) rets.ParetoFront.push_back(point.first);
+    auto itbest = front.end();
+    if(maxburstcost <= 0 && !front.empty()) itbest = std::prev(front.end());
+    else if(maxburstcost > 0)
+    {
+        itbest = std::find_if(front.begin(), front.end(),
+                              [=](auto &point){ return point.first.MaxBurstCost <= maxburstcost; });
+    }
+    if(itbest == front.end())
+    {
+        gMsgUI.Error("GroupForTransient: No grouping within maxburstcost %f, the minimum is %f", maxburstcost,
+                     front.empty() ? std::numeric_limits<double>::infinity() : front.back().first.MaxBurstCost);
+        return false;
+    }
+    if(gDbgOut)
+    {
+        for(auto &point : front)
+            gMsgUI.Info("Burst calculation: Pareto point with total energy %f and maximum burst energy %f",
+                        point.first.TotalCost, point.first.MaxBurstCost);
+    }
+    
+    groupends = std::move(itbest->second);
+    rets.TotalCost = itbest->first.TotalCost;
+    rets.MaxBurstCost = itbest->first.MaxBurstCost;
+    return true;
+}
+
 /** \internal Combines all the above functions to implement a pass that finds a scheduling and optimal burst
  *  partitioning for transient single-core systems.
  **/
@@ -453,21 +594,32 @@ bool GroupForTransient(Program &prog, TransientArgs &args, TransientRets &rets)
         return false;
     }
 
-    auto outdeps = GetOutDeps(prog.Dependencies);
-    EstablishExecutionOrder(prog, outdeps);
+    if(args.Greedy && args.Pareto)
+    {
+        gMsgUI.Error("GroupForTransient: greedy and pareto cannot be combined");
+        return false;
+    }
+
+    EstablishExecutionOrder(prog);
     prog.TaskGraph.ClearEdges();
     std::adjacent_find(prog.TaskGraph.NodesBegin(), prog.TaskGraph.NodesEnd(),
                        [&prog](auto &t1, auto &t2){ prog.TaskGraph.EmplaceEdge(&t1, &t2); return false; });
     
+    auto &depindex = prog.GetDependencyIndex();
     std::vector<const Task*> groupends;
-    if(args.Greedy)
+    if(args.Pareto)
     {
-        FindGreedyBursts(prog.TaskGraph, prog.Dependencies, outdeps, args.ReadCost, args.WriteCost,
+        if(!FindParetoBursts(prog.TaskGraph, prog.Dependencies, depindex, args.ReadCost, args.WriteCost,
+                             args.StartupCost, args.MaxBurstCost, groupends, rets)) return false;
+    }
+    else if(args.Greedy)
+    {
+        FindGreedyBursts(prog.TaskGraph, prog.Dependencies, depindex, args.ReadCost, args.WriteCost,
                          args.StartupCost, args.MaxBurstCost, groupends, rets);
     }
     else
     {
-        FindOptimalBursts(prog.TaskGraph, prog.Dependencies, outdeps, args.ReadCost, args.WriteCost,
+        FindOptimalBursts(prog.TaskGraph, prog.Dependencies, depindex, args.ReadCost, args.WriteCost,
                           args.StartupCost, args.MaxBurstCost, groupends, rets);
     }
     
@@ -486,6 +638,11 @@ bool GroupForTransient(Program &prog, TransientArgs &args, TransientRets &rets)
             upgroup = std::make_unique<TaskGroup>();
         }
     }
+    
+    //The task graph is a single chain now, so the successor index is cheap to build and the results of
+    //CalcSuccessorMatrix (which would not prune any edges) are available again.
+    prog.TaskReachability = Ladybirds::graph::ReachabilityIndex::Compressed(prog.TaskGraph);
+    prog.PassesPerformed.insert("CalcSuccessorMatrix");
     return true;
 }
 
@@ -1,34 +1,142 @@
 // Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 
 #include "program.h"
+
+#include <tuple>
+
+#include "dependencyindex.h"
 #include "taskgroup.h"
 
 namespace Ladybirds { namespace impl {
 
-Program::Program(){}
+Program::Program()
+{
+    //re-create the containers inside the arena
+    graph::Arena::Scope scope(Memory);
+    TaskGraph = spec::TaskGraph();
+    ExternalBuffers = BufferList();
+}
 Program::~Program(){}
 
+/// \internal Loads the tasks of \p tg, which can only be created by the graph (cf. LoadStore::IO_Register)
+static bool LoadTasks(loadstore::LoadStore & ls, spec::TaskGraph & tg)
+{
+    if(!ls.PrepareNamedVar("tasks")) return false;
+    
+    bool ret = ls.RawArrayIO(0, [&tg](loadstore::LoadStore & ls) { return ls.RawIO_Register(*tg.EmplaceNode()); });
+    if(!ret) ls.Error("while processing element tasks");
+    return ls.FlushNamedVar("tasks") && ret;
+}
+
 bool Program::Definition::LoadStoreMembers(loadstore::LoadStore& ls)
 {
     return ls.IO("id", Identifier) & ls.IO("definition", Value);
 }
 
+bool Program::MappedFile::LoadStoreMembers(loadstore::LoadStore& ls)
+{
+    return ls.IO("packet", Packet) & ls.IO("file", Filename);
+}
+
+bool Program::IsStorable() const
+{
+    return Groups.empty() && Divisions.empty() && Channels.empty() && ExternalBuffers.empty() && SpecialKernels.empty()
+        && SpecialDependencies.empty();
+}
+
+const DependencyIndex & Program::GetDependencyIndex() const
+{
+    std::lock_guard<std::mutex> lock(DependencyIndexMutex_);
+    if(!upDependencyIndex_ || !upDependencyIndex_->IsCurrent(*this))
+    {
+        upDependencyIndex_ = std::make_unique<DependencyIndex>(*this);
+    }
+    return *upDependencyIndex_;
+}
+
 bool Program::LoadStoreMembers(loadstore::LoadStore& ld)
 {
-    assert(ld.IsStoring()); //loading not supported
-    return ld.IO("definitions", Definitions)
+    // the sizes of the types by name; the packets refer to Types while being loaded (cf. Packet::LoadStoreMembers)
+    loadstore::LoadStore::Table<int> types;
+    loadstore::LoadStore::TemporaryContext ctx(ld, &Types);
+    std::vector<std::string> performed;
+    std::vector<int> levels; // by position in the task list
+    
+    if(ld.IsStoring())
+    {
+        for(auto & entry : Types) types.emplace(entry.first, entry.second.Size);
+        performed.assign(PassesPerformed.begin(), PassesPerformed.end());
+        if(!TaskLevels.IsEmpty()) for(auto & task : GetTasks()) levels.push_back(TaskLevels[task]);
+        return ld.IO("types", types)
+            & ld.IO("definitions", Definitions)
+            & ld.IO_Register("nativekernels", NativeKernels)
+            & ld.IO_Register("metakernels", MetaKernels)
+            & ld.IO_Register("externalbuffers", graph::ContainerRange<graph::PresDeque<Buffer>>(ExternalBuffers))
+            & ld.IO_Register("tasks", GetTasks())
+            & ld.IO_Register("maintask", MainTask)
+            & ld.IO("dependencies", Dependencies)
+            & ld.IO("families", TaskFamilies)
+            & ld.IO_Register("groups", Groups)
+            & ld.IO("divisions", Divisions)
+            & ld.IO("channels", Channels)
+            & ld.IO("codefiles", CodeFiles)
+            & ld.IO("auxfiles", AuxFiles)
+            & ld.IO("mappedfiles", MappedFiles)
+            & ld.IO("performed", performed)
+            & ld.IO("levels", levels);
+    }
+    
+    // Loading restores a program before grouping (cf. pass StoreProgram), i.e. without buffers, groups, divisions and
+    // channels. The tasks are created in the arena, and the edges of the task graph from the dependencies, unpruned;
+    // so the reachability index is not restored, and CalcSuccessorMatrix has to be applied again.
+    graph::Arena::Scope scope(Memory);
+    if(!ld.IO("types", types, false)) return false;
+    for(auto & entry : types)
+    {
+        Types.emplace(std::piecewise_construct, std::forward_as_tuple(entry.first),
+                      std::forward_as_tuple(entry.first, entry.second));
+    }
+    
+    bool ret = ld.IO("definitions", Definitions)
         & ld.IO_Register("nativekernels", NativeKernels)
         & ld.IO_Register("metakernels", MetaKernels)
-        & ld.IO_Register("externalbuffers", graph::ContainerRange<graph::PresDeque<Buffer>>(ExternalBuffers))
-        & ld.IO_Register("tasks", GetTasks())
+        & LoadTasks(ld, TaskGraph)
         & ld.IO_Register("maintask", MainTask)
         & ld.IO("dependencies", Dependencies)
-        & ld.IO_Register("groups", Groups)
-        & ld.IO("divisions", Divisions)
-        & ld.IO("channels", Channels)
+        & ld.IO("families", TaskFamilies, false)
         & ld.IO("codefiles", CodeFiles)
-        & ld.IO("auxfiles", AuxFiles);
+        & ld.IO("auxfiles", AuxFiles)
+        & ld.IO("mappedfiles", MappedFiles, false)
+        & ld.IO("performed", performed, false)
+        & ld.IO("levels", levels, false);
+    
+    PassesPerformed.insert(performed.begin(), performed.end());
+    PassesPerformed.erase("CalcSuccessorMatrix");
+    if(!levels.empty())
+    {
+        if(levels.size() != GetTasks().size())
+        {
+            ld.Error("Expected %d task levels, found %d", (int) GetTasks().size(), (int) levels.size());
+            return false;
+        }
+        TaskLevels = TaskGraph.GetNodeMap<int>(0);
+        auto itlevel = levels.begin();
+        for(auto & task : GetTasks()) TaskLevels[task] = *itlevel++;
+    }
+    
+    for(auto & upkernel : NativeKernels) Kernels[upkernel->Name] = upkernel.get();
+    for(auto & upmk : MetaKernels) Kernels[upmk->Name] = upmk.get();
     
+    auto adjacency = TaskGraph.GetNodeMap(TaskGraph.GetNodeSet()); //remember which edges we have already inserted
+    for(auto & dep : Dependencies)
+    {
+        spec::Task *t1 = dep.From.TheIface->GetTask(), *t2 = dep.To.TheIface->GetTask();
+        if(t1 == &MainTask || t2 == &MainTask || adjacency[t1].Contains(t2)) continue;
+        
+        TaskGraph.EmplaceEdge(t1, t2);
+        adjacency[t1].Insert(t2);
+    }
+    return ret;
 }
 
 }} //namespace Ladybirds::impl
@@ -4,15 +4,18 @@
 #define PROGRAM_H
 
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "graph/arena.h"
 #include "graph/graph.h"
 #include "graph/itemmap.h"
 #include "graph/itemset.h"
 #include "graph/presdeque.h"
+#include "graph/reachabilityindex.h"
 #include "dependency.h"
 #include "kernel.h"
 #include "loadstore.h"
@@ -23,6 +26,7 @@
 
 namespace Ladybirds { namespace impl {
 struct Channel;
+class DependencyIndex;
 class TaskDivision;
  
 struct Program : public loadstore::Referenceable
@@ -39,6 +43,15 @@ struct Program : public loadstore::Referenceable
         inline Definition(std::string && id, std::string && val) : Identifier(id), Value(val) {}
         virtual bool LoadStoreMembers(loadstore::LoadStore& ls) override;
     };
+    /// External packet of the main meta-kernel bound to a file (cf. LoadProjectInfo). The generated code maps the file
+    /// into memory and uses the mapping as the buffer of the packet, instead of the one passed by the caller.
+    struct MappedFile : public loadstore::LoadStorableCompound
+    {
+        std::string Packet;
+        std::string Filename;
+        
+        virtual bool LoadStoreMembers(loadstore::LoadStore& ls) override;
+    };
     using KernelList = std::unordered_map<std::string, spec::Kernel*>;
     using NativeKernelList = std::vector<std::unique_ptr<spec::Kernel>>;
     using MetaKernelList = std::vector<std::unique_ptr<spec::MetaKernel>>;
@@ -49,11 +62,15 @@ struct Program : public loadstore::Referenceable
     using GroupList = std::vector<std::unique_ptr<TaskGroup>>;
     using ChannelList = std::vector<std::unique_ptr<Channel>>;
     using StringList = std::vector<std::string>;
+    using MappedFileList = std::vector<MappedFile>;
     using DivisionList = std::vector<TaskDivision>;
-    using TypeMap = std::unordered_map<std::string, spec::BaseType>;
-    using ReachabilityMap = graph::ItemMap<graph::ItemSet>;
+    using TypeMap = spec::BaseTypeMap;
+    using ReachabilityMap = graph::ReachabilityIndex;
+    using LevelMap = graph::ItemMap<int>;
     using PassNameSet = std::set<std::string>;
     
+    /// Memory for the task graph and the task interfaces. Declared first, such that it is destroyed last.
+    graph::Arena Memory;
     DefList Definitions;
     KernelList Kernels;
     NativeKernelList NativeKernels;
@@ -61,23 +78,40 @@ struct Program : public loadstore::Referenceable
     MetaKernelList MetaKernels;
     spec::Task MainTask;
     spec::TaskGraph TaskGraph;
+    /// Loops of tasks that only differ in the positions of their interfaces (cf. spec::TaskFamily). Their tasks are
+    /// marked by Task::Family; TaskFamily::First refers to the flattened main meta-kernel and has no meaning here.
+    spec::MetaKernel::FamilyList TaskFamilies;
     DepList Dependencies;
     DepList SpecialDependencies;
     ReachabilityMap TaskReachability;
+    LevelMap TaskLevels; ///< Topological level of each task, i.e. length of the longest path to it (cf. TaskTopoSort)
     GroupList Groups;
     DivisionList Divisions;
     BufferList ExternalBuffers;
     ChannelList Channels;
     StringList CodeFiles, AuxFiles;
+    MappedFileList MappedFiles;
     TypeMap Types;
     PassNameSet PassesPerformed;
+    unsigned Revision = 0; ///< Counts the passes applied, e.g. for noticing changes after a lazy export (cf. Export)
     
     Program(); //does not do much, but we need to define it in program.cpp to reduce dependencies
     ~Program(); //dito
     
     auto GetTasks() {return TaskGraph.Nodes(); }
     auto GetTasks() const {return TaskGraph.Nodes(); }
+    /// Whether the program can be stored such that LoadStoreMembers can load it again, i.e. before its tasks are
+    /// grouped and buffers are allocated (cf. pass StoreProgram)
+    bool IsStorable() const;
+    /// Returns an index of Dependencies by interface and by pair of tasks. It is built on the first call and rebuilt
+    /// when the dependencies or the task graph have changed since (cf. DependencyIndex::IsCurrent). The reference is
+    /// valid until the next call after such a change.
+    const DependencyIndex & GetDependencyIndex() const;
     virtual bool LoadStoreMembers(loadstore::LoadStore& ls) override;
+
+private:
+    mutable std::unique_ptr<DependencyIndex> upDependencyIndex_;
+    mutable std::mutex DependencyIndexMutex_; ///< Passes may run concurrently (cf. Ladybirds.RunPipeline)
 };
 
 }} //namespace Ladybirds::impl
@@ -142,14 +142,14 @@ Space & Space::Remove(const Space &s)
 
 Space& Space::Displace(const std::vector<int> & d)
 {
-    assert(d.size() == size());
+    assert(d.size() == (size_t) size());
     std::equal(begin(), end(), d.begin(), [](Range & a, int b) {a += b; return true;});
     return *this;
 }
 
 Space& Space::DisplaceNeg(const std::vector<int> & d)
 {
-    assert(d.size() == size());
+    assert(d.size() == (size_t) size());
     std::equal(begin(), end(), d.begin(), [](Range & a, int b) {a -= b; return true;});
     return *this;
 }
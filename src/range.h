@@ -4,6 +4,7 @@
 #define RANGE_H
 
 #include "loadstore.h"
+#include "smallvector.h"
 
 namespace Ladybirds {
 namespace gen {
@@ -109,17 +110,23 @@ inline Range operator -(Range r, int offset) { return r -= offset; }
 int RangeSubtract(const Range & from, const Range & sub, /*out*/Range result[2]);
 
 //! Represents a vector of ranges for multiple dimensions
-/**(e.g. for giving the dimensions of a multi-dimensional array or sub-array)**/
-class Space : private std::vector<Range>
+/**(e.g. for giving the dimensions of a multi-dimensional array or sub-array)
+ * Spaces with up to four dimensions, i.e. nearly all of them, keep their ranges inside the object, so that copying and
+ * intersecting them does not allocate memory. **/
+class Space : private SmallVector<Range, 4>
 {
+    using RangeVector = SmallVector<Range, 4>;
+    
 public:
-    using vector<Range>::operator[];
-    using vector<Range>::begin;
-    using vector<Range>::end;
-    using vector<Range>::rbegin;
-    using vector<Range>::rend;
-    using vector<Range>::push_back;
-    using vector<Range>::reserve;
+    using RangeVector::iterator;
+    using RangeVector::const_iterator;
+    using RangeVector::operator[];
+    using RangeVector::begin;
+    using RangeVector::end;
+    using RangeVector::rbegin;
+    using RangeVector::rend;
+    using RangeVector::push_back;
+    using RangeVector::reserve;
     
     Space() = default;
     //! Given d := \p dimensions, constructs a space { [0, d0), [0, d1), ... }.
@@ -128,13 +135,15 @@ public:
     bool operator ==(const Space & other) const;
     inline bool operator !=(const Space & other) const { return !operator==(other); }
     
-    //! Provides direct access to the underlying vector interface, e.g. for standard serialization functions etc.
-    vector<Range> & AsVector() { return *this; }
-    //! Provides direct access to the underlying vector interface, e.g. for standard serialization functions etc.
-    const vector<Range> & AsVector() const { return *this; }
+    //! Provides direct access to the underlying vector interface, e.g. for resizing the space.
+    RangeVector & AsVector() { return *this; }
+    //! Provides direct access to the underlying vector interface, e.g. for resizing the space.
+    const RangeVector & AsVector() const { return *this; }
     
     //! Returns the number of dimensions of the space
     int Dimensions() const { return size(); }
+    //! Returns the bytes allocated on the heap for the ranges, i.e. none for spaces with up to four dimensions
+    std::size_t GetHeapBytes() const { return capacity() > 4 ? capacity() * sizeof(Range) : 0; }
     
     //! Returns true if \p other overlaps this space (i.e. if all element ranges overlap)
     bool Overlaps(const Space & other) const;
@@ -206,10 +215,10 @@ public:
 //! Returns the union of two overlapping spaces \p a and \p b.
 /** Since the return value is supposed to be a space as well, \p a and \p b must overlap. 
  *  Otherwise, the result is undefined. **/
-inline Space operator |(Space a, const Space & b) { return a |= b; }
+inline Space operator |(Space a, const Space & b) { a |= b; return a; } // not return a |= b;, which copies a
 
 //! Returns the intersection of two spaces \p a and \p b.
-inline Space operator &(Space a, const Space & b) { return a &= b; }
+inline Space operator &(Space a, const Space & b) { a &= b; return a; }
 
 std::ostream & operator<<(std::ostream & strm, const Range & r);
 std::ostream & operator<<(std::ostream & strm, const Space & s);
@@ -0,0 +1,94 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "recordfile.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+namespace Ladybirds {
+namespace tools {
+
+bool RecordFile::Open(const std::string & filename, const char * kind)
+{
+    Buffer_.resize(1 << 20); // reading large files in bigger chunks than the default
+    File_.rdbuf()->pubsetbuf(Buffer_.data(), Buffer_.size());
+    File_.open(filename);
+    if(!File_.is_open()) return false;
+
+    Filename_ = filename;
+    LineNumber_ = 1;
+    std::string magic = std::string("#ladybirds ") + kind + ' ';
+    if(!std::getline(File_, Line_) || Line_.compare(0, magic.size(), magic) != 0)
+    {
+        File_.close();
+        return false;
+    }
+    return true;
+}
+
+bool RecordFile::Next()
+{
+    while(std::getline(File_, Line_))
+    {
+        ++LineNumber_;
+        Fields_.clear();
+        if(Line_.empty() || Line_[0] == '#') continue;
+
+        // split in place: the fields point into Line_, each terminated by overwriting the white space behind it
+        char * pos = &Line_[0];
+        for(;;)
+        {
+            pos += strspn(pos, " \t\r");
+            if(!*pos) break;
+            Fields_.push_back(pos);
+            pos += strcspn(pos, " \t\r");
+            if(!*pos) break;
+            *pos++ = '\0';
+        }
+        if(!Fields_.empty()) return true;
+    }
+    return false;
+}
+
+bool RecordFile::Number(int i, double & val)
+{
+    char * end;
+    errno = 0;
+    val = strtod(Fields_[i], &end);
+    if(*end || end == Fields_[i] || errno == ERANGE)
+    {
+        Error("'%s' is not a valid number", Fields_[i]);
+        return false;
+    }
+    return true;
+}
+
+bool RecordFile::Number(int i, long & val)
+{
+    char * end;
+    errno = 0;
+    val = strtol(Fields_[i], &end, 10);
+    if(*end || end == Fields_[i] || errno == ERANGE)
+    {
+        Error("'%s' is not a valid integer", Fields_[i]);
+        return false;
+    }
+    return true;
+}
+
+bool RecordFile::Number(int i, int & val)
+{
+    long lval;
+    if(!Number(i, lval)) return false;
+    if(lval < INT_MIN || lval > INT_MAX)
+    {
+        Error("%s is out of range", Fields_[i]);
+        return false;
+    }
+    val = lval;
+    return true;
+}
+
+}} // namespace Ladybirds::tools
@@ -0,0 +1,55 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_TOOLS_RECORDFILE_H
+#define LADYBIRDS_TOOLS_RECORDFILE_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "msgui.h"
+#include "tools.h"
+
+namespace Ladybirds {
+namespace tools {
+
+//! Reads a line-oriented record file, as written by the instrumentation runtime for large measurements
+/** The first line of such a file is "#ladybirds <kind> <version>". Every further line is a record of fields
+ *  separated by white space; empty lines and lines starting with '#' are skipped. The file is read one record at a
+ *  time, such that it never has to be held in memory as a whole (unlike the Lua tables LoadCost & co. read else). **/
+class RecordFile
+{
+private:
+    std::ifstream File_;
+    std::string Filename_;
+    std::string Line_;
+    std::vector<const char*> Fields_;
+    int LineNumber_ = 0;
+    std::vector<char> Buffer_;
+
+public:
+    //! Opens \p filename if it is a record file of \p kind (e.g. "accesses"). Returns false without any message if
+    //! it is not, such that the caller can fall back to another format (and report errors there).
+    bool Open(const std::string & filename, const char * kind);
+
+    //! Reads the next record. Returns false at the end of the file.
+    bool Next();
+
+    inline const std::string & GetFilename() const { return Filename_; }
+    inline int Size() const { return Fields_.size(); }
+    inline const char * operator[](int i) const { return Fields_[i]; }
+
+    //!@{ Converts field \p i to a number. Returns false and prints an error if it is none.
+    bool Number(int i, double & val);
+    bool Number(int i, long & val);
+    bool Number(int i, int & val);
+    //!@}
+
+    //! Prints an error message, prefixed with the file name and the line number of the current record
+    template<typename ... Args> void Error(const char * format, Args ... args)
+        { gMsgUI.Error("%s:%d: %s", Filename_.c_str(), LineNumber_, strprintf(format, args...).c_str()); }
+};
+
+}} // namespace Ladybirds::tools
+
+#endif // LADYBIRDS_TOOLS_RECORDFILE_H
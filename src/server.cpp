@@ -0,0 +1,253 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "server.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+
+#include "binaryloadstore.h"
+#include "cmdlineoptions.h"
+#include "msgui.h"
+
+using std::string;
+
+// A request consists of its size (4 bytes), sent together with the standard streams of the client (SCM_RIGHTS), and
+// the request itself, stored by loadstore::BinaryStore. The server answers with the exit code (4 bytes) when done.
+
+namespace Ladybirds { namespace tools {
+
+namespace {
+constexpr int NumStreams = 3; ///< The client passes its stdin, stdout and stderr to the server
+
+/// \internal What the client sends besides its standard streams
+struct Request : public loadstore::LoadStorableCompound
+{
+    string WorkDir;
+    CmdLineOptions Options;
+
+    virtual bool LoadStoreMembers(loadstore::LoadStore & ls) override
+    {
+        return ls.IO("workdir", WorkDir) & ls.IO("options", Options);
+    }
+};
+
+/// \internal The control message of a request, aligned as required for cmsghdr
+union StreamsMessage
+{
+    cmsghdr Header;
+    char Buf[CMSG_SPACE(NumStreams * sizeof(int))];
+};
+
+/// \internal Fills \p addr with the address of the Unix socket at \p path. Returns false (with an error) on failure.
+bool MakeAddress(const string & path, sockaddr_un & addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.empty() || path.size() >= sizeof(addr.sun_path))
+    {
+        gMsgUI.Error("Invalid socket path '%s'", path.c_str());
+        return false;
+    }
+    path.copy(addr.sun_path, path.size());
+    return true;
+}
+
+/// \internal Writes the \p size bytes at \p data to \p fd. Returns false on failure.
+bool WriteAll(int fd, const char * data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/// \internal Reads \p size bytes from \p fd to \p data. Returns false on failure or if the file ends before.
+bool ReadAll(int fd, char * data, size_t size)
+{
+    while(size > 0)
+    {
+        ssize_t n = read(fd, data, size);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/// \internal Receives a request on connection \p conn and runs it with \p run in this (forked) process, then sends the
+/// exit code to the client. Returns the exit code.
+int HandleRequest(int conn, const string & parsecache, const std::function<int()> & run)
+{
+    uint32_t size;
+    iovec iov = { &size, sizeof(size) };
+    StreamsMessage control;
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.Buf;
+    msg.msg_controllen = sizeof(control.Buf);
+    if(recvmsg(conn, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC) != sizeof(size)) return 1;
+
+    cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    if(!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(NumStreams * sizeof(int)))
+    {
+        gMsgUI.Error("Ignoring a request without standard streams");
+        return 1;
+    }
+    int streams[NumStreams];
+    memcpy(streams, CMSG_DATA(cmsg), sizeof(streams));
+
+    string data(size, '\0');
+    Request req;
+    if(!ReadAll(conn, &data[0], size)) return 1;
+    loadstore::BinaryLoad ld(std::move(data));
+    if(!ld.RawIO(req) || ld.GetErrorCount() != 0)
+    {
+        gMsgUI.Error("Ignoring a damaged request");
+        return 1;
+    }
+
+    // From here on, all output goes to the client
+    for(int i = 0; i < NumStreams; ++i)
+    {
+        dup2(streams[i], i);
+        close(streams[i]);
+    }
+
+    int ret = 1;
+    if(chdir(req.WorkDir.c_str()) != 0)
+    {
+        gMsgUI.Error("Unable to change to directory '%s': %s", req.WorkDir.c_str(), strerror(errno));
+    }
+    else
+    {
+        gCmdLineOptions = req.Options;
+        if(gCmdLineOptions.ParseCache.empty()) gCmdLineOptions.ParseCache = parsecache;
+        gMsgUI.open(stderr, gCmdLineOptions.Verbose ? stdout : nullptr);
+        ret = run();
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+    int32_t code = ret;
+    WriteAll(conn, reinterpret_cast<const char*>(&code), sizeof(code));
+    return ret;
+}
+} //namespace ::
+
+
+int Serve(const string & socketpath, const string & parsecache, const std::function<int()> & run)
+{
+    sockaddr_un addr;
+    if(!MakeAddress(socketpath, addr)) return 1;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socketpath.c_str()); // left over by an earlier server
+    if(sock < 0 || bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(sock, SOMAXCONN) != 0)
+    {
+        gMsgUI.Error("Unable to serve on '%s': %s", socketpath.c_str(), strerror(errno));
+        return 1;
+    }
+
+    signal(SIGCHLD, SIG_IGN); // nobody waits for the requests, so let them be reaped automatically
+    gMsgUI.Info("Serving compile requests on %s", socketpath.c_str());
+    for(;;)
+    {
+        int conn = accept(sock, nullptr, nullptr);
+        if(conn < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            gMsgUI.Error("Unable to accept requests on '%s': %s", socketpath.c_str(), strerror(errno));
+            return 1;
+        }
+        fcntl(conn, F_SETFD, FD_CLOEXEC); // not for the programs started by the backends
+
+        pid_t pid = fork();
+        if(pid == 0)
+        {
+            close(sock);
+            signal(SIGCHLD, SIG_DFL); // the backends wait for the programs they start
+            _exit(HandleRequest(conn, parsecache, run));
+        }
+        if(pid < 0) gMsgUI.Error("Unable to start a process for a request: %s", strerror(errno));
+        close(conn);
+    }
+}
+
+int RunOnServer(const string & socketpath)
+{
+    sockaddr_un addr;
+    if(!MakeAddress(socketpath, addr)) return 1;
+
+    Request req;
+    llvm::SmallString<128> cwd;
+    if(llvm::sys::fs::current_path(cwd))
+    {
+        gMsgUI.Error("Unable to determine the working directory");
+        return 1;
+    }
+    req.WorkDir = cwd.str().str();
+    req.Options = gCmdLineOptions;
+    loadstore::BinaryStore ls;
+    bool ok = ls.RawIO(req);
+    string data = ls.GetData();
+    if(!ok || ls.GetErrorCount() != 0) return 1;
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(sock < 0 || connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        gMsgUI.Error("Unable to connect to the server at '%s': %s", socketpath.c_str(), strerror(errno));
+        if(sock >= 0) close(sock);
+        return 1;
+    }
+
+    uint32_t size = data.size();
+    iovec iov = { &size, sizeof(size) };
+    StreamsMessage control;
+    memset(&control, 0, sizeof(control));
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.Buf;
+    msg.msg_controllen = sizeof(control.Buf);
+    cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(NumStreams * sizeof(int));
+    const int streams[NumStreams] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    memcpy(CMSG_DATA(cmsg), streams, sizeof(streams));
+
+    int32_t code;
+    ok = sendmsg(sock, &msg, 0) == sizeof(size) && WriteAll(sock, data.data(), data.size())
+        && ReadAll(sock, reinterpret_cast<char*>(&code), sizeof(code));
+    close(sock);
+    if(!ok)
+    {
+        gMsgUI.Error("The server at '%s' did not finish the request", socketpath.c_str());
+        return 1;
+    }
+    return code;
+}
+
+}} //namespace Ladybirds::tools
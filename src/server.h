@@ -0,0 +1,27 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_TOOLS_SERVER_H
+#define LADYBIRDS_TOOLS_SERVER_H
+
+#include <functional>
+#include <string>
+
+namespace Ladybirds {
+namespace tools {
+
+//! Serves compile requests on the Unix socket at \p socketpath until the process is terminated.
+/** Each request is run by \p run in a child process forked from this one, so it starts from the state prepared by the
+ *  caller (e.g. a Lua environment with the passes registered and the libraries loaded) without being able to change it
+ *  for later requests. Before \p run is called, the child takes over the working directory and the standard streams of
+ *  the client and sets gCmdLineOptions to the options the client was started with. Requests without a parse cache of
+ *  their own use \p parsecache (cf. parse::ParseCache), so that they only parse a specification once.
+ *  Returns 1 if the socket cannot be set up. **/
+int Serve(const std::string & socketpath, const std::string & parsecache, const std::function<int()> & run);
+
+//! Runs the compilation described by gCmdLineOptions on the server listening on \p socketpath (cf. Serve).
+//! Returns the exit code of the request, or 1 if the server cannot be reached or fails.
+int RunOnServer(const std::string & socketpath);
+
+}} // namespace Ladybirds::tools
+
+#endif // LADYBIRDS_TOOLS_SERVER_H
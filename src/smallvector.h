@@ -0,0 +1,136 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef SMALLVECTOR_H
+#define SMALLVECTOR_H
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <new>
+#include <utility>
+
+//! Vector that stores up to \p N elements inside the object and only allocates memory on the heap for more.
+/** Provides the part of the interface of std::vector that is needed so far. As with std::vector, iterators and
+ ** references are invalidated when the capacity grows; in addition, moving a small vector moves its elements. **/
+template<typename T, int N> class SmallVector
+{
+private:
+    T * Data_;
+    int Size_ = 0;
+    int Capacity_ = N;
+    alignas(T) unsigned char Inline_[N * sizeof(T)];
+
+public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+    inline SmallVector() : Data_(GetInline()) {}
+    template<typename InputIt> inline SmallVector(InputIt first, InputIt last) : SmallVector() { assign(first, last); }
+    inline SmallVector(const SmallVector & other) : SmallVector() { assign(other.begin(), other.end()); }
+    inline SmallVector(SmallVector && other) noexcept : SmallVector() { movehere(std::move(other)); }
+    inline ~SmallVector() { clear(); release(); }
+
+    inline SmallVector & operator=(const SmallVector & other)
+        { if(this != &other) assign(other.begin(), other.end()); return *this; }
+    inline SmallVector & operator=(SmallVector && other) noexcept
+        { if(this != &other) { clear(); release(); movehere(std::move(other)); } return *this; }
+
+    template<typename InputIt> void assign(InputIt first, InputIt last)
+    {
+        clear();
+        for(; first != last; ++first) emplace_back(*first);
+    }
+
+    inline T* data() { return Data_; }
+    inline const T* data() const { return Data_; }
+    inline int size() const { return Size_; }
+    inline bool empty() const { return Size_ == 0; }
+    inline int capacity() const { return Capacity_; }
+
+    inline iterator begin() { return Data_; }
+    inline const_iterator begin() const { return Data_; }
+    inline const_iterator cbegin() const { return Data_; }
+    inline iterator end() { return Data_ + Size_; }
+    inline const_iterator end() const { return Data_ + Size_; }
+    inline const_iterator cend() const { return Data_ + Size_; }
+    inline reverse_iterator rbegin() { return reverse_iterator(end()); }
+    inline const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    inline reverse_iterator rend() { return reverse_iterator(begin()); }
+    inline const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    inline T& operator[](int i) { assert(i >= 0 && i < Size_); return Data_[i]; }
+    inline const T& operator[](int i) const { assert(i >= 0 && i < Size_); return Data_[i]; }
+    inline T& front() { return (*this)[0]; }
+    inline const T& front() const { return (*this)[0]; }
+    inline T& back() { return (*this)[Size_-1]; }
+    inline const T& back() const { return (*this)[Size_-1]; }
+
+    template<typename... Args> T& emplace_back(Args&&... args)
+    {
+        if(Size_ == Capacity_)
+        {
+            T elem(std::forward<Args>(args)...); // args might refer to an element
+            grow(Size_ + 1);
+            return *new(Data_ + Size_++) T(std::move(elem));
+        }
+        return *new(Data_ + Size_++) T(std::forward<Args>(args)...);
+    }
+    inline void push_back(const T & elem) { emplace_back(elem); }
+    inline void push_back(T && elem) { emplace_back(std::move(elem)); }
+    inline void pop_back() { assert(Size_ > 0); Data_[--Size_].~T(); }
+
+    inline void reserve(int capacity) { if(capacity > Capacity_) grow(capacity); }
+    void resize(int size)
+    {
+        while(Size_ > size) pop_back();
+        reserve(size);
+        while(Size_ < size) emplace_back();
+    }
+    inline void clear() { while(Size_ > 0) pop_back(); }
+
+private:
+    inline T* GetInline() { return reinterpret_cast<T*>(Inline_); }
+    inline bool IsInline() const { return Data_ == reinterpret_cast<const T*>(Inline_); }
+
+    //! Moves the elements to a heap block with room for at least \p mincapacity elements
+    void grow(int mincapacity)
+    {
+        int capacity = std::max(mincapacity, 2 * Capacity_);
+        T * data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+        for(int i = 0; i < Size_; ++i)
+        {
+            new(data + i) T(std::move(Data_[i]));
+            Data_[i].~T();
+        }
+        release();
+        Data_ = data;
+        Capacity_ = capacity;
+    }
+
+    //! Frees the heap block, if any (the elements must be destroyed already)
+    inline void release()
+    {
+        if(!IsInline()) ::operator delete(Data_);
+        Data_ = GetInline();
+        Capacity_ = N;
+    }
+
+    //! Takes over the elements of \p other (this vector must be empty and use the inline storage)
+    void movehere(SmallVector && other)
+    {
+        if(!other.IsInline())
+        {
+            Data_ = other.Data_, Size_ = other.Size_, Capacity_ = other.Capacity_;
+            other.Data_ = other.GetInline(), other.Size_ = 0, other.Capacity_ = N;
+            return;
+        }
+        for(auto & elem : other) new(Data_ + Size_++) T(std::move(elem));
+        other.clear();
+    }
+};
+
+
+#endif //ndef SMALLVECTOR_H
@@ -3,45 +3,75 @@
 #ifndef LADYBIRDS_GEN_SPACEDIVISION_H
 #define LADYBIRDS_GEN_SPACEDIVISION_H
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
-#include <unordered_map>
+#include <map>
+#include <vector>
 
+#include "gen/sectionindex.h"
 #include "range.h"
 
 namespace Ladybirds { namespace gen {
 
 
+//! Sections of all space divisions split and merged so far, for the statistics of the passes (cf. lua::PassStats)
+struct SectionStats
+{
+    std::atomic<long> Split{0};  ///< Sections created by splitting others (cf. SpaceDivision::TrimSection)
+    std::atomic<long> Merged{0}; ///< Sections removed by merging them with adjacent ones (cf. SpaceDivision::Coalesce)
+};
+inline SectionStats & GetSectionStats()
+{
+    static SectionStats stats;
+    return stats;
+}
+
+
 template<typename AssignType>
 class SpaceDivision
 {
-    using SectionMap = std::unordered_multimap<AssignType, Space>;
+    using SectionMap = std::multimap<AssignType, Space>;
     using SearchResult = typename SectionMap::const_iterator;
+    
+    static constexpr std::size_t MinCoalesce = 64; ///< Number of sections below which they are not merged on their own
 
 protected:
     Space FullSpace_;
     SectionMap Sections_;
+    SectionIndex<SearchResult> Index_; ///< Of Sections_, for FindOverlaps
+    std::size_t CoalesceAt_ = MinCoalesce; ///< Number of sections at which they are merged next (cf. Coalesce)
 
 public:
-    SpaceDivision(Space fullspace) : FullSpace_(std::move(fullspace)) {}
-    SpaceDivision ( const SpaceDivision &other ) = default;
-    SpaceDivision &operator= ( const SpaceDivision &other ) = default;
+    SpaceDivision(Space fullspace) : FullSpace_(std::move(fullspace)), Index_(FullSpace_.Dimensions()) {}
+    SpaceDivision(const SpaceDivision &other)
+        : FullSpace_(other.FullSpace_), Sections_(other.Sections_), Index_(FullSpace_.Dimensions()),
+          CoalesceAt_(other.CoalesceAt_)
+        { IndexSections(); }
+    SpaceDivision &operator=(const SpaceDivision &other)
+    {
+        FullSpace_ = other.FullSpace_;
+        Sections_ = other.Sections_;
+        Index_ = SectionIndex<SearchResult>(FullSpace_.Dimensions());
+        CoalesceAt_ = other.CoalesceAt_;
+        IndexSections();
+        return *this;
+    }
+    SpaceDivision(SpaceDivision &&other) = default; // the sections keep their nodes, and so the index stays valid
+    SpaceDivision &operator=(SpaceDivision &&other) = default;
     
     const Space & GetFullSpace() const { return FullSpace_; }
     const SectionMap & GetSections() const { return Sections_; }
     int GetSectionCount() const { return Sections_.size(); }
     bool IsEmpty() const { return Sections_.empty(); }
     
-    void Clear() { Sections_.clear(); }
+    void Clear() { Sections_.clear(); Index_.Clear(); }
     
+    //! Returns the sections overlapping \p s, in no particular order (cf. SectionIndex)
     std::vector<SearchResult> FindOverlaps(const Space & s)
     {
         std::vector<SearchResult> ret;
-        
-        for(auto it = Sections_.begin(), itend = Sections_.end(); it != itend; ++it)
-        {
-            if(it->second.Overlaps(s)) ret.push_back(it);
-        }
-        
+        Index_.ForOverlaps(s, [&ret](SearchResult it) { ret.push_back(it); });
         return ret;
     }
     
@@ -57,13 +87,34 @@ public:
         {
             TrimSection(overlap, sec);
         }
-        Sections_.emplace(assign, sec);
+        Emplace(Sections_.end(), assign, std::move(sec));
+        CoalesceIfFragmented();
+    }
+    
+    //! Merges sections with the same assignment that are equal in all dimensions but one, in which one follows the
+    //! other directly, until there are no more such pairs. Returns the number of sections removed.
+    /** AssignSection does this on its own whenever the number of sections has doubled since, such that the pieces
+        left by partial overwrites (cf. TrimSection) do not accumulate. Invalidates the results of FindOverlaps. **/
+    int Coalesce()
+    {
+        int removed = 0;
+        for(auto it = Sections_.begin(); it != Sections_.end(); )
+        {
+            auto itend = Sections_.upper_bound(it->first);
+            removed += CoalesceRange(it, itend);
+            it = itend;
+        }
+        GetSectionStats().Merged.fetch_add(removed, std::memory_order_relaxed);
+        CoalesceAt_ = std::max(2*Sections_.size(), std::size_t(MinCoalesce)); // a copy, MinCoalesce is not defined
+        return removed;
     }
     
     //! Removes all assignments made to \p unassign from this division
     void Unassign(const AssignType & unassign)
     {
-        Sections_.erase(unassign);
+        auto range = Sections_.equal_range(unassign);
+        for(auto it = range.first; it != range.second; ++it) Index_.Erase(it->second);
+        Sections_.erase(range.first, range.second);
     }
     
     SpaceDivision SubDivision(const Space & subspace)
@@ -72,12 +123,11 @@ public:
         assert(subspace.Dimensions() == ndims);
         SpaceDivision ret(subspace);
         
-        Space s;
-        for(const auto & secpair : Sections_)
+        Index_.ForOverlaps(subspace, [&ret, &subspace](SearchResult it)
         {
-            s = secpair.second & subspace;
-            if(!s.IsEmpty()) ret.Sections_.emplace(secpair.first, std::move(s));
-        }
+            Space s = it->second & subspace;
+            if(!s.IsEmpty()) ret.Emplace(ret.Sections_.end(), it->first, std::move(s));
+        });
         return ret;
     }
     
@@ -97,13 +147,28 @@ public:
     }
     
 protected:
+    //! Calls Coalesce if the number of sections has doubled since it was last called
+    void CoalesceIfFragmented()
+    {
+        if(Sections_.size() >= CoalesceAt_) Coalesce();
+    }
+    
+    //! Adds a section (not empty) to Sections_ (inserting it as close as possible before \p hint) and to Index_
+    SearchResult Emplace(SearchResult hint, const AssignType & assign, Space sec)
+    {
+        auto it = Sections_.emplace_hint(hint, assign, std::move(sec));
+        Index_.Insert(it->second, it);
+        return it;
+    }
+    
     //! Removes all elements in \p remove from the section denoted by \p ittrim.
     /**This may include splitting it into multiple sections or removing it entirely.**/
-    void TrimSection(typename SectionMap::const_iterator ittrim, const Space & remove)
+    void TrimSection(SearchResult ittrim, const Space & remove)
     {
-        Space trim = std::move(ittrim->second);
-        AssignType assign = std::move(ittrim->first);
-        auto ithint = Sections_.erase(ittrim);
+        Index_.Erase(ittrim->second);
+        Space trim = ittrim->second;
+        AssignType assign = ittrim->first;
+        SearchResult ithint = Sections_.erase(ittrim);
         
         Range diff[2];
         for(int i = 0, iend = trim.Dimensions(); i < iend; ++i)
@@ -113,11 +178,69 @@ protected:
             for(int n = 0; n < ndiff; ++n)
             {
                 trim[i] = diff[n];
-                ithint = Sections_.emplace_hint(ithint, assign, trim);
+                ithint = Emplace(ithint, assign, trim);
             }
+            if(ndiff > 0) GetSectionStats().Split.fetch_add(ndiff, std::memory_order_relaxed);
             trim[i] = intersec;
         }
     }
+
+private:
+    using SectionIt = typename SectionMap::iterator;
+    
+    //! Merges the adjacent sections in [\p first, \p last), which have the same assignment (cf. Coalesce)
+    int CoalesceRange(SectionIt first, SectionIt last)
+    {
+        std::vector<SectionIt> secs;
+        for(auto it = first; it != last; ++it) secs.push_back(it);
+        if(secs.size() < 2) return 0;
+        
+        const int ndims = FullSpace_.Dimensions(), before = secs.size();
+        for(auto it : secs) Index_.Erase(it->second);
+        // sweep along each dimension in turn until nothing changes, as merging along one may enable another
+        for(bool changed = true; changed && secs.size() > 1; )
+        {
+            changed = false;
+            for(int dim = 0; dim < ndims; ++dim)
+            {
+                // sections differing only in dim become neighbours, ordered by their begin in it
+                std::sort(secs.begin(), secs.end(), [dim, ndims](SectionIt a, SectionIt b)
+                {
+                    for(int d = 0; d < ndims; ++d)
+                    {
+                        const Range &ra = a->second[d], &rb = b->second[d];
+                        if(d == dim || ra == rb) continue;
+                        return ra.begin() != rb.begin() ? ra.begin() < rb.begin() : ra.end() < rb.end();
+                    }
+                    return a->second[dim].begin() < b->second[dim].begin();
+                });
+                std::vector<SectionIt> kept{secs.front()};
+                for(auto it = secs.begin() + 1; it != secs.end(); ++it)
+                {
+                    Space &into = kept.back()->second;
+                    const Space &next = (*it)->second;
+                    bool adjacent = into[dim].end() == next[dim].begin();
+                    for(int d = 0; d < ndims && adjacent; ++d) adjacent = d == dim || into[d] == next[d];
+                    if(!adjacent)
+                    {
+                        kept.push_back(*it);
+                        continue;
+                    }
+                    into[dim] |= next[dim];
+                    Sections_.erase(*it);
+                    changed = true;
+                }
+                secs = std::move(kept);
+            }
+        }
+        for(auto it : secs) Index_.Insert(it->second, it);
+        return before - (int) secs.size();
+    }
+    
+    void IndexSections()
+    {
+        for(auto it = Sections_.cbegin(), itend = Sections_.cend(); it != itend; ++it) Index_.Insert(it->second, it);
+    }
 };
 
 template<typename AssignType>
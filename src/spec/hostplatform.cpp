@@ -0,0 +1,350 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "spec/hostplatform.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <unistd.h>
+
+#include "msgui.h"
+#include "tools.h"
+
+using std::string;
+using std::vector;
+
+namespace Ladybirds {
+namespace spec {
+
+namespace {
+const char * const SysCpu = "/sys/devices/system/cpu/";
+const char * const SysNode = "/sys/devices/system/node/";
+
+/// \internal Returns the first line of the file \p path, or an empty string if it cannot be read
+string ReadLine(const string & path)
+{
+    std::ifstream strm(path);
+    string line;
+    std::getline(strm, line);
+    return line;
+}
+
+/// \internal Parses a list of CPUs as used by sysfs, e.g. "0-3,8"
+vector<int> ParseCpuList(const string & list)
+{
+    vector<int> ret;
+    for(const char *pos = list.c_str(); *pos; )
+    {
+        char *end;
+        long first = strtol(pos, &end, 10), last = first;
+        if(end == pos) break;
+        if(*end == '-') last = strtol(end + 1, &end, 10);
+        for(long cpu = first; cpu <= last; ++cpu) ret.push_back(cpu);
+        pos = (*end == ',') ? end + 1 : end;
+        if(*end != ',') break;
+    }
+    return ret;
+}
+
+/// \internal Parses a size like "512K" (as in sysfs cache descriptions) into bytes
+long ParseSize(const string & str)
+{
+    char *end;
+    long ret = strtol(str.c_str(), &end, 10);
+    switch(*end)
+    {
+        case 'K': return ret << 10;
+        case 'M': return ret << 20;
+        case 'G': return ret << 30;
+        default:  return ret;
+    }
+}
+
+/// \internal A memory of the host: a NUMA node (Level 0) or a cache shared by some CPUs
+struct HostMem
+{
+    string Name;
+    int Level;
+    long Size;
+    int Node;           ///< The NUMA node of the CPUs, or the node itself
+    vector<int> Cpus;   ///< CPUs sharing the cache, or the CPUs of the node
+    Platform::Memory *pMem = nullptr;
+};
+
+/// \internal A logical CPU of the host, with its memories in the list of HostMem
+struct HostCpu
+{
+    int Id;
+    long MaxFreq = 0;
+    int Node = 0;
+    vector<int> Caches;
+};
+
+/// \internal Times of the accesses to a memory, in nanoseconds
+struct AccessTimes
+{
+    double Read = 0, Write = 0; ///< Per word of 8 bytes when streaming
+    double Latency = 0;         ///< Of a single dependent read
+};
+
+/// \internal Runs \p fn on a thread pinned to \p cpu (as far as the system supports it)
+template<typename fn_t> void RunOnCpu(int cpu, fn_t fn)
+{
+    std::thread thread([cpu, &fn]()
+    {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+        fn();
+    });
+    thread.join();
+}
+
+/// \internal Measures the access times for \p buffer, which should be as large as the memory to be measured allows
+AccessTimes MeasureAccess(vector<std::uint64_t> & buffer)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr double mintime = 5e6; // ns per measurement
+    volatile std::uint64_t sink = 0;
+    auto measure = [&](auto pass, double count)
+    {
+        pass(); // warm-up, which also brings the buffer into the memory level measured
+        long passes = 0;
+        double elapsed = 0;
+        for(auto start = clock::now(); elapsed < mintime; ++passes)
+        {
+            pass();
+            elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        }
+        return elapsed / (passes * count);
+    };
+
+    AccessTimes ret;
+    double nwords = buffer.size();
+    ret.Read = measure([&]() { sink = std::accumulate(buffer.begin(), buffer.end(), std::uint64_t(sink)); }, nwords);
+    ret.Write = measure([&]() { std::iota(buffer.begin(), buffer.end(), std::uint64_t(sink)); sink = buffer[1]; }, nwords);
+
+    // a random cycle through the buffer, one element per cache line, such that the reads cannot be prefetched
+    constexpr std::size_t stride = 8;
+    vector<std::size_t> order(buffer.size() / stride);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::minstd_rand(42));
+    for(std::size_t i = 0; i < order.size(); ++i) buffer[order[i]*stride] = order[(i + 1) % order.size()]*stride;
+    ret.Latency = measure([&]()
+    {
+        std::uint64_t pos = 0;
+        for(std::size_t i = order.size(); i-- > 0; ) pos = buffer[pos];
+        sink = pos;
+    }, order.size());
+    return ret;
+}
+
+/// \internal Converts \p ns to cost units; costs are at least 1, such that each access counts
+int ToCost(double ns, double scale)
+{
+    return int(std::min<double>(std::max(std::lround(ns*scale), 1L), INT_MAX));
+}
+
+/// \internal Reads the CPUs, caches and NUMA nodes of the host from sysfs. Returns false if it is not available.
+bool ReadTopology(vector<HostCpu> & cpus, vector<HostMem> & mems)
+{
+    auto online = ParseCpuList(ReadLine(string(SysCpu) + "online"));
+    if(online.empty()) return false;
+
+    std::map<int, int> cpupos;
+    for(int id : online)
+    {
+        cpupos[id] = cpus.size();
+        cpus.emplace_back();
+        cpus.back().Id = id;
+        cpus.back().MaxFreq = atol(ReadLine(strprintf("%scpu%d/cpufreq/cpuinfo_max_freq", SysCpu, id)).c_str());
+    }
+
+    for(int node = 0; ; ++node)
+    {
+        auto nodecpus = ParseCpuList(ReadLine(strprintf("%snode%d/cpulist", SysNode, node)));
+        if(nodecpus.empty() && node > 0) break;
+
+        long size = 0;
+        std::ifstream meminfo(strprintf("%snode%d/meminfo", SysNode, node));
+        for(string line; std::getline(meminfo, line); )
+        {
+            auto pos = line.find("MemTotal:");
+            if(pos != string::npos) size = atol(line.c_str() + pos + 9) << 10;
+        }
+        if(nodecpus.empty())
+        { // no NUMA information: a single memory for all CPUs
+            nodecpus = online;
+            size = long(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+        }
+
+        mems.push_back({ strprintf("node%d", node), 0, size, node, nodecpus });
+        for(int cpu : nodecpus) if(cpupos.count(cpu)) cpus[cpupos[cpu]].Node = node;
+        if(nodecpus == online) break;
+    }
+
+    std::map<string, int> caches; // by level and shared CPUs
+    for(auto &cpu : cpus)
+    {
+        for(int index = 0; ; ++index)
+        {
+            auto dir = strprintf("%scpu%d/cache/index%d/", SysCpu, cpu.Id, index);
+            auto level = ReadLine(dir + "level");
+            if(level.empty()) break;
+            auto type = ReadLine(dir + "type");
+            if((level != "2" && level != "3") || (type != "Unified" && type != "Data")) continue;
+
+            auto shared = ReadLine(dir + "shared_cpu_list");
+            auto key = "L" + level + ":" + shared;
+            auto it = caches.find(key);
+            if(it == caches.end())
+            {
+                it = caches.emplace(key, mems.size()).first;
+                mems.push_back({ key, atoi(level.c_str()), ParseSize(ReadLine(dir + "size")), cpu.Node,
+                                 ParseCpuList(shared) });
+            }
+            cpu.Caches.push_back(it->second);
+        }
+    }
+    return true;
+}
+} //namespace ::
+
+bool BuildHostPlatform(Platform & pf, const HostPlatformOptions & options)
+{
+    vector<HostCpu> cpus;
+    vector<HostMem> mems;
+    if(!ReadTopology(cpus, mems))
+    {
+        cpus.assign(std::max(1u, std::thread::hardware_concurrency()), HostCpu());
+        for(std::size_t i = 0; i < cpus.size(); ++i) cpus[i].Id = i;
+        mems.push_back({ "node0", 0, long(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE), 0, {} });
+        for(auto &cpu : cpus) mems[0].Cpus.push_back(cpu.Id);
+    }
+    auto firstcpu = [&mems](int mem) { return mems[mem].Cpus.empty() ? 0 : mems[mem].Cpus.front(); };
+    vector<int> nodes; // the NUMA nodes in mems
+    for(std::size_t i = 0; i < mems.size(); ++i) if(mems[i].Level == 0) nodes.push_back(i);
+
+    // measure the caches from one of their cores, and the nodes from one core of each node
+    AccessTimes guessed[4] = { {0.5, 0.5, 80}, {}, {0.1, 0.1, 4}, {0.2, 0.2, 15} };
+    vector<AccessTimes> cachetimes(mems.size());
+    vector<vector<AccessTimes>> nodetimes(mems.size(), vector<AccessTimes>(mems.size()));
+    for(std::size_t i = 0; i < mems.size(); ++i)
+    {
+        auto &mem = mems[i];
+        cachetimes[i] = guessed[std::min(mem.Level, 3)];
+        for(int from : nodes) nodetimes[from][i] = guessed[0], nodetimes[from][i].Latency *= (from == int(i)) ? 1 : 2;
+        if(!options.Calibrate) continue;
+
+        // half of a cache, such that it is not evicted by other data; main memory clearly larger than all caches
+        vector<std::uint64_t> buffer;
+        std::size_t nwords = std::max<long>(mem.Level ? mem.Size / 16 : 64 << 17, 1024);
+        RunOnCpu(firstcpu(i), [&]() { buffer.assign(nwords, 1); }); // first touch places the pages on the node
+        if(mem.Level)
+        {
+            RunOnCpu(firstcpu(i), [&]() { cachetimes[i] = MeasureAccess(buffer); });
+            gMsgUI.Verbose("HostPlatform: %s: read %.3f ns, write %.3f ns per word, latency %.1f ns", mem.Name.c_str(),
+                           cachetimes[i].Read, cachetimes[i].Write, cachetimes[i].Latency);
+            continue;
+        }
+        for(int from : nodes)
+        {
+            RunOnCpu(firstcpu(from), [&]() { nodetimes[from][i] = MeasureAccess(buffer); });
+            auto &times = nodetimes[from][i];
+            gMsgUI.Verbose("HostPlatform: %s from %s: read %.3f ns, write %.3f ns per word, latency %.1f ns",
+                           mem.Name.c_str(), mems[from].Name.c_str(), times.Read, times.Write, times.Latency);
+        }
+    }
+
+    // core types by maximum frequency, such that big and little cores differ
+    std::map<long, Platform::CoreType*> types;
+    for(auto &cpu : cpus) types[cpu.MaxFreq] = nullptr;
+    for(auto &entry : types)
+    {
+        Platform::CoreType type;
+        type.Name = (types.size() == 1) ? string("host") : strprintf("host-%ldMHz", entry.first / 1000);
+        entry.second = pf.AddCoreType(std::move(type));
+    }
+
+    for(auto &mem : mems)
+    {
+        Platform::Memory pfmem;
+        pfmem.Name = mem.Name;
+        pfmem.Size = int(std::min<long>(mem.Size, INT_MAX));
+        mem.pMem = pf.AddMemory(std::move(pfmem));
+    }
+    vector<Platform::DmaController*> copiers(mems.size(), nullptr);
+    for(int node : nodes)
+    {
+        Platform::DmaController dma;
+        dma.Name = mems[node].Name + ":copy";
+        copiers[node] = pf.AddDmaController(std::move(dma));
+    }
+
+    double scale = options.Scale;
+    auto nodeof = [&nodes, &mems](const HostMem & mem)
+    {
+        auto it = std::find_if(nodes.begin(), nodes.end(), [&](int node) { return mems[node].Node == mem.Node; });
+        return it == nodes.end() ? nodes.front() : *it;
+    };
+    for(auto &cpu : cpus)
+    {
+        Platform::Core core;
+        core.Name = strprintf("cpu%d", cpu.Id);
+        core.Type = types[cpu.MaxFreq];
+        auto *pcore = pf.AddCore(std::move(core));
+
+        int node = nodes.front();
+        for(int n : nodes) if(mems[n].Node == cpu.Node) node = n;
+        for(int cache : cpu.Caches)
+        {
+            auto &times = cachetimes[cache];
+            pf.AddEdge(pcore, mems[cache].pMem, ToCost(times.Read, scale), ToCost(times.Write, scale));
+        }
+        for(int n : nodes)
+        {
+            auto &times = nodetimes[node][n];
+            pf.AddEdge(pcore, mems[n].pMem, ToCost(times.Read, scale), ToCost(times.Write, scale));
+        }
+    }
+
+    // copies: between a cache and the memory of its node, and between nodes; per byte, the cost of reading the
+    // source and writing the target
+    auto addcopy = [&](int from, int to, const AccessTimes & fromtimes, const AccessTimes & totimes, int node)
+    {
+        pf.AddEdge(mems[from].pMem, mems[to].pMem, ToCost(fromtimes.Latency, scale),
+                   ToCost((fromtimes.Read + totimes.Write) / 8, scale), { copiers[node] });
+    };
+    for(std::size_t i = 0; i < mems.size(); ++i)
+    {
+        if(mems[i].Level == 0) continue;
+        int node = nodeof(mems[i]);
+        addcopy(i, node, cachetimes[i], nodetimes[node][node], node);
+        addcopy(node, i, nodetimes[node][node], cachetimes[i], node);
+    }
+    for(int from : nodes) for(int to : nodes)
+    {
+        if(from != to) addcopy(from, to, nodetimes[from][from], nodetimes[from][to], from);
+    }
+    return true;
+}
+
+}} // namespace Ladybirds::spec
@@ -0,0 +1,29 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_SPEC_HOSTPLATFORM_H
+#define LADYBIRDS_SPEC_HOSTPLATFORM_H
+
+#include "spec/platform.h"
+
+namespace Ladybirds {
+namespace spec {
+
+//! Options for BuildHostPlatform
+struct HostPlatformOptions
+{
+    double Scale = 1;       //!< Cost units per nanosecond (TraceCost measures task costs in nanoseconds)
+    bool Calibrate = true;  //!< Whether to measure the link costs; otherwise they are guessed from the memory level
+};
+
+//! Describes the machine we are running on in \p pf, which must be empty.
+/** The topology is read from Linux' sysfs: There is a core per logical CPU, with a core type per maximum clock
+ *  frequency (e.g. for big.LITTLE), and a memory per NUMA node and per shared L2 and L3 cache. The cores are linked to
+ *  their caches and to all NUMA nodes; the caches and nodes are connected by copy "DMA" links, each NUMA node having
+ *  a copy controller. Without sysfs, the platform has hardware_concurrency cores
+ *  sharing a single memory. The access costs are measured by streaming over a buffer of a suitable size with a thread
+ *  pinned to a core (a few milliseconds per cache and per pair of NUMA nodes). Returns false on errors. **/
+bool BuildHostPlatform(Platform & pf, const HostPlatformOptions & options);
+
+}} // namespace Ladybirds::spec
+
+#endif // LADYBIRDS_SPEC_HOSTPLATFORM_H
@@ -3,9 +3,13 @@
 #include "platform.h"
 
 #include <numeric>
+#include <queue>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 
 #include "graph/graph-extra.h"
+#include "tools.h"
 
 namespace Ladybirds {
 namespace spec {
@@ -35,19 +39,154 @@ bool Platform::DmaController::LoadStoreMembers(loadstore::LoadStore &ls)
     
 bool Platform::Memory::LoadStoreMembers(loadstore::LoadStore &ls)
 {
-    return ls.IO("name", Name) & ls.IO("size", Size, true, 0, 1);
+    return ls.IO("name", Name) & ls.IO("size", Size, true, 0, 1) & ls.IO("ports", Ports, false, 0, 0);
 }
 
 
+std::size_t Platform::GetHeapBytes() const
+{
+    std::size_t ret = CoreTypes_.size() * sizeof(CoreType) + Cores_.size() * sizeof(Core)
+                    + DmaControllers_.size() * sizeof(DmaController) + Memories_.size() * sizeof(Memory)
+                    + Groups_.size() * sizeof(Group) + Graph_.GetHeapBytes();
+    for(auto & type : CoreTypes_) ret += HeapBytes(type.Name);
+    for(auto & core : Cores_) ret += HeapBytes(core.Name) + core.Groups.size() * sizeof(Group*);
+    for(auto & dma : DmaControllers_) ret += HeapBytes(dma.Name);
+    for(auto & mem : Memories_) ret += HeapBytes(mem.Name) + mem.Groups.size() * sizeof(Group*);
+    for(auto & grp : Groups_) ret += HeapBytes(grp.GetCores()) + HeapBytes(grp.GetMemories());
+    for(auto & conn : Graph_.Edges()) ret += HeapBytes(conn.Controllers);
+    return ret;
+}
+
 const Platform::ConnMap & Platform::GetConnMap() const
 {
-    if(ConnMapVersion_ != Graph_.GetVersion())
+    return graph::cached::EdgeMatrix(Graph_);
+}
+
+namespace {
+struct RoutingKey {};
+} //namespace ::
+
+const Platform::Routing & Platform::GetRouting() const
+{
+    return Graph_.GetDerived<RoutingKey>([](const HwGraph & g) { return Routing(g); });
+}
+
+
+Platform::Routing::Routing(const HwGraph & g)
+{
+    std::vector<const ComponentNode*> memnodes;
+    for(auto &n : g.Nodes())
     {
-        ConnMap_ = graph::EdgeMatrix(Graph_);
-        ConnMapVersion_ = Graph_.GetVersion();
+        if(!n.pMem) continue;
+        if(std::size_t(n.pMem->Index) >= memnodes.size()) memnodes.resize(n.pMem->Index + 1, nullptr);
+        memnodes[n.pMem->Index] = &n;
     }
+    NumMems_ = memnodes.size();
+    NextHops_.assign(NumMems_*NumMems_, nullptr);
+    Costs_.assign(NumMems_*NumMems_, PathCost());
     
-    return ConnMap_;
+    // Dijkstra from each memory over the DMA connections, comparing costs by (PerByte, Fix)
+    auto less = [](const PathCost & a, const PathCost & b)
+        { return std::tie(a.PerByte, a.Fix) < std::tie(b.PerByte, b.Fix); };
+    using Entry = std::pair<PathCost, std::size_t>;
+    auto greater = [&less](const Entry & a, const Entry & b) { return less(b.first, a.first); };
+    std::vector<bool> done;
+    for(std::size_t from = 0; from < NumMems_; ++from)
+    {
+        if(!memnodes[from]) continue;
+        auto *pnexthops = &NextHops_[from*NumMems_];
+        auto *pcosts = &Costs_[from*NumMems_];
+        done.assign(NumMems_, false);
+        std::priority_queue<Entry, std::vector<Entry>, decltype(greater)> queue(greater);
+        queue.emplace(PathCost(), from);
+        while(!queue.empty())
+        {
+            auto entry = queue.top();
+            queue.pop();
+            auto cur = entry.second;
+            if(done[cur]) continue;
+            done[cur] = true;
+            
+            for(auto &conn : memnodes[cur]->OutEdges())
+            {
+                auto *ptarget = conn.GetTarget()->pMem;
+                if(!ptarget || conn.Controllers.empty() || done[ptarget->Index]) continue;
+                auto to = std::size_t(ptarget->Index);
+                
+                PathCost cost;
+                cost.Fix = entry.first.Fix + conn.FixCost, cost.PerByte = entry.first.PerByte + conn.WriteCost;
+                if(pnexthops[to] && !less(cost, pcosts[to])) continue;
+                pcosts[to] = cost;
+                pnexthops[to] = (cur == from) ? &conn : pnexthops[cur];
+                queue.emplace(cost, to);
+            }
+        }
+    }
+}
+
+void Platform::WriteScript(std::ostream & strm, const CostAdjustment & adjust) const
+{
+    std::unordered_map<const CoreType*, int> types;
+    strm << "local pf = Ladybirds.CreatePlatform();\nlocal types, cores, mems, dmas = {}, {}, {}, {};\n";
+    for(auto &type : CoreTypes_)
+    {
+        types[&type] = types.size() + 1;
+        strm << strprintf("types[%d] = pf:addcoretype{name=\"%s\"};\n", types[&type], type.Name.c_str());
+    }
+    for(auto &core : Cores_)
+    {
+        strm << strprintf("cores[%d] = pf:addcore{name=\"%s\", type=types[%d]};\n",
+                          core.Index + 1, core.Name.c_str(), types[core.Type]);
+    }
+    for(auto &mem : Memories_)
+        strm << strprintf("mems[%d] = pf:addmem{name=\"%s\", size=%d};\n", mem.Index + 1, mem.Name.c_str(), mem.Size);
+    for(auto &dma : DmaControllers_)
+        strm << strprintf("dmas[%d] = pf:adddma{name=\"%s\"};\n", dma.Index + 1, dma.Name.c_str());
+
+    for(auto &conn : Graph_.Edges())
+    {
+        int fixcost = conn.FixCost, readcost = conn.ReadCost, writecost = conn.WriteCost;
+        if(adjust) adjust(conn, fixcost, readcost, writecost);
+        if(conn.GetSource()->pCore)
+        {
+            strm << strprintf("pf:addlink{core=cores[%d], mem=mems[%d], readcost=%d, writecost=%d};\n",
+                              conn.GetSource()->pCore->Index + 1, conn.GetTarget()->pMem->Index + 1,
+                              readcost, writecost);
+            continue;
+        }
+        std::string controllers;
+        for(auto *pdma : conn.Controllers)
+            controllers += strprintf("%sdmas[%d]", controllers.empty() ? "" : ", ", pdma->Index + 1);
+        strm << strprintf("pf:adddmalink{from=mems[%d], to=mems[%d], controllers={%s}, fixcost=%d, writecost=%d};\n",
+                          conn.GetSource()->pMem->Index + 1, conn.GetTarget()->pMem->Index + 1, controllers.c_str(),
+                          fixcost, writecost);
+    }
+    for(auto &group : Groups_)
+    {
+        std::string cores, mems;
+        for(auto *pcore : group.GetCores())
+            cores += strprintf("%scores[%d]", cores.empty() ? "" : ", ", pcore->Index + 1);
+        for(auto *pmem : group.GetMemories())
+            mems += strprintf("%smems[%d]", mems.empty() ? "" : ", ", pmem->Index + 1);
+        strm << strprintf("pf:addgroup{cores={%s}, mems={%s}};\n", cores.c_str(), mems.c_str());
+    }
+    strm << "return pf;\n";
+}
+
+std::vector<const Platform::HwConnection*> Platform::Routing::GetRoute(const Memory & from, const Memory & to) const
+{
+    std::vector<const HwConnection*> ret;
+    // the hop count is bounded for safety: with connections without any cost, equally cheap routes could form a loop
+    auto *pcur = &from;
+    while(pcur != &to && ret.size() < NumMems_)
+    {
+        auto *phop = GetNextHop(*pcur, to);
+        if(!phop) return {};
+        ret.push_back(phop);
+        pcur = phop->GetTarget()->pMem;
+    }
+    if(pcur != &to) ret.clear();
+    return ret;
 }
 
 }} //namespace Ladybirds::spec
@@ -4,6 +4,8 @@
 #define LADYBIRDS_SPEC_PLATFORM_H
 
 #include <deque>
+#include <functional>
+#include <ostream>
 #include <string>
 #include <vector>
 
@@ -97,6 +99,9 @@ struct Platform : public loadstore::Referenceable
         ADD_CLASS_SIGNATURE(Memory);
         std::string Name;
         int Size;
+        /// Number of accesses (by cores or DMA transfers) the memory serves at full speed at the same time, 0 for
+        /// unlimited. More accesses share its bandwidth and slow down accordingly (cf. opt::Schedule).
+        int Ports = 0;
         ComponentNode *pNode;
         std::deque<Group*> Groups;
         int Index = -1;
@@ -133,6 +138,48 @@ struct Platform : public loadstore::Referenceable
     };
     
     using ConnMap = graph::ItemMap<graph::ItemMap<const spec::Platform::HwConnection *>>;
+    using HwGraph = graph::Graph<ComponentNode, graph::Version>;
+    
+    //! Cheapest routes for DMA transfers between all pairs of memories, possibly over several hops (cf. GetRouting)
+    /** On platforms without a direct connection between every pair of memories (e.g. NoC meshes), data is forwarded
+     *  through intermediate memories, each hop using the DMA controllers of its connection. Routes minimize the cost
+     *  per byte first and then the fix costs, i.e. they are the cheapest ones for large transfers. Instead of a map
+     *  between all graph nodes, only a table of the first hop and of the summed up costs is kept per pair of
+     *  memories. **/
+    class Routing
+    {
+    public:
+        //! Summed up costs of all hops of a route, such that the cost of a transfer is Fix + PerByte*nbytes
+        struct PathCost
+        {
+            long Fix = 0, PerByte = 0;
+            inline long For(long nbytes) const { return Fix + PerByte*nbytes; }
+        };
+        
+    private:
+        std::size_t NumMems_ = 0;
+        std::vector<const HwConnection*> NextHops_; ///< By Pos(); null if the memories are the same or unconnected
+        std::vector<PathCost> Costs_;               ///< By Pos()
+        
+    public:
+        explicit Routing(const HwGraph & g);
+        
+        //! Whether data can be transferred from \p from to \p to. Always true if they are the same.
+        inline bool IsReachable(const Memory & from, const Memory & to) const
+            { return &from == &to || NextHops_[Pos(from, to)]; }
+        //! The connection for the first hop from \p from to \p to; null if they are the same or unreachable
+        inline const HwConnection * GetNextHop(const Memory & from, const Memory & to) const
+            { return NextHops_[Pos(from, to)]; }
+        //! The connections of the route from \p from to \p to; empty if they are the same or unreachable
+        std::vector<const HwConnection*> GetRoute(const Memory & from, const Memory & to) const;
+        //! The costs of the route from \p from to \p to; only meaningful if IsReachable
+        inline const PathCost & GetCost(const Memory & from, const Memory & to) const
+            { return Costs_[Pos(from, to)]; }
+        
+    private:
+        inline std::size_t Pos(const Memory & from, const Memory & to) const
+            { return from.Index * NumMems_ + to.Index; }
+    };
     
 private:
     std::deque<CoreType> CoreTypes_;
@@ -140,9 +187,7 @@ private:
     std::deque<DmaController> DmaControllers_;
     std::deque<Memory> Memories_;
     std::deque<Group> Groups_;
-    graph::Graph<ComponentNode, graph::Version> Graph_;
-    mutable ConnMap ConnMap_;
-    mutable graph::Version ConnMapVersion_;
+    HwGraph Graph_;
     
 public:
     const auto &GetCoreTypes() const { return CoreTypes_;}
@@ -195,9 +240,21 @@ public:
         pconn->Controllers = std::move(dmas);
     }
     
+    /// Returns the bytes allocated for the components, their connections and names (cf. impl::MemStats). The data
+    /// derived from the platform on demand (GetConnMap, GetRouting) is not included.
+    std::size_t GetHeapBytes() const;
+    
     /// Returns a reference to a map for easily looking up connections from one node to another
     /** The returned reference is valid until this platform object is modified. **/
     const ConnMap & GetConnMap() const;
+    /// Returns the routes between all memories (cf. Routing)
+    /** The returned reference is valid until this platform object is modified. **/
+    const Routing & GetRouting() const;
+    
+    /// Callback for WriteScript, which may change the FixCost, ReadCost and WriteCost written for a connection
+    using CostAdjustment = std::function<void(const HwConnection &, int &, int &, int &)>;
+    /// Writes a Lua script that creates this platform with Ladybirds.CreatePlatform and returns it
+    void WriteScript(std::ostream & strm, const CostAdjustment & adjust = nullptr) const;
     
 };
 
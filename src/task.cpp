@@ -33,9 +33,14 @@ Iface::Iface(Task * ptask, const Iface & other)
 {
 }
 
+std::size_t Iface::GetHeapBytes() const
+{
+    return PosHint.GetHeapBytes();
+}
+
 int Iface::GetMemSize() const
 {
-    return Product(Dimensions_) * Packet_->GetBaseType().Size;
+    return Product(*Dimensions_) * Packet_->GetBaseType().Size;
 }
 
 Iface::BuddyList Iface::GetBuddies() const
@@ -51,26 +56,39 @@ Iface::BuddyList Iface::GetBuddies() const
 
 bool Iface::LoadStoreMembers(loadstore::LoadStore& ls)
 {
+    std::vector<gen::Range> poshint(PosHint.begin(), PosHint.end());
+    BufferDimVec bufferdims = *BufferDimsAdj_;
     std::string callparam = "(int[]){";
     if(ls.IsStoring())
     {
-        if(!BufferDimsAdj_.empty())
+        if(!bufferdims.empty())
         {
-            for(auto i = BufferDimsAdj_.size(); --i > 0; ) (callparam += std::to_string(BufferDimsAdj_[i])) += ", ";
-            (callparam += std::to_string(BufferDimsAdj_[0])) += '}';
+            for(auto i = bufferdims.size(); --i > 0; ) (callparam += std::to_string(bufferdims[i])) += ", ";
+            (callparam += std::to_string(bufferdims[0])) += '}';
         }
         else callparam += "0}";
     }
-    return ls.IORef("task", Task_)
+    bool ret = ls.IORef("task", Task_)
          & ls.IORef("packet", Packet_)
          & ls.IORef("buffer", Buffer_, false)
          & ls.IO("offset", BufferOffset_)
-         & ls.IO("bufferdims", BufferDimsAdj_)
-         & ls.IO("callparam", callparam, false);
+         & ls.IO("bufferdims", bufferdims)
+         & ls.IO("callparam", callparam, false)
+         & ls.IO("poshint", poshint, false)
+         & ls.IO("bufferhint", BufferHint, false, -1)
+         & ls.IO("reads", Reads, false)
+         & ls.IO("writes", Writes, false);
+    if(ls.IsLoading())
+    {
+        BufferDimsAdj_ = std::move(bufferdims);
+        PosHint.AsVector().assign(poshint.begin(), poshint.end());
+    }
+    return ret;
 }
 
 Task::Task ( const Task& other )
- : Kernel_(other.Kernel_), Params_(other.Params_), DerivedParams_(other.DerivedParams_), Name(other.Name)
+ : Kernel_(other.Kernel_), Params_(other.Params_), DerivedParams_(other.DerivedParams_), Name(other.Name),
+   Path(other.Path)
 {
     Ifaces.reserve(Kernel_->Packets.size());
     for(auto & oiface : other.Ifaces)
@@ -82,7 +100,9 @@ Task::Task ( const Task& other )
 Task::Task (Task&& other)
 : basenode(std::move(other)),
   Kernel_(other.Kernel_), Params_(std::move(other.Params_)), DerivedParams_(std::move(other.DerivedParams_)),
-  Name(std::move(other.Name)), Cost(other.Cost), Ifaces(std::move(other.Ifaces))
+  Name(std::move(other.Name)), Path(std::move(other.Path)), Cost(other.Cost), Wcet(other.Wcet),
+  TypeCosts(std::move(other.TypeCosts)), Family(other.Family), FamilyPos(other.FamilyPos),
+  Ifaces(std::move(other.Ifaces))
 {
     for(auto & iface : Ifaces) iface.Task_ = this;
 }
@@ -91,37 +111,100 @@ Task& Task::operator= ( Task&& other )
 {
     Kernel_ = other.Kernel_;
     Name = std::move(other.Name);
+    Path = std::move(other.Path);
     Params_ = std::move(other.Params_);
     DerivedParams_ = std::move(other.DerivedParams_);
     Ifaces = std::move(other.Ifaces);
     for(auto & iface : Ifaces) iface.Task_ = this;
     Cost = other.Cost;
+    Wcet = other.Wcet;
+    TypeCosts = std::move(other.TypeCosts);
+    Family = other.Family;
+    FamilyPos = other.FamilyPos;
     return *this;
 }
 
+std::size_t Task::GetHeapBytes() const
+{
+    std::size_t ret = HeapBytes(Params_) + HeapBytes(DerivedParams_) + HeapBytes(Name)
+                    + TypeCosts.bucket_count() * sizeof(void*);
+    for(auto & entry : TypeCosts) ret += sizeof(entry) + sizeof(void*) + HeapBytes(entry.first);
+    return ret;
+}
+
 
 bool Task::LoadStoreMembers(loadstore::LoadStore& ls)
 {
+    // a loaded task gets its full name as Name, without a Path
+    std::string fullname = ls.IsLoading() ? std::string() : GetFullName();
     if(!(ls.IORef("kernel", Kernel_)
-         & ls.IO("name", Name)
+         & ls.IO("name", ls.IsLoading() ? Name : fullname)
          & ls.IO("parameters", Params_, false)
-         & ls.IO("derivedparams", DerivedParams_, false))) return false;
+         & ls.IO("derivedparams", DerivedParams_, false)
+         & ls.IO("cost", Cost, false, 0, 0)
+         & ls.IO("wcet", Wcet, false, 0, 0)
+         & ls.IO("typecosts", TypeCosts, false, -DBL_MAX)
+         & ls.IO("family", Family, false, -1, -1)
+         & ls.IO("familypos", FamilyPos, false, 0, 0))) return false;
     
     if(ls.IsLoading())
     {
-        assert(false && "not supported");
-        //FillIfaces();
-        return true;
+        Path.reset();
+        Ifaces.clear();
+        FillIfaces();
     }
-    else 
+    return ls.IO_RegisterInPlace("ifaces", Ifaces);
+}
+
+std::string Task::GetFullName() const
+{
+    if(!Path) return Name;
+    std::string ret(Path->Length + 1 + Name.size(), '.');
+    size_t end = Path->Length;
+    ret.replace(end + 1, Name.size(), Name);
+    for(auto *ppath = Path.get(); ppath; ppath = ppath->Parent.get())
     {
-        return ls.IO_Register("ifaces", Ifaces);
+        end -= ppath->Name.size();
+        ret.replace(end, ppath->Name.size(), ppath->Name);
+        --end; // the '.' before it, if any
     }
+    return ret;
 }
 
-std::string Task::GetFullName() const
+
+bool TaskNameIndex::Add(Task & task)
+{
+    return Tasks_.emplace(Key(GetCanonical(task.Path.get()), task.Name), &task).second;
+}
+
+const TaskPath * TaskNameIndex::GetCanonical(const TaskPath * ppath)
+{
+    if(!ppath) return nullptr;
+    auto it = Canonical_.find(ppath);
+    if(it != Canonical_.end()) return it->second;
+    // different instances with the same full path (e.g. of ambiguous names) are the same node of the trie
+    auto *pcanonical = Paths_.emplace(Key(GetCanonical(ppath->Parent.get()), ppath->Name), ppath).first->second;
+    Canonical_[ppath] = pcanonical;
+    return pcanonical;
+}
+
+Task * TaskNameIndex::Find(const std::string & fullname) const
 {
-    return Name;
+    return Find(nullptr, fullname, 0);
+}
+
+Task * TaskNameIndex::Find(const TaskPath * ppath, const std::string & fullname, size_t pos) const
+{
+    auto it = Tasks_.find(Key(ppath, fullname.substr(pos)));
+    if(it != Tasks_.end()) return it->second;
+    // names may contain '.' themselves, so try every split into a path name and the rest
+    for(size_t dot = fullname.find('.', pos); dot != std::string::npos; dot = fullname.find('.', dot + 1))
+    {
+        auto itpath = Paths_.find(Key(ppath, fullname.substr(pos, dot - pos)));
+        if(itpath == Paths_.end()) continue;
+        if(auto *ptask = Find(itpath->second, fullname, dot + 1)) return ptask;
+    }
+    return nullptr;
 }
 
 void Task::FillIfaces()
@@ -137,10 +220,17 @@ void Task::FillIfaces()
     }
 }
 
+void Task::RebindKernel(Kernel * kernel)
+{
+    assert(kernel->Packets.size() == Ifaces.size());
+    Kernel_ = kernel;
+    for(size_t i = 0; i < Ifaces.size(); ++i) Ifaces[i].Packet_ = &kernel->Packets[i];
+}
+
 Iface* Task::GetIfaceByName(const std::string& name)
 {
-    return &*std::find_if(Ifaces.begin(), Ifaces.end(),
-        [&name](auto & iface) {return iface.GetName() == name;});
+    auto it = std::find_if(Ifaces.begin(), Ifaces.end(), [&name](auto & iface) {return iface.GetName() == name;});
+    return it != Ifaces.end() ? &*it : nullptr;
 }
 
 }}//namespace Ladybirds::spec
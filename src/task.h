@@ -6,9 +6,12 @@
 #include <ostream>
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "graph/arena.h"
 #include "graph/graph.h"
+#include "interned.h"
 #include "loadstore.h"
 #include "range.h"
 
@@ -39,11 +42,11 @@ public:
 private:
     Task * Task_ = nullptr;
     Packet * Packet_ = nullptr;
-    ArrayDimVec Dimensions_;
+    InternedDimVec Dimensions_; // interned, as all instances of a kernel share them
     impl::Buffer * Buffer_ = nullptr;
     
-    std::shared_ptr<const BufferDimVec> BufferDims_;
-    BufferDimVec BufferDimsAdj_;
+    InternedDimVec BufferDims_;
+    InternedDimVec BufferDimsAdj_;
     int BufferOffset_ = OffsetNA;
 
 public:
@@ -81,15 +84,14 @@ public:
     //! The dimensions of the buffer
     inline const BufferDimVec & GetBufferDims() const { return *BufferDims_; }
     //! The dimensions of the buffer, collapsed for this interface.
-    inline const BufferDimVec & GetBufferDimsAdj() const { return BufferDimsAdj_; }
+    inline const BufferDimVec & GetBufferDimsAdj() const { return *BufferDimsAdj_; }
     //! The offset denoting the position at which the packets produced/consumed by this interface are placed in the buffer
     inline int GetBufferOffset() const { return BufferOffset_; }
     //! Sets buffer, multiplication vector and offset (cf. GetBuffer, GetBufferDimsAdj and GetBufferOffset)
-    inline void SetBuffer(impl::Buffer * pt, std::shared_ptr<const BufferDimVec> dims,
-                           BufferDimVec dimsadj, int offset)
+    inline void SetBuffer(impl::Buffer * pt, InternedDimVec dims, InternedDimVec dimsadj, int offset)
     {
-        Buffer_ = pt; BufferDims_ = std::move(dims);
-        BufferDimsAdj_ = std::move(dimsadj); BufferOffset_ = offset;
+        Buffer_ = pt; BufferDims_ = dims;
+        BufferDimsAdj_ = dimsadj; BufferOffset_ = offset;
     }
     //! Replaces the buffer with a new one (e.g. when merging buffers)
     inline void RelocateBuffer(impl::Buffer * pt) { Buffer_ = pt; }
@@ -102,9 +104,11 @@ public:
     inline const Packet* GetPacket() const {return Packet_; }; ///< The packet which is expected/delivered on this iface
     //! The dimensions of the packet expected/delivered on this interface
     /**(for flexible kernels, this may vary between different instances)**/
-    inline const ArrayDimVec & GetDimensions() const { return Dimensions_; };
+    inline const ArrayDimVec & GetDimensions() const { return *Dimensions_; };
     int GetMemSize() const;
     BuddyList GetBuddies() const;
+    //! Bytes allocated on the heap for the position hint (cf. impl::MemStats); the dimensions are interned
+    std::size_t GetHeapBytes() const;
     
     virtual bool LoadStoreMembers(loadstore::LoadStore& ls) override;
 };
@@ -115,6 +119,19 @@ std::ostream & operator <<(std::ostream & strm, Iface & iface);
 
 class Task;
 using TaskDependency = graph::Edge<Task>;
+
+//! The path of nested meta-kernel instances a task was expanded from (cf. MetaKernel::Flatten). Shared by all tasks of
+//! an instance, such that the common prefixes of their full names (cf. Task::GetFullName) are stored only once.
+struct TaskPath
+{
+    std::shared_ptr<const TaskPath> Parent; ///< Path of the enclosing instance (null at the top level)
+    std::string Name;                       ///< Name of the instance
+    int Length;                             ///< Length of the full path, i.e. of the names joined by '.'
+    
+    TaskPath(std::shared_ptr<const TaskPath> parent, std::string name)
+        : Parent(std::move(parent)), Name(std::move(name)),
+          Length((Parent ? Parent->Length + 1 : 0) + (int) Name.size()) {}
+};
 using TaskGraph = graph::Graph<Task>;
 
 class Task : public graph::Node<TaskGraph, TaskDependency>, public loadstore::Referenceable
@@ -122,6 +139,10 @@ class Task : public graph::Node<TaskGraph, TaskDependency>, public loadstore::Re
     ADD_CLASS_SIGNATURE(Task);
     using basenode = graph::Node<TaskGraph, TaskDependency>;
     
+public:
+    /// The interface list is taken from the active arena (cf. graph::Arena), typically the one of the Program.
+    using IfaceList = std::vector<Iface, graph::ArenaAllocator<Iface>>;
+    
 private:
     Kernel * Kernel_ = nullptr;
 
@@ -129,10 +150,19 @@ private:
     std::vector<int> DerivedParams_;
     
 public:
-    std::string Name;
+    std::string Name; ///< Name within the innermost meta-kernel instance the task was expanded from (cf. Path)
+    std::shared_ptr<const TaskPath> Path; ///< That instance (null if the task was not expanded from one)
     double Cost = 0;
+    /// Worst-case execution time of the task (cf. LoadCost), for bounds that must be safe (cf. pass LatencyBound). Zero
+    /// if not known, in which case Cost is taken instead.
+    double Wcet = 0;
+    /// Costs on particular core types (by spec::Platform::CoreType::Name) that differ from Cost. A negative cost means
+    /// that the task cannot run on cores of that type.
+    std::unordered_map<std::string, double> TypeCosts;
+    int Family = -1;   ///< Index of the family of the task in Program::TaskFamilies (cf. TaskFamily), or -1
+    int FamilyPos = 0; ///< Position of the task in that family (cf. TaskFamily::GetIteration)
     
-    std::vector<Iface> Ifaces;
+    IfaceList Ifaces;
     
     impl::TaskGroup * Group = nullptr; //TODO: make this a propagate_const
     
@@ -150,13 +180,28 @@ public:
     //! Returns the kernel which this task is an instance of
     inline Kernel * GetKernel() { return Kernel_; }
     inline const Kernel * GetKernel() const { return Kernel_; }
+    //! Makes the task an instance of \p kernel instead, which must have the same interface as the current kernel
+    //! (e.g. its definition, if the task was created from a declaration). The interfaces are kept.
+    void RebindKernel(Kernel * kernel);
     
     //! Returns the parameters used for instantiating the kernel into this task
     inline const auto & GetParameters() const { return Params_; }
     //! Returns the derived parameters for this task
     /**(they are derived from the other parameters and required for variablearray dimensions)**/
     inline const auto & GetDerivedParameters() const { return DerivedParams_; }
+    //! Returns the name of the task, prefixed by the names of the instances in its path (joined by '.')
     std::string GetFullName() const;
+    //! Returns the cost of the task on a core of the type named \p coretype (TypeCosts, else Cost). It is negative if
+    //! the task cannot run there.
+    inline double GetCost(const std::string & coretype) const
+    {
+        auto it = TypeCosts.find(coretype);
+        return it == TypeCosts.end() ? Cost : it->second;
+    }
+    
+    //! Bytes allocated on the heap for the task, not counting the interfaces (which are taken from the arena, cf.
+    //! Iface::GetHeapBytes) and the path, which is shared with other tasks (cf. impl::MemStats)
+    std::size_t GetHeapBytes() const;
     
     Iface * GetIfaceByName(const std::string & name);
     inline const Iface * GetIfaceByName(const std::string & name) const
@@ -169,6 +214,33 @@ private:
 };
 
 
+//! Finds tasks by their full names (cf. Task::GetFullName) without building these names, by following the names in
+//! their paths like a trie
+class TaskNameIndex
+{
+    using Key = std::pair<const TaskPath*, std::string>;
+    struct KeyHash
+    {
+        inline size_t operator()(const Key & key) const
+            { return std::hash<const void*>()(key.first) * 31 + std::hash<std::string>()(key.second); }
+    };
+    
+    std::unordered_map<Key, const TaskPath*, KeyHash> Paths_; ///< Distinct paths by parent and name
+    std::unordered_map<const TaskPath*, const TaskPath*> Canonical_; ///< Representative in Paths_ of every path seen
+    std::unordered_map<Key, Task*, KeyHash> Tasks_;
+
+public:
+    //! Adds \p task to the index. Returns false if there is already a task with the same full name.
+    bool Add(Task & task);
+    //! Returns the task with the full name \p fullname, or nullptr if there is none
+    Task * Find(const std::string & fullname) const;
+    
+private:
+    const TaskPath * GetCanonical(const TaskPath * ppath);
+    Task * Find(const TaskPath * ppath, const std::string & fullname, size_t pos) const;
+};
+
+
 
 }}//namespace Ladybirds::spec
 
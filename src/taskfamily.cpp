@@ -0,0 +1,148 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#include "taskfamily.h"
+
+#include <algorithm>
+
+namespace Ladybirds { namespace spec {
+
+using gen::Space;
+
+namespace {
+/// \internal Returns \p pos displaced by the steps of \p shift for the iteration \p it
+Space Displace(Space pos, const TaskFamily::Shift & shift, const TaskFamily::Iteration & it)
+{
+    std::vector<int> displacement(pos.Dimensions(), 0);
+    for(size_t d = 0; d < it.size(); ++d)
+    {
+        auto & step = shift.Steps[d];
+        for(size_t k = 0; k < displacement.size(); ++k) displacement[k] += it[d] * step[k];
+    }
+    return pos.Displace(displacement);
+}
+} //namespace ::
+
+size_t TaskFamily::GetIterationCount() const
+{
+    size_t ret = 1;
+    for(int n : Domain) ret *= n;
+    return ret;
+}
+
+size_t TaskFamily::GetTaskPos(const Iteration & it, int templ) const
+{
+    assert(it.size() == Domain.size());
+    size_t linear = 0;
+    for(size_t d = 0; d < Domain.size(); ++d) linear = linear * Domain[d] + it[d];
+    return linear * Period + templ;
+}
+
+TaskFamily::Iteration TaskFamily::GetIteration(size_t pos, int * ptempl) const
+{
+    if(ptempl) *ptempl = pos % Period;
+    Iteration it(Domain.size());
+    size_t rest = pos / Period;
+    for(size_t d = Domain.size(); d-- > 0; )
+    {
+        it[d] = rest % Domain[d];
+        rest /= Domain[d];
+    }
+    return it;
+}
+
+Space TaskFamily::GetIfacePos(Space pos, const Iteration & it, int templ, int iface) const
+{
+    auto itshift = std::find_if(Shifts.begin(), Shifts.end(),
+                                [=](const Shift & s) { return s.Task == templ && s.Iface == iface; });
+    return itshift == Shifts.end() ? pos : Displace(std::move(pos), *itshift, it);
+}
+
+bool TaskFamily::Fit(const std::vector<std::unique_ptr<Task>> & tasks)
+{
+    Shifts.clear();
+    size_t count = GetTaskCount();
+    if(Period <= 0 || Domain.empty() || First + count > tasks.size()) return false;
+
+    // The steps of each loop, from the instances one iteration of that loop away from the template.
+    // shifts holds them for all interfaces of the template, firstshift the index of the first one of each task.
+    std::vector<Shift> shifts;
+    std::vector<size_t> firstshift(Period);
+    Iteration unit(Domain.size(), 0);
+    for(int t = 0; t < Period; ++t)
+    {
+        const Task & templ = *tasks[First + t];
+        firstshift[t] = shifts.size();
+        for(int i = 0, n = templ.Ifaces.size(); i < n; ++i)
+        {
+            const Space & pos = templ.Ifaces[i].PosHint;
+            shifts.push_back({t, i, {}});
+            for(size_t d = 0; d < Domain.size(); ++d)
+            {
+                std::vector<int> step(pos.Dimensions(), 0);
+                if(Domain[d] > 1)
+                {
+                    unit[d] = 1;
+                    const Task & next = *tasks[First + GetTaskPos(unit, t)];
+                    unit[d] = 0;
+                    if(next.Ifaces.size() != templ.Ifaces.size()) return false;
+                    const Space & nextpos = next.Ifaces[i].PosHint;
+                    if(nextpos.Dimensions() != pos.Dimensions()) return false;
+                    for(size_t k = 0; k < step.size(); ++k) step[k] = nextpos[k].first() - pos[k].first();
+                }
+                shifts.back().Steps.push_back(std::move(step));
+            }
+        }
+    }
+
+    // Now check all instances against the template
+    for(size_t pos = Period; pos < count; ++pos)
+    {
+        int t;
+        Iteration it = GetIteration(pos, &t);
+        const Task & templ = *tasks[First + t], & task = *tasks[First + pos];
+        if(task.GetKernel() != templ.GetKernel() || task.GetParameters() != templ.GetParameters()
+           || task.GetDerivedParameters() != templ.GetDerivedParameters() || task.Ifaces.size() != templ.Ifaces.size())
+        {
+            return false;
+        }
+        for(size_t i = 0; i < task.Ifaces.size(); ++i)
+        {
+            auto & iface = task.Ifaces[i], & templiface = templ.Ifaces[i];
+            if(iface.BufferHint != templiface.BufferHint
+               || iface.PosHint.Dimensions() != templiface.PosHint.Dimensions()
+               || iface.PosHint != Displace(templiface.PosHint, shifts[firstshift[t] + i], it))
+            {
+                return false;
+            }
+        }
+    }
+
+    auto moving = [](const Shift & s)
+    {
+        return std::any_of(s.Steps.begin(), s.Steps.end(),
+                           [](auto & step) { return std::any_of(step.begin(), step.end(), [](int n) { return n; }); });
+    };
+    for(auto & shift : shifts)
+    {
+        if(moving(shift)) Shifts.push_back(std::move(shift));
+    }
+    return true;
+}
+
+bool TaskFamily::Shift::LoadStoreMembers(loadstore::LoadStore & ls)
+{
+    return ls.IO("task", Task, true, 0, 0) & ls.IO("iface", Iface, true, 0, 0) & ls.IO("steps", Steps);
+}
+
+bool TaskFamily::LoadStoreMembers(loadstore::LoadStore & ls)
+{
+    int first = First;
+    bool ret = ls.IO("domain", Domain, true, 0)
+             & ls.IO("first", first, true, 0, 0)
+             & ls.IO("period", Period, true, 0, 0)
+             & ls.IO("shifts", Shifts);
+    if(ls.IsLoading()) First = first;
+    return ret;
+}
+
+}} // namespace Ladybirds::spec
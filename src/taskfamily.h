@@ -0,0 +1,65 @@
+// Copyright ETH Zurich, 2022. This code is under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+
+#ifndef LADYBIRDS_SPEC_TASKFAMILY_H
+#define LADYBIRDS_SPEC_TASKFAMILY_H
+
+#include <memory>
+#include <vector>
+#include "loadstore.h"
+#include "range.h"
+#include "task.h"
+
+namespace Ladybirds { namespace spec {
+
+//! The tasks created by a loop (or a nest of loops) over generator variables in a meta-kernel, described by the tasks
+//! of the first iteration (the template), the iteration domain and an affine map for the interface positions.
+/** All iterations consist of the same tasks as the template: same kernels and parameters, with the position of each
+ *  interface (Iface::PosHint) shifted by a fixed step for each loop. So passes can reason about a whole loop through
+ *  its template and only need to look at concrete instances (cf. GetTaskPos) where these differ, e.g. in their
+ *  mapping. The tasks are numbered iteration by iteration, the innermost loop running fastest. **/
+class TaskFamily : public loadstore::LoadStorableCompound
+{
+public:
+    using Iteration = std::vector<int>; ///< The value of each loop counter (from 0), outermost first
+
+    //! Shift of the position of interface \c Iface of template task \c Task for one iteration of each loop
+    struct Shift : public loadstore::LoadStorableCompound
+    {
+        int Task = 0, Iface = 0;
+        std::vector<std::vector<int>> Steps; ///< For each loop, the displacement in each dimension (cf. Space::Displace)
+
+        Shift() = default;
+        inline Shift(int task, int iface, std::vector<std::vector<int>> steps)
+            : Task(task), Iface(iface), Steps(std::move(steps)) {}
+        virtual bool LoadStoreMembers(loadstore::LoadStore & ls) override;
+    };
+
+    std::vector<int> Domain; ///< Number of iterations of each loop, outermost first
+    size_t First = 0;        ///< Index of the first task in the task list the family was found in (cf. Fit)
+    int Period = 0;          ///< Number of tasks of each iteration, i.e. of the template
+    std::vector<Shift> Shifts; ///< Only for the interfaces whose position changes between iterations
+
+public:
+    //! Returns the number of iterations, i.e. the product of the loop counts
+    size_t GetIterationCount() const;
+    //! Returns the number of tasks in the family
+    inline size_t GetTaskCount() const { return Period * GetIterationCount(); }
+
+    //! Returns the position in the family (from 0) of the instance of template task \p templ in iteration \p it
+    size_t GetTaskPos(const Iteration & it, int templ) const;
+    //! Returns the iteration of the task at position \p pos in the family, and stores its template in \p *ptempl
+    Iteration GetIteration(size_t pos, int * ptempl = nullptr) const;
+    //! Returns the position of interface \p iface of (the instance of) template task \p templ in iteration \p it,
+    //! given its position \p pos in the template
+    gen::Space GetIfacePos(gen::Space pos, const Iteration & it, int templ, int iface) const;
+
+    //! Checks whether \p tasks, from index First on, consist of instances of the first Period ones over the Domain,
+    //! and computes the Shifts. Returns false if the tasks differ in any other way.
+    bool Fit(const std::vector<std::unique_ptr<Task>> & tasks);
+
+    virtual bool LoadStoreMembers(loadstore::LoadStore & ls) override;
+};
+
+}} // namespace Ladybirds::spec
+
+#endif // LADYBIRDS_SPEC_TASKFAMILY_H
@@ -9,6 +9,7 @@
 #include "packet.h"
 #include "task.h"
 #include "buffer.h"
+#include "tools.h"
 
 using namespace Ladybirds::spec;
 
@@ -119,6 +120,19 @@ void TaskGroup::AddTask(TaskGroup::Task* task)
     if(Division_) Division_->InvalidateTasks();
 }
 
+void TaskGroup::RemoveTask(TaskGroup::Task* task)
+{
+    auto it = TaskMap_.find(task);
+    assert(it != TaskMap_.end());
+    int pos = it->second;
+    assert(Operations_[pos]->Inputs.empty() && Operations_[pos]->Outputs.empty());
+    TaskMap_.erase(it);
+    Operations_.erase(Operations_.begin() + pos);
+    for(auto & entry : TaskMap_) if(entry.second > pos) --entry.second;
+    if(task->Group == this) task->Group = nullptr;
+    if(Division_) Division_->InvalidateTasks();
+}
+
 
 void TaskGroup::Reorder(const std::vector<std::unique_ptr<Task>>& newOrder)
 {
@@ -241,6 +255,21 @@ void TaskGroup::PortCleanup()
     }
 }
 
+std::size_t TaskGroup::GetHeapBytes() const
+{
+    std::size_t ret = HeapBytes(Name_) + HeapBytes(Operations_) + TaskMap_.bucket_count() * sizeof(void*)
+                    + TaskMap_.size() * (sizeof(TaskMap_.begin()->first) + sizeof(int) + sizeof(void*));
+    for(auto & upop : Operations_)
+    {
+        ret += sizeof(Operation) + HeapBytes(upop->Inputs) + HeapBytes(upop->Outputs);
+        for(auto * pports : {&upop->Inputs, &upop->Outputs})
+        {
+            for(auto & upport : *pports) ret += sizeof(Port) + upport->Position.GetHeapBytes();
+        }
+    }
+    return ret;
+}
+
 TaskDivision::TaskDivision(TaskDivision &&other) : Groups_(std::move(other.Groups_))
 {
     for(auto * pg : Groups_) pg->Division_ = this;
@@ -260,6 +289,11 @@ bool TaskDivision::LoadStoreMembers(loadstore::LoadStore& ls)
          & ls.IORef("groups", Groups_);
 }
 
+std::size_t TaskDivision::GetHeapBytes() const
+{
+    return Buffers.GetHeapBytes() + HeapBytes(Groups_) + HeapBytes(Tasks_);
+}
+
 void TaskDivision::UpdateTasks() const
 {
     Tasks_.clear();
@@ -130,6 +130,8 @@ public:
     inline const OpList & GetOperations() { return Operations_; }
     
     void AddTask(Ladybirds::impl::TaskGroup::Task* task);
+    //! Removes \p task from the group (e.g. when it is deleted). Must be called before any ports are added.
+    void RemoveTask(Task* task);
     inline int GetTaskCount() const { return TaskMap_.size(); }
     
     virtual bool LoadStoreMembers(loadstore::LoadStore& ls) override;
@@ -151,6 +153,9 @@ public:
     //! The division this group belongs to (or nullptr)
     inline TaskDivision * GetDivision() { return Division_; }
     
+    //! Bytes allocated on the heap for the operations and their ports (cf. MemStats)
+    std::size_t GetHeapBytes() const;
+    
     inline void Bind(const Core *pc) { CoreBinding_ = pc; } ///< Bind this group to a given PE in a platform
     inline const Core* GetBinding() { return CoreBinding_; } ///< Retrieve the PE to which this group has been bound
 };
@@ -188,6 +193,8 @@ public:
     }
         
     inline void InvalidateTasks() { Tasks_.clear(); }
+    //! Bytes allocated on the heap for the buffers and the lists of groups and tasks (cf. MemStats)
+    std::size_t GetHeapBytes() const;
     
 private:
     void UpdateTasks() const;
@@ -29,7 +29,7 @@ int FlattenIndex(std::vector<int>::const_iterator indexBegin, std::vector<int>::
     return ret;
 }
 
-int FlattenIndex(std::vector<Range>::const_iterator indexBegin, std::vector<Range>::const_iterator indexEnd, 
+int FlattenIndex(Space::const_iterator indexBegin, Space::const_iterator indexEnd, 
                  std::vector<int>::const_iterator dimensionsBegin)
 {
     int ret = 0;
@@ -65,8 +65,8 @@ std::string IndexString(std::vector<int>::const_iterator begin, std::vector<int>
     return strm.str();
 }
 
-std::string IndexString(std::vector<Ladybirds::gen::Range>::const_iterator begin, 
-                        std::vector<Ladybirds::gen::Range>::const_iterator end)
+std::string IndexString(Ladybirds::gen::Space::const_iterator begin, 
+                        Ladybirds::gen::Space::const_iterator end)
 {
     std::stringstream strm;
     for(; begin != end; ++begin) strm << '[' << *begin << ']';
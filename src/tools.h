@@ -66,8 +66,8 @@ int FlattenIndex(std::vector<int>::const_iterator indexBegin, std::vector<int>::
 
 //!Given an array index vector and an array dimension vector (both in order of C array index – 0 leftmost, then 1, ...),
 //!this function converts the multi-dimensional index to a one-dimensional index.
-int FlattenIndex(std::vector<Ladybirds::gen::Range>::const_iterator indexBegin,
-                 std::vector<Ladybirds::gen::Range>::const_iterator indexEnd, 
+int FlattenIndex(Ladybirds::gen::Space::const_iterator indexBegin,
+                 Ladybirds::gen::Space::const_iterator indexEnd, 
                  std::vector<int>::const_iterator dimensionsBegin);
 
 //! Counterpart to \c FlattenIndex
@@ -77,8 +77,8 @@ std::vector<int> UnflattenIndex(int flatindex, std::vector<int>::const_iterator
 //!@{ Returns a string with a C array index for a vector or range of indices, e.g. "[1][2][3]" for {1, 2, 3}.
 std::string IndexString(std::vector<int>::const_iterator begin, std::vector<int>::const_iterator end);
 inline std::string IndexString(const std::vector<int> & index) {return IndexString(index.begin(), index.end()); }
-std::string IndexString(std::vector<Ladybirds::gen::Range>::const_iterator begin, 
-                        std::vector<Ladybirds::gen::Range>::const_iterator end);
+std::string IndexString(Ladybirds::gen::Space::const_iterator begin, 
+                        Ladybirds::gen::Space::const_iterator end);
 inline std::string IndexString(const Ladybirds::gen::Space & index)
     {return IndexString(index.begin(), index.end()); }
 //!@}
@@ -100,6 +100,14 @@ auto Sum(container_t &cont, callback_t cb)
     return ret;
 }
 
+//!@{ Returns the bytes allocated on the heap for the contents of a string or vector, not counting the object itself
+//! nor what the elements of the vector allocate (cf. impl::MemStats)
+inline std::size_t HeapBytes(const std::string & str)
+    { return str.capacity() > std::string().capacity() ? str.capacity() + 1 : 0; }
+template<typename t, typename alloc_t> inline std::size_t HeapBytes(const std::vector<t, alloc_t> & vec)
+    { return vec.capacity() * sizeof(t); }
+//!@}
+
 
 //! Clones a vector of unique_ptrs by cloning the objects pointed to
 template<typename T> std::vector<std::unique_ptr<T>> Clone(const std::vector<std::unique_ptr<T>> & vec)